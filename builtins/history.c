@@ -39,7 +39,7 @@ CHAR strHistoryHelpText[] =
         "\n"
         "HISTORY [-license] [-c|-l <file>|-n lines]\n"
         "\n"
-        "   -c             Clear current history\n"
+        "   -c             Clear current and saved history\n"
         "   -l             Load history from a file\n"
         "   -n             The number of lines of history to output\n"
         "   -u             Display a menu for the user to select a command\n";
@@ -516,6 +516,9 @@ YoriCmd_HISTORY(
         if (!YoriCallClearHistoryStrings()) {
             return EXIT_FAILURE;
         }
+        if (!YoriCallClearHistoryFile()) {
+            return EXIT_FAILURE;
+        }
     } else if (Op == HistoryLoadHistory) {
         YORI_STRING FileName;
         if (!YoriLibUserStringToSingleFilePath(SourceFile, TRUE, &FileName)) {
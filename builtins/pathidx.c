@@ -0,0 +1,148 @@
+/**
+ * @file builtins/pathidx.c
+ *
+ * Yori shell display statistics for the cache of PATH executables
+ *
+ * Copyright (c) 2018 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include <yoricall.h>
+
+/**
+ Help text to display to the user.
+ */
+const
+CHAR strPathIdxHelpText[] =
+        "\n"
+        "Displays how effectively the shell's cache of PATH directories is\n"
+        "resolving commands and tab completion.\n"
+        "\n"
+        "PATHIDX [-license]\n";
+
+/**
+ Display usage text to the user.
+ */
+BOOL
+PathIdxHelp(VOID)
+{
+    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("PathIdx %i.%02i\n"), YORI_VER_MAJOR, YORI_VER_MINOR);
+#if YORI_BUILD_ID
+    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("  Build %i\n"), YORI_BUILD_ID);
+#endif
+    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%hs"), strPathIdxHelpText);
+    return TRUE;
+}
+
+/**
+ Builtin command for displaying statistics about the cache of PATH
+ directories.
+
+ @param ArgC The number of arguments.
+
+ @param ArgV Pointer to the array of arguments.
+
+ @return Zero for success, nonzero on failure.
+ */
+DWORD
+YORI_BUILTIN_FN
+YoriCmd_PATHIDX(
+    __in YORI_ALLOC_SIZE_T ArgC,
+    __in YORI_STRING ArgV[]
+    )
+{
+    BOOL ArgumentUnderstood;
+    YORI_ALLOC_SIZE_T i;
+    YORI_STRING Arg;
+    YORI_LIB_PATH_INDEX_STATISTICS Stats;
+    DWORDLONG Probes;
+    DWORDLONG HitPercent;
+    DWORDLONG AverageLatency;
+
+    YoriLibLoadNtDllFunctions();
+    YoriLibLoadKernel32Functions();
+
+    for (i = 1; i < ArgC; i++) {
+
+        ArgumentUnderstood = FALSE;
+        ASSERT(YoriLibIsStringNullTerminated(&ArgV[i]));
+
+        if (YoriLibIsCommandLineOption(&ArgV[i], &Arg)) {
+
+            if (YoriLibCompareStringLitIns(&Arg, _T("?")) == 0) {
+                PathIdxHelp();
+                return EXIT_SUCCESS;
+            } else if (YoriLibCompareStringLitIns(&Arg, _T("license")) == 0) {
+                YoriLibDisplayMitLicense(_T("2018"));
+                return EXIT_SUCCESS;
+            }
+        }
+
+        if (!ArgumentUnderstood) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Argument not understood, ignored: %y\n"), &ArgV[i]);
+        }
+    }
+
+    ZeroMemory(&Stats, sizeof(Stats));
+    if (!YoriCallGetPathIndexStatistics(&Stats)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("pathidx: the shell is not caching PATH directories\n"));
+        return EXIT_FAILURE;
+    }
+
+    Probes = Stats.IndexProbes + Stats.FileSystemProbes;
+    HitPercent = 0;
+    if (Probes > 0) {
+        HitPercent = Stats.IndexProbes * 100 / Probes;
+    }
+
+    AverageLatency = 0;
+    if (Stats.Lookups > 0) {
+        AverageLatency = Stats.TotalLookupMicroseconds / Stats.Lookups;
+    }
+
+    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT,
+                  _T("Directories:       %i (%i cached, %i watched for changes)\n")
+                  _T("Files:             %i\n")
+                  _T("Lookups:           %lli\n")
+                  _T("Directory probes:  %lli from cache, %lli from file system (%lli%% hit rate)\n")
+                  _T("Enumerations:      %lli\n")
+                  _T("Changes detected:  %lli\n")
+                  _T("PATH changes:      %lli\n")
+                  _T("Lookup latency:    %lli us average, %lli us maximum\n"),
+                  Stats.DirectoryCount,
+                  Stats.DirectoriesPopulated,
+                  Stats.DirectoriesWatched,
+                  Stats.FileCount,
+                  Stats.Lookups,
+                  Stats.IndexProbes,
+                  Stats.FileSystemProbes,
+                  HitPercent,
+                  Stats.Enumerations,
+                  Stats.ChangesDetected,
+                  Stats.PathChanges,
+                  AverageLatency,
+                  Stats.MaximumLookupMicroseconds);
+
+    return EXIT_SUCCESS;
+}
+
+// vim:sw=4:ts=4:et:
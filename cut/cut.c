@@ -269,7 +269,6 @@ CutProcessStreamOffset(
     DWORD BufferSize;
     DWORD BufferDisplayOffset;
     DWORD BytesReturned;
-    DWORD BytesWritten;
     DWORD LengthToDisplay;
     DWORD FileType;
     LARGE_INTEGER StreamOffset;
@@ -363,7 +362,7 @@ CutProcessStreamOffset(
         //
 
         if (LengthToDisplay > 0) {
-            if (!WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), &Buffer[BufferDisplayOffset], LengthToDisplay, &BytesWritten, NULL)) {
+            if (!YoriLibWriteOutputDevice(GetStdHandle(STD_OUTPUT_HANDLE), &Buffer[BufferDisplayOffset], LengthToDisplay)) {
                 break;
             }
         }
@@ -666,6 +665,8 @@ ENTRYPOINT(
     YoriLibCancelEnable(FALSE);
 #endif
 
+    YoriLibEnableOutputBuffering(GetStdHandle(STD_OUTPUT_HANDLE));
+
     //
     //  Attempt to enable backup privilege so an administrator can access more
     //  objects successfully.
@@ -695,7 +695,6 @@ HexDumpReverseProcessStream(
     PVOID LineContext = NULL;
     YORI_STRING LineString;
     HANDLE OutputHandle;
-    DWORD BytesWritten;
     HEXDUMP_REVERSE_CONTEXT ReverseContext;
 
     YoriLibInitEmptyString(&LineString);
@@ -723,7 +722,7 @@ HexDumpReverseProcessStream(
             break;
         }
 
-        WriteFile(OutputHandle, ReverseContext.OutputBuffer, ReverseContext.BytesThisLine, &BytesWritten, NULL);
+        YoriLibWriteOutputDevice(OutputHandle, ReverseContext.OutputBuffer, ReverseContext.BytesThisLine);
 
         if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
             break;
@@ -929,7 +928,6 @@ HexDumpBinaryProcessStream(
     PVOID LineContext = NULL;
     YORI_STRING LineString;
     HANDLE OutputHandle;
-    DWORD BytesWritten;
     DWORDLONG LineNumber;
     HEXDUMP_REVERSE_CONTEXT ReverseContext;
     YORI_ALLOC_SIZE_T ErrorChar;
@@ -995,7 +993,7 @@ HexDumpBinaryProcessStream(
         }
 
         if (ReverseContext.BytesThisLine > 0) {
-            WriteFile(OutputHandle, ReverseContext.OutputBuffer, ReverseContext.BytesThisLine, &BytesWritten, NULL);
+            YoriLibWriteOutputDevice(OutputHandle, ReverseContext.OutputBuffer, ReverseContext.BytesThisLine);
         }
 
         if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
@@ -1855,6 +1853,13 @@ ENTRYPOINT(
     YoriLibCancelEnable(FALSE);
 #endif
 
+    //
+    //  Each line of a dump is a separate write, so if the output is going to
+    //  a file or pipe, collect them into larger writes.
+    //
+
+    YoriLibEnableOutputBuffering(GetStdHandle(STD_OUTPUT_HANDLE));
+
     //
     //  Attempt to enable backup privilege so an administrator can access more
     //  objects successfully.
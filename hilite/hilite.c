@@ -95,6 +95,13 @@ typedef struct _HILITE_MATCH_CRITERIA {
      The color to apply to the line, in event of a match.
      */
     YORILIB_COLOR_ATTRIBUTES Color;
+
+    /**
+     For a contains match, the index of this match's string within the
+     ContainsStrings array, or YORI_MAX_ALLOC_SIZE if it is not searched
+     for.
+     */
+    YORI_ALLOC_SIZE_T ContainsIndex;
 } HILITE_MATCH_CRITERIA, *PHILITE_MATCH_CRITERIA;
 
 /**
@@ -145,6 +152,18 @@ typedef struct _HILITE_CONTEXT {
      */
     YORI_LIST_ENTRY EndMatches;
 
+    /**
+     An array of the strings of each contains match, in the order of
+     MiddleMatches.
+     */
+    PYORI_STRING ContainsStrings;
+
+    /**
+     A matcher to search for all of the strings in ContainsStrings in a
+     single pass over each line.
+     */
+    YORI_LIB_MULTI_MATCH ContainsMatcher;
+
 } HILITE_CONTEXT, *PHILITE_CONTEXT;
 
 /**
@@ -214,6 +233,64 @@ HiliteGetNextMatch(
     return NULL;
 }
 
+/**
+ Prepare to search for the strings of all contains matches at once, rather
+ than searching each line for each string separately.
+
+ @param HiliteContext Pointer to the context, which has been populated with
+        all of the user's criteria.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+HilitePrepareContainsMatches(
+    __inout PHILITE_CONTEXT HiliteContext
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PHILITE_MATCH_CRITERIA MatchCriteria;
+    YORI_ALLOC_SIZE_T ContainsCount;
+
+    ContainsCount = 0;
+    ListEntry = YoriLibGetNextListEntry(&HiliteContext->MiddleMatches, NULL);
+    while (ListEntry != NULL) {
+        ContainsCount++;
+        ListEntry = YoriLibGetNextListEntry(&HiliteContext->MiddleMatches, ListEntry);
+    }
+
+    if (ContainsCount == 0) {
+        return TRUE;
+    }
+
+    HiliteContext->ContainsStrings = YoriLibMalloc(ContainsCount * sizeof(YORI_STRING));
+    if (HiliteContext->ContainsStrings == NULL) {
+        return FALSE;
+    }
+
+    //
+    //  When highlighting matching text, an empty string is never
+    //  highlighted, so don't search for it.
+    //
+
+    ContainsCount = 0;
+    ListEntry = YoriLibGetNextListEntry(&HiliteContext->MiddleMatches, NULL);
+    while (ListEntry != NULL) {
+        MatchCriteria = CONTAINING_RECORD(ListEntry, HILITE_MATCH_CRITERIA, ListEntry);
+        ASSERT(MatchCriteria->MatchType == HiliteMatchTypeContains);
+        if (HiliteContext->HighlightMatchText && MatchCriteria->MatchString.LengthInChars == 0) {
+            MatchCriteria->ContainsIndex = YORI_MAX_ALLOC_SIZE;
+        } else {
+            MatchCriteria->ContainsIndex = ContainsCount;
+            memcpy(&HiliteContext->ContainsStrings[ContainsCount], &MatchCriteria->MatchString, sizeof(YORI_STRING));
+            ContainsCount++;
+        }
+        ListEntry = YoriLibGetNextListEntry(&HiliteContext->MiddleMatches, ListEntry);
+    }
+
+    YoriLibInitializeMultiMatch(&HiliteContext->ContainsMatcher, ContainsCount, HiliteContext->ContainsStrings, HiliteContext->Insensitive);
+    return TRUE;
+}
+
 /**
  Process a stream and apply the hilite criteria before outputting to standard
  output.
@@ -233,6 +310,8 @@ HiliteProcessStream(
 {
     PVOID LineContext = NULL;
     CONSOLE_SCREEN_BUFFER_INFO ScreenInfo;
+    YORI_LIB_LINE_BATCH Batch;
+    YORI_ALLOC_SIZE_T BatchIndex;
     YORI_STRING LineString;
     YORI_STRING Substring;
     YORI_STRING DisplayString;
@@ -241,23 +320,43 @@ HiliteProcessStream(
     YORI_ALLOC_SIZE_T BestMatchOffset;
     YORILIB_COLOR_ATTRIBUTES ColorToUse;
     PYORI_LIST_ENTRY ListHead;
+    PYORI_STRING ContainsFound;
+    YORI_ALLOC_SIZE_T ContainsOffset;
+    BOOLEAN ContainsSearched;
     BOOLEAN MatchFound;
     BOOLEAN AnyMatchFound;
     YORI_ALLOC_SIZE_T MatchOffset;
 
+    YoriLibInitializeLineBatch(&Batch);
+    BatchIndex = 0;
     YoriLibInitEmptyString(&LineString);
     YoriLibInitEmptyString(&Substring);
     YoriLibInitEmptyString(&DisplayString);
     MatchOffset = 0;
+    ContainsFound = NULL;
+    ContainsOffset = 0;
 
     HiliteContext->FilesFound++;
 
     while (TRUE) {
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
-            break;
+        //
+        //  Read lines in batches, which avoids copying each line
+        //  individually, and process one line from the batch in each
+        //  iteration.
+        //
+
+        if (BatchIndex >= Batch.LineCount) {
+            if (!YoriLibReadLineBatch(&Batch, &LineContext, hSource)) {
+                break;
+            }
+            BatchIndex = 0;
         }
 
+        LineString.StartOfString = Batch.Lines[BatchIndex].Line.StartOfString;
+        LineString.LengthInChars = Batch.Lines[BatchIndex].Line.LengthInChars;
+        BatchIndex++;
+
         Substring.StartOfString = LineString.StartOfString;
         Substring.LengthInChars = LineString.LengthInChars;
         ColorToUse.Ctrl = HiliteContext->DefaultColor.Ctrl;
@@ -275,6 +374,7 @@ HiliteProcessStream(
             BestMatchCriteria = NULL;
             BestMatchOffset = 0;
             AnyMatchFound = FALSE;
+            ContainsSearched = FALSE;
             if (Substring.StartOfString == LineString.StartOfString) {
                 ListHead = &HiliteContext->StartMatches;
             } else {
@@ -321,14 +421,29 @@ HiliteProcessStream(
                         }
                     }
                 } else if (MatchCriteria->MatchType == HiliteMatchTypeContains) {
-                    if (HiliteContext->Insensitive) {
-                        if (YoriLibFindFirstMatchSubstrIns(&Substring, 1, &MatchCriteria->MatchString, &MatchOffset)) {
-                            MatchFound = TRUE;
-                        }
-                    } else {
-                        if (YoriLibFindFirstMatchSubstr(&Substring, 1, &MatchCriteria->MatchString, &MatchOffset)) {
-                            MatchFound = TRUE;
+
+                    //
+                    //  Search for all of the contains strings the first time
+                    //  one is encountered.  When highlighting text, the
+                    //  earliest match in the line is the only one that
+                    //  can be used; when highlighting lines, the first
+                    //  criteria that matches is used.
+                    //
+
+                    if (!ContainsSearched) {
+                        if (HiliteContext->HighlightMatchText) {
+                            ContainsFound = YoriLibFindFirstMultiMatch(&HiliteContext->ContainsMatcher, &Substring, &ContainsOffset);
+                        } else {
+                            ContainsFound = YoriLibFindLowestMultiMatch(&HiliteContext->ContainsMatcher, &Substring, &ContainsOffset);
                         }
+                        ContainsSearched = TRUE;
+                    }
+
+                    if (ContainsFound != NULL &&
+                        (YORI_ALLOC_SIZE_T)(ContainsFound - HiliteContext->ContainsStrings) == MatchCriteria->ContainsIndex) {
+
+                        MatchFound = TRUE;
+                        MatchOffset = ContainsOffset;
                     }
                 }
 
@@ -432,7 +547,7 @@ HiliteProcessStream(
     }
 
     YoriLibLineReadCloseOrCache(LineContext);
-    YoriLibFreeStringContents(&LineString);
+    YoriLibFreeLineBatch(&Batch);
 
     return TRUE;
 }
@@ -576,6 +691,12 @@ HiliteCleanupContext(
         YoriLibFree(MatchCriteria);
         MatchCriteria = NextMatchCriteria;
     }
+
+    YoriLibCleanupMultiMatch(&HiliteContext->ContainsMatcher);
+    if (HiliteContext->ContainsStrings != NULL) {
+        YoriLibFree(HiliteContext->ContainsStrings);
+        HiliteContext->ContainsStrings = NULL;
+    }
 }
 
 
@@ -725,6 +846,11 @@ ENTRYPOINT(
         }
     }
 
+    if (!HilitePrepareContainsMatches(&HiliteContext)) {
+        HiliteCleanupContext(&HiliteContext);
+        return EXIT_FAILURE;
+    }
+
     //
     //  Attempt to enable backup privilege so an administrator can access more
     //  objects successfully.
@@ -245,6 +245,43 @@ YoriCallBuiltinUnregister(
 }
 
 
+/**
+ Prototype for the @ref YoriApiClearHistoryFile function.
+ */
+typedef BOOL YORI_API_CLEAR_HISTORY_FILE(VOID);
+
+/**
+ Prototype for a pointer to the @ref YoriApiClearHistoryFile function.
+ */
+typedef YORI_API_CLEAR_HISTORY_FILE *PYORI_API_CLEAR_HISTORY_FILE;
+
+/**
+ Pointer to the @ref YoriApiClearHistoryFile function.
+ */
+PYORI_API_CLEAR_HISTORY_FILE pYoriApiClearHistoryFile;
+
+/**
+ Remove all commands from the file that the shell saves history to.
+
+ @return TRUE if the history file was successfully cleared, FALSE if not.
+ */
+__success(return)
+BOOL
+YoriCallClearHistoryFile(VOID)
+{
+    if (pYoriApiClearHistoryFile == NULL) {
+        HMODULE hYori;
+
+        hYori = GetModuleHandle(NULL);
+        __analysis_assume(hYori != NULL);
+        pYoriApiClearHistoryFile = (PYORI_API_CLEAR_HISTORY_FILE)GetProcAddress(hYori, "YoriApiClearHistoryFile");
+        if (pYoriApiClearHistoryFile == NULL) {
+            return FALSE;
+        }
+    }
+    return pYoriApiClearHistoryFile();
+}
+
 /**
  Prototype for the @ref YoriApiClearHistoryStrings function.
  */
@@ -985,6 +1022,49 @@ YoriCallGetNextJobId(
     return pYoriApiGetNextJobId(PreviousJobId);
 }
 
+/**
+ Prototype for the @ref YoriApiGetPathIndexStatistics function.
+ */
+typedef BOOL YORI_API_GET_PATH_INDEX_STATISTICS(PYORI_LIB_PATH_INDEX_STATISTICS);
+
+/**
+ Prototype for a pointer to the @ref YoriApiGetPathIndexStatistics function.
+ */
+typedef YORI_API_GET_PATH_INDEX_STATISTICS *PYORI_API_GET_PATH_INDEX_STATISTICS;
+
+/**
+ Pointer to the @ref YoriApiGetPathIndexStatistics function.
+ */
+PYORI_API_GET_PATH_INDEX_STATISTICS pYoriApiGetPathIndexStatistics;
+
+/**
+ Return counters describing the shell's cache of executables found in PATH
+ directories.
+
+ @param Statistics On successful completion, populated with the counters.
+
+ @return TRUE to indicate success, or FALSE if the shell is not caching
+         PATH directories.
+ */
+__success(return)
+BOOL
+YoriCallGetPathIndexStatistics(
+    __out PYORI_LIB_PATH_INDEX_STATISTICS Statistics
+    )
+{
+    if (pYoriApiGetPathIndexStatistics == NULL) {
+        HMODULE hYori;
+
+        hYori = GetModuleHandle(NULL);
+        __analysis_assume(hYori != NULL);
+        pYoriApiGetPathIndexStatistics = (PYORI_API_GET_PATH_INDEX_STATISTICS)GetProcAddress(hYori, "YoriApiGetPathIndexStatistics");
+        if (pYoriApiGetPathIndexStatistics == NULL) {
+            return FALSE;
+        }
+    }
+    return pYoriApiGetPathIndexStatistics(Statistics);
+}
+
 /**
  Prototype for the @ref YoriApiGetSystemAliasStrings function.
  */
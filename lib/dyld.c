@@ -145,6 +145,7 @@ YoriLibLoadNtDllFunctions(VOID)
     DllNtDll.pNtQueryObject = (PNT_QUERY_OBJECT)GetProcAddress(DllNtDll.hDll, "NtQueryObject");
     DllNtDll.pNtQuerySymbolicLinkObject = (PNT_QUERY_SYMBOLIC_LINK_OBJECT)GetProcAddress(DllNtDll.hDll, "NtQuerySymbolicLinkObject");
     DllNtDll.pNtQuerySystemInformation = (PNT_QUERY_SYSTEM_INFORMATION)GetProcAddress(DllNtDll.hDll, "NtQuerySystemInformation");
+    DllNtDll.pNtQueryVolumeInformationFile = (PNT_QUERY_VOLUME_INFORMATION_FILE)GetProcAddress(DllNtDll.hDll, "NtQueryVolumeInformationFile");
     DllNtDll.pNtSetInformationFile = (PNT_SET_INFORMATION_FILE)GetProcAddress(DllNtDll.hDll, "NtSetInformationFile");
     DllNtDll.pNtSystemDebugControl = (PNT_SYSTEM_DEBUG_CONTROL)GetProcAddress(DllNtDll.hDll, "NtSystemDebugControl");
     DllNtDll.pRtlGetLastNtStatus = (PRTL_GET_LAST_NT_STATUS)GetProcAddress(DllNtDll.hDll, "RtlGetLastNtStatus");
@@ -168,6 +169,7 @@ CONST YORI_DLL_NAME_MAP DllKernel32Symbols[] = {
     {(FARPROC *)&DllKernel32.pCreateHardLinkW, "CreateHardLinkW"},
     {(FARPROC *)&DllKernel32.pCreateJobObjectW, "CreateJobObjectW"},
     {(FARPROC *)&DllKernel32.pCreateSymbolicLinkW, "CreateSymbolicLinkW"},
+    {(FARPROC *)&DllKernel32.pFindFirstFileExW, "FindFirstFileExW"},
     {(FARPROC *)&DllKernel32.pFindFirstStreamW, "FindFirstStreamW"},
     {(FARPROC *)&DllKernel32.pFindFirstVolumeW, "FindFirstVolumeW"},
     {(FARPROC *)&DllKernel32.pFindNextStreamW, "FindNextStreamW"},
@@ -216,6 +218,7 @@ CONST YORI_DLL_NAME_MAP DllKernel32Symbols[] = {
     {(FARPROC *)&DllKernel32.pQueryFullProcessImageNameW, "QueryFullProcessImageNameW"},
     {(FARPROC *)&DllKernel32.pQueryInformationJobObject, "QueryInformationJobObject"},
     {(FARPROC *)&DllKernel32.pRegisterApplicationRestart, "RegisterApplicationRestart"},
+    {(FARPROC *)&DllKernel32.pReOpenFile, "ReOpenFile"},
     {(FARPROC *)&DllKernel32.pReplaceFileW, "ReplaceFileW"},
     {(FARPROC *)&DllKernel32.pRtlCaptureStackBackTrace, "RtlCaptureStackBackTrace"},
     {(FARPROC *)&DllKernel32.pSetConsoleDisplayMode, "SetConsoleDisplayMode"},
@@ -29,7 +29,20 @@
 
 
 /**
- Allocate an empty hash table.
+ The average number of entries per bucket which causes a hash table to be
+ resized.
+ */
+#define YORI_HASH_TABLE_MAX_LOAD (2)
+
+/**
+ The number of buckets to move from the previous bucket array each time an
+ entry is inserted while a hash table is being resized.
+ */
+#define YORI_HASH_TABLE_REHASH_BUCKETS (4)
+
+/**
+ Allocate an empty hash table.  The table grows automatically as entries
+ are inserted, so the number of buckets is only the initial size.
 
  @param NumberBuckets The number of buckets to allocate into the hash table.
 
@@ -56,6 +69,10 @@ YoriLibAllocateHashTable(
 
     HashTable->NumberBuckets = NumberBuckets;
     HashTable->Buckets = (PYORI_HASH_BUCKET)(HashTable + 1);
+    HashTable->EntryCount = 0;
+    HashTable->OldNumberBuckets = 0;
+    HashTable->OldBuckets = NULL;
+    HashTable->RehashIndex = 0;
 
     for (BucketIndex = 0; BucketIndex < NumberBuckets; BucketIndex++) {
         YoriLibInitializeListHead(&HashTable->Buckets[BucketIndex].ListHead);
@@ -64,6 +81,25 @@ YoriLibAllocateHashTable(
     return HashTable;
 }
 
+/**
+ Free an array of hash buckets, unless it is the array that was allocated
+ along with the hash table.
+
+ @param HashTable Pointer to the hash table.
+
+ @param Buckets Pointer to the array of buckets to free.
+ */
+VOID
+YoriLibHashFreeBuckets(
+    __in PYORI_HASH_TABLE HashTable,
+    __in PYORI_HASH_BUCKET Buckets
+    )
+{
+    if (Buckets != (PYORI_HASH_BUCKET)(HashTable + 1)) {
+        YoriLibFree(Buckets);
+    }
+}
+
 /**
  Free a hash table.  This assumes the caller has already removed and
  performed all necessary cleanup for any objects within it.
@@ -81,8 +117,18 @@ YoriLibFreeEmptyHashTable(
     for (BucketIndex = 0; BucketIndex < HashTable->NumberBuckets; BucketIndex++) {
         ASSERT(YoriLibGetNextListEntry(&HashTable->Buckets[BucketIndex].ListHead, NULL) == NULL);
     }
+    if (HashTable->OldBuckets != NULL) {
+        for (BucketIndex = 0; BucketIndex < HashTable->OldNumberBuckets; BucketIndex++) {
+            ASSERT(YoriLibGetNextListEntry(&HashTable->OldBuckets[BucketIndex].ListHead, NULL) == NULL);
+        }
+    }
+    ASSERT(HashTable->EntryCount == 0);
 #endif
 
+    if (HashTable->OldBuckets != NULL) {
+        YoriLibHashFreeBuckets(HashTable, HashTable->OldBuckets);
+    }
+    YoriLibHashFreeBuckets(HashTable, HashTable->Buckets);
     YoriLibDereference(HashTable);
 }
 
@@ -124,29 +170,135 @@ YoriLibHashString32(
 }
 
 /**
- Hash a yori string into a 16 bit hash value.
+ Hash a yori string into a 32 bit hash value used to select a bucket.  The
+ hash is case insensitive, since keys are compared case insensitively.
+ This is an FNV-1a hash of each upcased character, followed by a final mix
+ so that every bit of the result depends on every character, allowing the
+ low bits to be used as a bucket index.
 
  @param String The string to generate a hash for.
 
- @return A 16 bit hash value for the string.
+ @return A 32 bit hash value for the string.
  */
-WORD
+DWORD
 YoriLibHashString(
     __in PCYORI_STRING String
     )
 {
     DWORD Hash;
-    Hash = YoriLibHashString32(0, String);
+    YORI_ALLOC_SIZE_T Index;
 
-    //
-    //  Move some high bits into the low bits since the low bits
-    //  will likely be used as a bucket index.  Note we're moving
-    //  bits 16 here and 3 above (ie., not divisible and won't
-    //  cancel out.)
-    //
+    Hash = 0x811c9dc5;
+    for (Index = 0; Index < String->LengthInChars; Index++) {
+        Hash = (Hash ^ YoriLibUpcaseChar(String->StartOfString[Index])) * 0x01000193;
+    }
 
     Hash = Hash ^ (Hash >> 16);
-    return (WORD)Hash;
+    Hash = Hash * 0x85ebca6b;
+    Hash = Hash ^ (Hash >> 13);
+    Hash = Hash * 0xc2b2ae35;
+    Hash = Hash ^ (Hash >> 16);
+
+    return Hash;
+}
+
+/**
+ Move entries from the previous bucket array of a hash table that is being
+ resized into the current bucket array.  When every bucket has been moved,
+ the previous bucket array is freed.
+
+ @param HashTable Pointer to the hash table.
+
+ @param BucketCount The number of previous buckets to move.
+ */
+VOID
+YoriLibHashRehashBuckets(
+    __in PYORI_HASH_TABLE HashTable,
+    __in YORI_ALLOC_SIZE_T BucketCount
+    )
+{
+    PYORI_HASH_BUCKET OldBucket;
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_LIST_ENTRY ListEntry;
+    DWORD BucketIndex;
+
+    while (BucketCount > 0 && HashTable->RehashIndex < HashTable->OldNumberBuckets) {
+        OldBucket = &HashTable->OldBuckets[HashTable->RehashIndex];
+        ListEntry = YoriLibGetNextListEntry(&OldBucket->ListHead, NULL);
+        while (ListEntry != NULL) {
+            HashEntry = CONTAINING_RECORD(ListEntry, YORI_HASH_ENTRY, ListEntry);
+            YoriLibRemoveListItem(ListEntry);
+            BucketIndex = HashEntry->Hash % HashTable->NumberBuckets;
+            YoriLibInsertList(&HashTable->Buckets[BucketIndex].ListHead, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&OldBucket->ListHead, NULL);
+        }
+
+        HashTable->RehashIndex++;
+        BucketCount--;
+    }
+
+    if (HashTable->RehashIndex == HashTable->OldNumberBuckets) {
+        YoriLibHashFreeBuckets(HashTable, HashTable->OldBuckets);
+        HashTable->OldBuckets = NULL;
+        HashTable->OldNumberBuckets = 0;
+        HashTable->RehashIndex = 0;
+    }
+}
+
+/**
+ Prepare a hash table for the insertion of an entry.  If the table is being
+ resized, this moves some buckets into the new bucket array.  If the table
+ has too many entries for its buckets, this starts resizing it.  Resizing
+ is spread across later insertions so that no single insertion needs to
+ move every entry.  If memory cannot be allocated, the table continues to
+ operate with its existing buckets.
+
+ @param HashTable Pointer to the hash table.
+ */
+VOID
+YoriLibHashGrowIfNeeded(
+    __in PYORI_HASH_TABLE HashTable
+    )
+{
+    PYORI_HASH_BUCKET NewBuckets;
+    DWORD NewNumberBuckets;
+    DWORD SizeNeeded;
+    DWORD BucketIndex;
+
+    if (HashTable->OldBuckets != NULL) {
+        YoriLibHashRehashBuckets(HashTable, YORI_HASH_TABLE_REHASH_BUCKETS);
+        return;
+    }
+
+    if (HashTable->EntryCount <= HashTable->NumberBuckets * YORI_HASH_TABLE_MAX_LOAD) {
+        return;
+    }
+
+    NewNumberBuckets = HashTable->NumberBuckets * 2 + 1;
+    SizeNeeded = NewNumberBuckets * sizeof(YORI_HASH_BUCKET);
+    if (NewNumberBuckets < HashTable->NumberBuckets ||
+        SizeNeeded / sizeof(YORI_HASH_BUCKET) != NewNumberBuckets ||
+        !YoriLibIsSizeAllocatable(SizeNeeded)) {
+
+        return;
+    }
+
+    NewBuckets = YoriLibMalloc((YORI_ALLOC_SIZE_T)SizeNeeded);
+    if (NewBuckets == NULL) {
+        return;
+    }
+
+    for (BucketIndex = 0; BucketIndex < NewNumberBuckets; BucketIndex++) {
+        YoriLibInitializeListHead(&NewBuckets[BucketIndex].ListHead);
+    }
+
+    HashTable->OldBuckets = HashTable->Buckets;
+    HashTable->OldNumberBuckets = HashTable->NumberBuckets;
+    HashTable->RehashIndex = 0;
+    HashTable->Buckets = NewBuckets;
+    HashTable->NumberBuckets = (YORI_ALLOC_SIZE_T)NewNumberBuckets;
+
+    YoriLibHashRehashBuckets(HashTable, YORI_HASH_TABLE_REHASH_BUCKETS);
 }
 
 /**
@@ -170,13 +322,56 @@ YoriLibHashInsertByKey(
     __out PYORI_HASH_ENTRY HashEntry
     )
 {
-    DWORD BucketIndex = YoriLibHashString(KeyString) % HashTable->NumberBuckets;
+    DWORD BucketIndex;
+
+    YoriLibHashGrowIfNeeded(HashTable);
+
+    HashEntry->Hash = YoriLibHashString(KeyString);
+    BucketIndex = HashEntry->Hash % HashTable->NumberBuckets;
 
     YoriLibCloneString(&HashEntry->Key, KeyString);
     HashEntry->Context = Context;
+    HashEntry->HashTable = HashTable;
+    HashTable->EntryCount++;
     YoriLibInsertList(&HashTable->Buckets[BucketIndex].ListHead, &HashEntry->ListEntry);
 }
 
+/**
+ Search a hash bucket for an entry matching a specified key.
+
+ @param Bucket Pointer to the bucket to search.
+
+ @param KeyString Pointer to the key to identify the object.
+
+ @param Hash The hash of KeyString.
+
+ @return Pointer to the entry within the hash table if a match is found.
+         If no match is found, returns NULL.
+ */
+PYORI_HASH_ENTRY
+YoriLibHashLookupInBucket(
+    __in PYORI_HASH_BUCKET Bucket,
+    __in PCYORI_STRING KeyString,
+    __in DWORD Hash
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_HASH_ENTRY HashEntry;
+
+    ListEntry = YoriLibGetNextListEntry(&Bucket->ListHead, NULL);
+    while (ListEntry != NULL) {
+        HashEntry = CONTAINING_RECORD(ListEntry, YORI_HASH_ENTRY, ListEntry);
+        if (HashEntry->Hash == Hash &&
+            YoriLibCompareStringIns(KeyString, &HashEntry->Key) == 0) {
+
+            return HashEntry;
+        }
+        ListEntry = YoriLibGetNextListEntry(&Bucket->ListHead, ListEntry);
+    }
+
+    return NULL;
+}
+
 /**
  Locate an object within the hash table by a specified key.
 
@@ -193,22 +388,115 @@ YoriLibHashLookupByKey(
     __in PCYORI_STRING KeyString
     )
 {
-    DWORD BucketIndex = YoriLibHashString(KeyString) % HashTable->NumberBuckets;
-    PYORI_LIST_ENTRY ListEntry;
+    DWORD Hash;
+    DWORD BucketIndex;
     PYORI_HASH_ENTRY HashEntry;
 
-    HashEntry = NULL;
-    ListEntry = YoriLibGetNextListEntry(&HashTable->Buckets[BucketIndex].ListHead, NULL);
-    while (ListEntry != NULL) {
-        HashEntry = CONTAINING_RECORD(ListEntry, YORI_HASH_ENTRY, ListEntry);
-        if (YoriLibCompareStringIns(KeyString, &HashEntry->Key) == 0) {
+    Hash = YoriLibHashString(KeyString);
+
+    //
+    //  If the table is being resized, the entry may not have been moved
+    //  from the previous buckets yet.
+    //
+
+    if (HashTable->OldBuckets != NULL) {
+        BucketIndex = Hash % HashTable->OldNumberBuckets;
+        if (BucketIndex >= HashTable->RehashIndex) {
+            HashEntry = YoriLibHashLookupInBucket(&HashTable->OldBuckets[BucketIndex], KeyString, Hash);
+            if (HashEntry != NULL) {
+                return HashEntry;
+            }
+        }
+    }
+
+    BucketIndex = Hash % HashTable->NumberBuckets;
+    return YoriLibHashLookupInBucket(&HashTable->Buckets[BucketIndex], KeyString, Hash);
+}
+
+/**
+ Return the next entry in a hash table.  Entries are returned in no
+ particular order.  Entries must not be inserted or removed while the table
+ is being enumerated, except that an entry may be removed once the entry
+ following it has been returned.
+
+ @param HashTable Pointer to the hash table to enumerate.
+
+ @param PreviousEntry Pointer to the entry returned from the previous call
+        to this function, or NULL to return the first entry.
+
+ @return Pointer to the next entry, or NULL if all entries have been
+         returned.
+ */
+PYORI_HASH_ENTRY
+YoriLibHashGetNextEntry(
+    __in PYORI_HASH_TABLE HashTable,
+    __in_opt PYORI_HASH_ENTRY PreviousEntry
+    )
+{
+    PYORI_HASH_BUCKET Buckets;
+    PYORI_LIST_ENTRY ListEntry;
+    DWORD NumberBuckets;
+    DWORD BucketIndex;
+    BOOLEAN InOldBuckets;
+
+    //
+    //  Entries in the previous bucket array are returned first, followed
+    //  by entries in the current bucket array.  Find the array and bucket
+    //  containing the previous entry, and the entry following it.
+    //
+
+    ListEntry = NULL;
+    if (PreviousEntry == NULL) {
+        InOldBuckets = TRUE;
+        BucketIndex = HashTable->RehashIndex;
+    } else {
+        InOldBuckets = FALSE;
+        if (HashTable->OldBuckets != NULL) {
+            BucketIndex = PreviousEntry->Hash % HashTable->OldNumberBuckets;
+            if (BucketIndex >= HashTable->RehashIndex) {
+                InOldBuckets = TRUE;
+            }
+        }
+
+        if (InOldBuckets) {
+            Buckets = HashTable->OldBuckets;
+        } else {
+            Buckets = HashTable->Buckets;
+            BucketIndex = PreviousEntry->Hash % HashTable->NumberBuckets;
+        }
+
+        ListEntry = YoriLibGetNextListEntry(&Buckets[BucketIndex].ListHead, &PreviousEntry->ListEntry);
+        if (ListEntry != NULL) {
+            return CONTAINING_RECORD(ListEntry, YORI_HASH_ENTRY, ListEntry);
+        }
+        BucketIndex++;
+    }
+
+    while (TRUE) {
+        if (InOldBuckets) {
+            Buckets = HashTable->OldBuckets;
+            NumberBuckets = HashTable->OldNumberBuckets;
+        } else {
+            Buckets = HashTable->Buckets;
+            NumberBuckets = HashTable->NumberBuckets;
+        }
+
+        for (; BucketIndex < NumberBuckets; BucketIndex++) {
+            ListEntry = YoriLibGetNextListEntry(&Buckets[BucketIndex].ListHead, NULL);
+            if (ListEntry != NULL) {
+                return CONTAINING_RECORD(ListEntry, YORI_HASH_ENTRY, ListEntry);
+            }
+        }
+
+        if (!InOldBuckets) {
             break;
         }
-        HashEntry = NULL;
-        ListEntry = YoriLibGetNextListEntry(&HashTable->Buckets[BucketIndex].ListHead, ListEntry);
+
+        InOldBuckets = FALSE;
+        BucketIndex = 0;
     }
 
-    return HashEntry;
+    return NULL;
 }
 
 /**
@@ -222,6 +510,9 @@ YoriLibHashRemoveByEntry(
     __in PYORI_HASH_ENTRY HashEntry
     )
 {
+    ASSERT(HashEntry->HashTable->EntryCount > 0);
+    HashEntry->HashTable->EntryCount--;
+    HashEntry->HashTable = NULL;
     YoriLibRemoveListItem(&HashEntry->ListEntry);
     YoriLibFreeStringContents(&HashEntry->Key);
 }
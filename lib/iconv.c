@@ -135,6 +135,310 @@ YoriLibSetMultibyteInputEncoding(
     YoriLibActiveInputEncodingInitialized = TRUE;
 }
 
+/**
+ The character used in place of a sequence that cannot be converted.
+ */
+#define YORI_LIB_REPLACEMENT_CHAR (0xFFFD)
+
+/**
+ A DWORD_PTR with every byte set to one.
+ */
+#define YORI_LIB_ICONV_BYTE_ONES ((DWORD_PTR)-1 / 0xFF)
+
+/**
+ A DWORD_PTR with every 16 bit value set to one.
+ */
+#define YORI_LIB_ICONV_WCHAR_ONES ((DWORD_PTR)-1 / 0xFFFF)
+
+/**
+ Convert a UTF8 string into UTF16.  Sequences which are not valid UTF8,
+ including overlong forms, encoded surrogates and values above U+10FFFF,
+ are replaced with U+FFFD.  Each maximal prefix of a valid sequence is
+ replaced with a single U+FFFD, consistent with the Unicode recommended
+ practice used by current versions of Windows.  Runs of ASCII are converted
+ a machine word at a time.
+
+ @param Input Pointer to the UTF8 string.
+
+ @param InputLength The length of Input, in bytes.
+
+ @param Output Optionally points to a buffer to receive the UTF16 string.
+        If NULL, the number of characters needed is returned.
+
+ @param OutputLength The length of Output, in characters.  If the buffer is
+        too small, conversion stops at the last complete character that
+        fits.
+
+ @return The number of characters written to Output, or the number of
+         characters required if Output is NULL.
+ */
+YORI_ALLOC_SIZE_T
+YoriLibUtf8ToUtf16(
+    __in_ecount(InputLength) LPCSTR Input,
+    __in YORI_ALLOC_SIZE_T InputLength,
+    __out_ecount_opt(OutputLength) LPTSTR Output,
+    __in YORI_ALLOC_SIZE_T OutputLength
+    )
+{
+    CONST UCHAR *Src;
+    YORI_ALLOC_SIZE_T SrcIndex;
+    YORI_ALLOC_SIZE_T DestIndex;
+    YORI_ALLOC_SIZE_T Consumed;
+    YORI_ALLOC_SIZE_T ByteIndex;
+    YORI_ALLOC_SIZE_T ContinuationCount;
+    DWORD_PTR Word;
+    DWORD CodePoint;
+    UCHAR Lead;
+    UCHAR Next;
+    UCHAR Lower;
+    UCHAR Upper;
+
+    Src = (CONST UCHAR *)Input;
+    SrcIndex = 0;
+    DestIndex = 0;
+
+    while (SrcIndex < InputLength) {
+
+        //
+        //  If this is aligned and the next word is ASCII, widen it without
+        //  inspecting each byte.
+        //
+
+        if (((DWORD_PTR)&Src[SrcIndex] & (sizeof(DWORD_PTR) - 1)) == 0) {
+            while (SrcIndex + sizeof(DWORD_PTR) <= InputLength) {
+                Word = *(PDWORD_PTR)&Src[SrcIndex];
+                if ((Word & (YORI_LIB_ICONV_BYTE_ONES * 0x80)) != 0) {
+                    break;
+                }
+                if (Output != NULL) {
+                    if (DestIndex + sizeof(DWORD_PTR) > OutputLength) {
+                        break;
+                    }
+                    for (ByteIndex = 0; ByteIndex < sizeof(DWORD_PTR); ByteIndex++) {
+                        Output[DestIndex + ByteIndex] = Src[SrcIndex + ByteIndex];
+                    }
+                }
+                SrcIndex = SrcIndex + sizeof(DWORD_PTR);
+                DestIndex = DestIndex + sizeof(DWORD_PTR);
+            }
+
+            if (SrcIndex >= InputLength) {
+                break;
+            }
+        }
+
+        Lead = Src[SrcIndex];
+        if (Lead < 0x80) {
+            if (Output != NULL) {
+                if (DestIndex + 1 > OutputLength) {
+                    break;
+                }
+                Output[DestIndex] = Lead;
+            }
+            SrcIndex++;
+            DestIndex++;
+            continue;
+        }
+
+        //
+        //  Determine the number of continuation bytes and the valid range of
+        //  the first continuation byte, which excludes overlong forms,
+        //  surrogates and values above U+10FFFF.
+        //
+
+        Lower = 0x80;
+        Upper = 0xBF;
+        if (Lead >= 0xC2 && Lead <= 0xDF) {
+            ContinuationCount = 1;
+        } else if (Lead >= 0xE0 && Lead <= 0xEF) {
+            ContinuationCount = 2;
+            if (Lead == 0xE0) {
+                Lower = 0xA0;
+            } else if (Lead == 0xED) {
+                Upper = 0x9F;
+            }
+        } else if (Lead >= 0xF0 && Lead <= 0xF4) {
+            ContinuationCount = 3;
+            if (Lead == 0xF0) {
+                Lower = 0x90;
+            } else if (Lead == 0xF4) {
+                Upper = 0x8F;
+            }
+        } else {
+            ContinuationCount = 0;
+        }
+
+        CodePoint = Lead & (0x3F >> ContinuationCount);
+        Consumed = 1;
+        while (Consumed <= ContinuationCount && SrcIndex + Consumed < InputLength) {
+            Next = Src[SrcIndex + Consumed];
+            if (Next < Lower || Next > Upper) {
+                break;
+            }
+            CodePoint = (CodePoint << 6) | (Next & 0x3F);
+            Consumed++;
+            Lower = 0x80;
+            Upper = 0xBF;
+        }
+
+        if (ContinuationCount == 0 || Consumed <= ContinuationCount) {
+            CodePoint = YORI_LIB_REPLACEMENT_CHAR;
+        }
+
+        if (CodePoint >= 0x10000) {
+            if (Output != NULL) {
+                if (DestIndex + 2 > OutputLength) {
+                    break;
+                }
+                CodePoint = CodePoint - 0x10000;
+                Output[DestIndex] = (TCHAR)(0xD800 + (CodePoint >> 10));
+                Output[DestIndex + 1] = (TCHAR)(0xDC00 + (CodePoint & 0x3FF));
+            }
+            DestIndex = DestIndex + 2;
+        } else {
+            if (Output != NULL) {
+                if (DestIndex + 1 > OutputLength) {
+                    break;
+                }
+                Output[DestIndex] = (TCHAR)CodePoint;
+            }
+            DestIndex++;
+        }
+
+        SrcIndex = SrcIndex + Consumed;
+    }
+
+    return DestIndex;
+}
+
+/**
+ Convert a UTF16 string into UTF8.  Surrogates which are not part of a valid
+ pair are replaced with U+FFFD.  Runs of ASCII are converted a machine word
+ at a time.
+
+ @param Input Pointer to the UTF16 string.
+
+ @param InputLength The length of Input, in characters.
+
+ @param Output Optionally points to a buffer to receive the UTF8 string.  If
+        NULL, the number of bytes needed is returned.
+
+ @param OutputLength The length of Output, in bytes.  If the buffer is too
+        small, conversion stops at the last complete character that fits.
+
+ @return The number of bytes written to Output, or the number of bytes
+         required if Output is NULL.
+ */
+YORI_ALLOC_SIZE_T
+YoriLibUtf16ToUtf8(
+    __in_ecount(InputLength) LPCTSTR Input,
+    __in YORI_ALLOC_SIZE_T InputLength,
+    __out_ecount_opt(OutputLength) LPSTR Output,
+    __in YORI_ALLOC_SIZE_T OutputLength
+    )
+{
+    YORI_ALLOC_SIZE_T SrcIndex;
+    YORI_ALLOC_SIZE_T DestIndex;
+    YORI_ALLOC_SIZE_T CharIndex;
+    YORI_ALLOC_SIZE_T BytesNeeded;
+    DWORD_PTR Word;
+    DWORD CodePoint;
+    TCHAR Char;
+
+    SrcIndex = 0;
+    DestIndex = 0;
+
+    while (SrcIndex < InputLength) {
+
+        //
+        //  If this is aligned and the next word is ASCII, narrow it without
+        //  inspecting each character.
+        //
+
+        if (((DWORD_PTR)&Input[SrcIndex] & (sizeof(DWORD_PTR) - 1)) == 0) {
+            while (SrcIndex + sizeof(DWORD_PTR) / sizeof(TCHAR) <= InputLength) {
+                Word = *(PDWORD_PTR)&Input[SrcIndex];
+                if ((Word & (YORI_LIB_ICONV_WCHAR_ONES * 0xFF80)) != 0) {
+                    break;
+                }
+                if (Output != NULL) {
+                    if (DestIndex + sizeof(DWORD_PTR) / sizeof(TCHAR) > OutputLength) {
+                        break;
+                    }
+                    for (CharIndex = 0; CharIndex < sizeof(DWORD_PTR) / sizeof(TCHAR); CharIndex++) {
+                        Output[DestIndex + CharIndex] = (CHAR)Input[SrcIndex + CharIndex];
+                    }
+                }
+                SrcIndex = SrcIndex + sizeof(DWORD_PTR) / sizeof(TCHAR);
+                DestIndex = DestIndex + sizeof(DWORD_PTR) / sizeof(TCHAR);
+            }
+
+            if (SrcIndex >= InputLength) {
+                break;
+            }
+        }
+
+        Char = Input[SrcIndex];
+        SrcIndex++;
+        CodePoint = Char;
+
+        if (Char >= 0xD800 && Char <= 0xDBFF) {
+            if (SrcIndex < InputLength &&
+                Input[SrcIndex] >= 0xDC00 &&
+                Input[SrcIndex] <= 0xDFFF) {
+
+                CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (Input[SrcIndex] - 0xDC00);
+                SrcIndex++;
+            } else {
+                CodePoint = YORI_LIB_REPLACEMENT_CHAR;
+            }
+        } else if (Char >= 0xDC00 && Char <= 0xDFFF) {
+            CodePoint = YORI_LIB_REPLACEMENT_CHAR;
+        }
+
+        if (CodePoint < 0x80) {
+            BytesNeeded = 1;
+        } else if (CodePoint < 0x800) {
+            BytesNeeded = 2;
+        } else if (CodePoint < 0x10000) {
+            BytesNeeded = 3;
+        } else {
+            BytesNeeded = 4;
+        }
+
+        if (Output != NULL) {
+            if (DestIndex + BytesNeeded > OutputLength) {
+                break;
+            }
+
+            switch(BytesNeeded) {
+                case 1:
+                    Output[DestIndex] = (CHAR)CodePoint;
+                    break;
+                case 2:
+                    Output[DestIndex] = (CHAR)(0xC0 | (CodePoint >> 6));
+                    Output[DestIndex + 1] = (CHAR)(0x80 | (CodePoint & 0x3F));
+                    break;
+                case 3:
+                    Output[DestIndex] = (CHAR)(0xE0 | (CodePoint >> 12));
+                    Output[DestIndex + 1] = (CHAR)(0x80 | ((CodePoint >> 6) & 0x3F));
+                    Output[DestIndex + 2] = (CHAR)(0x80 | (CodePoint & 0x3F));
+                    break;
+                default:
+                    Output[DestIndex] = (CHAR)(0xF0 | (CodePoint >> 18));
+                    Output[DestIndex + 1] = (CHAR)(0x80 | ((CodePoint >> 12) & 0x3F));
+                    Output[DestIndex + 2] = (CHAR)(0x80 | ((CodePoint >> 6) & 0x3F));
+                    Output[DestIndex + 3] = (CHAR)(0x80 | (CodePoint & 0x3F));
+                    break;
+            }
+        }
+
+        DestIndex = DestIndex + BytesNeeded;
+    }
+
+    return DestIndex;
+}
+
 /**
  Returns the number of bytes needed to store a specified UTF16 string in
  the current output encoding.
@@ -156,6 +460,9 @@ YoriLibGetMbyteOutputSizeNeeded(
     if (Encoding == CP_UTF16) {
         return BufferLength * sizeof(WCHAR);
     }
+    if (Encoding == CP_UTF8) {
+        return YoriLibUtf16ToUtf8(StringBuffer, BufferLength, NULL, 0);
+    }
     Return = WideCharToMultiByte(Encoding, 0, StringBuffer, BufferLength, NULL, 0, NULL, NULL);
     ASSERT(Return > 0 || BufferLength == 0);
     ASSERT(YoriLibIsSizeAllocatable(Return));
@@ -198,6 +505,10 @@ YoriLibMultibyteOutput(
         }
         return;
     }
+    if (Encoding == CP_UTF8) {
+        YoriLibUtf16ToUtf8(InputStringBuffer, InputBufferLength, OutputStringBuffer, OutputBufferLength);
+        return;
+    }
     Return = WideCharToMultiByte(Encoding,
                                  0,
                                  InputStringBuffer,
@@ -234,6 +545,9 @@ YoriLibGetMultibyteInputSizeNeeded(
     if (Encoding == CP_UTF16) {
         return BufferLength;
     }
+    if (Encoding == CP_UTF8) {
+        return YoriLibUtf8ToUtf16(StringBuffer, BufferLength, NULL, 0);
+    }
     Return = MultiByteToWideChar(Encoding, 0, StringBuffer, BufferLength, NULL, 0);
     ASSERT(YoriLibIsSizeAllocatable(Return));
     return (YORI_ALLOC_SIZE_T)Return;
@@ -268,6 +582,10 @@ YoriLibMultibyteInput(
         }
         return;
     }
+    if (Encoding == CP_UTF8) {
+        YoriLibUtf8ToUtf16(InputStringBuffer, InputBufferLength, OutputStringBuffer, OutputBufferLength);
+        return;
+    }
     Return = MultiByteToWideChar(Encoding,
                                  0,
                                  InputStringBuffer,
@@ -66,6 +66,35 @@ typedef struct _YORI_LIB_LINE_READ_CONTEXT {
      */
     DWORD FileType;
 
+    /**
+     If the stream is a disk file being read through mapped views, a handle
+     to the file mapping.  In this case PreviousBuffer refers to the mapped
+     view, BytesInBuffer and LengthOfBuffer are the length of the view, and
+     CurrentBufferOffset is the offset within the view.  NULL if data is
+     read into an allocated PreviousBuffer.
+     */
+    HANDLE MappingHandle;
+
+    /**
+     If the stream is being read through mapped views, a second handle to
+     the file which denies write access to other opens, so that the file
+     cannot be modified or truncated while it is mapped.  The file mapping
+     is created from this handle.  NULL if the file is not mapped.
+     */
+    HANDLE ReadOnlyHandle;
+
+    /**
+     The offset within the file of the beginning of the mapped view.  Only
+     meaningful if MappingHandle is not NULL.
+     */
+    DWORDLONG ViewFileOffset;
+
+    /**
+     The size of the file when it was mapped.  Only meaningful if
+     MappingHandle is not NULL.
+     */
+    DWORDLONG FileSize;
+
     /**
      If TRUE, the read operation is performed on 16 bit characters.  If FALSE,
      the input contains 8 bit characters.  Unlike most other encodings, this
@@ -314,9 +343,39 @@ YoriLibReadLineAllocateContext(VOID)
     }
     ReadContext->PreviousBuffer = NULL;
     ReadContext->LengthOfBuffer = 0;
+    ReadContext->MappingHandle = NULL;
+    ReadContext->ReadOnlyHandle = NULL;
     return ReadContext;
 }
 
+/**
+ Close any mapped view and file mapping used by a line read context.  On
+ completion, the context has no buffer.
+
+ @param ReadContext Pointer to the line read context.
+ */
+VOID
+YoriLibLineReadUnmapFile(
+    __inout PYORI_LIB_LINE_READ_CONTEXT ReadContext
+    )
+{
+    if (ReadContext->MappingHandle == NULL) {
+        return;
+    }
+
+    if (ReadContext->PreviousBuffer != NULL) {
+        UnmapViewOfFile(ReadContext->PreviousBuffer);
+    }
+    CloseHandle(ReadContext->MappingHandle);
+    CloseHandle(ReadContext->ReadOnlyHandle);
+    ReadContext->MappingHandle = NULL;
+    ReadContext->ReadOnlyHandle = NULL;
+    ReadContext->PreviousBuffer = NULL;
+    ReadContext->LengthOfBuffer = 0;
+    ReadContext->BytesInBuffer = 0;
+    ReadContext->CurrentBufferOffset = 0;
+}
+
 /**
  Close a line read context, and store it in the cache if there is an
  available slot for it.  After using this routine, a caller is expected to
@@ -334,6 +393,15 @@ YoriLibLineReadCloseOrCache(
         PYORI_LIB_LINE_READ_CONTEXT OldContext;
         DWORD ProbeIndex;
 
+        //
+        //  A mapped view refers to the file being closed, so only the
+        //  context itself can be reused.
+        //
+
+        if (ReadContext != NULL) {
+            YoriLibLineReadUnmapFile(ReadContext);
+        }
+
         OldContext = NULL;
         for (ProbeIndex = 0;
              ProbeIndex < YORI_LIB_READ_LINE_CACHE_ENTRIES;
@@ -380,70 +448,376 @@ YoriLibLineReadCleanupCache(VOID)
 
 
 /**
- Read a line from an input stream.
+ A value with every byte set to one, in the native word size.
+ */
+#define YORI_LIB_LINE_READ_BYTE_ONES ((DWORD_PTR)-1 / 0xFF)
 
- @param UserString Pointer to a string to be updated to contain data for a
-        line.  This must be initialized by the caller and the caller's buffer
-        will be used if it is large enough.  If not, this function may
-        reallocate the string to point to a new buffer.
+/**
+ A value with the high bit of every byte set, in the native word size.
+ */
+#define YORI_LIB_LINE_READ_BYTE_HIGHS (YORI_LIB_LINE_READ_BYTE_ONES * 0x80)
 
- @param Context Pointer to a PVOID sized block of memory that should be
-        initialized to NULL for the first line read, and will be updated by
-        this function.
+/**
+ A value with every 16 bit character set to one, in the native word size.
+ */
+#define YORI_LIB_LINE_READ_WCHAR_ONES ((DWORD_PTR)-1 / 0xFFFF)
 
- @param ReturnFinalNonTerminatedLine If TRUE, treat any line at the end of the
-        stream without a line ending character to be a line to return.  If
-        FALSE, assume new input could arrive that means we just haven't
-        observed the line break yet.
+/**
+ A value with the high bit of every 16 bit character set, in the native word
+ size.
+ */
+#define YORI_LIB_LINE_READ_WCHAR_HIGHS (YORI_LIB_LINE_READ_WCHAR_ONES * 0x8000)
 
- @param MaximumDelay Specifies the maximum amount of time to wait for a
-        complete line.  This value can be INFINITE or a specified number of
-        milliseconds.  If the timeout value is reached, TimeoutReached will
-        be set to true and the function will return NULL.
+/**
+ Returns nonzero if any byte within a native word is zero.
+ */
+#define YORI_LIB_LINE_READ_HAS_ZERO_BYTE(Word) \
+    (((Word) - YORI_LIB_LINE_READ_BYTE_ONES) & ~(Word) & YORI_LIB_LINE_READ_BYTE_HIGHS)
 
- @param FileHandle Specifies the handle to the file to read the line from.
+/**
+ Returns nonzero if any 16 bit character within a native word is zero.
+ */
+#define YORI_LIB_LINE_READ_HAS_ZERO_WCHAR(Word) \
+    (((Word) - YORI_LIB_LINE_READ_WCHAR_ONES) & ~(Word) & YORI_LIB_LINE_READ_WCHAR_HIGHS)
 
- @param LineEnding On successful completion, set to indicate the string of
-        characters used to terminate the line.  Can be YoriLibLineEndingNone
-        to indicate no line end was found, which can happen if
-        ReturnFinalNonTerminatedLine is TRUE or MaximumDelay is less than
-        infinite and a partial line was found.
+/**
+ Find the first carriage return or line feed in a buffer of 8 bit
+ characters.  Once the buffer is aligned, this checks a native word at a
+ time, so long lines are scanned without examining each character.
 
- @param TimeoutReached On successful completion, set to TRUE to indicate that
-        the timeout value in MaximumDelay was reached.  If MaximumDelay is
-        INFINITE, this cannot happen.
+ @param Buffer Pointer to the buffer to search.
 
- @return Pointer to the Line buffer for success, NULL on failure.
+ @param Length The number of characters in the buffer.
+
+ @return The offset of the first carriage return or line feed, or Length if
+         the buffer contains neither.
  */
-PVOID
-YoriLibReadLineToStringEx(
-    __in PYORI_STRING UserString,
+YORI_ALLOC_SIZE_T
+YoriLibFindLineBreakA(
+    __in PUCHAR Buffer,
+    __in YORI_ALLOC_SIZE_T Length
+    )
+{
+    YORI_ALLOC_SIZE_T Index;
+    DWORD_PTR Word;
+
+    Index = 0;
+    while (Index < Length && ((DWORD_PTR)&Buffer[Index] & (sizeof(DWORD_PTR) - 1)) != 0) {
+        if (Buffer[Index] == 0xD || Buffer[Index] == 0xA) {
+            return Index;
+        }
+        Index++;
+    }
+
+    while (Index + sizeof(DWORD_PTR) <= Length) {
+        Word = *(PDWORD_PTR)&Buffer[Index];
+        if (YORI_LIB_LINE_READ_HAS_ZERO_BYTE(Word ^ (YORI_LIB_LINE_READ_BYTE_ONES * 0xD)) ||
+            YORI_LIB_LINE_READ_HAS_ZERO_BYTE(Word ^ (YORI_LIB_LINE_READ_BYTE_ONES * 0xA))) {
+
+            break;
+        }
+        Index = Index + sizeof(DWORD_PTR);
+    }
+
+    for (; Index < Length; Index++) {
+        if (Buffer[Index] == 0xD || Buffer[Index] == 0xA) {
+            return Index;
+        }
+    }
+
+    return Length;
+}
+
+/**
+ Find the first carriage return or line feed in a buffer of 16 bit
+ characters.  Once the buffer is aligned, this checks a native word at a
+ time, so long lines are scanned without examining each character.
+
+ @param Buffer Pointer to the buffer to search.
+
+ @param Length The number of characters in the buffer.
+
+ @return The offset of the first carriage return or line feed, or Length if
+         the buffer contains neither.
+ */
+YORI_ALLOC_SIZE_T
+YoriLibFindLineBreakW(
+    __in PWCHAR Buffer,
+    __in YORI_ALLOC_SIZE_T Length
+    )
+{
+    YORI_ALLOC_SIZE_T Index;
+    DWORD_PTR Word;
+
+    Index = 0;
+    while (Index < Length && ((DWORD_PTR)&Buffer[Index] & (sizeof(DWORD_PTR) - 1)) != 0) {
+        if (Buffer[Index] == 0xD || Buffer[Index] == 0xA) {
+            return Index;
+        }
+        Index++;
+    }
+
+    while (Index + sizeof(DWORD_PTR) / sizeof(WCHAR) <= Length) {
+        Word = *(PDWORD_PTR)&Buffer[Index];
+        if (YORI_LIB_LINE_READ_HAS_ZERO_WCHAR(Word ^ (YORI_LIB_LINE_READ_WCHAR_ONES * 0xD)) ||
+            YORI_LIB_LINE_READ_HAS_ZERO_WCHAR(Word ^ (YORI_LIB_LINE_READ_WCHAR_ONES * 0xA))) {
+
+            break;
+        }
+        Index = Index + sizeof(DWORD_PTR) / sizeof(WCHAR);
+    }
+
+    for (; Index < Length; Index++) {
+        if (Buffer[Index] == 0xD || Buffer[Index] == 0xA) {
+            return Index;
+        }
+    }
+
+    return Length;
+}
+
+/**
+ The number of bytes to map from a disk file at a time.
+ */
+#define YORI_LIB_LINE_READ_VIEW_SIZE (4 * 1024 * 1024)
+
+/**
+ The alignment of the file offset of each mapped view.  This is the
+ allocation granularity used by every NT platform.
+ */
+#define YORI_LIB_LINE_READ_VIEW_ALIGNMENT (64 * 1024)
+
+/**
+ Map a view of a file so that the specified file offset can be read.
+
+ @param ReadContext Pointer to the line read context, which has a file
+        mapping.
+
+ @param FileOffset The offset within the file which should be returned next.
+
+ @param Length The number of bytes to map, which is reduced if the file
+        ends sooner.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibLineReadMapView(
+    __inout PYORI_LIB_LINE_READ_CONTEXT ReadContext,
+    __in DWORDLONG FileOffset,
+    __in YORI_ALLOC_SIZE_T Length
+    )
+{
+    DWORDLONG ViewFileOffset;
+    PVOID View;
+
+    ViewFileOffset = FileOffset & ~((DWORDLONG)YORI_LIB_LINE_READ_VIEW_ALIGNMENT - 1);
+    if (ViewFileOffset + Length > ReadContext->FileSize) {
+        Length = (YORI_ALLOC_SIZE_T)(ReadContext->FileSize - ViewFileOffset);
+    }
+
+    View = MapViewOfFile(ReadContext->MappingHandle,
+                         FILE_MAP_READ,
+                         (DWORD)(ViewFileOffset >> 32),
+                         (DWORD)ViewFileOffset,
+                         Length);
+
+    if (View == NULL) {
+        return FALSE;
+    }
+
+    if (ReadContext->PreviousBuffer != NULL) {
+        UnmapViewOfFile(ReadContext->PreviousBuffer);
+    }
+
+    ReadContext->PreviousBuffer = View;
+    ReadContext->ViewFileOffset = ViewFileOffset;
+    ReadContext->LengthOfBuffer = Length;
+    ReadContext->BytesInBuffer = Length;
+    ReadContext->CurrentBufferOffset = (YORI_ALLOC_SIZE_T)(FileOffset - ViewFileOffset);
+    return TRUE;
+}
+
+/**
+ Attempt to read a disk file through mapped views rather than reading it
+ into a buffer.  This avoids copying the file into the buffer and moving
+ partial lines within it.  Reading starts from the current file position.
+
+ Reading a mapped view raises an exception if the data cannot be paged in,
+ which occurs if a network or removable device fails or the file is
+ truncated.  Lines can refer directly to the view, so the exception could
+ be raised in the caller, and no handler can recover from it there.  Files
+ are therefore only mapped if they are on a local, fixed device and nobody
+ else has the file open for writing, and the file is reopened to prevent
+ anybody from opening it for writing while it is mapped.  Any other file
+ is read with ReadFile.
+
+ @param ReadContext Pointer to the line read context.  Any allocated buffer
+        is freed if the file is mapped.
+
+ @param FileHandle Specifies the handle to the file.
+
+ @return TRUE if the file is now being read through mapped views, FALSE if
+         it should be read into a buffer.
+ */
+BOOL
+YoriLibLineReadMapFile(
+    __inout PYORI_LIB_LINE_READ_CONTEXT ReadContext,
+    __in HANDLE FileHandle
+    )
+{
+    LARGE_INTEGER FileSize;
+    LARGE_INTEGER FileOffset;
+    IO_STATUS_BLOCK IoStatusBlock;
+    YORI_FILE_FS_DEVICE_INFORMATION DeviceInfo;
+    HANDLE ReadOnlyHandle;
+    DWORD Err;
+
+    ASSERT(ReadContext->MappingHandle == NULL);
+
+    if (DllNtDll.pNtQueryVolumeInformationFile == NULL ||
+        DllKernel32.pReOpenFile == NULL) {
+
+        return FALSE;
+    }
+
+    if (DllNtDll.pNtQueryVolumeInformationFile(FileHandle, &IoStatusBlock, &DeviceInfo, sizeof(DeviceInfo), FileFsDeviceInformation) != 0) {
+        return FALSE;
+    }
+
+    if (DeviceInfo.Characteristics & (FILE_REMOTE_DEVICE | FILE_REMOVABLE_MEDIA)) {
+        return FALSE;
+    }
+
+    //
+    //  Opening without FILE_SHARE_WRITE fails if any existing handle can
+    //  write to the file, including the caller's.
+    //
+
+    ReadOnlyHandle = DllKernel32.pReOpenFile(FileHandle, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, 0);
+    if (ReadOnlyHandle == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    FileSize.LowPart = GetFileSize(ReadOnlyHandle, (LPDWORD)&FileSize.HighPart);
+    if (FileSize.LowPart == (DWORD)-1) {
+        Err = GetLastError();
+        if (Err != NO_ERROR) {
+            CloseHandle(ReadOnlyHandle);
+            return FALSE;
+        }
+    }
+
+    FileOffset.HighPart = 0;
+    FileOffset.LowPart = SetFilePointer(FileHandle, 0, &FileOffset.HighPart, FILE_CURRENT);
+    if (FileOffset.LowPart == (DWORD)-1) {
+        Err = GetLastError();
+        if (Err != NO_ERROR) {
+            CloseHandle(ReadOnlyHandle);
+            return FALSE;
+        }
+    }
+
+    //
+    //  If there's nothing left to read, there's nothing to map.  Let the
+    //  regular read path find the end of the file.
+    //
+
+    if (FileOffset.QuadPart >= FileSize.QuadPart) {
+        CloseHandle(ReadOnlyHandle);
+        return FALSE;
+    }
+
+    ReadContext->MappingHandle = CreateFileMapping(ReadOnlyHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (ReadContext->MappingHandle == NULL) {
+        CloseHandle(ReadOnlyHandle);
+        return FALSE;
+    }
+    ReadContext->ReadOnlyHandle = ReadOnlyHandle;
+
+    if (ReadContext->PreviousBuffer != NULL) {
+        YoriLibFree(ReadContext->PreviousBuffer);
+        ReadContext->PreviousBuffer = NULL;
+    }
+
+    ReadContext->FileSize = FileSize.QuadPart;
+    if (!YoriLibLineReadMapView(ReadContext, FileOffset.QuadPart, YORI_LIB_LINE_READ_VIEW_SIZE)) {
+        YoriLibLineReadUnmapFile(ReadContext);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Map the next view of a file being read through mapped views.  The view
+ starts with the data that has not been returned yet.  If that data is a
+ partial line longer than the view size, the view is made larger so that
+ more of the line is available.
+
+ @param ReadContext Pointer to the line read context.
+
+ @return TRUE if more data is available, FALSE if the end of the file has
+         been reached or the view could not be mapped.
+ */
+BOOL
+YoriLibLineReadAdvanceView(
+    __inout PYORI_LIB_LINE_READ_CONTEXT ReadContext
+    )
+{
+    DWORDLONG ViewEnd;
+    DWORDLONG FileOffset;
+    DWORDLONG NewViewFileOffset;
+    DWORDLONG Length;
+
+    ViewEnd = ReadContext->ViewFileOffset + ReadContext->BytesInBuffer;
+    if (ViewEnd >= ReadContext->FileSize) {
+        return FALSE;
+    }
+
+    FileOffset = ReadContext->ViewFileOffset + ReadContext->CurrentBufferOffset;
+    NewViewFileOffset = FileOffset & ~((DWORDLONG)YORI_LIB_LINE_READ_VIEW_ALIGNMENT - 1);
+    Length = YORI_LIB_LINE_READ_VIEW_SIZE;
+    if (NewViewFileOffset + Length <= ViewEnd) {
+        Length = (ViewEnd - NewViewFileOffset) * 2;
+        if (Length > YORI_MAX_ALLOC_SIZE - YORI_LIB_LINE_READ_VIEW_ALIGNMENT) {
+            return FALSE;
+        }
+    }
+
+    return YoriLibLineReadMapView(ReadContext, FileOffset, (YORI_ALLOC_SIZE_T)Length);
+}
+
+/**
+ Find or allocate the line read context for a stream, and ensure it has a
+ buffer to read into.
+
+ @param Context Pointer to a PVOID sized block of memory that should be
+        initialized to NULL for the first read, and will be updated by
+        this function.
+
+ @param FileHandle Specifies the handle to the file to read from.
+
+ @param MinimumBufferLength The minimum size of the buffer to read into.
+        Callers pass the size of the buffer lines are returned in, so a
+        buffer that can hold a line can be populated.
+
+ @param AllowMapping If TRUE, a disk file may be read through mapped views
+        rather than into a buffer.  This is only possible for callers that
+        read until the end of the file and never modify the buffer.
+
+ @return Pointer to the line read context, or NULL if it could not be
+         allocated or a previous operation has terminated.
+ */
+PYORI_LIB_LINE_READ_CONTEXT
+YoriLibLineReadPrepareContext(
     __inout PVOID * Context,
-    __in BOOL ReturnFinalNonTerminatedLine,
-    __in DWORD MaximumDelay,
     __in HANDLE FileHandle,
-    __out PYORI_LIB_LINE_ENDING LineEnding,
-    __out PBOOL TimeoutReached
+    __in YORI_ALLOC_SIZE_T MinimumBufferLength,
+    __in BOOL AllowMapping
     )
 {
     PYORI_LIB_LINE_READ_CONTEXT ReadContext;
-    YORI_ALLOC_SIZE_T Count = 0;
-    DWORD LastError;
-    YORI_ALLOC_SIZE_T BytesToRead;
-    DWORD BytesRead;
-    YORI_ALLOC_SIZE_T CharsToCopy;
-    YORI_ALLOC_SIZE_T CharsToSkip;
-    BOOL BomFound = FALSE;
-    BOOL TerminateProcessing;
-    HANDLE HandleArray[2];
-    DWORD HandleCount;
-    DWORD WaitResult;
-    DWORD DelayTime;
-    YORI_ALLOC_SIZE_T CharsRemaining;
-    DWORD CumulativeDelay;
-    YORI_LIB_LINE_ENDING LocalLineEnding;
-
-    *TimeoutReached = FALSE;
 
     //
     //  If we don't have a line read context yet, allocate one.
@@ -452,8 +826,6 @@ YoriLibReadLineToStringEx(
     if (*Context == NULL) {
         ReadContext = YoriLibReadLineAllocateContext();
         if (ReadContext == NULL) {
-            UserString->LengthInChars = 0;
-            *LineEnding = YoriLibLineEndingNone;
             return NULL;
         }
         *Context = ReadContext;
@@ -467,6 +839,10 @@ YoriLibReadLineToStringEx(
             ReadContext->ReadWChars = FALSE;
         }
         ReadContext->Terminated = FALSE;
+        ReadContext->MappingHandle = NULL;
+        if (AllowMapping && ReadContext->FileType == FILE_TYPE_DISK) {
+            YoriLibLineReadMapFile(ReadContext, FileHandle);
+        }
     } else {
         ReadContext = *Context;
         if (ReadContext->Terminated) {
@@ -478,7 +854,7 @@ YoriLibReadLineToStringEx(
     //  If the line read context doesn't have a buffer yet, allocate it
     //
 
-    if (ReadContext->PreviousBuffer == NULL || UserString->LengthAllocated > ReadContext->LengthOfBuffer) {
+    if (ReadContext->PreviousBuffer == NULL || MinimumBufferLength > ReadContext->LengthOfBuffer) {
         YORI_ALLOC_SIZE_T MinBufferSize;
         if (ReadContext->PreviousBuffer != NULL) {
             YoriLibFree(ReadContext->PreviousBuffer);
@@ -488,52 +864,309 @@ YoriLibReadLineToStringEx(
         //
         //  MSFIX: Need to adjust this for smaller alloc size limits
         //
-        ReadContext->LengthOfBuffer = UserString->LengthAllocated;
+        ReadContext->LengthOfBuffer = MinimumBufferLength;
         MinBufferSize = YoriLibMaximumAllocationInRange(60 * 1024, 256 * 1024);
         if (ReadContext->LengthOfBuffer < MinBufferSize) {
             ReadContext->LengthOfBuffer = MinBufferSize;
         }
         ReadContext->PreviousBuffer = YoriLibMalloc(ReadContext->LengthOfBuffer);
         if (ReadContext->PreviousBuffer == NULL) {
-            UserString->LengthInChars = 0;
-            *LineEnding = YoriLibLineEndingNone;
             ReadContext->Terminated = TRUE;
             return NULL;
         }
     }
 
-    do {
+    return ReadContext;
+}
 
-        BOOL ProcessThisLine;
-        ASSERT(ReadContext->CurrentBufferOffset <= ReadContext->BytesInBuffer);
+/**
+ Wait for more data to arrive on an input stream and append it to the
+ buffer in a line read context.
 
-        //
-        //  Scan through the buffer looking for newlines.  If we find one,
-        //  copy the data back into the caller's buffer.  Copy any remaining
-        //  buffer back to the beginning of the holdover buffer, and
-        //  decrement chars there accordingly.
-        //
+ @param ReadContext Pointer to the line read context.  The buffer is
+        expected to have space available.
 
-        if (ReadContext->ReadWChars) {
-            PWCHAR WideBuffer = (PWCHAR)YoriLibAddToPointer(ReadContext->PreviousBuffer, ReadContext->CurrentBufferOffset);
-            CharsRemaining = (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset) / sizeof(WCHAR);
-            for (Count = 0; Count < CharsRemaining; Count++) {
-                if (WideBuffer[Count] == 0xD ||
-                    WideBuffer[Count] == 0xA) {
+ @param FileHandle Specifies the handle to the file to read from.
 
-                    ProcessThisLine = TRUE;
+ @param MaximumDelay Specifies the maximum amount of time to wait for data to
+        arrive on a pipe.  This value can be INFINITE or a specified number
+        of milliseconds.
 
-                    CharsToCopy = Count;
-                    LocalLineEnding = YoriLibLineEndingCR;
-                    if (WideBuffer[Count] == 0xD) {
-                        if ((Count + 1) * sizeof(WCHAR) < (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset)) {
-                            if (WideBuffer[Count + 1] == 0xA) {
-                                Count++;
-                                LocalLineEnding = YoriLibLineEndingCRLF;
-                            }
-                        } else if (ReadContext->CurrentBufferOffset > 0) {
-                            ProcessThisLine = FALSE;
-                        }
+ @param TimeoutReached On completion, set to TRUE if the timeout value in
+        MaximumDelay was reached.  This is not modified otherwise.
+
+ @return TRUE if data was added to the buffer, FALSE if the end of the
+         stream was reached, the operation was cancelled, or the timeout
+         was reached.
+ */
+BOOL
+YoriLibLineReadFillBuffer(
+    __inout PYORI_LIB_LINE_READ_CONTEXT ReadContext,
+    __in HANDLE FileHandle,
+    __in DWORD MaximumDelay,
+    __inout PBOOL TimeoutReached
+    )
+{
+    DWORD LastError;
+    YORI_ALLOC_SIZE_T BytesToRead;
+    DWORD BytesRead;
+    BOOL TerminateProcessing;
+    HANDLE HandleArray[2];
+    DWORD HandleCount;
+    DWORD WaitResult;
+    DWORD DelayTime;
+    DWORD CumulativeDelay;
+
+    if (ReadContext->MappingHandle != NULL) {
+        return YoriLibLineReadAdvanceView(ReadContext);
+    }
+
+    //
+    //  Wait for more data, or for cancellation if it's enabled.
+    //
+    //  This stupid dance about waiting and sleeping is for the following
+    //  brain-damaged comment in MSDN under "Named Pipe Operations":
+    //
+    //    The pipe server should not perform a blocking read operation
+    //    until the pipe client has started. Otherwise, a race condition
+    //    can occur. This typically occurs when initialization code, such
+    //    as that of the C run-time library, needs to lock and examine
+    //    inherited handles.
+    //
+    //  Of course, we don't control the behavior of the pipe client.  We
+    //  do, however, observe that the pipe can be signalled prior to the
+    //  client performing operations on it, which requires us to
+    //  distinguish between "signalled due to correct operation" and
+    //  "signalled due to a documented bug on MSDN."
+    //
+    //  The cancel event is listed first because in the case where the
+    //  pipe is overactively signalled, we still want to detect cancel,
+    //  which will not be overactively signalled.
+    //
+
+    CumulativeDelay = 0;
+    DelayTime = 1;
+    TerminateProcessing = FALSE;
+    while(TRUE) {
+        DWORD BytesAvailable;
+
+        if (YoriLibCancelGetEvent() != NULL) {
+            HandleCount = 2;
+            HandleArray[0] = YoriLibCancelGetEvent();
+            HandleArray[1] = FileHandle;
+        } else {
+            HandleCount = 1;
+            HandleArray[0] = FileHandle;
+        }
+
+        WaitResult = WaitForMultipleObjectsEx(HandleCount, HandleArray, FALSE, INFINITE, FALSE);
+        if (WaitResult == WAIT_OBJECT_0 && HandleCount > 1) {
+            TerminateProcessing = TRUE;
+            break;
+        }
+
+        if (ReadContext->FileType != FILE_TYPE_PIPE) {
+            break;
+        }
+
+        if (!PeekNamedPipe(FileHandle, NULL, 0, NULL, &BytesAvailable, NULL)) {
+            TerminateProcessing = TRUE;
+            break;
+        }
+
+        if (BytesAvailable > 0) {
+            break;
+        }
+
+        if (MaximumDelay != INFINITE && CumulativeDelay >= MaximumDelay) {
+            *TimeoutReached = TRUE;
+            TerminateProcessing = TRUE;
+            break;
+        }
+
+        //
+        //  Note that this delay is not exercised once the process
+        //  starts pushing data into the pipe.  Think of this as
+        //  the maximum interval that we're waiting for the process
+        //  to start.
+        //
+
+        Sleep(DelayTime);
+        CumulativeDelay += DelayTime;
+        if (DelayTime < 10) {
+            DelayTime++;
+        } else {
+            DelayTime = DelayTime * 5 / 4;
+        }
+        if (DelayTime > 500) {
+            DelayTime = 500;
+        }
+    }
+
+    //
+    //  If we haven't found a newline yet, check if we can read more
+    //  data and see if it helps.  If we fail to read more data,
+    //  just treat any buffer remainder as a line.
+    //
+
+    BytesRead = 0;
+    if (!TerminateProcessing) {
+
+        BytesToRead = ReadContext->LengthOfBuffer - ReadContext->BytesInBuffer;
+        LastError = ERROR_SUCCESS;
+
+        while(TRUE) {
+            if (ReadFile(FileHandle, YoriLibAddToPointer(ReadContext->PreviousBuffer, ReadContext->BytesInBuffer), BytesToRead, &BytesRead, NULL)) {
+                LastError = ERROR_SUCCESS;
+                break;
+            }
+
+            //
+            //  NT 3.1 can fail reads with NOT_ENOUGH_MEMORY if the buffer
+            //  is too large.  Work around this by shrinking the requested
+            //  number of bytes to read.
+            //
+
+            LastError = GetLastError();
+            if (LastError == ERROR_NOT_ENOUGH_MEMORY && BytesToRead > 16384) {
+                BytesToRead = 16384;
+                continue;
+            }
+
+            break;
+        }
+
+        if (LastError != ERROR_SUCCESS) {
+#if DBG
+            //
+            //  Most of these indicate the source has gone away or ended.
+            //  ERROR_INVALID_PARAMETER happens when we're trying to
+            //  perform an unaligned read on a noncached handle, which
+            //  is crazy, but Windows will silently allow cached opens to
+            //  devices to be noncached opens, which inconveniently means
+            //  the detection of the problem happens later than it should.
+            //
+
+            ASSERT(LastError == ERROR_BROKEN_PIPE ||
+                   LastError == ERROR_NO_DATA ||
+                   LastError == ERROR_HANDLE_EOF ||
+                   LastError == ERROR_INVALID_PARAMETER);
+#endif
+            TerminateProcessing = TRUE;
+        }
+
+        if (ReadContext->FileType != FILE_TYPE_PIPE && BytesRead == 0) {
+
+            TerminateProcessing = TRUE;
+        }
+    }
+
+    if (TerminateProcessing) {
+        return FALSE;
+    }
+
+    ReadContext->BytesInBuffer = ReadContext->BytesInBuffer + (YORI_ALLOC_SIZE_T)BytesRead;
+    return TRUE;
+}
+
+/**
+ Read a line from an input stream.
+
+ @param UserString Pointer to a string to be updated to contain data for a
+        line.  This must be initialized by the caller and the caller's buffer
+        will be used if it is large enough.  If not, this function may
+        reallocate the string to point to a new buffer.
+
+ @param Context Pointer to a PVOID sized block of memory that should be
+        initialized to NULL for the first line read, and will be updated by
+        this function.
+
+ @param ReturnFinalNonTerminatedLine If TRUE, treat any line at the end of the
+        stream without a line ending character to be a line to return.  If
+        FALSE, assume new input could arrive that means we just haven't
+        observed the line break yet.
+
+ @param MaximumDelay Specifies the maximum amount of time to wait for a
+        complete line.  This value can be INFINITE or a specified number of
+        milliseconds.  If the timeout value is reached, TimeoutReached will
+        be set to true and the function will return NULL.
+
+ @param FileHandle Specifies the handle to the file to read the line from.
+
+ @param LineEnding On successful completion, set to indicate the string of
+        characters used to terminate the line.  Can be YoriLibLineEndingNone
+        to indicate no line end was found, which can happen if
+        ReturnFinalNonTerminatedLine is TRUE or MaximumDelay is less than
+        infinite and a partial line was found.
+
+ @param TimeoutReached On successful completion, set to TRUE to indicate that
+        the timeout value in MaximumDelay was reached.  If MaximumDelay is
+        INFINITE, this cannot happen.
+
+ @return Pointer to the Line buffer for success, NULL on failure.
+ */
+PVOID
+YoriLibReadLineToStringEx(
+    __in PYORI_STRING UserString,
+    __inout PVOID * Context,
+    __in BOOL ReturnFinalNonTerminatedLine,
+    __in DWORD MaximumDelay,
+    __in HANDLE FileHandle,
+    __out PYORI_LIB_LINE_ENDING LineEnding,
+    __out PBOOL TimeoutReached
+    )
+{
+    PYORI_LIB_LINE_READ_CONTEXT ReadContext;
+    YORI_ALLOC_SIZE_T Count = 0;
+    YORI_ALLOC_SIZE_T CharsToCopy;
+    YORI_ALLOC_SIZE_T CharsToSkip;
+    BOOL BomFound = FALSE;
+    BOOL TerminateProcessing;
+    YORI_ALLOC_SIZE_T CharsRemaining;
+    YORI_LIB_LINE_ENDING LocalLineEnding;
+
+    *TimeoutReached = FALSE;
+
+    ReadContext = YoriLibLineReadPrepareContext(Context, FileHandle, UserString->LengthAllocated, FALSE);
+    if (ReadContext == NULL) {
+        UserString->LengthInChars = 0;
+        *LineEnding = YoriLibLineEndingNone;
+        return NULL;
+    }
+    ASSERT(ReadContext->MappingHandle == NULL);
+
+    do {
+
+        BOOL ProcessThisLine;
+        ASSERT(ReadContext->CurrentBufferOffset <= ReadContext->BytesInBuffer);
+
+        //
+        //  Scan through the buffer looking for newlines.  If we find one,
+        //  copy the data back into the caller's buffer.  Copy any remaining
+        //  buffer back to the beginning of the holdover buffer, and
+        //  decrement chars there accordingly.
+        //
+
+        if (ReadContext->ReadWChars) {
+            PWCHAR WideBuffer = (PWCHAR)YoriLibAddToPointer(ReadContext->PreviousBuffer, ReadContext->CurrentBufferOffset);
+            CharsRemaining = (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset) / sizeof(WCHAR);
+            for (Count = 0; Count < CharsRemaining; Count++) {
+                Count = Count + YoriLibFindLineBreakW(&WideBuffer[Count], CharsRemaining - Count);
+                if (Count < CharsRemaining) {
+
+                    ProcessThisLine = TRUE;
+
+                    CharsToCopy = Count;
+                    LocalLineEnding = YoriLibLineEndingCR;
+                    if (WideBuffer[Count] == 0xD) {
+                        if ((Count + 1) * sizeof(WCHAR) < (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset)) {
+                            if (WideBuffer[Count + 1] == 0xA) {
+                                Count++;
+                                LocalLineEnding = YoriLibLineEndingCRLF;
+                            }
+                        } else if (ReadContext->CurrentBufferOffset > 0) {
+                            ProcessThisLine = FALSE;
+                        }
                     } else {
                         LocalLineEnding = YoriLibLineEndingLF;
                     }
@@ -569,9 +1202,8 @@ YoriLibReadLineToStringEx(
             PUCHAR Buffer = YoriLibAddToPointer(ReadContext->PreviousBuffer, ReadContext->CurrentBufferOffset);
             CharsRemaining = ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset;
             for (Count = 0; Count < CharsRemaining; Count++) {
-
-                if (Buffer[Count] == 0xD ||
-                    Buffer[Count] == 0xA) {
+                Count = Count + YoriLibFindLineBreakA(&Buffer[Count], CharsRemaining - Count);
+                if (Count < CharsRemaining) {
 
                     ProcessThisLine = TRUE;
 
@@ -645,145 +1277,7 @@ YoriLibReadLineToStringEx(
             return NULL;
         }
 
-        //
-        //  Wait for more data, or for cancellation if it's enabled.
-        //
-        //  This stupid dance about waiting and sleeping is for the following
-        //  brain-damaged comment in MSDN under "Named Pipe Operations":
-        //
-        //    The pipe server should not perform a blocking read operation
-        //    until the pipe client has started. Otherwise, a race condition
-        //    can occur. This typically occurs when initialization code, such
-        //    as that of the C run-time library, needs to lock and examine
-        //    inherited handles.
-        //
-        //  Of course, we don't control the behavior of the pipe client.  We
-        //  do, however, observe that the pipe can be signalled prior to the
-        //  client performing operations on it, which requires us to
-        //  distinguish between "signalled due to correct operation" and
-        //  "signalled due to a documented bug on MSDN."
-        //
-        //  The cancel event is listed first because in the case where the
-        //  pipe is overactively signalled, we still want to detect cancel,
-        //  which will not be overactively signalled.
-        //
-
-        CumulativeDelay = 0;
-        DelayTime = 1;
-        TerminateProcessing = FALSE;
-        while(TRUE) {
-            DWORD BytesAvailable;
-
-            if (YoriLibCancelGetEvent() != NULL) {
-                HandleCount = 2;
-                HandleArray[0] = YoriLibCancelGetEvent();
-                HandleArray[1] = FileHandle;
-            } else {
-                HandleCount = 1;
-                HandleArray[0] = FileHandle;
-            }
-
-            WaitResult = WaitForMultipleObjectsEx(HandleCount, HandleArray, FALSE, INFINITE, FALSE);
-            if (WaitResult == WAIT_OBJECT_0 && HandleCount > 1) {
-                TerminateProcessing = TRUE;
-                break;
-            }
-
-            if (ReadContext->FileType != FILE_TYPE_PIPE) {
-                break;
-            }
-
-            if (!PeekNamedPipe(FileHandle, NULL, 0, NULL, &BytesAvailable, NULL)) {
-                TerminateProcessing = TRUE;
-                break;
-            }
-
-            if (BytesAvailable > 0) {
-                break;
-            }
-
-            if (MaximumDelay != INFINITE && CumulativeDelay >= MaximumDelay) {
-                *TimeoutReached = TRUE;
-                TerminateProcessing = TRUE;
-                break;
-            }
-
-            //
-            //  Note that this delay is not exercised once the process
-            //  starts pushing data into the pipe.  Think of this as
-            //  the maximum interval that we're waiting for the process
-            //  to start.
-            //
-
-            Sleep(DelayTime);
-            CumulativeDelay += DelayTime;
-            if (DelayTime < 10) {
-                DelayTime++;
-            } else {
-                DelayTime = DelayTime * 5 / 4;
-            }
-            if (DelayTime > 500) {
-                DelayTime = 500;
-            }
-        }
-
-        //
-        //  If we haven't found a newline yet, check if we can read more
-        //  data and see if it helps.  If we fail to read more data,
-        //  just treat any buffer remainder as a line.
-        //
-
-        BytesRead = 0;
-        if (!TerminateProcessing) {
-
-            BytesToRead = ReadContext->LengthOfBuffer - ReadContext->BytesInBuffer;
-            LastError = ERROR_SUCCESS;
-
-            while(TRUE) {
-                if (ReadFile(FileHandle, YoriLibAddToPointer(ReadContext->PreviousBuffer, ReadContext->BytesInBuffer), BytesToRead, &BytesRead, NULL)) {
-                    LastError = ERROR_SUCCESS;
-                    break;
-                }
-
-                //
-                //  NT 3.1 can fail reads with NOT_ENOUGH_MEMORY if the buffer
-                //  is too large.  Work around this by shrinking the requested
-                //  number of bytes to read.
-                //
-
-                LastError = GetLastError();
-                if (LastError == ERROR_NOT_ENOUGH_MEMORY && BytesToRead > 16384) {
-                    BytesToRead = 16384;
-                    continue;
-                }
-
-                break;
-            }
-
-            if (LastError != ERROR_SUCCESS) {
-#if DBG
-                //
-                //  Most of these indicate the source has gone away or ended.
-                //  ERROR_INVALID_PARAMETER happens when we're trying to
-                //  perform an unaligned read on a noncached handle, which
-                //  is crazy, but Windows will silently allow cached opens to
-                //  devices to be noncached opens, which inconveniently means
-                //  the detection of the problem happens later than it should.
-                //
-
-                ASSERT(LastError == ERROR_BROKEN_PIPE ||
-                       LastError == ERROR_NO_DATA ||
-                       LastError == ERROR_HANDLE_EOF ||
-                       LastError == ERROR_INVALID_PARAMETER);
-#endif
-                TerminateProcessing = TRUE;
-            }
-
-            if (ReadContext->FileType != FILE_TYPE_PIPE && BytesRead == 0) {
-
-                TerminateProcessing = TRUE;
-            }
-        }
+        TerminateProcessing = !YoriLibLineReadFillBuffer(ReadContext, FileHandle, MaximumDelay, TimeoutReached);
 
         if (TerminateProcessing) {
             if (ReturnFinalNonTerminatedLine) {
@@ -831,8 +1325,6 @@ YoriLibReadLineToStringEx(
             return NULL;
         }
 
-        ReadContext->BytesInBuffer = ReadContext->BytesInBuffer + (YORI_ALLOC_SIZE_T)BytesRead;
-
     } while(TRUE);
 }
 
@@ -865,6 +1357,326 @@ YoriLibReadLineToString(
     return YoriLibReadLineToStringEx(UserString, Context, TRUE, INFINITE, FileHandle, &LineEnding, &TimeoutReached);
 }
 
+/**
+ Initialize a batch of lines so that it can be populated with
+ @ref YoriLibReadLineBatch .
+
+ @param Batch Pointer to the batch to initialize.
+ */
+VOID
+YoriLibInitializeLineBatch(
+    __out PYORI_LIB_LINE_BATCH Batch
+    )
+{
+    YoriLibInitEmptyString(&Batch->Text);
+    Batch->Lines = NULL;
+    Batch->LineCount = 0;
+    Batch->LinesAllocated = 0;
+}
+
+/**
+ Free the memory used by a batch of lines.
+
+ @param Batch Pointer to the batch to free.
+ */
+VOID
+YoriLibFreeLineBatch(
+    __inout PYORI_LIB_LINE_BATCH Batch
+    )
+{
+    YoriLibFreeStringContents(&Batch->Text);
+    if (Batch->Lines != NULL) {
+        YoriLibFree(Batch->Lines);
+    }
+    YoriLibInitializeLineBatch(Batch);
+}
+
+/**
+ Return the number of characters in a buffer up to and including the final
+ complete line ending.  A carriage return at the end of the buffer is not
+ complete, because a line feed may follow it.
+
+ @param ReadContext Pointer to the line read context, which indicates the
+        size of each character.
+
+ @param Buffer Pointer to the buffer to search.
+
+ @param Length The number of characters in the buffer.
+
+ @return The number of characters up to and including the final complete
+         line ending, or zero if the buffer contains no complete line.
+ */
+YORI_ALLOC_SIZE_T
+YoriLibLineReadFindLastLineEnd(
+    __in PYORI_LIB_LINE_READ_CONTEXT ReadContext,
+    __in PUCHAR Buffer,
+    __in YORI_ALLOC_SIZE_T Length
+    )
+{
+    YORI_ALLOC_SIZE_T Index;
+    WCHAR Char;
+
+    for (Index = Length; Index > 0; Index--) {
+        if (ReadContext->ReadWChars) {
+            Char = ((PWCHAR)Buffer)[Index - 1];
+        } else {
+            Char = Buffer[Index - 1];
+        }
+
+        if (Char == 0xA) {
+            return Index;
+        }
+
+        if (Char == 0xD && Index < Length) {
+            return Index;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ Split the decoded text in a batch into lines.
+
+ @param Batch Pointer to the batch.  Text contains the decoded text, and on
+        successful completion, Lines and LineCount describe each line within
+        it.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibSplitLineBatch(
+    __inout PYORI_LIB_LINE_BATCH Batch
+    )
+{
+    PYORI_LIB_LINE_BATCH_ENTRY NewLines;
+    PYORI_LIB_LINE_BATCH_ENTRY Entry;
+    YORI_ALLOC_SIZE_T NewLinesAllocated;
+    YORI_ALLOC_SIZE_T Offset;
+    YORI_ALLOC_SIZE_T Length;
+    LPTSTR Text;
+
+    Text = Batch->Text.StartOfString;
+    Offset = 0;
+    while (Offset < Batch->Text.LengthInChars) {
+        if (Batch->LineCount == Batch->LinesAllocated) {
+            NewLinesAllocated = Batch->LinesAllocated * 2;
+            if (NewLinesAllocated < 256) {
+                NewLinesAllocated = 256;
+            }
+            NewLines = YoriLibMalloc(NewLinesAllocated * sizeof(YORI_LIB_LINE_BATCH_ENTRY));
+            if (NewLines == NULL) {
+                return FALSE;
+            }
+            if (Batch->Lines != NULL) {
+                memcpy(NewLines, Batch->Lines, Batch->LineCount * sizeof(YORI_LIB_LINE_BATCH_ENTRY));
+                YoriLibFree(Batch->Lines);
+            }
+            Batch->Lines = NewLines;
+            Batch->LinesAllocated = NewLinesAllocated;
+        }
+
+        Length = YoriLibFindLineBreakW(&Text[Offset], Batch->Text.LengthInChars - Offset);
+        Entry = &Batch->Lines[Batch->LineCount];
+        YoriLibInitEmptyString(&Entry->Line);
+        Entry->Line.StartOfString = &Text[Offset];
+        Entry->Line.LengthInChars = Length;
+        Offset = Offset + Length;
+
+        if (Offset == Batch->Text.LengthInChars) {
+            Entry->LineEnding = YoriLibLineEndingNone;
+        } else if (Text[Offset] == 0xD) {
+            if (Offset + 1 < Batch->Text.LengthInChars && Text[Offset + 1] == 0xA) {
+                Entry->LineEnding = YoriLibLineEndingCRLF;
+                Offset = Offset + 2;
+            } else {
+                Entry->LineEnding = YoriLibLineEndingCR;
+                Offset++;
+            }
+        } else {
+            Entry->LineEnding = YoriLibLineEndingLF;
+            Offset++;
+        }
+
+        Batch->LineCount++;
+    }
+
+    return TRUE;
+}
+
+/**
+ Read all of the complete lines that are available from an input stream.
+ If no complete line is available, this waits for one.  All of the lines
+ are converted to host encoding in a single operation and are returned as
+ a set of strings referring to a single buffer, so a caller processing many
+ short lines does not need to copy each line individually.  Any line at the
+ end of the stream without a line ending is returned as a line.
+
+ If the stream is a disk file, it is read through mapped views rather than
+ being copied into a buffer.  If the file is also UTF-16, the lines refer
+ directly to the mapped view.  A context used with this function should not
+ be used with @ref YoriLibReadLineToString , and must not be closed while
+ the lines in the batch are in use.
+
+ @param Batch Pointer to a batch initialized with
+        @ref YoriLibInitializeLineBatch .  On successful completion, this
+        contains the lines that were read.  These remain valid until the
+        batch is used for the next read or is freed.
+
+ @param Context Pointer to a PVOID sized block of memory that should be
+        initialized to NULL for the first read, and will be updated by
+        this function.  This is the same context used by
+        @ref YoriLibReadLineToString and is freed in the same way.
+
+ @param FileHandle Specifies the handle to the file to read lines from.
+
+ @return TRUE to indicate one or more lines were returned, FALSE to indicate
+         the end of the stream or failure.
+ */
+__success(return)
+BOOL
+YoriLibReadLineBatch(
+    __inout PYORI_LIB_LINE_BATCH Batch,
+    __inout PVOID * Context,
+    __in HANDLE FileHandle
+    )
+{
+    PYORI_LIB_LINE_READ_CONTEXT ReadContext;
+    PUCHAR Buffer;
+    YORI_ALLOC_SIZE_T CharSize;
+    YORI_ALLOC_SIZE_T CharsRemaining;
+    YORI_ALLOC_SIZE_T CharsToDecode;
+    YORI_ALLOC_SIZE_T CharsToSkip;
+    YORI_ALLOC_SIZE_T CharsNeeded;
+    BOOL TimeoutReached;
+    BOOL FinalLine;
+
+    Batch->LineCount = 0;
+    Batch->Text.LengthInChars = 0;
+
+    ReadContext = YoriLibLineReadPrepareContext(Context, FileHandle, 0, TRUE);
+    if (ReadContext == NULL) {
+        return FALSE;
+    }
+
+    CharSize = sizeof(UCHAR);
+    if (ReadContext->ReadWChars) {
+        CharSize = sizeof(WCHAR);
+    }
+
+    FinalLine = FALSE;
+    while (TRUE) {
+        Buffer = YoriLibAddToPointer(ReadContext->PreviousBuffer, ReadContext->CurrentBufferOffset);
+        CharsRemaining = (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset) / CharSize;
+        CharsToDecode = YoriLibLineReadFindLastLineEnd(ReadContext, Buffer, CharsRemaining);
+        if (CharsToDecode > 0) {
+            break;
+        }
+
+        //
+        //  There's no complete line.  Move the contents that are still
+        //  unprocessed to the front of the buffer.  A mapped view is
+        //  advanced by filling it instead.
+        //
+
+        if (ReadContext->MappingHandle == NULL &&
+            ReadContext->CurrentBufferOffset != 0) {
+            memmove(ReadContext->PreviousBuffer,
+                    Buffer,
+                    ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset);
+            ReadContext->BytesInBuffer = ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset;
+            ReadContext->CurrentBufferOffset = 0;
+        }
+
+        //
+        //  As with single line reads, a line longer than the buffer ends
+        //  processing.
+        //
+
+        if (ReadContext->MappingHandle == NULL &&
+            ReadContext->LengthOfBuffer == ReadContext->BytesInBuffer) {
+            ReadContext->Terminated = TRUE;
+            return FALSE;
+        }
+
+        TimeoutReached = FALSE;
+        if (!YoriLibLineReadFillBuffer(ReadContext, FileHandle, INFINITE, &TimeoutReached)) {
+            ReadContext->Terminated = TRUE;
+            if (ReadContext->BytesInBuffer == ReadContext->CurrentBufferOffset) {
+                return FALSE;
+            }
+            Buffer = YoriLibAddToPointer(ReadContext->PreviousBuffer, ReadContext->CurrentBufferOffset);
+            CharsToDecode = (ReadContext->BytesInBuffer - ReadContext->CurrentBufferOffset) / CharSize;
+            FinalLine = TRUE;
+            break;
+        }
+    }
+
+    //
+    //  Skip any BOM at the start of the stream.
+    //
+
+    CharsToSkip = 0;
+    if (ReadContext->LinesRead == 0 && ReadContext->CurrentBufferOffset == 0) {
+        CharsToSkip = YoriLibBytesInBom(Buffer, CharsToDecode * CharSize) / CharSize;
+    }
+
+    if (CharsToDecode > CharsToSkip &&
+        ReadContext->MappingHandle != NULL &&
+        ReadContext->ReadWChars &&
+        ((DWORD_PTR)Buffer & (sizeof(WCHAR) - 1)) == 0) {
+
+        //
+        //  UTF-16 text in a mapped view is already in host encoding, so
+        //  refer to it rather than copying it.  The text is not NUL
+        //  terminated.
+        //
+
+        YoriLibFreeStringContents(&Batch->Text);
+        Batch->Text.StartOfString = (LPTSTR)&Buffer[CharsToSkip * CharSize];
+        Batch->Text.LengthInChars = CharsToDecode - CharsToSkip;
+
+    } else if (CharsToDecode > CharsToSkip) {
+        CharsNeeded = (YORI_ALLOC_SIZE_T)YoriLibGetMultibyteInputSizeNeeded((LPSTR)&Buffer[CharsToSkip * CharSize], CharsToDecode - CharsToSkip) + 1;
+        if (CharsNeeded > Batch->Text.LengthAllocated) {
+            YoriLibFreeStringContents(&Batch->Text);
+            if (!YoriLibAllocateString(&Batch->Text, CharsNeeded + 1024)) {
+                ReadContext->Terminated = TRUE;
+                return FALSE;
+            }
+        }
+
+        YoriLibMultibyteInput((LPSTR)&Buffer[CharsToSkip * CharSize],
+                              CharsToDecode - CharsToSkip,
+                              Batch->Text.StartOfString,
+                              Batch->Text.LengthAllocated);
+
+        Batch->Text.LengthInChars = CharsNeeded - 1;
+        Batch->Text.StartOfString[Batch->Text.LengthInChars] = '\0';
+    }
+
+    if (FinalLine) {
+        ReadContext->BytesInBuffer = 0;
+        ReadContext->CurrentBufferOffset = 0;
+    } else {
+        ReadContext->CurrentBufferOffset = ReadContext->CurrentBufferOffset + CharsToDecode * CharSize;
+    }
+
+    if (!YoriLibSplitLineBatch(Batch)) {
+        Batch->LineCount = 0;
+        ReadContext->Terminated = TRUE;
+        return FALSE;
+    }
+
+    ReadContext->LinesRead = ReadContext->LinesRead + Batch->LineCount;
+    if (Batch->LineCount == 0) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 /**
  Free any context allocated by YoriLibReadLineFromFile .
 
@@ -877,7 +1689,9 @@ YoriLibLineReadClose(
 {
     PYORI_LIB_LINE_READ_CONTEXT ReadContext = (PYORI_LIB_LINE_READ_CONTEXT)Context;
     if (ReadContext != NULL) {
-        if (ReadContext->PreviousBuffer != NULL) {
+        if (ReadContext->MappingHandle != NULL) {
+            YoriLibLineReadUnmapFile(ReadContext);
+        } else if (ReadContext->PreviousBuffer != NULL) {
             YoriLibFree(ReadContext->PreviousBuffer);
         }
         YoriLibFree(ReadContext);
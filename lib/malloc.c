@@ -27,6 +27,24 @@
 #include "yoripch.h"
 #include "yorilib.h"
 
+#if defined(_MSC_VER) && (_MSC_VER >= 1300)
+PVOID _ReturnAddress(VOID);
+#pragma intrinsic(_ReturnAddress)
+
+/**
+ The code address that called the current function, used to attribute
+ allocations to call sites when profiling.
+ */
+#define YoriLibCallerAddress() _ReturnAddress()
+#else
+
+/**
+ Older compilers have no way to find the caller, so all allocations are
+ attributed to a single site when profiling.
+ */
+#define YoriLibCallerAddress() NULL
+#endif
+
 #if YORI_SPECIAL_HEAP
 
 #if YORI_MAX_ALLOC_SIZE < ((DWORD)-1)
@@ -158,6 +176,9 @@ YoriLibMalloc(
 {
     PVOID Alloc;
     Alloc = HeapAlloc(GetProcessHeap(), 0, Bytes);
+    if (Alloc != NULL && YoriLibAllocationProfileActive) {
+        YoriLibAllocationProfileRecordAlloc(Alloc, Bytes, YoriLibCallerAddress());
+    }
     return Alloc;
 }
 #else
@@ -278,6 +299,9 @@ YoriLibFree(
     )
 {
 #if !YORI_SPECIAL_HEAP
+    if (YoriLibAllocationProfileActive) {
+        YoriLibAllocationProfileRecordFree(Ptr);
+    }
     HeapFree(GetProcessHeap(), 0, Ptr);
 #else
     PYORI_SPECIAL_HEAP_HEADER Header;
@@ -413,11 +437,20 @@ YoriLibReferencedMalloc(
 {
     PYORILIB_REFERENCED_MALLOC_HEADER Header;
 
-    Header = YoriLibMalloc(Bytes + sizeof(YORILIB_REFERENCED_MALLOC_HEADER));
+    //
+    //  Allocate from the heap here rather than calling YoriLibMalloc so that
+    //  a profile attributes the allocation to this function's caller.
+    //
+
+    Header = HeapAlloc(GetProcessHeap(), 0, Bytes + sizeof(YORILIB_REFERENCED_MALLOC_HEADER));
     if (Header == NULL) {
         return NULL;
     }
 
+    if (YoriLibAllocationProfileActive) {
+        YoriLibAllocationProfileRecordAlloc(Header, Bytes + sizeof(YORILIB_REFERENCED_MALLOC_HEADER), YoriLibCallerAddress());
+    }
+
     Header->ReferenceCount = 1;
 
     return (PVOID)(Header + 1);
@@ -641,5 +674,602 @@ YoriLibIsAllocationExtendable(
     return YoriLibMaximumAllocationInRange(AllocSize + RequiredExtraSize, AllocSize + DesiredExtraSize);
 }
 
+/**
+ The alignment of allocations returned from an arena.  This is sufficient
+ for any integer or pointer type.
+ */
+#define YORI_LIB_ARENA_ALIGNMENT (sizeof(DWORDLONG))
+
+/**
+ A block of memory that allocations from an arena are carved from.  This
+ structure is at the beginning of a reference counted allocation, and the
+ remainder of the allocation is used to satisfy requests from the arena.
+ */
+typedef struct _YORI_LIB_ARENA_CHUNK {
+
+    /**
+     The next chunk owned by the same arena.
+     */
+    struct _YORI_LIB_ARENA_CHUNK *Next;
+
+    /**
+     The number of bytes in the chunk, including this header.
+     */
+    YORI_ALLOC_SIZE_T Size;
+
+    /**
+     The number of bytes in the chunk that have been consumed, including
+     this header.
+     */
+    YORI_ALLOC_SIZE_T Used;
+} YORI_LIB_ARENA_CHUNK, *PYORI_LIB_ARENA_CHUNK;
+
+/**
+ Initialize an arena.  An arena satisfies small allocations by advancing
+ through larger chunks of memory, and releases all of them in a single call
+ to @ref YoriLibCleanupArena .  No memory is allocated until the first
+ allocation from the arena.
+
+ @param Arena Pointer to the arena to initialize.
+
+ @param ChunkSize The number of bytes to allocate at a time to satisfy
+        allocations from the arena.  If zero, a default size is used.
+ */
+VOID
+YoriLibInitializeArena(
+    __out PYORI_LIB_ARENA Arena,
+    __in YORI_ALLOC_SIZE_T ChunkSize
+    )
+{
+    if (ChunkSize == 0) {
+        ChunkSize = YORI_LIB_ARENA_DEFAULT_CHUNK_SIZE;
+    }
+
+    Arena->FirstChunk = NULL;
+    Arena->CurrentChunk = NULL;
+    Arena->ChunkSize = ChunkSize;
+    Arena->ChunksAllocated = 0;
+    Arena->AllocationCount = 0;
+}
+
+/**
+ Return the offset within a chunk that the next allocation would be placed
+ at, after aligning it.
+
+ @param Chunk Pointer to the chunk.
+
+ @return The offset from the beginning of the chunk of the next allocation.
+ */
+YORI_ALLOC_SIZE_T
+YoriLibArenaAlignedOffset(
+    __in PYORI_LIB_ARENA_CHUNK Chunk
+    )
+{
+    DWORD_PTR Address;
+
+    Address = (DWORD_PTR)Chunk + Chunk->Used;
+    Address = (Address + YORI_LIB_ARENA_ALIGNMENT - 1) & ~((DWORD_PTR)YORI_LIB_ARENA_ALIGNMENT - 1);
+    return (YORI_ALLOC_SIZE_T)(Address - (DWORD_PTR)Chunk);
+}
+
+/**
+ Allocate memory from an arena.  The memory remains valid until the arena
+ is reset or cleaned up.  If the caller needs the memory to remain valid
+ after that point, it can request a reference on the underlying allocation,
+ which is released with @ref YoriLibDereference .  This allows allocations
+ from an arena to be used in structures such as @ref YORI_STRING which
+ record the allocation to release.
+
+ @param Arena Pointer to the arena to allocate from.
+
+ @param Bytes The number of bytes to allocate.
+
+ @param MemoryToFree Optionally points to a location to receive a referenced
+        pointer to the allocation containing the returned memory.  If NULL,
+        no reference is taken.
+
+ @return A pointer to the allocated memory, or NULL on failure.
+ */
+PVOID
+YoriLibArenaAlloc(
+    __inout PYORI_LIB_ARENA Arena,
+    __in YORI_ALLOC_SIZE_T Bytes,
+    __out_opt PVOID *MemoryToFree
+    )
+{
+    PYORI_LIB_ARENA_CHUNK Chunk;
+    PYORI_LIB_ARENA_CHUNK NewChunk;
+    YORI_ALLOC_SIZE_T Offset;
+    YORI_MAX_UNSIGNED_T ChunkBytes;
+
+    //
+    //  Look for the first chunk with enough space, starting at the chunk
+    //  currently being used.  Any chunks after it have either been reset
+    //  and are empty, or contain a single large allocation.
+    //
+
+    Chunk = Arena->CurrentChunk;
+    while (Chunk != NULL) {
+        Offset = YoriLibArenaAlignedOffset(Chunk);
+        if (Offset <= Chunk->Size && Chunk->Size - Offset >= Bytes) {
+            break;
+        }
+        Chunk = Chunk->Next;
+    }
+
+    if (Chunk == NULL) {
+
+        ChunkBytes = Bytes;
+        ChunkBytes = ChunkBytes + sizeof(YORI_LIB_ARENA_CHUNK) + YORI_LIB_ARENA_ALIGNMENT;
+        if (ChunkBytes < Arena->ChunkSize) {
+            ChunkBytes = Arena->ChunkSize;
+        }
+
+        if (!YoriLibIsSizeAllocatable(ChunkBytes)) {
+            return NULL;
+        }
+
+        NewChunk = YoriLibReferencedMalloc((YORI_ALLOC_SIZE_T)ChunkBytes);
+        if (NewChunk == NULL) {
+            return NULL;
+        }
+
+        NewChunk->Size = (YORI_ALLOC_SIZE_T)ChunkBytes;
+        NewChunk->Used = sizeof(YORI_LIB_ARENA_CHUNK);
+        Arena->ChunksAllocated++;
+
+        //
+        //  Insert the chunk after the current chunk.  If the allocation is
+        //  large, leave the current chunk active so its remaining space can
+        //  be used by later allocations.
+        //
+
+        if (Arena->CurrentChunk == NULL) {
+            NewChunk->Next = NULL;
+            Arena->FirstChunk = NewChunk;
+            Arena->CurrentChunk = NewChunk;
+        } else {
+            Chunk = Arena->CurrentChunk;
+            NewChunk->Next = Chunk->Next;
+            Chunk->Next = NewChunk;
+            if (Bytes < Arena->ChunkSize / 4) {
+                Arena->CurrentChunk = NewChunk;
+            }
+        }
+
+        Chunk = NewChunk;
+        Offset = YoriLibArenaAlignedOffset(Chunk);
+    } else if (Bytes < Arena->ChunkSize / 4) {
+        Arena->CurrentChunk = Chunk;
+    }
+
+    Chunk->Used = Offset + Bytes;
+    Arena->AllocationCount++;
+
+    if (MemoryToFree != NULL) {
+        YoriLibReference(Chunk);
+        *MemoryToFree = Chunk;
+    }
+
+    return YoriLibAddToPointer(Chunk, Offset);
+}
+
+/**
+ Allocate memory for a Yori string from an arena.  The string records a
+ reference to the underlying allocation, so it can be freed with
+ @ref YoriLibFreeStringContents and remains valid after the arena is
+ cleaned up.
+
+ @param Arena Pointer to the arena to allocate from.
+
+ @param String Pointer to the string to allocate.
+
+ @param CharsToAllocate The number of characters to allocate in the string.
+
+ @return TRUE to indicate the allocate was successful, FALSE if it was not.
+ */
+__success(return)
+BOOL
+YoriLibArenaAllocateString(
+    __inout PYORI_LIB_ARENA Arena,
+    __out PYORI_STRING String,
+    __in YORI_ALLOC_SIZE_T CharsToAllocate
+    )
+{
+    YoriLibInitEmptyString(String);
+    if (CharsToAllocate > YORI_MAX_ALLOC_SIZE / sizeof(TCHAR)) {
+        return FALSE;
+    }
+    String->StartOfString = YoriLibArenaAlloc(Arena, CharsToAllocate * sizeof(TCHAR), &String->MemoryToFree);
+    if (String->StartOfString == NULL) {
+        return FALSE;
+    }
+    String->LengthAllocated = CharsToAllocate;
+    return TRUE;
+}
+
+/**
+ Discard all allocations from an arena so that its memory can be reused.
+ Chunks which are still referenced by a caller are released by the arena
+ and freed when the caller releases them.  Other chunks are retained and
+ allocations are satisfied from them again.
+
+ @param Arena Pointer to the arena to reset.
+ */
+VOID
+YoriLibResetArena(
+    __inout PYORI_LIB_ARENA Arena
+    )
+{
+    PYORI_LIB_ARENA_CHUNK Chunk;
+    PYORI_LIB_ARENA_CHUNK NextChunk;
+    PYORI_LIB_ARENA_CHUNK *PreviousLink;
+    PYORILIB_REFERENCED_MALLOC_HEADER Header;
+
+    PreviousLink = (PYORI_LIB_ARENA_CHUNK *)&Arena->FirstChunk;
+    Chunk = Arena->FirstChunk;
+    while (Chunk != NULL) {
+        NextChunk = Chunk->Next;
+        Header = (PYORILIB_REFERENCED_MALLOC_HEADER)Chunk - 1;
+        if (Header->ReferenceCount > 1) {
+            *PreviousLink = NextChunk;
+            YoriLibDereference(Chunk);
+        } else {
+            Chunk->Used = sizeof(YORI_LIB_ARENA_CHUNK);
+            PreviousLink = &Chunk->Next;
+        }
+        Chunk = NextChunk;
+    }
+
+    Arena->CurrentChunk = Arena->FirstChunk;
+}
+
+/**
+ Release all memory owned by an arena.  Any allocation where the caller
+ requested a reference remains valid until that reference is released.
+
+ @param Arena Pointer to the arena to clean up.
+ */
+VOID
+YoriLibCleanupArena(
+    __inout PYORI_LIB_ARENA Arena
+    )
+{
+    PYORI_LIB_ARENA_CHUNK Chunk;
+    PYORI_LIB_ARENA_CHUNK NextChunk;
+
+    Chunk = Arena->FirstChunk;
+    while (Chunk != NULL) {
+        NextChunk = Chunk->Next;
+        YoriLibDereference(Chunk);
+        Chunk = NextChunk;
+    }
+
+    Arena->FirstChunk = NULL;
+    Arena->CurrentChunk = NULL;
+}
+
+/**
+ Round a size up to the alignment used for elements returned from a pool.
+ */
+#define YoriLibPoolAlignUp(Size) \
+    (((Size) + YORI_LIB_ARENA_ALIGNMENT - 1) & ~(YORI_LIB_ARENA_ALIGNMENT - 1))
+
+/**
+ The minimum number of elements to allocate in a single slab.  The first slab
+ allocated for a pool has this many elements, and each subsequent slab is
+ larger until YORI_LIB_POOL_MAX_SLAB_ELEMENTS is reached.
+ */
+#define YORI_LIB_POOL_MIN_SLAB_ELEMENTS (0x10)
+
+/**
+ The maximum number of elements to allocate in a single slab.
+ */
+#define YORI_LIB_POOL_MAX_SLAB_ELEMENTS (0x100)
+
+/**
+ A block of memory that elements from a pool are carved from.  This
+ structure is at the beginning of each block, followed by the elements.
+ */
+typedef struct _YORI_LIB_POOL_SLAB {
+
+    /**
+     The next slab owned by the same pool.
+     */
+    struct _YORI_LIB_POOL_SLAB *Next;
+} YORI_LIB_POOL_SLAB, *PYORI_LIB_POOL_SLAB;
+
+/**
+ A structure before each element returned to callers, allowing the element
+ to be returned to its pool without the caller specifying the pool.
+ */
+typedef struct _YORI_LIB_POOL_ELEMENT_HEADER {
+
+    /**
+     The pool that the element was allocated from.
+     */
+    PYORI_LIB_POOL Pool;
+} YORI_LIB_POOL_ELEMENT_HEADER, *PYORI_LIB_POOL_ELEMENT_HEADER;
+
+/**
+ The number of bytes preceding the first element in a slab.
+ */
+#define YORI_LIB_POOL_SLAB_HEADER_SIZE YoriLibPoolAlignUp(sizeof(YORI_LIB_POOL_SLAB))
+
+/**
+ The number of bytes preceding each element returned to the caller.
+ */
+#define YORI_LIB_POOL_ELEMENT_HEADER_SIZE YoriLibPoolAlignUp(sizeof(YORI_LIB_POOL_ELEMENT_HEADER))
+
+/**
+ Acquire a lock which is only held for a handful of instructions, such as
+ the locks protecting a pool.  A waiter yields its time slice and retries
+ rather than waiting on a kernel object, so a lock which is zero is ready
+ for use.
+
+ @param Lock Pointer to the lock to acquire.
+ */
+VOID
+YoriLibAcquireSpinLock(
+    __inout LONG *Lock
+    )
+{
+    while (InterlockedExchange((INTERLOCKED_VOLATILE LONG *)Lock, TRUE) != FALSE) {
+        Sleep(0);
+    }
+}
+
+/**
+ Release a lock acquired with @ref YoriLibAcquireSpinLock .
+
+ @param Lock Pointer to the lock to release.
+ */
+VOID
+YoriLibReleaseSpinLock(
+    __inout LONG *Lock
+    )
+{
+    InterlockedExchange((INTERLOCKED_VOLATILE LONG *)Lock, FALSE);
+}
+
+/**
+ Return the cache within a pool that the calling thread should use.  Thread
+ IDs are multiples of four, so the low bits are discarded before selecting a
+ cache.
+
+ @param Pool Pointer to the pool.
+
+ @return Pointer to the cache for the calling thread.
+ */
+PYORI_LIB_POOL_CACHE
+YoriLibPoolGetCache(
+    __in PYORI_LIB_POOL Pool
+    )
+{
+    DWORD Index;
+
+    Index = (GetCurrentThreadId() / 4) % YORI_LIB_POOL_CACHE_COUNT;
+    return &Pool->Caches[Index];
+}
+
+/**
+ Return the number of bytes consumed by each element in a pool, including
+ its header.
+
+ @param Pool Pointer to the pool.
+
+ @return The number of bytes between consecutive elements in a slab.
+ */
+YORI_ALLOC_SIZE_T
+YoriLibPoolElementStride(
+    __in PYORI_LIB_POOL Pool
+    )
+{
+    YORI_ALLOC_SIZE_T ElementSize;
+
+    //
+    //  Elements on a free list store a pointer to the next free element, so
+    //  each element must be able to contain a pointer.
+    //
+
+    ElementSize = Pool->ElementSize;
+    if (ElementSize < sizeof(PVOID)) {
+        ElementSize = sizeof(PVOID);
+    }
+
+    return (YORI_ALLOC_SIZE_T)(YORI_LIB_POOL_ELEMENT_HEADER_SIZE + YoriLibPoolAlignUp(ElementSize));
+}
+
+/**
+ Allocate a new slab for a cache within a pool.  This is called with the
+ cache lock held.
+
+ @param Pool Pointer to the pool.
+
+ @param Cache Pointer to the cache which has no remaining elements.
+
+ @param SizeInBytes The size of the element that the caller is allocating.
+
+ @return TRUE to indicate a slab was allocated, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibPoolAllocateSlab(
+    __in PYORI_LIB_POOL Pool,
+    __in PYORI_LIB_POOL_CACHE Cache,
+    __in YORI_ALLOC_SIZE_T SizeInBytes
+    )
+{
+    PYORI_LIB_POOL_SLAB Slab;
+    YORI_ALLOC_SIZE_T Stride;
+    YORI_ALLOC_SIZE_T BytesToAllocate;
+    YORI_MAX_UNSIGNED_T BytesRequired;
+    YORI_MAX_UNSIGNED_T BytesDesired;
+    DWORD ElementCount;
+
+    YoriLibAcquireSpinLock(&Pool->Lock);
+
+    if (Pool->ElementSize == 0) {
+        Pool->ElementSize = SizeInBytes;
+    } else if (Pool->ElementSize != SizeInBytes) {
+        YoriLibReleaseSpinLock(&Pool->Lock);
+        return FALSE;
+    }
+
+    //
+    //  Start with small slabs so pools that only ever contain a few elements
+    //  don't reserve much memory, and increase the slab size as the pool
+    //  grows.
+    //
+
+    ElementCount = YORI_LIB_POOL_MAX_SLAB_ELEMENTS;
+    if (Pool->SlabsAllocated < 4) {
+        ElementCount = YORI_LIB_POOL_MIN_SLAB_ELEMENTS << Pool->SlabsAllocated;
+    }
+
+    Stride = YoriLibPoolElementStride(Pool);
+    BytesRequired = YORI_LIB_POOL_SLAB_HEADER_SIZE + Stride;
+    BytesDesired = YORI_LIB_POOL_SLAB_HEADER_SIZE + (YORI_MAX_UNSIGNED_T)Stride * ElementCount;
+    BytesToAllocate = YoriLibMaximumAllocationInRange(BytesRequired, BytesDesired);
+    if (BytesToAllocate == 0) {
+        YoriLibReleaseSpinLock(&Pool->Lock);
+        return FALSE;
+    }
+
+    Slab = YoriLibMalloc(BytesToAllocate);
+    if (Slab == NULL) {
+        YoriLibReleaseSpinLock(&Pool->Lock);
+        return FALSE;
+    }
+
+    Slab->Next = Pool->FirstSlab;
+    Pool->FirstSlab = Slab;
+    Pool->SlabsAllocated++;
+
+    YoriLibReleaseSpinLock(&Pool->Lock);
+
+    Cache->Slab = Slab;
+    Cache->SlabElementsUsed = 0;
+    Cache->SlabElementCount = (BytesToAllocate - YORI_LIB_POOL_SLAB_HEADER_SIZE) / Stride;
+    return TRUE;
+}
+
+/**
+ Allocate a fixed size element from a pool.  A pool which has been zeroed is
+ ready for use, and the size of its elements is determined by the first
+ allocation.  Each thread allocates from and frees to one of a small number
+ of caches within the pool, so threads rarely contend with each other, and
+ an element can be freed from a different thread to the one that allocated
+ it.
+
+ @param Pool Pointer to the pool to allocate from.
+
+ @param SizeInBytes The size of the element to allocate.  This must be the
+        same for every allocation from a pool.
+
+ @return Pointer to the newly allocated element, or NULL on allocation
+         failure or if the size does not match previous allocations.
+ */
+PVOID
+YoriLibPoolAlloc(
+    __inout PYORI_LIB_POOL Pool,
+    __in YORI_ALLOC_SIZE_T SizeInBytes
+    )
+{
+    PYORI_LIB_POOL_CACHE Cache;
+    PYORI_LIB_POOL_ELEMENT_HEADER Header;
+    PVOID Element;
+
+    if (Pool->ElementSize != 0 &&
+        Pool->ElementSize != SizeInBytes) {
+
+        return NULL;
+    }
+
+    Cache = YoriLibPoolGetCache(Pool);
+    YoriLibAcquireSpinLock(&Cache->Lock);
+
+    Element = Cache->FreeList;
+    if (Element != NULL) {
+        Cache->FreeList = *(PVOID *)Element;
+    } else {
+        if (Cache->SlabElementsUsed == Cache->SlabElementCount) {
+            if (!YoriLibPoolAllocateSlab(Pool, Cache, SizeInBytes)) {
+                YoriLibReleaseSpinLock(&Cache->Lock);
+                return NULL;
+            }
+        }
+
+        Header = YoriLibAddToPointer(Cache->Slab, YORI_LIB_POOL_SLAB_HEADER_SIZE + Cache->SlabElementsUsed * YoriLibPoolElementStride(Pool));
+        Header->Pool = Pool;
+        Cache->SlabElementsUsed++;
+        Element = YoriLibAddToPointer(Header, YORI_LIB_POOL_ELEMENT_HEADER_SIZE);
+    }
+
+    YoriLibReleaseSpinLock(&Cache->Lock);
+    InterlockedIncrement((INTERLOCKED_VOLATILE LONG *)&Pool->ElementsAllocated);
+    return Element;
+}
+
+/**
+ Free an element that was previously allocated with @ref YoriLibPoolAlloc .
+ The element is retained by the pool to satisfy a later allocation.
+
+ @param Ptr Pointer to the element to free.
+ */
+VOID
+YoriLibPoolFree(
+    __in PVOID Ptr
+    )
+{
+    PYORI_LIB_POOL_ELEMENT_HEADER Header;
+    PYORI_LIB_POOL_CACHE Cache;
+    PYORI_LIB_POOL Pool;
+
+    Header = YoriLibSubtractFromPointer(Ptr, YORI_LIB_POOL_ELEMENT_HEADER_SIZE);
+    Pool = Header->Pool;
+
+    Cache = YoriLibPoolGetCache(Pool);
+    YoriLibAcquireSpinLock(&Cache->Lock);
+    *(PVOID *)Ptr = Cache->FreeList;
+    Cache->FreeList = Ptr;
+    YoriLibReleaseSpinLock(&Cache->Lock);
+
+    InterlockedDecrement((INTERLOCKED_VOLATILE LONG *)&Pool->ElementsAllocated);
+}
+
+/**
+ Release the memory owned by a pool, returning it to the state it was in
+ before any allocations.  This must not be called while another thread may
+ be using the pool.  If any elements are still allocated, the memory is
+ retained so that those elements remain valid.
+
+ @param Pool Pointer to the pool to clean up.
+
+ @return TRUE to indicate the memory was released, FALSE if elements are
+         still allocated.
+ */
+BOOL
+YoriLibCleanupPool(
+    __inout PYORI_LIB_POOL Pool
+    )
+{
+    PYORI_LIB_POOL_SLAB Slab;
+    PYORI_LIB_POOL_SLAB NextSlab;
+
+    if (Pool->ElementsAllocated != 0) {
+        return FALSE;
+    }
+
+    Slab = Pool->FirstSlab;
+    while (Slab != NULL) {
+        NextSlab = Slab->Next;
+        YoriLibFree(Slab);
+        Slab = NextSlab;
+    }
+
+    ZeroMemory(Pool, sizeof(YORI_LIB_POOL));
+    return TRUE;
+}
 
 // vim:sw=4:ts=4:et:
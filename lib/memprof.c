@@ -0,0 +1,710 @@
+/**
+ * @file lib/memprof.c
+ *
+ * Yori allocation profiling routines
+ *
+ * Copyright (c) 2018 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "yoripch.h"
+#include "yorilib.h"
+
+/**
+ The number of call sites that can be recorded.  This must be a power of
+ two.  Allocations from call sites that cannot be recorded are attributed
+ to a single overflow site.
+ */
+#define YORI_LIB_ALLOC_PROFILE_SITES (0x1000)
+
+/**
+ The number of call site slots to search before giving up and using the
+ overflow site.
+ */
+#define YORI_LIB_ALLOC_PROFILE_SITE_PROBES (0x40)
+
+/**
+ The number of stack frames recorded for each call site, starting with the
+ code which called the allocator.  Allocations made through helpers such as
+ YoriLibAllocateString are distinguished by the frames above the helper.
+ */
+#define YORI_LIB_ALLOC_PROFILE_FRAMES (4)
+
+/**
+ The number of stack frames captured when searching for the code which
+ called the allocator.  This includes frames within the allocator and the
+ profiler, whose number depends on inlining.
+ */
+#define YORI_LIB_ALLOC_PROFILE_CAPTURE_FRAMES (YORI_LIB_ALLOC_PROFILE_FRAMES + 4)
+
+/**
+ The number of hash buckets used to find outstanding allocations.  This must
+ be a power of two.
+ */
+#define YORI_LIB_ALLOC_PROFILE_BUCKETS (0x10000)
+
+/**
+ The number of outstanding allocation records to allocate from the heap at a
+ time.
+ */
+#define YORI_LIB_ALLOC_PROFILE_LIVE_BLOCK (0x100)
+
+/**
+ The number of lifetime ranges recorded for each call site.
+ */
+#define YORI_LIB_ALLOC_PROFILE_LIFETIMES (8)
+
+/**
+ The upper bound, in milliseconds, of each lifetime range except the last,
+ which contains everything longer.
+ */
+CONST DWORD YoriLibAllocProfileLifetimeLimits[YORI_LIB_ALLOC_PROFILE_LIFETIMES - 1] = {
+    1,
+    10,
+    100,
+    1000,
+    10 * 1000,
+    60 * 1000,
+    60 * 60 * 1000
+};
+
+/**
+ Information about allocations made from a single call site.
+ */
+typedef struct _YORI_LIB_ALLOC_PROFILE_SITE {
+
+    /**
+     The return addresses of the stack when the allocation was made.  The
+     first is the code address that called the allocator, or NULL for the
+     overflow site.  Later entries are the code that called each previous
+     entry, or NULL if the stack could not be captured.
+     */
+    PVOID Frames[YORI_LIB_ALLOC_PROFILE_FRAMES];
+
+    /**
+     The number of allocations made from this site.
+     */
+    DWORDLONG Allocations;
+
+    /**
+     The number of allocations from this site that have been freed.
+     */
+    DWORDLONG Frees;
+
+    /**
+     The total number of bytes allocated from this site.
+     */
+    DWORDLONG BytesAllocated;
+
+    /**
+     The number of bytes allocated from this site that have not been freed.
+     */
+    DWORDLONG LiveBytes;
+
+    /**
+     The number of freed allocations whose lifetime fell within each range
+     described by YoriLibAllocProfileLifetimeLimits.
+     */
+    DWORDLONG Lifetimes[YORI_LIB_ALLOC_PROFILE_LIFETIMES];
+} YORI_LIB_ALLOC_PROFILE_SITE, *PYORI_LIB_ALLOC_PROFILE_SITE;
+
+/**
+ A record of an allocation that has not yet been freed.
+ */
+typedef struct _YORI_LIB_ALLOC_PROFILE_LIVE {
+
+    /**
+     The next record in the same hash bucket, or the next free record.
+     */
+    struct _YORI_LIB_ALLOC_PROFILE_LIVE *Next;
+
+    /**
+     The address returned to the caller.
+     */
+    PVOID Allocation;
+
+    /**
+     The call site that made the allocation.
+     */
+    PYORI_LIB_ALLOC_PROFILE_SITE Site;
+
+    /**
+     The tick count when the allocation was made.
+     */
+    DWORD Tick;
+
+    /**
+     The number of bytes in the allocation.
+     */
+    YORI_ALLOC_SIZE_T Bytes;
+} YORI_LIB_ALLOC_PROFILE_LIVE, *PYORI_LIB_ALLOC_PROFILE_LIVE;
+
+/**
+ Process global state for the allocation profiler.
+ */
+typedef struct _YORI_LIB_ALLOC_PROFILE {
+
+    /**
+     Nonzero if a thread is currently updating the profile.
+     */
+    LONG Lock;
+
+    /**
+     An array of YORI_LIB_ALLOC_PROFILE_SITES call sites, indexed by a hash
+     of the caller.
+     */
+    PYORI_LIB_ALLOC_PROFILE_SITE Sites;
+
+    /**
+     The site that allocations are attributed to if the Sites array has no
+     space for their caller.
+     */
+    YORI_LIB_ALLOC_PROFILE_SITE OverflowSite;
+
+    /**
+     An array of YORI_LIB_ALLOC_PROFILE_BUCKETS lists of outstanding
+     allocations, indexed by a hash of the allocation address.
+     */
+    PYORI_LIB_ALLOC_PROFILE_LIVE *Buckets;
+
+    /**
+     A list of records which can be used for new outstanding allocations.
+     */
+    PYORI_LIB_ALLOC_PROFILE_LIVE FreeRecords;
+
+    /**
+     The file that the profile was last written to, or will be written to
+     on exit.
+     */
+    TCHAR FileName[MAX_PATH];
+} YORI_LIB_ALLOC_PROFILE, *PYORI_LIB_ALLOC_PROFILE;
+
+/**
+ Process global state for the allocation profiler.
+ */
+YORI_LIB_ALLOC_PROFILE YoriLibAllocProfile;
+
+/**
+ Set to TRUE once the allocation profiler has been started.  This is checked
+ by the allocator before calling the profiler, and is never cleared.
+ */
+BOOLEAN YoriLibAllocationProfileActive;
+
+/**
+ Capture the stack of the code which called the allocator.
+
+ @param Caller The code address that called the allocator, or NULL if it
+        could not be determined.
+
+ @param Frames On completion, populated with the return addresses of the
+        stack, starting with Caller.  Frames that could not be captured are
+        set to NULL.
+ */
+VOID
+YoriLibAllocationProfileCaptureStack(
+    __in_opt PVOID Caller,
+    __out_ecount(YORI_LIB_ALLOC_PROFILE_FRAMES) PVOID * Frames
+    )
+{
+    PVOID Captured[YORI_LIB_ALLOC_PROFILE_CAPTURE_FRAMES];
+    WORD CapturedCount;
+    WORD Start;
+    WORD Index;
+
+    ZeroMemory(Frames, YORI_LIB_ALLOC_PROFILE_FRAMES * sizeof(PVOID));
+    Frames[0] = Caller;
+
+    if (Caller == NULL || DllKernel32.pRtlCaptureStackBackTrace == NULL) {
+        return;
+    }
+
+    //
+    //  The number of frames within the allocator depends on how it was
+    //  compiled, so find the caller within the captured stack and record
+    //  the frames from there.  If it can't be found, only the caller is
+    //  recorded.
+    //
+
+    CapturedCount = DllKernel32.pRtlCaptureStackBackTrace(1, YORI_LIB_ALLOC_PROFILE_CAPTURE_FRAMES, Captured, NULL);
+    for (Start = 0; Start < CapturedCount; Start++) {
+        if (Captured[Start] == Caller) {
+            break;
+        }
+    }
+
+    for (Index = 1; Index < YORI_LIB_ALLOC_PROFILE_FRAMES && Start + Index < CapturedCount; Index++) {
+        Frames[Index] = Captured[Start + Index];
+    }
+}
+
+/**
+ Return the call site record for a stack, creating it if it does not exist.
+ This is called with the profile lock held.
+
+ @param Frames The return addresses of the stack, starting with the code
+        address that called the allocator.
+
+ @return Pointer to the call site record.
+ */
+PYORI_LIB_ALLOC_PROFILE_SITE
+YoriLibAllocationProfileFindSite(
+    __in_ecount(YORI_LIB_ALLOC_PROFILE_FRAMES) PVOID * Frames
+    )
+{
+    PYORI_LIB_ALLOC_PROFILE_SITE Site;
+    DWORD_PTR Hash;
+    DWORD Index;
+    DWORD Probe;
+
+    if (Frames[0] == NULL) {
+        return &YoriLibAllocProfile.OverflowSite;
+    }
+
+    Hash = 0;
+    for (Index = 0; Index < YORI_LIB_ALLOC_PROFILE_FRAMES; Index++) {
+        Hash = (Hash * 31) ^ ((DWORD_PTR)Frames[Index] >> 2);
+    }
+
+    Index = (DWORD)(Hash * 2654435761UL);
+    for (Probe = 0; Probe < YORI_LIB_ALLOC_PROFILE_SITE_PROBES; Probe++) {
+        Site = &YoriLibAllocProfile.Sites[(Index + Probe) & (YORI_LIB_ALLOC_PROFILE_SITES - 1)];
+        if (memcmp(Site->Frames, Frames, sizeof(Site->Frames)) == 0) {
+            return Site;
+        }
+        if (Site->Frames[0] == NULL) {
+            memcpy(Site->Frames, Frames, sizeof(Site->Frames));
+            return Site;
+        }
+    }
+
+    return &YoriLibAllocProfile.OverflowSite;
+}
+
+/**
+ Return the hash bucket that records an outstanding allocation.
+
+ @param Allocation The address returned to the caller.
+
+ @return Pointer to the head of the list for the bucket.
+ */
+PYORI_LIB_ALLOC_PROFILE_LIVE *
+YoriLibAllocationProfileBucket(
+    __in PVOID Allocation
+    )
+{
+    DWORD Index;
+
+    Index = (DWORD)(((DWORD_PTR)Allocation >> 4) * 2654435761UL) >> 16;
+    return &YoriLibAllocProfile.Buckets[Index & (YORI_LIB_ALLOC_PROFILE_BUCKETS - 1)];
+}
+
+/**
+ Record that memory has been allocated.  This is called by the allocator when
+ the profiler is active.  Memory used by the profiler is allocated directly
+ from the heap so that it is not itself profiled.
+
+ @param Allocation The address returned to the caller.
+
+ @param Bytes The number of bytes allocated.
+
+ @param Caller The code address that called the allocator, or NULL if it
+        could not be determined.
+ */
+VOID
+YoriLibAllocationProfileRecordAlloc(
+    __in PVOID Allocation,
+    __in YORI_ALLOC_SIZE_T Bytes,
+    __in_opt PVOID Caller
+    )
+{
+    PYORI_LIB_ALLOC_PROFILE_SITE Site;
+    PYORI_LIB_ALLOC_PROFILE_LIVE Record;
+    PYORI_LIB_ALLOC_PROFILE_LIVE *Bucket;
+    PVOID Frames[YORI_LIB_ALLOC_PROFILE_FRAMES];
+    DWORD Index;
+
+    YoriLibAllocationProfileCaptureStack(Caller, Frames);
+
+    YoriLibAcquireSpinLock(&YoriLibAllocProfile.Lock);
+
+    Site = YoriLibAllocationProfileFindSite(Frames);
+    Site->Allocations++;
+    Site->BytesAllocated += Bytes;
+    Site->LiveBytes += Bytes;
+
+    //
+    //  If there's no record available to track the allocation, get some
+    //  more.  If that fails, the free can't be matched to the allocation,
+    //  so count it as freed now and don't record its lifetime.
+    //
+
+    if (YoriLibAllocProfile.FreeRecords == NULL) {
+        Record = HeapAlloc(GetProcessHeap(), 0, YORI_LIB_ALLOC_PROFILE_LIVE_BLOCK * sizeof(YORI_LIB_ALLOC_PROFILE_LIVE));
+        if (Record == NULL) {
+            Site->Frees++;
+            Site->LiveBytes -= Bytes;
+            YoriLibReleaseSpinLock(&YoriLibAllocProfile.Lock);
+            return;
+        }
+
+        for (Index = 0; Index < YORI_LIB_ALLOC_PROFILE_LIVE_BLOCK; Index++) {
+            Record[Index].Next = YoriLibAllocProfile.FreeRecords;
+            YoriLibAllocProfile.FreeRecords = &Record[Index];
+        }
+    }
+
+    Record = YoriLibAllocProfile.FreeRecords;
+    YoriLibAllocProfile.FreeRecords = Record->Next;
+
+    Record->Allocation = Allocation;
+    Record->Site = Site;
+    Record->Tick = GetTickCount();
+    Record->Bytes = Bytes;
+
+    Bucket = YoriLibAllocationProfileBucket(Allocation);
+    Record->Next = *Bucket;
+    *Bucket = Record;
+
+    YoriLibReleaseSpinLock(&YoriLibAllocProfile.Lock);
+}
+
+/**
+ Record that memory is being freed.  This is called by the allocator when the
+ profiler is active.  Memory which was allocated before the profiler started
+ is ignored.
+
+ @param Allocation The address that was returned to the caller when the
+        memory was allocated.
+ */
+VOID
+YoriLibAllocationProfileRecordFree(
+    __in PVOID Allocation
+    )
+{
+    PYORI_LIB_ALLOC_PROFILE_LIVE Record;
+    PYORI_LIB_ALLOC_PROFILE_LIVE *PreviousLink;
+    PYORI_LIB_ALLOC_PROFILE_SITE Site;
+    DWORD Lifetime;
+    DWORD Index;
+
+    YoriLibAcquireSpinLock(&YoriLibAllocProfile.Lock);
+
+    PreviousLink = YoriLibAllocationProfileBucket(Allocation);
+    Record = *PreviousLink;
+    while (Record != NULL) {
+        if (Record->Allocation == Allocation) {
+            break;
+        }
+        PreviousLink = &Record->Next;
+        Record = Record->Next;
+    }
+
+    if (Record != NULL) {
+        *PreviousLink = Record->Next;
+
+        Site = Record->Site;
+        Site->Frees++;
+        Site->LiveBytes -= Record->Bytes;
+
+        Lifetime = GetTickCount() - Record->Tick;
+        for (Index = 0; Index < YORI_LIB_ALLOC_PROFILE_LIFETIMES - 1; Index++) {
+            if (Lifetime < YoriLibAllocProfileLifetimeLimits[Index]) {
+                break;
+            }
+        }
+        Site->Lifetimes[Index]++;
+
+        Record->Next = YoriLibAllocProfile.FreeRecords;
+        YoriLibAllocProfile.FreeRecords = Record;
+    }
+
+    YoriLibReleaseSpinLock(&YoriLibAllocProfile.Lock);
+}
+
+/**
+ Write a single line of the profile to a file.
+
+ @param hFile Handle to the file.
+
+ @param Line Pointer to the NULL terminated line to write.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibAllocationProfileWriteLine(
+    __in HANDLE hFile,
+    __in LPCSTR Line
+    )
+{
+    DWORD Length;
+    DWORD BytesWritten;
+
+    Length = 0;
+    while (Line[Length] != '\0') {
+        Length++;
+    }
+
+    if (!WriteFile(hFile, Line, Length, &BytesWritten, NULL) ||
+        BytesWritten != Length) {
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Find the module containing a code address and the offset of the address
+ within it.
+
+ @param Address The code address to resolve.
+
+ @param ModuleName Pointer to a buffer which may be used to hold the file
+        name of the module.
+
+ @param ModuleNameSize The size of ModuleName, in bytes.
+
+ @param ModuleFilePart On completion, points to the name of the module,
+        without its path, or "Unknown" if the module could not be found.
+
+ @param Offset On completion, the offset of the address within the module,
+        or the address itself if the module could not be found.
+ */
+VOID
+YoriLibAllocationProfileResolveAddress(
+    __in PVOID Address,
+    __out_bcount(ModuleNameSize) LPSTR ModuleName,
+    __in DWORD ModuleNameSize,
+    __out LPSTR * ModuleFilePart,
+    __out PDWORDLONG Offset
+    )
+{
+    MEMORY_BASIC_INFORMATION MemoryInfo;
+    DWORD_PTR ModuleBase;
+    DWORD Length;
+
+    //
+    //  Find the module containing the address so the offset can be
+    //  resolved against its symbols.  Executable images are mapped as a
+    //  single allocation, so the allocation base is the module base.
+    //
+
+    ModuleBase = 0;
+    *ModuleFilePart = "Unknown";
+    if (Address != NULL &&
+        VirtualQuery(Address, &MemoryInfo, sizeof(MemoryInfo)) != 0) {
+
+        ModuleBase = (DWORD_PTR)MemoryInfo.AllocationBase;
+        Length = GetModuleFileNameA((HMODULE)MemoryInfo.AllocationBase, ModuleName, ModuleNameSize);
+        if (Length > 0 && Length < ModuleNameSize) {
+            *ModuleFilePart = ModuleName;
+            while (Length > 0) {
+                Length--;
+                if (ModuleName[Length] == '\\') {
+                    *ModuleFilePart = &ModuleName[Length + 1];
+                    break;
+                }
+            }
+        }
+    }
+
+    *Offset = (DWORDLONG)((DWORD_PTR)Address - ModuleBase);
+}
+
+/**
+ Write the current allocation profile to a file as comma separated values.
+ Each line describes a call site, identified by the module containing the
+ code which called the allocator and the offset of the return address within
+ that module, followed by the number of allocations, frees, bytes, and
+ the number of freed allocations within each lifetime range.  The final
+ column lists the callers above the call site as module+offset pairs
+ separated by semicolons, so that allocations made through helpers such as
+ YoriLibAllocateString can be attributed to the code using the helper.
+
+ @param FileName Optionally points to the file to write.  If NULL, the file
+        named when the profiler was started, or when the profile was last
+        written, is used.
+
+ @return TRUE to indicate the profile was written, FALSE if the profiler is
+         not active or the file could not be written.
+ */
+__success(return)
+BOOL
+YoriLibWriteAllocationProfile(
+    __in_opt LPCTSTR FileName
+    )
+{
+    PYORI_LIB_ALLOC_PROFILE_SITE Sites;
+    PYORI_LIB_ALLOC_PROFILE_SITE Site;
+    CHAR ModuleName[MAX_PATH];
+    CHAR Line[512];
+    LPSTR ModuleFilePart;
+    DWORDLONG Offset;
+    DWORD SiteCount;
+    DWORD Index;
+    DWORD FrameIndex;
+    HANDLE hFile;
+    BOOL Result;
+
+    if (!YoriLibAllocationProfileActive) {
+        return FALSE;
+    }
+
+    if (FileName == NULL) {
+        FileName = YoriLibAllocProfile.FileName;
+    }
+
+    //
+    //  Take a copy of the sites that have been used so that the file can be
+    //  written without blocking allocations.
+    //
+
+    Sites = HeapAlloc(GetProcessHeap(), 0, (YORI_LIB_ALLOC_PROFILE_SITES + 1) * sizeof(YORI_LIB_ALLOC_PROFILE_SITE));
+    if (Sites == NULL) {
+        return FALSE;
+    }
+
+    YoriLibAcquireSpinLock(&YoriLibAllocProfile.Lock);
+    SiteCount = 0;
+    for (Index = 0; Index < YORI_LIB_ALLOC_PROFILE_SITES; Index++) {
+        if (YoriLibAllocProfile.Sites[Index].Frames[0] != NULL) {
+            memcpy(&Sites[SiteCount], &YoriLibAllocProfile.Sites[Index], sizeof(YORI_LIB_ALLOC_PROFILE_SITE));
+            SiteCount++;
+        }
+    }
+    if (YoriLibAllocProfile.OverflowSite.Allocations > 0) {
+        memcpy(&Sites[SiteCount], &YoriLibAllocProfile.OverflowSite, sizeof(YORI_LIB_ALLOC_PROFILE_SITE));
+        SiteCount++;
+    }
+    YoriLibReleaseSpinLock(&YoriLibAllocProfile.Lock);
+
+    hFile = CreateFile(FileName, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        HeapFree(GetProcessHeap(), 0, Sites);
+        return FALSE;
+    }
+
+    Result = YoriLibAllocationProfileWriteLine(hFile, "Module,Offset,Allocations,Frees,BytesAllocated,LiveAllocations,LiveBytes,Lifetime<1ms,Lifetime<10ms,Lifetime<100ms,Lifetime<1s,Lifetime<10s,Lifetime<1m,Lifetime<1h,Lifetime>=1h,Callers\r\n");
+
+    for (Index = 0; Result && Index < SiteCount; Index++) {
+        Site = &Sites[Index];
+
+        YoriLibAllocationProfileResolveAddress(Site->Frames[0], ModuleName, sizeof(ModuleName), &ModuleFilePart, &Offset);
+
+        YoriLibSPrintfSA(Line,
+                         sizeof(Line),
+                         "%s,0x%llx,%lli,%lli,%lli,%lli,%lli,%lli,%lli,%lli,%lli,%lli,%lli,%lli,%lli,",
+                         ModuleFilePart,
+                         Offset,
+                         Site->Allocations,
+                         Site->Frees,
+                         Site->BytesAllocated,
+                         Site->Allocations - Site->Frees,
+                         Site->LiveBytes,
+                         Site->Lifetimes[0],
+                         Site->Lifetimes[1],
+                         Site->Lifetimes[2],
+                         Site->Lifetimes[3],
+                         Site->Lifetimes[4],
+                         Site->Lifetimes[5],
+                         Site->Lifetimes[6],
+                         Site->Lifetimes[7]);
+
+        Result = YoriLibAllocationProfileWriteLine(hFile, Line);
+
+        for (FrameIndex = 1; Result && FrameIndex < YORI_LIB_ALLOC_PROFILE_FRAMES; FrameIndex++) {
+            if (Site->Frames[FrameIndex] == NULL) {
+                break;
+            }
+
+            YoriLibAllocationProfileResolveAddress(Site->Frames[FrameIndex], ModuleName, sizeof(ModuleName), &ModuleFilePart, &Offset);
+            YoriLibSPrintfSA(Line,
+                             sizeof(Line),
+                             "%s%s+0x%llx",
+                             (FrameIndex > 1)?";":"",
+                             ModuleFilePart,
+                             Offset);
+            Result = YoriLibAllocationProfileWriteLine(hFile, Line);
+        }
+
+        if (Result) {
+            Result = YoriLibAllocationProfileWriteLine(hFile, "\r\n");
+        }
+    }
+
+    CloseHandle(hFile);
+    HeapFree(GetProcessHeap(), 0, Sites);
+
+    if (Result && FileName != YoriLibAllocProfile.FileName) {
+        YoriLibSPrintfS(YoriLibAllocProfile.FileName, sizeof(YoriLibAllocProfile.FileName)/sizeof(YoriLibAllocProfile.FileName[0]), _T("%s"), FileName);
+    }
+
+    return Result;
+}
+
+/**
+ Check the YORIALLOCPROFILE environment variable.  If it is set and the
+ profiler is not active, start profiling allocations, and write the profile
+ to the named file when @ref YoriLibWriteAllocationProfile is called on
+ exit.  This is only called by processes which want to be profiled, so that
+ child processes inheriting the variable don't overwrite the profile.  If
+ the profiler is active and the variable names a different file to the one
+ last written, write the current profile to the new file.  This allows a
+ long running process to start profiling, and to take a snapshot of the
+ profile, by changing the variable.
+ */
+VOID
+YoriLibCheckAllocationProfileEnvironment(VOID)
+{
+    TCHAR FileName[MAX_PATH];
+    YORI_STRING PreviousFileName;
+    DWORD Length;
+
+    Length = GetEnvironmentVariable(_T("YORIALLOCPROFILE"), FileName, sizeof(FileName)/sizeof(FileName[0]));
+    if (Length == 0 || Length >= sizeof(FileName)/sizeof(FileName[0])) {
+        return;
+    }
+
+    if (YoriLibAllocationProfileActive) {
+        YoriLibConstantString(&PreviousFileName, YoriLibAllocProfile.FileName);
+        if (YoriLibCompareStringLitIns(&PreviousFileName, FileName) != 0) {
+            YoriLibWriteAllocationProfile(FileName);
+        }
+        return;
+    }
+
+    YoriLibAllocProfile.Sites = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, YORI_LIB_ALLOC_PROFILE_SITES * sizeof(YORI_LIB_ALLOC_PROFILE_SITE));
+    if (YoriLibAllocProfile.Sites == NULL) {
+        return;
+    }
+
+    YoriLibAllocProfile.Buckets = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, YORI_LIB_ALLOC_PROFILE_BUCKETS * sizeof(PYORI_LIB_ALLOC_PROFILE_LIVE));
+    if (YoriLibAllocProfile.Buckets == NULL) {
+        HeapFree(GetProcessHeap(), 0, YoriLibAllocProfile.Sites);
+        YoriLibAllocProfile.Sites = NULL;
+        return;
+    }
+
+    YoriLibSPrintfS(YoriLibAllocProfile.FileName, sizeof(YoriLibAllocProfile.FileName)/sizeof(YoriLibAllocProfile.FileName[0]), _T("%s"), FileName);
+    YoriLibAllocationProfileActive = TRUE;
+}
+
+// vim:sw=4:ts=4:et:
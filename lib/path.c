@@ -92,6 +92,50 @@ FindFirstNonDirectoryFile(
     return Handle;
 }
 
+/**
+ Determine whether a file name can be found using the path index.  The index
+ can find a file by its exact name or enumerate files by prefix, so a name
+ containing any other wildcard, or a path component, is resolved by the file
+ system.
+
+ @param FileName Pointer to the file name.
+
+ @param AllowTrailingWildcard If TRUE, the file name may end in an asterisk
+        to indicate a prefix match.
+
+ @return TRUE if the path index can be used to find the file name, FALSE if
+         it cannot.
+ */
+BOOLEAN
+YoriLibPathCanUseIndex(
+    __in PCYORI_STRING FileName,
+    __in BOOLEAN AllowTrailingWildcard
+    )
+{
+    YORI_ALLOC_SIZE_T Index;
+    YORI_ALLOC_SIZE_T Length;
+
+    Length = FileName->LengthInChars;
+    if (AllowTrailingWildcard &&
+        Length > 0 &&
+        FileName->StartOfString[Length - 1] == '*') {
+
+        Length--;
+    }
+
+    for (Index = 0; Index < Length; Index++) {
+        if (FileName->StartOfString[Index] == '*' ||
+            FileName->StartOfString[Index] == '?' ||
+            FileName->StartOfString[Index] == ':' ||
+            YoriLibIsSep(FileName->StartOfString[Index])) {
+
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
 /**
  Searches an environment variable with semicolon delimited elements for a file
  name match.
@@ -132,6 +176,10 @@ YoriLibSearchEnv(
     HANDLE hFind;
     WIN32_FIND_DATA FindData;
     LPTSTR fn;
+    YORI_STRING Component;
+    PVOID IndexDirectory;
+    BOOLEAN UseIndex;
+    BOOL Found;
 
     ASSERT(YoriLibIsStringNullTerminated(FileName));
     ASSERT(YoriLibIsStringNullTerminated(EnvVarData));
@@ -170,6 +218,7 @@ YoriLibSearchEnv(
 
     Out->StartOfString[0] = '\0';
 
+    UseIndex = YoriLibPathCanUseIndex(FileName, FALSE);
     begin = EnvVarData->StartOfString;
 
     while (*begin == ';') begin++;
@@ -201,10 +250,26 @@ YoriLibSearchEnv(
             YoriLibSPrintf(ScratchArea->StartOfString + componentlen + 1, _T("%y"), FileName);
             ScratchArea->LengthInChars = componentlen + 1 + FileName->LengthInChars;
 
-            hFind = FindFirstNonDirectoryFile(ScratchArea->StartOfString, &FindData);
+            IndexDirectory = NULL;
+            if (UseIndex) {
+                YoriLibInitEmptyString(&Component);
+                Component.StartOfString = (LPTSTR)begin;
+                Component.LengthInChars = componentlen;
+                IndexDirectory = YoriLibPathIndexFindDirectory(&Component);
+            }
+
+            Found = FALSE;
+            if (IndexDirectory != NULL) {
+                Found = YoriLibPathIndexFindFile(IndexDirectory, FileName, NULL, &FindData);
+            } else {
+                hFind = FindFirstNonDirectoryFile(ScratchArea->StartOfString, &FindData);
+                if (hFind != INVALID_HANDLE_VALUE) {
+                    FindClose(hFind);
+                    Found = TRUE;
+                }
+            }
 
-            if (hFind != INVALID_HANDLE_VALUE) {
-                FindClose(hFind);
+            if (Found) {
                 if (!YoriLibGetFullPathNameAlloc(ScratchArea, FullPath, Out, &fn) || fn == NULL) {
                     Out->LengthInChars = 0;
                     Out->StartOfString[0] = '\0';
@@ -513,9 +578,13 @@ YoriLibLocateFileExtensionsInOnePath(
     WIN32_FIND_DATA FindData;
     WIN32_FIND_DATA *PathExtMatches;
     YORI_STRING SearchName;
+    YORI_STRING Prefix;
     BOOLEAN PartialMatchOkay;
     BOOLEAN NeedsSeperator;
+    BOOL MoreFiles;
     YORI_ALLOC_SIZE_T Count;
+    PVOID IndexDirectory;
+    PVOID IndexContext;
 
     //
     //  If we can't possibly do anything, stop.
@@ -615,19 +684,50 @@ YoriLibLocateFileExtensionsInOnePath(
     }
 
     //
-    //  Search the directory for all files with this prefix.
+    //  If the directory is in the path index, use its cached contents.  An
+    //  exact match only needs a lookup for each extension; a partial match
+    //  walks the cached files with the requested prefix.  Otherwise, search
+    //  the directory for all files with this prefix.
     //
 
-    hFind = FindFirstNonDirectoryFile(SearchName.StartOfString, &FindData);
-    if (hFind == INVALID_HANDLE_VALUE) {
-        return TRUE;
+    hFind = INVALID_HANDLE_VALUE;
+    IndexContext = NULL;
+    IndexDirectory = NULL;
+    if (YoriLibPathCanUseIndex(FileName, TRUE)) {
+        IndexDirectory = YoriLibPathIndexFindDirectory(SearchPath);
+    }
+
+    YoriLibInitEmptyString(&Prefix);
+    Prefix.StartOfString = FileName->StartOfString;
+    Prefix.LengthInChars = FileName->LengthInChars;
+    if (PartialMatchOkay) {
+        Prefix.LengthInChars--;
+    }
+
+    if (IndexDirectory != NULL) {
+        MoreFiles = FALSE;
+        if (PartialMatchOkay) {
+            MoreFiles = YoriLibPathIndexFindNextPrefix(IndexDirectory, &Prefix, &IndexContext, &FindData);
+        } else {
+            for (Count = 0; Count < PathExtCount; Count++) {
+                if (YoriLibPathIndexFindFile(IndexDirectory, FileName, &PathExtData[Count].Extension, &PathExtMatches[Count])) {
+                    PathExtData[Count].Found = TRUE;
+                }
+            }
+        }
+    } else {
+        hFind = FindFirstNonDirectoryFile(SearchName.StartOfString, &FindData);
+        if (hFind == INVALID_HANDLE_VALUE) {
+            return TRUE;
+        }
+        MoreFiles = TRUE;
     }
 
     //
     //  For every file we find in the pathext list, mark it as found.
     //
 
-    do {
+    while (MoreFiles) {
         FileNameLen = (YORI_ALLOC_SIZE_T)_tcslen(FindData.cFileName);
         for (Count = 0; Count < PathExtCount; Count++) {
             if (!PathExtData[Count].Found &&
@@ -652,7 +752,9 @@ YoriLibLocateFileExtensionsInOnePath(
 
                         ChildPathExtComponents = YoriLibPathBuildPathExtComponentList(&ChildPathExtCount);
                         if (ChildPathExtComponents == NULL) {
-                            FindClose(hFind);
+                            if (hFind != INVALID_HANDLE_VALUE) {
+                                FindClose(hFind);
+                            }
                             return FALSE;
                         }
 
@@ -673,7 +775,9 @@ YoriLibLocateFileExtensionsInOnePath(
 
                             YoriLibPathFreePathExtComponents(ChildPathExtComponents, ChildPathExtCount);
                             YoriLibFreeStringContents(&ChildScratchArea);
-                            FindClose(hFind);
+                            if (hFind != INVALID_HANDLE_VALUE) {
+                                FindClose(hFind);
+                            }
                             return FALSE;
                         }
 
@@ -689,9 +793,16 @@ YoriLibLocateFileExtensionsInOnePath(
             }
         }
 
-    } while(FindNextNonDirectoryFile(hFind, &FindData));
+        if (IndexDirectory != NULL) {
+            MoreFiles = YoriLibPathIndexFindNextPrefix(IndexDirectory, &Prefix, &IndexContext, &FindData);
+        } else {
+            MoreFiles = FindNextNonDirectoryFile(hFind, &FindData);
+        }
+    }
 
-    FindClose(hFind);
+    if (hFind != INVALID_HANDLE_VALUE) {
+        FindClose(hFind);
+    }
 
     if (MatchAllCallback != NULL) {
         for (Count = 0; Count < PathExtCount; Count++) {
@@ -1022,8 +1133,8 @@ YoriLibPathLocateKnownExtensionUnknownLocation(
 
 /**
  Search for a file name within the path.  If it's found, output the string
- matching.  The caller is expected to free this string with
- @ref YoriLibDereference .
+ matching.  This is the body of @ref YoriLibLocateExecutableInPath , which
+ is invoked once the path index is ready for use.
 
  @param SearchFor The file name to search for.
 
@@ -1040,7 +1151,7 @@ YoriLibPathLocateKnownExtensionUnknownLocation(
  */
 __success(return)
 BOOLEAN
-YoriLibLocateExecutableInPath(
+YoriLibLocateExecutableInPathWorker(
     __in PYORI_STRING SearchFor,
     __in_opt PYORI_LIB_PATH_MATCH_FN MatchAllCallback,
     __in_opt PVOID MatchAllContext,
@@ -1226,4 +1337,44 @@ YoriLibLocateExecutableInPath(
     return TRUE;
 }
 
+/**
+ Search for a file name within the path.  If it's found, output the string
+ matching.  The caller is expected to free this string with
+ @ref YoriLibDereference .  If the path index is enabled, directories in
+ PATH are searched using their cached contents.
+
+ @param SearchFor The file name to search for.
+
+ @param MatchAllCallback An optional callback to invoke each time a
+        candidate match is found.
+
+ @param MatchAllContext Context information to supply to MatchAllCallback
+        if it is specified.
+
+ @param PathName On successful completion, updated to point to a newly
+        allocated string matching the next match.
+
+ @return TRUE to indicate a match was found, FALSE if it was not.
+ */
+__success(return)
+BOOLEAN
+YoriLibLocateExecutableInPath(
+    __in PYORI_STRING SearchFor,
+    __in_opt PYORI_LIB_PATH_MATCH_FN MatchAllCallback,
+    __in_opt PVOID MatchAllContext,
+    __out _When_(MatchAllCallback != NULL, _Post_invalid_) PYORI_STRING PathName
+    )
+{
+    LARGE_INTEGER StartTime;
+    BOOLEAN Result;
+
+    if (!YoriLibPathIndexBeginLookup(&StartTime)) {
+        return YoriLibLocateExecutableInPathWorker(SearchFor, MatchAllCallback, MatchAllContext, PathName);
+    }
+
+    Result = YoriLibLocateExecutableInPathWorker(SearchFor, MatchAllCallback, MatchAllContext, PathName);
+    YoriLibPathIndexEndLookup(&StartTime);
+    return Result;
+}
+
 // vim:sw=4:ts=4:et:
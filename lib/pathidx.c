@@ -0,0 +1,984 @@
+/**
+ * @file lib/pathidx.c
+ *
+ * Yori cache of executable files within PATH directories
+ *
+ * Copyright (c) 2018 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "yoripch.h"
+#include "yorilib.h"
+
+/**
+ The number of milliseconds after which the contents of a directory which
+ cannot be monitored for changes are enumerated again.
+ */
+#define YORI_LIB_PATH_INDEX_UNWATCHED_REFRESH (30 * 1000)
+
+/**
+ The initial number of hash buckets used to find files within a directory.
+ */
+#define YORI_LIB_PATH_INDEX_FILE_BUCKETS (64)
+
+/**
+ The initial number of hash buckets used to find directories.
+ */
+#define YORI_LIB_PATH_INDEX_DIRECTORY_BUCKETS (32)
+
+/**
+ A single file found within an indexed directory.  These are allocated from
+ the arena of the directory, so they are all released together when the
+ directory is enumerated again.
+ */
+typedef struct _YORI_LIB_PATH_INDEX_FILE {
+
+    /**
+     The link of this file within the list of files in the directory.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The entry used to find the file by its long name.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The entry used to find the file by its short name.  The HashTable
+     member is NULL if the file has no distinct short name.
+     */
+    YORI_HASH_ENTRY ShortNameHashEntry;
+
+    /**
+     The long name of the file.
+     */
+    YORI_STRING FileName;
+
+    /**
+     The short name of the file, if it has one which differs from the
+     long name.
+     */
+    YORI_STRING ShortName;
+
+    /**
+     The attributes of the file when it was enumerated.
+     */
+    DWORD FileAttributes;
+} YORI_LIB_PATH_INDEX_FILE, *PYORI_LIB_PATH_INDEX_FILE;
+
+/**
+ A directory from the PATH environment variable whose contents can be
+ cached.
+ */
+typedef struct _YORI_LIB_PATH_INDEX_DIRECTORY {
+
+    /**
+     The link of this directory within the list of indexed directories.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The entry used to find this directory by name.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The name of the directory as it is found in PATH.  This is NULL
+     terminated and its memory follows this structure.
+     */
+    YORI_STRING Path;
+
+    /**
+     A handle which is signalled when files are created, deleted or renamed
+     within the directory, or INVALID_HANDLE_VALUE if the directory is not
+     being monitored.
+     */
+    HANDLE ChangeNotification;
+
+    /**
+     A hash table of files within the directory, keyed by file name.
+     */
+    PYORI_HASH_TABLE Files;
+
+    /**
+     A list of files within the directory, used to search for files by
+     prefix.
+     */
+    YORI_LIST_ENTRY FileList;
+
+    /**
+     The arena that file entries are allocated from.
+     */
+    YORI_LIB_ARENA Arena;
+
+    /**
+     The number of files within the directory.
+     */
+    DWORD FileCount;
+
+    /**
+     The tick count when the directory was last enumerated.
+     */
+    DWORD PopulatedTick;
+
+    /**
+     The lookup generation when the cached contents were last checked for
+     changes.  Contents are checked at most once per lookup so that a lookup
+     which is enumerating the directory cannot see it change.
+     */
+    DWORD ValidatedGeneration;
+
+    /**
+     TRUE if the directory has been enumerated and FileList describes its
+     contents.
+     */
+    BOOLEAN Populated;
+
+    /**
+     Set while applying a new PATH value to indicate that the directory is
+     still referenced by it.
+     */
+    BOOLEAN InPath;
+} YORI_LIB_PATH_INDEX_DIRECTORY, *PYORI_LIB_PATH_INDEX_DIRECTORY;
+
+/**
+ The global state of the path index.
+ */
+typedef struct _YORI_LIB_PATH_INDEX {
+
+    /**
+     A lock held for the duration of a lookup.  Lookups from other threads
+     while the lock is held bypass the index.
+     */
+    LONG Lock;
+
+    /**
+     The thread performing the current lookup, or zero if no lookup is
+     in progress.
+     */
+    DWORD OwningThreadId;
+
+    /**
+     Incremented for each lookup.
+     */
+    DWORD Generation;
+
+    /**
+     TRUE if the index should be used by lookups.
+     */
+    BOOLEAN Enabled;
+
+    /**
+     TRUE if PathValue has been captured from the environment.
+     */
+    BOOLEAN PathInitialized;
+
+    /**
+     A hash table of indexed directories, keyed by the directory name.
+     */
+    PYORI_HASH_TABLE Directories;
+
+    /**
+     A list of indexed directories.
+     */
+    YORI_LIST_ENTRY DirectoryList;
+
+    /**
+     The value of the PATH environment variable that the set of indexed
+     directories was built from.
+     */
+    YORI_STRING PathValue;
+
+    /**
+     A buffer used to read the PATH environment variable to check whether
+     it has changed.
+     */
+    YORI_STRING PathScratch;
+
+    /**
+     The frequency of the performance counter, used to measure lookups.
+     */
+    LARGE_INTEGER Frequency;
+
+    /**
+     Counters describing the effectiveness of the index.
+     */
+    YORI_LIB_PATH_INDEX_STATISTICS Stats;
+} YORI_LIB_PATH_INDEX, *PYORI_LIB_PATH_INDEX;
+
+/**
+ The path index for the process.
+ */
+YORI_LIB_PATH_INDEX YoriLibPathIndex;
+
+/**
+ Discard the cached contents of a directory.  The directory remains indexed
+ and will be enumerated again when next used.
+
+ @param Directory Pointer to the directory.
+ */
+VOID
+YoriLibPathIndexDiscardFiles(
+    __inout PYORI_LIB_PATH_INDEX_DIRECTORY Directory
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIB_PATH_INDEX_FILE File;
+
+    ListEntry = YoriLibGetNextListEntry(&Directory->FileList, NULL);
+    while (ListEntry != NULL) {
+        File = CONTAINING_RECORD(ListEntry, YORI_LIB_PATH_INDEX_FILE, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&Directory->FileList, ListEntry);
+
+        YoriLibHashRemoveByEntry(&File->HashEntry);
+        if (File->ShortNameHashEntry.HashTable != NULL) {
+            YoriLibHashRemoveByEntry(&File->ShortNameHashEntry);
+        }
+    }
+
+    YoriLibInitializeListHead(&Directory->FileList);
+    YoriLibResetArena(&Directory->Arena);
+    Directory->FileCount = 0;
+    Directory->Populated = FALSE;
+}
+
+/**
+ Allocate a copy of a string from the arena of a directory.
+
+ @param Directory Pointer to the directory.
+
+ @param Source Pointer to the NULL terminated string to copy.
+
+ @param String On successful completion, updated to describe the copy.  The
+        string does not hold a reference, so it remains valid until the
+        contents of the directory are discarded.
+
+ @return TRUE to indicate success, FALSE on allocation failure.
+ */
+__success(return)
+BOOL
+YoriLibPathIndexCopyName(
+    __inout PYORI_LIB_PATH_INDEX_DIRECTORY Directory,
+    __in LPCTSTR Source,
+    __out PYORI_STRING String
+    )
+{
+    YORI_ALLOC_SIZE_T Length;
+
+    YoriLibInitEmptyString(String);
+    Length = (YORI_ALLOC_SIZE_T)_tcslen(Source);
+    String->StartOfString = YoriLibArenaAlloc(&Directory->Arena, (Length + 1) * sizeof(TCHAR), NULL);
+    if (String->StartOfString == NULL) {
+        return FALSE;
+    }
+
+    memcpy(String->StartOfString, Source, (Length + 1) * sizeof(TCHAR));
+    String->LengthInChars = Length;
+    String->LengthAllocated = Length + 1;
+    return TRUE;
+}
+
+/**
+ Enumerate the contents of a directory and record every file within it.
+ Before enumerating, a change notification is registered so that any
+ change made during or after the enumeration is detected.
+
+ @param Directory Pointer to the directory.
+
+ @return TRUE if the directory was enumerated, or FALSE if its contents
+         could not be determined and the caller should query the file
+         system directly.
+ */
+__success(return)
+BOOL
+YoriLibPathIndexPopulate(
+    __inout PYORI_LIB_PATH_INDEX_DIRECTORY Directory
+    )
+{
+    YORI_STRING SearchName;
+    WIN32_FIND_DATA FindData;
+    HANDLE hFind;
+    DWORD Err;
+    PYORI_LIB_PATH_INDEX_FILE File;
+    BOOLEAN AllocationFailed;
+
+    ASSERT(!Directory->Populated);
+
+    if (Directory->ChangeNotification == INVALID_HANDLE_VALUE) {
+        Directory->ChangeNotification = FindFirstChangeNotification(Directory->Path.StartOfString, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME);
+    }
+
+    if (!YoriLibAllocateString(&SearchName, Directory->Path.LengthInChars + sizeof("\\*"))) {
+        return FALSE;
+    }
+
+    if (YoriLibIsSep(Directory->Path.StartOfString[Directory->Path.LengthInChars - 1])) {
+        SearchName.LengthInChars = YoriLibSPrintf(SearchName.StartOfString, _T("%y*"), &Directory->Path);
+    } else {
+        SearchName.LengthInChars = YoriLibSPrintf(SearchName.StartOfString, _T("%y\\*"), &Directory->Path);
+    }
+
+    Directory->PopulatedTick = GetTickCount();
+    YoriLibPathIndex.Stats.Enumerations++;
+
+    hFind = FindFirstFile(SearchName.StartOfString, &FindData);
+    YoriLibFreeStringContents(&SearchName);
+
+    //
+    //  If the directory doesn't exist, remember that it is empty.  Any
+    //  other failure, such as a network error, is not cached.
+    //
+
+    if (hFind == INVALID_HANDLE_VALUE) {
+        Err = GetLastError();
+        if (Err == ERROR_FILE_NOT_FOUND || Err == ERROR_PATH_NOT_FOUND) {
+            Directory->Populated = TRUE;
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    AllocationFailed = FALSE;
+    do {
+        if ((FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+            continue;
+        }
+
+        File = YoriLibArenaAlloc(&Directory->Arena, sizeof(YORI_LIB_PATH_INDEX_FILE), NULL);
+        if (File == NULL) {
+            AllocationFailed = TRUE;
+            break;
+        }
+
+        if (!YoriLibPathIndexCopyName(Directory, FindData.cFileName, &File->FileName)) {
+            AllocationFailed = TRUE;
+            break;
+        }
+
+        YoriLibInitEmptyString(&File->ShortName);
+        File->ShortNameHashEntry.HashTable = NULL;
+        File->FileAttributes = FindData.dwFileAttributes;
+
+        YoriLibHashInsertByKey(Directory->Files, &File->FileName, File, &File->HashEntry);
+
+        if (FindData.cAlternateFileName[0] != '\0' &&
+            _tcsicmp(FindData.cAlternateFileName, FindData.cFileName) != 0) {
+
+            if (!YoriLibPathIndexCopyName(Directory, FindData.cAlternateFileName, &File->ShortName)) {
+                YoriLibHashRemoveByEntry(&File->HashEntry);
+                AllocationFailed = TRUE;
+                break;
+            }
+
+            YoriLibHashInsertByKey(Directory->Files, &File->ShortName, File, &File->ShortNameHashEntry);
+        }
+
+        YoriLibAppendList(&Directory->FileList, &File->ListEntry);
+        Directory->FileCount++;
+
+    } while (FindNextFile(hFind, &FindData));
+
+    FindClose(hFind);
+
+    //
+    //  If an allocation failed, don't leave a partial view of the
+    //  directory behind.
+    //
+
+    if (AllocationFailed) {
+        YoriLibPathIndexDiscardFiles(Directory);
+        return FALSE;
+    }
+
+    Directory->Populated = TRUE;
+    return TRUE;
+}
+
+/**
+ Stop indexing a directory and free it.
+
+ @param Directory Pointer to the directory.
+ */
+VOID
+YoriLibPathIndexFreeDirectory(
+    __in PYORI_LIB_PATH_INDEX_DIRECTORY Directory
+    )
+{
+    YoriLibPathIndexDiscardFiles(Directory);
+    if (Directory->ChangeNotification != INVALID_HANDLE_VALUE) {
+        FindCloseChangeNotification(Directory->ChangeNotification);
+    }
+    YoriLibCleanupArena(&Directory->Arena);
+    YoriLibFreeEmptyHashTable(Directory->Files);
+    YoriLibHashRemoveByEntry(&Directory->HashEntry);
+    YoriLibRemoveListItem(&Directory->ListEntry);
+    YoriLibFree(Directory);
+}
+
+/**
+ Start indexing a directory which has been found in PATH.  The directory
+ is not enumerated until a lookup needs it.
+
+ @param Path Pointer to the name of the directory.
+
+ @return TRUE to indicate success, FALSE on allocation failure.
+ */
+__success(return)
+BOOL
+YoriLibPathIndexAddDirectory(
+    __in PCYORI_STRING Path
+    )
+{
+    PYORI_LIB_PATH_INDEX_DIRECTORY Directory;
+
+    Directory = YoriLibMalloc(sizeof(YORI_LIB_PATH_INDEX_DIRECTORY) + (Path->LengthInChars + 1) * sizeof(TCHAR));
+    if (Directory == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(Directory, sizeof(YORI_LIB_PATH_INDEX_DIRECTORY));
+    Directory->Files = YoriLibAllocateHashTable(YORI_LIB_PATH_INDEX_FILE_BUCKETS);
+    if (Directory->Files == NULL) {
+        YoriLibFree(Directory);
+        return FALSE;
+    }
+
+    YoriLibInitEmptyString(&Directory->Path);
+    Directory->Path.StartOfString = (LPTSTR)(Directory + 1);
+    memcpy(Directory->Path.StartOfString, Path->StartOfString, Path->LengthInChars * sizeof(TCHAR));
+    Directory->Path.StartOfString[Path->LengthInChars] = '\0';
+    Directory->Path.LengthInChars = Path->LengthInChars;
+    Directory->Path.LengthAllocated = Path->LengthInChars + 1;
+
+    Directory->ChangeNotification = INVALID_HANDLE_VALUE;
+    Directory->InPath = TRUE;
+    YoriLibInitializeListHead(&Directory->FileList);
+    YoriLibInitializeArena(&Directory->Arena, 0);
+
+    YoriLibHashInsertByKey(YoriLibPathIndex.Directories, &Directory->Path, Directory, &Directory->HashEntry);
+    YoriLibAppendList(&YoriLibPathIndex.DirectoryList, &Directory->ListEntry);
+    return TRUE;
+}
+
+/**
+ Update the set of indexed directories to match the directories in
+ PathValue.  Directories which remain in PATH keep their contents.  Only
+ absolute directories are indexed; the contents of relative directories
+ depend on the current directory and are always found by querying the
+ file system.
+ */
+VOID
+YoriLibPathIndexApplyPath(VOID)
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIB_PATH_INDEX_DIRECTORY Directory;
+    PYORI_HASH_ENTRY HashEntry;
+    YORI_STRING Component;
+    LPTSTR Begin;
+    LPTSTR End;
+    LPTSTR PathEnd;
+    TCHAR Search;
+
+    ListEntry = YoriLibGetNextListEntry(&YoriLibPathIndex.DirectoryList, NULL);
+    while (ListEntry != NULL) {
+        Directory = CONTAINING_RECORD(ListEntry, YORI_LIB_PATH_INDEX_DIRECTORY, ListEntry);
+        Directory->InPath = FALSE;
+        ListEntry = YoriLibGetNextListEntry(&YoriLibPathIndex.DirectoryList, ListEntry);
+    }
+
+    Begin = YoriLibPathIndex.PathValue.StartOfString;
+    PathEnd = Begin + YoriLibPathIndex.PathValue.LengthInChars;
+
+    while (Begin < PathEnd) {
+        Search = ';';
+        if (*Begin == '"') {
+            Begin++;
+            Search = '"';
+        }
+
+        for (End = Begin; End < PathEnd && *End != Search; End++);
+
+        YoriLibInitEmptyString(&Component);
+        Component.StartOfString = Begin;
+        Component.LengthInChars = (YORI_ALLOC_SIZE_T)(End - Begin);
+
+        if (YoriLibIsDrvLetterColonSlash(&Component) ||
+            (Component.LengthInChars > 2 &&
+             YoriLibIsSep(Component.StartOfString[0]) &&
+             YoriLibIsSep(Component.StartOfString[1]))) {
+
+            HashEntry = YoriLibHashLookupByKey(YoriLibPathIndex.Directories, &Component);
+            if (HashEntry != NULL) {
+                Directory = HashEntry->Context;
+                Directory->InPath = TRUE;
+            } else {
+                YoriLibPathIndexAddDirectory(&Component);
+            }
+        }
+
+        Begin = End;
+        if (Search == '"') {
+            while (Begin < PathEnd && *Begin == '"') Begin++;
+        }
+        while (Begin < PathEnd && *Begin == ';') Begin++;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&YoriLibPathIndex.DirectoryList, NULL);
+    while (ListEntry != NULL) {
+        Directory = CONTAINING_RECORD(ListEntry, YORI_LIB_PATH_INDEX_DIRECTORY, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&YoriLibPathIndex.DirectoryList, ListEntry);
+        if (!Directory->InPath) {
+            YoriLibPathIndexFreeDirectory(Directory);
+        }
+    }
+}
+
+/**
+ Check whether the PATH environment variable has changed since the set of
+ indexed directories was built, and if so, update the set.  Comparing the
+ value detects every change, including those made by builtin commands and
+ by restoring a saved environment.
+
+ @return TRUE if the set of indexed directories reflects the current PATH,
+         FALSE if it could not be checked.
+ */
+__success(return)
+BOOL
+YoriLibPathIndexCheckPath(VOID)
+{
+    YORI_STRING Swap;
+    YORI_ALLOC_SIZE_T LengthNeeded;
+
+    LengthNeeded = (YORI_ALLOC_SIZE_T)GetEnvironmentVariable(_T("PATH"), NULL, 0);
+    if (LengthNeeded > YoriLibPathIndex.PathScratch.LengthAllocated) {
+        YoriLibFreeStringContents(&YoriLibPathIndex.PathScratch);
+        if (!YoriLibAllocateString(&YoriLibPathIndex.PathScratch, LengthNeeded + 0x100)) {
+            return FALSE;
+        }
+    }
+
+    YoriLibPathIndex.PathScratch.LengthInChars = 0;
+    if (YoriLibPathIndex.PathScratch.LengthAllocated > 0) {
+        LengthNeeded = (YORI_ALLOC_SIZE_T)GetEnvironmentVariable(_T("PATH"), YoriLibPathIndex.PathScratch.StartOfString, YoriLibPathIndex.PathScratch.LengthAllocated);
+        if (LengthNeeded >= YoriLibPathIndex.PathScratch.LengthAllocated) {
+            return FALSE;
+        }
+        YoriLibPathIndex.PathScratch.LengthInChars = LengthNeeded;
+    }
+
+    if (YoriLibPathIndex.PathInitialized &&
+        YoriLibCompareString(&YoriLibPathIndex.PathScratch, &YoriLibPathIndex.PathValue) == 0) {
+
+        return TRUE;
+    }
+
+    if (YoriLibPathIndex.PathInitialized) {
+        YoriLibPathIndex.Stats.PathChanges++;
+    }
+
+    memcpy(&Swap, &YoriLibPathIndex.PathValue, sizeof(YORI_STRING));
+    memcpy(&YoriLibPathIndex.PathValue, &YoriLibPathIndex.PathScratch, sizeof(YORI_STRING));
+    memcpy(&YoriLibPathIndex.PathScratch, &Swap, sizeof(YORI_STRING));
+    YoriLibPathIndex.PathInitialized = TRUE;
+
+    YoriLibPathIndexApplyPath();
+    return TRUE;
+}
+
+/**
+ Begin using the path index to locate files within PATH.  Each call which
+ returns TRUE must be matched with a call to
+ @ref YoriLibPathIndexEndLookup .  If the index is not enabled, or is in use
+ by another thread, the lookup should query the file system directly.
+
+ @param StartTime On successful completion, populated with the time the
+        lookup started.
+
+ @return TRUE if the index can be used by the calling thread, FALSE if it
+         cannot.
+ */
+__success(return)
+BOOL
+YoriLibPathIndexBeginLookup(
+    __out PLARGE_INTEGER StartTime
+    )
+{
+    if (!YoriLibPathIndex.Enabled) {
+        return FALSE;
+    }
+
+    if (InterlockedExchange((INTERLOCKED_VOLATILE LONG *)&YoriLibPathIndex.Lock, TRUE) != FALSE) {
+        return FALSE;
+    }
+
+    if (!YoriLibPathIndex.Enabled) {
+        YoriLibReleaseSpinLock(&YoriLibPathIndex.Lock);
+        return FALSE;
+    }
+
+    QueryPerformanceCounter(StartTime);
+
+    if (!YoriLibPathIndexCheckPath()) {
+        YoriLibReleaseSpinLock(&YoriLibPathIndex.Lock);
+        return FALSE;
+    }
+
+    YoriLibPathIndex.OwningThreadId = GetCurrentThreadId();
+    YoriLibPathIndex.Generation++;
+    YoriLibPathIndex.Stats.Lookups++;
+    return TRUE;
+}
+
+/**
+ Complete a lookup started with @ref YoriLibPathIndexBeginLookup and record
+ the time it took.
+
+ @param StartTime Pointer to the time the lookup started, as returned from
+        @ref YoriLibPathIndexBeginLookup .
+ */
+VOID
+YoriLibPathIndexEndLookup(
+    __in PLARGE_INTEGER StartTime
+    )
+{
+    LARGE_INTEGER EndTime;
+    DWORDLONG Microseconds;
+
+    ASSERT(YoriLibPathIndex.OwningThreadId == GetCurrentThreadId());
+
+    QueryPerformanceCounter(&EndTime);
+    if (YoriLibPathIndex.Frequency.QuadPart > 0 &&
+        EndTime.QuadPart > StartTime->QuadPart) {
+
+        Microseconds = (DWORDLONG)(EndTime.QuadPart - StartTime->QuadPart);
+        Microseconds = Microseconds * 1000 * 1000 / YoriLibPathIndex.Frequency.QuadPart;
+        YoriLibPathIndex.Stats.TotalLookupMicroseconds += Microseconds;
+        if (Microseconds > YoriLibPathIndex.Stats.MaximumLookupMicroseconds) {
+            YoriLibPathIndex.Stats.MaximumLookupMicroseconds = Microseconds;
+        }
+    }
+
+    YoriLibPathIndex.OwningThreadId = 0;
+    YoriLibReleaseSpinLock(&YoriLibPathIndex.Lock);
+}
+
+/**
+ Find the cached contents of a directory.  This can only succeed between
+ calls to @ref YoriLibPathIndexBeginLookup and
+ @ref YoriLibPathIndexEndLookup on the same thread.  If the directory has
+ changed since it was enumerated, it is enumerated again.
+
+ @param Path Pointer to the name of the directory, as found in PATH.
+
+ @return An opaque pointer to the directory which can be passed to
+         @ref YoriLibPathIndexFindFile or
+         @ref YoriLibPathIndexFindNextPrefix , or NULL if the caller should
+         query the file system directly.
+ */
+PVOID
+YoriLibPathIndexFindDirectory(
+    __in PCYORI_STRING Path
+    )
+{
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_LIB_PATH_INDEX_DIRECTORY Directory;
+
+    if (YoriLibPathIndex.OwningThreadId != GetCurrentThreadId()) {
+        return NULL;
+    }
+
+    HashEntry = YoriLibHashLookupByKey(YoriLibPathIndex.Directories, Path);
+    if (HashEntry == NULL) {
+        YoriLibPathIndex.Stats.FileSystemProbes++;
+        return NULL;
+    }
+
+    Directory = HashEntry->Context;
+    if (Directory->ValidatedGeneration != YoriLibPathIndex.Generation) {
+
+        if (Directory->Populated) {
+            if (Directory->ChangeNotification != INVALID_HANDLE_VALUE) {
+                if (WaitForSingleObject(Directory->ChangeNotification, 0) == WAIT_OBJECT_0) {
+                    YoriLibPathIndex.Stats.ChangesDetected++;
+                    if (!FindNextChangeNotification(Directory->ChangeNotification)) {
+                        FindCloseChangeNotification(Directory->ChangeNotification);
+                        Directory->ChangeNotification = INVALID_HANDLE_VALUE;
+                    }
+                    YoriLibPathIndexDiscardFiles(Directory);
+                }
+            } else if (GetTickCount() - Directory->PopulatedTick > YORI_LIB_PATH_INDEX_UNWATCHED_REFRESH) {
+                YoriLibPathIndexDiscardFiles(Directory);
+            }
+        }
+
+        if (!Directory->Populated) {
+            if (!YoriLibPathIndexPopulate(Directory)) {
+                YoriLibPathIndex.Stats.FileSystemProbes++;
+                return NULL;
+            }
+        }
+
+        Directory->ValidatedGeneration = YoriLibPathIndex.Generation;
+    }
+
+    YoriLibPathIndex.Stats.IndexProbes++;
+    return Directory;
+}
+
+/**
+ Populate find data for a cached file.  Only the name and attributes of
+ the file are retained by the index.
+
+ @param File Pointer to the cached file.
+
+ @param FindData On completion, populated with information about the file.
+ */
+VOID
+YoriLibPathIndexFillFindData(
+    __in PYORI_LIB_PATH_INDEX_FILE File,
+    __out LPWIN32_FIND_DATA FindData
+    )
+{
+    ZeroMemory(FindData, sizeof(WIN32_FIND_DATA));
+    FindData->dwFileAttributes = File->FileAttributes;
+    memcpy(FindData->cFileName, File->FileName.StartOfString, (File->FileName.LengthInChars + 1) * sizeof(TCHAR));
+    if (File->ShortName.LengthInChars > 0) {
+        memcpy(FindData->cAlternateFileName, File->ShortName.StartOfString, (File->ShortName.LengthInChars + 1) * sizeof(TCHAR));
+    }
+}
+
+/**
+ Look for a file with an exact name within a directory from the path index.
+
+ @param Directory The directory, as returned from
+        @ref YoriLibPathIndexFindDirectory .
+
+ @param FileName Pointer to the name of the file.
+
+ @param Extension Optionally points to an extension to append to FileName.
+
+ @param FindData On successful completion, populated with information about
+        the file.
+
+ @return TRUE if the file was found, FALSE if it was not.
+ */
+__success(return)
+BOOL
+YoriLibPathIndexFindFile(
+    __in PVOID Directory,
+    __in PCYORI_STRING FileName,
+    __in_opt PCYORI_STRING Extension,
+    __out LPWIN32_FIND_DATA FindData
+    )
+{
+    PYORI_LIB_PATH_INDEX_DIRECTORY IndexDirectory;
+    PYORI_HASH_ENTRY HashEntry;
+    TCHAR KeyBuffer[MAX_PATH];
+    YORI_STRING Key;
+
+    IndexDirectory = (PYORI_LIB_PATH_INDEX_DIRECTORY)Directory;
+
+    YoriLibInitEmptyString(&Key);
+    Key.StartOfString = KeyBuffer;
+    Key.LengthAllocated = sizeof(KeyBuffer)/sizeof(KeyBuffer[0]);
+
+    if (FileName->LengthInChars >= Key.LengthAllocated) {
+        return FALSE;
+    }
+
+    memcpy(Key.StartOfString, FileName->StartOfString, FileName->LengthInChars * sizeof(TCHAR));
+    Key.LengthInChars = FileName->LengthInChars;
+
+    if (Extension != NULL) {
+        if (Key.LengthInChars + Extension->LengthInChars >= Key.LengthAllocated) {
+            return FALSE;
+        }
+        memcpy(&Key.StartOfString[Key.LengthInChars], Extension->StartOfString, Extension->LengthInChars * sizeof(TCHAR));
+        Key.LengthInChars = Key.LengthInChars + Extension->LengthInChars;
+    }
+
+    HashEntry = YoriLibHashLookupByKey(IndexDirectory->Files, &Key);
+    if (HashEntry == NULL) {
+        return FALSE;
+    }
+
+    YoriLibPathIndexFillFindData(HashEntry->Context, FindData);
+    return TRUE;
+}
+
+/**
+ Enumerate files within a directory from the path index whose names start
+ with a specified prefix.
+
+ @param Directory The directory, as returned from
+        @ref YoriLibPathIndexFindDirectory .
+
+ @param Prefix Pointer to the prefix to match.  Comparison is case
+        insensitive.
+
+ @param Context On input, points to NULL to start the enumeration, or the
+        value returned from the previous call to continue it.  On output,
+        updated to describe the position of the enumeration.
+
+ @param FindData On successful completion, populated with information about
+        the next matching file.
+
+ @return TRUE if a matching file was found, FALSE if there are no more.
+ */
+__success(return)
+BOOL
+YoriLibPathIndexFindNextPrefix(
+    __in PVOID Directory,
+    __in PCYORI_STRING Prefix,
+    __inout PVOID *Context,
+    __out LPWIN32_FIND_DATA FindData
+    )
+{
+    PYORI_LIB_PATH_INDEX_DIRECTORY IndexDirectory;
+    PYORI_LIB_PATH_INDEX_FILE File;
+    PYORI_LIST_ENTRY ListEntry;
+
+    IndexDirectory = (PYORI_LIB_PATH_INDEX_DIRECTORY)Directory;
+
+    ListEntry = YoriLibGetNextListEntry(&IndexDirectory->FileList, *Context);
+    while (ListEntry != NULL) {
+        File = CONTAINING_RECORD(ListEntry, YORI_LIB_PATH_INDEX_FILE, ListEntry);
+        if (YoriLibCompareStringInsCnt(&File->FileName, Prefix, Prefix->LengthInChars) == 0) {
+            YoriLibPathIndexFillFindData(File, FindData);
+            *Context = ListEntry;
+            return TRUE;
+        }
+        ListEntry = YoriLibGetNextListEntry(&IndexDirectory->FileList, ListEntry);
+    }
+
+    *Context = NULL;
+    return FALSE;
+}
+
+/**
+ Start caching the contents of directories in PATH so that executables can
+ be located without querying the file system for each lookup.
+
+ @return TRUE to indicate the index is enabled, FALSE if it could not be
+         enabled.
+ */
+__success(return)
+BOOL
+YoriLibEnablePathIndex(VOID)
+{
+    YoriLibAcquireSpinLock(&YoriLibPathIndex.Lock);
+    if (YoriLibPathIndex.Enabled) {
+        YoriLibReleaseSpinLock(&YoriLibPathIndex.Lock);
+        return TRUE;
+    }
+
+    YoriLibPathIndex.Directories = YoriLibAllocateHashTable(YORI_LIB_PATH_INDEX_DIRECTORY_BUCKETS);
+    if (YoriLibPathIndex.Directories == NULL) {
+        YoriLibReleaseSpinLock(&YoriLibPathIndex.Lock);
+        return FALSE;
+    }
+
+    YoriLibInitializeListHead(&YoriLibPathIndex.DirectoryList);
+    YoriLibInitEmptyString(&YoriLibPathIndex.PathValue);
+    YoriLibInitEmptyString(&YoriLibPathIndex.PathScratch);
+    YoriLibPathIndex.PathInitialized = FALSE;
+    ZeroMemory(&YoriLibPathIndex.Stats, sizeof(YoriLibPathIndex.Stats));
+    QueryPerformanceFrequency(&YoriLibPathIndex.Frequency);
+    YoriLibPathIndex.Enabled = TRUE;
+    YoriLibReleaseSpinLock(&YoriLibPathIndex.Lock);
+    return TRUE;
+}
+
+/**
+ Stop caching the contents of directories in PATH and free the index.
+ */
+VOID
+YoriLibDisablePathIndex(VOID)
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIB_PATH_INDEX_DIRECTORY Directory;
+
+    YoriLibAcquireSpinLock(&YoriLibPathIndex.Lock);
+    if (!YoriLibPathIndex.Enabled) {
+        YoriLibReleaseSpinLock(&YoriLibPathIndex.Lock);
+        return;
+    }
+
+    YoriLibPathIndex.Enabled = FALSE;
+
+    ListEntry = YoriLibGetNextListEntry(&YoriLibPathIndex.DirectoryList, NULL);
+    while (ListEntry != NULL) {
+        Directory = CONTAINING_RECORD(ListEntry, YORI_LIB_PATH_INDEX_DIRECTORY, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&YoriLibPathIndex.DirectoryList, ListEntry);
+        YoriLibPathIndexFreeDirectory(Directory);
+    }
+
+    YoriLibFreeEmptyHashTable(YoriLibPathIndex.Directories);
+    YoriLibPathIndex.Directories = NULL;
+    YoriLibFreeStringContents(&YoriLibPathIndex.PathValue);
+    YoriLibFreeStringContents(&YoriLibPathIndex.PathScratch);
+    YoriLibReleaseSpinLock(&YoriLibPathIndex.Lock);
+}
+
+/**
+ Return counters describing the contents of the path index and how
+ effective it has been.
+
+ @param Statistics On successful completion, populated with the counters.
+
+ @return TRUE if the index is enabled and Statistics has been populated,
+         FALSE if the index is not enabled.
+ */
+__success(return)
+BOOL
+YoriLibGetPathIndexStatistics(
+    __out PYORI_LIB_PATH_INDEX_STATISTICS Statistics
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIB_PATH_INDEX_DIRECTORY Directory;
+
+    YoriLibAcquireSpinLock(&YoriLibPathIndex.Lock);
+    if (!YoriLibPathIndex.Enabled) {
+        YoriLibReleaseSpinLock(&YoriLibPathIndex.Lock);
+        return FALSE;
+    }
+
+    memcpy(Statistics, &YoriLibPathIndex.Stats, sizeof(YORI_LIB_PATH_INDEX_STATISTICS));
+
+    ListEntry = YoriLibGetNextListEntry(&YoriLibPathIndex.DirectoryList, NULL);
+    while (ListEntry != NULL) {
+        Directory = CONTAINING_RECORD(ListEntry, YORI_LIB_PATH_INDEX_DIRECTORY, ListEntry);
+        Statistics->DirectoryCount++;
+        if (Directory->Populated) {
+            Statistics->DirectoriesPopulated++;
+            Statistics->FileCount = Statistics->FileCount + Directory->FileCount;
+        }
+        if (Directory->ChangeNotification != INVALID_HANDLE_VALUE) {
+            Statistics->DirectoriesWatched++;
+        }
+        ListEntry = YoriLibGetNextListEntry(&YoriLibPathIndex.DirectoryList, ListEntry);
+    }
+
+    YoriLibReleaseSpinLock(&YoriLibPathIndex.Lock);
+    return TRUE;
+}
+
+// vim:sw=4:ts=4:et:
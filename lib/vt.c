@@ -130,6 +130,352 @@ YoriLibVtGetLineEnding(VOID)
     return YoriLibVtLineEnding;
 }
 
+/**
+ The size of the buffer used to batch writes to files and pipes.
+ */
+#define YORI_LIB_OUTPUT_BUFFER_SIZE (64 * 1024)
+
+/**
+ The maximum number of handles which can have buffering enabled at once.
+ Typically this is standard output and standard error.
+ */
+#define YORI_LIB_OUTPUT_BUFFER_HANDLES 4
+
+/**
+ State used to batch writes to files and pipes.  Output to any buffered
+ handle is appended to a single buffer, and that buffer is flushed before
+ output is sent anywhere else.  This means data reaches the devices in the
+ order it was generated, even if two handles refer to the same file.
+ */
+typedef struct _YORI_LIB_OUTPUT_BUFFER {
+
+    /**
+     A spin lock that ensures Lock is only initialized once.
+     */
+    LONG InitLock;
+
+    /**
+     Set to TRUE once Lock has been initialized.
+     */
+    BOOLEAN LockInitialized;
+
+    /**
+     A critical section that synchronizes access to the buffer.  This is
+     held while buffered data is written, so data reaches devices in the
+     order it was generated, and a thread waiting for a slow device to
+     accept data blocks rather than spinning.  This is initialized when
+     buffering is first enabled, and is only used if HandleCount is
+     nonzero.
+     */
+    CRITICAL_SECTION Lock;
+
+    /**
+     The number of handles in the Handles array.  This is checked without
+     the lock so that output to unbuffered devices stays cheap when
+     buffering is not in use.
+     */
+    DWORD HandleCount;
+
+    /**
+     The handles that have buffering enabled.
+     */
+    HANDLE Handles[YORI_LIB_OUTPUT_BUFFER_HANDLES];
+
+    /**
+     The handle that should receive the data in Buffer.
+     */
+    HANDLE PendingHandle;
+
+    /**
+     A handle that buffered data could not be written to, typically because
+     the reader of a pipe has gone away.  Further writes to this handle fail
+     rather than being buffered, so callers notice the failure as they would
+     without buffering.
+     */
+    HANDLE FailedHandle;
+
+    /**
+     The number of bytes of data in Buffer.
+     */
+    DWORD BytesPending;
+
+    /**
+     The buffer of data waiting to be written, which is allocated when
+     buffering is first enabled.
+     */
+    PUCHAR Buffer;
+} YORI_LIB_OUTPUT_BUFFER, *PYORI_LIB_OUTPUT_BUFFER;
+
+/**
+ The buffer used to batch writes to files and pipes.
+ */
+YORI_LIB_OUTPUT_BUFFER YoriLibOutputBuffer;
+
+/**
+ Write any buffered data to its device.  The caller must hold the lock on
+ YoriLibOutputBuffer.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriLibFlushOutputBufferLocked(VOID)
+{
+    DWORD BytesWritten;
+    DWORD Offset;
+    BOOL Result;
+
+    Result = TRUE;
+    Offset = 0;
+    while (Offset < YoriLibOutputBuffer.BytesPending) {
+        if (!WriteFile(YoriLibOutputBuffer.PendingHandle,
+                       &YoriLibOutputBuffer.Buffer[Offset],
+                       YoriLibOutputBuffer.BytesPending - Offset,
+                       &BytesWritten,
+                       NULL) ||
+            BytesWritten == 0) {
+
+            Result = FALSE;
+            YoriLibOutputBuffer.FailedHandle = YoriLibOutputBuffer.PendingHandle;
+            break;
+        }
+        Offset = Offset + BytesWritten;
+    }
+
+    YoriLibOutputBuffer.BytesPending = 0;
+    YoriLibOutputBuffer.PendingHandle = NULL;
+    return Result;
+}
+
+/**
+ Check whether a handle has buffering enabled.  The caller must hold the lock
+ on YoriLibOutputBuffer.
+
+ @param hOutput The handle to check.
+
+ @return TRUE if output to the handle is buffered, FALSE if it is written
+         immediately.
+ */
+BOOLEAN
+YoriLibIsOutputBufferedLocked(
+    __in HANDLE hOutput
+    )
+{
+    DWORD Index;
+
+    for (Index = 0; Index < YoriLibOutputBuffer.HandleCount; Index++) {
+        if (YoriLibOutputBuffer.Handles[Index] == hOutput) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ Check whether a handle has buffering enabled.  If it does not, any data
+ buffered for other handles is written first, so that output to this handle
+ appears after it.
+
+ @param hOutput The handle which is about to receive output.
+
+ @return TRUE if output to the handle is buffered, FALSE if it should be
+         written immediately.
+ */
+BOOLEAN
+YoriLibPrepareOutputDevice(
+    __in HANDLE hOutput
+    )
+{
+    BOOLEAN Buffered;
+
+    if (YoriLibOutputBuffer.HandleCount == 0) {
+        return FALSE;
+    }
+
+    EnterCriticalSection(&YoriLibOutputBuffer.Lock);
+    Buffered = YoriLibIsOutputBufferedLocked(hOutput);
+    if (!Buffered && YoriLibOutputBuffer.BytesPending > 0) {
+        YoriLibFlushOutputBufferLocked();
+    }
+    LeaveCriticalSection(&YoriLibOutputBuffer.Lock);
+    return Buffered;
+}
+
+/**
+ Request that output to a handle be buffered until the buffer is full or
+ the buffer is explicitly flushed.  Buffering is only enabled for files and
+ pipes.  Output to a console is written at the end of each call, so each
+ line is visible as soon as it is complete, and text attributes are applied
+ in order.  Callers that enable buffering must call
+ YoriLibDisableOutputBuffering before the handle is closed or changed, which
+ happens automatically when a program or builtin command returns.
+
+ @param hOutput The handle to buffer output for.
+
+ @return TRUE to indicate that output is buffered, FALSE if it will be
+         written immediately.
+ */
+BOOL
+YoriLibEnableOutputBuffering(
+    __in HANDLE hOutput
+    )
+{
+    DWORD CurrentMode;
+    BOOL Result;
+
+    if (hOutput == NULL ||
+        hOutput == INVALID_HANDLE_VALUE ||
+        hOutput == YORI_LIB_DEBUGGER_HANDLE ||
+        GetConsoleMode(hOutput, &CurrentMode)) {
+
+        return FALSE;
+    }
+
+    if (!YoriLibOutputBuffer.LockInitialized) {
+        YoriLibAcquireSpinLock(&YoriLibOutputBuffer.InitLock);
+        if (!YoriLibOutputBuffer.LockInitialized) {
+            InitializeCriticalSection(&YoriLibOutputBuffer.Lock);
+            YoriLibOutputBuffer.LockInitialized = TRUE;
+        }
+        YoriLibReleaseSpinLock(&YoriLibOutputBuffer.InitLock);
+    }
+
+    Result = FALSE;
+    EnterCriticalSection(&YoriLibOutputBuffer.Lock);
+    if (YoriLibIsOutputBufferedLocked(hOutput)) {
+        Result = TRUE;
+        goto Exit;
+    }
+
+    if (YoriLibOutputBuffer.HandleCount >= YORI_LIB_OUTPUT_BUFFER_HANDLES) {
+        goto Exit;
+    }
+
+    if (YoriLibOutputBuffer.Buffer == NULL) {
+        YoriLibOutputBuffer.Buffer = YoriLibMalloc(YORI_LIB_OUTPUT_BUFFER_SIZE);
+        if (YoriLibOutputBuffer.Buffer == NULL) {
+            goto Exit;
+        }
+    }
+
+    YoriLibOutputBuffer.Handles[YoriLibOutputBuffer.HandleCount] = hOutput;
+    YoriLibOutputBuffer.HandleCount++;
+    Result = TRUE;
+
+Exit:
+    LeaveCriticalSection(&YoriLibOutputBuffer.Lock);
+    return Result;
+}
+
+/**
+ Write any buffered output to its device.
+
+ @return TRUE to indicate success, FALSE to indicate failure, including if
+         previously buffered output could not be written.
+ */
+BOOL
+YoriLibFlushOutputBuffer(VOID)
+{
+    BOOL Result;
+
+    if (YoriLibOutputBuffer.HandleCount == 0) {
+        return TRUE;
+    }
+
+    EnterCriticalSection(&YoriLibOutputBuffer.Lock);
+    Result = YoriLibFlushOutputBufferLocked();
+    if (YoriLibOutputBuffer.FailedHandle != NULL) {
+        Result = FALSE;
+    }
+    LeaveCriticalSection(&YoriLibOutputBuffer.Lock);
+    return Result;
+}
+
+/**
+ Write any buffered output to its device, stop buffering output to all
+ handles, and free the buffer.
+ */
+VOID
+YoriLibDisableOutputBuffering(VOID)
+{
+    if (YoriLibOutputBuffer.HandleCount == 0) {
+        return;
+    }
+
+    EnterCriticalSection(&YoriLibOutputBuffer.Lock);
+    YoriLibFlushOutputBufferLocked();
+    YoriLibOutputBuffer.HandleCount = 0;
+    YoriLibOutputBuffer.FailedHandle = NULL;
+    if (YoriLibOutputBuffer.Buffer != NULL) {
+        YoriLibFree(YoriLibOutputBuffer.Buffer);
+        YoriLibOutputBuffer.Buffer = NULL;
+    }
+    LeaveCriticalSection(&YoriLibOutputBuffer.Lock);
+}
+
+/**
+ Write bytes to a device.  If the device has buffering enabled, the bytes
+ are added to the buffer, otherwise they are written immediately.  Once
+ buffered data could not be written to a device, all later writes to it
+ fail.
+
+ @param hOutput The handle to write to.
+
+ @param Buffer Pointer to the bytes to write.
+
+ @param BytesToWrite The number of bytes to write.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+YoriLibWriteOutputDevice(
+    __in HANDLE hOutput,
+    __in LPCVOID Buffer,
+    __in DWORD BytesToWrite
+    )
+{
+    DWORD BytesWritten;
+    BOOL Result;
+
+    if (YoriLibOutputBuffer.HandleCount == 0) {
+        return WriteFile(hOutput, Buffer, BytesToWrite, &BytesWritten, NULL);
+    }
+
+    EnterCriticalSection(&YoriLibOutputBuffer.Lock);
+    if (!YoriLibIsOutputBufferedLocked(hOutput)) {
+        if (YoriLibOutputBuffer.BytesPending > 0) {
+            YoriLibFlushOutputBufferLocked();
+        }
+        LeaveCriticalSection(&YoriLibOutputBuffer.Lock);
+        return WriteFile(hOutput, Buffer, BytesToWrite, &BytesWritten, NULL);
+    }
+
+    if (YoriLibOutputBuffer.FailedHandle == hOutput) {
+        LeaveCriticalSection(&YoriLibOutputBuffer.Lock);
+        return FALSE;
+    }
+
+    Result = TRUE;
+    if (YoriLibOutputBuffer.BytesPending > 0 &&
+        (YoriLibOutputBuffer.PendingHandle != hOutput ||
+         YoriLibOutputBuffer.BytesPending + BytesToWrite > YORI_LIB_OUTPUT_BUFFER_SIZE)) {
+
+        Result = YoriLibFlushOutputBufferLocked();
+    }
+
+    if (BytesToWrite >= YORI_LIB_OUTPUT_BUFFER_SIZE) {
+        if (!WriteFile(hOutput, Buffer, BytesToWrite, &BytesWritten, NULL)) {
+            Result = FALSE;
+        }
+    } else if (BytesToWrite > 0) {
+        memcpy(&YoriLibOutputBuffer.Buffer[YoriLibOutputBuffer.BytesPending], Buffer, BytesToWrite);
+        YoriLibOutputBuffer.BytesPending = YoriLibOutputBuffer.BytesPending + BytesToWrite;
+        YoriLibOutputBuffer.PendingHandle = hOutput;
+    }
+
+    LeaveCriticalSection(&YoriLibOutputBuffer.Lock);
+    return Result;
+}
+
 /**
  Convert any incoming string to the active output encoding, and send it to
  the output device.
@@ -147,7 +493,6 @@ YoriLibOutputTextToMbyteDev(
     __in PCYORI_STRING String
     )
 {
-    DWORD BytesTransferred;
     BOOL Result;
 
 #ifdef UNICODE
@@ -170,7 +515,7 @@ YoriLibOutputTextToMbyteDev(
                                    AnsiBuf,
                                    AnsiBytesNeeded);
 
-            Result = WriteFile(hOutput, AnsiBuf, AnsiBytesNeeded, &BytesTransferred, NULL);
+            Result = YoriLibWriteOutputDevice(hOutput, AnsiBuf, AnsiBytesNeeded);
 
             if (AnsiBuf != AnsiStackBuf) {
                 YoriLibFree(AnsiBuf);
@@ -180,11 +525,9 @@ YoriLibOutputTextToMbyteDev(
         }
     }
 #else
-    Result = WriteFile(hOutput,
-                       String->StartOfString,
-                       String->LengthInChars*sizeof(TCHAR),
-                       &BytesTransferred,
-                       NULL);
+    Result = YoriLibWriteOutputDevice(hOutput,
+                                      String->StartOfString,
+                                      String->LengthInChars*sizeof(TCHAR));
 #endif
     return Result;
 }
@@ -1036,11 +1379,18 @@ YoriLibOutputInternal(
 
     //
     //  Check if we're writing to a console supporting color or a file
-    //  that doesn't
+    //  that doesn't.  Handles with buffering enabled are known not to be
+    //  consoles.
     //
 
     if (hOut == YORI_LIB_DEBUGGER_HANDLE) {
         YoriLibDbgSetFn(&Callbacks);
+    } else if (YoriLibPrepareOutputDevice(hOut)) {
+        if ((Flags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
+            YoriLibUtf8TextNoEscSetFn(&Callbacks);
+        } else {
+            YoriLibUtf8TextWithEscSetFn(&Callbacks);
+        }
     } else if (GetConsoleMode(hOut, &CurrentMode)) {
         if ((Flags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
             YoriLibConsoleNoEscSetFn(&Callbacks);
@@ -1141,10 +1491,17 @@ YoriLibOutputString(
 
     //
     //  Check if we're writing to a console supporting color or a file
-    //  that doesn't
+    //  that doesn't.  Handles with buffering enabled are known not to be
+    //  consoles.
     //
 
-    if (GetConsoleMode(hOut, &CurrentMode)) {
+    if (YoriLibPrepareOutputDevice(hOut)) {
+        if ((Flags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
+            YoriLibUtf8TextNoEscSetFn(&Callbacks);
+        } else {
+            YoriLibUtf8TextWithEscSetFn(&Callbacks);
+        }
+    } else if (GetConsoleMode(hOut, &CurrentMode)) {
         if ((Flags & YORI_LIB_OUTPUT_STRIP_VT) != 0) {
             YoriLibConsoleNoEscSetFn(&Callbacks);
         } else if ((Flags & YORI_LIB_OUTPUT_PASSTHROUGH_VT) != 0) {
@@ -28,51 +28,653 @@
 #include "yorilib.h"
 
 /**
- Search through a string looking to see if any substrings can be located.
- Returns the first match in offet from the beginning of the string order.
- This routine looks for matches case sensitively.
+ The number of strings to search for which causes a state machine to be
+ built.  With fewer strings, comparing each string at each candidate offset
+ is faster than following the state machine.
+ */
+#define YORI_LIB_MULTI_MATCH_AUTOMATON_THRESHOLD (8)
+
+/**
+ A value indicating that no string has been found.
+ */
+#define YORI_LIB_MULTI_MATCH_NONE ((DWORD)-1)
+
+/**
+ A node in the state machine used to search for many strings.  Each node
+ corresponds to a prefix of one or more of the strings being searched for,
+ and node zero is the empty prefix.  This is an Aho-Corasick automaton.
+ */
+typedef struct _YORI_LIB_MULTI_MATCH_NODE {
+
+    /**
+     The index of the first node whose prefix extends this one by a single
+     character, or zero if there are none.
+     */
+    DWORD FirstChild;
+
+    /**
+     The index of the next node with the same parent as this one, or zero
+     if there are no more.
+     */
+    DWORD NextSibling;
+
+    /**
+     The index of the node for the longest proper suffix of this node's
+     prefix that is also a node, used when the next character does not
+     extend this node's prefix.
+     */
+    DWORD Failure;
+
+    /**
+     The index of the next node reached by following Failure which
+     completes a string, or zero if there are none.
+     */
+    DWORD OutputLink;
+
+    /**
+     The lowest index into the match array of a string that is completed
+     by this node, or YORI_LIB_MULTI_MATCH_NONE if this node does not
+     complete a string.
+     */
+    DWORD MatchIndex;
+
+    /**
+     The length of this node's prefix, in characters.
+     */
+    YORI_ALLOC_SIZE_T Depth;
+
+    /**
+     The final character of this node's prefix.  If matching is case
+     insensitive, this is upcased.
+     */
+    TCHAR Char;
+} YORI_LIB_MULTI_MATCH_NODE, *PYORI_LIB_MULTI_MATCH_NODE;
+
+/**
+ A state machine used to search for many strings.
+ */
+typedef struct _YORI_LIB_MULTI_MATCH_AUTOMATON {
+
+    /**
+     The number of nodes in the Nodes array.
+     */
+    DWORD NodeCount;
+
+    /**
+     For each character below 256, the node reached from node zero, or zero
+     if no string starts with that character.  This avoids searching the
+     children of node zero, which is the most common state.
+     */
+    DWORD RootChildren[256];
+
+    /**
+     An array of nodes.
+     */
+    PYORI_LIB_MULTI_MATCH_NODE Nodes;
+} YORI_LIB_MULTI_MATCH_AUTOMATON, *PYORI_LIB_MULTI_MATCH_AUTOMATON;
+
+/**
+ Return the character at a specified offset in a string, upcased if the
+ matcher is case insensitive.
+
+ @param Matcher Pointer to the matcher.
+
+ @param String Pointer to the string.
+
+ @param Offset The offset of the character within the string.
+
+ @return The character.
+ */
+TCHAR
+YoriLibMultiMatchGetChar(
+    __in PYORI_LIB_MULTI_MATCH Matcher,
+    __in PCYORI_STRING String,
+    __in YORI_ALLOC_SIZE_T Offset
+    )
+{
+    if (Matcher->Insensitive) {
+        return YoriLibUpcaseChar(String->StartOfString[Offset]);
+    }
+    return String->StartOfString[Offset];
+}
+
+/**
+ Find the node which extends the prefix of a node by one character.
+
+ @param Automaton Pointer to the state machine.
+
+ @param Node The index of the node to extend.
+
+ @param Char The character to extend the node's prefix with.
+
+ @return The index of the node, or zero if no string contains the extended
+         prefix.
+ */
+DWORD
+YoriLibMultiMatchFindChild(
+    __in PYORI_LIB_MULTI_MATCH_AUTOMATON Automaton,
+    __in DWORD Node,
+    __in TCHAR Char
+    )
+{
+    DWORD Child;
+
+    if (Node == 0 && Char < 256) {
+        return Automaton->RootChildren[Char];
+    }
+
+    Child = Automaton->Nodes[Node].FirstChild;
+    while (Child != 0) {
+        if (Automaton->Nodes[Child].Char == Char) {
+            break;
+        }
+        Child = Automaton->Nodes[Child].NextSibling;
+    }
+
+    return Child;
+}
+
+/**
+ Build a state machine to search for every string in a matcher.  On
+ failure, the matcher compares each string at each candidate offset.
+
+ @param Matcher Pointer to the matcher, whose strings have been populated.
+ */
+VOID
+YoriLibMultiMatchBuildAutomaton(
+    __inout PYORI_LIB_MULTI_MATCH Matcher
+    )
+{
+    PYORI_LIB_MULTI_MATCH_AUTOMATON Automaton;
+    PYORI_LIB_MULTI_MATCH_NODE Nodes;
+    PYORI_LIB_MULTI_MATCH_NODE Node;
+    PDWORD Queue;
+    DWORDLONG TotalNodes;
+    DWORDLONG SizeNeeded;
+    DWORD QueueHead;
+    DWORD QueueTail;
+    DWORD NodeIndex;
+    DWORD Child;
+    DWORD Failure;
+    DWORD Next;
+    YORI_ALLOC_SIZE_T MatchIndex;
+    YORI_ALLOC_SIZE_T CharIndex;
+    TCHAR Char;
+
+    TotalNodes = 1;
+    for (MatchIndex = 0; MatchIndex < Matcher->NumberMatches; MatchIndex++) {
+        TotalNodes = TotalNodes + Matcher->MatchArray[MatchIndex].LengthInChars;
+    }
+
+    SizeNeeded = sizeof(YORI_LIB_MULTI_MATCH_AUTOMATON) + TotalNodes * sizeof(YORI_LIB_MULTI_MATCH_NODE);
+    if (!YoriLibIsSizeAllocatable(SizeNeeded) ||
+        !YoriLibIsSizeAllocatable(TotalNodes * sizeof(DWORD))) {
+        return;
+    }
+
+    Automaton = YoriLibMalloc((YORI_ALLOC_SIZE_T)SizeNeeded);
+    if (Automaton == NULL) {
+        return;
+    }
+
+    Queue = YoriLibMalloc((YORI_ALLOC_SIZE_T)(TotalNodes * sizeof(DWORD)));
+    if (Queue == NULL) {
+        YoriLibFree(Automaton);
+        return;
+    }
+
+    ZeroMemory(Automaton->RootChildren, sizeof(Automaton->RootChildren));
+    Nodes = (PYORI_LIB_MULTI_MATCH_NODE)(Automaton + 1);
+    Automaton->Nodes = Nodes;
+    Automaton->NodeCount = 1;
+    ZeroMemory(&Nodes[0], sizeof(YORI_LIB_MULTI_MATCH_NODE));
+    Nodes[0].MatchIndex = YORI_LIB_MULTI_MATCH_NONE;
+
+    //
+    //  Add a node for each prefix of each string.  Where more than one
+    //  string is the same, the node records the first.
+    //
+
+    for (MatchIndex = 0; MatchIndex < Matcher->NumberMatches; MatchIndex++) {
+        NodeIndex = 0;
+        for (CharIndex = 0; CharIndex < Matcher->MatchArray[MatchIndex].LengthInChars; CharIndex++) {
+            Char = YoriLibMultiMatchGetChar(Matcher, &Matcher->MatchArray[MatchIndex], CharIndex);
+            Child = YoriLibMultiMatchFindChild(Automaton, NodeIndex, Char);
+            if (Child == 0) {
+                Child = Automaton->NodeCount;
+                Automaton->NodeCount++;
+                Node = &Nodes[Child];
+                Node->FirstChild = 0;
+                Node->NextSibling = Nodes[NodeIndex].FirstChild;
+                Node->Failure = 0;
+                Node->OutputLink = 0;
+                Node->MatchIndex = YORI_LIB_MULTI_MATCH_NONE;
+                Node->Depth = CharIndex + 1;
+                Node->Char = Char;
+                Nodes[NodeIndex].FirstChild = Child;
+                if (NodeIndex == 0 && Char < 256) {
+                    Automaton->RootChildren[Char] = Child;
+                }
+            }
+            NodeIndex = Child;
+        }
+
+        if (NodeIndex != 0 && Nodes[NodeIndex].MatchIndex == YORI_LIB_MULTI_MATCH_NONE) {
+            Nodes[NodeIndex].MatchIndex = MatchIndex;
+        }
+    }
+
+    //
+    //  Calculate failure links in order of increasing depth, so the failure
+    //  link of each node's parent is known before the node is processed.
+    //
+
+    QueueHead = 0;
+    QueueTail = 0;
+    Child = Nodes[0].FirstChild;
+    while (Child != 0) {
+        Queue[QueueTail] = Child;
+        QueueTail++;
+        Child = Nodes[Child].NextSibling;
+    }
+
+    while (QueueHead < QueueTail) {
+        NodeIndex = Queue[QueueHead];
+        QueueHead++;
+
+        Child = Nodes[NodeIndex].FirstChild;
+        while (Child != 0) {
+            Failure = Nodes[NodeIndex].Failure;
+            while (TRUE) {
+                Next = YoriLibMultiMatchFindChild(Automaton, Failure, Nodes[Child].Char);
+                if (Next != 0 || Failure == 0) {
+                    break;
+                }
+                Failure = Nodes[Failure].Failure;
+            }
+
+            Nodes[Child].Failure = Next;
+            if (Nodes[Next].MatchIndex != YORI_LIB_MULTI_MATCH_NONE) {
+                Nodes[Child].OutputLink = Next;
+            } else {
+                Nodes[Child].OutputLink = Nodes[Next].OutputLink;
+            }
+
+            Queue[QueueTail] = Child;
+            QueueTail++;
+            Child = Nodes[Child].NextSibling;
+        }
+    }
+
+    YoriLibFree(Queue);
+    Matcher->Automaton = Automaton;
+}
+
+/**
+ Search a string using a matcher's state machine.
+
+ @param Matcher Pointer to the matcher.
 
  @param String The string to search through.
 
+ @param Lowest If TRUE, find the string earliest in the match array which
+        is found anywhere.  If FALSE, find the match which starts earliest
+        in String, and if more than one starts at that offset, the one
+        earliest in the match array.
+
+ @param StringOffsetOfMatch On successful completion, updated to contain
+        the offset within String of the match.
+
+ @return The index within the match array of the match, or
+         YORI_LIB_MULTI_MATCH_NONE if no match was found.
+ */
+DWORD
+YoriLibMultiMatchSearchAutomaton(
+    __in PYORI_LIB_MULTI_MATCH Matcher,
+    __in PCYORI_STRING String,
+    __in BOOLEAN Lowest,
+    __out PYORI_ALLOC_SIZE_T StringOffsetOfMatch
+    )
+{
+    PYORI_LIB_MULTI_MATCH_AUTOMATON Automaton;
+    PYORI_LIB_MULTI_MATCH_NODE Nodes;
+    YORI_ALLOC_SIZE_T Offset;
+    YORI_ALLOC_SIZE_T MatchStart;
+    YORI_ALLOC_SIZE_T BestStart;
+    DWORD BestIndex;
+    DWORD NodeIndex;
+    DWORD Output;
+    DWORD Next;
+    TCHAR Char;
+
+    Automaton = (PYORI_LIB_MULTI_MATCH_AUTOMATON)Matcher->Automaton;
+    Nodes = Automaton->Nodes;
+
+    BestIndex = YORI_LIB_MULTI_MATCH_NONE;
+    BestStart = 0;
+    if (Matcher->FirstEmptyMatch != YORI_MAX_ALLOC_SIZE && String->LengthInChars > 0) {
+        BestIndex = Matcher->FirstEmptyMatch;
+    }
+
+    NodeIndex = 0;
+    for (Offset = 0; Offset < String->LengthInChars; Offset++) {
+
+        //
+        //  When looking for the earliest match, once a match has been found,
+        //  only matches which start at the same offset or before it can
+        //  replace it.  A match ending at this offset starts after it.
+        //
+
+        if (!Lowest &&
+            BestIndex != YORI_LIB_MULTI_MATCH_NONE &&
+            Offset - BestStart >= Matcher->LongestMatch) {
+
+            break;
+        }
+
+        Char = YoriLibMultiMatchGetChar(Matcher, String, Offset);
+        while (TRUE) {
+            Next = YoriLibMultiMatchFindChild(Automaton, NodeIndex, Char);
+            if (Next != 0 || NodeIndex == 0) {
+                break;
+            }
+            NodeIndex = Nodes[NodeIndex].Failure;
+        }
+        NodeIndex = Next;
+
+        if (Nodes[NodeIndex].MatchIndex != YORI_LIB_MULTI_MATCH_NONE) {
+            Output = NodeIndex;
+        } else {
+            Output = Nodes[NodeIndex].OutputLink;
+        }
+
+        while (Output != 0) {
+            MatchStart = Offset + 1 - Nodes[Output].Depth;
+            if (BestIndex == YORI_LIB_MULTI_MATCH_NONE ||
+                (Lowest && Nodes[Output].MatchIndex < BestIndex) ||
+                (!Lowest && (MatchStart < BestStart ||
+                             (MatchStart == BestStart && Nodes[Output].MatchIndex < BestIndex)))) {
+
+                BestIndex = Nodes[Output].MatchIndex;
+                BestStart = MatchStart;
+            }
+            Output = Nodes[Output].OutputLink;
+        }
+
+        if (Lowest && BestIndex == 0) {
+            break;
+        }
+    }
+
+    *StringOffsetOfMatch = BestStart;
+    return BestIndex;
+}
+
+/**
+ Check whether a string in a matcher occurs at a specified offset in the
+ string being searched.
+
+ @param Matcher Pointer to the matcher.
+
+ @param String The string being searched.
+
+ @param Offset The offset within String to check.
+
+ @param MatchIndex The index of the string in the match array to check for.
+
+ @return TRUE if the string is found at the offset, FALSE if it is not.
+ */
+BOOLEAN
+YoriLibMultiMatchCompareAt(
+    __in PYORI_LIB_MULTI_MATCH Matcher,
+    __in PCYORI_STRING String,
+    __in YORI_ALLOC_SIZE_T Offset,
+    __in YORI_ALLOC_SIZE_T MatchIndex
+    )
+{
+    YORI_STRING RemainingString;
+    PYORI_STRING Match;
+
+    YoriLibInitEmptyString(&RemainingString);
+    RemainingString.StartOfString = &String->StartOfString[Offset];
+    RemainingString.LengthInChars = String->LengthInChars - Offset;
+    Match = &Matcher->MatchArray[MatchIndex];
+
+    if (Matcher->Insensitive) {
+        if (YoriLibCompareStringInsCnt(&RemainingString, Match, Match->LengthInChars) == 0) {
+            return TRUE;
+        }
+    } else {
+        if (YoriLibCompareStringCnt(&RemainingString, Match, Match->LengthInChars) == 0) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ Prepare a matcher without building a state machine.  This does not
+ allocate memory, so the matcher does not need to be cleaned up.
+
+ @param Matcher On completion, populated with a matcher.
+
  @param NumberMatches The number of substrings to look for.
 
- @param MatchArray An array of strings corresponding to the matches to
-        look for.
+ @param MatchArray An array of strings corresponding to the matches to look
+        for.
+
+ @param Insensitive TRUE if strings should be compared case insensitively.
+ */
+VOID
+YoriLibInitializeMultiMatchNoAutomaton(
+    __out PYORI_LIB_MULTI_MATCH Matcher,
+    __in YORI_ALLOC_SIZE_T NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __in BOOLEAN Insensitive
+    )
+{
+    YORI_ALLOC_SIZE_T MatchIndex;
+    TCHAR Char;
+
+    Matcher->MatchArray = MatchArray;
+    Matcher->NumberMatches = NumberMatches;
+    Matcher->LongestMatch = 0;
+    Matcher->FirstEmptyMatch = YORI_MAX_ALLOC_SIZE;
+    Matcher->Insensitive = Insensitive;
+    Matcher->Automaton = NULL;
+    ZeroMemory(Matcher->FirstChars, sizeof(Matcher->FirstChars));
+
+    for (MatchIndex = 0; MatchIndex < NumberMatches; MatchIndex++) {
+        if (MatchArray[MatchIndex].LengthInChars == 0) {
+            if (Matcher->FirstEmptyMatch == YORI_MAX_ALLOC_SIZE) {
+                Matcher->FirstEmptyMatch = MatchIndex;
+            }
+            continue;
+        }
+
+        if (MatchArray[MatchIndex].LengthInChars > Matcher->LongestMatch) {
+            Matcher->LongestMatch = MatchArray[MatchIndex].LengthInChars;
+        }
+
+        Char = YoriLibMultiMatchGetChar(Matcher, &MatchArray[MatchIndex], 0);
+        Matcher->FirstChars[Char & 0xFF] = TRUE;
+    }
+}
+
+/**
+ Prepare a set of substrings so that strings can be searched for any of
+ them.  When searching for a large number of substrings, this builds a
+ state machine that examines each character being searched once.  If this
+ cannot be allocated, the matcher compares each substring instead.
+
+ @param Matcher On completion, populated with a matcher.  The caller should
+        free this with @ref YoriLibCleanupMultiMatch .
+
+ @param NumberMatches The number of substrings to look for.
+
+ @param MatchArray An array of strings corresponding to the matches to look
+        for.  This array is referenced by the matcher and must remain valid
+        until the matcher is cleaned up.
+
+ @param Insensitive TRUE if strings should be compared case insensitively,
+        FALSE if they should be compared case sensitively.
+ */
+VOID
+YoriLibInitializeMultiMatch(
+    __out PYORI_LIB_MULTI_MATCH Matcher,
+    __in YORI_ALLOC_SIZE_T NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __in BOOLEAN Insensitive
+    )
+{
+    YoriLibInitializeMultiMatchNoAutomaton(Matcher, NumberMatches, MatchArray, Insensitive);
+    if (NumberMatches >= YORI_LIB_MULTI_MATCH_AUTOMATON_THRESHOLD) {
+        YoriLibMultiMatchBuildAutomaton(Matcher);
+    }
+}
+
+/**
+ Free any memory allocated by a matcher.
+
+ @param Matcher Pointer to the matcher.
+ */
+VOID
+YoriLibCleanupMultiMatch(
+    __inout PYORI_LIB_MULTI_MATCH Matcher
+    )
+{
+    if (Matcher->Automaton != NULL) {
+        YoriLibFree(Matcher->Automaton);
+        Matcher->Automaton = NULL;
+    }
+}
+
+/**
+ Search through a string for any of the substrings in a matcher.  Returns
+ the match which starts earliest in the string.  If more than one match
+ starts at the same offset, returns the one earliest in the match array.
+
+ @param Matcher Pointer to the matcher.
+
+ @param String The string to search through.
 
  @param StringOffsetOfMatch On successful completion, returns the offset
         within the string of the match.
 
- @return If a match is found, returns a pointer to the entry in MatchArray
-         corresponding to the substring that was matched.  If no match is
-         found, returns NULL.
+ @return If a match is found, returns a pointer to the entry in the match
+         array corresponding to the substring that was matched.  If no
+         match is found, returns NULL.
  */
 PYORI_STRING
-YoriLibFindFirstMatchSubstr(
+YoriLibFindFirstMultiMatch(
+    __in PYORI_LIB_MULTI_MATCH Matcher,
     __in PCYORI_STRING String,
-    __in YORI_ALLOC_SIZE_T NumberMatches,
-    __in PYORI_STRING MatchArray,
     __out_opt PYORI_ALLOC_SIZE_T StringOffsetOfMatch
     )
 {
-    YORI_STRING RemainingString;
-    YORI_ALLOC_SIZE_T CheckCount;
+    YORI_ALLOC_SIZE_T Offset;
+    YORI_ALLOC_SIZE_T MatchIndex;
+    DWORD FoundIndex;
+    TCHAR Char;
+
+    if (Matcher->Automaton != NULL) {
+        FoundIndex = YoriLibMultiMatchSearchAutomaton(Matcher, String, FALSE, &Offset);
+        if (FoundIndex != YORI_LIB_MULTI_MATCH_NONE) {
+            if (StringOffsetOfMatch != NULL) {
+                *StringOffsetOfMatch = Offset;
+            }
+            return &Matcher->MatchArray[FoundIndex];
+        }
+    } else {
+        for (Offset = 0; Offset < String->LengthInChars; Offset++) {
 
-    YoriLibInitEmptyString(&RemainingString);
-    RemainingString.StartOfString = String->StartOfString;
-    RemainingString.LengthInChars = String->LengthInChars;
+            //
+            //  Only compare against each string if the character here
+            //  could start a match.  An empty string matches at the start.
+            //
 
-    while (RemainingString.LengthInChars > 0) {
-        for (CheckCount = 0; CheckCount < NumberMatches; CheckCount++) {
-            if (YoriLibCompareStringCnt(&RemainingString, &MatchArray[CheckCount], MatchArray[CheckCount].LengthInChars) == 0) {
-                if (StringOffsetOfMatch != NULL) {
-                    *StringOffsetOfMatch = String->LengthInChars - RemainingString.LengthInChars;
+            Char = YoriLibMultiMatchGetChar(Matcher, String, Offset);
+            if (!Matcher->FirstChars[Char & 0xFF] &&
+                (Offset > 0 || Matcher->FirstEmptyMatch == YORI_MAX_ALLOC_SIZE)) {
+
+                continue;
+            }
+
+            for (MatchIndex = 0; MatchIndex < Matcher->NumberMatches; MatchIndex++) {
+                if (YoriLibMultiMatchCompareAt(Matcher, String, Offset, MatchIndex)) {
+                    if (StringOffsetOfMatch != NULL) {
+                        *StringOffsetOfMatch = Offset;
+                    }
+                    return &Matcher->MatchArray[MatchIndex];
                 }
-                return &MatchArray[CheckCount];
             }
         }
+    }
+
+    if (StringOffsetOfMatch != NULL) {
+        *StringOffsetOfMatch = 0;
+    }
+    return NULL;
+}
+
+/**
+ Search through a string for any of the substrings in a matcher.  Returns
+ the substring earliest in the match array that is found anywhere in the
+ string.  This is useful where substrings have an order of precedence.
+
+ @param Matcher Pointer to the matcher.
+
+ @param String The string to search through.
+
+ @param StringOffsetOfMatch On successful completion, returns the offset
+        within the string of the first occurrence of the match.
+
+ @return If a match is found, returns a pointer to the entry in the match
+         array corresponding to the substring that was matched.  If no
+         match is found, returns NULL.
+ */
+PYORI_STRING
+YoriLibFindLowestMultiMatch(
+    __in PYORI_LIB_MULTI_MATCH Matcher,
+    __in PCYORI_STRING String,
+    __out_opt PYORI_ALLOC_SIZE_T StringOffsetOfMatch
+    )
+{
+    YORI_ALLOC_SIZE_T Offset;
+    YORI_ALLOC_SIZE_T MatchIndex;
+    DWORD FoundIndex;
+    TCHAR FirstChar;
+
+    if (Matcher->Automaton != NULL) {
+        FoundIndex = YoriLibMultiMatchSearchAutomaton(Matcher, String, TRUE, &Offset);
+        if (FoundIndex != YORI_LIB_MULTI_MATCH_NONE) {
+            if (StringOffsetOfMatch != NULL) {
+                *StringOffsetOfMatch = Offset;
+            }
+            return &Matcher->MatchArray[FoundIndex];
+        }
+    } else if (String->LengthInChars > 0) {
+        for (MatchIndex = 0; MatchIndex < Matcher->NumberMatches; MatchIndex++) {
+            if (Matcher->MatchArray[MatchIndex].LengthInChars == 0) {
+                if (StringOffsetOfMatch != NULL) {
+                    *StringOffsetOfMatch = 0;
+                }
+                return &Matcher->MatchArray[MatchIndex];
+            }
+
+            FirstChar = YoriLibMultiMatchGetChar(Matcher, &Matcher->MatchArray[MatchIndex], 0);
+            for (Offset = 0; Offset < String->LengthInChars; Offset++) {
+                if (YoriLibMultiMatchGetChar(Matcher, String, Offset) == FirstChar &&
+                    YoriLibMultiMatchCompareAt(Matcher, String, Offset, MatchIndex)) {
 
-        RemainingString.LengthInChars--;
-        RemainingString.StartOfString++;
+                    if (StringOffsetOfMatch != NULL) {
+                        *StringOffsetOfMatch = Offset;
+                    }
+                    return &Matcher->MatchArray[MatchIndex];
+                }
+            }
+        }
     }
 
     if (StringOffsetOfMatch != NULL) {
@@ -84,7 +686,9 @@ YoriLibFindFirstMatchSubstr(
 /**
  Search through a string looking to see if any substrings can be located.
  Returns the first match in offet from the beginning of the string order.
- This routine looks for matches insensitively.
+ This routine looks for matches case sensitively.  Callers searching many
+ strings for the same substrings should use @ref YoriLibInitializeMultiMatch
+ to prepare the substrings once.
 
  @param String The string to search through.
 
@@ -101,38 +705,52 @@ YoriLibFindFirstMatchSubstr(
          found, returns NULL.
  */
 PYORI_STRING
-YoriLibFindFirstMatchSubstrIns(
+YoriLibFindFirstMatchSubstr(
     __in PCYORI_STRING String,
     __in YORI_ALLOC_SIZE_T NumberMatches,
     __in PYORI_STRING MatchArray,
     __out_opt PYORI_ALLOC_SIZE_T StringOffsetOfMatch
     )
 {
-    YORI_STRING RemainingString;
-    YORI_ALLOC_SIZE_T CheckCount;
+    YORI_LIB_MULTI_MATCH Matcher;
 
-    YoriLibInitEmptyString(&RemainingString);
-    RemainingString.StartOfString = String->StartOfString;
-    RemainingString.LengthInChars = String->LengthInChars;
+    YoriLibInitializeMultiMatchNoAutomaton(&Matcher, NumberMatches, MatchArray, FALSE);
+    return YoriLibFindFirstMultiMatch(&Matcher, String, StringOffsetOfMatch);
+}
 
-    while (RemainingString.LengthInChars > 0) {
-        for (CheckCount = 0; CheckCount < NumberMatches; CheckCount++) {
-            if (YoriLibCompareStringInsCnt(&RemainingString, &MatchArray[CheckCount], MatchArray[CheckCount].LengthInChars) == 0) {
-                if (StringOffsetOfMatch != NULL) {
-                    *StringOffsetOfMatch = String->LengthInChars - RemainingString.LengthInChars;
-                }
-                return &MatchArray[CheckCount];
-            }
-        }
+/**
+ Search through a string looking to see if any substrings can be located.
+ Returns the first match in offet from the beginning of the string order.
+ This routine looks for matches insensitively.  Callers searching many
+ strings for the same substrings should use @ref YoriLibInitializeMultiMatch
+ to prepare the substrings once.
 
-        RemainingString.LengthInChars--;
-        RemainingString.StartOfString++;
-    }
+ @param String The string to search through.
 
-    if (StringOffsetOfMatch != NULL) {
-        *StringOffsetOfMatch = 0;
-    }
-    return NULL;
+ @param NumberMatches The number of substrings to look for.
+
+ @param MatchArray An array of strings corresponding to the matches to
+        look for.
+
+ @param StringOffsetOfMatch On successful completion, returns the offset
+        within the string of the match.
+
+ @return If a match is found, returns a pointer to the entry in MatchArray
+         corresponding to the substring that was matched.  If no match is
+         found, returns NULL.
+ */
+PYORI_STRING
+YoriLibFindFirstMatchSubstrIns(
+    __in PCYORI_STRING String,
+    __in YORI_ALLOC_SIZE_T NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __out_opt PYORI_ALLOC_SIZE_T StringOffsetOfMatch
+    )
+{
+    YORI_LIB_MULTI_MATCH Matcher;
+
+    YoriLibInitializeMultiMatchNoAutomaton(&Matcher, NumberMatches, MatchArray, TRUE);
+    return YoriLibFindFirstMultiMatch(&Matcher, String, StringOffsetOfMatch);
 }
 
 /**
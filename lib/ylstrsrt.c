@@ -50,15 +50,16 @@ YoriLibSwapStrings(
 }
 
 /**
- Sort an array of strings.  This is currently implemented using a handrolled
- quicksort.
+ Sort an array of strings in place without allocating memory.  This is a
+ handrolled quicksort, used if memory for a faster sort cannot be
+ allocated.
 
  @param StringArray Pointer to an array of strings.
 
  @param Count The number of elements in the array.
  */
 VOID
-YoriLibSortStringArray(
+YoriLibSortStringArrayInPlace(
     __in_ecount(Count) PYORI_STRING StringArray,
     __in YORI_ALLOC_SIZE_T Count
     )
@@ -157,10 +158,10 @@ YoriLibSortStringArray(
 
     if (FirstOffset && (Count - FirstOffset)) {
         if (FirstOffset > 0) {
-            YoriLibSortStringArray(StringArray, FirstOffset);
+            YoriLibSortStringArrayInPlace(StringArray, FirstOffset);
         }
         if ((Count - FirstOffset) > 0) {
-            YoriLibSortStringArray(&StringArray[FirstOffset], Count - FirstOffset);
+            YoriLibSortStringArrayInPlace(&StringArray[FirstOffset], Count - FirstOffset);
         }
     }
 
@@ -175,4 +176,802 @@ YoriLibSortStringArray(
     ASSERT (Index == Count - 1);
 }
 
+
+/**
+ Sort an array of strings in place without allocating memory, preserving
+ the order of strings that compare equal.  This is an insertion sort, used
+ if memory for a faster sort cannot be allocated.
+
+ @param StringArray Pointer to an array of strings.
+
+ @param Count The number of elements in the array.
+ */
+VOID
+YoriLibSortStringArrayInPlaceStable(
+    __in_ecount(Count) PYORI_STRING StringArray,
+    __in YORI_ALLOC_SIZE_T Count
+    )
+{
+    YORI_ALLOC_SIZE_T Index;
+    YORI_ALLOC_SIZE_T InsertIndex;
+    YORI_STRING Current;
+
+    for (Index = 1; Index < Count; Index++) {
+        memcpy(&Current, &StringArray[Index], sizeof(YORI_STRING));
+        for (InsertIndex = Index; InsertIndex > 0; InsertIndex--) {
+            if (YoriLibCompareStringIns(&StringArray[InsertIndex - 1], &Current) <= 0) {
+                break;
+            }
+            memcpy(&StringArray[InsertIndex], &StringArray[InsertIndex - 1], sizeof(YORI_STRING));
+        }
+        memcpy(&StringArray[InsertIndex], &Current, sizeof(YORI_STRING));
+    }
+}
+
+/**
+ The number of characters from the start of each string that are upcased
+ and packed into its sort key.
+ */
+#define YORI_LIB_SORT_KEY_CHARS (4)
+
+/**
+ Ranges with this many elements or fewer are sorted by insertion sort.
+ */
+#define YORI_LIB_SORT_SMALL_RANGE (16)
+
+/**
+ The minimum number of elements to sort on multiple threads.  Below this,
+ the cost of creating threads exceeds the time saved.
+ */
+#define YORI_LIB_SORT_PARALLEL_THRESHOLD (32768)
+
+/**
+ The maximum number of threads to use for a single sort.
+ */
+#define YORI_LIB_SORT_MAX_THREADS (16)
+
+/**
+ A string being sorted, along with a sort key describing the start of the
+ string.
+ */
+typedef struct _YORI_LIB_SORT_ENTRY {
+
+    /**
+     The first YORI_LIB_SORT_KEY_CHARS characters of the string, upcased,
+     with the first character in the most significant bits.  Characters
+     beyond the end of the string are zero.  If two keys differ, the
+     strings compare in the same order as the keys, so most comparisons
+     don't need to examine the strings.
+     */
+    DWORDLONG Key;
+
+    /**
+     The string.
+     */
+    YORI_STRING String;
+} YORI_LIB_SORT_ENTRY, *PYORI_LIB_SORT_ENTRY;
+
+/**
+ A unit of work performed while sorting on multiple threads.
+ */
+typedef struct _YORI_LIB_SORT_TASK {
+
+    /**
+     The array of entries to sort or merge from.
+     */
+    PYORI_LIB_SORT_ENTRY Entries;
+
+    /**
+     An array the same size as Entries.  When sorting, this is used as
+     temporary space.  When merging, this receives the merged entries.
+     */
+    PYORI_LIB_SORT_ENTRY Temp;
+
+    /**
+     The index of the first entry to process.
+     */
+    YORI_ALLOC_SIZE_T Start;
+
+    /**
+     When merging, the index of the first entry in the second sorted range.
+     */
+    YORI_ALLOC_SIZE_T Middle;
+
+    /**
+     The index after the last entry to process.
+     */
+    YORI_ALLOC_SIZE_T End;
+
+    /**
+     TRUE if the task should merge two sorted ranges, FALSE if it should
+     sort a range.
+     */
+    BOOLEAN Merge;
+
+    /**
+     TRUE if the order of equal strings should be preserved.
+     */
+    BOOLEAN Stable;
+} YORI_LIB_SORT_TASK, *PYORI_LIB_SORT_TASK;
+
+/**
+ Compare two sort entries.
+
+ @param Entry1 Pointer to the first entry.
+
+ @param Entry2 Pointer to the second entry.
+
+ @return Less than zero if the first string should be sorted before the
+         second, greater than zero if it should be sorted after the second,
+         or zero if the strings are equal.
+ */
+int
+YoriLibCompareSortEntries(
+    __in PYORI_LIB_SORT_ENTRY Entry1,
+    __in PYORI_LIB_SORT_ENTRY Entry2
+    )
+{
+    if (Entry1->Key < Entry2->Key) {
+        return -1;
+    } else if (Entry1->Key > Entry2->Key) {
+        return 1;
+    }
+
+    if (Entry1->String.LengthInChars <= YORI_LIB_SORT_KEY_CHARS &&
+        Entry1->String.LengthInChars == Entry2->String.LengthInChars) {
+
+        return 0;
+    }
+
+    return YoriLibCompareStringIns(&Entry1->String, &Entry2->String);
+}
+
+/**
+ Swap two sort entries.
+
+ @param Entry1 Pointer to the first entry.
+
+ @param Entry2 Pointer to the second entry.
+ */
+VOID
+YoriLibSwapSortEntries(
+    __inout PYORI_LIB_SORT_ENTRY Entry1,
+    __inout PYORI_LIB_SORT_ENTRY Entry2
+    )
+{
+    YORI_LIB_SORT_ENTRY SwapEntry;
+
+    memcpy(&SwapEntry, Entry2, sizeof(YORI_LIB_SORT_ENTRY));
+    memcpy(Entry2, Entry1, sizeof(YORI_LIB_SORT_ENTRY));
+    memcpy(Entry1, &SwapEntry, sizeof(YORI_LIB_SORT_ENTRY));
+}
+
+/**
+ Sort a small range of entries with an insertion sort.  This preserves the
+ order of equal entries.
+
+ @param Entries Pointer to the first entry to sort.
+
+ @param Count The number of entries to sort.
+ */
+VOID
+YoriLibInsertionSortEntries(
+    __inout PYORI_LIB_SORT_ENTRY Entries,
+    __in YORI_ALLOC_SIZE_T Count
+    )
+{
+    YORI_ALLOC_SIZE_T Index;
+    YORI_ALLOC_SIZE_T InsertIndex;
+    YORI_LIB_SORT_ENTRY Current;
+
+    for (Index = 1; Index < Count; Index++) {
+        if (YoriLibCompareSortEntries(&Entries[Index - 1], &Entries[Index]) <= 0) {
+            continue;
+        }
+        memcpy(&Current, &Entries[Index], sizeof(YORI_LIB_SORT_ENTRY));
+        InsertIndex = Index;
+        do {
+            memcpy(&Entries[InsertIndex], &Entries[InsertIndex - 1], sizeof(YORI_LIB_SORT_ENTRY));
+            InsertIndex--;
+        } while (InsertIndex > 0 && YoriLibCompareSortEntries(&Entries[InsertIndex - 1], &Current) > 0);
+        memcpy(&Entries[InsertIndex], &Current, sizeof(YORI_LIB_SORT_ENTRY));
+    }
+}
+
+/**
+ Sort entries with a heap sort.  This is used if quicksort is partitioning
+ badly, since it has no pathological inputs.
+
+ @param Entries Pointer to the first entry to sort.
+
+ @param Count The number of entries to sort.
+ */
+VOID
+YoriLibHeapSortEntries(
+    __inout PYORI_LIB_SORT_ENTRY Entries,
+    __in YORI_ALLOC_SIZE_T Count
+    )
+{
+    YORI_ALLOC_SIZE_T Start;
+    YORI_ALLOC_SIZE_T End;
+    YORI_ALLOC_SIZE_T Parent;
+    YORI_ALLOC_SIZE_T Child;
+
+    //
+    //  Build a heap with the largest entry at the front, then repeatedly
+    //  move the front entry to the end and restore the heap.
+    //
+
+    Start = Count / 2;
+    End = Count;
+    while (End > 1) {
+        if (Start > 0) {
+            Start--;
+        } else {
+            End--;
+            YoriLibSwapSortEntries(&Entries[0], &Entries[End]);
+        }
+
+        Parent = Start;
+        while (TRUE) {
+            Child = Parent * 2 + 1;
+            if (Child >= End) {
+                break;
+            }
+            if (Child + 1 < End &&
+                YoriLibCompareSortEntries(&Entries[Child], &Entries[Child + 1]) < 0) {
+                Child++;
+            }
+            if (YoriLibCompareSortEntries(&Entries[Parent], &Entries[Child]) >= 0) {
+                break;
+            }
+            YoriLibSwapSortEntries(&Entries[Parent], &Entries[Child]);
+            Parent = Child;
+        }
+    }
+}
+
+/**
+ Sort entries with an introsort.  This is a quicksort using the median of
+ the first, middle and last entries as a pivot, which performs well on
+ sorted and reverse sorted input.  If partitioning goes badly, it switches
+ to a heap sort, and small ranges are completed with an insertion sort.
+ This does not preserve the order of equal entries.
+
+ @param Entries Pointer to the first entry to sort.
+
+ @param Count The number of entries to sort.
+
+ @param DepthRemaining The number of times ranges can be partitioned before
+        switching to a heap sort.
+ */
+VOID
+YoriLibIntroSortEntries(
+    __inout PYORI_LIB_SORT_ENTRY Entries,
+    __in YORI_ALLOC_SIZE_T Count,
+    __in DWORD DepthRemaining
+    )
+{
+    YORI_LIB_SORT_ENTRY Pivot;
+    YORI_ALLOC_SIZE_T Middle;
+    YORI_ALLOC_SIZE_T Last;
+    YORI_ALLOC_SIZE_T Left;
+    YORI_ALLOC_SIZE_T Right;
+    PYORI_LIB_SORT_ENTRY Median;
+
+    while (Count > YORI_LIB_SORT_SMALL_RANGE) {
+        if (DepthRemaining == 0) {
+            YoriLibHeapSortEntries(Entries, Count);
+            return;
+        }
+        DepthRemaining--;
+
+        Middle = Count / 2;
+        Last = Count - 1;
+        if (YoriLibCompareSortEntries(&Entries[0], &Entries[Middle]) < 0) {
+            if (YoriLibCompareSortEntries(&Entries[Middle], &Entries[Last]) < 0) {
+                Median = &Entries[Middle];
+            } else if (YoriLibCompareSortEntries(&Entries[0], &Entries[Last]) < 0) {
+                Median = &Entries[Last];
+            } else {
+                Median = &Entries[0];
+            }
+        } else {
+            if (YoriLibCompareSortEntries(&Entries[0], &Entries[Last]) < 0) {
+                Median = &Entries[0];
+            } else if (YoriLibCompareSortEntries(&Entries[Middle], &Entries[Last]) < 0) {
+                Median = &Entries[Last];
+            } else {
+                Median = &Entries[Middle];
+            }
+        }
+        memcpy(&Pivot, Median, sizeof(YORI_LIB_SORT_ENTRY));
+
+        //
+        //  Partition so that entries up to and including Right are no
+        //  greater than the pivot and entries after Right are no less than
+        //  it.  Since the pivot is the median of three entries, there is an
+        //  entry on each side which stops each scan, and neither side can
+        //  be empty.
+        //
+
+        Left = 0;
+        Right = Last;
+        while (TRUE) {
+            while (YoriLibCompareSortEntries(&Entries[Left], &Pivot) < 0) {
+                Left++;
+            }
+            while (YoriLibCompareSortEntries(&Entries[Right], &Pivot) > 0) {
+                Right--;
+            }
+            if (Left >= Right) {
+                break;
+            }
+            YoriLibSwapSortEntries(&Entries[Left], &Entries[Right]);
+            Left++;
+            Right--;
+        }
+
+        //
+        //  Recurse into the smaller range and loop on the larger one, so the
+        //  stack depth is logarithmic.
+        //
+
+        if (Right + 1 < Count - Right - 1) {
+            YoriLibIntroSortEntries(Entries, Right + 1, DepthRemaining);
+            Entries = &Entries[Right + 1];
+            Count = Count - Right - 1;
+        } else {
+            YoriLibIntroSortEntries(&Entries[Right + 1], Count - Right - 1, DepthRemaining);
+            Count = Right + 1;
+        }
+    }
+
+    YoriLibInsertionSortEntries(Entries, Count);
+}
+
+/**
+ Merge two adjacent sorted ranges of entries.  Where entries are equal, the
+ entry from the first range is placed first.
+
+ @param Source Pointer to the entries to merge.
+
+ @param Dest Pointer to an array to receive the merged entries, at the same
+        indexes as the entries in Source.
+
+ @param Start The index of the first entry in the first range.
+
+ @param Middle The index of the first entry in the second range.
+
+ @param End The index after the last entry in the second range.
+ */
+VOID
+YoriLibMergeSortEntries(
+    __in PYORI_LIB_SORT_ENTRY Source,
+    __out PYORI_LIB_SORT_ENTRY Dest,
+    __in YORI_ALLOC_SIZE_T Start,
+    __in YORI_ALLOC_SIZE_T Middle,
+    __in YORI_ALLOC_SIZE_T End
+    )
+{
+    YORI_ALLOC_SIZE_T Left;
+    YORI_ALLOC_SIZE_T Right;
+    YORI_ALLOC_SIZE_T Index;
+
+    //
+    //  If the ranges are already in order, which is common for sorted
+    //  input, just copy them.
+    //
+
+    if (Middle == Start ||
+        Middle == End ||
+        YoriLibCompareSortEntries(&Source[Middle - 1], &Source[Middle]) <= 0) {
+
+        memcpy(&Dest[Start], &Source[Start], (End - Start) * sizeof(YORI_LIB_SORT_ENTRY));
+        return;
+    }
+
+    Left = Start;
+    Right = Middle;
+    Index = Start;
+    while (Left < Middle && Right < End) {
+        if (YoriLibCompareSortEntries(&Source[Left], &Source[Right]) <= 0) {
+            memcpy(&Dest[Index], &Source[Left], sizeof(YORI_LIB_SORT_ENTRY));
+            Left++;
+        } else {
+            memcpy(&Dest[Index], &Source[Right], sizeof(YORI_LIB_SORT_ENTRY));
+            Right++;
+        }
+        Index++;
+    }
+
+    if (Left < Middle) {
+        memcpy(&Dest[Index], &Source[Left], (Middle - Left) * sizeof(YORI_LIB_SORT_ENTRY));
+    } else if (Right < End) {
+        memcpy(&Dest[Index], &Source[Right], (End - Right) * sizeof(YORI_LIB_SORT_ENTRY));
+    }
+}
+
+/**
+ Sort entries with a merge sort, which preserves the order of equal
+ entries.  Small ranges are sorted with an insertion sort, and then merged
+ together.
+
+ @param Entries Pointer to the first entry to sort.
+
+ @param Temp Pointer to an array of the same size as Entries to use while
+        sorting.
+
+ @param Count The number of entries to sort.
+ */
+VOID
+YoriLibStableSortEntries(
+    __inout PYORI_LIB_SORT_ENTRY Entries,
+    __out_ecount(Count) PYORI_LIB_SORT_ENTRY Temp,
+    __in YORI_ALLOC_SIZE_T Count
+    )
+{
+    PYORI_LIB_SORT_ENTRY Source;
+    PYORI_LIB_SORT_ENTRY Dest;
+    PYORI_LIB_SORT_ENTRY Swap;
+    YORI_ALLOC_SIZE_T Width;
+    YORI_ALLOC_SIZE_T Start;
+    YORI_ALLOC_SIZE_T Middle;
+    YORI_ALLOC_SIZE_T End;
+
+    for (Start = 0; Start < Count; Start = Start + YORI_LIB_SORT_SMALL_RANGE) {
+        End = Count - Start;
+        if (End > YORI_LIB_SORT_SMALL_RANGE) {
+            End = YORI_LIB_SORT_SMALL_RANGE;
+        }
+        YoriLibInsertionSortEntries(&Entries[Start], End);
+    }
+
+    Source = Entries;
+    Dest = Temp;
+    for (Width = YORI_LIB_SORT_SMALL_RANGE; Width < Count; Width = Width * 2) {
+        for (Start = 0; Start < Count; Start = End) {
+            Middle = Count;
+            End = Count;
+            if (Count - Start > Width) {
+                Middle = Start + Width;
+                if (Count - Middle > Width) {
+                    End = Middle + Width;
+                }
+            }
+            YoriLibMergeSortEntries(Source, Dest, Start, Middle, End);
+        }
+
+        Swap = Source;
+        Source = Dest;
+        Dest = Swap;
+    }
+
+    if (Source != Entries) {
+        memcpy(Entries, Source, Count * sizeof(YORI_LIB_SORT_ENTRY));
+    }
+}
+
+/**
+ Sort a range of entries, without using multiple threads.
+
+ @param Entries Pointer to the first entry to sort.
+
+ @param Temp Pointer to an array of the same size as Entries to use while
+        sorting.  This is only used for a stable sort.
+
+ @param Count The number of entries to sort.
+
+ @param Stable TRUE if the order of equal entries should be preserved.
+ */
+VOID
+YoriLibSortEntries(
+    __inout PYORI_LIB_SORT_ENTRY Entries,
+    __out_ecount_opt(Count) PYORI_LIB_SORT_ENTRY Temp,
+    __in YORI_ALLOC_SIZE_T Count,
+    __in BOOLEAN Stable
+    )
+{
+    DWORD Depth;
+    YORI_ALLOC_SIZE_T Remaining;
+
+    if (Stable) {
+        ASSERT(Temp != NULL);
+        __analysis_assume(Temp != NULL);
+        YoriLibStableSortEntries(Entries, Temp, Count);
+        return;
+    }
+
+    Depth = 0;
+    for (Remaining = Count; Remaining > 1; Remaining = Remaining / 2) {
+        Depth = Depth + 2;
+    }
+
+    YoriLibIntroSortEntries(Entries, Count, Depth);
+}
+
+/**
+ Perform one unit of work for a sort on multiple threads.
+
+ @param Context Pointer to the task to perform.
+
+ @return Zero.
+ */
+DWORD WINAPI
+YoriLibSortWorker(
+    __in LPVOID Context
+    )
+{
+    PYORI_LIB_SORT_TASK Task;
+
+    Task = (PYORI_LIB_SORT_TASK)Context;
+    if (Task->Merge) {
+        YoriLibMergeSortEntries(Task->Entries, Task->Temp, Task->Start, Task->Middle, Task->End);
+    } else {
+        YoriLibSortEntries(&Task->Entries[Task->Start],
+                           &Task->Temp[Task->Start],
+                           Task->End - Task->Start,
+                           Task->Stable);
+    }
+
+    return 0;
+}
+
+/**
+ Perform a set of sort tasks concurrently.  The first task is performed on
+ the calling thread, and each other task on a new thread.  If a thread
+ cannot be created, its task is performed on the calling thread.
+
+ @param Tasks Pointer to an array of tasks.
+
+ @param TaskCount The number of tasks in the array.
+ */
+VOID
+YoriLibSortRunTasks(
+    __in_ecount(TaskCount) PYORI_LIB_SORT_TASK Tasks,
+    __in DWORD TaskCount
+    )
+{
+    HANDLE Threads[YORI_LIB_SORT_MAX_THREADS];
+    DWORD ThreadCount;
+    DWORD ThreadId;
+    DWORD Index;
+
+    ASSERT(TaskCount <= YORI_LIB_SORT_MAX_THREADS);
+
+    ThreadCount = 0;
+    for (Index = 1; Index < TaskCount; Index++) {
+        Threads[ThreadCount] = CreateThread(NULL, 0, YoriLibSortWorker, &Tasks[Index], 0, &ThreadId);
+        if (Threads[ThreadCount] == NULL) {
+            YoriLibSortWorker(&Tasks[Index]);
+        } else {
+            ThreadCount++;
+        }
+    }
+
+    YoriLibSortWorker(&Tasks[0]);
+
+    if (ThreadCount > 0) {
+        WaitForMultipleObjects(ThreadCount, Threads, TRUE, INFINITE);
+        for (Index = 0; Index < ThreadCount; Index++) {
+            CloseHandle(Threads[Index]);
+        }
+    }
+}
+
+/**
+ Sort entries using multiple threads.  The entries are divided into ranges
+ which are each sorted on a separate thread, and the sorted ranges are
+ then merged, with each pair of ranges at each level merged on a separate
+ thread.
+
+ @param Entries Pointer to the first entry to sort.
+
+ @param Temp Pointer to an array of the same size as Entries to use while
+        sorting.
+
+ @param Count The number of entries to sort.
+
+ @param Stable TRUE if the order of equal entries should be preserved.
+
+ @param ThreadCount The number of ranges to sort concurrently.
+ */
+VOID
+YoriLibParallelSortEntries(
+    __inout PYORI_LIB_SORT_ENTRY Entries,
+    __out_ecount(Count) PYORI_LIB_SORT_ENTRY Temp,
+    __in YORI_ALLOC_SIZE_T Count,
+    __in BOOLEAN Stable,
+    __in DWORD ThreadCount
+    )
+{
+    YORI_LIB_SORT_TASK Tasks[YORI_LIB_SORT_MAX_THREADS];
+    YORI_ALLOC_SIZE_T Bounds[YORI_LIB_SORT_MAX_THREADS + 1];
+    PYORI_LIB_SORT_ENTRY Source;
+    PYORI_LIB_SORT_ENTRY Dest;
+    PYORI_LIB_SORT_ENTRY Swap;
+    DWORD RangeCount;
+    DWORD TaskCount;
+    DWORD Index;
+
+    for (Index = 0; Index < ThreadCount; Index++) {
+        Bounds[Index] = (YORI_ALLOC_SIZE_T)((DWORDLONG)Count * Index / ThreadCount);
+        Tasks[Index].Entries = Entries;
+        Tasks[Index].Temp = Temp;
+        Tasks[Index].Start = Bounds[Index];
+        Tasks[Index].Middle = 0;
+        Tasks[Index].End = (YORI_ALLOC_SIZE_T)((DWORDLONG)Count * (Index + 1) / ThreadCount);
+        Tasks[Index].Merge = FALSE;
+        Tasks[Index].Stable = Stable;
+    }
+    Bounds[ThreadCount] = Count;
+
+    YoriLibSortRunTasks(Tasks, ThreadCount);
+
+    //
+    //  Merge pairs of adjacent ranges until one range remains.  A range
+    //  without a partner is copied.
+    //
+
+    Source = Entries;
+    Dest = Temp;
+    RangeCount = ThreadCount;
+    while (RangeCount > 1) {
+        TaskCount = 0;
+        for (Index = 0; Index < RangeCount; Index = Index + 2) {
+            Tasks[TaskCount].Entries = Source;
+            Tasks[TaskCount].Temp = Dest;
+            Tasks[TaskCount].Start = Bounds[Index];
+            Tasks[TaskCount].Merge = TRUE;
+            Tasks[TaskCount].Stable = Stable;
+            if (Index + 1 < RangeCount) {
+                Tasks[TaskCount].Middle = Bounds[Index + 1];
+                Tasks[TaskCount].End = Bounds[Index + 2];
+            } else {
+                Tasks[TaskCount].Middle = Bounds[Index + 1];
+                Tasks[TaskCount].End = Bounds[Index + 1];
+            }
+            Bounds[TaskCount] = Bounds[Index];
+            TaskCount++;
+        }
+        Bounds[TaskCount] = Count;
+
+        YoriLibSortRunTasks(Tasks, TaskCount);
+
+        RangeCount = TaskCount;
+        Swap = Source;
+        Source = Dest;
+        Dest = Swap;
+    }
+
+    if (Source != Entries) {
+        memcpy(Entries, Source, Count * sizeof(YORI_LIB_SORT_ENTRY));
+    }
+}
+
+/**
+ Sort an array of strings case insensitively.
+
+ @param StringArray Pointer to an array of strings.
+
+ @param Count The number of elements in the array.
+
+ @param Flags Specifies how to sort.  YORI_LIB_SORT_STABLE preserves the
+        order of strings that compare equal.  YORI_LIB_SORT_PARALLEL sorts
+        large arrays using multiple threads.
+ */
+VOID
+YoriLibSortStringArrayEx(
+    __in_ecount(Count) PYORI_STRING StringArray,
+    __in YORI_ALLOC_SIZE_T Count,
+    __in DWORD Flags
+    )
+{
+    PYORI_LIB_SORT_ENTRY Entries;
+    PYORI_LIB_SORT_ENTRY Temp;
+    YORI_MAX_UNSIGNED_T EntriesNeeded;
+    YORI_ALLOC_SIZE_T Index;
+    YORI_ALLOC_SIZE_T CharIndex;
+    DWORDLONG Key;
+    DWORD ThreadCount;
+    BOOLEAN Stable;
+    TCHAR Char;
+
+    if (Count <= 1) {
+        return;
+    }
+
+    Stable = FALSE;
+    if (Flags & YORI_LIB_SORT_STABLE) {
+        Stable = TRUE;
+    }
+
+    ThreadCount = 1;
+    if ((Flags & YORI_LIB_SORT_PARALLEL) != 0 &&
+        Count >= YORI_LIB_SORT_PARALLEL_THRESHOLD) {
+
+        SYSTEM_INFO SystemInfo;
+        GetSystemInfo(&SystemInfo);
+        ThreadCount = SystemInfo.dwNumberOfProcessors;
+        if (ThreadCount < 1) {
+            ThreadCount = 1;
+        }
+        if (ThreadCount > YORI_LIB_SORT_MAX_THREADS) {
+            ThreadCount = YORI_LIB_SORT_MAX_THREADS;
+        }
+    }
+
+    //
+    //  Temporary space is needed to merge.  If memory can't be allocated,
+    //  sort the strings directly.
+    //
+
+    EntriesNeeded = Count;
+    if (Stable || ThreadCount > 1) {
+        EntriesNeeded = EntriesNeeded * 2;
+    }
+
+    Entries = NULL;
+    if (YoriLibIsSizeAllocatable(EntriesNeeded * sizeof(YORI_LIB_SORT_ENTRY))) {
+        Entries = YoriLibMalloc((YORI_ALLOC_SIZE_T)(EntriesNeeded * sizeof(YORI_LIB_SORT_ENTRY)));
+    }
+
+    if (Entries == NULL) {
+        if (Stable) {
+            YoriLibSortStringArrayInPlaceStable(StringArray, Count);
+        } else {
+            YoriLibSortStringArrayInPlace(StringArray, Count);
+        }
+        return;
+    }
+
+    Temp = NULL;
+    if (EntriesNeeded > Count) {
+        Temp = &Entries[Count];
+    }
+
+    for (Index = 0; Index < Count; Index++) {
+        Key = 0;
+        for (CharIndex = 0; CharIndex < YORI_LIB_SORT_KEY_CHARS; CharIndex++) {
+            Char = 0;
+            if (CharIndex < StringArray[Index].LengthInChars) {
+                Char = YoriLibUpcaseChar(StringArray[Index].StartOfString[CharIndex]);
+            }
+            Key = (Key << (sizeof(TCHAR) * 8)) | Char;
+        }
+        Entries[Index].Key = Key;
+        memcpy(&Entries[Index].String, &StringArray[Index], sizeof(YORI_STRING));
+    }
+
+    if (ThreadCount > 1) {
+        __analysis_assume(Temp != NULL);
+        YoriLibParallelSortEntries(Entries, Temp, Count, Stable, ThreadCount);
+    } else {
+        YoriLibSortEntries(Entries, Temp, Count, Stable);
+    }
+
+    for (Index = 0; Index < Count; Index++) {
+        memcpy(&StringArray[Index], &Entries[Index].String, sizeof(YORI_STRING));
+    }
+
+    YoriLibFree(Entries);
+}
+
+/**
+ Sort an array of strings case insensitively.  The order of strings that
+ compare equal is not preserved.
+
+ @param StringArray Pointer to an array of strings.
+
+ @param Count The number of elements in the array.
+ */
+VOID
+YoriLibSortStringArray(
+    __in_ecount(Count) PYORI_STRING StringArray,
+    __in YORI_ALLOC_SIZE_T Count
+    )
+{
+    YoriLibSortStringArrayEx(StringArray, Count, 0);
+}
+
 // vim:sw=4:ts=4:et:
@@ -53,6 +53,9 @@ YoriCallBuiltinUnregister(
     __in PYORI_CMD_BUILTIN CallbackFn
     );
 
+BOOL
+YoriCallClearHistoryFile(VOID);
+
 BOOL
 YoriCallClearHistoryStrings(VOID);
 
@@ -151,6 +154,12 @@ YoriCallGetNextJobId(
     __in DWORD PreviousJobId
     );
 
+__success(return)
+BOOL
+YoriCallGetPathIndexStatistics(
+    __out PYORI_LIB_PATH_INDEX_STATISTICS Statistics
+    );
+
 __success(return)
 BOOL
 YoriCallGetSystemAliasStrings(
@@ -196,6 +196,14 @@ typedef _Return_type_success_(return >= 0) long HRESULT;
 #define ERROR_OLD_WIN_VERSION 1150
 #endif
 
+#ifndef ERROR_UNABLE_TO_MOVE_REPLACEMENT_2
+/**
+ Define for the error indicating that ReplaceFile renamed the replaced file
+ to the backup name but could not rename the replacement file into place.
+ */
+#define ERROR_UNABLE_TO_MOVE_REPLACEMENT_2 1177
+#endif
+
 #ifndef PROCESS_QUERY_LIMITED_INFORMATION
 /**
  Definition for opening processes with very limited access for compilation
@@ -444,6 +452,47 @@ typedef struct _YORI_FILE_CASE_SENSITIVE_INFORMATION {
 
 } YORI_FILE_CASE_SENSITIVE_INFORMATION, *PYORI_FILE_CASE_SENSITIVE_INFORMATION;
 
+/**
+ Definition of the information class to obtain the device type and
+ characteristics of a volume for compilation environments that don't
+ define it.
+ */
+#define FileFsDeviceInformation (4)
+
+/**
+ Information about the device containing a volume.
+ */
+typedef struct _YORI_FILE_FS_DEVICE_INFORMATION {
+
+    /**
+     The type of the device, as a FILE_DEVICE_* value.
+     */
+    DWORD DeviceType;
+
+    /**
+     Flags describing the device, including FILE_REMOVABLE_MEDIA and
+     FILE_REMOTE_DEVICE.
+     */
+    DWORD Characteristics;
+
+} YORI_FILE_FS_DEVICE_INFORMATION, *PYORI_FILE_FS_DEVICE_INFORMATION;
+
+#ifndef FILE_REMOVABLE_MEDIA
+/**
+ If not defined by the current compilation environment, the device
+ characteristic indicating media can be removed from the device.
+ */
+#define FILE_REMOVABLE_MEDIA 0x00000001
+#endif
+
+#ifndef FILE_REMOTE_DEVICE
+/**
+ If not defined by the current compilation environment, the device
+ characteristic indicating the device is accessed over a network.
+ */
+#define FILE_REMOTE_DEVICE 0x00000010
+#endif
+
 /**
  Definition of the information class to query memory usage of a process for
  compilation environments that don't define it.
@@ -3101,6 +3150,93 @@ typedef USN_JOURNAL_DATA *PUSN_JOURNAL_DATA;
 
 #endif
 
+#ifndef FSCTL_READ_USN_JOURNAL
+
+/**
+ Specifies the FSCTL_READ_USN_JOURNAL numerical representation if the
+ compilation environment doesn't provide it.
+ */
+#define FSCTL_READ_USN_JOURNAL          CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 46,  METHOD_NEITHER, FILE_ANY_ACCESS)
+
+/**
+ Information supplied to FSCTL_READ_USN_JOURNAL where compiler doesn't
+ define it.
+ */
+typedef struct {
+
+    /**
+     The first USN to return.
+     */
+    LONGLONG StartUsn;
+
+    /**
+     A mask of reasons that should be returned.
+     */
+    DWORD ReasonMask;
+
+    /**
+     If nonzero, only return records generated when the file is closed.
+     */
+    DWORD ReturnOnlyOnClose;
+
+    /**
+     The time to wait for records, if BytesToWaitFor is nonzero.
+     */
+    DWORDLONG Timeout;
+
+    /**
+     The number of bytes of records to wait for before returning.  Zero
+     indicates the call should return immediately.
+     */
+    DWORDLONG BytesToWaitFor;
+
+    /**
+     The USN journal identifier that the records should be read from.
+     */
+    DWORDLONG UsnJournalID;
+} READ_USN_JOURNAL_DATA;
+
+/**
+ Pointer to information supplied to FSCTL_READ_USN_JOURNAL where compiler
+ doesn't define it.
+ */
+typedef READ_USN_JOURNAL_DATA *PREAD_USN_JOURNAL_DATA;
+
+#endif
+
+#ifndef USN_REASON_FILE_DELETE
+
+/**
+ A change journal reason indicating a file was deleted, if the compilation
+ environment doesn't provide it.
+ */
+#define USN_REASON_FILE_DELETE           (0x00000200)
+
+/**
+ A change journal reason indicating a file was renamed from this name, if
+ the compilation environment doesn't provide it.
+ */
+#define USN_REASON_RENAME_OLD_NAME       (0x00001000)
+
+/**
+ A change journal reason indicating a file was renamed to this name, if
+ the compilation environment doesn't provide it.
+ */
+#define USN_REASON_RENAME_NEW_NAME       (0x00002000)
+
+#endif
+
+#ifndef FIND_FIRST_EX_LARGE_FETCH
+
+/**
+ A flag to FindFirstFileEx indicating that a larger buffer should be used
+ to return directory entries, if the compilation environment doesn't
+ provide it.
+ */
+#define FIND_FIRST_EX_LARGE_FETCH 0x00000002
+
+#endif
+
 
 #ifndef FSCTL_GET_EXTERNAL_BACKING
 
@@ -7434,6 +7570,18 @@ NT_QUERY_SYSTEM_INFORMATION(DWORD, PVOID, DWORD, PDWORD);
  */
 typedef NT_QUERY_SYSTEM_INFORMATION *PNT_QUERY_SYSTEM_INFORMATION;
 
+/**
+ A prototype for the NtQueryVolumeInformationFile function.
+ */
+typedef
+LONG WINAPI
+NT_QUERY_VOLUME_INFORMATION_FILE(HANDLE, PIO_STATUS_BLOCK, PVOID, DWORD, DWORD);
+
+/**
+ A prototype for a pointer to the NtQueryVolumeInformationFile function.
+ */
+typedef NT_QUERY_VOLUME_INFORMATION_FILE *PNT_QUERY_VOLUME_INFORMATION_FILE;
+
 /**
  A prototype for the NtSetInformationFile function.
  */
@@ -7535,6 +7683,12 @@ typedef struct _YORI_NTDLL_FUNCTIONS {
      */
     PNT_QUERY_SYSTEM_INFORMATION pNtQuerySystemInformation;
 
+    /**
+     If it's available on the current system, a pointer to
+     NtQueryVolumeInformationFile.
+     */
+    PNT_QUERY_VOLUME_INFORMATION_FILE pNtQueryVolumeInformationFile;
+
     /**
      If it's available on the current system, a pointer to
      NtSetInformationFile.
@@ -7644,6 +7798,18 @@ CREATE_SYMBOLIC_LINKW(LPTSTR, LPTSTR, DWORD);
  */
 typedef CREATE_SYMBOLIC_LINKW *PCREATE_SYMBOLIC_LINKW;
 
+/**
+ A prototype for the FindFirstFileExW function.
+ */
+typedef
+HANDLE WINAPI
+FIND_FIRST_FILE_EXW(LPCWSTR, DWORD, LPWIN32_FIND_DATAW, DWORD, LPVOID, DWORD);
+
+/**
+ A prototype for a pointer to the FindFirstFileExW function.
+ */
+typedef FIND_FIRST_FILE_EXW *PFIND_FIRST_FILE_EXW;
+
 /**
  A prototype for the FindFirstStreamW function.
  */
@@ -8220,6 +8386,18 @@ REGISTER_APPLICATION_RESTART(LPCWSTR, DWORD);
  */
 typedef REGISTER_APPLICATION_RESTART *PREGISTER_APPLICATION_RESTART;
 
+/**
+ A prototype for the ReOpenFile function.
+ */
+typedef
+HANDLE WINAPI
+REOPEN_FILE(HANDLE, DWORD, DWORD, DWORD);
+
+/**
+ A prototype for a pointer to the ReOpenFile function.
+ */
+typedef REOPEN_FILE *PREOPEN_FILE;
+
 /**
  A prototype for the ReplaceFileW function.
  */
@@ -8432,6 +8610,11 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     PCREATE_SYMBOLIC_LINKW pCreateSymbolicLinkW;
 
+    /**
+     If it's available on the current system, a pointer to FindFirstFileExW.
+     */
+    PFIND_FIRST_FILE_EXW pFindFirstFileExW;
+
     /**
      If it's available on the current system, a pointer to FindFirstStreamW.
      */
@@ -8672,6 +8855,11 @@ typedef struct _YORI_KERNEL32_FUNCTIONS {
      */
     PREGISTER_APPLICATION_RESTART pRegisterApplicationRestart;
 
+    /**
+     If it's available on the current system, a pointer to ReOpenFile.
+     */
+    PREOPEN_FILE pReOpenFile;
+
     /**
      If it's available on the current system, a pointer to ReplaceFileW.
      */
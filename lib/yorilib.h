@@ -214,6 +214,18 @@ typedef struct _YORI_HASH_ENTRY {
      table to identify the entry.
      */
     PVOID Context;
+
+    /**
+     The hash table that this entry is inserted into.
+     */
+    struct _YORI_HASH_TABLE *HashTable;
+
+    /**
+     The full hash of Key.  This is used to select a bucket when the table
+     is resized, and allows most entries with a different key to be skipped
+     without comparing the strings.
+     */
+    DWORD Hash;
 } YORI_HASH_ENTRY, *PYORI_HASH_ENTRY;
 
 /**
@@ -241,6 +253,29 @@ typedef struct _YORI_HASH_TABLE {
      An array of hash buckets.
      */
     PYORI_HASH_BUCKET Buckets;
+
+    /**
+     The number of entries inserted into the hash table.
+     */
+    YORI_ALLOC_SIZE_T EntryCount;
+
+    /**
+     The number of buckets in OldBuckets.
+     */
+    YORI_ALLOC_SIZE_T OldNumberBuckets;
+
+    /**
+     When the table is being resized, the previous array of hash buckets.
+     Entries are moved from this array into Buckets a few buckets at a time
+     as new entries are inserted.  NULL if the table is not being resized.
+     */
+    PYORI_HASH_BUCKET OldBuckets;
+
+    /**
+     The index of the next bucket in OldBuckets to move into Buckets.
+     Buckets below this index in OldBuckets are empty.
+     */
+    YORI_ALLOC_SIZE_T RehashIndex;
 } YORI_HASH_TABLE, *PYORI_HASH_TABLE;
 
 #pragma pack(push, 1)
@@ -2663,6 +2698,12 @@ YoriLibHashLookupByKey(
     __in PCYORI_STRING KeyString
     );
 
+PYORI_HASH_ENTRY
+YoriLibHashGetNextEntry(
+    __in PYORI_HASH_TABLE HashTable,
+    __in_opt PYORI_HASH_ENTRY PreviousEntry
+    );
+
 VOID
 YoriLibHashRemoveByEntry(
     __in PYORI_HASH_ENTRY HashEntry
@@ -2836,6 +2877,22 @@ YoriLibSetMultibyteInputEncoding(
     __in DWORD Encoding
     );
 
+YORI_ALLOC_SIZE_T
+YoriLibUtf8ToUtf16(
+    __in_ecount(InputLength) LPCSTR Input,
+    __in YORI_ALLOC_SIZE_T InputLength,
+    __out_ecount_opt(OutputLength) LPTSTR Output,
+    __in YORI_ALLOC_SIZE_T OutputLength
+    );
+
+YORI_ALLOC_SIZE_T
+YoriLibUtf16ToUtf8(
+    __in_ecount(InputLength) LPCTSTR Input,
+    __in YORI_ALLOC_SIZE_T InputLength,
+    __out_ecount_opt(OutputLength) LPSTR Output,
+    __in YORI_ALLOC_SIZE_T OutputLength
+    );
+
 YORI_ALLOC_SIZE_T
 YoriLibGetMbyteOutputSizeNeeded(
     __in LPCTSTR StringBuffer,
@@ -2911,6 +2968,69 @@ typedef enum _YORI_LIB_LINE_ENDING {
  */
 typedef YORI_LIB_LINE_ENDING *PYORI_LIB_LINE_ENDING;
 
+/**
+ A single line within a batch of lines.
+ */
+typedef struct _YORI_LIB_LINE_BATCH_ENTRY {
+
+    /**
+     The contents of the line, not including the line ending.  This refers
+     to YORI_LIB_LINE_BATCH::Text and is not NULL terminated.
+     */
+    YORI_STRING Line;
+
+    /**
+     The characters that terminated the line.
+     */
+    YORI_LIB_LINE_ENDING LineEnding;
+
+} YORI_LIB_LINE_BATCH_ENTRY, *PYORI_LIB_LINE_BATCH_ENTRY;
+
+/**
+ A set of lines read from a stream in a single operation.
+ */
+typedef struct _YORI_LIB_LINE_BATCH {
+
+    /**
+     The text of all of the lines, converted to host encoding.
+     */
+    YORI_STRING Text;
+
+    /**
+     An array of lines within Text.
+     */
+    PYORI_LIB_LINE_BATCH_ENTRY Lines;
+
+    /**
+     The number of valid elements in Lines.
+     */
+    YORI_ALLOC_SIZE_T LineCount;
+
+    /**
+     The number of elements allocated in Lines.
+     */
+    YORI_ALLOC_SIZE_T LinesAllocated;
+
+} YORI_LIB_LINE_BATCH, *PYORI_LIB_LINE_BATCH;
+
+VOID
+YoriLibInitializeLineBatch(
+    __out PYORI_LIB_LINE_BATCH Batch
+    );
+
+VOID
+YoriLibFreeLineBatch(
+    __inout PYORI_LIB_LINE_BATCH Batch
+    );
+
+__success(return)
+BOOL
+YoriLibReadLineBatch(
+    __inout PYORI_LIB_LINE_BATCH Batch,
+    __inout PVOID * Context,
+    __in HANDLE FileHandle
+    );
+
 PVOID
 YoriLibReadLineToString(
     __in PYORI_STRING UserString,
@@ -3068,6 +3188,202 @@ YoriLibIsAllocationExtendable(
     __in YORI_ALLOC_SIZE_T DesiredExtraSize
     );
 
+/**
+ The number of bytes allocated at a time to satisfy allocations from an
+ arena if the caller does not specify a size.
+ */
+#define YORI_LIB_ARENA_DEFAULT_CHUNK_SIZE (16 * 1024)
+
+/**
+ An arena that satisfies small allocations from larger chunks of memory,
+ which are released together.
+ */
+typedef struct _YORI_LIB_ARENA {
+
+    /**
+     The first chunk of memory owned by the arena.
+     */
+    PVOID FirstChunk;
+
+    /**
+     The chunk of memory that allocations are currently being made from.
+     */
+    PVOID CurrentChunk;
+
+    /**
+     The number of bytes to allocate at a time.
+     */
+    YORI_ALLOC_SIZE_T ChunkSize;
+
+    /**
+     The number of chunks that have been allocated from the heap.
+     */
+    DWORD ChunksAllocated;
+
+    /**
+     The number of allocations that have been satisfied from the arena.
+     */
+    DWORD AllocationCount;
+} YORI_LIB_ARENA, *PYORI_LIB_ARENA;
+
+VOID
+YoriLibInitializeArena(
+    __out PYORI_LIB_ARENA Arena,
+    __in YORI_ALLOC_SIZE_T ChunkSize
+    );
+
+PVOID
+YoriLibArenaAlloc(
+    __inout PYORI_LIB_ARENA Arena,
+    __in YORI_ALLOC_SIZE_T Bytes,
+    __out_opt PVOID *MemoryToFree
+    );
+
+__success(return)
+BOOL
+YoriLibArenaAllocateString(
+    __inout PYORI_LIB_ARENA Arena,
+    __out PYORI_STRING String,
+    __in YORI_ALLOC_SIZE_T CharsToAllocate
+    );
+
+VOID
+YoriLibResetArena(
+    __inout PYORI_LIB_ARENA Arena
+    );
+
+VOID
+YoriLibCleanupArena(
+    __inout PYORI_LIB_ARENA Arena
+    );
+
+/**
+ The number of caches within a pool.  Each thread allocates from one of
+ these caches based on its thread ID.
+ */
+#define YORI_LIB_POOL_CACHE_COUNT (8)
+
+/**
+ A set of free and unused elements within a pool which are used by a subset
+ of threads.
+ */
+typedef struct _YORI_LIB_POOL_CACHE {
+
+    /**
+     Nonzero if a thread is currently using this cache.
+     */
+    LONG Lock;
+
+    /**
+     A singly linked list of elements which have been freed and can be
+     returned by the next allocation.
+     */
+    PVOID FreeList;
+
+    /**
+     The slab that new elements are carved from when the free list is empty.
+     */
+    PVOID Slab;
+
+    /**
+     The number of elements in Slab that have been used.
+     */
+    DWORD SlabElementsUsed;
+
+    /**
+     The number of elements in Slab.
+     */
+    DWORD SlabElementCount;
+} YORI_LIB_POOL_CACHE, *PYORI_LIB_POOL_CACHE;
+
+/**
+ A pool of fixed sized elements which are allocated from the heap in groups.
+ A pool which has been zeroed is ready for use.
+ */
+typedef struct _YORI_LIB_POOL {
+
+    /**
+     The size of each element, or zero if no element has been allocated.
+     */
+    YORI_ALLOC_SIZE_T ElementSize;
+
+    /**
+     Nonzero if a thread is currently allocating a new slab.
+     */
+    LONG Lock;
+
+    /**
+     The first slab of memory owned by the pool.
+     */
+    PVOID FirstSlab;
+
+    /**
+     The number of slabs that have been allocated from the heap.
+     */
+    DWORD SlabsAllocated;
+
+    /**
+     The number of elements that have been allocated and not yet freed.
+     */
+    LONG ElementsAllocated;
+
+    /**
+     Caches of elements, each used by a subset of threads.
+     */
+    YORI_LIB_POOL_CACHE Caches[YORI_LIB_POOL_CACHE_COUNT];
+} YORI_LIB_POOL, *PYORI_LIB_POOL;
+
+PVOID
+YoriLibPoolAlloc(
+    __inout PYORI_LIB_POOL Pool,
+    __in YORI_ALLOC_SIZE_T SizeInBytes
+    );
+
+VOID
+YoriLibPoolFree(
+    __in PVOID Ptr
+    );
+
+BOOL
+YoriLibCleanupPool(
+    __inout PYORI_LIB_POOL Pool
+    );
+
+VOID
+YoriLibAcquireSpinLock(
+    __inout LONG *Lock
+    );
+
+VOID
+YoriLibReleaseSpinLock(
+    __inout LONG *Lock
+    );
+
+// *** MEMPROF.C ***
+
+extern BOOLEAN YoriLibAllocationProfileActive;
+
+VOID
+YoriLibAllocationProfileRecordAlloc(
+    __in PVOID Allocation,
+    __in YORI_ALLOC_SIZE_T Bytes,
+    __in_opt PVOID Caller
+    );
+
+VOID
+YoriLibAllocationProfileRecordFree(
+    __in PVOID Allocation
+    );
+
+__success(return)
+BOOL
+YoriLibWriteAllocationProfile(
+    __in_opt LPCTSTR FileName
+    );
+
+VOID
+YoriLibCheckAllocationProfileEnvironment(VOID);
+
 // *** MOVEFILE.C ***
 
 DWORD
@@ -3263,6 +3579,127 @@ YoriLibLocateExecutableInPath(
     __out _When_(MatchAllCallback != NULL, _Post_invalid_) PYORI_STRING PathName
     );
 
+// *** PATHIDX.C ***
+
+/**
+ Counters describing the contents of the path index and how effective it
+ has been at answering lookups.
+ */
+typedef struct _YORI_LIB_PATH_INDEX_STATISTICS {
+
+    /**
+     The number of directories in PATH which are indexed.
+     */
+    DWORD DirectoryCount;
+
+    /**
+     The number of indexed directories whose contents are currently cached.
+     */
+    DWORD DirectoriesPopulated;
+
+    /**
+     The number of indexed directories which are being monitored for
+     changes.  Directories which cannot be monitored are enumerated again
+     periodically.
+     */
+    DWORD DirectoriesWatched;
+
+    /**
+     The number of files cached across all indexed directories.
+     */
+    DWORD FileCount;
+
+    /**
+     The number of lookups which have used the index.
+     */
+    DWORDLONG Lookups;
+
+    /**
+     The number of times a directory was searched using cached contents.
+     */
+    DWORDLONG IndexProbes;
+
+    /**
+     The number of times a directory was searched by querying the file
+     system, because it is not indexed or could not be enumerated.
+     */
+    DWORDLONG FileSystemProbes;
+
+    /**
+     The number of times a directory was enumerated to populate the index.
+     */
+    DWORDLONG Enumerations;
+
+    /**
+     The number of times a change notification indicated that cached
+     contents were stale.
+     */
+    DWORDLONG ChangesDetected;
+
+    /**
+     The number of times the PATH environment variable was found to have
+     changed.
+     */
+    DWORDLONG PathChanges;
+
+    /**
+     The total time spent in lookups, in microseconds.
+     */
+    DWORDLONG TotalLookupMicroseconds;
+
+    /**
+     The longest time spent in a single lookup, in microseconds.
+     */
+    DWORDLONG MaximumLookupMicroseconds;
+} YORI_LIB_PATH_INDEX_STATISTICS, *PYORI_LIB_PATH_INDEX_STATISTICS;
+
+__success(return)
+BOOL
+YoriLibPathIndexBeginLookup(
+    __out PLARGE_INTEGER StartTime
+    );
+
+VOID
+YoriLibPathIndexEndLookup(
+    __in PLARGE_INTEGER StartTime
+    );
+
+PVOID
+YoriLibPathIndexFindDirectory(
+    __in PCYORI_STRING Path
+    );
+
+__success(return)
+BOOL
+YoriLibPathIndexFindFile(
+    __in PVOID Directory,
+    __in PCYORI_STRING FileName,
+    __in_opt PCYORI_STRING Extension,
+    __out LPWIN32_FIND_DATA FindData
+    );
+
+__success(return)
+BOOL
+YoriLibPathIndexFindNextPrefix(
+    __in PVOID Directory,
+    __in PCYORI_STRING Prefix,
+    __inout PVOID *Context,
+    __out LPWIN32_FIND_DATA FindData
+    );
+
+__success(return)
+BOOL
+YoriLibEnablePathIndex(VOID);
+
+VOID
+YoriLibDisablePathIndex(VOID);
+
+__success(return)
+BOOL
+YoriLibGetPathIndexStatistics(
+    __out PYORI_LIB_PATH_INDEX_STATISTICS Statistics
+    );
+
 // *** PRINTF.C ***
 
 YORI_SIGNED_ALLOC_SIZE_T
@@ -3932,6 +4369,84 @@ YoriLibCntStringTrailingChars(
     __in LPCTSTR chars
     );
 
+/**
+ A set of substrings to search for, prepared so that many strings can be
+ searched without examining every substring at every offset.
+ */
+typedef struct _YORI_LIB_MULTI_MATCH {
+
+    /**
+     An array of strings to search for.  This is owned by the caller and
+     must remain valid while the matcher is in use.
+     */
+    PYORI_STRING MatchArray;
+
+    /**
+     The number of elements in MatchArray.
+     */
+    YORI_ALLOC_SIZE_T NumberMatches;
+
+    /**
+     The length of the longest string in MatchArray, in characters.
+     */
+    YORI_ALLOC_SIZE_T LongestMatch;
+
+    /**
+     The index of the first empty string in MatchArray, or
+     YORI_MAX_ALLOC_SIZE if no string is empty.  An empty string matches at
+     the beginning of any string being searched.
+     */
+    YORI_ALLOC_SIZE_T FirstEmptyMatch;
+
+    /**
+     TRUE if strings are compared case insensitively.
+     */
+    BOOLEAN Insensitive;
+
+    /**
+     For each value of the low 8 bits of a character, TRUE if any string in
+     MatchArray starts with a character with those low bits.  When case
+     insensitive, characters are upcased first.  Offsets whose character
+     is not in this table cannot be the start of a match.
+     */
+    BOOLEAN FirstChars[256];
+
+    /**
+     If a large number of strings are being searched for, points to a
+     state machine which examines each character of the string being
+     searched once.  NULL if each string is compared at each offset which
+     passes the FirstChars check.
+     */
+    PVOID Automaton;
+} YORI_LIB_MULTI_MATCH, *PYORI_LIB_MULTI_MATCH;
+
+VOID
+YoriLibInitializeMultiMatch(
+    __out PYORI_LIB_MULTI_MATCH Matcher,
+    __in YORI_ALLOC_SIZE_T NumberMatches,
+    __in PYORI_STRING MatchArray,
+    __in BOOLEAN Insensitive
+    );
+
+VOID
+YoriLibCleanupMultiMatch(
+    __inout PYORI_LIB_MULTI_MATCH Matcher
+    );
+
+PYORI_STRING
+YoriLibFindFirstMultiMatch(
+    __in PYORI_LIB_MULTI_MATCH Matcher,
+    __in PCYORI_STRING String,
+    __out_opt PYORI_ALLOC_SIZE_T StringOffsetOfMatch
+    );
+
+PYORI_STRING
+YoriLibFindLowestMultiMatch(
+    __in PYORI_LIB_MULTI_MATCH Matcher,
+    __in PCYORI_STRING String,
+    __out_opt PYORI_ALLOC_SIZE_T StringOffsetOfMatch
+    );
+
 PYORI_STRING
 YoriLibFindFirstMatchSubstr(
     __in PCYORI_STRING String,
@@ -4033,6 +4548,23 @@ YoriLibSortStringArray(
     __in YORI_ALLOC_SIZE_T Count
     );
 
+/**
+ Preserve the order of strings that compare equal when sorting.
+ */
+#define YORI_LIB_SORT_STABLE   (0x00000001)
+
+/**
+ Sort large arrays using multiple threads.
+ */
+#define YORI_LIB_SORT_PARALLEL (0x00000002)
+
+VOID
+YoriLibSortStringArrayEx(
+    __in_ecount(Count) PYORI_STRING StringArray,
+    __in YORI_ALLOC_SIZE_T Count,
+    __in DWORD Flags
+    );
+
 BOOLEAN
 YoriLibStringConcat(
     __inout PYORI_STRING String,
@@ -4274,6 +4806,24 @@ YoriLibShellExecuteInstanceToError(
  */
 #define YORI_MAX_VT_ESCAPE_CHARS sizeof("E[0;999;999;1m")
 
+BOOL
+YoriLibEnableOutputBuffering(
+    __in HANDLE hOutput
+    );
+
+BOOL
+YoriLibFlushOutputBuffer(VOID);
+
+VOID
+YoriLibDisableOutputBuffering(VOID);
+
+BOOL
+YoriLibWriteOutputDevice(
+    __in HANDLE hOutput,
+    __in LPCVOID Buffer,
+    __in DWORD BytesToWrite
+    );
+
 BOOL
 YoriLibOutputTextToMbyteDev(
     __in HANDLE hOutput,
@@ -562,7 +562,15 @@ YoriDlgDirRefreshView(
     YoriWinListClearAllItems(DirList);
     YoriStringArrayInitialize(&NewListItems);
     YoriLibForEachFile(&SearchString, YORILIB_FILEENUM_RETURN_DIRECTORIES | YORILIB_FILEENUM_INCLUDE_DOTFILES | YORILIB_FILEENUM_BASIC_EXPANSION, 0, YoriDlgDirDirFoundCallback, NULL, &NewListItems);
-    YoriLibSortStringArray(NewListItems.Items, NewListItems.Count);
+
+    //
+    //  Names that differ only in case can exist in case sensitive
+    //  directories.  Keep them in the order the file system returned them
+    //  so the list doesn't change between refreshes, and use all processors
+    //  for very large directories.
+    //
+
+    YoriLibSortStringArrayEx(NewListItems.Items, NewListItems.Count, YORI_LIB_SORT_STABLE | YORI_LIB_SORT_PARALLEL);
     YoriWinListAddItems(DirList, NewListItems.Items, NewListItems.Count);
     YoriStringArrayCleanup(&NewListItems);
     State->NumberDirectories = YoriWinListGetItemCount(DirList);
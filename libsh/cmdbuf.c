@@ -28,21 +28,129 @@
 #include <yorilib.h>
 #include <yorish.h>
 
+/**
+ The size of the first chunk allocated to hold data from a process.  Most
+ processes generate small amounts of output, so this starts small.
+ */
+#define YORI_LIBSH_PROCESS_BUFFER_INITIAL_CHUNK_SIZE (1024)
+
+/**
+ The largest size of a chunk allocated to hold data from a process.  Each
+ chunk is twice the size of the previous one until this size is reached.
+ */
+#define YORI_LIBSH_PROCESS_BUFFER_MAX_CHUNK_SIZE (64 * 1024)
+
+/**
+ The amount of data that can accumulate for a mirror while the source has
+ more data ready before it is written to the mirror.
+ */
+#define YORI_LIBSH_PROCESS_BUFFER_MIRROR_WRITE_SIZE (64 * 1024)
+
+/**
+ The number of megabytes of memory that a single buffered stream can consume
+ before older data is written to a temporary file, unless overridden with
+ YORIBUFFERLIMIT.
+ */
+#define YORI_LIBSH_PROCESS_BUFFER_DEFAULT_LIMIT_MB (16)
+
+/**
+ A single region of memory containing data from a process.  Chunks are
+ allocated as data arrives and are never reallocated, so data that has been
+ captured is never copied within memory.
+ */
+typedef struct _YORI_LIBSH_PROCESS_BUFFER_CHUNK {
+
+    /**
+     The link into the list of chunks for the stream, in the order that data
+     was received.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The number of bytes allocated to this chunk.
+     */
+    DWORD BytesAllocated;
+
+    /**
+     The number of bytes populated with data in this chunk.  Every chunk
+     other than the final one in the list is full.
+     */
+    DWORD BytesPopulated;
+
+    /**
+     The data buffer, which immediately follows this structure.
+     */
+    PUCHAR Buffer;
+
+} YORI_LIBSH_PROCESS_BUFFER_CHUNK, *PYORI_LIBSH_PROCESS_BUFFER_CHUNK;
+
 /**
  A buffer for a single data stream.  A process may have a different buffered
  data stream for stdout as well as stderr.
+
+ The stream consists of a prefix of data which has been written to a
+ temporary file, followed by a list of chunks in memory.  Data is only
+ written to the file when the memory consumed by chunks exceeds MemoryLimit.
  */
 typedef struct _YORI_LIBSH_PROCESS_BUFFER {
 
     /**
-     The number of bytes currently allocated to this buffer.
+     The list of chunks held in memory, ordered by stream offset.
+     */
+    YORI_LIST_ENTRY ChunkList;
+
+    /**
+     The chunk that data from the source is currently being read into.  This
+     is the final chunk in ChunkList.
+     */
+    PYORI_LIBSH_PROCESS_BUFFER_CHUNK CurrentChunk;
+
+    /**
+     The chunk that was most recently used to satisfy a request for data at
+     a stream offset.  Since requests are typically sequential, the search
+     for the next request starts here.  This is NULL if the chunk has been
+     written to the spill file.
+     */
+    PYORI_LIBSH_PROCESS_BUFFER_CHUNK LookupChunk;
+
+    /**
+     The stream offset of the first byte in LookupChunk.
      */
-    YORI_ALLOC_SIZE_T BytesAllocated;
+    DWORDLONG LookupChunkOffset;
 
     /**
-     The number of bytes populated with data in this buffer.
+     The number of bytes populated with data in this stream, including data
+     in the spill file.
      */
-    YORI_ALLOC_SIZE_T BytesPopulated;
+    DWORDLONG BytesPopulated;
+
+    /**
+     The number of bytes at the start of the stream that have been written to
+     the spill file and are no longer in memory.
+     */
+    DWORDLONG BytesSpilled;
+
+    /**
+     The number of bytes allocated to chunks in memory.
+     */
+    DWORDLONG BytesInMemory;
+
+    /**
+     The number of bytes that chunks can consume before full chunks are
+     written to the spill file.
+     */
+    DWORDLONG MemoryLimit;
+
+    /**
+     The number of bytes to allocate for the next chunk.
+     */
+    DWORD NextChunkSize;
+
+    /**
+     TRUE if an attempt to write to the spill file has failed, in which case
+     all further data is retained in memory.
+     */
+    BOOLEAN SpillFailed;
 
     /**
      A handle to the buffer processing thread.
@@ -50,9 +158,18 @@ typedef struct _YORI_LIBSH_PROCESS_BUFFER {
     HANDLE hPumpThread;
 
     /**
-     A lock for the data and sizes referred to in this structure.
+     A lock for the data and sizes referred to in this structure.  This is
+     acquired by the pump thread each time data arrives, and is nearly
+     always uncontended, so it is a critical section rather than a kernel
+     object.
      */
-    HANDLE Mutex;
+    CRITICAL_SECTION Lock;
+
+    /**
+     TRUE if Lock has been initialized and must be deleted when the buffer
+     is freed.
+     */
+    BOOLEAN LockInitialized;
 
     /**
      A handle to a pipe which is the source of data for this buffer.
@@ -68,12 +185,25 @@ typedef struct _YORI_LIBSH_PROCESS_BUFFER {
     /**
      The number of bytes which have been sent to hMirror.
      */
-    DWORD BytesSent;
+    DWORDLONG BytesSent;
+
+    /**
+     A handle to the temporary file containing the start of the stream, or
+     NULL if no data has been written to a file.
+     */
+    HANDLE hSpillFile;
+
+    /**
+     The name of the temporary file, so it can be deleted when the buffer is
+     freed.
+     */
+    YORI_STRING SpillFileName;
 
     /**
-     The data buffer.
+     A buffer used to return data which has been read back from the spill
+     file.  This is allocated on first use.
      */
-    PCHAR Buffer;
+    PUCHAR SpillReadBuffer;
 
 } YORI_LIBSH_PROCESS_BUFFER, *PYORI_LIBSH_PROCESS_BUFFER;
 
@@ -115,31 +245,9 @@ typedef struct _YORI_LIBSH_BUFFERED_PROCESS {
 YORI_LIST_ENTRY BufferedProcessList;
 
 /**
- Acquire a Win32 mutex, because for some unknowable reason this isn't a
- Win32 function.
-
- @param Mutex The mutex to acquire.
+ The pool that buffered process structures are allocated from.
  */
-_Acquires_lock_(Mutex)
-VOID
-AcquireMutex(
-    __in HANDLE Mutex
-    )
-{
-
-    //
-    //  Whether the mutex is acquired is determined by the return value and
-    //  the acceptable return values are defined by the parameters.  Analyze
-    //  might think we're doing something like closing the handle while using
-    //  it as a synchronization primitive, but if that happened, we have
-    //  bigger problems.
-    //
-
-#if defined(_MSC_VER) && (_MSC_VER >= 1700)
-#pragma warning(suppress: 26166) 
-#endif
-    WaitForSingleObject(Mutex, INFINITE);
-}
+YORI_LIB_POOL BufferedProcessPool;
 
 /**
  Free structures associated with a single input stream.
@@ -151,17 +259,34 @@ YoriLibShFreeProcessBuffer(
     __in PYORI_LIBSH_PROCESS_BUFFER ThisBuffer
     )
 {
-    if (ThisBuffer->Buffer != NULL) {
-        YoriLibFree(ThisBuffer->Buffer);
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIBSH_PROCESS_BUFFER_CHUNK Chunk;
+
+    if (ThisBuffer->ChunkList.Next != NULL) {
+        ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, NULL);
+        while (ListEntry != NULL) {
+            Chunk = CONTAINING_RECORD(ListEntry, YORI_LIBSH_PROCESS_BUFFER_CHUNK, ListEntry);
+            ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, ListEntry);
+            YoriLibRemoveListItem(&Chunk->ListEntry);
+            YoriLibFree(Chunk);
+        }
+    }
+    if (ThisBuffer->SpillReadBuffer != NULL) {
+        YoriLibFree(ThisBuffer->SpillReadBuffer);
+    }
+    if (ThisBuffer->hSpillFile != NULL) {
+        CloseHandle(ThisBuffer->hSpillFile);
+        DeleteFile(ThisBuffer->SpillFileName.StartOfString);
     }
+    YoriLibFreeStringContents(&ThisBuffer->SpillFileName);
     if (ThisBuffer->hMirror != NULL) {
         CloseHandle(ThisBuffer->hMirror);
     }
     if (ThisBuffer->hPumpThread != NULL) {
         CloseHandle(ThisBuffer->hPumpThread);
     }
-    if (ThisBuffer->Mutex != NULL) {
-        CloseHandle(ThisBuffer->Mutex);
+    if (ThisBuffer->LockInitialized) {
+        DeleteCriticalSection(&ThisBuffer->Lock);
     }
 }
 
@@ -181,7 +306,271 @@ YoriLibShFreeProcessBuffers(
     if (ThisBuffer->hCancelPumpEvent != NULL) {
         CloseHandle(ThisBuffer->hCancelPumpEvent);
     }
-    YoriLibFree(ThisBuffer);
+    YoriLibPoolFree(ThisBuffer);
+}
+
+/**
+ Allocate a new chunk and add it to the end of a stream.  The caller is
+ expected to hold the lock if other threads may be accessing the stream.
+
+ @param ThisBuffer Pointer to the stream to add a chunk to.
+
+ @return Pointer to the new chunk, or NULL on allocation failure.
+ */
+PYORI_LIBSH_PROCESS_BUFFER_CHUNK
+YoriLibShAllocateProcessBufferChunk(
+    __in PYORI_LIBSH_PROCESS_BUFFER ThisBuffer
+    )
+{
+    PYORI_LIBSH_PROCESS_BUFFER_CHUNK Chunk;
+
+    Chunk = YoriLibMalloc(sizeof(YORI_LIBSH_PROCESS_BUFFER_CHUNK) + ThisBuffer->NextChunkSize);
+    if (Chunk == NULL) {
+        return NULL;
+    }
+
+    Chunk->BytesAllocated = ThisBuffer->NextChunkSize;
+    Chunk->BytesPopulated = 0;
+    Chunk->Buffer = (PUCHAR)(Chunk + 1);
+    YoriLibAppendList(&ThisBuffer->ChunkList, &Chunk->ListEntry);
+    ThisBuffer->CurrentChunk = Chunk;
+    ThisBuffer->BytesInMemory = ThisBuffer->BytesInMemory + Chunk->BytesAllocated;
+
+    if (ThisBuffer->NextChunkSize < YORI_LIBSH_PROCESS_BUFFER_MAX_CHUNK_SIZE) {
+        ThisBuffer->NextChunkSize = ThisBuffer->NextChunkSize * 2;
+    }
+
+    return Chunk;
+}
+
+/**
+ Create a temporary file to hold data from a stream that exceeds its memory
+ limit.
+
+ @param ThisBuffer Pointer to the stream to create a spill file for.
+
+ @return TRUE if the file was created, FALSE if it was not.
+ */
+__success(return)
+BOOL
+YoriLibShCreateProcessBufferSpillFile(
+    __in PYORI_LIBSH_PROCESS_BUFFER ThisBuffer
+    )
+{
+    YORI_STRING TempPath;
+    YORI_STRING Prefix;
+    HANDLE hFile;
+
+    if (!YoriLibGetTempPath(&TempPath, 0)) {
+        return FALSE;
+    }
+
+    //
+    //  The temp path normally ends in a separator, and
+    //  YoriLibGetTempFileName will add one.
+    //
+
+    if (TempPath.LengthInChars > 0 &&
+        YoriLibIsSep(TempPath.StartOfString[TempPath.LengthInChars - 1])) {
+
+        TempPath.LengthInChars--;
+    }
+
+    YoriLibConstantString(&Prefix, _T("YBUF"));
+    if (!YoriLibGetTempFileName(&TempPath, &Prefix, &hFile, &ThisBuffer->SpillFileName)) {
+        YoriLibFreeStringContents(&TempPath);
+        return FALSE;
+    }
+
+    YoriLibFreeStringContents(&TempPath);
+    ThisBuffer->hSpillFile = hFile;
+    return TRUE;
+}
+
+/**
+ If the chunks in memory for a stream exceed its memory limit, write the
+ oldest full chunks to the spill file and free them.  The chunk currently
+ being read into is never written.  The caller must hold the lock.
+
+ @param ThisBuffer Pointer to the stream to enforce the memory limit on.
+ */
+VOID
+YoriLibShSpillProcessBuffer(
+    __in PYORI_LIBSH_PROCESS_BUFFER ThisBuffer
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIBSH_PROCESS_BUFFER_CHUNK Chunk;
+    LARGE_INTEGER FileOffset;
+    DWORD BytesWritten;
+
+    while (ThisBuffer->BytesInMemory > ThisBuffer->MemoryLimit &&
+           !ThisBuffer->SpillFailed) {
+
+        ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, NULL);
+        ASSERT(ListEntry != NULL);
+        Chunk = CONTAINING_RECORD(ListEntry, YORI_LIBSH_PROCESS_BUFFER_CHUNK, ListEntry);
+        if (Chunk == ThisBuffer->CurrentChunk) {
+            break;
+        }
+
+        ASSERT(Chunk->BytesPopulated == Chunk->BytesAllocated);
+
+        if (ThisBuffer->hSpillFile == NULL &&
+            !YoriLibShCreateProcessBufferSpillFile(ThisBuffer)) {
+
+            ThisBuffer->SpillFailed = TRUE;
+            break;
+        }
+
+        FileOffset.QuadPart = ThisBuffer->BytesSpilled;
+        SetFilePointer(ThisBuffer->hSpillFile, FileOffset.LowPart, &FileOffset.HighPart, FILE_BEGIN);
+        if (!WriteFile(ThisBuffer->hSpillFile, Chunk->Buffer, Chunk->BytesPopulated, &BytesWritten, NULL) ||
+            BytesWritten != Chunk->BytesPopulated) {
+
+            ThisBuffer->SpillFailed = TRUE;
+            break;
+        }
+
+        ThisBuffer->BytesSpilled = ThisBuffer->BytesSpilled + Chunk->BytesPopulated;
+        ThisBuffer->BytesInMemory = ThisBuffer->BytesInMemory - Chunk->BytesAllocated;
+        ThisBuffer->LookupChunk = NULL;
+        YoriLibRemoveListItem(&Chunk->ListEntry);
+        YoriLibFree(Chunk);
+    }
+}
+
+/**
+ Find the data at a specified offset within a stream.  Data in memory is
+ returned in place; data in the spill file is read into a buffer owned by
+ the stream, which remains valid until the next call.  The caller must hold
+ the lock.
+
+ @param ThisBuffer Pointer to the stream to find data in.
+
+ @param Offset The offset within the stream of the data to return.
+
+ @param Data On successful completion, updated to point to the data.
+
+ @param BytesAvailable On successful completion, updated to contain the
+        number of contiguous bytes found at Data.  This may be less than the
+        remaining length of the stream.
+
+ @return TRUE to indicate data was found, FALSE if the offset is beyond the
+         end of the stream or data could not be read.
+ */
+__success(return)
+BOOL
+YoriLibShGetProcessBufferData(
+    __in PYORI_LIBSH_PROCESS_BUFFER ThisBuffer,
+    __in DWORDLONG Offset,
+    __out PUCHAR *Data,
+    __out PDWORD BytesAvailable
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIBSH_PROCESS_BUFFER_CHUNK Chunk;
+    DWORDLONG ChunkOffset;
+    LARGE_INTEGER FileOffset;
+    DWORD BytesToRead;
+    DWORD BytesRead;
+
+    if (Offset >= ThisBuffer->BytesPopulated) {
+        return FALSE;
+    }
+
+    if (Offset < ThisBuffer->BytesSpilled) {
+        if (ThisBuffer->SpillReadBuffer == NULL) {
+            ThisBuffer->SpillReadBuffer = YoriLibMalloc(YORI_LIBSH_PROCESS_BUFFER_MAX_CHUNK_SIZE);
+            if (ThisBuffer->SpillReadBuffer == NULL) {
+                return FALSE;
+            }
+        }
+
+        BytesToRead = YORI_LIBSH_PROCESS_BUFFER_MAX_CHUNK_SIZE;
+        if (Offset + BytesToRead > ThisBuffer->BytesSpilled) {
+            BytesToRead = (DWORD)(ThisBuffer->BytesSpilled - Offset);
+        }
+
+        FileOffset.QuadPart = Offset;
+        SetFilePointer(ThisBuffer->hSpillFile, FileOffset.LowPart, &FileOffset.HighPart, FILE_BEGIN);
+        if (!ReadFile(ThisBuffer->hSpillFile, ThisBuffer->SpillReadBuffer, BytesToRead, &BytesRead, NULL) ||
+            BytesRead == 0) {
+
+            return FALSE;
+        }
+
+        *Data = ThisBuffer->SpillReadBuffer;
+        *BytesAvailable = BytesRead;
+        return TRUE;
+    }
+
+    //
+    //  Data is in memory.  Since readers typically move forward through the
+    //  stream, resume the search from the last chunk found if possible.
+    //
+
+    if (ThisBuffer->LookupChunk != NULL &&
+        Offset >= ThisBuffer->LookupChunkOffset) {
+
+        ListEntry = &ThisBuffer->LookupChunk->ListEntry;
+        ChunkOffset = ThisBuffer->LookupChunkOffset;
+    } else {
+        ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, NULL);
+        ChunkOffset = ThisBuffer->BytesSpilled;
+    }
+
+    while (ListEntry != NULL) {
+        Chunk = CONTAINING_RECORD(ListEntry, YORI_LIBSH_PROCESS_BUFFER_CHUNK, ListEntry);
+        if (Offset < ChunkOffset + Chunk->BytesPopulated) {
+            ThisBuffer->LookupChunk = Chunk;
+            ThisBuffer->LookupChunkOffset = ChunkOffset;
+            *Data = Chunk->Buffer + (DWORD)(Offset - ChunkOffset);
+            *BytesAvailable = Chunk->BytesPopulated - (DWORD)(Offset - ChunkOffset);
+            return TRUE;
+        }
+        ChunkOffset = ChunkOffset + Chunk->BytesPopulated;
+        ListEntry = YoriLibGetNextListEntry(&ThisBuffer->ChunkList, ListEntry);
+    }
+
+    ASSERT(FALSE);
+    return FALSE;
+}
+
+/**
+ Write data from a stream to a handle, starting from a specified offset and
+ continuing to the end of the contiguous region containing that offset.
+ Data is written directly from the chunk containing it.  The caller must
+ hold the lock.
+
+ @param ThisBuffer Pointer to the stream to write data from.
+
+ @param hTarget The handle to write data to.
+
+ @param Offset The offset within the stream of the data to write.
+
+ @param BytesWritten On successful completion, updated to contain the number
+        of bytes written.
+
+ @return TRUE to indicate data was written, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibShWriteProcessBufferData(
+    __in PYORI_LIBSH_PROCESS_BUFFER ThisBuffer,
+    __in HANDLE hTarget,
+    __in DWORDLONG Offset,
+    __out PDWORD BytesWritten
+    )
+{
+    PUCHAR Data;
+    DWORD BytesAvailable;
+
+    if (!YoriLibShGetProcessBufferData(ThisBuffer, Offset, &Data, &BytesAvailable)) {
+        return FALSE;
+    }
+
+    return WriteFile(hTarget, Data, BytesAvailable, BytesWritten, NULL);
 }
 
 /**
@@ -198,33 +587,30 @@ YoriLibShCmdBufferPumpToNextProcess(
     )
 {
     PYORI_LIBSH_PROCESS_BUFFER ThisBuffer = (PYORI_LIBSH_PROCESS_BUFFER)Param;
-    DWORD BytesSent = 0;
+    DWORDLONG BytesSent = 0;
     DWORD BytesWritten;
-    DWORD BytesToWrite;
+    BOOL Complete;
 
     while (TRUE) {
 
-        BytesToWrite = 4096;
-        AcquireMutex(ThisBuffer->Mutex);
-        if (BytesSent + BytesToWrite > ThisBuffer->BytesPopulated) {
-            BytesToWrite = ThisBuffer->BytesPopulated - BytesSent;
+        EnterCriticalSection(&ThisBuffer->Lock);
+        if (BytesSent >= ThisBuffer->BytesPopulated) {
+            LeaveCriticalSection(&ThisBuffer->Lock);
+            break;
         }
 
-        if (WriteFile(ThisBuffer->hSource,
-                      YoriLibAddToPointer(ThisBuffer->Buffer, BytesSent),
-                      BytesToWrite,
-                      &BytesWritten,
-                      NULL)) {
-
-            BytesSent += BytesWritten;
+        if (YoriLibShWriteProcessBufferData(ThisBuffer, ThisBuffer->hSource, BytesSent, &BytesWritten)) {
+            BytesSent = BytesSent + BytesWritten;
         } else {
-            ReleaseMutex(ThisBuffer->Mutex);
+            LeaveCriticalSection(&ThisBuffer->Lock);
             break;
         }
-        ReleaseMutex(ThisBuffer->Mutex);
 
         ASSERT(BytesSent <= ThisBuffer->BytesPopulated);
-        if (BytesSent >= ThisBuffer->BytesPopulated) {
+        Complete = (BytesSent >= ThisBuffer->BytesPopulated);
+        LeaveCriticalSection(&ThisBuffer->Lock);
+
+        if (Complete) {
             break;
         }
     }
@@ -236,6 +622,76 @@ YoriLibShCmdBufferPumpToNextProcess(
 }
 
 
+/**
+ Send any data in a stream which has not yet been sent to its mirror.  If the
+ mirror cannot be written to, it is closed.  The caller must hold the lock.
+
+ @param ThisBuffer Pointer to the stream to send data from.
+ */
+VOID
+YoriLibShFlushProcessBufferMirror(
+    __in PYORI_LIBSH_PROCESS_BUFFER ThisBuffer
+    )
+{
+    DWORD BytesWritten;
+    HANDLE hTemp;
+
+    while (ThisBuffer->BytesSent < ThisBuffer->BytesPopulated) {
+
+        if (YoriLibShWriteProcessBufferData(ThisBuffer, ThisBuffer->hMirror, ThisBuffer->BytesSent, &BytesWritten)) {
+            ThisBuffer->BytesSent = ThisBuffer->BytesSent + BytesWritten;
+        } else {
+            hTemp = ThisBuffer->hMirror;
+            ThisBuffer->hMirror = NULL;
+            CloseHandle(hTemp);
+            ThisBuffer->BytesSent = 0;
+            break;
+        }
+
+        ASSERT(ThisBuffer->BytesSent <= ThisBuffer->BytesPopulated);
+    }
+}
+
+/**
+ Determine whether data that has arrived should be held back from the mirror
+ so that it can be sent along with data that is about to arrive.  This
+ happens when the source already has more data waiting and the amount not
+ yet sent is small, so a producer writing many small pieces results in a
+ small number of large writes to the mirror.  When the source has nothing
+ waiting, data is sent immediately so interactive output is not delayed.
+ The caller must hold the lock.
+
+ @param ThisBuffer Pointer to the stream to check.
+
+ @return TRUE if sending to the mirror should wait for more data, FALSE if
+         data should be sent now.
+ */
+BOOL
+YoriLibShShouldDeferMirror(
+    __in PYORI_LIBSH_PROCESS_BUFFER ThisBuffer
+    )
+{
+    DWORD BytesAvailable;
+
+    if (ThisBuffer->hSource == NULL) {
+        return FALSE;
+    }
+
+    if (ThisBuffer->BytesPopulated - ThisBuffer->BytesSent >= YORI_LIBSH_PROCESS_BUFFER_MIRROR_WRITE_SIZE) {
+        return FALSE;
+    }
+
+    if (!PeekNamedPipe(ThisBuffer->hSource, NULL, 0, NULL, &BytesAvailable, NULL)) {
+        return FALSE;
+    }
+
+    if (BytesAvailable == 0) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 /**
  Code running on a dedicated thread for the duration of an outstanding process
  to populate data into its process buffer set.
@@ -250,92 +706,61 @@ YoriLibShCmdBufferPump(
     )
 {
     PYORI_LIBSH_PROCESS_BUFFER ThisBuffer = (PYORI_LIBSH_PROCESS_BUFFER)Param;
+    PYORI_LIBSH_PROCESS_BUFFER_CHUNK Chunk;
     DWORD BytesRead;
     HANDLE hTemp;
 
-    while (ThisBuffer->hSource != NULL) {
+    //
+    //  Every exit from this loop occurs with the lock held.
+    //
+
+    while (TRUE) {
+
+        //
+        //  Only this thread modifies the current chunk, so it can be read
+        //  into without holding the lock.  Other threads only look at the
+        //  populated region, which is updated under the lock.
+        //
 
+        Chunk = ThisBuffer->CurrentChunk;
         if (ReadFile(ThisBuffer->hSource,
-                     YoriLibAddToPointer(ThisBuffer->Buffer, ThisBuffer->BytesPopulated),
-                     ThisBuffer->BytesAllocated - ThisBuffer->BytesPopulated,
+                     Chunk->Buffer + Chunk->BytesPopulated,
+                     Chunk->BytesAllocated - Chunk->BytesPopulated,
                      &BytesRead,
                      NULL)) {
 
-            AcquireMutex(ThisBuffer->Mutex);
+            EnterCriticalSection(&ThisBuffer->Lock);
 
             if (BytesRead == 0) {
                 break;
             }
 
-            ThisBuffer->BytesPopulated = ThisBuffer->BytesPopulated + (YORI_ALLOC_SIZE_T)BytesRead;
-            ASSERT(ThisBuffer->BytesPopulated <= ThisBuffer->BytesAllocated);
-            if (ThisBuffer->BytesPopulated >= ThisBuffer->BytesAllocated) {
-                YORI_ALLOC_SIZE_T NewBytesAllocated;
-                PCHAR NewBuffer;
-
-                if (ThisBuffer->BytesAllocated >= YORI_MAX_ALLOC_SIZE) {
+            Chunk->BytesPopulated = Chunk->BytesPopulated + BytesRead;
+            ThisBuffer->BytesPopulated = ThisBuffer->BytesPopulated + BytesRead;
+            ASSERT(Chunk->BytesPopulated <= Chunk->BytesAllocated);
+            if (Chunk->BytesPopulated >= Chunk->BytesAllocated) {
+                if (YoriLibShAllocateProcessBufferChunk(ThisBuffer) == NULL) {
                     break;
                 }
-
-                NewBytesAllocated = ThisBuffer->BytesAllocated * 4;
-
-                NewBuffer = YoriLibMalloc(NewBytesAllocated);
-                if (NewBuffer == NULL) {
-                    break;
-                }
-
-                memcpy(NewBuffer, ThisBuffer->Buffer, ThisBuffer->BytesAllocated);
-                YoriLibFree(ThisBuffer->Buffer);
-                ThisBuffer->Buffer = NewBuffer;
-                ThisBuffer->BytesAllocated = NewBytesAllocated;
+                YoriLibShSpillProcessBuffer(ThisBuffer);
             }
         } else {
-            DWORD LastError = GetLastError();
-
-            AcquireMutex(ThisBuffer->Mutex);
 
             //
-            //  Close the source but let the mirror drain if present.
+            //  Typically this is ERROR_BROKEN_PIPE when the process exits.
+            //  Any data not yet sent to the mirror is sent below.
             //
 
-            if (LastError == ERROR_BROKEN_PIPE) {
-                hTemp = ThisBuffer->hSource;
-                ThisBuffer->hSource = NULL;
-                CloseHandle(hTemp);
-            } else {
-                break;
-            }
+            EnterCriticalSection(&ThisBuffer->Lock);
+            break;
         }
 
-        if (ThisBuffer->hMirror != NULL) {
-            while (ThisBuffer->BytesSent < ThisBuffer->BytesPopulated) {
-                DWORD BytesToWrite;
-                DWORD BytesWritten;
-                BytesToWrite = 4096;
-                if (ThisBuffer->BytesSent + BytesToWrite > ThisBuffer->BytesPopulated) {
-                    BytesToWrite = ThisBuffer->BytesPopulated - ThisBuffer->BytesSent;
-                }
-
-                if (WriteFile(ThisBuffer->hMirror,
-                              YoriLibAddToPointer(ThisBuffer->Buffer, ThisBuffer->BytesSent),
-                              BytesToWrite,
-                              &BytesWritten,
-                              NULL)) {
-
-                    ThisBuffer->BytesSent += BytesWritten;
-                } else {
-                    hTemp = ThisBuffer->hMirror;
-                    ThisBuffer->hMirror = NULL;
-                    CloseHandle(hTemp);
-                    ThisBuffer->BytesSent = 0;
-                    break;
-                }
-
-                ASSERT(ThisBuffer->BytesSent <= ThisBuffer->BytesPopulated);
-            }
+        if (ThisBuffer->hMirror != NULL &&
+            !YoriLibShShouldDeferMirror(ThisBuffer)) {
 
+            YoriLibShFlushProcessBufferMirror(ThisBuffer);
         }
-        ReleaseMutex(ThisBuffer->Mutex);
+        LeaveCriticalSection(&ThisBuffer->Lock);
     }
 
     if (ThisBuffer->hSource != NULL) {
@@ -344,13 +769,17 @@ YoriLibShCmdBufferPump(
         CloseHandle(hTemp);
     }
 
+    if (ThisBuffer->hMirror != NULL) {
+        YoriLibShFlushProcessBufferMirror(ThisBuffer);
+    }
+
     if (ThisBuffer->hMirror != NULL) {
         hTemp = ThisBuffer->hMirror;
         ThisBuffer->hMirror = NULL;
         CloseHandle(hTemp);
     }
 
-    ReleaseMutex(ThisBuffer->Mutex);
+    LeaveCriticalSection(&ThisBuffer->Lock);
 
     return 0;
 }
@@ -368,14 +797,24 @@ YoriLibShAllocateSingleProcessBuffer(
     __out PYORI_LIBSH_PROCESS_BUFFER Buffer
     )
 {
-    Buffer->BytesAllocated = 1024;
-    Buffer->Buffer = YoriLibMalloc(Buffer->BytesAllocated);
-    if (Buffer->Buffer == NULL) {
-        return FALSE;
+    YORI_MAX_SIGNED_T LimitInMb;
+
+    LimitInMb = YORI_LIBSH_PROCESS_BUFFER_DEFAULT_LIMIT_MB;
+    if (!YoriLibGetEnvVarAsNumber(_T("YORIBUFFERLIMIT"), &LimitInMb) ||
+        LimitInMb < 0) {
+
+        LimitInMb = YORI_LIBSH_PROCESS_BUFFER_DEFAULT_LIMIT_MB;
     }
 
-    Buffer->Mutex = CreateMutex(NULL, FALSE, NULL);
-    if (Buffer->Mutex == NULL) {
+    InitializeCriticalSection(&Buffer->Lock);
+    Buffer->LockInitialized = TRUE;
+
+    Buffer->MemoryLimit = (DWORDLONG)LimitInMb * 1024 * 1024;
+    Buffer->NextChunkSize = YORI_LIBSH_PROCESS_BUFFER_INITIAL_CHUNK_SIZE;
+    YoriLibInitializeListHead(&Buffer->ChunkList);
+    YoriLibInitEmptyString(&Buffer->SpillFileName);
+
+    if (YoriLibShAllocateProcessBufferChunk(Buffer) == NULL) {
         return FALSE;
     }
 
@@ -403,7 +842,7 @@ YoriLibShCreateNewProcessBuffer(
         YoriLibInitializeListHead(&BufferedProcessList);
     }
 
-    ThisBuffer = YoriLibMalloc(sizeof(YORI_LIBSH_BUFFERED_PROCESS));
+    ThisBuffer = YoriLibPoolAlloc(&BufferedProcessPool, sizeof(YORI_LIBSH_BUFFERED_PROCESS));
     if (ThisBuffer == NULL) {
         return FALSE;
     }
@@ -631,28 +1070,86 @@ YoriLibShGetProcessBuffer(
     )
 {
     YORI_ALLOC_SIZE_T LengthNeeded;
+    YORI_ALLOC_SIZE_T BytesToReturn;
+    YORI_ALLOC_SIZE_T BytesCopied;
+    DWORD BytesAvailable;
+    PUCHAR Data;
+    PUCHAR Gathered;
 
-    if (ThisBuffer->Buffer == NULL) {
+    if (ThisBuffer->CurrentChunk == NULL) {
         return FALSE;
     }
 
-    AcquireMutex(ThisBuffer->Mutex);
+    EnterCriticalSection(&ThisBuffer->Lock);
 
-    LengthNeeded = YoriLibGetMultibyteInputSizeNeeded(ThisBuffer->Buffer, ThisBuffer->BytesPopulated);
-    if (LengthNeeded == 0 && ThisBuffer->BytesPopulated == 0) {
-        ReleaseMutex(ThisBuffer->Mutex);
+    if (ThisBuffer->BytesPopulated == 0) {
+        LeaveCriticalSection(&ThisBuffer->Lock);
         YoriLibInitEmptyString(String);
         return TRUE;
     }
 
+    //
+    //  The stream can be larger than a string can describe.  If so, return
+    //  as much of the start of the stream as will fit.
+    //
+
+    if (ThisBuffer->BytesPopulated > YORI_MAX_ALLOC_SIZE / sizeof(TCHAR)) {
+        BytesToReturn = YORI_MAX_ALLOC_SIZE / sizeof(TCHAR);
+    } else {
+        BytesToReturn = (YORI_ALLOC_SIZE_T)ThisBuffer->BytesPopulated;
+    }
+
+    //
+    //  If the data is in a single chunk, convert it in place.  Otherwise
+    //  gather it into a single allocation so that characters which span
+    //  chunks are converted correctly.
+    //
+
+    Gathered = NULL;
+    if (!YoriLibShGetProcessBufferData(ThisBuffer, 0, &Data, &BytesAvailable)) {
+        LeaveCriticalSection(&ThisBuffer->Lock);
+        return FALSE;
+    }
+
+    if (BytesAvailable < BytesToReturn) {
+        Gathered = YoriLibMalloc(BytesToReturn);
+        if (Gathered == NULL) {
+            LeaveCriticalSection(&ThisBuffer->Lock);
+            return FALSE;
+        }
+
+        BytesCopied = 0;
+        while (BytesCopied < BytesToReturn) {
+            if (!YoriLibShGetProcessBufferData(ThisBuffer, BytesCopied, &Data, &BytesAvailable)) {
+                YoriLibFree(Gathered);
+                LeaveCriticalSection(&ThisBuffer->Lock);
+                return FALSE;
+            }
+            if (BytesAvailable > BytesToReturn - BytesCopied) {
+                BytesAvailable = BytesToReturn - BytesCopied;
+            }
+            memcpy(Gathered + BytesCopied, Data, BytesAvailable);
+            BytesCopied = BytesCopied + BytesAvailable;
+        }
+        Data = Gathered;
+    }
+
+    LengthNeeded = YoriLibGetMultibyteInputSizeNeeded((LPCSTR)Data, BytesToReturn);
+
     if (!YoriLibAllocateString(String, LengthNeeded)) {
-        ReleaseMutex(ThisBuffer->Mutex);
+        if (Gathered != NULL) {
+            YoriLibFree(Gathered);
+        }
+        LeaveCriticalSection(&ThisBuffer->Lock);
         return FALSE;
     }
 
-    YoriLibMultibyteInput(ThisBuffer->Buffer, ThisBuffer->BytesPopulated, String->StartOfString, String->LengthAllocated);
+    YoriLibMultibyteInput((LPCSTR)Data, BytesToReturn, String->StartOfString, String->LengthAllocated);
     String->LengthInChars = LengthNeeded;
-    ReleaseMutex(ThisBuffer->Mutex);
+    if (Gathered != NULL) {
+        YoriLibFree(Gathered);
+    }
+    LeaveCriticalSection(&ThisBuffer->Lock);
 
     return TRUE;
 }
@@ -854,6 +1351,10 @@ YoriLibShScanProcessBuffersForTeardown(
         YoriLibShTeardownProcessBuffersIfCompletedInternal(ThisBuffer, TeardownAll);
     }
 
+    if (TeardownAll) {
+        YoriLibCleanupPool(&BufferedProcessPool);
+    }
+
     return TRUE;
 }
 
@@ -924,7 +1425,7 @@ YoriLibShPipeProcessBuffers(
     //
 
     if (hPipeOutput != NULL) {
-        if (ThisBufferNonOpaque->OutputBuffer.Buffer != NULL) {
+        if (ThisBufferNonOpaque->OutputBuffer.CurrentChunk != NULL) {
             HaveOutput = TRUE;
         } else {
             return FALSE;
@@ -932,7 +1433,7 @@ YoriLibShPipeProcessBuffers(
     }
 
     if (hPipeErrors != NULL) {
-        if (ThisBufferNonOpaque->ErrorBuffer.Buffer != NULL) {
+        if (ThisBufferNonOpaque->ErrorBuffer.CurrentChunk != NULL) {
             HaveErrors = TRUE;
         } else {
             return FALSE;
@@ -940,10 +1441,10 @@ YoriLibShPipeProcessBuffers(
     }
 
     if (HaveOutput) {
-        AcquireMutex(ThisBufferNonOpaque->OutputBuffer.Mutex);
+        EnterCriticalSection(&ThisBufferNonOpaque->OutputBuffer.Lock);
     }
     if (HaveErrors) {
-        AcquireMutex(ThisBufferNonOpaque->ErrorBuffer.Mutex);
+        EnterCriticalSection(&ThisBufferNonOpaque->ErrorBuffer.Lock);
     }
 
     //
@@ -968,10 +1469,10 @@ YoriLibShPipeProcessBuffers(
 
     if (Collision) {
         if (HaveOutput) {
-            ReleaseMutex(ThisBufferNonOpaque->OutputBuffer.Mutex);
+            LeaveCriticalSection(&ThisBufferNonOpaque->OutputBuffer.Lock);
         }
         if (HaveErrors) {
-            ReleaseMutex(ThisBufferNonOpaque->ErrorBuffer.Mutex);
+            LeaveCriticalSection(&ThisBufferNonOpaque->ErrorBuffer.Lock);
         }
         return FALSE;
     }
@@ -991,10 +1492,10 @@ YoriLibShPipeProcessBuffers(
     }
 
     if (HaveOutput) {
-        ReleaseMutex(ThisBufferNonOpaque->OutputBuffer.Mutex);
+        LeaveCriticalSection(&ThisBufferNonOpaque->OutputBuffer.Lock);
     }
     if (HaveErrors) {
-        ReleaseMutex(ThisBufferNonOpaque->ErrorBuffer.Mutex);
+        LeaveCriticalSection(&ThisBufferNonOpaque->ErrorBuffer.Lock);
     }
 
     return TRUE;
@@ -138,9 +138,15 @@ YoriLibShIsArgumentSeperator(
 }
 
 /**
- Allocate the ArgV and ArgContexts arrays within a CmdContext.  Optionally the
- caller can request additional bytes to be in this allocation, and if so, this
- routine will output a pointer to the additional payload.
+ Allocate the ArgV and ArgContexts arrays within a CmdContext, optionally
+ from an arena.  Optionally the caller can request additional bytes to be in
+ this allocation, and if so, this routine will output a pointer to the
+ additional payload.
+
+ @param Arena Optionally points to an arena to allocate the arrays from.  If
+        NULL, the arrays are allocated from the heap.  Either way the
+        CmdContext holds references on the allocation, so the arena can be
+        cleaned up while the CmdContext is in use.
 
  @param CmdContext Pointer to the CmdContext whose arrays should be allocated.
 
@@ -156,24 +162,34 @@ YoriLibShIsArgumentSeperator(
  */
 __success(return)
 BOOLEAN
-YoriLibShAllocateArgCount(
+YoriLibShAllocateArgCountInArena(
+    __inout_opt PYORI_LIB_ARENA Arena,
     __out PYORI_LIBSH_CMD_CONTEXT CmdContext,
     __in YORI_ALLOC_SIZE_T ArgCount,
     __in YORI_ALLOC_SIZE_T ExtraByteCount,
     __out_opt PVOID *ExtraData
     )
 {
+    PVOID Buffer;
     PVOID MemoryToFree;
-    MemoryToFree = YoriLibReferencedMalloc((ArgCount * (sizeof(YORI_STRING) + sizeof(YORI_LIBSH_ARG_CONTEXT))) +
-                                                       ExtraByteCount);
-    if (MemoryToFree == NULL) {
+
+    if (Arena != NULL) {
+        Buffer = YoriLibArenaAlloc(Arena,
+                                   (ArgCount * (sizeof(YORI_STRING) + sizeof(YORI_LIBSH_ARG_CONTEXT))) + ExtraByteCount,
+                                   &MemoryToFree);
+    } else {
+        MemoryToFree = YoriLibReferencedMalloc((ArgCount * (sizeof(YORI_STRING) + sizeof(YORI_LIBSH_ARG_CONTEXT))) +
+                                                           ExtraByteCount);
+        Buffer = MemoryToFree;
+    }
+    if (Buffer == NULL) {
         return FALSE;
     }
 
-    ZeroMemory(MemoryToFree, ArgCount * (sizeof(YORI_STRING) + sizeof(YORI_LIBSH_ARG_CONTEXT)));
+    ZeroMemory(Buffer, ArgCount * (sizeof(YORI_STRING) + sizeof(YORI_LIBSH_ARG_CONTEXT)));
 
     CmdContext->ArgC = ArgCount;
-    CmdContext->ArgV = MemoryToFree;
+    CmdContext->ArgV = Buffer;
     CmdContext->MemoryToFreeArgV = MemoryToFree;
 
     YoriLibReference(MemoryToFree);
@@ -195,6 +211,35 @@ YoriLibShAllocateArgCount(
     return TRUE;
 }
 
+/**
+ Allocate the ArgV and ArgContexts arrays within a CmdContext.  Optionally the
+ caller can request additional bytes to be in this allocation, and if so, this
+ routine will output a pointer to the additional payload.
+
+ @param CmdContext Pointer to the CmdContext whose arrays should be allocated.
+
+ @param ArgCount Specifies the number of arguments to allocate.
+
+ @param ExtraByteCount Specifies the number of extra bytes to include in the
+        allocation.  If this is nonzero, the ExtraData argument is mandatory.
+
+ @param ExtraData Pointer to a pointer that will receive the location of the
+        extra allocation, if ExtraByteCount is nonzero.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOLEAN
+YoriLibShAllocateArgCount(
+    __out PYORI_LIBSH_CMD_CONTEXT CmdContext,
+    __in YORI_ALLOC_SIZE_T ArgCount,
+    __in YORI_ALLOC_SIZE_T ExtraByteCount,
+    __out_opt PVOID *ExtraData
+    )
+{
+    return YoriLibShAllocateArgCountInArena(NULL, CmdContext, ArgCount, ExtraByteCount, ExtraData);
+}
+
 /**
  Remove spaces from the beginning of a Yori string.  Note this implies
  advancing the StartOfString pointer, so a caller cannot assume this
@@ -1456,9 +1501,13 @@ YoriLibShCopyArg(
 }
 
 /**
- Perform a deep copy of a command context.  This will allocate a new argument
- array but reference any arguments from the source (so they must still be
- reallocated individually if/when modified.)
+ Perform a deep copy of a command context, optionally allocating the new
+ argument array from an arena.  This will allocate a new argument array but
+ reference any arguments from the source (so they must still be reallocated
+ individually if/when modified.)
+
+ @param Arena Optionally points to an arena to allocate the argument array
+        from.  If NULL, the array is allocated from the heap.
 
  @param DestCmdContext Pointer to the command context to populate with contents
         from the source.
@@ -1469,14 +1518,15 @@ YoriLibShCopyArg(
  */
 __success(return)
 BOOL
-YoriLibShCopyCmdContext(
+YoriLibShCopyCmdContextInArena(
+    __inout_opt PYORI_LIB_ARENA Arena,
     __out PYORI_LIBSH_CMD_CONTEXT DestCmdContext,
     __in PYORI_LIBSH_CMD_CONTEXT SrcCmdContext
     )
 {
     YORI_ALLOC_SIZE_T Count;
 
-    if (!YoriLibShAllocateArgCount(DestCmdContext, SrcCmdContext->ArgC, 0, NULL)) {
+    if (!YoriLibShAllocateArgCountInArena(Arena, DestCmdContext, SrcCmdContext->ArgC, 0, NULL)) {
         return FALSE;
     }
 
@@ -1491,6 +1541,28 @@ YoriLibShCopyCmdContext(
     return TRUE;
 }
 
+/**
+ Perform a deep copy of a command context.  This will allocate a new argument
+ array but reference any arguments from the source (so they must still be
+ reallocated individually if/when modified.)
+
+ @param DestCmdContext Pointer to the command context to populate with contents
+        from the source.
+
+ @param SrcCmdContext Pointer to the source command context.
+
+ @return TRUE to indicate success, or FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriLibShCopyCmdContext(
+    __out PYORI_LIBSH_CMD_CONTEXT DestCmdContext,
+    __in PYORI_LIBSH_CMD_CONTEXT SrcCmdContext
+    )
+{
+    return YoriLibShCopyCmdContextInArena(NULL, DestCmdContext, SrcCmdContext);
+}
+
 /**
  Add extra arguments into a CmdContext.  This routine can reallocate the
  ArgV and ArgContexts arrays to the specified size.
@@ -1790,6 +1862,8 @@ YoriLibShCheckForDeviceNameAndDuplicate(
  different programs, as well as redirection information for the
  program being parsed.
 
+ @param Arena Pointer to an arena to allocate the program's arguments from.
+
  @param CmdContext Pointer to a raw series of arguments to parse for
         and individual program's execution.
 
@@ -1819,6 +1893,7 @@ YoriLibShCheckForDeviceNameAndDuplicate(
 __success(return > 0)
 YORI_ALLOC_SIZE_T
 YoriLibShParseCmdContextToExecContext(
+    __inout PYORI_LIB_ARENA Arena,
     __in PYORI_LIBSH_CMD_CONTEXT CmdContext,
     __in YORI_ALLOC_SIZE_T InitialArgument,
     __out PYORI_LIBSH_SINGLE_EXEC_CONTEXT ExecContext,
@@ -1877,7 +1952,7 @@ YoriLibShParseCmdContextToExecContext(
 
     ArgumentsConsumed = Count - InitialArgument;
 
-    if (!YoriLibShAllocateArgCount(&ExecContext->CmdToExec, ArgumentsConsumed, 0, NULL)) {
+    if (!YoriLibShAllocateArgCountInArena(Arena, &ExecContext->CmdToExec, ArgumentsConsumed, 0, NULL)) {
         return 0;
     }
     ExecContext->CmdToExec.ArgC = 0;
@@ -2208,6 +2283,8 @@ YoriLibShParseCmdContextToExecPlan(
     BOOLEAN FoundProgramMatch;
     YORI_ALLOC_SIZE_T LocalCurrentArgIndex;
     YORI_ALLOC_SIZE_T LocalCurrentArgOffset;
+    YORI_LIB_ARENA Arena;
+    YORI_MAX_UNSIGNED_T ArenaSize;
 
     if (CmdContext->ArgC == 0) {
         return FALSE;
@@ -2232,11 +2309,26 @@ YoriLibShParseCmdContextToExecPlan(
     ZeroMemory(ExecPlan, sizeof(YORI_LIBSH_EXEC_PLAN));
     FoundProgramMatch = FALSE;
 
+    //
+    //  The argument arrays for the entire command and each program are
+    //  allocated from a single arena, sized so that all of them normally fit
+    //  in one allocation.  Each array holds a reference on the allocation,
+    //  so the arena itself can be discarded once the plan is built.
+    //
+
+    ArenaSize = CmdContext->ArgC;
+    ArenaSize = ArenaSize * 2 * (sizeof(YORI_STRING) + sizeof(YORI_LIBSH_ARG_CONTEXT) + sizeof(DWORDLONG)) + 256;
+    if (!YoriLibIsSizeAllocatable(ArenaSize)) {
+        ArenaSize = 0;
+    }
+    YoriLibInitializeArena(&Arena, (YORI_ALLOC_SIZE_T)ArenaSize);
+
     //
     //  First, turn the entire CmdContext into an ExecContext.
     //
 
-    if (!YoriLibShCopyCmdContext(&ExecPlan->EntireCmd.CmdToExec, CmdContext)) {
+    if (!YoriLibShCopyCmdContextInArena(&Arena, &ExecPlan->EntireCmd.CmdToExec, CmdContext)) {
+        YoriLibCleanupArena(&Arena);
         YoriLibShFreeExecPlan(ExecPlan);
         return FALSE;
     }
@@ -2248,12 +2340,14 @@ YoriLibShParseCmdContextToExecPlan(
 
         ThisProgram = YoriLibMalloc(sizeof(YORI_LIBSH_SINGLE_EXEC_CONTEXT));
         if (ThisProgram == NULL) {
+            YoriLibCleanupArena(&Arena);
             YoriLibShFreeExecPlan(ExecPlan);
             return FALSE;
         }
 
-        ArgsConsumed = YoriLibShParseCmdContextToExecContext(CmdContext, CurrentArg, ThisProgram, &LocalCurrentArgIsForProgram, &LocalCurrentArgIndex, &LocalCurrentArgOffset);
+        ArgsConsumed = YoriLibShParseCmdContextToExecContext(&Arena, CmdContext, CurrentArg, ThisProgram, &LocalCurrentArgIsForProgram, &LocalCurrentArgIndex, &LocalCurrentArgOffset);
         if (ArgsConsumed == 0) {
+            YoriLibCleanupArena(&Arena);
             YoriLibShDereferenceExecContext(ThisProgram, TRUE);
             YoriLibShFreeExecPlan(ExecPlan);
             return FALSE;
@@ -2384,6 +2478,8 @@ YoriLibShParseCmdContextToExecPlan(
         }
     }
 
+    YoriLibCleanupArena(&Arena);
+
     if (CmdContext->CurrentArg >= CmdContext->ArgC &&
         PreviousProgram != NULL &&
         !FoundProgramMatch) {
@@ -140,10 +140,12 @@ LinesProcessStream(
     )
 {
     PVOID LineContext = NULL;
-    YORI_STRING LineString;
+    YORI_LIB_LINE_BATCH Batch;
+    PYORI_STRING LineString;
+    YORI_ALLOC_SIZE_T Index;
     BOOLEAN OneLineFound;
 
-    YoriLibInitEmptyString(&LineString);
+    YoriLibInitializeLineBatch(&Batch);
 
     LinesContext->FilesFound++;
     LinesContext->FilesFoundThisArg++;
@@ -153,26 +155,26 @@ LinesProcessStream(
     LinesContext->FileTotalChars = 0;
     OneLineFound = FALSE;
 
-    while (TRUE) {
+    while (YoriLibReadLineBatch(&Batch, &LineContext, hSource)) {
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
-            break;
-        }
+        for (Index = 0; Index < Batch.LineCount; Index++) {
+            LineString = &Batch.Lines[Index].Line;
 
-        LinesContext->FileLinesFound++;
-        LinesContext->FileTotalChars = LinesContext->FileTotalChars + LineString.LengthInChars;
-        if (LineString.LengthInChars > LinesContext->FileLongestLine) {
-            LinesContext->FileLongestLine = LineString.LengthInChars;
-        }
+            LinesContext->FileLinesFound++;
+            LinesContext->FileTotalChars = LinesContext->FileTotalChars + LineString->LengthInChars;
+            if (LineString->LengthInChars > LinesContext->FileLongestLine) {
+                LinesContext->FileLongestLine = LineString->LengthInChars;
+            }
 
-        if (!OneLineFound || LineString.LengthInChars < LinesContext->FileShortestLine) {
-            LinesContext->FileShortestLine = LineString.LengthInChars;
-            OneLineFound = TRUE;
+            if (!OneLineFound || LineString->LengthInChars < LinesContext->FileShortestLine) {
+                LinesContext->FileShortestLine = LineString->LengthInChars;
+                OneLineFound = TRUE;
+            }
         }
     }
 
     YoriLibLineReadCloseOrCache(LineContext);
-    YoriLibFreeStringContents(&LineString);
+    YoriLibFreeLineBatch(&Batch);
 
     LinesContext->TotalLinesFound += LinesContext->FileLinesFound;
     return TRUE;
@@ -409,6 +411,8 @@ ENTRYPOINT(
     YoriLibCancelEnable(FALSE);
 #endif
 
+    YoriLibEnableOutputBuffering(GetStdHandle(STD_OUTPUT_HANDLE));
+
     //
     //  Attempt to enable backup privilege so an administrator can access more
     //  objects successfully.
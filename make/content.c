@@ -0,0 +1,679 @@
+/**
+ * @file make/content.c
+ *
+ * Yori shell make content hashing of dependencies
+ *
+ * Copyright (c) 2020 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include <yorish.h>
+#include "make.h"
+
+/**
+ The size of the buffer used to read files, in bytes.  This must be a
+ multiple of MAKE_CONTENT_HASH_STRIPE.
+ */
+#define MAKE_CONTENT_HASH_BUFFER (256 * 1024)
+
+/**
+ The number of bytes consumed by each iteration of the hash function.
+ */
+#define MAKE_CONTENT_HASH_STRIPE (32)
+
+/**
+ Constants used by the hash function.  The hash is XXH64 with a seed of
+ zero.  It is not cryptographically secure, but it is fast and changes to
+ a file are overwhelmingly likely to change it.
+ */
+#define MAKE_CONTENT_HASH_PRIME1 ((((DWORDLONG)0x9E3779B1) << 32) | 0x85EBCA87)
+
+/**
+ A constant used by the hash function.
+ */
+#define MAKE_CONTENT_HASH_PRIME2 ((((DWORDLONG)0xC2B2AE3D) << 32) | 0x27D4EB4F)
+
+/**
+ A constant used by the hash function.
+ */
+#define MAKE_CONTENT_HASH_PRIME3 ((((DWORDLONG)0x165667B1) << 32) | 0x9E3779F9)
+
+/**
+ A constant used by the hash function.
+ */
+#define MAKE_CONTENT_HASH_PRIME4 ((((DWORDLONG)0x85EBCA77) << 32) | 0xC2B2AE63)
+
+/**
+ A constant used by the hash function.
+ */
+#define MAKE_CONTENT_HASH_PRIME5 ((((DWORDLONG)0x27D4EB2F) << 32) | 0x165667C5)
+
+/**
+ Rotate a 64 bit value left by a specified number of bits.
+ */
+#define MAKE_CONTENT_HASH_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+/**
+ The state of the hash function while a file is being read.
+ */
+typedef struct _MAKE_CONTENT_HASH_STATE {
+
+    /**
+     The four accumulators which each consume 8 bytes of every stripe.
+     */
+    DWORDLONG Lanes[4];
+
+    /**
+     The number of bytes consumed so far.
+     */
+    DWORDLONG TotalLength;
+} MAKE_CONTENT_HASH_STATE, *PMAKE_CONTENT_HASH_STATE;
+
+/**
+ Mix 8 bytes of input into an accumulator.
+
+ @param Accumulator The existing accumulator value.
+
+ @param Input The 8 bytes of input.
+
+ @return The new accumulator value.
+ */
+DWORDLONG
+MakeContentHashRound(
+    __in DWORDLONG Accumulator,
+    __in DWORDLONG Input
+    )
+{
+    Accumulator = Accumulator + Input * MAKE_CONTENT_HASH_PRIME2;
+    Accumulator = MAKE_CONTENT_HASH_ROTL(Accumulator, 31);
+    return Accumulator * MAKE_CONTENT_HASH_PRIME1;
+}
+
+/**
+ Initialize the state of the hash function.
+
+ @param State Pointer to the state to initialize.
+ */
+VOID
+MakeContentHashInitialize(
+    __out PMAKE_CONTENT_HASH_STATE State
+    )
+{
+    State->Lanes[0] = MAKE_CONTENT_HASH_PRIME1 + MAKE_CONTENT_HASH_PRIME2;
+    State->Lanes[1] = MAKE_CONTENT_HASH_PRIME2;
+    State->Lanes[2] = 0;
+    State->Lanes[3] = (DWORDLONG)0 - MAKE_CONTENT_HASH_PRIME1;
+    State->TotalLength = 0;
+}
+
+/**
+ Consume every complete stripe within a buffer.
+
+ @param State Pointer to the state of the hash function.
+
+ @param Buffer Pointer to the buffer.  This is expected to be 8 byte aligned.
+
+ @param Length The length of the buffer, in bytes.
+
+ @return The number of bytes consumed, which is Length rounded down to a
+         multiple of MAKE_CONTENT_HASH_STRIPE.
+ */
+DWORD
+MakeContentHashUpdate(
+    __inout PMAKE_CONTENT_HASH_STATE State,
+    __in PUCHAR Buffer,
+    __in DWORD Length
+    )
+{
+    DWORDLONG UNALIGNED *Input;
+    DWORDLONG Lane0;
+    DWORDLONG Lane1;
+    DWORDLONG Lane2;
+    DWORDLONG Lane3;
+    DWORD Offset;
+
+    Lane0 = State->Lanes[0];
+    Lane1 = State->Lanes[1];
+    Lane2 = State->Lanes[2];
+    Lane3 = State->Lanes[3];
+
+    for (Offset = 0; Offset + MAKE_CONTENT_HASH_STRIPE <= Length; Offset = Offset + MAKE_CONTENT_HASH_STRIPE) {
+        Input = (DWORDLONG UNALIGNED *)&Buffer[Offset];
+        Lane0 = MakeContentHashRound(Lane0, Input[0]);
+        Lane1 = MakeContentHashRound(Lane1, Input[1]);
+        Lane2 = MakeContentHashRound(Lane2, Input[2]);
+        Lane3 = MakeContentHashRound(Lane3, Input[3]);
+    }
+
+    State->Lanes[0] = Lane0;
+    State->Lanes[1] = Lane1;
+    State->Lanes[2] = Lane2;
+    State->Lanes[3] = Lane3;
+    State->TotalLength = State->TotalLength + Offset;
+
+    return Offset;
+}
+
+/**
+ Consume the final bytes of input and return the hash.
+
+ @param State Pointer to the state of the hash function.
+
+ @param Buffer Pointer to the final bytes of input.
+
+ @param Length The number of bytes in Buffer.
+
+ @return The hash of all input.
+ */
+DWORDLONG
+MakeContentHashFinalize(
+    __inout PMAKE_CONTENT_HASH_STATE State,
+    __in PUCHAR Buffer,
+    __in DWORD Length
+    )
+{
+    DWORDLONG Hash;
+    DWORD Offset;
+    DWORD Index;
+    DWORD Word;
+
+    Offset = MakeContentHashUpdate(State, Buffer, Length);
+
+    if (State->TotalLength >= MAKE_CONTENT_HASH_STRIPE) {
+        Hash = MAKE_CONTENT_HASH_ROTL(State->Lanes[0], 1) +
+               MAKE_CONTENT_HASH_ROTL(State->Lanes[1], 7) +
+               MAKE_CONTENT_HASH_ROTL(State->Lanes[2], 12) +
+               MAKE_CONTENT_HASH_ROTL(State->Lanes[3], 18);
+
+        for (Index = 0; Index < 4; Index++) {
+            Hash = Hash ^ MakeContentHashRound(0, State->Lanes[Index]);
+            Hash = Hash * MAKE_CONTENT_HASH_PRIME1 + MAKE_CONTENT_HASH_PRIME4;
+        }
+    } else {
+        Hash = MAKE_CONTENT_HASH_PRIME5;
+    }
+
+    Hash = Hash + State->TotalLength + (Length - Offset);
+
+    while (Offset + sizeof(DWORDLONG) <= Length) {
+        Hash = Hash ^ MakeContentHashRound(0, *(DWORDLONG UNALIGNED *)&Buffer[Offset]);
+        Hash = MAKE_CONTENT_HASH_ROTL(Hash, 27) * MAKE_CONTENT_HASH_PRIME1 + MAKE_CONTENT_HASH_PRIME4;
+        Offset = Offset + sizeof(DWORDLONG);
+    }
+
+    if (Offset + sizeof(DWORD) <= Length) {
+        Word = *(DWORD UNALIGNED *)&Buffer[Offset];
+        Hash = Hash ^ ((DWORDLONG)Word * MAKE_CONTENT_HASH_PRIME1);
+        Hash = MAKE_CONTENT_HASH_ROTL(Hash, 23) * MAKE_CONTENT_HASH_PRIME2 + MAKE_CONTENT_HASH_PRIME3;
+        Offset = Offset + sizeof(DWORD);
+    }
+
+    while (Offset < Length) {
+        Hash = Hash ^ ((DWORDLONG)Buffer[Offset] * MAKE_CONTENT_HASH_PRIME5);
+        Hash = MAKE_CONTENT_HASH_ROTL(Hash, 11) * MAKE_CONTENT_HASH_PRIME1;
+        Offset++;
+    }
+
+    Hash = Hash ^ (Hash >> 33);
+    Hash = Hash * MAKE_CONTENT_HASH_PRIME2;
+    Hash = Hash ^ (Hash >> 29);
+    Hash = Hash * MAKE_CONTENT_HASH_PRIME3;
+    Hash = Hash ^ (Hash >> 32);
+
+    return Hash;
+}
+
+/**
+ Read a file and calculate a hash of its contents.
+
+ @param FileName Pointer to the full path to the file.
+
+ @param Buffer Pointer to a buffer of MAKE_CONTENT_HASH_BUFFER bytes used to
+        read the file.
+
+ @param Hash On successful completion, updated to contain the hash of the
+        contents of the file.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOLEAN
+MakeHashFileContents(
+    __in PYORI_STRING FileName,
+    __in PUCHAR Buffer,
+    __out PDWORDLONG Hash
+    )
+{
+    MAKE_CONTENT_HASH_STATE State;
+    HANDLE FileHandle;
+    DWORD BytesRead;
+
+    ASSERT(YoriLibIsStringNullTerminated(FileName));
+    FileHandle = CreateFile(FileName->StartOfString,
+                            FILE_READ_DATA,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL);
+
+    if (FileHandle == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+
+    MakeContentHashInitialize(&State);
+
+    while (TRUE) {
+        if (!ReadFile(FileHandle, Buffer, MAKE_CONTENT_HASH_BUFFER, &BytesRead, NULL)) {
+            CloseHandle(FileHandle);
+            return FALSE;
+        }
+
+        if (BytesRead < MAKE_CONTENT_HASH_BUFFER) {
+            break;
+        }
+
+        MakeContentHashUpdate(&State, Buffer, BytesRead);
+    }
+
+    CloseHandle(FileHandle);
+
+    *Hash = MakeContentHashFinalize(&State, Buffer, BytesRead);
+    return TRUE;
+}
+
+/**
+ Process a single request to hash a file and indicate that it is complete.
+
+ @param Request Pointer to the request.
+
+ @param Buffer Pointer to a buffer of MAKE_CONTENT_HASH_BUFFER bytes used to
+        read the file.
+ */
+VOID
+MakeProcessContentHashRequest(
+    __inout PMAKE_CONTENT_HASH_REQUEST Request,
+    __in PUCHAR Buffer
+    )
+{
+    Request->Succeeded = MakeHashFileContents(&Request->Target->HashEntry.Key, Buffer, &Request->Hash);
+    InterlockedExchange((INTERLOCKED_VOLATILE LONG *)&Request->Complete, TRUE);
+}
+
+/**
+ A thread which hashes files queued to the pool until the pool is deleted.
+
+ @param Context Pointer to the pool.
+
+ @return Zero.
+ */
+DWORD WINAPI
+MakeContentHashWorker(
+    __in LPVOID Context
+    )
+{
+    PMAKE_CONTENT_HASH_POOL Pool;
+    PMAKE_CONTENT_HASH_REQUEST Request;
+    PUCHAR Buffer;
+    DWORD FoundEvent;
+
+    Pool = (PMAKE_CONTENT_HASH_POOL)Context;
+    Buffer = YoriLibMalloc(MAKE_CONTENT_HASH_BUFFER);
+
+    while (TRUE) {
+
+        //
+        //  Wait for an indication of more work or shutdown.
+        //
+
+        FoundEvent = WaitForMultipleObjectsEx(2, &Pool->WorkerWaitEvent, FALSE, INFINITE, FALSE);
+
+        //
+        //  Process any queued work.  If a buffer couldn't be allocated,
+        //  leave the work for the main thread.
+        //
+
+        while (Buffer != NULL) {
+            WaitForSingleObject(Pool->Mutex, INFINITE);
+            if (YoriLibIsListEmpty(&Pool->PendingList)) {
+                ReleaseMutex(Pool->Mutex);
+                break;
+            }
+
+            Request = CONTAINING_RECORD(Pool->PendingList.Next, MAKE_CONTENT_HASH_REQUEST, PendingListEntry);
+            YoriLibRemoveListItem(&Request->PendingListEntry);
+            Request->Started = TRUE;
+            ReleaseMutex(Pool->Mutex);
+
+            MakeProcessContentHashRequest(Request, Buffer);
+            SetEvent(Pool->CompletionEvent);
+        }
+
+        //
+        //  If shutdown was requested, terminate the thread.
+        //
+
+        if (FoundEvent == (WAIT_OBJECT_0 + 1)) {
+            break;
+        }
+    }
+
+    if (Buffer != NULL) {
+        YoriLibFree(Buffer);
+    }
+
+    return 0;
+}
+
+/**
+ Allocate a pool of threads to hash the contents of dependencies, so that
+ dependencies whose timestamp has changed but whose contents have not do
+ not cause targets to be rebuilt.  Threads are created as work is queued.
+
+ @param MakeContext Pointer to the context.  The number of child processes
+        is expected to have been determined, and is used as the maximum
+        number of threads.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOLEAN
+MakeCreateContentHashPool(
+    __inout PMAKE_CONTEXT MakeContext
+    )
+{
+    PMAKE_CONTENT_HASH_POOL Pool;
+
+    ASSERT(MakeContext->ContentHashPool == NULL);
+
+    Pool = YoriLibMalloc(sizeof(MAKE_CONTENT_HASH_POOL) + MakeContext->NumberProcesses * sizeof(HANDLE));
+    if (Pool == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(Pool, sizeof(MAKE_CONTENT_HASH_POOL));
+    YoriLibInitializeListHead(&Pool->PendingList);
+    YoriLibInitializeListHead(&Pool->RequestList);
+    Pool->Threads = (PHANDLE)(Pool + 1);
+    Pool->MaxThreads = MakeContext->NumberProcesses;
+    MakeContext->ContentHashPool = Pool;
+
+    Pool->Buffer = YoriLibMalloc(MAKE_CONTENT_HASH_BUFFER);
+    if (Pool->Buffer == NULL) {
+        MakeDeleteContentHashPool(MakeContext);
+        return FALSE;
+    }
+
+    //
+    //  Note the wait event and shutdown event must be adjacent so threads
+    //  can wait on both.
+    //
+
+    Pool->WorkerWaitEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    Pool->WorkerShutdownEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    Pool->CompletionEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    Pool->Mutex = CreateMutex(NULL, FALSE, NULL);
+
+    if (Pool->WorkerWaitEvent == NULL ||
+        Pool->WorkerShutdownEvent == NULL ||
+        Pool->CompletionEvent == NULL ||
+        Pool->Mutex == NULL) {
+
+        MakeDeleteContentHashPool(MakeContext);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Wait for a request to complete.  If no thread has started processing the
+ request, it is processed on the calling thread.
+
+ @param Pool Pointer to the pool.
+
+ @param Request Pointer to the request to wait for.
+ */
+VOID
+MakeWaitForContentHashRequest(
+    __in PMAKE_CONTENT_HASH_POOL Pool,
+    __inout PMAKE_CONTENT_HASH_REQUEST Request
+    )
+{
+    BOOLEAN ProcessHere;
+
+    ProcessHere = FALSE;
+    WaitForSingleObject(Pool->Mutex, INFINITE);
+    if (!Request->Started) {
+        YoriLibRemoveListItem(&Request->PendingListEntry);
+        Request->Started = TRUE;
+        ProcessHere = TRUE;
+    }
+    ReleaseMutex(Pool->Mutex);
+
+    if (ProcessHere) {
+        MakeProcessContentHashRequest(Request, Pool->Buffer);
+        return;
+    }
+
+    //
+    //  The completion event is shared across all requests, so it may have
+    //  been signalled for a different request, or been consumed before this
+    //  request completed.  Check the request each time it is signalled.
+    //
+
+    while (!Request->Complete) {
+        WaitForSingleObject(Pool->CompletionEvent, INFINITE);
+    }
+}
+
+/**
+ Delete the pool of threads used to hash contents of dependencies.  Any
+ request that has not been consumed is waited for and discarded.
+
+ @param MakeContext Pointer to the context.
+ */
+VOID
+MakeDeleteContentHashPool(
+    __inout PMAKE_CONTEXT MakeContext
+    )
+{
+    PMAKE_CONTENT_HASH_POOL Pool;
+    PMAKE_CONTENT_HASH_REQUEST Request;
+    PYORI_LIST_ENTRY ListEntry;
+
+    Pool = MakeContext->ContentHashPool;
+    if (Pool == NULL) {
+        return;
+    }
+
+    if (Pool->ThreadsAllocated > 0) {
+        SetEvent(Pool->WorkerShutdownEvent);
+        WaitForMultipleObjectsEx(Pool->ThreadsAllocated, Pool->Threads, TRUE, INFINITE, FALSE);
+        while (Pool->ThreadsAllocated > 0) {
+            Pool->ThreadsAllocated--;
+            CloseHandle(Pool->Threads[Pool->ThreadsAllocated]);
+        }
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&Pool->RequestList, NULL);
+    while (ListEntry != NULL) {
+        Request = CONTAINING_RECORD(ListEntry, MAKE_CONTENT_HASH_REQUEST, RequestListEntry);
+        if (!Request->Started) {
+            YoriLibRemoveListItem(&Request->PendingListEntry);
+        }
+        YoriLibRemoveListItem(&Request->RequestListEntry);
+        Request->Target->ContentHashRequest = NULL;
+        YoriLibFree(Request);
+        ListEntry = YoriLibGetNextListEntry(&Pool->RequestList, NULL);
+    }
+
+    if (Pool->WorkerWaitEvent != NULL) {
+        CloseHandle(Pool->WorkerWaitEvent);
+    }
+    if (Pool->WorkerShutdownEvent != NULL) {
+        CloseHandle(Pool->WorkerShutdownEvent);
+    }
+    if (Pool->CompletionEvent != NULL) {
+        CloseHandle(Pool->CompletionEvent);
+    }
+    if (Pool->Mutex != NULL) {
+        CloseHandle(Pool->Mutex);
+    }
+    if (Pool->Buffer != NULL) {
+        YoriLibFree(Pool->Buffer);
+    }
+
+    YoriLibFree(Pool);
+    MakeContext->ContentHashPool = NULL;
+}
+
+/**
+ Start determining when the contents of a target file last changed.  If the
+ build state has a hash of the file at its current timestamp, that is used.
+ Otherwise the file is queued to be hashed by the pool, so that several
+ files can be read concurrently.  The result is collected with
+ @ref MakeGetContentModifiedTime .
+
+ @param MakeContext Pointer to the context.  If content hashing is not in
+        use, this function does nothing.
+
+ @param Target Pointer to the target, which is expected to have been probed
+        and found to exist.
+ */
+VOID
+MakeQueueContentHash(
+    __in PMAKE_CONTEXT MakeContext,
+    __inout PMAKE_TARGET Target
+    )
+{
+    PMAKE_CONTENT_HASH_POOL Pool;
+    PMAKE_CONTENT_HASH_REQUEST Request;
+    DWORDLONG ContentHash;
+    LARGE_INTEGER HashedModifiedTime;
+    LARGE_INTEGER ContentModifiedTime;
+    DWORD ThreadId;
+
+    Pool = MakeContext->ContentHashPool;
+    if (Pool == NULL ||
+        Target->ContentModifiedTimeKnown ||
+        Target->ContentHashRequest != NULL ||
+        !Target->FileExists ||
+        Target->ModifiedTime.QuadPart == 0) {
+
+        return;
+    }
+
+    if (MakeGetBuildStateContentHash(MakeContext, Target, &ContentHash, &HashedModifiedTime, &ContentModifiedTime) &&
+        HashedModifiedTime.QuadPart == Target->ModifiedTime.QuadPart) {
+
+        Target->ContentModifiedTime.QuadPart = ContentModifiedTime.QuadPart;
+        Target->ContentModifiedTimeKnown = TRUE;
+        return;
+    }
+
+    Request = YoriLibMalloc(sizeof(MAKE_CONTENT_HASH_REQUEST));
+    if (Request == NULL) {
+        return;
+    }
+
+    ZeroMemory(Request, sizeof(MAKE_CONTENT_HASH_REQUEST));
+    Request->Target = Target;
+    Target->ContentHashRequest = Request;
+    YoriLibAppendList(&Pool->RequestList, &Request->RequestListEntry);
+    MakeContext->FilesHashed++;
+
+    WaitForSingleObject(Pool->Mutex, INFINITE);
+    YoriLibAppendList(&Pool->PendingList, &Request->PendingListEntry);
+    ReleaseMutex(Pool->Mutex);
+
+    if (Pool->ThreadsAllocated < Pool->MaxThreads) {
+        Pool->Threads[Pool->ThreadsAllocated] = CreateThread(NULL, 0, MakeContentHashWorker, Pool, 0, &ThreadId);
+        if (Pool->Threads[Pool->ThreadsAllocated] != NULL) {
+            Pool->ThreadsAllocated++;
+        }
+    }
+
+    SetEvent(Pool->WorkerWaitEvent);
+}
+
+/**
+ Return the time that the contents of a target file last changed.  If the
+ file has been written with identical contents since the build state
+ recorded its hash, this is older than the file's timestamp.  If content
+ hashing is not in use or the contents cannot be hashed, this is the file's
+ timestamp.
+
+ @param MakeContext Pointer to the context.
+
+ @param Target Pointer to the target, which is expected to have been probed.
+
+ @return The time that the contents of the file last changed.
+ */
+LONGLONG
+MakeGetContentModifiedTime(
+    __in PMAKE_CONTEXT MakeContext,
+    __inout PMAKE_TARGET Target
+    )
+{
+    PMAKE_CONTENT_HASH_REQUEST Request;
+    DWORDLONG ContentHash;
+    LARGE_INTEGER HashedModifiedTime;
+    LARGE_INTEGER ContentModifiedTime;
+
+    if (Target->ContentModifiedTimeKnown) {
+        return Target->ContentModifiedTime.QuadPart;
+    }
+
+    Request = Target->ContentHashRequest;
+    if (Request == NULL) {
+        return Target->ModifiedTime.QuadPart;
+    }
+
+    MakeWaitForContentHashRequest(MakeContext->ContentHashPool, Request);
+
+    //
+    //  If the contents match the recorded hash, the contents last changed
+    //  when the build state says they did.  Otherwise they changed when the
+    //  file was last written.
+    //
+
+    Target->ContentModifiedTime.QuadPart = Target->ModifiedTime.QuadPart;
+    if (Request->Succeeded) {
+        if (MakeGetBuildStateContentHash(MakeContext, Target, &ContentHash, &HashedModifiedTime, &ContentModifiedTime) &&
+            ContentHash == Request->Hash &&
+            ContentModifiedTime.QuadPart < Target->ModifiedTime.QuadPart) {
+
+            Target->ContentModifiedTime.QuadPart = ContentModifiedTime.QuadPart;
+        }
+
+        MakeSetBuildStateContentHash(MakeContext, Target, Request->Hash, &Target->ContentModifiedTime);
+    }
+    Target->ContentModifiedTimeKnown = TRUE;
+
+    YoriLibRemoveListItem(&Request->RequestListEntry);
+    Target->ContentHashRequest = NULL;
+    YoriLibFree(Request);
+
+    return Target->ContentModifiedTime.QuadPart;
+}
+
+// vim:sw=4:ts=4:et:
@@ -78,8 +78,148 @@ typedef struct _MAKE_CHILD_RECIPE {
      An execution plan.  Should be deallocated if CmdContextPresent is TRUE.
      */
     YORI_LIBSH_EXEC_PLAN ExecPlan;
+
+    /**
+     The process handle that a wait thread should wait for.  This is set by
+     the main thread when a process is launched and cleared by the wait
+     thread when the process completes.  Only used when wait threads are
+     in use.
+     */
+    HANDLE WaitHandle;
+
+    /**
+     Set to TRUE by a wait thread when the process has completed and the
+     completion has not yet been processed by the main thread.  Only used
+     when wait threads are in use.
+     */
+    LONG Completed;
+
+    /**
+     The time that a wait thread observed the process completing.  Only
+     used when wait threads are in use.
+     */
+    LARGE_INTEGER SignalTime;
+
+    /**
+     The time between a wait thread observing the current command complete
+     and the main thread processing the completion, in performance counter
+     units.  Only used when wait threads are in use.
+     */
+    DWORDLONG WaitLatency;
+
+    /**
+     The time that the current command was launched.  Only used when
+     recording a trace.
+     */
+    LARGE_INTEGER CmdStartTime;
 } MAKE_CHILD_RECIPE, *PMAKE_CHILD_RECIPE;
 
+/**
+ The number of child processes that a single wait thread can wait for.  One
+ wait object is reserved for the event used to tell the thread to rescan its
+ set of processes.
+ */
+#define MAKE_CHILDREN_PER_WAIT_THREAD (MAXIMUM_WAIT_OBJECTS - 1)
+
+/**
+ Information about a thread that waits for a subset of child processes.
+ */
+typedef struct _MAKE_WAIT_THREAD {
+
+    /**
+     Pointer to the scheduler that owns this thread.
+     */
+    struct _MAKE_CHILD_SCHEDULER *Scheduler;
+
+    /**
+     A handle to the thread.
+     */
+    HANDLE ThreadHandle;
+
+    /**
+     An event that is signalled when the set of processes that this thread
+     should wait for has changed, or when the thread should terminate.
+     */
+    HANDLE WakeEvent;
+
+    /**
+     The index of the first child recipe that this thread is waiting for.
+     */
+    DWORD FirstChild;
+
+    /**
+     The number of child recipes that this thread is waiting for.
+     */
+    DWORD NumberChildren;
+} MAKE_WAIT_THREAD, *PMAKE_WAIT_THREAD;
+
+/**
+ State used to launch child processes and wait for them to complete.  Each
+ child recipe occupies a fixed slot in ChildRecipeArray for its lifetime.
+ If the number of child processes is small enough, the main thread waits
+ for them directly with WaitForMultipleObjects.  If not, the children are
+ divided among wait threads, each waiting for up to
+ MAKE_CHILDREN_PER_WAIT_THREAD children, which mark completed children and
+ release a semaphore that the main thread waits on.
+ */
+typedef struct _MAKE_CHILD_SCHEDULER {
+
+    /**
+     Pointer to the make context.
+     */
+    PMAKE_CONTEXT MakeContext;
+
+    /**
+     An array of MakeContext->NumberProcesses child recipes.  A child recipe
+     is in use if its Target is not NULL.
+     */
+    PMAKE_CHILD_RECIPE ChildRecipeArray;
+
+    /**
+     An array of MakeContext->NumberProcesses indexes of child recipes that
+     are not in use.
+     */
+    PDWORD FreeChildren;
+
+    /**
+     The number of elements in FreeChildren.
+     */
+    DWORD NumberFreeChildren;
+
+    /**
+     An array of handles used when waiting from the main thread.  Only used
+     when wait threads are not in use.
+     */
+    HANDLE *ProcessHandleArray;
+
+    /**
+     An array of child recipe indexes corresponding to each element in
+     ProcessHandleArray.  Only used when wait threads are not in use.
+     */
+    PDWORD ProcessHandleChild;
+
+    /**
+     An array of wait threads.  NULL if the main thread waits directly.
+     */
+    PMAKE_WAIT_THREAD WaitThreads;
+
+    /**
+     The number of elements in WaitThreads.
+     */
+    DWORD NumberWaitThreads;
+
+    /**
+     A semaphore released once for each child that a wait thread has
+     observed completing.
+     */
+    HANDLE CompletionSemaphore;
+
+    /**
+     Set to TRUE to indicate that wait threads should terminate.
+     */
+    BOOLEAN Terminate;
+} MAKE_CHILD_SCHEDULER, *PMAKE_CHILD_SCHEDULER;
+
 /**
  Attempt to set the temporary directory for this process to match the
  specified JobId, creating the directory if it does not exist.
@@ -99,26 +239,23 @@ MakeSetTemporaryDirectory(
     __in DWORD JobId
     )
 {
-    DWORDLONG TestMask;
     YORI_STRING JobTempPath;
 
     ASSERT(JobId < MakeContext->NumberProcesses);
-    TestMask = 1;
-    TestMask = TestMask << JobId;
 
-    if (!YoriLibAllocateString(&JobTempPath, MakeContext->TempPath.LengthInChars + sizeof("\\YMAKE12"))) {
+    if (!YoriLibAllocateString(&JobTempPath, MakeContext->TempPath.LengthInChars + sizeof("\\YMAKE4294967295"))) {
         return FALSE;
     }
 
     JobTempPath.LengthInChars = YoriLibSPrintf(JobTempPath.StartOfString, _T("%y\\YMAKE%i"), &MakeContext->TempPath, JobId);
 
-    if ((MakeContext->TempDirectoriesCreated & TestMask) == 0) {
+    if (!MakeContext->TempDirectoriesCreated[JobId]) {
         if (!YoriLibCreateDirectoryAndParents(&JobTempPath)) {
             YoriLibFreeStringContents(&JobTempPath);
             return FALSE;
         }
 
-        MakeContext->TempDirectoriesCreated = MakeContext->TempDirectoriesCreated | TestMask;
+        MakeContext->TempDirectoriesCreated[JobId] = TRUE;
     }
 
     if (!SetEnvironmentVariable(_T("TEMP"), JobTempPath.StartOfString)) {
@@ -148,17 +285,18 @@ MakeCleanupTemporaryDirectories(
     )
 {
     DWORD Probe;
-    DWORDLONG TestMask;
     YORI_STRING TempPath;
 
-    if (!YoriLibAllocateString(&TempPath, MakeContext->TempPath.LengthInChars + sizeof("\\YMAKE12"))) {
+    if (MakeContext->TempDirectoriesCreated == NULL) {
+        return;
+    }
+
+    if (!YoriLibAllocateString(&TempPath, MakeContext->TempPath.LengthInChars + sizeof("\\YMAKE4294967295"))) {
         return;
     }
 
     for (Probe = 0; Probe < MakeContext->NumberProcesses; Probe++) {
-        TestMask = 1;
-        TestMask = TestMask << Probe;
-        if ((MakeContext->TempDirectoriesCreated & TestMask) != 0) {
+        if (MakeContext->TempDirectoriesCreated[Probe]) {
             TempPath.LengthInChars = YoriLibSPrintf(TempPath.StartOfString, _T("%y\\YMAKE%i"), &MakeContext->TempPath, Probe);
             RemoveDirectory(TempPath.StartOfString);
         }
@@ -183,13 +321,10 @@ MakeAllocateJobId(
     )
 {
     DWORD Probe;
-    DWORDLONG TestMask;
 
     for (Probe = 0; Probe < MakeContext->NumberProcesses; Probe++) {
-        TestMask = 1;
-        TestMask = TestMask << Probe;
-        if ((MakeContext->JobIdsAllocated & TestMask) == 0) {
-            MakeContext->JobIdsAllocated = MakeContext->JobIdsAllocated | TestMask;
+        if (!MakeContext->JobIdsAllocated[Probe]) {
+            MakeContext->JobIdsAllocated[Probe] = TRUE;
             MakeSetTemporaryDirectory(MakeContext, Probe);
             return Probe;
         }
@@ -212,14 +347,9 @@ MakeFreeJobId(
     __in DWORD JobId
     )
 {
-    DWORDLONG TestMask;
-
     ASSERT(JobId < MakeContext->NumberProcesses);
-
-    TestMask = 1;
-    TestMask = TestMask << JobId;
-    ASSERT(MakeContext->JobIdsAllocated & TestMask);
-    MakeContext->JobIdsAllocated = MakeContext->JobIdsAllocated & ~(TestMask);
+    ASSERT(MakeContext->JobIdsAllocated[JobId]);
+    MakeContext->JobIdsAllocated[JobId] = FALSE;
 }
 
 /**
@@ -229,6 +359,7 @@ MakeFreeJobId(
 CONST LPTSTR
 MakePuntToCmd[] = {
     _T("COPY"),
+    _T("DEL"),
     _T("ERASE"),
     _T("FOR"),
     _T("IF"),
@@ -583,15 +714,33 @@ MakeLaunchNextCmd(
             } else {
                 PYORI_LIBSH_BUILTIN_CALLBACK Callback;
 
-                Callback = YoriLibShLookupBuiltinByName(&ExecContext->CmdToExec.ArgV[0]);
+                //
+                //  Builtins which are also CMD commands are only executed in
+                //  process if they would behave the same way as CMD.  If
+                //  not, fall through to create a process below.  Only the
+                //  first program is executed here, so if the plan contains
+                //  pipes or other operators, it is handed to CMD.
+                //
+
+                Callback = NULL;
+                if (ExecContext->NextProgram == NULL) {
+                    Callback = YoriLibShLookupBuiltinByName(&ExecContext->CmdToExec.ArgV[0]);
+                }
                 if (Callback) {
+                    LARGE_INTEGER EndTime;
 
+                    QueryPerformanceCounter(&ChildRecipe->CmdStartTime);
                     SetCurrentDirectory(ChildRecipe->CurrentDirectory.StartOfString);
-                    Result = MakeShExecuteInProc(Callback->BuiltInFn, ExecContext);
+                    if (MakeShIsBuiltinCmdCompatible(ExecContext)) {
+                        Result = MakeShExecuteInProc(Callback->BuiltInFn, ExecContext);
+                        ExecutedBuiltin = TRUE;
+                        ChildRecipe->ProcessHandle = NULL;
+                    }
                     SetCurrentDirectory(MakeContext->ProcessCurrentDirectory.StartOfString);
-
-                    ExecutedBuiltin = TRUE;
-                    ChildRecipe->ProcessHandle = NULL;
+                    if (ExecutedBuiltin && MakeContext->Trace != NULL) {
+                        QueryPerformanceCounter(&EndTime);
+                        MakeTraceComplete(MakeContext, _T("builtin"), &CmdToExec->Cmd, 0, &ChildRecipe->CmdStartTime, &EndTime);
+                    }
                 }
             }
 
@@ -690,6 +839,7 @@ MakeLaunchNextCmd(
     }
 
     ChildRecipe->JobId = MakeAllocateJobId(MakeContext);
+    QueryPerformanceCounter(&ChildRecipe->CmdStartTime);
 
     Error = YoriLibShCreateProcess(ExecContext,
                                    ChildRecipe->CurrentDirectory.StartOfString,
@@ -729,7 +879,7 @@ MakeRecipeCompletion(
     __inout PMAKE_CHILD_RECIPE ChildRecipe
     )
 {
-    UNREFERENCED_PARAMETER(MakeContext);
+    PMAKE_TARGET Target;
 
     //
     //  This recipe structure should not have child processes executing.
@@ -737,6 +887,10 @@ MakeRecipeCompletion(
 
     ASSERT(!ChildRecipe->CmdContextPresent);
     YoriLibFreeStringContents(&ChildRecipe->CurrentDirectory);
+
+    Target = ChildRecipe->Target;
+    QueryPerformanceCounter(&Target->ExecuteEndTime);
+    MakeContext->RecipeTimeTotal = MakeContext->RecipeTimeTotal + Target->ExecuteEndTime.QuadPart - Target->ExecuteStartTime.QuadPart;
 }
 
 /**
@@ -787,6 +941,7 @@ MakeLaunchNextTarget(
 
     ChildRecipe->Target = Target;
     ChildRecipe->Cmd = NULL;
+    QueryPerformanceCounter(&Target->ExecuteStartTime);
 
     //
     //  The previous recipe should have been cleaned up.
@@ -816,6 +971,223 @@ MakeLaunchNextTarget(
     return Result;
 }
 
+/**
+ Add a target to the list of targets that are ready to execute.  The list
+ is kept in order of the longest expected chain of work that depends on
+ each target, so that long chains start as early as possible rather than
+ serializing the end of the build.  Targets with equal cost are executed
+ in the order they became ready.
+
+ @param MakeContext Pointer to the context.
+
+ @param Target Pointer to the target that is ready to execute.
+ */
+VOID
+MakeInsertReadyTarget(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_TARGET Target
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PMAKE_TARGET ReadyTarget;
+
+    ListEntry = YoriLibGetNextListEntry(&MakeContext->TargetsReady, NULL);
+    while (ListEntry != NULL) {
+        ReadyTarget = CONTAINING_RECORD(ListEntry, MAKE_TARGET, RebuildList);
+        if (ReadyTarget->CriticalPathCost < Target->CriticalPathCost) {
+
+            //
+            //  Appending to an entry within a list inserts before it.
+            //
+
+            YoriLibAppendList(ListEntry, &Target->RebuildList);
+            return;
+        }
+        ListEntry = YoriLibGetNextListEntry(&MakeContext->TargetsReady, ListEntry);
+    }
+
+    YoriLibAppendList(&MakeContext->TargetsReady, &Target->RebuildList);
+}
+
+/**
+ Calculate the expected time to execute a target and the longest chain of
+ targets that depend on it.
+
+ @param Target Pointer to the target.
+ */
+VOID
+MakeCalculateCriticalPathCost(
+    __in PMAKE_TARGET Target
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PMAKE_TARGET_DEPENDENCY Dependency;
+    DWORDLONG LongestChild;
+
+    if (Target->CriticalPathCalculated) {
+        return;
+    }
+
+    LongestChild = 0;
+    ListEntry = YoriLibGetNextListEntry(&Target->ChildDependents, NULL);
+    while (ListEntry != NULL) {
+        Dependency = CONTAINING_RECORD(ListEntry, MAKE_TARGET_DEPENDENCY, ParentDependents);
+        if (Dependency->Child->RebuildRequired) {
+            MakeCalculateCriticalPathCost(Dependency->Child);
+            if (Dependency->Child->CriticalPathCost > LongestChild) {
+                LongestChild = Dependency->Child->CriticalPathCost;
+            }
+        }
+        ListEntry = YoriLibGetNextListEntry(&Target->ChildDependents, ListEntry);
+    }
+
+    Target->CriticalPathCost = Target->RecipeDuration + LongestChild;
+    Target->CriticalPathCalculated = TRUE;
+}
+
+/**
+ Determine the expected cost of every target that needs to be rebuilt and
+ order the ready targets so that the longest chains start first.  Targets
+ whose recipe duration is not known from a previous build are assumed to
+ take the average of those that are known.
+
+ @param MakeContext Pointer to the context.
+ */
+VOID
+MakePrioritizeTargets(
+    __in PMAKE_CONTEXT MakeContext
+    )
+{
+    PYORI_LIST_ENTRY ListHeads[2];
+    PYORI_LIST_ENTRY ListEntry;
+    PMAKE_TARGET Target;
+    DWORDLONG KnownTotal;
+    DWORD KnownCount;
+    DWORDLONG DefaultDuration;
+    YORI_LIST_ENTRY ReadyList;
+    DWORD Index;
+
+    ListHeads[0] = &MakeContext->TargetsReady;
+    ListHeads[1] = &MakeContext->TargetsWaiting;
+
+    KnownTotal = 0;
+    KnownCount = 0;
+    for (Index = 0; Index < sizeof(ListHeads)/sizeof(ListHeads[0]); Index++) {
+        ListEntry = YoriLibGetNextListEntry(ListHeads[Index], NULL);
+        while (ListEntry != NULL) {
+            Target = CONTAINING_RECORD(ListEntry, MAKE_TARGET, RebuildList);
+            Target->RecipeDuration = MakeGetBuildStateRecipeDuration(MakeContext, Target);
+            if (Target->RecipeDuration != 0) {
+                KnownTotal = KnownTotal + Target->RecipeDuration;
+                KnownCount++;
+            }
+            ListEntry = YoriLibGetNextListEntry(ListHeads[Index], ListEntry);
+        }
+    }
+
+    DefaultDuration = 1;
+    if (KnownCount > 0) {
+        DefaultDuration = KnownTotal / KnownCount + 1;
+    }
+
+    for (Index = 0; Index < sizeof(ListHeads)/sizeof(ListHeads[0]); Index++) {
+        ListEntry = YoriLibGetNextListEntry(ListHeads[Index], NULL);
+        while (ListEntry != NULL) {
+            Target = CONTAINING_RECORD(ListEntry, MAKE_TARGET, RebuildList);
+            if (Target->RecipeDuration == 0 && !YoriLibIsListEmpty(&Target->ExecCmds)) {
+                Target->RecipeDuration = DefaultDuration;
+            }
+            ListEntry = YoriLibGetNextListEntry(ListHeads[Index], ListEntry);
+        }
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&MakeContext->TargetsWaiting, NULL);
+    while (ListEntry != NULL) {
+        Target = CONTAINING_RECORD(ListEntry, MAKE_TARGET, RebuildList);
+        MakeCalculateCriticalPathCost(Target);
+        ListEntry = YoriLibGetNextListEntry(&MakeContext->TargetsWaiting, ListEntry);
+    }
+
+    //
+    //  Move every ready target to a temporary list and insert them back in
+    //  priority order.
+    //
+
+    YoriLibInitializeListHead(&ReadyList);
+    ListEntry = YoriLibGetNextListEntry(&MakeContext->TargetsReady, NULL);
+    while (ListEntry != NULL) {
+        YoriLibRemoveListItem(ListEntry);
+        YoriLibAppendList(&ReadyList, ListEntry);
+        ListEntry = YoriLibGetNextListEntry(&MakeContext->TargetsReady, NULL);
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&ReadyList, NULL);
+    while (ListEntry != NULL) {
+        YoriLibRemoveListItem(ListEntry);
+        Target = CONTAINING_RECORD(ListEntry, MAKE_TARGET, RebuildList);
+        MakeCalculateCriticalPathCost(Target);
+        MakeInsertReadyTarget(MakeContext, Target);
+        ListEntry = YoriLibGetNextListEntry(&ReadyList, NULL);
+    }
+}
+
+/**
+ Display the chain of targets that determined how long the build took.
+ This starts from the last target to finish, and repeatedly finds the
+ dependency of that target that finished last.
+
+ @param MakeContext Pointer to the context.
+ */
+VOID
+MakeDisplayCriticalPath(
+    __in PMAKE_CONTEXT MakeContext
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PMAKE_TARGET_DEPENDENCY Dependency;
+    PMAKE_TARGET Target;
+    PMAKE_TARGET NextTarget;
+    LARGE_INTEGER Frequency;
+    LONGLONG Duration;
+
+    NextTarget = NULL;
+    ListEntry = YoriLibGetNextListEntry(&MakeContext->TargetsFinished, NULL);
+    while (ListEntry != NULL) {
+        Target = CONTAINING_RECORD(ListEntry, MAKE_TARGET, RebuildList);
+        if (Target->ExecuteEndTime.QuadPart != 0 &&
+            (NextTarget == NULL || Target->ExecuteEndTime.QuadPart > NextTarget->ExecuteEndTime.QuadPart)) {
+
+            NextTarget = Target;
+        }
+        ListEntry = YoriLibGetNextListEntry(&MakeContext->TargetsFinished, ListEntry);
+    }
+
+    if (NextTarget == NULL) {
+        return;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("\nCritical path, last to finish first:\n"));
+
+    while (NextTarget != NULL) {
+        Target = NextTarget;
+        Duration = (Target->ExecuteEndTime.QuadPart - Target->ExecuteStartTime.QuadPart) * 1000 / Frequency.QuadPart;
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("  %8lli ms %y\n"), Duration, &Target->HashEntry.Key);
+
+        NextTarget = NULL;
+        ListEntry = YoriLibGetNextListEntry(&Target->ParentDependents, NULL);
+        while (ListEntry != NULL) {
+            Dependency = CONTAINING_RECORD(ListEntry, MAKE_TARGET_DEPENDENCY, ChildDependents);
+            if (Dependency->Parent->ExecuteEndTime.QuadPart != 0 &&
+                (NextTarget == NULL || Dependency->Parent->ExecuteEndTime.QuadPart > NextTarget->ExecuteEndTime.QuadPart)) {
+
+                NextTarget = Dependency->Parent;
+            }
+            ListEntry = YoriLibGetNextListEntry(&Target->ParentDependents, ListEntry);
+        }
+    }
+}
+
 /**
  Update the dependency graph to ensure that any targets waiting for the
  specified target can now be executed.
@@ -836,6 +1208,17 @@ MakeUpdateDependenciesForTarget(
     YoriLibRemoveListItem(&Target->RebuildList);
     YoriLibAppendList(&MakeContext->TargetsFinished, &Target->RebuildList);
 
+    //
+    //  If the recipe executed, record how long it took so that future
+    //  builds can schedule it.
+    //
+
+    if (Target->ExecuteEndTime.QuadPart != 0) {
+        LARGE_INTEGER Frequency;
+        QueryPerformanceFrequency(&Frequency);
+        MakeSetBuildStateRecipeDuration(MakeContext, Target, (DWORD)((Target->ExecuteEndTime.QuadPart - Target->ExecuteStartTime.QuadPart) * 1000 / Frequency.QuadPart));
+    }
+
     ListEntry = NULL;
     ListEntry = YoriLibGetNextListEntry(&Target->ChildDependents, ListEntry);
     while (ListEntry != NULL) {
@@ -844,7 +1227,7 @@ MakeUpdateDependenciesForTarget(
             Dependency->Child->NumberParentsToBuild--;
             if (Dependency->Child->NumberParentsToBuild == 0) {
                 YoriLibRemoveListItem(&Dependency->Child->RebuildList);
-                YoriLibAppendList(&MakeContext->TargetsReady, &Dependency->Child->RebuildList);
+                MakeInsertReadyTarget(MakeContext, Dependency->Child);
             }
         }
         ListEntry = YoriLibGetNextListEntry(&Target->ChildDependents, ListEntry);
@@ -889,6 +1272,17 @@ MakeProcessCompletion(
 
     if (ChildRecipe->ProcessHandle != NULL) {
 
+        if (MakeContext->Trace != NULL) {
+            LARGE_INTEGER EndTime;
+
+            if (ChildRecipe->SignalTime.QuadPart != 0) {
+                EndTime.QuadPart = ChildRecipe->SignalTime.QuadPart;
+            } else {
+                QueryPerformanceCounter(&EndTime);
+            }
+            MakeTraceComplete(MakeContext, _T("recipe"), &ChildRecipe->Cmd->Cmd, ChildRecipe->JobId + 1, &ChildRecipe->CmdStartTime, &EndTime);
+        }
+
         ExitCode = 255;
         GetExitCodeProcess(ChildRecipe->ProcessHandle, &ExitCode);
         ASSERT(ChildRecipe->CmdContextPresent);
@@ -936,6 +1330,19 @@ MakeProcessCompletion(
             YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Command:\n%y\n"), &ChildRecipe->Cmd->Cmd);
         }
 
+        //
+        //  When displaying performance information, report how long this
+        //  completion waited to be processed, so slow jobs can be found
+        //  rather than only the average and maximum on exit.
+        //
+
+        if (MakeContext->PerfDisplay && ChildRecipe->SignalTime.QuadPart != 0) {
+            LARGE_INTEGER Frequency;
+
+            QueryPerformanceFrequency(&Frequency);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Job %i completion latency %lli us: %y\n"), ChildRecipe->JobId + 1, ChildRecipe->WaitLatency * 1000000 / Frequency.QuadPart, &ChildRecipe->Cmd->Cmd);
+        }
+
         if (RestoreColor) {
             YoriLibVtSetConsoleTextAttr(YORI_LIB_OUTPUT_STDOUT, YoriLibVtGetDefaultColor());
         }
@@ -995,6 +1402,388 @@ MakeCompleteReadyWithNoRecipe(
     return RemovedItem;
 }
 
+/**
+ A thread which waits for a subset of child processes to complete and
+ reports their completion to the main thread.
+
+ @param Context Pointer to the MAKE_WAIT_THREAD structure describing the
+        child processes to wait for.
+
+ @return Zero.
+ */
+DWORD WINAPI
+MakeWaitThreadMain(
+    __in LPVOID Context
+    )
+{
+    PMAKE_WAIT_THREAD WaitThread;
+    PMAKE_CHILD_SCHEDULER Scheduler;
+    PMAKE_CHILD_RECIPE ChildRecipe;
+    HANDLE WaitHandles[MAXIMUM_WAIT_OBJECTS];
+    DWORD WaitChild[MAXIMUM_WAIT_OBJECTS];
+    DWORD HandleCount;
+    DWORD Index;
+    DWORD Err;
+
+    WaitThread = (PMAKE_WAIT_THREAD)Context;
+    Scheduler = WaitThread->Scheduler;
+
+    while (TRUE) {
+
+        //
+        //  The first handle is always the wake event, followed by every
+        //  child process that has been launched and not yet observed to
+        //  complete.
+        //
+
+        WaitHandles[0] = WaitThread->WakeEvent;
+        HandleCount = 1;
+        for (Index = 0; Index < WaitThread->NumberChildren; Index++) {
+            ChildRecipe = &Scheduler->ChildRecipeArray[WaitThread->FirstChild + Index];
+            if (ChildRecipe->WaitHandle != NULL) {
+                WaitHandles[HandleCount] = ChildRecipe->WaitHandle;
+                WaitChild[HandleCount] = WaitThread->FirstChild + Index;
+                HandleCount++;
+            }
+        }
+
+        Err = WaitForMultipleObjectsEx(HandleCount, WaitHandles, FALSE, INFINITE, FALSE);
+        Index = Err - WAIT_OBJECT_0;
+        if (Index >= HandleCount) {
+            break;
+        }
+
+        if (Index == 0) {
+            if (Scheduler->Terminate) {
+                break;
+            }
+            continue;
+        }
+
+        //
+        //  Record when the completion was observed, stop waiting on the
+        //  handle, and tell the main thread.
+        //
+
+        ChildRecipe = &Scheduler->ChildRecipeArray[WaitChild[Index]];
+        QueryPerformanceCounter(&ChildRecipe->SignalTime);
+        ChildRecipe->WaitHandle = NULL;
+        InterlockedExchange((INTERLOCKED_VOLATILE LONG *)&ChildRecipe->Completed, TRUE);
+        ReleaseSemaphore(Scheduler->CompletionSemaphore, 1, NULL);
+    }
+
+    return 0;
+}
+
+/**
+ Stop any wait threads and free all memory and handles associated with a
+ child scheduler.  All child processes should have been waited for before
+ calling this function.
+
+ @param Scheduler Pointer to the scheduler to clean up.
+ */
+VOID
+MakeCleanupChildScheduler(
+    __inout PMAKE_CHILD_SCHEDULER Scheduler
+    )
+{
+    DWORD Index;
+    PMAKE_WAIT_THREAD WaitThread;
+
+    Scheduler->Terminate = TRUE;
+
+    if (Scheduler->WaitThreads != NULL) {
+        for (Index = 0; Index < Scheduler->NumberWaitThreads; Index++) {
+            WaitThread = &Scheduler->WaitThreads[Index];
+            if (WaitThread->ThreadHandle != NULL) {
+                SetEvent(WaitThread->WakeEvent);
+                WaitForSingleObject(WaitThread->ThreadHandle, INFINITE);
+                CloseHandle(WaitThread->ThreadHandle);
+            }
+            if (WaitThread->WakeEvent != NULL) {
+                CloseHandle(WaitThread->WakeEvent);
+            }
+        }
+        YoriLibFree(Scheduler->WaitThreads);
+        Scheduler->WaitThreads = NULL;
+    }
+
+    if (Scheduler->CompletionSemaphore != NULL) {
+        CloseHandle(Scheduler->CompletionSemaphore);
+        Scheduler->CompletionSemaphore = NULL;
+    }
+
+    if (Scheduler->ProcessHandleArray != NULL) {
+        YoriLibFree(Scheduler->ProcessHandleArray);
+        Scheduler->ProcessHandleArray = NULL;
+    }
+
+    if (Scheduler->ChildRecipeArray != NULL) {
+        YoriLibFree(Scheduler->ChildRecipeArray);
+        Scheduler->ChildRecipeArray = NULL;
+    }
+}
+
+/**
+ Initialize a child scheduler capable of waiting for
+ MakeContext->NumberProcesses concurrent child processes.  If this is more
+ than a single WaitForMultipleObjects call can wait for, wait threads are
+ created.
+
+ @param MakeContext Pointer to the make context.
+
+ @param Scheduler Pointer to the scheduler to initialize.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOLEAN
+MakeInitializeChildScheduler(
+    __in PMAKE_CONTEXT MakeContext,
+    __out PMAKE_CHILD_SCHEDULER Scheduler
+    )
+{
+    DWORD Index;
+    DWORD ThreadId;
+    YORI_ALLOC_SIZE_T NumberProcesses;
+    PMAKE_WAIT_THREAD WaitThread;
+
+    ZeroMemory(Scheduler, sizeof(MAKE_CHILD_SCHEDULER));
+    Scheduler->MakeContext = MakeContext;
+    NumberProcesses = MakeContext->NumberProcesses;
+
+    Scheduler->ChildRecipeArray = YoriLibMalloc(NumberProcesses * sizeof(MAKE_CHILD_RECIPE));
+    if (Scheduler->ChildRecipeArray == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(Scheduler->ChildRecipeArray, NumberProcesses * sizeof(MAKE_CHILD_RECIPE));
+
+    //
+    //  Allocate the handle array and both index arrays together.  The
+    //  handle array is first so all elements are naturally aligned.
+    //
+
+    Scheduler->ProcessHandleArray = YoriLibMalloc(NumberProcesses * (sizeof(HANDLE) + 2 * sizeof(DWORD)));
+    if (Scheduler->ProcessHandleArray == NULL) {
+        MakeCleanupChildScheduler(Scheduler);
+        return FALSE;
+    }
+
+    Scheduler->ProcessHandleChild = (PDWORD)(Scheduler->ProcessHandleArray + NumberProcesses);
+    Scheduler->FreeChildren = Scheduler->ProcessHandleChild + NumberProcesses;
+
+    //
+    //  Hand out the lowest numbered entries first, so that when waiting
+    //  from the main thread, handles for earlier launched targets are
+    //  found first.
+    //
+
+    for (Index = 0; Index < NumberProcesses; Index++) {
+        Scheduler->FreeChildren[Index] = NumberProcesses - Index - 1;
+    }
+    Scheduler->NumberFreeChildren = NumberProcesses;
+
+    if (NumberProcesses <= MAXIMUM_WAIT_OBJECTS) {
+        return TRUE;
+    }
+
+    Scheduler->CompletionSemaphore = CreateSemaphore(NULL, 0, NumberProcesses, NULL);
+    if (Scheduler->CompletionSemaphore == NULL) {
+        MakeCleanupChildScheduler(Scheduler);
+        return FALSE;
+    }
+
+    Scheduler->NumberWaitThreads = (NumberProcesses + MAKE_CHILDREN_PER_WAIT_THREAD - 1) / MAKE_CHILDREN_PER_WAIT_THREAD;
+    Scheduler->WaitThreads = YoriLibMalloc(Scheduler->NumberWaitThreads * sizeof(MAKE_WAIT_THREAD));
+    if (Scheduler->WaitThreads == NULL) {
+        MakeCleanupChildScheduler(Scheduler);
+        return FALSE;
+    }
+
+    ZeroMemory(Scheduler->WaitThreads, Scheduler->NumberWaitThreads * sizeof(MAKE_WAIT_THREAD));
+
+    for (Index = 0; Index < Scheduler->NumberWaitThreads; Index++) {
+        WaitThread = &Scheduler->WaitThreads[Index];
+        WaitThread->Scheduler = Scheduler;
+        WaitThread->FirstChild = Index * MAKE_CHILDREN_PER_WAIT_THREAD;
+        WaitThread->NumberChildren = NumberProcesses - WaitThread->FirstChild;
+        if (WaitThread->NumberChildren > MAKE_CHILDREN_PER_WAIT_THREAD) {
+            WaitThread->NumberChildren = MAKE_CHILDREN_PER_WAIT_THREAD;
+        }
+
+        WaitThread->WakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (WaitThread->WakeEvent == NULL) {
+            MakeCleanupChildScheduler(Scheduler);
+            return FALSE;
+        }
+
+        WaitThread->ThreadHandle = CreateThread(NULL, 0, MakeWaitThreadMain, WaitThread, 0, &ThreadId);
+        if (WaitThread->ThreadHandle == NULL) {
+            MakeCleanupChildScheduler(Scheduler);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Obtain an unused child recipe from the scheduler.  The caller must have
+ checked that fewer than MakeContext->NumberProcesses children are active.
+
+ @param Scheduler Pointer to the scheduler.
+
+ @return The index of the child recipe within ChildRecipeArray.
+ */
+DWORD
+MakeAllocateChildRecipe(
+    __inout PMAKE_CHILD_SCHEDULER Scheduler
+    )
+{
+    ASSERT(Scheduler->NumberFreeChildren > 0);
+    Scheduler->NumberFreeChildren--;
+    return Scheduler->FreeChildren[Scheduler->NumberFreeChildren];
+}
+
+/**
+ Return a child recipe to the scheduler once its target has completed.
+
+ @param Scheduler Pointer to the scheduler.
+
+ @param ChildIndex The index of the child recipe within ChildRecipeArray.
+ */
+VOID
+MakeFreeChildRecipe(
+    __inout PMAKE_CHILD_SCHEDULER Scheduler,
+    __in DWORD ChildIndex
+    )
+{
+    ASSERT(Scheduler->NumberFreeChildren < Scheduler->MakeContext->NumberProcesses);
+    ZeroMemory(&Scheduler->ChildRecipeArray[ChildIndex], sizeof(MAKE_CHILD_RECIPE));
+    Scheduler->FreeChildren[Scheduler->NumberFreeChildren] = ChildIndex;
+    Scheduler->NumberFreeChildren++;
+}
+
+/**
+ Indicate that a command has been launched for a child recipe.  If the
+ command created a child process and wait threads are in use, the wait
+ thread responsible for this child recipe is told to wait for it.
+
+ @param Scheduler Pointer to the scheduler.
+
+ @param ChildIndex The index of the child recipe within ChildRecipeArray.
+ */
+VOID
+MakeChildCmdLaunched(
+    __in PMAKE_CHILD_SCHEDULER Scheduler,
+    __in DWORD ChildIndex
+    )
+{
+    PMAKE_CHILD_RECIPE ChildRecipe;
+
+    if (Scheduler->WaitThreads == NULL) {
+        return;
+    }
+
+    ChildRecipe = &Scheduler->ChildRecipeArray[ChildIndex];
+    if (ChildRecipe->ProcessHandle == NULL) {
+        return;
+    }
+
+    ASSERT(ChildRecipe->WaitHandle == NULL);
+    ChildRecipe->SignalTime.QuadPart = 0;
+    ChildRecipe->WaitLatency = 0;
+    ChildRecipe->WaitHandle = ChildRecipe->ProcessHandle;
+    SetEvent(Scheduler->WaitThreads[ChildIndex / MAKE_CHILDREN_PER_WAIT_THREAD].WakeEvent);
+}
+
+/**
+ Wait for an active child recipe to complete its current command.  The
+ caller must have checked that at least one child recipe is active.
+
+ @param Scheduler Pointer to the scheduler.
+
+ @return The index of the child recipe within ChildRecipeArray whose
+         command has completed.
+ */
+DWORD
+MakeWaitForChildCompletion(
+    __inout PMAKE_CHILD_SCHEDULER Scheduler
+    )
+{
+    PMAKE_CONTEXT MakeContext;
+    PMAKE_CHILD_RECIPE ChildRecipe;
+    DWORD Index;
+    DWORD HandleCount;
+    LARGE_INTEGER Now;
+    DWORDLONG Latency;
+
+    MakeContext = Scheduler->MakeContext;
+
+    //
+    //  A process handle can be NULL if either a command failed to launch
+    //  but was prefixed with - indicating failures should be ignored; or if
+    //  it's a builtin command that completed synchronously.  In either case
+    //  rather than wait, just process as if this command completed and move
+    //  to the next command or target.
+    //
+
+    HandleCount = 0;
+    for (Index = 0; Index < MakeContext->NumberProcesses; Index++) {
+        ChildRecipe = &Scheduler->ChildRecipeArray[Index];
+        if (ChildRecipe->Target == NULL) {
+            continue;
+        }
+        if (ChildRecipe->ProcessHandle == NULL) {
+            return Index;
+        }
+        if (Scheduler->WaitThreads == NULL) {
+            Scheduler->ProcessHandleArray[HandleCount] = ChildRecipe->ProcessHandle;
+            Scheduler->ProcessHandleChild[HandleCount] = Index;
+            HandleCount++;
+        }
+    }
+
+    if (Scheduler->WaitThreads == NULL) {
+        ASSERT(HandleCount > 0);
+        Index = WaitForMultipleObjectsEx(HandleCount, Scheduler->ProcessHandleArray, FALSE, INFINITE, FALSE);
+        Index = Index - WAIT_OBJECT_0;
+        return Scheduler->ProcessHandleChild[Index];
+    }
+
+    //
+    //  Each time the semaphore is acquired, at least one child recipe
+    //  that has not yet been processed has completed.
+    //
+
+    WaitForSingleObject(Scheduler->CompletionSemaphore, INFINITE);
+
+    for (Index = 0; Index < MakeContext->NumberProcesses; Index++) {
+        ChildRecipe = &Scheduler->ChildRecipeArray[Index];
+        if (ChildRecipe->Completed) {
+            InterlockedExchange((INTERLOCKED_VOLATILE LONG *)&ChildRecipe->Completed, FALSE);
+            QueryPerformanceCounter(&Now);
+            Latency = Now.QuadPart - ChildRecipe->SignalTime.QuadPart;
+            ChildRecipe->WaitLatency = Latency;
+            MakeContext->ChildWaitLatencyTotal = MakeContext->ChildWaitLatencyTotal + Latency;
+            if (Latency > MakeContext->ChildWaitLatencyMax) {
+                MakeContext->ChildWaitLatencyMax = Latency;
+            }
+            MakeContext->ChildWaitCount++;
+            return Index;
+        }
+    }
+
+    //
+    //  The semaphore is only released after a completion is recorded, so
+    //  something must have been found above.
+    //
+
+    ASSERT(FALSE);
+    return 0;
+}
+
 /**
  Execute commands required to build the requested target.
 
@@ -1010,8 +1799,8 @@ MakeExecuteRequiredTargets(
 
     YORI_ALLOC_SIZE_T NumberActiveProcesses;
     DWORD Index;
-    HANDLE *ProcessHandleArray;
-    PMAKE_CHILD_RECIPE ChildRecipeArray;
+    MAKE_CHILD_SCHEDULER Scheduler;
+    PMAKE_CHILD_RECIPE ChildRecipe;
     BOOLEAN Result;
     BOOLEAN MoveToNextTarget;
     BOOLEAN TargetFailureObserved;
@@ -1019,30 +1808,25 @@ MakeExecuteRequiredTargets(
     NumberActiveProcesses = 0;
     TargetFailureObserved = FALSE;
 
-    ProcessHandleArray = YoriLibMalloc(MakeContext->NumberProcesses * sizeof(HANDLE));
-    if (ProcessHandleArray == NULL) {
+    if (!MakeInitializeChildScheduler(MakeContext, &Scheduler)) {
         return FALSE;
     }
 
-    ZeroMemory(ProcessHandleArray, MakeContext->NumberProcesses * sizeof(HANDLE));
+    MakePrioritizeTargets(MakeContext);
 
-    ChildRecipeArray = YoriLibMalloc(MakeContext->NumberProcesses * sizeof(MAKE_CHILD_RECIPE));
-    if (ChildRecipeArray == NULL) {
-        YoriLibFree(ProcessHandleArray);
-        return FALSE;
-    }
-
-    ZeroMemory(ChildRecipeArray, MakeContext->NumberProcesses * sizeof(MAKE_CHILD_RECIPE));
     Result = TRUE;
 
     while (TRUE) {
 
         while (NumberActiveProcesses < MakeContext->NumberProcesses && !YoriLibIsListEmpty(&MakeContext->TargetsReady)) {
             if (!MakeCompleteReadyWithNoRecipe(MakeContext)) {
-                if (!MakeLaunchNextTarget(MakeContext, &ChildRecipeArray[NumberActiveProcesses])) {
+                Index = MakeAllocateChildRecipe(&Scheduler);
+                if (!MakeLaunchNextTarget(MakeContext, &Scheduler.ChildRecipeArray[Index])) {
+                    MakeFreeChildRecipe(&Scheduler, Index);
                     Result = FALSE;
                     goto Drain;
                 }
+                MakeChildCmdLaunched(&Scheduler, Index);
                 NumberActiveProcesses++;
             }
         }
@@ -1053,26 +1837,8 @@ MakeExecuteRequiredTargets(
                 break;
             }
 
-            //
-            //  A process handle can be NULL if either a command failed to
-            //  launch but was prefixed with - indicating failures should be
-            //  ignored; or if it's a builtin command that completed
-            //  synchronously.  In either case rather than wait, just process
-            //  as if this command completed and move to the next command or
-            //  target.
-            //
-
-            for (Index = 0; Index < NumberActiveProcesses; Index++) {
-                ProcessHandleArray[Index] = ChildRecipeArray[Index].ProcessHandle;
-                if (ProcessHandleArray[Index] == NULL) {
-                    break;
-                }
-            }
-
-            if (Index == NumberActiveProcesses) {
-                Index = WaitForMultipleObjectsEx(NumberActiveProcesses, ProcessHandleArray, FALSE, INFINITE, FALSE);
-                Index = Index - WAIT_OBJECT_0;
-            }
+            Index = MakeWaitForChildCompletion(&Scheduler);
+            ChildRecipe = &Scheduler.ChildRecipeArray[Index];
 
             //
             //  Check if the process succeeded.  If so, and there are more
@@ -1080,47 +1846,34 @@ MakeExecuteRequiredTargets(
             //
 
             MoveToNextTarget = TRUE;
-            Result = MakeProcessCompletion(MakeContext, &ChildRecipeArray[Index]);
+            Result = MakeProcessCompletion(MakeContext, ChildRecipe);
             if (Result) {
-                if (MakeDoesTargetHaveMoreCommands(&ChildRecipeArray[Index])) {
-                    if (MakeLaunchNextCmd(MakeContext, &ChildRecipeArray[Index])) {
+                if (MakeDoesTargetHaveMoreCommands(ChildRecipe)) {
+                    if (MakeLaunchNextCmd(MakeContext, ChildRecipe)) {
+                        MakeChildCmdLaunched(&Scheduler, Index);
                         MoveToNextTarget = FALSE;
                     } else {
                         Result = FALSE;
                     }
                 } else {
-                    MakeRecipeCompletion(MakeContext, &ChildRecipeArray[Index]);
+                    MakeRecipeCompletion(MakeContext, ChildRecipe);
                 }
             }
 
             //
-            //  If we are moving to the next target, overwrite this child
-            //  process with the executing ones, and launch a new target.
-            //  If we failed, we still need to move up all of the executing
-            //  ones to facilitate drain.
+            //  If we are moving to the next target, return this child
+            //  recipe so a new target can be launched in it.
             //
 
             if (MoveToNextTarget) {
                 if (Result) {
-                    MakeUpdateDependenciesForTarget(MakeContext, ChildRecipeArray[Index].Target);
+                    MakeUpdateDependenciesForTarget(MakeContext, ChildRecipe->Target);
                 } else {
-                    MakeRecipeCompletion(MakeContext, &ChildRecipeArray[Index]);
-                }
-
-                if (NumberActiveProcesses > (YORI_ALLOC_SIZE_T)(Index + 1)) {
-                    memmove(&ChildRecipeArray[Index],
-                            &ChildRecipeArray[Index + 1],
-                            (NumberActiveProcesses - Index - 1) * sizeof(MAKE_CHILD_RECIPE));
+                    MakeRecipeCompletion(MakeContext, ChildRecipe);
                 }
 
+                MakeFreeChildRecipe(&Scheduler, Index);
                 NumberActiveProcesses--;
-
-                //
-                //  Everything in the final entry has been moved to earlier
-                //  entries, so the final entry is uninitialized.
-                //
-
-                ZeroMemory(&ChildRecipeArray[NumberActiveProcesses], sizeof(MAKE_CHILD_RECIPE));
             }
 
             if (Result == FALSE) {
@@ -1151,39 +1904,17 @@ MakeExecuteRequiredTargets(
 Drain:
 
     while (NumberActiveProcesses > 0) {
-        for (Index = 0; Index < NumberActiveProcesses; Index++) {
-            if (ChildRecipeArray[Index].ProcessHandle == NULL) {
-                break;
-            }
-            ProcessHandleArray[Index] = ChildRecipeArray[Index].ProcessHandle;
-        }
-
-        //
-        //  If all have active processes, wait for one to complete, then clean
-        //  up the one that did.  If Index != NumberActiveProcesses, it means
-        //  no handle was found above, so there's nothing to wait for, and
-        //  the entry needs to be cleaned up.
-        //
-
-        if (Index == NumberActiveProcesses) {
-            Index = WaitForMultipleObjectsEx(NumberActiveProcesses, ProcessHandleArray, FALSE, INFINITE, FALSE);
-            Index = Index - WAIT_OBJECT_0;
-        }
+        Index = MakeWaitForChildCompletion(&Scheduler);
+        ChildRecipe = &Scheduler.ChildRecipeArray[Index];
 
-        MakeProcessCompletion(MakeContext, &ChildRecipeArray[Index]);
-        MakeRecipeCompletion(MakeContext, &ChildRecipeArray[Index]);
-
-        if (NumberActiveProcesses > Index + 1) {
-            memmove(&ChildRecipeArray[Index],
-                    &ChildRecipeArray[Index + 1],
-                    (NumberActiveProcesses - Index - 1) * sizeof(MAKE_CHILD_RECIPE));
-        }
+        MakeProcessCompletion(MakeContext, ChildRecipe);
+        MakeRecipeCompletion(MakeContext, ChildRecipe);
+        MakeFreeChildRecipe(&Scheduler, Index);
 
         NumberActiveProcesses--;
     }
 
-    YoriLibFree(ChildRecipeArray);
-    YoriLibFree(ProcessHandleArray);
+    MakeCleanupChildScheduler(&Scheduler);
 
     return Result;
 }
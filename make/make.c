@@ -37,17 +37,21 @@ CHAR strMakeHelpText[] =
         "\n"
         "Execute makefiles.\n"
         "\n"
-        "YMAKE [-license] [-f file] [-j n] [-m] [-perf] [-pru] [-s] [var=value] [target]\n"
+        "YMAKE [-license] [-db] [-f file] [-hash] [-j n] [-m] [-perf] [-pru] [-s] [-trace file] [var=value] [target]\n"
         "\n"
         "   --             Treat all further arguments as display parameters\n"
+        "   -db            Keep a build state database to avoid probing unchanged files\n"
         "   -f             Name of the makefile to use, default YMkFile or Makefile\n"
+        "   -hash          Don't rebuild when newer dependencies have unchanged contents\n"
         "   -j             The number of child processes, default number of processors+1\n"
         "   -k             Keep executing jobs after errors\n"
         "   -m             Perform tasks at low priority\n"
         "   -mm            Perform tasks at very low priority\n"
         "   -perf          Display how much time was spent in each phase of processing\n"
+        "                    and how long each job's completion waited to be processed\n"
         "   -pru           Keep a cache of preprocessor recently executed results\n"
-        "   -s             Silently launch child processes\n";
+        "   -s             Silently launch child processes\n"
+        "   -trace         Write a timeline of the build to a trace event JSON file\n";
 
 
 /**
@@ -87,7 +91,8 @@ typedef struct _MAKE_DEFAULT_MACRO {
  */
 CONST YORI_STRING MakeArgsWithParameter[] = {
     YORILIB_CONSTANT_STRING(_T("f")),
-    YORILIB_CONSTANT_STRING(_T("j"))
+    YORILIB_CONSTANT_STRING(_T("j")),
+    YORILIB_CONSTANT_STRING(_T("trace"))
 };
 
 /**
@@ -124,11 +129,26 @@ typedef struct _MAKE_BUILTIN_NAME_MAPPING {
  */
 YORI_CMD_BUILTIN YoriCmd_REM;
 
+/**
+ Declaration for the builtin command.
+ */
+YORI_CMD_BUILTIN YoriCmd_TOUCH;
+
+/**
+ Declaration for the builtin command.
+ */
+YORI_CMD_BUILTIN YoriCmd_YCOPY;
+
 /**
  Declaration for the builtin command.
  */
 YORI_CMD_BUILTIN YoriCmd_YECHO;
 
+/**
+ Declaration for the builtin command.
+ */
+YORI_CMD_BUILTIN YoriCmd_YERASE;
+
 /**
  Declaration for the builtin command.
  */
@@ -144,10 +164,14 @@ YORI_CMD_BUILTIN YoriCmd_YRMDIR;
  */
 CONST MAKE_BUILTIN_NAME_MAPPING
 MakeBuiltinCmds[] = {
+    {_T("COPY"),      YoriCmd_YCOPY},
+    {_T("DEL"),       YoriCmd_YERASE},
     {_T("ECHO"),      YoriCmd_YECHO},
+    {_T("ERASE"),     YoriCmd_YERASE},
     {_T("MKDIR"),     YoriCmd_YMKDIR},
     {_T("REM"),       YoriCmd_REM},
     {_T("RMDIR"),     YoriCmd_YRMDIR},
+    {_T("TOUCH"),     YoriCmd_TOUCH},
     {NULL,            NULL}
 };
 
@@ -355,6 +379,7 @@ ENTRYPOINT(
     YORI_ALLOC_SIZE_T StartArg = 0;
     MAKE_CONTEXT MakeContext;
     PYORI_STRING FileName;
+    PYORI_STRING TraceFileName;
     PMAKE_TARGET RootTarget;
     YORI_STRING FullFileName;
     LARGE_INTEGER StartTime;
@@ -367,10 +392,13 @@ ENTRYPOINT(
     YORI_ALLOC_SIZE_T CharsConsumed;
     MAKE_PRIORITY Priority;
     BOOLEAN ExplicitTargetFound;
+    BOOLEAN HashContents;
     WORD PerformanceProcessors;
     WORD EfficiencyProcessors;
 
     FileName = NULL;
+    TraceFileName = NULL;
+    HashContents = FALSE;
     RootTarget = NULL;
     ZeroMemory(&MakeContext, sizeof(MakeContext));
     YoriLibInitializeListHead(&MakeContext.ScopesList);
@@ -381,6 +409,8 @@ ENTRYPOINT(
     YoriLibInitializeListHead(&MakeContext.TargetsReady);
     YoriLibInitializeListHead(&MakeContext.TargetsWaiting);
     YoriLibInitializeListHead(&MakeContext.PreprocessorCacheList);
+    YoriLibInitializeListHead(&MakeContext.BuildStateList);
+    YoriLibInitializeListHead(&MakeContext.BuildStateVolumes);
     YoriLibInitEmptyString(&FullFileName);
     Priority = MakePriorityNormal;
     ExplicitTargetFound = FALSE;
@@ -463,11 +493,36 @@ ENTRYPOINT(
                 YoriLibDisplayMitLicense(_T("2021"));
                 Result = EXIT_SUCCESS;
                 goto Cleanup;
+            } else if (YoriLibCompareStringLitIns(&Arg, _T("db")) == 0) {
+                if (MakeContext.BuildState == NULL) {
+                    MakeContext.BuildState = YoriLibAllocateHashTable(4000);
+                    if (MakeContext.BuildState == NULL) {
+                        Result = EXIT_FAILURE;
+                        goto Cleanup;
+                    }
+                }
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringLitIns(&Arg, _T("f")) == 0) {
                 if (i + 1 < ArgC) {
                     FileName = &ArgV[i + 1];
                     ArgumentUnderstood = TRUE;
                 }
+            } else if (YoriLibCompareStringLitIns(&Arg, _T("hash")) == 0) {
+
+                //
+                //  Hashes are recorded in the build state, so this implies
+                //  -db.
+                //
+
+                if (MakeContext.BuildState == NULL) {
+                    MakeContext.BuildState = YoriLibAllocateHashTable(4000);
+                    if (MakeContext.BuildState == NULL) {
+                        Result = EXIT_FAILURE;
+                        goto Cleanup;
+                    }
+                }
+                HashContents = TRUE;
+                ArgumentUnderstood = TRUE;
             } else if (YoriLibCompareStringLitIns(&Arg, _T("j")) == 0) {
                 if (i + 1 < ArgC) {
                     if (YoriLibStringToNumber(&ArgV[i + 1], FALSE, &llTemp, &CharsConsumed) && CharsConsumed > 0) {
@@ -502,6 +557,11 @@ ENTRYPOINT(
             } else if (YoriLibCompareStringLitIns(&Arg, _T("s")) == 0) {
                 MakeContext.SilentCommandLaunching = TRUE;
                 ArgumentUnderstood = TRUE;
+            } else if (YoriLibCompareStringLitIns(&Arg, _T("trace")) == 0) {
+                if (i + 1 < ArgC) {
+                    TraceFileName = &ArgV[i + 1];
+                    ArgumentUnderstood = TRUE;
+                }
             } else if (YoriLibCompareStringLitIns(&Arg, _T("wundef")) == 0) {
                 MakeContext.WarnOnUndefinedVariable = TRUE;
                 ArgumentUnderstood = TRUE;
@@ -609,12 +669,50 @@ ENTRYPOINT(
     }
 
     //
-    //  WaitForMultipleObjects has a limit of 64 things to wait for, so this
-    //  program can't currently have more than 64 children.
+    //  Child processes beyond what WaitForMultipleObjects can wait for are
+    //  handled by wait threads, but still apply a sanity limit so a typo
+    //  doesn't create an unbounded number of processes and threads.
+    //
+
+    if (MakeContext.NumberProcesses > MAKE_MAX_PROCESSES) {
+        MakeContext.NumberProcesses = MAKE_MAX_PROCESSES;
+    }
+
+    //
+    //  Allocate the arrays tracking job IDs and their temporary directories.
+    //
+
+    MakeContext.JobIdsAllocated = YoriLibMalloc(MakeContext.NumberProcesses * 2 * sizeof(BOOLEAN));
+    if (MakeContext.JobIdsAllocated == NULL) {
+        Result = EXIT_FAILURE;
+        goto Cleanup;
+    }
+
+    ZeroMemory(MakeContext.JobIdsAllocated, MakeContext.NumberProcesses * 2 * sizeof(BOOLEAN));
+    MakeContext.TempDirectoriesCreated = MakeContext.JobIdsAllocated + MakeContext.NumberProcesses;
+
+    //
+    //  If requested, start recording a timeline of the build.  This needs
+    //  to know the number of child processes so each can be displayed.
+    //
+
+    if (TraceFileName != NULL) {
+        if (!MakeTraceOpen(&MakeContext, TraceFileName)) {
+            Result = EXIT_FAILURE;
+            goto Cleanup;
+        }
+    }
+
+    //
+    //  If requested, create threads to hash dependencies.  These use the
+    //  same number of threads as child processes.
     //
 
-    if (MakeContext.NumberProcesses > 64) {
-        MakeContext.NumberProcesses = 64;
+    if (HashContents) {
+        if (!MakeCreateContentHashPool(&MakeContext)) {
+            Result = EXIT_FAILURE;
+            goto Cleanup;
+        }
     }
 
     //
@@ -730,6 +828,15 @@ ENTRYPOINT(
         MakeLoadPreprocessorCacheEntries(&MakeContext, &FullFileName);
     }
 
+    //
+    //  When using a build state, load the state of files from the previous
+    //  run and use the change journal to determine which are unchanged.
+    //
+
+    if (MakeContext.BuildState != NULL) {
+        MakeLoadBuildState(&MakeContext, &FullFileName);
+    }
+
     hStream = CreateFile(FullFileName.StartOfString, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
     if (hStream == INVALID_HANDLE_VALUE) {
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("No makefile found\n"));
@@ -757,11 +864,20 @@ ENTRYPOINT(
     MakeFindInferenceRulesForScope(MakeContext.RootScope);
 
     //
-    //  Determine the tasks to execute
+    //  Determine the tasks to execute.  Targets are probed by enumerating
+    //  the directories containing them where possible.  This isn't done
+    //  when recording build state, which needs each file's ID.
     //
 
     QueryPerformanceCounter(&StartTime);
 
+    if (MakeContext.BuildState == NULL) {
+        if (!MakeInitializeDirectoryCache(&MakeContext)) {
+            Result = EXIT_FAILURE;
+            goto Cleanup;
+        }
+    }
+
     //
     //  Scan through command line arguments again, this time looking for
     //  targets to execute.
@@ -812,8 +928,20 @@ ENTRYPOINT(
         }
     }
 
+    //
+    //  Recipes are about to modify the files that were enumerated, so from
+    //  here any target that still needs probing is opened individually.
+    //
+
+    MakeDeleteDirectoryCache(&MakeContext);
+    MakeDeleteContentHashPool(&MakeContext);
+
     QueryPerformanceCounter(&EndTime);
     MakeContext.TimeBuildingGraph = EndTime.QuadPart - StartTime.QuadPart;
+    if (MakeContext.Trace != NULL) {
+        YoriLibConstantString(&Arg, _T("Build graph"));
+        MakeTraceComplete(&MakeContext, _T("phase"), &Arg, 0, &StartTime, &EndTime);
+    }
 
     //
     //  Execute the tasks
@@ -827,6 +955,14 @@ ENTRYPOINT(
     }
     QueryPerformanceCounter(&EndTime);
     MakeContext.TimeInExecute = EndTime.QuadPart - StartTime.QuadPart;
+    if (MakeContext.Trace != NULL) {
+        YoriLibConstantString(&Arg, _T("Execute"));
+        MakeTraceComplete(&MakeContext, _T("phase"), &Arg, 0, &StartTime, &EndTime);
+    }
+
+    if (MakeContext.PerfDisplay) {
+        MakeDisplayCriticalPath(&MakeContext);
+    }
 
 
     Result = EXIT_SUCCESS;
@@ -835,8 +971,14 @@ Cleanup:
 
     QueryPerformanceCounter(&StartTime);
 
+    MakeDeleteContentHashPool(&MakeContext);
     MakeDeleteInlineFiles(&MakeContext);
     MakeCleanupTemporaryDirectories(&MakeContext);
+    if (MakeContext.JobIdsAllocated != NULL) {
+        YoriLibFree(MakeContext.JobIdsAllocated);
+        MakeContext.JobIdsAllocated = NULL;
+        MakeContext.TempDirectoriesCreated = NULL;
+    }
 
     ASSERT(MakeContext.ActiveScope == MakeContext.RootScope ||
            MakeContext.ActiveScope == NULL);
@@ -845,9 +987,7 @@ Cleanup:
         MakeContext.RootScope = NULL;
     }
 
-    MakeSlabCleanup(&MakeContext.TargetAllocator);
-    MakeSlabCleanup(&MakeContext.DependencyAllocator);
-
+    MakeDeleteDirectoryCache(&MakeContext);
     MakeDeleteAllTargets(&MakeContext);
 
     if (MakeContext.Targets != NULL) {
@@ -855,7 +995,11 @@ Cleanup:
     }
 
     MakeDeleteAllScopes(&MakeContext);
+    YoriLibCleanupPool(&MakeContext.TargetAllocator);
+    YoriLibCleanupPool(&MakeContext.DependencyAllocator);
     MakeSaveAndDeleteAllPreprocessorCacheEntries(&MakeContext, &FullFileName);
+    MakeSaveAndDeleteBuildState(&MakeContext, &FullFileName);
+    MakeTraceClose(&MakeContext);
 
     YoriLibFreeStringContents(&FullFileName);
 
@@ -877,12 +1021,20 @@ Cleanup:
 
     if (MakeContext.PerfDisplay && Result == EXIT_SUCCESS) {
         LARGE_INTEGER Frequency;
+        LONGLONG IdlePercent;
         QueryPerformanceFrequency(&Frequency);
+        IdlePercent = 0;
         MakeContext.TimeInPreprocessor = MakeContext.TimeInPreprocessor - MakeContext.TimeInPreprocessorCreateProcess;
 
         MakeContext.TimeInPreprocessorCreateProcess = MakeContext.TimeInPreprocessorCreateProcess * 1000 / Frequency.QuadPart;
         MakeContext.TimeInPreprocessor = MakeContext.TimeInPreprocessor * 1000 / Frequency.QuadPart;
         MakeContext.TimeBuildingGraph = MakeContext.TimeBuildingGraph * 1000 / Frequency.QuadPart;
+        if (MakeContext.TimeInExecute > 0) {
+            IdlePercent = 100 - (LONGLONG)(MakeContext.RecipeTimeTotal * 100 / (MakeContext.TimeInExecute * MakeContext.NumberProcesses));
+            if (IdlePercent < 0) {
+                IdlePercent = 0;
+            }
+        }
         MakeContext.TimeInExecute = MakeContext.TimeInExecute * 1000 / Frequency.QuadPart;
         MakeContext.TimeInCleanup = MakeContext.TimeInCleanup * 1000 / Frequency.QuadPart;
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("\n"));
@@ -890,7 +1042,26 @@ Cleanup:
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Time in preprocessor: %lli ms\n"), MakeContext.TimeInPreprocessor);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Time building graph: %lli ms\n"), MakeContext.TimeBuildingGraph);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Time executing commands: %lli ms\n"), MakeContext.TimeInExecute);
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Idle child process slots while executing: %lli%%\n"), IdlePercent);
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Time cleaning up: %lli ms\n"), MakeContext.TimeInCleanup);
+        if (MakeContext.ChildWaitCount > 0) {
+            MakeContext.ChildWaitLatencyTotal = MakeContext.ChildWaitLatencyTotal * 1000000 / Frequency.QuadPart;
+            MakeContext.ChildWaitLatencyMax = MakeContext.ChildWaitLatencyMax * 1000000 / Frequency.QuadPart;
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Average child completion latency: %lli us\n"), MakeContext.ChildWaitLatencyTotal / MakeContext.ChildWaitCount);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Maximum child completion latency: %lli us\n"), MakeContext.ChildWaitLatencyMax);
+        }
+        if (MakeContext.TargetsFromBuildState > 0 || MakeContext.TargetsProbed > 0) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Files opened: %i, files from build state: %i\n"), MakeContext.TargetsProbed, MakeContext.TargetsFromBuildState);
+        }
+        if (MakeContext.TargetsFromDirectoryCache > 0) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Files from enumerating %i directories: %i\n"), MakeContext.DirectoriesEnumerated, MakeContext.TargetsFromDirectoryCache);
+        }
+        if (MakeContext.VariableCacheHits > 0 || MakeContext.VariableCacheMisses > 0) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Variable cache hits: %i, misses: %i, stale: %i, case mismatches: %i, entries: %i\n"), MakeContext.VariableCacheHits, MakeContext.VariableCacheMisses, MakeContext.VariableCacheStale, MakeContext.VariableCacheCaseMismatches, MakeContext.VariableCacheEntries);
+        }
+        if (HashContents) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Files hashed: %i, newer dependencies with unchanged contents: %i\n"), MakeContext.FilesHashed, MakeContext.DependenciesUnchangedByContent);
+        }
 
 #if MAKE_DEBUG_PERF
         YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Number dependency allocs: %i\n"), MakeContext.AllocDependency);
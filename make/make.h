@@ -60,58 +60,424 @@
 
 
 /**
- A structure to record information about how to allocate fixed sized
- structures in groups.
+ A record of the exitcode of a preprocessor command.  These can be recorded
+ to save time on a subsequent compilation.
+ */
+typedef struct _MAKE_PREPROC_EXEC_CACHE_ENTRY {
+
+    /**
+     The hash entry of the preprocessor command.  This includes the command
+     string as well as a hash of the environment and variable state so that
+     if a different compilation environment is used, the cache will not
+     match.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     A list of all entries to facilitate efficient teardown.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The exit code of the preprocessor command.
+     */
+    DWORD ExitCode;
+
+} MAKE_PREPROC_EXEC_CACHE_ENTRY, *PMAKE_PREPROC_EXEC_CACHE_ENTRY;
+
+/**
+ A preprocessor command that has been launched before the parser reached the
+ line containing it, so that it can execute concurrently with parsing and
+ other commands.
  */
-typedef struct _MAKE_SLAB_ALLOC {
+typedef struct _MAKE_PREPROC_PROBE {
+
+    /**
+     The list entry for this probe within MAKE_PREPROC_PREFETCH::Probes.
+     Probes are in the order they occur within the makefile.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The line number within the makefile containing the command.  If the
+     command spans multiple lines, this refers to the final line.
+     */
+    DWORD LineNumber;
+
+    /**
+     The lowest number not in use by any other outstanding probe when this
+     probe was launched.  This is used to display concurrent probes in a
+     trace.
+     */
+    DWORD Slot;
 
     /**
-     The size of each element.
+     The time the probe was launched.
      */
-    DWORD ElementSize;
+    LARGE_INTEGER LaunchTime;
+
+    /**
+     The command to execute, after expanding variables at the time the
+     probe was launched.  If this does not match the command when the
+     parser reaches the line, the result is discarded.
+     */
+    YORI_STRING Cmd;
 
     /**
-     The number of elements allocated from the heap in the buffer array
-     below.
+     The parsed form of the command.
      */
-    DWORD NumberAllocatedFromSystem;
+    YORI_LIBSH_CMD_CONTEXT CmdContext;
 
     /**
-     The number of elements from the buffer array below that have been used.
+     The execution plan for the command.  The final process in the plan
+     determines the exit code.
      */
-    DWORD NumberAllocatedToCaller;
+    YORI_LIBSH_EXEC_PLAN ExecPlan;
 
     /**
-     An array of elements.
+     The result of launching the command.  This is the exit code of the
+     command if the final process in the plan could not be launched.
      */
-    PVOID Buffer;
-} MAKE_SLAB_ALLOC, *PMAKE_SLAB_ALLOC;
+    DWORD ExitCode;
+} MAKE_PREPROC_PROBE, *PMAKE_PREPROC_PROBE;
 
 /**
- A record of the exitcode of a preprocessor command.  These can be recorded
- to save time on a subsequent compilation.
+ State used to scan ahead of the parser within a single makefile looking for
+ preprocessor commands to launch ahead of the parser.  The scan tracks
+ conditional nesting so that it only launches commands the parser is certain
+ to execute, and suspends itself when it reaches a line whose effect it
+ cannot predict until the parser has processed that line.
  */
-typedef struct _MAKE_PREPROC_EXEC_CACHE_ENTRY {
+typedef struct _MAKE_PREPROC_PREFETCH {
 
     /**
-     The hash entry of the preprocessor command.  This includes the command
-     string as well as a hash of the environment and variable state so that
-     if a different compilation environment is used, the cache will not
-     match.
+     Pointer to the make context.
+     */
+    struct _MAKE_CONTEXT *MakeContext;
+
+    /**
+     The file name of the makefile.
+     */
+    PYORI_STRING FileName;
+
+    /**
+     A handle to the makefile used for scanning ahead.  This is distinct
+     from the handle used by the parser.  NULL if the file has not been
+     opened yet.
+     */
+    HANDLE hSource;
+
+    /**
+     The line reading context for hSource.
+     */
+    PVOID LineContext;
+
+    /**
+     A buffer for the most recently read line.
+     */
+    YORI_STRING LineString;
+
+    /**
+     A buffer used to join lines that span multiple physical lines.
+     */
+    YORI_STRING JoinedLine;
+
+    /**
+     A buffer used to expand variables in lines found while scanning.
+     */
+    YORI_STRING ExpandedLine;
+
+    /**
+     The line number most recently read by the parser.
+     */
+    DWORD ParserLineNumber;
+
+    /**
+     The number of lines the parser has completely processed.  When this is
+     equal to ParserLineNumber, the parser is between lines and the state of
+     the scope describes every line up to and including this one.
+     */
+    DWORD ParserLinesComplete;
+
+    /**
+     The line number most recently read when scanning ahead.
+     */
+    DWORD ScanLineNumber;
+
+    /**
+     If Suspended is TRUE, the line that the parser must complete before
+     scanning can resume.
+     */
+    DWORD ResumeLineNumber;
+
+    /**
+     The number of conditional blocks the scan has entered beyond the
+     parser's conditional nesting level when the scan last resumed.  Lines
+     within these blocks may or may not be executed by the parser, so
+     commands within them are not launched.
+     */
+    DWORD ScanNestingLevel;
+
+    /**
+     The names of variables assigned within conditional blocks the scan has
+     skipped since it last resumed.  A later condition referring to one of
+     these may expand differently when the parser reaches it.
+     */
+    YORI_STRING_ARRAY SkippedAssignments;
+
+    /**
+     A list of probes which have been launched and not yet consumed by the
+     parser, in makefile order.
+     */
+    YORI_LIST_ENTRY Probes;
+
+    /**
+     The number of elements in Probes.
+     */
+    DWORD NumberProbes;
+
+    /**
+     Set to TRUE once scanning ahead has reached the end of the makefile or
+     encountered an error.
+     */
+    BOOLEAN ScanComplete;
+
+    /**
+     Set to TRUE if scanning is waiting for the parser to complete
+     ResumeLineNumber.  When it resumes, the conditional state of the scan
+     is reinitialized from the parser's state.
+     */
+    BOOLEAN Suspended;
+
+    /**
+     Set to TRUE if lines at ScanNestingLevel zero will be executed by the
+     parser, or FALSE if they are within a conditional block that the parser
+     is skipping.
+     */
+    BOOLEAN ScanExecutionEnabled;
+} MAKE_PREPROC_PREFETCH, *PMAKE_PREPROC_PREFETCH;
+
+/**
+ Information about a volume containing files recorded in the build state.
+ If the volume has a change journal, the build state records the point in
+ the journal at which the state was captured, so that a later run can find
+ every file that has changed since.
+ */
+typedef struct _MAKE_BUILD_STATE_VOLUME {
+
+    /**
+     The list entry for this volume within MAKE_CONTEXT::BuildStateVolumes.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     A path which can be used to open the volume.
+     */
+    YORI_STRING VolumePath;
+
+    /**
+     The serial number of the volume.  Build state entries refer to their
+     volume by serial number.
+     */
+    DWORD VolumeSerialNumber;
+
+    /**
+     TRUE if the change journal for this volume was queried successfully
+     during this run, so UsnJournalId and NextUsn refer to the current
+     journal.
+     */
+    BOOLEAN JournalValid;
+
+    /**
+     The identifier of the change journal on this volume.
+     */
+    DWORDLONG UsnJournalId;
+
+    /**
+     The next USN in the journal.  When loaded, this refers to the point at
+     which the previous build state was captured.  After validation, this
+     refers to the point at which this run started using the volume; any
+     change after that will have a larger USN.
+     */
+    DWORDLONG NextUsn;
+} MAKE_BUILD_STATE_VOLUME, *PMAKE_BUILD_STATE_VOLUME;
+
+/**
+ Information about a target recorded in the build state.  This may describe
+ the state of the file, the time taken to build it, or both.
+ */
+typedef struct _MAKE_BUILD_STATE_ENTRY {
+
+    /**
+     The hash entry for this file within MAKE_CONTEXT::BuildState.  The key
+     is the full path to the target.
      */
     YORI_HASH_ENTRY HashEntry;
 
     /**
-     A list of all entries to facilitate efficient teardown.
+     The list entry for this file within MAKE_CONTEXT::BuildStateList.
      */
     YORI_LIST_ENTRY ListEntry;
 
     /**
-     The exit code of the preprocessor command.
+     The serial number of the volume containing this file.
      */
-    DWORD ExitCode;
+    DWORD VolumeSerialNumber;
 
-} MAKE_PREPROC_EXEC_CACHE_ENTRY, *PMAKE_PREPROC_EXEC_CACHE_ENTRY;
+    /**
+     The file ID of this file, which corresponds to the file reference
+     number in change journal records.
+     */
+    DWORDLONG FileId;
+
+    /**
+     The time the file was last modified, as it would be recorded in
+     MAKE_TARGET::ModifiedTime.
+     */
+    LARGE_INTEGER ModifiedTime;
+
+    /**
+     The time taken to execute the recipe for this target when it was last
+     built, in milliseconds.  Zero if not known.
+     */
+    DWORD RecipeDuration;
+
+    /**
+     A hash of the contents of the file.  Only meaningful if
+     ContentHashPresent is TRUE.
+     */
+    DWORDLONG ContentHash;
+
+    /**
+     The modification time of the file when ContentHash was calculated.  If
+     the file has the same modification time, the hash is assumed to still
+     describe it.
+     */
+    LARGE_INTEGER HashedModifiedTime;
+
+    /**
+     The modification time of the file when its contents last changed.
+     This is older than HashedModifiedTime if the file has been written
+     with identical contents.
+     */
+    LARGE_INTEGER ContentModifiedTime;
+
+    /**
+     TRUE if VolumeSerialNumber, FileId and ModifiedTime describe the file.
+     */
+    BOOLEAN FileIdPresent;
+
+    /**
+     TRUE if ContentHash, HashedModifiedTime and ContentModifiedTime
+     describe the file.
+     */
+    BOOLEAN ContentHashPresent;
+
+    /**
+     TRUE if the change journal has confirmed that this file has not changed
+     since the entry was recorded, so it can be used instead of opening the
+     file.
+     */
+    BOOLEAN Trusted;
+} MAKE_BUILD_STATE_ENTRY, *PMAKE_BUILD_STATE_ENTRY;
+
+/**
+ A directory containing targets.  Once enough targets within a directory
+ have been probed, the directory is enumerated and the results are used
+ for every other target within it.
+ */
+typedef struct _MAKE_DIRECTORY_CACHE_DIR {
+
+    /**
+     The hash entry for this directory within MAKE_CONTEXT::DirectoryCache.
+     The key is the full path to the directory.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The list entry for this directory within
+     MAKE_CONTEXT::DirectoryCacheList.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The number of targets within this directory that have been probed.
+     */
+    DWORD ProbeCount;
+
+    /**
+     TRUE if the directory has been enumerated, so every file within it is
+     in MAKE_CONTEXT::DirectoryCacheFiles.
+     */
+    BOOLEAN Enumerated;
+
+    /**
+     TRUE if the directory could not be enumerated, so targets within it
+     must be probed individually.
+     */
+    BOOLEAN EnumerateFailed;
+} MAKE_DIRECTORY_CACHE_DIR, *PMAKE_DIRECTORY_CACHE_DIR;
+
+/**
+ A file found by enumerating a directory.
+ */
+typedef struct _MAKE_DIRECTORY_CACHE_FILE {
+
+    /**
+     The hash entry for this file within MAKE_CONTEXT::DirectoryCacheFiles.
+     The key is the full path to the file.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The list entry for this file within
+     MAKE_CONTEXT::DirectoryCacheFileList.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The time the file was last modified, as it would be recorded in
+     MAKE_TARGET::ModifiedTime.
+     */
+    LARGE_INTEGER ModifiedTime;
+} MAKE_DIRECTORY_CACHE_FILE, *PMAKE_DIRECTORY_CACHE_FILE;
+
+/**
+ State used to record a timeline of the build as a file of trace events in
+ the format understood by chrome://tracing and Perfetto.  Events are written
+ as they complete.  Thread zero refers to the ymake process itself, and
+ threads from one onwards refer to slots for concurrently executing child
+ processes.
+ */
+typedef struct _MAKE_TRACE {
+
+    /**
+     A handle to the trace file.
+     */
+    HANDLE hFile;
+
+    /**
+     The performance counter value when the trace started.  Event times are
+     relative to this.
+     */
+    LARGE_INTEGER StartTime;
+
+    /**
+     The frequency of the performance counter.
+     */
+    LARGE_INTEGER Frequency;
+
+    /**
+     A buffer used to escape strings before writing them to the trace.
+     */
+    YORI_STRING EscapedString;
+
+    /**
+     TRUE if an event has been written to the trace, meaning any further
+     event needs a separator.
+     */
+    BOOLEAN EventWritten;
+} MAKE_TRACE, *PMAKE_TRACE;
 
 /**
  The name of the default target within a scope.  This refers to the first
@@ -121,6 +487,13 @@ typedef struct _MAKE_PREPROC_EXEC_CACHE_ENTRY {
  */
 #define MAKE_DEFAULT_SCOPE_TARGET_NAME _T(":Default")
 
+/**
+ The maximum number of child processes to execute concurrently.  Beyond
+ MAXIMUM_WAIT_OBJECTS, each additional MAXIMUM_WAIT_OBJECTS - 1 processes
+ require an additional wait thread.
+ */
+#define MAKE_MAX_PROCESSES 1024
+
 /**
  Indicates the state of parsing, indicating whether the next line corresponds
  to an inline file, a recipe, or only rules are acceptable.
@@ -199,6 +572,13 @@ typedef struct _MAKE_SCOPE_CONTEXT {
      */
     YORI_STRING CurrentIncludeDirectory;
 
+    /**
+     Information about preprocessor commands being launched ahead of the
+     parser for the makefile currently being parsed.  NULL if no makefile
+     is being parsed or commands are not being launched ahead.
+     */
+    PMAKE_PREPROC_PREFETCH ActivePrefetch;
+
     /**
      A hash table of known variables, used for regular lookup during
      line evaluation.
@@ -210,6 +590,27 @@ typedef struct _MAKE_SCOPE_CONTEXT {
      */
     YORI_LIST_ENTRY VariableList;
 
+    /**
+     A hash table of variable references that have been resolved in this
+     scope, including any search and replace expression, so that repeated
+     references to unchanged variables do not need to search each parent
+     scope or repeat the replacement.
+     */
+    PYORI_HASH_TABLE VariableCache;
+
+    /**
+     A list of resolved variable references, used to facilitate bulk
+     delete.
+     */
+    YORI_LIST_ENTRY VariableCacheList;
+
+    /**
+     An arena that variables and resolved variable references for this
+     scope are allocated from.  These are only deleted when the scope is
+     deleted, so they are released together.
+     */
+    YORI_LIB_ARENA Arena;
+
     /**
      A list of known inference rules.
      */
@@ -315,6 +716,38 @@ typedef struct _MAKE_VARIABLE {
 
 } MAKE_VARIABLE, *PMAKE_VARIABLE;
 
+/**
+ A variable reference that has been resolved within a scope.  This is only
+ valid while no variable has been set since it was resolved.
+ */
+typedef struct _MAKE_VARIABLE_CACHE_ENTRY {
+
+    /**
+     The hash entry for the reference.  Paired with
+     MAKE_SCOPE_CONTEXT::VariableCache.  The key is the text of the
+     reference, including any search and replace expression.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The list entry for the reference.  Paired with
+     MAKE_SCOPE_CONTEXT::VariableCacheList.
+     */
+    YORI_LIST_ENTRY ListEntry;
+
+    /**
+     The value of MAKE_CONTEXT::VariableGeneration when the reference was
+     resolved.
+     */
+    DWORD Generation;
+
+    /**
+     The resolved value of the reference.
+     */
+    YORI_STRING Value;
+
+} MAKE_VARIABLE_CACHE_ENTRY, *PMAKE_VARIABLE_CACHE_ENTRY;
+
 /**
  A fallback rule to transform files with one extension into another
  extension, often implying compilation.
@@ -589,8 +1022,161 @@ typedef struct _MAKE_TARGET {
      */
     YORI_LIST_ENTRY ExecCmds;
 
+    /**
+     The expected time to execute the recipe for this target, in
+     milliseconds.  This is based on the time taken when it was last built
+     if known.
+     */
+    DWORDLONG RecipeDuration;
+
+    /**
+     The expected time to execute the recipe for this target and the
+     longest chain of targets that depend on it, in milliseconds.  Ready
+     targets with the longest chain are launched first.
+     */
+    DWORDLONG CriticalPathCost;
+
+    /**
+     The time that the recipe for this target started executing.  Zero if
+     it has not started.
+     */
+    LARGE_INTEGER ExecuteStartTime;
+
+    /**
+     The time that the recipe for this target finished executing.  Zero if
+     it has not finished.
+     */
+    LARGE_INTEGER ExecuteEndTime;
+
+    /**
+     A request to hash the contents of this file which has not yet been
+     consumed.  NULL if no request is outstanding.
+     */
+    struct _MAKE_CONTENT_HASH_REQUEST *ContentHashRequest;
+
+    /**
+     The modification time of the file when its contents last changed.  Only
+     meaningful if ContentModifiedTimeKnown is TRUE.
+     */
+    LARGE_INTEGER ContentModifiedTime;
+
+    /**
+     TRUE if CriticalPathCost has been calculated.
+     */
+    BOOLEAN CriticalPathCalculated;
+
+    /**
+     TRUE if ContentModifiedTime has been determined.
+     */
+    BOOLEAN ContentModifiedTimeKnown;
+
 } MAKE_TARGET, *PMAKE_TARGET;
 
+/**
+ A request to calculate a hash of the contents of a target file.  Requests
+ are processed by a pool of threads so that files can be read concurrently
+ while dependencies are evaluated.
+ */
+typedef struct _MAKE_CONTENT_HASH_REQUEST {
+
+    /**
+     The list entry for this request within
+     MAKE_CONTENT_HASH_POOL::PendingList while it is waiting to be processed.
+     Protected by MAKE_CONTENT_HASH_POOL::Mutex.
+     */
+    YORI_LIST_ENTRY PendingListEntry;
+
+    /**
+     The list entry for this request within
+     MAKE_CONTENT_HASH_POOL::RequestList.  Only used by the main thread.
+     */
+    YORI_LIST_ENTRY RequestListEntry;
+
+    /**
+     The target whose file is being hashed.
+     */
+    PMAKE_TARGET Target;
+
+    /**
+     The hash of the file contents.  Only meaningful if Succeeded is TRUE.
+     */
+    DWORDLONG Hash;
+
+    /**
+     Set to TRUE once the request has been processed.
+     */
+    LONG Complete;
+
+    /**
+     TRUE if the file was read and Hash is valid.
+     */
+    BOOLEAN Succeeded;
+
+    /**
+     TRUE if the request has been removed from the pending list to be
+     processed.  Protected by MAKE_CONTENT_HASH_POOL::Mutex.
+     */
+    BOOLEAN Started;
+} MAKE_CONTENT_HASH_REQUEST, *PMAKE_CONTENT_HASH_REQUEST;
+
+/**
+ A pool of threads used to hash the contents of target files.
+ */
+typedef struct _MAKE_CONTENT_HASH_POOL {
+
+    /**
+     A list of requests which have not yet been picked up by a thread.
+     Protected by Mutex.
+     */
+    YORI_LIST_ENTRY PendingList;
+
+    /**
+     A list of every request that has not yet been consumed by the main
+     thread.
+     */
+    YORI_LIST_ENTRY RequestList;
+
+    /**
+     A mutex protecting PendingList.
+     */
+    HANDLE Mutex;
+
+    /**
+     An event signalled when requests are added to PendingList.
+     */
+    HANDLE WorkerWaitEvent;
+
+    /**
+     An event signalled when the threads should terminate.
+     */
+    HANDLE WorkerShutdownEvent;
+
+    /**
+     An event signalled whenever a thread completes a request.
+     */
+    HANDLE CompletionEvent;
+
+    /**
+     An array of thread handles.
+     */
+    PHANDLE Threads;
+
+    /**
+     The number of threads in the Threads array which have been created.
+     */
+    DWORD ThreadsAllocated;
+
+    /**
+     The maximum number of threads to create.
+     */
+    DWORD MaxThreads;
+
+    /**
+     A buffer used to read files on the main thread.
+     */
+    PUCHAR Buffer;
+} MAKE_CONTENT_HASH_POOL, *PMAKE_CONTENT_HASH_POOL;
+
 /**
  Information about an inline file.  An inline file is one generated by <<
  operators in a makefile.
@@ -637,14 +1223,14 @@ typedef struct _MAKE_CONTEXT {
     YORI_STRING ProcessCurrentDirectory;
 
     /**
-     An allocator used to preallocate and suballocate target structures.
+     A pool used to preallocate and suballocate target structures.
      */
-    MAKE_SLAB_ALLOC TargetAllocator;
+    YORI_LIB_POOL TargetAllocator;
 
     /**
-     An allocator used to preallocate and suballocate dependency structures.
+     A pool used to preallocate and suballocate dependency structures.
      */
-    MAKE_SLAB_ALLOC DependencyAllocator;
+    YORI_LIB_POOL DependencyAllocator;
 
     /**
      A hash table of scopes whose key is their directory.
@@ -707,6 +1293,57 @@ typedef struct _MAKE_CONTEXT {
      */
     YORI_LIST_ENTRY PreprocessorCacheList;
 
+    /**
+     A hash table of build state entries recording the state of target
+     files.  NULL if build state is not in use.
+     */
+    PYORI_HASH_TABLE BuildState;
+
+    /**
+     A list of build state entries, used to facilitate bulk delete.
+     */
+    YORI_LIST_ENTRY BuildStateList;
+
+    /**
+     A list of volumes containing files recorded in the build state.
+     */
+    YORI_LIST_ENTRY BuildStateVolumes;
+
+    /**
+     A hash table of directories containing targets, used to probe targets
+     by enumerating directories.  NULL if targets should be probed
+     individually.
+     */
+    PYORI_HASH_TABLE DirectoryCache;
+
+    /**
+     A hash table of files found by enumerating directories.
+     */
+    PYORI_HASH_TABLE DirectoryCacheFiles;
+
+    /**
+     A list of directories in DirectoryCache, used to facilitate bulk
+     delete.
+     */
+    YORI_LIST_ENTRY DirectoryCacheList;
+
+    /**
+     A list of files in DirectoryCacheFiles, used to facilitate bulk delete.
+     */
+    YORI_LIST_ENTRY DirectoryCacheFileList;
+
+    /**
+     Trace state if a timeline of the build is being recorded, or NULL if
+     it is not.
+     */
+    PMAKE_TRACE Trace;
+
+    /**
+     A pool of threads used to hash the contents of dependencies.  NULL if
+     rebuild decisions are based on timestamps alone.
+     */
+    PMAKE_CONTENT_HASH_POOL ContentHashPool;
+
     /**
      Allocations used to generate files to look for when determining which
      inference rules to apply.  Because these are very temporary, they are
@@ -724,14 +1361,17 @@ typedef struct _MAKE_CONTEXT {
     YORI_STRING TempPath;
 
     /**
-     A bitmask representing which job IDs have been allocated.
+     An array of NumberProcesses elements indicating which job IDs have been
+     allocated.
      */
-    DWORDLONG JobIdsAllocated;
+    PBOOLEAN JobIdsAllocated;
 
     /**
-     A bitmask representing temporary directories which have been created.
+     An array of NumberProcesses elements indicating which temporary
+     directories have been created.  This is part of the same allocation as
+     JobIdsAllocated.
      */
-    DWORDLONG TempDirectoriesCreated;
+    PBOOLEAN TempDirectoriesCreated;
 
     /**
      The time taken to execute processes as part of preprocessor commands.
@@ -758,6 +1398,103 @@ typedef struct _MAKE_CONTEXT {
      */
     DWORDLONG TimeInCleanup;
 
+    /**
+     The total time between a child process completion being observed and
+     the completion being processed, in performance counter units.
+     */
+    DWORDLONG ChildWaitLatencyTotal;
+
+    /**
+     The longest time between a child process completion being observed and
+     the completion being processed, in performance counter units.
+     */
+    DWORDLONG ChildWaitLatencyMax;
+
+    /**
+     The number of child process completions included in
+     ChildWaitLatencyTotal.
+     */
+    DWORD ChildWaitCount;
+
+    /**
+     The number of targets whose state was determined by opening the file.
+     */
+    DWORD TargetsProbed;
+
+    /**
+     The number of targets whose state was determined from the build state
+     without opening the file.
+     */
+    DWORD TargetsFromBuildState;
+
+    /**
+     The number of targets whose state was determined by enumerating the
+     directory containing them.
+     */
+    DWORD TargetsFromDirectoryCache;
+
+    /**
+     The number of files whose contents were hashed.
+     */
+    DWORD FilesHashed;
+
+    /**
+     The number of dependencies which were newer than a target but had
+     unchanged contents, so did not cause the target to be rebuilt.
+     */
+    DWORD DependenciesUnchangedByContent;
+
+    /**
+     The number of directories enumerated to determine the state of
+     targets.
+     */
+    DWORD DirectoriesEnumerated;
+
+    /**
+     Incremented whenever a variable is set in any scope.  Resolved
+     variable references from an earlier generation are stale.
+     */
+    DWORD VariableGeneration;
+
+    /**
+     The number of variable references that were resolved from
+     MAKE_SCOPE_CONTEXT::VariableCache.
+     */
+    DWORD VariableCacheHits;
+
+    /**
+     The number of variable references that were not found in
+     MAKE_SCOPE_CONTEXT::VariableCache.
+     */
+    DWORD VariableCacheMisses;
+
+    /**
+     The number of variable references that were found in
+     MAKE_SCOPE_CONTEXT::VariableCache but could not be used because a
+     variable had been set since they were resolved.
+     */
+    DWORD VariableCacheStale;
+
+    /**
+     The number of variable references that were found in
+     MAKE_SCOPE_CONTEXT::VariableCache but could not be used because the
+     cached reference differs in case.
+     */
+    DWORD VariableCacheCaseMismatches;
+
+    /**
+     The number of resolved variable references added to
+     MAKE_SCOPE_CONTEXT::VariableCache across all scopes.
+     */
+    DWORD VariableCacheEntries;
+
+    /**
+     The total time spent executing recipes across all child processes, in
+     units of the performance counter.  Used to determine how well child
+     process slots were utilized.
+     */
+    DWORDLONG RecipeTimeTotal;
+
     /**
      The number of inference rule allocations.
      */
@@ -790,8 +1527,9 @@ typedef struct _MAKE_CONTEXT {
 
     /**
      The number of child processes to execute concurrently.  This defaults
-     to the number of logical processors, but is limited to 64 due to
-     WaitForMultipleObjects.
+     to the number of logical processors plus one.  If this is larger than
+     WaitForMultipleObjects can wait for, child processes are waited for by
+     a set of wait threads.
      */
     YORI_ALLOC_SIZE_T NumberProcesses;
 
@@ -838,24 +1576,6 @@ typedef struct _MAKE_CONTEXT {
 
 } MAKE_CONTEXT, *PMAKE_CONTEXT;
 
-// *** ALLOC.C ***
-
-PVOID
-MakeSlabAlloc(
-    __in PMAKE_SLAB_ALLOC Alloc,
-    __in YORI_ALLOC_SIZE_T SizeInBytes
-    );
-
-VOID
-MakeSlabFree(
-    __in PVOID Ptr
-    );
-
-VOID
-MakeSlabCleanup(
-    __in PMAKE_SLAB_ALLOC Alloc
-    );
-
 // *** VAR.C ***
 
 BOOLEAN
@@ -906,6 +1626,11 @@ MakeShExecuteInProc(
     __in PYORI_LIBSH_SINGLE_EXEC_CONTEXT ExecContext
     );
 
+BOOLEAN
+MakeShIsBuiltinCmdCompatible(
+    __inout PYORI_LIBSH_SINGLE_EXEC_CONTEXT ExecContext
+    );
+
 DWORD
 MakeShExecExecPlan(
     __in PYORI_LIBSH_EXEC_PLAN ExecPlan,
@@ -950,6 +1675,140 @@ MakeDeleteInlineFiles(
     __in PMAKE_CONTEXT MakeContext
     );
 
+// *** STATE.C ***
+
+VOID
+MakeLoadBuildState(
+    __inout PMAKE_CONTEXT MakeContext,
+    __in PYORI_STRING MakeFileName
+    );
+
+VOID
+MakeSaveAndDeleteBuildState(
+    __inout PMAKE_CONTEXT MakeContext,
+    __in PYORI_STRING MakeFileName
+    );
+
+__success(return)
+BOOLEAN
+MakeGetTargetFromBuildState(
+    __in PMAKE_CONTEXT MakeContext,
+    __inout PMAKE_TARGET Target
+    );
+
+VOID
+MakeUpdateBuildStateForTarget(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_TARGET Target,
+    __in HANDLE FileHandle,
+    __inout LPBY_HANDLE_FILE_INFORMATION FileInfo
+    );
+
+DWORD
+MakeGetBuildStateRecipeDuration(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_TARGET Target
+    );
+
+VOID
+MakeSetBuildStateRecipeDuration(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_TARGET Target,
+    __in DWORD RecipeDuration
+    );
+
+__success(return)
+BOOLEAN
+MakeGetBuildStateContentHash(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_TARGET Target,
+    __out PDWORDLONG ContentHash,
+    __out PLARGE_INTEGER HashedModifiedTime,
+    __out PLARGE_INTEGER ContentModifiedTime
+    );
+
+VOID
+MakeSetBuildStateContentHash(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_TARGET Target,
+    __in DWORDLONG ContentHash,
+    __in PLARGE_INTEGER ContentModifiedTime
+    );
+
+// *** CONTENT.C ***
+
+BOOLEAN
+MakeCreateContentHashPool(
+    __inout PMAKE_CONTEXT MakeContext
+    );
+
+VOID
+MakeDeleteContentHashPool(
+    __inout PMAKE_CONTEXT MakeContext
+    );
+
+VOID
+MakeQueueContentHash(
+    __in PMAKE_CONTEXT MakeContext,
+    __inout PMAKE_TARGET Target
+    );
+
+LONGLONG
+MakeGetContentModifiedTime(
+    __in PMAKE_CONTEXT MakeContext,
+    __inout PMAKE_TARGET Target
+    );
+
+// *** PROBE.C ***
+
+BOOLEAN
+MakeInitializeDirectoryCache(
+    __inout PMAKE_CONTEXT MakeContext
+    );
+
+VOID
+MakeDeleteDirectoryCache(
+    __inout PMAKE_CONTEXT MakeContext
+    );
+
+__success(return)
+BOOLEAN
+MakeGetTargetFromDirectoryCache(
+    __in PMAKE_CONTEXT MakeContext,
+    __inout PMAKE_TARGET Target
+    );
+
+// *** TRACE.C ***
+
+BOOLEAN
+MakeTraceOpen(
+    __inout PMAKE_CONTEXT MakeContext,
+    __in PYORI_STRING FileName
+    );
+
+VOID
+MakeTraceComplete(
+    __in PMAKE_CONTEXT MakeContext,
+    __in LPCTSTR Category,
+    __in PYORI_STRING Name,
+    __in DWORD ThreadId,
+    __in PLARGE_INTEGER StartTime,
+    __in PLARGE_INTEGER EndTime
+    );
+
+VOID
+MakeTraceInstant(
+    __in PMAKE_CONTEXT MakeContext,
+    __in LPCTSTR Category,
+    __in PYORI_STRING Name,
+    __in DWORD ThreadId
+    );
+
+VOID
+MakeTraceClose(
+    __inout PMAKE_CONTEXT MakeContext
+    );
+
 // *** SCOPE.C ***
 
 PMAKE_SCOPE_CONTEXT
@@ -1070,3 +1929,8 @@ BOOLEAN
 MakeExecuteRequiredTargets(
     __in PMAKE_CONTEXT MakeContext
     );
+
+VOID
+MakeDisplayCriticalPath(
+    __in PMAKE_CONTEXT MakeContext
+    );
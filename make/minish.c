@@ -240,6 +240,175 @@ Cleanup:
     return ExitCode;
 }
 
+/**
+ A description of a builtin command which is also a CMD command, describing
+ which forms of the command can be executed in process while behaving the
+ same way as CMD.
+ */
+typedef struct _MAKE_SH_CMD_COMPAT {
+
+    /**
+     The name of the command.
+     */
+    LPCTSTR CommandName;
+
+    /**
+     A CMD option which has no effect on the builtin, and is removed before
+     executing the builtin.  NULL if no option can be removed.
+     */
+    LPCTSTR IgnoredOption;
+
+    /**
+     Characters which cause an argument to be interpreted differently by
+     CMD and the builtin.  These are wildcards, which may behave differently
+     when nothing matches, Yori expansions such as {a,b} and [a-z], and
+     COPY's concatenation syntax.
+     */
+    LPCTSTR UnsupportedChars;
+
+    /**
+     TRUE if each argument must refer to an existing file which is not a
+     directory.  This is used for erase, because CMD's erase succeeds if a
+     file is not found and prompts before deleting a directory's contents.
+     */
+    BOOLEAN FilesMustExist;
+
+    /**
+     TRUE if the first argument must refer to an existing file which is not
+     a directory.  This is used for copy, because CMD's copy copies the
+     files within a directory source but not its subdirectories.
+     */
+    BOOLEAN SourceMustBeFile;
+} MAKE_SH_CMD_COMPAT, *PMAKE_SH_CMD_COMPAT;
+
+/**
+ The set of builtin commands which are also CMD commands.  Builtins not in
+ this list are executed in process unconditionally.
+ */
+CONST MAKE_SH_CMD_COMPAT MakeShCmdCompat[] = {
+    {_T("COPY"),   _T("y"),  _T("+[{"),  FALSE, TRUE},
+    {_T("DEL"),    _T("q"),  _T("*?[{"), TRUE,  FALSE},
+    {_T("ERASE"),  _T("q"),  _T("*?[{"), TRUE,  FALSE}
+};
+
+/**
+ Determine whether a builtin command can be executed in process while
+ behaving the same way as CMD would when executing the same command.  If
+ this returns FALSE, the caller is expected to fall back to creating a
+ process.  If this returns TRUE, CMD options which have no effect on the
+ builtin may have been removed from the command.  Relative paths are
+ resolved against the current directory, so the caller is expected to have
+ set the current directory that the builtin will execute in.
+
+ @param ExecContext Pointer to the command to check.
+
+ @return TRUE to indicate the builtin can be executed in process, FALSE if
+         a process should be created.
+ */
+BOOLEAN
+MakeShIsBuiltinCmdCompatible(
+    __inout PYORI_LIBSH_SINGLE_EXEC_CONTEXT ExecContext
+    )
+{
+    PYORI_LIBSH_CMD_CONTEXT CmdContext;
+    CONST MAKE_SH_CMD_COMPAT *Compat;
+    YORI_ALLOC_SIZE_T Index;
+    YORI_ALLOC_SIZE_T FileCount;
+    DWORD CharIndex;
+    YORI_STRING Arg;
+    YORI_STRING FullPath;
+    DWORD Attributes;
+
+    CmdContext = &ExecContext->CmdToExec;
+    ASSERT(CmdContext->ArgC > 0);
+
+    Compat = NULL;
+    for (Index = 0; Index < sizeof(MakeShCmdCompat)/sizeof(MakeShCmdCompat[0]); Index++) {
+        if (YoriLibCompareStringLitIns(&CmdContext->ArgV[0], MakeShCmdCompat[Index].CommandName) == 0) {
+            Compat = &MakeShCmdCompat[Index];
+            break;
+        }
+    }
+
+    if (Compat == NULL) {
+        return TRUE;
+    }
+
+    //
+    //  Check every argument before modifying anything, so that if the
+    //  command needs to be executed by CMD it is unchanged.
+    //
+
+    FileCount = 0;
+    for (Index = 1; Index < CmdContext->ArgC; Index++) {
+        if (YoriLibIsCommandLineOption(&CmdContext->ArgV[Index], &Arg)) {
+            if (Compat->IgnoredOption == NULL ||
+                YoriLibCompareStringLitIns(&Arg, Compat->IgnoredOption) != 0) {
+
+                return FALSE;
+            }
+            continue;
+        }
+
+        for (CharIndex = 0; Compat->UnsupportedChars[CharIndex] != '\0'; CharIndex++) {
+            if (YoriLibFindLeftMostCharacter(&CmdContext->ArgV[Index], Compat->UnsupportedChars[CharIndex]) != NULL) {
+                return FALSE;
+            }
+        }
+
+        if (Compat->FilesMustExist) {
+            YoriLibInitEmptyString(&FullPath);
+            if (!YoriLibUserStringToSingleFilePath(&CmdContext->ArgV[Index], TRUE, &FullPath)) {
+                return FALSE;
+            }
+            Attributes = GetFileAttributes(FullPath.StartOfString);
+            YoriLibFreeStringContents(&FullPath);
+            if (Attributes == (DWORD)-1 ||
+                (Attributes & (FILE_ATTRIBUTE_DIRECTORY | FILE_ATTRIBUTE_READONLY)) != 0) {
+
+                return FALSE;
+            }
+        } else if (Compat->SourceMustBeFile && FileCount == 0) {
+            YoriLibInitEmptyString(&FullPath);
+            if (!YoriLibUserStringToSingleFilePath(&CmdContext->ArgV[Index], TRUE, &FullPath)) {
+                return FALSE;
+            }
+            Attributes = GetFileAttributes(FullPath.StartOfString);
+            YoriLibFreeStringContents(&FullPath);
+            if (Attributes == (DWORD)-1 ||
+                (Attributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+
+                return FALSE;
+            }
+        }
+
+        FileCount++;
+    }
+
+    if (FileCount == 0) {
+        return FALSE;
+    }
+
+    //
+    //  Remove any options that have no effect on the builtin.  The only
+    //  options remaining at this point are the ignored option.
+    //
+
+    Index = 1;
+    while (Index < CmdContext->ArgC) {
+        if (YoriLibIsCommandLineOption(&CmdContext->ArgV[Index], &Arg)) {
+            YoriLibFreeStringContents(&CmdContext->ArgV[Index]);
+            memmove(&CmdContext->ArgV[Index], &CmdContext->ArgV[Index + 1], (CmdContext->ArgC - Index - 1) * sizeof(YORI_STRING));
+            memmove(&CmdContext->ArgContexts[Index], &CmdContext->ArgContexts[Index + 1], (CmdContext->ArgC - Index - 1) * sizeof(YORI_LIBSH_ARG_CONTEXT));
+            CmdContext->ArgC--;
+        } else {
+            Index++;
+        }
+    }
+
+    return TRUE;
+}
+
 /**
  Cancel an exec plan.  This is invoked after the user hits Ctrl+C and attempts
  to terminate all outstanding processes associated with the request.
@@ -343,7 +512,7 @@ MakeShExecExecPlan(
 
         ExitCode = 255;
         Callback = YoriLibShLookupBuiltinByName(&ExecContext->CmdToExec.ArgV[0]);
-        if (Callback != NULL) {
+        if (Callback != NULL && MakeShIsBuiltinCmdCompatible(ExecContext)) {
             ExitCode = MakeShExecuteInProc(Callback->BuiltInFn, ExecContext);
         } else {
             YoriLibInitEmptyString(&FoundInPath);
@@ -1023,6 +1023,707 @@ MakeAddToPreprocessorCache(
     YoriLibFreeStringContents(&Key);
 }
 
+/**
+ Initialize the state used to launch preprocessor commands ahead of the
+ parser for a makefile.
+
+ @param Prefetch Pointer to the prefetch state to initialize.
+
+ @param MakeContext Pointer to the make context.
+
+ @param FileName Pointer to the file name of the makefile.  This is expected
+        to remain valid until the prefetch state is cleaned up.
+ */
+VOID
+MakeInitializePreprocessorPrefetch(
+    __out PMAKE_PREPROC_PREFETCH Prefetch,
+    __in PMAKE_CONTEXT MakeContext,
+    __in PYORI_STRING FileName
+    )
+{
+    ZeroMemory(Prefetch, sizeof(MAKE_PREPROC_PREFETCH));
+    Prefetch->MakeContext = MakeContext;
+    Prefetch->FileName = FileName;
+    YoriLibInitEmptyString(&Prefetch->LineString);
+    YoriLibInitEmptyString(&Prefetch->JoinedLine);
+    YoriLibInitEmptyString(&Prefetch->ExpandedLine);
+    YoriLibInitializeListHead(&Prefetch->Probes);
+    YoriStringArrayInitialize(&Prefetch->SkippedAssignments);
+
+    //
+    //  Scanning starts suspended so that its conditional state is taken
+    //  from the parser before the first line is read.
+    //
+
+    Prefetch->Suspended = TRUE;
+}
+
+/**
+ Wait for a preprocessor command that was launched ahead of the parser to
+ complete and return its exit code.
+
+ @param Prefetch Pointer to the prefetch state.
+
+ @param Probe Pointer to the probe to wait for.
+
+ @return The exit code of the command.
+ */
+DWORD
+MakeWaitForPreprocessorProbe(
+    __in PMAKE_PREPROC_PREFETCH Prefetch,
+    __in PMAKE_PREPROC_PROBE Probe
+    )
+{
+    PYORI_LIBSH_SINGLE_EXEC_CONTEXT ExecContext;
+    LARGE_INTEGER EndTime;
+    DWORD ExitCode;
+
+    ExecContext = Probe->ExecPlan.FirstCmd;
+    while (ExecContext->NextProgram != NULL) {
+        ExecContext = ExecContext->NextProgram;
+    }
+
+    if (ExecContext->hProcess == NULL) {
+        return Probe->ExitCode;
+    }
+
+    ExitCode = 255;
+    WaitForSingleObject(ExecContext->hProcess, INFINITE);
+    GetExitCodeProcess(ExecContext->hProcess, &ExitCode);
+
+    //
+    //  The time the wait completes may be well after the process completed,
+    //  but the process has completed by then, so this is the best available
+    //  without waiting on another thread.
+    //
+
+    if (Prefetch->MakeContext->Trace != NULL) {
+        QueryPerformanceCounter(&EndTime);
+        MakeTraceComplete(Prefetch->MakeContext, _T("probe"), &Probe->Cmd, Probe->Slot + 1, &Probe->LaunchTime, &EndTime);
+    }
+
+    return ExitCode;
+}
+
+/**
+ Remove a probe from the list of outstanding probes and free it.  The probe
+ must have completed execution.
+
+ @param Prefetch Pointer to the prefetch state.
+
+ @param Probe Pointer to the probe to free.
+ */
+VOID
+MakeFreePreprocessorProbe(
+    __inout PMAKE_PREPROC_PREFETCH Prefetch,
+    __in PMAKE_PREPROC_PROBE Probe
+    )
+{
+    YoriLibRemoveListItem(&Probe->ListEntry);
+    Prefetch->NumberProbes--;
+    YoriLibShFreeExecPlan(&Probe->ExecPlan);
+    YoriLibShFreeCmdContext(&Probe->CmdContext);
+    YoriLibFreeStringContents(&Probe->Cmd);
+    YoriLibFree(Probe);
+}
+
+/**
+ Wait for any outstanding preprocessor commands launched ahead of the parser
+ and free all state associated with launching them.
+
+ @param Prefetch Pointer to the prefetch state.
+ */
+VOID
+MakeCleanupPreprocessorPrefetch(
+    __inout PMAKE_PREPROC_PREFETCH Prefetch
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PMAKE_PREPROC_PROBE Probe;
+
+    ListEntry = YoriLibGetNextListEntry(&Prefetch->Probes, NULL);
+    while (ListEntry != NULL) {
+        Probe = CONTAINING_RECORD(ListEntry, MAKE_PREPROC_PROBE, ListEntry);
+        MakeWaitForPreprocessorProbe(Prefetch, Probe);
+        MakeFreePreprocessorProbe(Prefetch, Probe);
+        ListEntry = YoriLibGetNextListEntry(&Prefetch->Probes, NULL);
+    }
+
+    if (Prefetch->LineContext != NULL) {
+        YoriLibLineReadCloseOrCache(Prefetch->LineContext);
+        Prefetch->LineContext = NULL;
+    }
+
+    if (Prefetch->hSource != NULL) {
+        CloseHandle(Prefetch->hSource);
+        Prefetch->hSource = NULL;
+    }
+
+    YoriLibFreeStringContents(&Prefetch->LineString);
+    YoriLibFreeStringContents(&Prefetch->JoinedLine);
+    YoriLibFreeStringContents(&Prefetch->ExpandedLine);
+    YoriStringArrayCleanup(&Prefetch->SkippedAssignments);
+}
+
+/**
+ Launch a preprocessor command ahead of the parser reaching it.  Commands
+ are only launched if every program is an external program and programs
+ are only connected via pipes, so the exit code is the exit code of the
+ final process.  Builtins execute on the calling thread and cannot be
+ launched asynchronously.  Commands that redirect to or from files are not
+ launched, because they may depend on or affect the output of an earlier
+ command.
+
+ @param ScopeContext Pointer to the scope context.
+
+ @param Prefetch Pointer to the prefetch state.
+
+ @param Cmd Pointer to the command to launch.
+
+ @return TRUE to indicate the command was launched or its result is already
+         available, FALSE if the command must be executed by the parser when
+         it reaches the line.
+ */
+BOOLEAN
+MakeLaunchPreprocessorProbe(
+    __in PMAKE_SCOPE_CONTEXT ScopeContext,
+    __inout PMAKE_PREPROC_PREFETCH Prefetch,
+    __in PYORI_STRING Cmd
+    )
+{
+    PMAKE_PREPROC_PROBE Probe;
+    PMAKE_PREPROC_PROBE OtherProbe;
+    PYORI_LIBSH_SINGLE_EXEC_CONTEXT ExecContext;
+    PYORI_LIST_ENTRY ListEntry;
+
+    //
+    //  If the same command is already outstanding for this line, there's
+    //  nothing to do.  If the result is already cached, there's no need to
+    //  launch anything either.
+    //
+
+    ListEntry = YoriLibGetNextListEntry(&Prefetch->Probes, NULL);
+    while (ListEntry != NULL) {
+        Probe = CONTAINING_RECORD(ListEntry, MAKE_PREPROC_PROBE, ListEntry);
+        if (Probe->LineNumber == Prefetch->ScanLineNumber &&
+            YoriLibCompareString(&Probe->Cmd, Cmd) == 0) {
+
+            return TRUE;
+        }
+        ListEntry = YoriLibGetNextListEntry(&Prefetch->Probes, ListEntry);
+    }
+
+    if (ScopeContext->MakeContext->PreprocessorCache != NULL &&
+        MakeLookupPreprocessorCache(ScopeContext, Cmd) != NULL) {
+
+        return TRUE;
+    }
+
+    Probe = YoriLibMalloc(sizeof(MAKE_PREPROC_PROBE));
+    if (Probe == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(Probe, sizeof(MAKE_PREPROC_PROBE));
+
+    if (!YoriLibAllocateString(&Probe->Cmd, Cmd->LengthInChars + 1)) {
+        YoriLibFree(Probe);
+        return FALSE;
+    }
+
+    memcpy(Probe->Cmd.StartOfString, Cmd->StartOfString, Cmd->LengthInChars * sizeof(TCHAR));
+    Probe->Cmd.StartOfString[Cmd->LengthInChars] = '\0';
+    Probe->Cmd.LengthInChars = Cmd->LengthInChars;
+
+    if (!YoriLibShParseCmdlineToCmdContext(&Probe->Cmd, 0, &Probe->CmdContext)) {
+        YoriLibFreeStringContents(&Probe->Cmd);
+        YoriLibFree(Probe);
+        return FALSE;
+    }
+
+    if (!YoriLibShParseCmdContextToExecPlan(&Probe->CmdContext, &Probe->ExecPlan, NULL, NULL, NULL, NULL)) {
+        YoriLibShFreeCmdContext(&Probe->CmdContext);
+        YoriLibFreeStringContents(&Probe->Cmd);
+        YoriLibFree(Probe);
+        return FALSE;
+    }
+
+    ExecContext = Probe->ExecPlan.FirstCmd;
+    while (ExecContext != NULL) {
+        if (ExecContext->CmdToExec.ArgC == 0 ||
+            YoriLibShLookupBuiltinByName(&ExecContext->CmdToExec.ArgV[0]) != NULL ||
+            (ExecContext->NextProgram != NULL && ExecContext->NextProgramType != NextProgramExecConcurrently) ||
+            ExecContext->StdInType == StdInTypeFile ||
+            ExecContext->StdOutType == StdOutTypeOverwrite ||
+            ExecContext->StdOutType == StdOutTypeAppend ||
+            ExecContext->StdErrType == StdErrTypeOverwrite ||
+            ExecContext->StdErrType == StdErrTypeAppend) {
+
+            break;
+        }
+
+        //
+        //  Don't wait for the final process.  It will be waited for when
+        //  the parser reaches this line.
+        //
+
+        if (ExecContext->NextProgram == NULL) {
+            ExecContext->WaitForCompletion = FALSE;
+        }
+        ExecContext = ExecContext->NextProgram;
+    }
+
+    if (ExecContext != NULL || Probe->ExecPlan.FirstCmd == NULL) {
+        YoriLibShFreeExecPlan(&Probe->ExecPlan);
+        YoriLibShFreeCmdContext(&Probe->CmdContext);
+        YoriLibFreeStringContents(&Probe->Cmd);
+        YoriLibFree(Probe);
+        return FALSE;
+    }
+
+#if MAKE_DEBUG_PREPROCESSOR_CREATEPROCESS
+    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("Launching preprocessor command ahead: %y\n"), &Probe->Cmd);
+#endif
+
+    //
+    //  Find the lowest slot not used by another outstanding probe.  This is
+    //  only used to display concurrent probes on separate rows of a trace.
+    //
+
+    Probe->Slot = 0;
+    ListEntry = YoriLibGetNextListEntry(&Prefetch->Probes, NULL);
+    while (ListEntry != NULL) {
+        OtherProbe = CONTAINING_RECORD(ListEntry, MAKE_PREPROC_PROBE, ListEntry);
+        if (OtherProbe->Slot == Probe->Slot) {
+            Probe->Slot++;
+            ListEntry = YoriLibGetNextListEntry(&Prefetch->Probes, NULL);
+        } else {
+            ListEntry = YoriLibGetNextListEntry(&Prefetch->Probes, ListEntry);
+        }
+    }
+
+    Probe->LineNumber = Prefetch->ScanLineNumber;
+    QueryPerformanceCounter(&Probe->LaunchTime);
+    Probe->ExitCode = MakeShExecExecPlan(&Probe->ExecPlan, NULL);
+
+    YoriLibAppendList(&Prefetch->Probes, &Probe->ListEntry);
+    Prefetch->NumberProbes++;
+
+    return TRUE;
+}
+
+/**
+ Suspend scanning ahead until the parser has completed a line.  When the
+ parser has completed the line, the scan resumes with conditional state
+ taken from the parser.
+
+ @param Prefetch Pointer to the prefetch state.
+
+ @param ResumeLineNumber The line that the parser must complete before
+        scanning resumes.
+ */
+VOID
+MakeSuspendPreprocessorPrefetch(
+    __inout PMAKE_PREPROC_PREFETCH Prefetch,
+    __in DWORD ResumeLineNumber
+    )
+{
+    Prefetch->Suspended = TRUE;
+    Prefetch->ResumeLineNumber = ResumeLineNumber;
+}
+
+/**
+ If a line in a makefile assigns a variable, return the name of the
+ variable.  This follows the same rules as MakeDetermineLineType, but
+ without depending on the parser's state.
+
+ @param Line Pointer to the line, which has had comments removed.
+
+ @param Variable On successful completion, updated to point to the name of
+        the variable within Line.
+
+ @return TRUE if the line assigns a variable, FALSE if it does not.
+ */
+__success(return)
+BOOLEAN
+MakePrefetchFindAssignedVariable(
+    __in PYORI_STRING Line,
+    __out PYORI_STRING Variable
+    )
+{
+    YORI_ALLOC_SIZE_T Index;
+    DWORD BraceDepth;
+
+    if (Line->LengthInChars == 0 ||
+        MakeIsCharWhitespace(Line->StartOfString[0])) {
+
+        return FALSE;
+    }
+
+    BraceDepth = 0;
+    for (Index = 0; Index < Line->LengthInChars; Index++) {
+        if (Line->StartOfString[Index] == '[') {
+            BraceDepth++;
+        } else if (Line->StartOfString[Index] == ']' && BraceDepth > 0) {
+            BraceDepth--;
+        }
+
+        if (BraceDepth == 0) {
+            if (Line->StartOfString[Index] == '=') {
+                YoriLibInitEmptyString(Variable);
+                Variable->StartOfString = Line->StartOfString;
+                Variable->LengthInChars = Index;
+                MakeTrimWhitespace(Variable);
+                return TRUE;
+            } else if (Line->StartOfString[Index] == ':') {
+                return FALSE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ Scan ahead of the parser in a makefile looking for preprocessor conditions
+ that execute commands, and launch those commands so they execute
+ concurrently.  The scan tracks conditional nesting relative to the parser,
+ and only launches commands in conditions that the parser is certain to
+ evaluate: commands within a conditional block whose condition is not yet
+ known are not launched.  When the scan reaches a line whose effect cannot
+ be predicted, such as a variable assignment or include that the parser will
+ execute, or a command that cannot be launched ahead, it suspends until the
+ parser has processed that line, and resumes with the parser's conditional
+ state.  Variables assigned within skipped blocks are remembered, and a
+ condition that refers to one suspends the scan rather than being launched
+ with a value that may be stale.  If the parser reaches the line and the
+ command matches, it consumes the result; otherwise the result is
+ discarded.  At most MakeContext->NumberProcesses commands are outstanding.
+
+ @param ScopeContext Pointer to the scope context.
+
+ @param Prefetch Pointer to the prefetch state.
+ */
+VOID
+MakePrefetchPreprocessorCommands(
+    __in PMAKE_SCOPE_CONTEXT ScopeContext,
+    __inout PMAKE_PREPROC_PREFETCH Prefetch
+    )
+{
+    MAKE_PREPROCESSOR_LINE_TYPE PreprocessorLineType;
+    YORI_STRING LineToProcess;
+    YORI_STRING Variable;
+    YORI_STRING Cmd;
+    YORI_ALLOC_SIZE_T Index;
+    BOOLEAN MoreLinesNeeded;
+    BOOLEAN ParserBetweenLines;
+
+    if (Prefetch->ScanComplete) {
+        return;
+    }
+
+    if (Prefetch->hSource == NULL) {
+        Prefetch->hSource = CreateFile(Prefetch->FileName->StartOfString, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+        if (Prefetch->hSource == INVALID_HANDLE_VALUE) {
+            Prefetch->hSource = NULL;
+            Prefetch->ScanComplete = TRUE;
+            return;
+        }
+    }
+
+    ParserBetweenLines = FALSE;
+    if (Prefetch->ParserLineNumber == Prefetch->ParserLinesComplete) {
+        ParserBetweenLines = TRUE;
+    }
+
+    //
+    //  If the parser has overtaken the scan, the scan's conditional state no
+    //  longer describes the parser, so wait until it can be reinitialized.
+    //
+
+    if (!Prefetch->Suspended &&
+        Prefetch->ScanLineNumber < Prefetch->ParserLinesComplete) {
+
+        MakeSuspendPreprocessorPrefetch(Prefetch, Prefetch->ParserLinesComplete);
+    }
+
+    //
+    //  The scan can only resume when the parser is between lines, because
+    //  that is the only time the parser's conditional state describes a
+    //  known line.  Skip any lines the parser has processed since the scan
+    //  was suspended, then take the conditional state from the parser.
+    //
+
+    if (Prefetch->Suspended) {
+        if (!ParserBetweenLines ||
+            Prefetch->ParserLinesComplete < Prefetch->ResumeLineNumber) {
+
+            return;
+        }
+
+        while (Prefetch->ScanLineNumber < Prefetch->ParserLinesComplete) {
+            if (!YoriLibReadLineToString(&Prefetch->LineString, &Prefetch->LineContext, Prefetch->hSource)) {
+                Prefetch->ScanComplete = TRUE;
+                return;
+            }
+            Prefetch->ScanLineNumber++;
+        }
+
+        Prefetch->JoinedLine.LengthInChars = 0;
+        Prefetch->ScanNestingLevel = 0;
+        Prefetch->ScanExecutionEnabled = FALSE;
+        if (ScopeContext->CurrentConditionalNestingLevel == ScopeContext->ActiveConditionalNestingLevel &&
+            ScopeContext->ActiveConditionalNestingLevelExecutionEnabled) {
+
+            Prefetch->ScanExecutionEnabled = TRUE;
+        }
+        YoriStringArrayCleanup(&Prefetch->SkippedAssignments);
+        Prefetch->Suspended = FALSE;
+    }
+
+    YoriLibInitEmptyString(&LineToProcess);
+    YoriLibInitEmptyString(&Cmd);
+
+    while (!Prefetch->Suspended &&
+           Prefetch->NumberProbes < ScopeContext->MakeContext->NumberProcesses) {
+
+        //
+        //  Never read a line the parser has started processing.  If the
+        //  parser is between lines, the next line is one it has not
+        //  started.
+        //
+
+        if (!ParserBetweenLines &&
+            Prefetch->ScanLineNumber < Prefetch->ParserLineNumber) {
+
+            MakeSuspendPreprocessorPrefetch(Prefetch, Prefetch->ParserLineNumber);
+            break;
+        }
+
+        if (!YoriLibReadLineToString(&Prefetch->LineString, &Prefetch->LineContext, Prefetch->hSource)) {
+            Prefetch->ScanComplete = TRUE;
+            break;
+        }
+        Prefetch->ScanLineNumber++;
+
+        //
+        //  Join lines in the same way as the parser, so that line numbers
+        //  refer to the final line of a joined line in both.
+        //
+
+        LineToProcess.StartOfString = Prefetch->LineString.StartOfString;
+        LineToProcess.LengthInChars = Prefetch->LineString.LengthInChars;
+        MakeTruncateComments(&LineToProcess);
+
+        MoreLinesNeeded = FALSE;
+        if (LineToProcess.LengthInChars > 0 && LineToProcess.StartOfString[LineToProcess.LengthInChars - 1] == '\\') {
+            MoreLinesNeeded = TRUE;
+        }
+
+        if (Prefetch->JoinedLine.LengthInChars > 0 || MoreLinesNeeded) {
+            MakeTrimWhitespace(&LineToProcess);
+            MakeJoinLines(&Prefetch->JoinedLine, &LineToProcess);
+            if (MoreLinesNeeded) {
+                continue;
+            }
+            LineToProcess.StartOfString = Prefetch->JoinedLine.StartOfString;
+            LineToProcess.LengthInChars = Prefetch->JoinedLine.LengthInChars;
+        }
+
+        //
+        //  A variable assignment that the parser will execute may change
+        //  how any later line expands, so wait for the parser.  One within
+        //  a skipped block may or may not execute, so remember it and
+        //  check conditions for references to it.
+        //
+
+        if (LineToProcess.LengthInChars == 0 ||
+            LineToProcess.StartOfString[0] != '!') {
+
+            if (MakePrefetchFindAssignedVariable(&LineToProcess, &Variable)) {
+                if (Prefetch->ScanNestingLevel == 0 && Prefetch->ScanExecutionEnabled) {
+                    MakeSuspendPreprocessorPrefetch(Prefetch, Prefetch->ScanLineNumber);
+                } else if (Prefetch->ScanNestingLevel > 0 &&
+                           Variable.LengthInChars > 0 &&
+                           !YoriStringArrayAddItems(&Prefetch->SkippedAssignments, &Variable, 1)) {
+
+                    MakeSuspendPreprocessorPrefetch(Prefetch, Prefetch->ScanLineNumber);
+                }
+            }
+            Prefetch->JoinedLine.LengthInChars = 0;
+            continue;
+        }
+
+        MakeTrimWhitespace(&LineToProcess);
+        if (!MakeExpandVariables(ScopeContext, NULL, &Prefetch->ExpandedLine, &LineToProcess, NULL)) {
+            MakeSuspendPreprocessorPrefetch(Prefetch, Prefetch->ScanLineNumber);
+            Prefetch->JoinedLine.LengthInChars = 0;
+            continue;
+        }
+
+        PreprocessorLineType = MakeDeterminePreprocessorLineType(&Prefetch->ExpandedLine, NULL);
+        switch(PreprocessorLineType) {
+            case MakePreprocessorLineTypeIf:
+            case MakePreprocessorLineTypeIfDef:
+            case MakePreprocessorLineTypeIfNDef:
+
+                //
+                //  A condition at the parser's level in a block the parser
+                //  is executing will be evaluated.  Its contents may or may
+                //  not be.
+                //
+
+                if (Prefetch->ScanNestingLevel == 0 &&
+                    Prefetch->ScanExecutionEnabled &&
+                    PreprocessorLineType == MakePreprocessorLineTypeIf) {
+
+                    if (Prefetch->SkippedAssignments.Count > 0 &&
+                        YoriLibFindFirstMatchSubstrIns(&LineToProcess, Prefetch->SkippedAssignments.Count, Prefetch->SkippedAssignments.Items, NULL) != NULL) {
+
+                        MakeSuspendPreprocessorPrefetch(Prefetch, Prefetch->ScanLineNumber);
+                        break;
+                    }
+
+                    //
+                    //  Launch each bracketed command in the condition.  The
+                    //  parser evaluates each of them in order, so if one
+                    //  cannot be launched, later ones may depend on it.
+                    //
+
+                    for (Index = 0; Index < Prefetch->ExpandedLine.LengthInChars; Index++) {
+                        if (Prefetch->ExpandedLine.StartOfString[Index] != '[') {
+                            continue;
+                        }
+
+                        Cmd.StartOfString = &Prefetch->ExpandedLine.StartOfString[Index + 1];
+                        for (Index = Index + 1; Index < Prefetch->ExpandedLine.LengthInChars; Index++) {
+                            if (Prefetch->ExpandedLine.StartOfString[Index] == ']') {
+                                break;
+                            }
+                        }
+
+                        if (Index == Prefetch->ExpandedLine.LengthInChars) {
+                            break;
+                        }
+
+                        Cmd.LengthInChars = (YORI_ALLOC_SIZE_T)(&Prefetch->ExpandedLine.StartOfString[Index] - Cmd.StartOfString);
+                        if (Cmd.LengthInChars > 0 &&
+                            !MakeLaunchPreprocessorProbe(ScopeContext, Prefetch, &Cmd)) {
+
+                            MakeSuspendPreprocessorPrefetch(Prefetch, Prefetch->ScanLineNumber);
+                            break;
+                        }
+                    }
+                }
+                Prefetch->ScanNestingLevel++;
+                break;
+
+            case MakePreprocessorLineTypeElse:
+            case MakePreprocessorLineTypeElseIf:
+            case MakePreprocessorLineTypeElseIfDef:
+            case MakePreprocessorLineTypeElseIfNDef:
+
+                //
+                //  If the parser is executing the current block, any later
+                //  block at the same level will be skipped.  If it is not,
+                //  it's not known whether this block will execute.
+                //
+
+                if (Prefetch->ScanNestingLevel == 0) {
+                    if (Prefetch->ScanExecutionEnabled) {
+                        Prefetch->ScanNestingLevel = 1;
+                    } else {
+                        MakeSuspendPreprocessorPrefetch(Prefetch, Prefetch->ScanLineNumber);
+                    }
+                }
+                break;
+
+            case MakePreprocessorLineTypeEndIf:
+
+                //
+                //  If the parser is executing the current block, the
+                //  enclosing block is executing also.
+                //
+
+                if (Prefetch->ScanNestingLevel > 0) {
+                    Prefetch->ScanNestingLevel--;
+                } else if (!Prefetch->ScanExecutionEnabled) {
+                    MakeSuspendPreprocessorPrefetch(Prefetch, Prefetch->ScanLineNumber);
+                }
+                break;
+
+            case MakePreprocessorLineTypeMessage:
+                break;
+
+            default:
+
+                //
+                //  Includes, undefines and errors change state in ways the
+                //  scan can't follow.
+                //
+
+                MakeSuspendPreprocessorPrefetch(Prefetch, Prefetch->ScanLineNumber);
+                break;
+        }
+
+        Prefetch->JoinedLine.LengthInChars = 0;
+    }
+}
+
+/**
+ Check whether a preprocessor command being executed by the parser has
+ already been launched ahead of the parser, and if so, wait for it and
+ return its result.  Any commands launched for lines the parser has already
+ passed were speculated incorrectly and are discarded.
+
+ @param Prefetch Pointer to the prefetch state.
+
+ @param Cmd Pointer to the command the parser is executing.
+
+ @param ExitCode On successful completion, updated to contain the exit code
+        of the command.
+
+ @return TRUE if the command had been launched ahead and its result has been
+         returned, FALSE if the command should be executed now.
+ */
+__success(return)
+BOOLEAN
+MakeConsumePreprocessorProbe(
+    __inout PMAKE_PREPROC_PREFETCH Prefetch,
+    __in PYORI_STRING Cmd,
+    __out PDWORD ExitCode
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_LIST_ENTRY NextEntry;
+    PMAKE_PREPROC_PROBE Probe;
+
+    ListEntry = YoriLibGetNextListEntry(&Prefetch->Probes, NULL);
+    while (ListEntry != NULL) {
+        Probe = CONTAINING_RECORD(ListEntry, MAKE_PREPROC_PROBE, ListEntry);
+        NextEntry = YoriLibGetNextListEntry(&Prefetch->Probes, ListEntry);
+
+        if (Probe->LineNumber > Prefetch->ParserLineNumber) {
+            break;
+        }
+
+        if (Probe->LineNumber == Prefetch->ParserLineNumber) {
+            if (YoriLibCompareString(&Probe->Cmd, Cmd) == 0) {
+                *ExitCode = MakeWaitForPreprocessorProbe(Prefetch, Probe);
+                MakeFreePreprocessorProbe(Prefetch, Probe);
+                return TRUE;
+            }
+        } else {
+            MakeWaitForPreprocessorProbe(Prefetch, Probe);
+            MakeFreePreprocessorProbe(Prefetch, Probe);
+        }
+
+        ListEntry = NextEntry;
+    }
+
+    return FALSE;
+}
+
 /**
  Execute a subcommand and capture the result.  Currently this is used to
  evaluate preprocessor if statements only.
@@ -1041,9 +1742,11 @@ MakeExecuteCommandCaptureExitCode(
     )
 {
     PMAKE_PREPROC_EXEC_CACHE_ENTRY Entry;
+    PMAKE_PREPROC_PREFETCH Prefetch;
     YORI_LIBSH_CMD_CONTEXT CmdContext;
     YORI_LIBSH_EXEC_PLAN ExecPlan;
     LARGE_INTEGER StartTime;
+    BOOLEAN Prefetched;
     LARGE_INTEGER EndTime;
     DWORD ExitCode;
 
@@ -1067,6 +1770,21 @@ MakeExecuteCommandCaptureExitCode(
         }
     }
 
+    //
+    //  If the command was launched ahead of the parser, use its result.
+    //  Either way, launch any commands in later lines so they can execute
+    //  while this one completes.
+    //
+
+    Prefetch = ScopeContext->ActivePrefetch;
+    if (Prefetch != NULL) {
+        Prefetched = MakeConsumePreprocessorProbe(Prefetch, Cmd, &ExitCode);
+        MakePrefetchPreprocessorCommands(ScopeContext, Prefetch);
+        if (Prefetched) {
+            goto AddToCache;
+        }
+    }
+
     if (!YoriLibShParseCmdlineToCmdContext(Cmd, 0, &CmdContext)) {
         goto Complete;
     }
@@ -1081,6 +1799,8 @@ MakeExecuteCommandCaptureExitCode(
     YoriLibShFreeExecPlan(&ExecPlan);
     YoriLibShFreeCmdContext(&CmdContext);
 
+AddToCache:
+
     if (ScopeContext->MakeContext->PreprocessorCache != NULL) {
         MakeAddToPreprocessorCache(ScopeContext, Cmd, ExitCode);
     }
@@ -1089,6 +1809,7 @@ Complete:
 
     QueryPerformanceCounter(&EndTime);
     ScopeContext->MakeContext->TimeInPreprocessorCreateProcess = ScopeContext->MakeContext->TimeInPreprocessorCreateProcess + EndTime.QuadPart - StartTime.QuadPart;
+    MakeTraceComplete(ScopeContext->MakeContext, _T("preprocessor"), Cmd, 0, &StartTime, &EndTime);
 #if MAKE_DEBUG_PREPROCESSOR_CREATEPROCESS
     YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("...took %lli\n"), EndTime.QuadPart - StartTime.QuadPart);
 #endif
@@ -2700,10 +3421,28 @@ MakeProcessStream(
     LPTSTR PrefixString;
     PMAKE_TARGET ActiveRecipeTarget = NULL;
     PMAKE_SCOPE_CONTEXT ScopeContext;
+    MAKE_PREPROC_PREFETCH Prefetch;
+    PMAKE_PREPROC_PREFETCH PreviousPrefetch;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER EndTime;
     DWORD LineNumber;
 
     ScopeContext = MakeContext->ActiveScope;
 
+    //
+    //  If multiple processes can execute concurrently, allow preprocessor
+    //  commands in this makefile to be launched ahead of the parser.
+    //
+
+    QueryPerformanceCounter(&StartTime);
+    MakeInitializePreprocessorPrefetch(&Prefetch, MakeContext, FileName);
+    PreviousPrefetch = ScopeContext->ActivePrefetch;
+    if (MakeContext->NumberProcesses > 1) {
+        ScopeContext->ActivePrefetch = &Prefetch;
+    } else {
+        ScopeContext->ActivePrefetch = NULL;
+    }
+
     YoriLibInitEmptyString(&LineString);
     YoriLibInitEmptyString(&JoinedLine);
     YoriLibInitEmptyString(&LineToProcess);
@@ -2716,10 +3455,23 @@ MakeProcessStream(
 
     while (TRUE) {
 
+        //
+        //  When the parser is between lines, let the scan resume if it was
+        //  waiting for the lines processed so far.
+        //
+
+        if (JoinedLine.LengthInChars == 0) {
+            Prefetch.ParserLinesComplete = LineNumber;
+            if (ScopeContext->ActivePrefetch == &Prefetch) {
+                MakePrefetchPreprocessorCommands(ScopeContext, &Prefetch);
+            }
+        }
+
         if (!YoriLibReadLineToString(&LineString, &LineContext, hSource)) {
             break;
         }
         LineNumber++;
+        Prefetch.ParserLineNumber = LineNumber;
 
         //
         //  Line might be:
@@ -2880,6 +3632,14 @@ MakeProcessStream(
     YoriLibFreeStringContents(&JoinedLine);
     YoriLibFreeStringContents(&ExpandedLine);
 
+    MakeCleanupPreprocessorPrefetch(&Prefetch);
+    ScopeContext->ActivePrefetch = PreviousPrefetch;
+
+    if (MakeContext->Trace != NULL) {
+        QueryPerformanceCounter(&EndTime);
+        MakeTraceComplete(MakeContext, _T("parse"), FileName, 0, &StartTime, &EndTime);
+    }
+
     return TRUE;
 }
 
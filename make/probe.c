@@ -0,0 +1,382 @@
+/**
+ * @file make/probe.c
+ *
+ * Yori shell make target probing by directory enumeration
+ *
+ * Copyright (c) 2020 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include <yorish.h>
+#include "make.h"
+
+/**
+ The number of targets within a directory that are probed individually
+ before the directory is enumerated.  A directory containing a single
+ target is cheaper to probe with a single open than to enumerate, which
+ matters for large directories such as compiler include directories.
+ */
+#define MAKE_DIRECTORY_CACHE_PROBE_THRESHOLD 2
+
+/**
+ The FindExInfoBasic information level, which omits short file names.
+ This is only supported on Windows 7 and above.
+ */
+#define MAKE_FIND_EX_INFO_BASIC 1
+
+/**
+ The FindExInfoStandard information level.
+ */
+#define MAKE_FIND_EX_INFO_STANDARD 0
+
+/**
+ The FindExSearchNameMatch search operation.
+ */
+#define MAKE_FIND_EX_SEARCH_NAME_MATCH 0
+
+/**
+ Prepare for targets to be probed by enumerating their directories.
+
+ @param MakeContext Pointer to the context.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOLEAN
+MakeInitializeDirectoryCache(
+    __inout PMAKE_CONTEXT MakeContext
+    )
+{
+    YoriLibInitializeListHead(&MakeContext->DirectoryCacheList);
+    YoriLibInitializeListHead(&MakeContext->DirectoryCacheFileList);
+
+    MakeContext->DirectoryCache = YoriLibAllocateHashTable(1000);
+    if (MakeContext->DirectoryCache == NULL) {
+        return FALSE;
+    }
+
+    MakeContext->DirectoryCacheFiles = YoriLibAllocateHashTable(4000);
+    if (MakeContext->DirectoryCacheFiles == NULL) {
+        YoriLibFreeEmptyHashTable(MakeContext->DirectoryCache);
+        MakeContext->DirectoryCache = NULL;
+        return FALSE;
+    }
+
+    YoriLibLoadKernel32Functions();
+    return TRUE;
+}
+
+/**
+ Free all directories and files found by enumeration.  After this point,
+ targets are probed individually.  This is done before any recipe executes,
+ since recipes modify the files that the enumeration describes.
+
+ @param MakeContext Pointer to the context.
+ */
+VOID
+MakeDeleteDirectoryCache(
+    __inout PMAKE_CONTEXT MakeContext
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PMAKE_DIRECTORY_CACHE_DIR Dir;
+    PMAKE_DIRECTORY_CACHE_FILE File;
+
+    if (MakeContext->DirectoryCache == NULL) {
+        return;
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&MakeContext->DirectoryCacheFileList, NULL);
+    while (ListEntry != NULL) {
+        File = CONTAINING_RECORD(ListEntry, MAKE_DIRECTORY_CACHE_FILE, ListEntry);
+        YoriLibRemoveListItem(&File->ListEntry);
+        YoriLibHashRemoveByEntry(&File->HashEntry);
+        YoriLibFree(File);
+        ListEntry = YoriLibGetNextListEntry(&MakeContext->DirectoryCacheFileList, NULL);
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&MakeContext->DirectoryCacheList, NULL);
+    while (ListEntry != NULL) {
+        Dir = CONTAINING_RECORD(ListEntry, MAKE_DIRECTORY_CACHE_DIR, ListEntry);
+        YoriLibRemoveListItem(&Dir->ListEntry);
+        YoriLibHashRemoveByEntry(&Dir->HashEntry);
+        YoriLibFree(Dir);
+        ListEntry = YoriLibGetNextListEntry(&MakeContext->DirectoryCacheList, NULL);
+    }
+
+    YoriLibFreeEmptyHashTable(MakeContext->DirectoryCacheFiles);
+    YoriLibFreeEmptyHashTable(MakeContext->DirectoryCache);
+    MakeContext->DirectoryCacheFiles = NULL;
+    MakeContext->DirectoryCache = NULL;
+}
+
+/**
+ Open a directory enumeration, using the cheapest form that the system
+ supports.
+
+ @param SearchPath Pointer to a NULL terminated search string.
+
+ @param FindData On successful completion, populated with the first entry.
+
+ @return Handle to the enumeration, or INVALID_HANDLE_VALUE on failure.
+ */
+HANDLE
+MakeFindFirstFile(
+    __in PYORI_STRING SearchPath,
+    __out PWIN32_FIND_DATA FindData
+    )
+{
+    HANDLE hFind;
+
+    if (DllKernel32.pFindFirstFileExW == NULL) {
+        return FindFirstFile(SearchPath->StartOfString, FindData);
+    }
+
+    //
+    //  Short names are not needed, and a larger buffer means fewer trips to
+    //  the file system, which matters on network shares.  Older systems
+    //  don't support either of these, so fall back to a regular query.
+    //
+
+    hFind = DllKernel32.pFindFirstFileExW(SearchPath->StartOfString,
+                                          MAKE_FIND_EX_INFO_BASIC,
+                                          FindData,
+                                          MAKE_FIND_EX_SEARCH_NAME_MATCH,
+                                          NULL,
+                                          FIND_FIRST_EX_LARGE_FETCH);
+
+    if (hFind == INVALID_HANDLE_VALUE && GetLastError() == ERROR_INVALID_PARAMETER) {
+        hFind = DllKernel32.pFindFirstFileExW(SearchPath->StartOfString,
+                                              MAKE_FIND_EX_INFO_STANDARD,
+                                              FindData,
+                                              MAKE_FIND_EX_SEARCH_NAME_MATCH,
+                                              NULL,
+                                              0);
+    }
+
+    return hFind;
+}
+
+/**
+ Enumerate a directory and record every file within it.
+
+ @param MakeContext Pointer to the context.
+
+ @param Dir Pointer to the directory to enumerate.
+
+ @return TRUE to indicate that the directory contents are known, FALSE if
+         targets within the directory must be probed individually.
+ */
+__success(return)
+BOOLEAN
+MakeEnumerateDirectoryCacheDir(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_DIRECTORY_CACHE_DIR Dir
+    )
+{
+    WIN32_FIND_DATA FindData;
+    YORI_STRING SearchPath;
+    YORI_STRING FileName;
+    PMAKE_DIRECTORY_CACHE_FILE File;
+    YORI_ALLOC_SIZE_T NameLength;
+    YORI_ALLOC_SIZE_T CharsNeeded;
+    HANDLE hFind;
+    DWORD Err;
+
+    if (!YoriLibAllocateString(&SearchPath, Dir->HashEntry.Key.LengthInChars + MAX_PATH + 2)) {
+        return FALSE;
+    }
+
+    SearchPath.LengthInChars = YoriLibSPrintf(SearchPath.StartOfString, _T("%y\\*"), &Dir->HashEntry.Key);
+
+    //
+    //  Paths this long would need to be escaped, and failure could then be
+    //  mistaken for a missing directory, so leave these to be opened.
+    //
+
+    if (SearchPath.LengthInChars >= MAX_PATH) {
+        YoriLibFreeStringContents(&SearchPath);
+        return FALSE;
+    }
+
+    hFind = MakeFindFirstFile(&SearchPath, &FindData);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        Err = GetLastError();
+        YoriLibFreeStringContents(&SearchPath);
+
+        //
+        //  If the directory doesn't exist, nothing within it exists either.
+        //  This is common for object directories before a clean build.
+        //
+
+        if (Err == ERROR_PATH_NOT_FOUND || Err == ERROR_FILE_NOT_FOUND) {
+            MakeContext->DirectoriesEnumerated++;
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    do {
+        NameLength = (YORI_ALLOC_SIZE_T)_tcslen(FindData.cFileName);
+        if ((NameLength == 1 && FindData.cFileName[0] == '.') ||
+            (NameLength == 2 && FindData.cFileName[0] == '.' && FindData.cFileName[1] == '.')) {
+
+            continue;
+        }
+
+        //
+        //  The full path to the file is the key used to find it.  The hash
+        //  table only refers to the key, so store it after the structure.
+        //
+
+        CharsNeeded = Dir->HashEntry.Key.LengthInChars + 1 + NameLength + 1;
+        File = YoriLibMalloc(sizeof(MAKE_DIRECTORY_CACHE_FILE) + CharsNeeded * sizeof(TCHAR));
+        if (File == NULL) {
+            FindClose(hFind);
+            YoriLibFreeStringContents(&SearchPath);
+            return FALSE;
+        }
+
+        if (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            File->ModifiedTime.QuadPart = 0;
+        } else {
+            File->ModifiedTime.LowPart = FindData.ftLastWriteTime.dwLowDateTime;
+            File->ModifiedTime.HighPart = FindData.ftLastWriteTime.dwHighDateTime;
+        }
+
+        YoriLibInitEmptyString(&FileName);
+        FileName.StartOfString = (LPTSTR)(File + 1);
+        FileName.LengthAllocated = CharsNeeded;
+        FileName.LengthInChars = YoriLibSPrintfS(FileName.StartOfString, FileName.LengthAllocated, _T("%y\\%s"), &Dir->HashEntry.Key, FindData.cFileName);
+        YoriLibHashInsertByKey(MakeContext->DirectoryCacheFiles, &FileName, File, &File->HashEntry);
+        YoriLibAppendList(&MakeContext->DirectoryCacheFileList, &File->ListEntry);
+
+    } while (FindNextFile(hFind, &FindData));
+
+    FindClose(hFind);
+    YoriLibFreeStringContents(&SearchPath);
+    MakeContext->DirectoriesEnumerated++;
+    return TRUE;
+}
+
+/**
+ Check whether the state of a target file can be determined by enumerating
+ the directory containing it.
+
+ @param MakeContext Pointer to the context.
+
+ @param Target Pointer to the target.  On successful completion, the
+        existence and modification time of the file are populated.
+
+ @return TRUE if the state of the target was determined, FALSE if the
+         target file needs to be opened.
+ */
+__success(return)
+BOOLEAN
+MakeGetTargetFromDirectoryCache(
+    __in PMAKE_CONTEXT MakeContext,
+    __inout PMAKE_TARGET Target
+    )
+{
+    YORI_STRING DirName;
+    YORI_STRING BaseName;
+    YORI_ALLOC_SIZE_T Index;
+    PYORI_HASH_ENTRY HashEntry;
+    PMAKE_DIRECTORY_CACHE_DIR Dir;
+    PMAKE_DIRECTORY_CACHE_FILE File;
+
+    if (MakeContext->DirectoryCache == NULL) {
+        return FALSE;
+    }
+
+    //
+    //  Split the target into the directory and the file name within it.
+    //
+
+    for (Index = Target->HashEntry.Key.LengthInChars; Index > 0; Index--) {
+        if (YoriLibIsSep(Target->HashEntry.Key.StartOfString[Index - 1])) {
+            break;
+        }
+    }
+
+    if (Index <= 1 || Index == Target->HashEntry.Key.LengthInChars) {
+        return FALSE;
+    }
+
+    YoriLibInitEmptyString(&DirName);
+    DirName.MemoryToFree = Target->HashEntry.Key.MemoryToFree;
+    DirName.StartOfString = Target->HashEntry.Key.StartOfString;
+    DirName.LengthInChars = Index - 1;
+
+    YoriLibInitEmptyString(&BaseName);
+    BaseName.StartOfString = &Target->HashEntry.Key.StartOfString[Index];
+    BaseName.LengthInChars = Target->HashEntry.Key.LengthInChars - Index;
+
+    HashEntry = YoriLibHashLookupByKey(MakeContext->DirectoryCache, &DirName);
+    if (HashEntry != NULL) {
+        Dir = HashEntry->Context;
+    } else {
+        Dir = YoriLibMalloc(sizeof(MAKE_DIRECTORY_CACHE_DIR));
+        if (Dir == NULL) {
+            return FALSE;
+        }
+        ZeroMemory(Dir, sizeof(MAKE_DIRECTORY_CACHE_DIR));
+        YoriLibHashInsertByKey(MakeContext->DirectoryCache, &DirName, Dir, &Dir->HashEntry);
+        YoriLibAppendList(&MakeContext->DirectoryCacheList, &Dir->ListEntry);
+    }
+
+    Dir->ProbeCount++;
+
+    if (!Dir->Enumerated) {
+        if (Dir->EnumerateFailed ||
+            Dir->ProbeCount < MAKE_DIRECTORY_CACHE_PROBE_THRESHOLD) {
+
+            return FALSE;
+        }
+
+        if (!MakeEnumerateDirectoryCacheDir(MakeContext, Dir)) {
+            Dir->EnumerateFailed = TRUE;
+            return FALSE;
+        }
+        Dir->Enumerated = TRUE;
+    }
+
+    HashEntry = YoriLibHashLookupByKey(MakeContext->DirectoryCacheFiles, &Target->HashEntry.Key);
+    if (HashEntry != NULL) {
+        File = HashEntry->Context;
+        Target->FileExists = TRUE;
+        Target->ModifiedTime.QuadPart = File->ModifiedTime.QuadPart;
+        return TRUE;
+    }
+
+    //
+    //  The enumeration only returns long file names, so if this target
+    //  could be a short name, it needs to be opened to check.
+    //
+
+    if (YoriLibFindLeftMostCharacter(&BaseName, '~') != NULL) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// vim:sw=4:ts=4:et:
@@ -58,6 +58,7 @@ MakeAllocateNewScope(
     ScopeContext->PreviousScope = NULL;
     ScopeContext->MakeContext = MakeContext;
     ScopeContext->ReferenceCount = 2; // One for the caller, one for the hash
+    YoriLibInitializeArena(&ScopeContext->Arena, 0);
 
     ScopeContext->Variables = YoriLibAllocateHashTable(1000);
     if (ScopeContext->Variables == NULL) {
@@ -65,6 +66,13 @@ MakeAllocateNewScope(
         return NULL;
     }
 
+    ScopeContext->VariableCache = YoriLibAllocateHashTable(1000);
+    if (ScopeContext->VariableCache == NULL) {
+        YoriLibFreeEmptyHashTable(ScopeContext->Variables);
+        YoriLibDereference(ScopeContext);
+        return NULL;
+    }
+
     //
     //  Copy and NULL terminate the directory
     //
@@ -82,6 +90,7 @@ MakeAllocateNewScope(
     YoriLibHashInsertByKey(MakeContext->Scopes, &ScopeContext->CurrentIncludeDirectory, ScopeContext, &ScopeContext->HashEntry);
 
     YoriLibInitializeListHead(&ScopeContext->VariableList);
+    YoriLibInitializeListHead(&ScopeContext->VariableCacheList);
     YoriLibInitializeListHead(&ScopeContext->InferenceRuleList);
     YoriLibInitializeListHead(&ScopeContext->InferenceRuleNeededList);
     YoriLibAppendList(&MakeContext->ScopesList, &ScopeContext->ListEntry);
@@ -89,6 +98,7 @@ MakeAllocateNewScope(
     ScopeContext->CurrentConditionalNestingLevel = 0;
     ScopeContext->ActiveConditionalNestingLevel = 0;
     ScopeContext->ParserState = MakeParserDefault;
+    ScopeContext->ActivePrefetch = NULL;
     ScopeContext->ActiveConditionalNestingLevelExecutionEnabled = TRUE;
     ScopeContext->ActiveConditionalNestingLevelExecutionOccurred = FALSE;
 
@@ -99,6 +109,9 @@ MakeAllocateNewScope(
         if (ScopeContext->Variables != NULL) {
             YoriLibFreeEmptyHashTable(ScopeContext->Variables);
         }
+        if (ScopeContext->VariableCache != NULL) {
+            YoriLibFreeEmptyHashTable(ScopeContext->VariableCache);
+        }
         YoriLibRemoveListItem(&ScopeContext->ListEntry);
         YoriLibHashRemoveByEntry(&ScopeContext->HashEntry);
         YoriLibFreeStringContents(&ScopeContext->CurrentIncludeDirectory);
@@ -144,6 +157,10 @@ MakeDereferenceScope(
         if (ScopeContext->Variables != NULL) {
             YoriLibFreeEmptyHashTable(ScopeContext->Variables);
         }
+        if (ScopeContext->VariableCache != NULL) {
+            YoriLibFreeEmptyHashTable(ScopeContext->VariableCache);
+        }
+        YoriLibCleanupArena(&ScopeContext->Arena);
 
         YoriLibDereference(ScopeContext);
     }
@@ -193,6 +210,7 @@ MakeActivateScope(
         ScopeContext->PreviousScope = MakeContext->ActiveScope;
         MakeReferenceScope(ScopeContext);
         MakeContext->ActiveScope = ScopeContext;
+        MakeTraceInstant(MakeContext, _T("scope"), &ScopeContext->HashEntry.Key, 0);
         *FoundExisting = TRUE;
         return TRUE;
     }
@@ -211,6 +229,7 @@ MakeActivateScope(
     ScopeContext->PreviousScope = MakeContext->ActiveScope;
     ScopeContext->ActiveConditionalNestingLevelExecutionEnabled = TRUE;
     MakeContext->ActiveScope = ScopeContext;
+    MakeTraceInstant(MakeContext, _T("scope"), &ScopeContext->HashEntry.Key, 0);
     return TRUE;
 }
 
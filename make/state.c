@@ -0,0 +1,1201 @@
+/**
+ * @file make/state.c
+ *
+ * Yori shell make persistent build state
+ *
+ * Copyright (c) 2020 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include <yorish.h>
+#include "make.h"
+
+/**
+ The size of the buffer used to read change journal records, in bytes.
+ */
+#define MAKE_BUILD_STATE_JOURNAL_BUFFER (64 * 1024)
+
+/**
+ A build state entry as it exists while the build state is being loaded.
+ Each entry is also indexed by volume and file ID so that change journal
+ records can be matched against it.
+ */
+typedef struct _MAKE_BUILD_STATE_LOAD_ENTRY {
+
+    /**
+     The hash entry for this file, keyed by volume serial number and file ID.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     Pointer to the build state entry.
+     */
+    PMAKE_BUILD_STATE_ENTRY Entry;
+
+    /**
+     Storage for the text of the key.  The hash table refers to this buffer
+     rather than copying it, so each entry needs its own.
+     */
+    TCHAR KeyBuffer[32];
+} MAKE_BUILD_STATE_LOAD_ENTRY, *PMAKE_BUILD_STATE_LOAD_ENTRY;
+
+/**
+ Generate the name of the build state file from the specified make file
+ name.
+
+ @param MakeFileName Pointer to the make file name.
+
+ @param StateFileName On successful completion, updated to contain a newly
+        allocated string referring to the file name of the build state file.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOLEAN
+MakeGetBuildStateFileName(
+    __in PYORI_STRING MakeFileName,
+    __out PYORI_STRING StateFileName
+    )
+{
+    YoriLibInitEmptyString(StateFileName);
+    if (MakeFileName->LengthInChars > 0) {
+        if (YoriLibAllocateString(StateFileName, MakeFileName->LengthInChars + sizeof(".ybs"))) {
+            StateFileName->LengthInChars = YoriLibSPrintf(StateFileName->StartOfString, _T("%y.ybs"), MakeFileName);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ Generate a key describing a file by its volume serial number and file ID.
+
+ @param VolumeSerialNumber The serial number of the volume.
+
+ @param FileId The file ID.
+
+ @param Key Pointer to a string to populate with the key.  This string is
+        expected to have space for at least 26 characters.
+ */
+VOID
+MakeBuildStateFileIdKey(
+    __in DWORD VolumeSerialNumber,
+    __in DWORDLONG FileId,
+    __inout PYORI_STRING Key
+    )
+{
+    Key->LengthInChars = YoriLibSPrintfS(Key->StartOfString, Key->LengthAllocated, _T("%08x:%016llx"), VolumeSerialNumber, FileId);
+}
+
+/**
+ Parse a hexadecimal field from a line in the build state file, followed by
+ a seperator.
+
+ @param Remaining Pointer to the remaining portion of the line.  On
+        successful completion, this is updated to point beyond the field and
+        its seperator.
+
+ @param Value On successful completion, updated to contain the value of the
+        field.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOLEAN
+MakeBuildStateParseField(
+    __inout PYORI_STRING Remaining,
+    __out PDWORDLONG Value
+    )
+{
+    YORI_MAX_SIGNED_T llTemp;
+    YORI_ALLOC_SIZE_T CharsConsumed;
+
+    if (!YoriLibStringToNumberBase(Remaining, 16, FALSE, &llTemp, &CharsConsumed) ||
+        CharsConsumed == 0 ||
+        CharsConsumed >= Remaining->LengthInChars ||
+        Remaining->StartOfString[CharsConsumed] != ':') {
+
+        return FALSE;
+    }
+
+    *Value = (DWORDLONG)llTemp;
+    Remaining->StartOfString = Remaining->StartOfString + CharsConsumed + 1;
+    Remaining->LengthInChars = Remaining->LengthInChars - CharsConsumed - 1;
+    return TRUE;
+}
+
+/**
+ Find a volume in the build state by its serial number.
+
+ @param MakeContext Pointer to the context.
+
+ @param VolumeSerialNumber The serial number of the volume to find.
+
+ @return Pointer to the volume, or NULL if it is not known.
+ */
+PMAKE_BUILD_STATE_VOLUME
+MakeFindBuildStateVolume(
+    __in PMAKE_CONTEXT MakeContext,
+    __in DWORD VolumeSerialNumber
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PMAKE_BUILD_STATE_VOLUME Volume;
+
+    ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateVolumes, NULL);
+    while (ListEntry != NULL) {
+        Volume = CONTAINING_RECORD(ListEntry, MAKE_BUILD_STATE_VOLUME, ListEntry);
+        if (Volume->VolumeSerialNumber == VolumeSerialNumber) {
+            return Volume;
+        }
+        ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateVolumes, ListEntry);
+    }
+
+    return NULL;
+}
+
+/**
+ Allocate a new volume and add it to the build state.
+
+ @param MakeContext Pointer to the context.
+
+ @param VolumeSerialNumber The serial number of the volume.
+
+ @param VolumePath Pointer to a path which can be used to open the volume.
+
+ @return Pointer to the volume, or NULL on allocation failure.
+ */
+PMAKE_BUILD_STATE_VOLUME
+MakeAllocateBuildStateVolume(
+    __in PMAKE_CONTEXT MakeContext,
+    __in DWORD VolumeSerialNumber,
+    __in PYORI_STRING VolumePath
+    )
+{
+    PMAKE_BUILD_STATE_VOLUME Volume;
+
+    Volume = YoriLibMalloc(sizeof(MAKE_BUILD_STATE_VOLUME));
+    if (Volume == NULL) {
+        return NULL;
+    }
+
+    ZeroMemory(Volume, sizeof(MAKE_BUILD_STATE_VOLUME));
+    if (!YoriLibAllocateString(&Volume->VolumePath, VolumePath->LengthInChars + 1)) {
+        YoriLibFree(Volume);
+        return NULL;
+    }
+
+    memcpy(Volume->VolumePath.StartOfString, VolumePath->StartOfString, VolumePath->LengthInChars * sizeof(TCHAR));
+    Volume->VolumePath.StartOfString[VolumePath->LengthInChars] = '\0';
+    Volume->VolumePath.LengthInChars = VolumePath->LengthInChars;
+    Volume->VolumeSerialNumber = VolumeSerialNumber;
+    YoriLibAppendList(&MakeContext->BuildStateVolumes, &Volume->ListEntry);
+    return Volume;
+}
+
+/**
+ Open a volume so that its change journal can be queried.
+
+ @param Volume Pointer to the volume to open.
+
+ @return Handle to the volume, or INVALID_HANDLE_VALUE on failure.
+ */
+HANDLE
+MakeOpenBuildStateVolume(
+    __in PMAKE_BUILD_STATE_VOLUME Volume
+    )
+{
+    return CreateFile(Volume->VolumePath.StartOfString,
+                      FILE_READ_ATTRIBUTES | FILE_READ_DATA,
+                      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                      NULL,
+                      OPEN_EXISTING,
+                      0,
+                      NULL);
+}
+
+/**
+ Query the state of the change journal on a volume.
+
+ @param VolumeHandle Handle to the volume.
+
+ @param JournalData On successful completion, populated with the state of
+        the change journal.
+
+ @return TRUE to indicate success, FALSE to indicate failure, including
+         if the volume has no change journal.
+ */
+__success(return)
+BOOLEAN
+MakeQueryBuildStateJournal(
+    __in HANDLE VolumeHandle,
+    __out PUSN_JOURNAL_DATA JournalData
+    )
+{
+    DWORD BytesReturned;
+
+    if (!DeviceIoControl(VolumeHandle,
+                         FSCTL_QUERY_USN_JOURNAL,
+                         NULL,
+                         0,
+                         JournalData,
+                         sizeof(USN_JOURNAL_DATA),
+                         &BytesReturned,
+                         NULL)) {
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ Read the change journal for a volume from the point where the build state
+ was previously captured until the present, and mark any file that changed
+ as untrusted.
+
+ @param FileIds Pointer to a hash table of MAKE_BUILD_STATE_LOAD_ENTRY
+        structures keyed by volume serial number and file ID.
+
+ @param Volume Pointer to the volume.  On entry, NextUsn refers to the point
+        where the build state was previously captured.
+
+ @param VolumeHandle Handle to the volume.
+
+ @param JournalData Pointer to the current state of the change journal.
+
+ @param Buffer Pointer to a buffer of MAKE_BUILD_STATE_JOURNAL_BUFFER bytes
+        to read records into.
+
+ @return TRUE to indicate that every change was found, FALSE if the changes
+         could not be determined.
+ */
+__success(return)
+BOOLEAN
+MakeReadBuildStateJournal(
+    __in PYORI_HASH_TABLE FileIds,
+    __in PMAKE_BUILD_STATE_VOLUME Volume,
+    __in HANDLE VolumeHandle,
+    __in PUSN_JOURNAL_DATA JournalData,
+    __out_bcount(MAKE_BUILD_STATE_JOURNAL_BUFFER) PUCHAR Buffer
+    )
+{
+    READ_USN_JOURNAL_DATA ReadData;
+    PUSN_RECORD Record;
+    PYORI_HASH_ENTRY HashEntry;
+    PMAKE_BUILD_STATE_LOAD_ENTRY LoadEntry;
+    YORI_STRING Key;
+    TCHAR KeyBuffer[32];
+    DWORD BytesReturned;
+    DWORD Offset;
+    LONGLONG NextUsn;
+
+    if (Volume->UsnJournalId != JournalData->UsnJournalID ||
+        Volume->NextUsn < JournalData->FirstUsn ||
+        Volume->NextUsn > JournalData->NextUsn) {
+
+        return FALSE;
+    }
+
+    YoriLibInitEmptyString(&Key);
+    Key.StartOfString = KeyBuffer;
+    Key.LengthAllocated = sizeof(KeyBuffer)/sizeof(KeyBuffer[0]);
+
+    ZeroMemory(&ReadData, sizeof(ReadData));
+    ReadData.StartUsn = (LONGLONG)Volume->NextUsn;
+    ReadData.ReasonMask = 0xFFFFFFFF;
+    ReadData.UsnJournalID = JournalData->UsnJournalID;
+
+    while ((DWORDLONG)ReadData.StartUsn < JournalData->NextUsn) {
+
+        //
+        //  Only supply the original version of the input structure, which
+        //  ends at UsnJournalID.  This means the file system will return
+        //  version 2 records, which have 64 bit file IDs matching the ones
+        //  returned from GetFileInformationByHandle.
+        //
+
+        if (!DeviceIoControl(VolumeHandle,
+                             FSCTL_READ_USN_JOURNAL,
+                             &ReadData,
+                             FIELD_OFFSET(READ_USN_JOURNAL_DATA, UsnJournalID) + sizeof(DWORDLONG),
+                             Buffer,
+                             MAKE_BUILD_STATE_JOURNAL_BUFFER,
+                             &BytesReturned,
+                             NULL)) {
+
+            return FALSE;
+        }
+
+        if (BytesReturned < sizeof(LONGLONG)) {
+            return FALSE;
+        }
+
+        NextUsn = *(PLONGLONG)Buffer;
+        Offset = sizeof(LONGLONG);
+        while (Offset + FIELD_OFFSET(USN_RECORD, FileName) <= BytesReturned) {
+            Record = (PUSN_RECORD)YoriLibAddToPointer(Buffer, Offset);
+            if (Record->RecordLength == 0 || Offset + Record->RecordLength > BytesReturned) {
+                break;
+            }
+
+            if (Record->MajorVersion != 2) {
+                return FALSE;
+            }
+
+            //
+            //  Entries are recorded by path, and renaming or deleting a
+            //  directory changes the file that a path refers to without
+            //  generating records for the files within it.  Rather than
+            //  tracking the parent of each entry, treat this as a change
+            //  to everything on the volume.
+            //
+
+            if ((Record->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 &&
+                (Record->Reason & (USN_REASON_RENAME_OLD_NAME | USN_REASON_RENAME_NEW_NAME | USN_REASON_FILE_DELETE)) != 0) {
+
+                return FALSE;
+            }
+
+            MakeBuildStateFileIdKey(Volume->VolumeSerialNumber, Record->FileReferenceNumber, &Key);
+            HashEntry = YoriLibHashLookupByKey(FileIds, &Key);
+            if (HashEntry != NULL) {
+                LoadEntry = HashEntry->Context;
+                LoadEntry->Entry->Trusted = FALSE;
+            }
+
+            Offset = Offset + Record->RecordLength;
+        }
+
+        if (NextUsn <= ReadData.StartUsn) {
+            break;
+        }
+        ReadData.StartUsn = NextUsn;
+    }
+
+    return TRUE;
+}
+
+/**
+ Mark every build state entry on a volume as trusted or untrusted.
+
+ @param MakeContext Pointer to the context.
+
+ @param Volume Pointer to the volume.
+
+ @param Trusted TRUE if the entries should be trusted, FALSE if not.
+ */
+VOID
+MakeSetBuildStateVolumeTrusted(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_BUILD_STATE_VOLUME Volume,
+    __in BOOLEAN Trusted
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PMAKE_BUILD_STATE_ENTRY Entry;
+
+    ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateList, NULL);
+    while (ListEntry != NULL) {
+        Entry = CONTAINING_RECORD(ListEntry, MAKE_BUILD_STATE_ENTRY, ListEntry);
+        if (Entry->FileIdPresent &&
+            Entry->VolumeSerialNumber == Volume->VolumeSerialNumber) {
+
+            Entry->Trusted = Trusted;
+        }
+        ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateList, ListEntry);
+    }
+}
+
+/**
+ Validate the build state entries on a volume loaded from a previous run.
+ If the change journal indicates that an entry has not changed since the
+ state was captured, the entry is marked as trusted.  On completion, the
+ volume refers to the current point in the change journal.
+
+ @param MakeContext Pointer to the context.
+
+ @param FileIds Pointer to a hash table of MAKE_BUILD_STATE_LOAD_ENTRY
+        structures keyed by volume serial number and file ID.
+
+ @param Volume Pointer to the volume to validate.
+
+ @param Buffer Pointer to a buffer of MAKE_BUILD_STATE_JOURNAL_BUFFER bytes
+        to read records into.
+ */
+VOID
+MakeValidateBuildStateVolume(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PYORI_HASH_TABLE FileIds,
+    __inout PMAKE_BUILD_STATE_VOLUME Volume,
+    __out_bcount(MAKE_BUILD_STATE_JOURNAL_BUFFER) PUCHAR Buffer
+    )
+{
+    USN_JOURNAL_DATA JournalData;
+    HANDLE VolumeHandle;
+
+    VolumeHandle = MakeOpenBuildStateVolume(Volume);
+    if (VolumeHandle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    if (!MakeQueryBuildStateJournal(VolumeHandle, &JournalData)) {
+        CloseHandle(VolumeHandle);
+        return;
+    }
+
+    //
+    //  Assume every entry on the volume is unchanged, then walk the journal
+    //  and mark any that changed as untrusted.  If the journal can't be
+    //  read, nothing on the volume can be trusted.
+    //
+
+    MakeSetBuildStateVolumeTrusted(MakeContext, Volume, TRUE);
+    if (!MakeReadBuildStateJournal(FileIds, Volume, VolumeHandle, &JournalData, Buffer)) {
+        MakeSetBuildStateVolumeTrusted(MakeContext, Volume, FALSE);
+    }
+
+    CloseHandle(VolumeHandle);
+
+    //
+    //  Anything that changes from here on will have a USN beyond the current
+    //  one, so this is the point that the next run needs to read from.
+    //
+
+    Volume->UsnJournalId = JournalData.UsnJournalID;
+    Volume->NextUsn = JournalData.NextUsn;
+    Volume->JournalValid = TRUE;
+}
+
+/**
+ Find the build state entry for a file, creating one if it does not exist.
+
+ @param MakeContext Pointer to the context.
+
+ @param FileName Pointer to the full path to the file.
+
+ @return Pointer to the entry, or NULL on allocation failure.
+ */
+PMAKE_BUILD_STATE_ENTRY
+MakeLookupOrCreateBuildStateEntry(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PYORI_STRING FileName
+    )
+{
+    PYORI_HASH_ENTRY HashEntry;
+    PMAKE_BUILD_STATE_ENTRY Entry;
+    YORI_STRING Key;
+
+    HashEntry = YoriLibHashLookupByKey(MakeContext->BuildState, FileName);
+    if (HashEntry != NULL) {
+        return HashEntry->Context;
+    }
+
+    Entry = YoriLibMalloc(sizeof(MAKE_BUILD_STATE_ENTRY));
+    if (Entry == NULL) {
+        return NULL;
+    }
+
+    //
+    //  The hash table only references the key, and the caller's string may
+    //  point into a line buffer that is about to be reused, so give the
+    //  hash package an allocation of its own.
+    //
+
+    if (!YoriLibCopyString(&Key, FileName)) {
+        YoriLibFree(Entry);
+        return NULL;
+    }
+
+    ZeroMemory(Entry, sizeof(MAKE_BUILD_STATE_ENTRY));
+    YoriLibHashInsertByKey(MakeContext->BuildState, &Key, Entry, &Entry->HashEntry);
+    YoriLibAppendList(&MakeContext->BuildStateList, &Entry->ListEntry);
+    YoriLibFreeStringContents(&Key);
+    return Entry;
+}
+
+/**
+ Load the build state from a previous run and determine which entries can
+ be trusted without opening the file.
+
+ @param MakeContext Pointer to the context.
+
+ @param MakeFileName Pointer to the file name of the makefile.  If this
+        contains a string, it will be used as the base name for the build
+        state file.
+ */
+VOID
+MakeLoadBuildState(
+    __inout PMAKE_CONTEXT MakeContext,
+    __in PYORI_STRING MakeFileName
+    )
+{
+    PMAKE_BUILD_STATE_ENTRY Entry;
+    PMAKE_BUILD_STATE_LOAD_ENTRY LoadEntries;
+    PMAKE_BUILD_STATE_VOLUME Volume;
+    PYORI_HASH_TABLE FileIds;
+    PYORI_LIST_ENTRY ListEntry;
+    YORI_STRING StateFileName;
+    YORI_STRING LineString;
+    YORI_STRING Remaining;
+    YORI_STRING Key;
+    DWORDLONG Field1;
+    DWORDLONG Field2;
+    DWORDLONG Field3;
+    DWORD EntryCount;
+    DWORD Index;
+    PUCHAR Buffer;
+    HANDLE hState;
+    PVOID LineContext = NULL;
+
+    if (MakeContext->BuildState == NULL) {
+        return;
+    }
+
+    if (!MakeGetBuildStateFileName(MakeFileName, &StateFileName)) {
+        return;
+    }
+
+    hState = CreateFile(StateFileName.StartOfString, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    YoriLibFreeStringContents(&StateFileName);
+    if (hState == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    YoriLibInitEmptyString(&LineString);
+    EntryCount = 0;
+
+    //
+    //  The format of each line is expected to be one of:
+    //  V:VolumeSerialNumber:UsnJournalId:NextUsn:VolumePath
+    //  T:VolumeSerialNumber:FileId:ModifiedTime:FileName
+    //  D:RecipeDuration:FileName
+    //  H:ContentHash:HashedModifiedTime:ContentModifiedTime:FileName
+    //
+    //  All numbers are in hex.  Lines that are not understood are ignored.
+    //
+
+    while (TRUE) {
+        if (!YoriLibReadLineToString(&LineString, &LineContext, hState)) {
+            break;
+        }
+
+        if (LineString.LengthInChars < 2 || LineString.StartOfString[1] != ':') {
+            continue;
+        }
+
+        YoriLibInitEmptyString(&Remaining);
+        Remaining.StartOfString = &LineString.StartOfString[2];
+        Remaining.LengthInChars = LineString.LengthInChars - 2;
+
+        if (!MakeBuildStateParseField(&Remaining, &Field1)) {
+            continue;
+        }
+
+        if (LineString.StartOfString[0] == 'V') {
+            if (!MakeBuildStateParseField(&Remaining, &Field2) ||
+                !MakeBuildStateParseField(&Remaining, &Field3) ||
+                Remaining.LengthInChars == 0) {
+
+                continue;
+            }
+
+            if (MakeFindBuildStateVolume(MakeContext, (DWORD)Field1) != NULL) {
+                continue;
+            }
+
+            Volume = MakeAllocateBuildStateVolume(MakeContext, (DWORD)Field1, &Remaining);
+            if (Volume == NULL) {
+                break;
+            }
+            Volume->UsnJournalId = Field2;
+            Volume->NextUsn = Field3;
+
+        } else if (LineString.StartOfString[0] == 'T') {
+            if (!MakeBuildStateParseField(&Remaining, &Field2) ||
+                !MakeBuildStateParseField(&Remaining, &Field3) ||
+                Remaining.LengthInChars == 0) {
+
+                continue;
+            }
+
+            Entry = MakeLookupOrCreateBuildStateEntry(MakeContext, &Remaining);
+            if (Entry == NULL) {
+                break;
+            }
+
+            if (Entry->FileIdPresent) {
+                continue;
+            }
+
+            Entry->VolumeSerialNumber = (DWORD)Field1;
+            Entry->FileId = Field2;
+            Entry->ModifiedTime.QuadPart = (LONGLONG)Field3;
+            Entry->FileIdPresent = TRUE;
+            EntryCount++;
+
+        } else if (LineString.StartOfString[0] == 'D') {
+            if (Remaining.LengthInChars == 0) {
+                continue;
+            }
+
+            Entry = MakeLookupOrCreateBuildStateEntry(MakeContext, &Remaining);
+            if (Entry == NULL) {
+                break;
+            }
+
+            Entry->RecipeDuration = (DWORD)Field1;
+
+        } else if (LineString.StartOfString[0] == 'H') {
+
+            //
+            //  A run that compares timestamps without hashing may rebuild
+            //  targets from contents other than the ones recorded here.  If
+            //  the file were later reverted to the recorded contents, a
+            //  hashing run would consider it unchanged and not rebuild the
+            //  targets.  Drop the records so they are not saved again.
+            //
+
+            if (MakeContext->ContentHashPool == NULL) {
+                continue;
+            }
+
+            if (!MakeBuildStateParseField(&Remaining, &Field2) ||
+                !MakeBuildStateParseField(&Remaining, &Field3) ||
+                Remaining.LengthInChars == 0) {
+
+                continue;
+            }
+
+            Entry = MakeLookupOrCreateBuildStateEntry(MakeContext, &Remaining);
+            if (Entry == NULL) {
+                break;
+            }
+
+            Entry->ContentHash = Field1;
+            Entry->HashedModifiedTime.QuadPart = (LONGLONG)Field2;
+            Entry->ContentModifiedTime.QuadPart = (LONGLONG)Field3;
+            Entry->ContentHashPresent = TRUE;
+        }
+    }
+
+    YoriLibLineReadCloseOrCache(LineContext);
+    YoriLibFreeStringContents(&LineString);
+    CloseHandle(hState);
+
+    if (EntryCount == 0) {
+        return;
+    }
+
+    //
+    //  Index every entry by its file ID so change journal records can be
+    //  matched back to entries.  If this can't be done, nothing is trusted
+    //  and every file will be opened as if there were no build state.
+    //
+
+    LoadEntries = YoriLibMalloc(EntryCount * sizeof(MAKE_BUILD_STATE_LOAD_ENTRY));
+    if (LoadEntries == NULL) {
+        return;
+    }
+
+    FileIds = YoriLibAllocateHashTable(4000);
+    if (FileIds == NULL) {
+        YoriLibFree(LoadEntries);
+        return;
+    }
+
+    Buffer = YoriLibMalloc(MAKE_BUILD_STATE_JOURNAL_BUFFER);
+    if (Buffer == NULL) {
+        YoriLibFreeEmptyHashTable(FileIds);
+        YoriLibFree(LoadEntries);
+        return;
+    }
+
+    Index = 0;
+    ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateList, NULL);
+    while (ListEntry != NULL) {
+        Entry = CONTAINING_RECORD(ListEntry, MAKE_BUILD_STATE_ENTRY, ListEntry);
+        if (Entry->FileIdPresent) {
+            LoadEntries[Index].Entry = Entry;
+            YoriLibInitEmptyString(&Key);
+            Key.StartOfString = LoadEntries[Index].KeyBuffer;
+            Key.LengthAllocated = sizeof(LoadEntries[Index].KeyBuffer)/sizeof(LoadEntries[Index].KeyBuffer[0]);
+            MakeBuildStateFileIdKey(Entry->VolumeSerialNumber, Entry->FileId, &Key);
+            YoriLibHashInsertByKey(FileIds, &Key, &LoadEntries[Index], &LoadEntries[Index].HashEntry);
+            Index++;
+        }
+        ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateList, ListEntry);
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateVolumes, NULL);
+    while (ListEntry != NULL) {
+        Volume = CONTAINING_RECORD(ListEntry, MAKE_BUILD_STATE_VOLUME, ListEntry);
+        MakeValidateBuildStateVolume(MakeContext, FileIds, Volume, Buffer);
+        ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateVolumes, ListEntry);
+    }
+
+    for (Index = 0; Index < EntryCount; Index++) {
+        YoriLibHashRemoveByEntry(&LoadEntries[Index].HashEntry);
+    }
+
+    YoriLibFree(Buffer);
+    YoriLibFreeEmptyHashTable(FileIds);
+    YoriLibFree(LoadEntries);
+}
+
+/**
+ Check whether the state of a target file is known from the build state
+ without opening the file.
+
+ @param MakeContext Pointer to the context.
+
+ @param Target Pointer to the target.  On successful completion, the file
+        is marked as existing and its modification time is populated.
+
+ @return TRUE if the state of the target was determined from the build
+         state, FALSE if the target file needs to be opened.
+ */
+__success(return)
+BOOLEAN
+MakeGetTargetFromBuildState(
+    __in PMAKE_CONTEXT MakeContext,
+    __inout PMAKE_TARGET Target
+    )
+{
+    PYORI_HASH_ENTRY HashEntry;
+    PMAKE_BUILD_STATE_ENTRY Entry;
+
+    if (MakeContext->BuildState == NULL) {
+        return FALSE;
+    }
+
+    HashEntry = YoriLibHashLookupByKey(MakeContext->BuildState, &Target->HashEntry.Key);
+    if (HashEntry == NULL) {
+        return FALSE;
+    }
+
+    Entry = HashEntry->Context;
+    if (!Entry->Trusted) {
+        return FALSE;
+    }
+
+    Target->FileExists = TRUE;
+    Target->ModifiedTime.QuadPart = Entry->ModifiedTime.QuadPart;
+    return TRUE;
+}
+
+/**
+ Find or create the volume hosting a target file.  If the volume has not
+ been seen before, its change journal is queried so that a later run can
+ determine what changed after this point.
+
+ @param MakeContext Pointer to the context.
+
+ @param Target Pointer to the target.
+
+ @param VolumeSerialNumber The serial number of the volume hosting the
+        target.
+
+ @return Pointer to the volume, or NULL on failure.
+ */
+PMAKE_BUILD_STATE_VOLUME
+MakeGetBuildStateVolumeForTarget(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_TARGET Target,
+    __in DWORD VolumeSerialNumber
+    )
+{
+    PMAKE_BUILD_STATE_VOLUME Volume;
+    USN_JOURNAL_DATA JournalData;
+    YORI_STRING EscapedPath;
+    YORI_STRING VolumePath;
+    HANDLE VolumeHandle;
+
+    Volume = MakeFindBuildStateVolume(MakeContext, VolumeSerialNumber);
+    if (Volume != NULL) {
+        return Volume;
+    }
+
+    YoriLibInitEmptyString(&EscapedPath);
+    YoriLibInitEmptyString(&VolumePath);
+    if (!YoriLibUserStringToSingleFilePath(&Target->HashEntry.Key, TRUE, &EscapedPath)) {
+        return NULL;
+    }
+
+    if (!YoriLibGetVolumePathName(&EscapedPath, &VolumePath)) {
+        YoriLibFreeStringContents(&EscapedPath);
+        return NULL;
+    }
+    YoriLibFreeStringContents(&EscapedPath);
+
+    //
+    //  Truncate the trailing backslash so as to open the volume instead of
+    //  root directory
+    //
+
+    if (VolumePath.LengthInChars > 0 &&
+        VolumePath.StartOfString[VolumePath.LengthInChars - 1] == '\\') {
+
+        VolumePath.LengthInChars--;
+        VolumePath.StartOfString[VolumePath.LengthInChars] = '\0';
+    }
+
+    Volume = MakeAllocateBuildStateVolume(MakeContext, VolumeSerialNumber, &VolumePath);
+    YoriLibFreeStringContents(&VolumePath);
+    if (Volume == NULL) {
+        return NULL;
+    }
+
+    VolumeHandle = MakeOpenBuildStateVolume(Volume);
+    if (VolumeHandle != INVALID_HANDLE_VALUE) {
+        if (MakeQueryBuildStateJournal(VolumeHandle, &JournalData)) {
+            Volume->UsnJournalId = JournalData.UsnJournalID;
+            Volume->NextUsn = JournalData.NextUsn;
+            Volume->JournalValid = TRUE;
+        }
+        CloseHandle(VolumeHandle);
+    }
+
+    return Volume;
+}
+
+/**
+ Record the state of a target file that has just been opened into the
+ build state.  This is only possible for files on volumes with a change
+ journal, since otherwise a later run cannot tell whether the state is
+ still accurate.
+
+ @param MakeContext Pointer to the context.
+
+ @param Target Pointer to the target.  If the volume is queried for the
+        first time, the modification time of the target is refreshed.
+
+ @param FileHandle Handle to the target file.
+
+ @param FileInfo Pointer to information previously queried from the file.
+        If the volume is queried for the first time, this is refreshed.
+ */
+VOID
+MakeUpdateBuildStateForTarget(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_TARGET Target,
+    __in HANDLE FileHandle,
+    __inout LPBY_HANDLE_FILE_INFORMATION FileInfo
+    )
+{
+    PMAKE_BUILD_STATE_VOLUME Volume;
+    PMAKE_BUILD_STATE_ENTRY Entry;
+    BOOLEAN NewVolume;
+
+    if (MakeContext->BuildState == NULL) {
+        return;
+    }
+
+    NewVolume = FALSE;
+    if (MakeFindBuildStateVolume(MakeContext, FileInfo->dwVolumeSerialNumber) == NULL) {
+        NewVolume = TRUE;
+    }
+
+    Volume = MakeGetBuildStateVolumeForTarget(MakeContext, Target, FileInfo->dwVolumeSerialNumber);
+    if (Volume == NULL || !Volume->JournalValid) {
+        return;
+    }
+
+    //
+    //  If the journal was just queried, the file information may predate
+    //  the point recorded in the journal.  Query it again so that any
+    //  change to the file is either reflected here or is in the journal.
+    //
+
+    if (NewVolume) {
+        if (!GetFileInformationByHandle(FileHandle, FileInfo)) {
+            return;
+        }
+
+        if (FileInfo->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            Target->ModifiedTime.LowPart = 0;
+            Target->ModifiedTime.HighPart = 0;
+        } else {
+            Target->ModifiedTime.LowPart = FileInfo->ftLastWriteTime.dwLowDateTime;
+            Target->ModifiedTime.HighPart = FileInfo->ftLastWriteTime.dwHighDateTime;
+        }
+    }
+
+    Entry = MakeLookupOrCreateBuildStateEntry(MakeContext, &Target->HashEntry.Key);
+    if (Entry == NULL) {
+        return;
+    }
+
+    Entry->VolumeSerialNumber = FileInfo->dwVolumeSerialNumber;
+    Entry->FileId = ((DWORDLONG)FileInfo->nFileIndexHigh << 32) | FileInfo->nFileIndexLow;
+    Entry->ModifiedTime.QuadPart = Target->ModifiedTime.QuadPart;
+    Entry->FileIdPresent = TRUE;
+    Entry->Trusted = TRUE;
+}
+
+/**
+ Return the time taken to execute the recipe for a target when it was last
+ built, if known.
+
+ @param MakeContext Pointer to the context.
+
+ @param Target Pointer to the target.
+
+ @return The time taken to execute the recipe in milliseconds, or zero if
+         this is not known.
+ */
+DWORD
+MakeGetBuildStateRecipeDuration(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_TARGET Target
+    )
+{
+    PYORI_HASH_ENTRY HashEntry;
+    PMAKE_BUILD_STATE_ENTRY Entry;
+
+    if (MakeContext->BuildState == NULL) {
+        return 0;
+    }
+
+    HashEntry = YoriLibHashLookupByKey(MakeContext->BuildState, &Target->HashEntry.Key);
+    if (HashEntry == NULL) {
+        return 0;
+    }
+
+    Entry = HashEntry->Context;
+    return Entry->RecipeDuration;
+}
+
+/**
+ Record the time taken to execute the recipe for a target so that later
+ builds can schedule it appropriately.
+
+ @param MakeContext Pointer to the context.
+
+ @param Target Pointer to the target.
+
+ @param RecipeDuration The time taken to execute the recipe in
+        milliseconds.
+ */
+VOID
+MakeSetBuildStateRecipeDuration(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_TARGET Target,
+    __in DWORD RecipeDuration
+    )
+{
+    PMAKE_BUILD_STATE_ENTRY Entry;
+
+    if (MakeContext->BuildState == NULL) {
+        return;
+    }
+
+    Entry = MakeLookupOrCreateBuildStateEntry(MakeContext, &Target->HashEntry.Key);
+    if (Entry == NULL) {
+        return;
+    }
+
+    //
+    //  Zero indicates no duration is known, so record something for
+    //  recipes that completed very quickly.
+    //
+
+    if (RecipeDuration == 0) {
+        RecipeDuration = 1;
+    }
+    Entry->RecipeDuration = RecipeDuration;
+}
+
+/**
+ Return the hash of the contents of a target file recorded in the build
+ state, if known.
+
+ @param MakeContext Pointer to the context.
+
+ @param Target Pointer to the target.
+
+ @param ContentHash On successful completion, updated to contain the hash of
+        the contents of the file.
+
+ @param HashedModifiedTime On successful completion, updated to contain the
+        modification time of the file when the hash was calculated.
+
+ @param ContentModifiedTime On successful completion, updated to contain the
+        modification time of the file when its contents last changed.
+
+ @return TRUE if a hash is recorded for the target, FALSE if it is not.
+ */
+__success(return)
+BOOLEAN
+MakeGetBuildStateContentHash(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_TARGET Target,
+    __out PDWORDLONG ContentHash,
+    __out PLARGE_INTEGER HashedModifiedTime,
+    __out PLARGE_INTEGER ContentModifiedTime
+    )
+{
+    PYORI_HASH_ENTRY HashEntry;
+    PMAKE_BUILD_STATE_ENTRY Entry;
+
+    if (MakeContext->BuildState == NULL) {
+        return FALSE;
+    }
+
+    HashEntry = YoriLibHashLookupByKey(MakeContext->BuildState, &Target->HashEntry.Key);
+    if (HashEntry == NULL) {
+        return FALSE;
+    }
+
+    Entry = HashEntry->Context;
+    if (!Entry->ContentHashPresent) {
+        return FALSE;
+    }
+
+    *ContentHash = Entry->ContentHash;
+    HashedModifiedTime->QuadPart = Entry->HashedModifiedTime.QuadPart;
+    ContentModifiedTime->QuadPart = Entry->ContentModifiedTime.QuadPart;
+    return TRUE;
+}
+
+/**
+ Record the hash of the contents of a target file so that a later build
+ can tell whether the file has been written with identical contents.
+
+ @param MakeContext Pointer to the context.
+
+ @param Target Pointer to the target.  The current modification time of the
+        target is recorded as the time the hash was calculated.
+
+ @param ContentHash The hash of the contents of the file.
+
+ @param ContentModifiedTime Pointer to the modification time of the file
+        when its contents last changed.
+ */
+VOID
+MakeSetBuildStateContentHash(
+    __in PMAKE_CONTEXT MakeContext,
+    __in PMAKE_TARGET Target,
+    __in DWORDLONG ContentHash,
+    __in PLARGE_INTEGER ContentModifiedTime
+    )
+{
+    PMAKE_BUILD_STATE_ENTRY Entry;
+
+    if (MakeContext->BuildState == NULL) {
+        return;
+    }
+
+    Entry = MakeLookupOrCreateBuildStateEntry(MakeContext, &Target->HashEntry.Key);
+    if (Entry == NULL) {
+        return;
+    }
+
+    Entry->ContentHash = ContentHash;
+    Entry->HashedModifiedTime.QuadPart = Target->ModifiedTime.QuadPart;
+    Entry->ContentModifiedTime.QuadPart = ContentModifiedTime->QuadPart;
+    Entry->ContentHashPresent = TRUE;
+}
+
+/**
+ Deallocate the build state and optionally write it to a file.  File IDs
+ and timestamps are only written for entries that are known to be accurate
+ as of the point recorded in each volume's change journal.  Content hashes
+ are validated by timestamp, so are written regardless.
+
+ @param MakeContext Pointer to the context.
+
+ @param MakeFileName Pointer to the file name of the makefile.  If this
+        contains a string, it will be used as the base name for the build
+        state file.
+ */
+VOID
+MakeSaveAndDeleteBuildState(
+    __inout PMAKE_CONTEXT MakeContext,
+    __in PYORI_STRING MakeFileName
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PMAKE_BUILD_STATE_ENTRY Entry;
+    PMAKE_BUILD_STATE_VOLUME Volume;
+    YORI_STRING StateFileName;
+    HANDLE hState;
+
+    if (MakeContext->BuildState == NULL) {
+        return;
+    }
+
+    hState = NULL;
+    if (MakeGetBuildStateFileName(MakeFileName, &StateFileName)) {
+        hState = CreateFile(StateFileName.StartOfString, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hState == INVALID_HANDLE_VALUE) {
+            hState = NULL;
+        }
+        YoriLibFreeStringContents(&StateFileName);
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateVolumes, NULL);
+    while (ListEntry != NULL) {
+        Volume = CONTAINING_RECORD(ListEntry, MAKE_BUILD_STATE_VOLUME, ListEntry);
+        if (hState != NULL && Volume->JournalValid) {
+            YoriLibOutputToDevice(hState, 0, _T("V:%x:%llx:%llx:%y\n"), Volume->VolumeSerialNumber, Volume->UsnJournalId, Volume->NextUsn, &Volume->VolumePath);
+        }
+        ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateVolumes, ListEntry);
+    }
+
+    ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateList, NULL);
+    while (ListEntry != NULL) {
+        Entry = CONTAINING_RECORD(ListEntry, MAKE_BUILD_STATE_ENTRY, ListEntry);
+
+        if (hState != NULL && Entry->Trusted) {
+            YoriLibOutputToDevice(hState, 0, _T("T:%x:%llx:%llx:%y\n"), Entry->VolumeSerialNumber, Entry->FileId, Entry->ModifiedTime.QuadPart, &Entry->HashEntry.Key);
+        }
+        if (hState != NULL && Entry->RecipeDuration != 0) {
+            YoriLibOutputToDevice(hState, 0, _T("D:%x:%y\n"), Entry->RecipeDuration, &Entry->HashEntry.Key);
+        }
+        if (hState != NULL && Entry->ContentHashPresent) {
+            YoriLibOutputToDevice(hState, 0, _T("H:%llx:%llx:%llx:%y\n"), Entry->ContentHash, Entry->HashedModifiedTime.QuadPart, Entry->ContentModifiedTime.QuadPart, &Entry->HashEntry.Key);
+        }
+        YoriLibRemoveListItem(&Entry->ListEntry);
+        YoriLibHashRemoveByEntry(&Entry->HashEntry);
+        YoriLibFree(Entry);
+        ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateList, NULL);
+    }
+    YoriLibFreeEmptyHashTable(MakeContext->BuildState);
+    MakeContext->BuildState = NULL;
+
+    ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateVolumes, NULL);
+    while (ListEntry != NULL) {
+        Volume = CONTAINING_RECORD(ListEntry, MAKE_BUILD_STATE_VOLUME, ListEntry);
+        YoriLibRemoveListItem(&Volume->ListEntry);
+        YoriLibFreeStringContents(&Volume->VolumePath);
+        YoriLibFree(Volume);
+        ListEntry = YoriLibGetNextListEntry(&MakeContext->BuildStateVolumes, NULL);
+    }
+
+    if (hState != NULL) {
+        CloseHandle(hState);
+    }
+}
+
+// vim:sw=4:ts=4:et:
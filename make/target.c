@@ -75,7 +75,7 @@ MakeDereferenceTarget(
             Target->InferenceRuleParentTarget = NULL;
         }
 
-        MakeSlabFree(Target);
+        YoriLibPoolFree(Target);
     }
 }
 
@@ -111,7 +111,7 @@ MakeDeleteDependency(
     YoriLibRemoveListItem(&Dependency->ParentDependents);
     YoriLibRemoveListItem(&Dependency->ChildDependents);
 
-    MakeSlabFree(Dependency);
+    YoriLibPoolFree(Dependency);
 }
 
 /**
@@ -160,12 +160,17 @@ MakeDeleteAllTargets(
 
 /**
  Open the target and query its timestamp.  The target may not exist (implying
- it needs to be rebuilt.)
+ it needs to be rebuilt.)  If the build state indicates the file has not
+ changed since it was last recorded, or the directory containing the file
+ has been enumerated, that state is used without opening the file.
+
+ @param MakeContext Pointer to the context.
 
  @param Target Pointer to the target to query.
  */
 VOID
 MakeProbeTargetFile(
+    __in PMAKE_CONTEXT MakeContext,
     __in PMAKE_TARGET Target
     )
 {
@@ -178,6 +183,18 @@ MakeProbeTargetFile(
 
     ASSERT(!Target->FileExists);
 
+    if (MakeGetTargetFromBuildState(MakeContext, Target)) {
+        MakeContext->TargetsFromBuildState++;
+        Target->FileProbed = TRUE;
+        return;
+    }
+
+    if (MakeGetTargetFromDirectoryCache(MakeContext, Target)) {
+        MakeContext->TargetsFromDirectoryCache++;
+        Target->FileProbed = TRUE;
+        return;
+    }
+
     //
     //  Check if the object already exists, and if so, when it was last
     //  modified.  Normally this would only need FILE_READ_ATTRIBUTES,
@@ -193,6 +210,7 @@ MakeProbeTargetFile(
     //  clocks going backwards in time that produce false negatives.
     //
 
+    MakeContext->TargetsProbed++;
     ASSERT(YoriLibIsStringNullTerminated(&Target->HashEntry.Key));
     FileHandle = CreateFile(Target->HashEntry.Key.StartOfString,
                             FILE_READ_ATTRIBUTES | FILE_READ_DATA,
@@ -213,6 +231,8 @@ MakeProbeTargetFile(
                 Target->ModifiedTime.LowPart = FileInfo.ftLastWriteTime.dwLowDateTime;
                 Target->ModifiedTime.HighPart = FileInfo.ftLastWriteTime.dwHighDateTime;
             }
+
+            MakeUpdateBuildStateForTarget(MakeContext, Target, FileHandle, &FileInfo);
         }
         CloseHandle(FileHandle);
     }
@@ -339,7 +359,7 @@ MakeLookupOrCreateTarget(
         YoriLibFreeStringContents(&FullPath);
     } else {
 
-        Target = MakeSlabAlloc(&ScopeContext->MakeContext->TargetAllocator, sizeof(MAKE_TARGET));
+        Target = YoriLibPoolAlloc(&ScopeContext->MakeContext->TargetAllocator, sizeof(MAKE_TARGET));
         if (Target == NULL) {
             YoriLibFreeStringContents(&FullPath);
             return NULL;
@@ -1194,7 +1214,7 @@ MakeCreateParentChildDependency(
 {
     PMAKE_TARGET_DEPENDENCY Dependency;
 
-    Dependency = MakeSlabAlloc(&MakeContext->DependencyAllocator, sizeof(MAKE_TARGET_DEPENDENCY));
+    Dependency = YoriLibPoolAlloc(&MakeContext->DependencyAllocator, sizeof(MAKE_TARGET_DEPENDENCY));
     if (Dependency == NULL) {
         return FALSE;
     }
@@ -1257,7 +1277,7 @@ MakeExpandTargetVariable(
     if (SymbolChars == 0) {
         return FALSE;
     }
-    MakeProbeTargetFile(Target);
+    MakeProbeTargetFile(MakeContext, Target);
 
     YoriLibInitEmptyString(&BaseVariableName);
     BaseVariableName.StartOfString = VariableName->StartOfString;
@@ -1305,7 +1325,7 @@ MakeExpandTargetVariable(
         ListEntry = YoriLibGetNextListEntry(&Target->ParentDependents, NULL);
         while (ListEntry != NULL) {
             DependentTarget = CONTAINING_RECORD(ListEntry, MAKE_TARGET_DEPENDENCY, ChildDependents);
-            MakeProbeTargetFile(DependentTarget->Parent);
+            MakeProbeTargetFile(MakeContext, DependentTarget->Parent);
             if (!Target->FileExists ||
                 !DependentTarget->Parent->FileExists ||
                 DependentTarget->Parent->ModifiedTime.QuadPart > Target->ModifiedTime.QuadPart) {
@@ -1324,7 +1344,7 @@ MakeExpandTargetVariable(
         ListEntry = YoriLibGetNextListEntry(&Target->ParentDependents, NULL);
         while (ListEntry != NULL) {
             DependentTarget = CONTAINING_RECORD(ListEntry, MAKE_TARGET_DEPENDENCY, ChildDependents);
-            MakeProbeTargetFile(DependentTarget->Parent);
+            MakeProbeTargetFile(MakeContext, DependentTarget->Parent);
             if (!Target->FileExists ||
                 !DependentTarget->Parent->FileExists ||
                 DependentTarget->Parent->ModifiedTime.QuadPart > Target->ModifiedTime.QuadPart) {
@@ -1664,13 +1684,10 @@ MakeMarkTargetForRebuild(
     }
 
     //
-    //  MSFIX Ideally these lists would be sorted or approximately sorted
-    //  where the targets that have the most dependencies are done before
-    //  those with fewer dependencies.  Doing this intelligently really
-    //  requires knowledge of all ancestors.  Appending to the end means
-    //  that depth first traversal should ensure that all dependencies are
-    //  satisfied, and if many targets depend on one target that target
-    //  should be uncovered relatively early.
+    //  Appending to the end means that depth first traversal should ensure
+    //  that all dependencies are satisfied.  Once all targets are known,
+    //  the ready list is reordered so that targets with the longest chain
+    //  of work depending on them are executed first.
     //
 
     Target->RebuildRequired = TRUE;
@@ -1749,6 +1766,7 @@ MakeDetermineDependenciesForTarget(
     PMAKE_TARGET_DEPENDENCY Dependency;
     PMAKE_TARGET Parent;
     PYORI_LIST_ENTRY ListEntry;
+    LONGLONG ContentModifiedTime;
     BOOLEAN SetRebuildRequired;
 
     if (Target->DependenciesEvaluated) {
@@ -1760,7 +1778,7 @@ MakeDetermineDependenciesForTarget(
         return FALSE;
     }
 
-    MakeProbeTargetFile(Target);
+    MakeProbeTargetFile(MakeContext, Target);
 
     Target->EvaluatingDependencies = TRUE;
 
@@ -1802,9 +1820,40 @@ MakeDetermineDependenciesForTarget(
             Target->NumberParentsToBuild = Target->NumberParentsToBuild + 1;
             SetRebuildRequired = TRUE;
         }
-        MakeProbeTargetFile(Parent);
-        if (Parent->FileExists && Target->FileExists && Parent->ModifiedTime.QuadPart > Target->ModifiedTime.QuadPart) {
-            SetRebuildRequired = TRUE;
+        MakeProbeTargetFile(MakeContext, Parent);
+
+        //
+        //  If contents are being hashed, start hashing any parent that
+        //  exists and will not be rebuilt, so that all parents can be
+        //  read concurrently before their timestamps are compared below.
+        //
+
+        if (MakeContext->ContentHashPool != NULL &&
+            Parent->FileExists &&
+            !Parent->RebuildRequired) {
+
+            MakeQueueContentHash(MakeContext, Parent);
+        }
+        ListEntry = YoriLibGetNextListEntry(&Target->ParentDependents, ListEntry);
+    }
+
+    //
+    //  Check if any parent is newer than the target.  If contents are
+    //  being hashed, a parent is only newer if its contents changed after
+    //  the target was written.
+    //
+
+    ListEntry = YoriLibGetNextListEntry(&Target->ParentDependents, NULL);
+    while (ListEntry != NULL) {
+        Dependency = CONTAINING_RECORD(ListEntry, MAKE_TARGET_DEPENDENCY, ChildDependents);
+        Parent = Dependency->Parent;
+        ContentModifiedTime = MakeGetContentModifiedTime(MakeContext, Parent);
+        if (Parent->FileExists && Target->FileExists) {
+            if (ContentModifiedTime > Target->ModifiedTime.QuadPart) {
+                SetRebuildRequired = TRUE;
+            } else if (Parent->ModifiedTime.QuadPart > Target->ModifiedTime.QuadPart) {
+                MakeContext->DependenciesUnchangedByContent++;
+            }
         }
         ListEntry = YoriLibGetNextListEntry(&Target->ParentDependents, ListEntry);
     }
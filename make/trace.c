@@ -0,0 +1,322 @@
+/**
+ * @file make/trace.c
+ *
+ * Yori shell make timeline trace support
+ *
+ * Copyright (c) 2020 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include <yorish.h>
+#include "make.h"
+
+/**
+ Convert a performance counter value into the number of microseconds since
+ the trace started.
+
+ @param Trace Pointer to the trace state.
+
+ @param Time Pointer to the performance counter value.
+
+ @return The number of microseconds since the trace started.
+ */
+LONGLONG
+MakeTraceTimeToMicroseconds(
+    __in PMAKE_TRACE Trace,
+    __in PLARGE_INTEGER Time
+    )
+{
+    LONGLONG Elapsed;
+
+    Elapsed = Time->QuadPart - Trace->StartTime.QuadPart;
+    if (Elapsed < 0) {
+        Elapsed = 0;
+    }
+
+    return Elapsed * 1000000 / Trace->Frequency.QuadPart;
+}
+
+/**
+ Escape a string so that it can be included in a JSON string.  Quotes and
+ backslashes are escaped with a backslash, and control characters are
+ converted to unicode escapes.
+
+ @param Trace Pointer to the trace state.  On successful completion,
+        EscapedString is updated to contain the escaped form of the string.
+
+ @param String Pointer to the string to escape.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOLEAN
+MakeTraceEscapeString(
+    __inout PMAKE_TRACE Trace,
+    __in PYORI_STRING String
+    )
+{
+    YORI_ALLOC_SIZE_T Index;
+    YORI_ALLOC_SIZE_T CharsNeeded;
+    YORI_ALLOC_SIZE_T Offset;
+    PYORI_STRING Escaped;
+    TCHAR Char;
+
+    CharsNeeded = 1;
+    for (Index = 0; Index < String->LengthInChars; Index++) {
+        Char = String->StartOfString[Index];
+        if (Char == '"' || Char == '\\') {
+            CharsNeeded = CharsNeeded + 2;
+        } else if (Char < 0x20) {
+            CharsNeeded = CharsNeeded + 6;
+        } else {
+            CharsNeeded = CharsNeeded + 1;
+        }
+    }
+
+    Escaped = &Trace->EscapedString;
+    if (Escaped->LengthAllocated < CharsNeeded) {
+        YoriLibFreeStringContents(Escaped);
+        if (!YoriLibAllocateString(Escaped, CharsNeeded + 256)) {
+            return FALSE;
+        }
+    }
+
+    Offset = 0;
+    for (Index = 0; Index < String->LengthInChars; Index++) {
+        Char = String->StartOfString[Index];
+        if (Char == '"' || Char == '\\') {
+            Escaped->StartOfString[Offset] = '\\';
+            Escaped->StartOfString[Offset + 1] = Char;
+            Offset = Offset + 2;
+        } else if (Char < 0x20) {
+            Offset = Offset + (YORI_ALLOC_SIZE_T)YoriLibSPrintfS(&Escaped->StartOfString[Offset], Escaped->LengthAllocated - Offset, _T("\\u%04x"), Char);
+        } else {
+            Escaped->StartOfString[Offset] = Char;
+            Offset++;
+        }
+    }
+
+    Escaped->StartOfString[Offset] = '\0';
+    Escaped->LengthInChars = Offset;
+    return TRUE;
+}
+
+/**
+ Return the string that should precede the next event in the trace.  This
+ is a separator for every event after the first.
+
+ @param Trace Pointer to the trace state.
+
+ @return Pointer to the string to write before the next event.
+ */
+LPCTSTR
+MakeTraceSeparator(
+    __inout PMAKE_TRACE Trace
+    )
+{
+    if (Trace->EventWritten) {
+        return _T(",\n");
+    }
+
+    Trace->EventWritten = TRUE;
+    return _T("\n");
+}
+
+/**
+ Open a file to record a timeline of the build.  Each child process slot
+ is described as a thread so the timeline displays one row per slot.
+
+ @param MakeContext Pointer to the make context.  The number of child
+        processes is expected to have been determined already.
+
+ @param FileName Pointer to the name of the file to write the trace to.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOLEAN
+MakeTraceOpen(
+    __inout PMAKE_CONTEXT MakeContext,
+    __in PYORI_STRING FileName
+    )
+{
+    PMAKE_TRACE Trace;
+    YORI_STRING FullFileName;
+    YORI_ALLOC_SIZE_T Index;
+
+    ASSERT(MakeContext->Trace == NULL);
+
+    YoriLibInitEmptyString(&FullFileName);
+    if (!YoriLibUserStringToSingleFilePath(FileName, TRUE, &FullFileName)) {
+        return FALSE;
+    }
+
+    Trace = YoriLibMalloc(sizeof(MAKE_TRACE));
+    if (Trace == NULL) {
+        YoriLibFreeStringContents(&FullFileName);
+        return FALSE;
+    }
+
+    ZeroMemory(Trace, sizeof(MAKE_TRACE));
+    YoriLibInitEmptyString(&Trace->EscapedString);
+
+    Trace->hFile = CreateFile(FullFileName.StartOfString, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (Trace->hFile == INVALID_HANDLE_VALUE) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("ymake: could not open trace file %y\n"), &FullFileName);
+        YoriLibFreeStringContents(&FullFileName);
+        YoriLibFree(Trace);
+        return FALSE;
+    }
+
+    YoriLibFreeStringContents(&FullFileName);
+
+    QueryPerformanceFrequency(&Trace->Frequency);
+    QueryPerformanceCounter(&Trace->StartTime);
+
+    YoriLibOutputToDevice(Trace->hFile, 0, _T("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+    YoriLibOutputToDevice(Trace->hFile, 0, _T("%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ymake\"}}"), MakeTraceSeparator(Trace));
+    YoriLibOutputToDevice(Trace->hFile, 0, _T("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ymake\"}}"), MakeTraceSeparator(Trace));
+    for (Index = 0; Index < MakeContext->NumberProcesses; Index++) {
+        YoriLibOutputToDevice(Trace->hFile, 0, _T("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"Job slot %i\"}}"), MakeTraceSeparator(Trace), Index + 1, Index);
+    }
+
+    MakeContext->Trace = Trace;
+    return TRUE;
+}
+
+/**
+ Record an event that took a period of time to the trace.
+
+ @param MakeContext Pointer to the make context.  If a trace is not being
+        recorded, this function does nothing.
+
+ @param Category Pointer to the category of the event.  This is expected to
+        not require escaping.
+
+ @param Name Pointer to the name of the event.
+
+ @param ThreadId The thread to display the event on.  Zero refers to ymake
+        itself, and values from one refer to child process slots.
+
+ @param StartTime Pointer to the performance counter value when the event
+        started.
+
+ @param EndTime Pointer to the performance counter value when the event
+        completed.
+ */
+VOID
+MakeTraceComplete(
+    __in PMAKE_CONTEXT MakeContext,
+    __in LPCTSTR Category,
+    __in PYORI_STRING Name,
+    __in DWORD ThreadId,
+    __in PLARGE_INTEGER StartTime,
+    __in PLARGE_INTEGER EndTime
+    )
+{
+    PMAKE_TRACE Trace;
+    LONGLONG Start;
+    LONGLONG End;
+
+    Trace = MakeContext->Trace;
+    if (Trace == NULL) {
+        return;
+    }
+
+    if (!MakeTraceEscapeString(Trace, Name)) {
+        return;
+    }
+
+    Start = MakeTraceTimeToMicroseconds(Trace, StartTime);
+    End = MakeTraceTimeToMicroseconds(Trace, EndTime);
+    if (End < Start) {
+        End = Start;
+    }
+
+    YoriLibOutputToDevice(Trace->hFile, 0, _T("%s{\"name\":\"%y\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%lli,\"dur\":%lli}"), MakeTraceSeparator(Trace), &Trace->EscapedString, Category, ThreadId, Start, End - Start);
+}
+
+/**
+ Record an event that occurred at a point in time to the trace.  The event
+ is recorded as occurring now.
+
+ @param MakeContext Pointer to the make context.  If a trace is not being
+        recorded, this function does nothing.
+
+ @param Category Pointer to the category of the event.  This is expected to
+        not require escaping.
+
+ @param Name Pointer to the name of the event.
+
+ @param ThreadId The thread to display the event on.  Zero refers to ymake
+        itself, and values from one refer to child process slots.
+ */
+VOID
+MakeTraceInstant(
+    __in PMAKE_CONTEXT MakeContext,
+    __in LPCTSTR Category,
+    __in PYORI_STRING Name,
+    __in DWORD ThreadId
+    )
+{
+    PMAKE_TRACE Trace;
+    LARGE_INTEGER Now;
+
+    Trace = MakeContext->Trace;
+    if (Trace == NULL) {
+        return;
+    }
+
+    if (!MakeTraceEscapeString(Trace, Name)) {
+        return;
+    }
+
+    QueryPerformanceCounter(&Now);
+
+    YoriLibOutputToDevice(Trace->hFile, 0, _T("%s{\"name\":\"%y\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%i,\"ts\":%lli}"), MakeTraceSeparator(Trace), &Trace->EscapedString, Category, ThreadId, MakeTraceTimeToMicroseconds(Trace, &Now));
+}
+
+/**
+ Complete the trace file and free the trace state.
+
+ @param MakeContext Pointer to the make context.  If a trace is not being
+        recorded, this function does nothing.
+ */
+VOID
+MakeTraceClose(
+    __inout PMAKE_CONTEXT MakeContext
+    )
+{
+    PMAKE_TRACE Trace;
+
+    Trace = MakeContext->Trace;
+    if (Trace == NULL) {
+        return;
+    }
+
+    YoriLibOutputToDevice(Trace->hFile, 0, _T("\n]}\n"));
+    CloseHandle(Trace->hFile);
+    YoriLibFreeStringContents(&Trace->EscapedString);
+    YoriLibFree(Trace);
+    MakeContext->Trace = NULL;
+}
+
+// vim:sw=4:ts=4:et:
@@ -30,11 +30,12 @@
 #include "make.h"
 
 /**
- Deallocate a single variable.
+ Delete a single variable.  The memory for the variable is owned by the
+ scope's arena and is released when the scope is deleted.
 
  @param ScopeContext Pointer to the scope context.
 
- @param Variable Pointer to the variable to deallocate.
+ @param Variable Pointer to the variable to delete.
  */
 VOID
 MakeDeleteVariable(
@@ -47,11 +48,27 @@ MakeDeleteVariable(
     YoriLibRemoveListItem(&Variable->ListEntry);
     YoriLibHashRemoveByEntry(&Variable->HashEntry);
     YoriLibFreeStringContents(&Variable->Value);
-    YoriLibDereference(Variable);
 }
 
 /**
- Deallocate all variables within the specified context.
+ Delete a single resolved variable reference.  The memory for the reference
+ is owned by the scope's arena and is released when the scope is deleted.
+
+ @param CacheEntry Pointer to the resolved variable reference to delete.
+ */
+VOID
+MakeDeleteVariableCacheEntry(
+    __in PMAKE_VARIABLE_CACHE_ENTRY CacheEntry
+    )
+{
+    YoriLibRemoveListItem(&CacheEntry->ListEntry);
+    YoriLibHashRemoveByEntry(&CacheEntry->HashEntry);
+    YoriLibFreeStringContents(&CacheEntry->Value);
+}
+
+/**
+ Deallocate all variables and resolved variable references within the
+ specified context.
 
  @param ScopeContext Pointer to the scope context.
  */
@@ -62,6 +79,14 @@ MakeDeleteAllVariables(
 { 
     PYORI_LIST_ENTRY ListEntry = NULL;
     PMAKE_VARIABLE Variable;
+    PMAKE_VARIABLE_CACHE_ENTRY CacheEntry;
+
+    ListEntry = YoriLibGetNextListEntry(&ScopeContext->VariableCacheList, NULL);
+    while (ListEntry != NULL) {
+        CacheEntry = CONTAINING_RECORD(ListEntry, MAKE_VARIABLE_CACHE_ENTRY, ListEntry);
+        MakeDeleteVariableCacheEntry(CacheEntry);
+        ListEntry = YoriLibGetNextListEntry(&ScopeContext->VariableCacheList, NULL);
+    }
 
     ListEntry = YoriLibGetNextListEntry(&ScopeContext->VariableList, NULL);
     while (ListEntry != NULL) {
@@ -187,6 +212,59 @@ MakeIsVariableTargetSpecific(
     return FALSE;
 }
 
+/**
+ Record the result of resolving a variable reference so that later
+ references can use it until a variable is set.
+
+ @param ScopeContext Pointer to the scope context.
+
+ @param CacheEntry Optionally points to a stale resolved reference for the
+        same text, which is updated in place.  If NULL, a new resolved
+        reference is allocated.
+
+ @param VariableName Pointer to the text of the reference.
+
+ @param VariableData Pointer to the resolved value.  This is referenced
+        rather than copied.
+ */
+VOID
+MakeCacheVariableReference(
+    __in PMAKE_SCOPE_CONTEXT ScopeContext,
+    __in_opt PMAKE_VARIABLE_CACHE_ENTRY CacheEntry,
+    __in PCYORI_STRING VariableName,
+    __in PYORI_STRING VariableData
+    )
+{
+    YORI_STRING NameCopy;
+
+    if (CacheEntry == NULL) {
+        CacheEntry = YoriLibArenaAlloc(&ScopeContext->Arena, sizeof(MAKE_VARIABLE_CACHE_ENTRY) + VariableName->LengthInChars * sizeof(TCHAR), NULL);
+        if (CacheEntry == NULL) {
+            return;
+        }
+
+        //
+        //  As with variables, the hash package references the key rather
+        //  than copying it, so copy it into the same allocation.
+        //
+
+        YoriLibInitEmptyString(&NameCopy);
+        NameCopy.StartOfString = (LPTSTR)(CacheEntry + 1);
+        memcpy(NameCopy.StartOfString, VariableName->StartOfString, VariableName->LengthInChars * sizeof(TCHAR));
+        NameCopy.LengthInChars = VariableName->LengthInChars;
+
+        YoriLibInitEmptyString(&CacheEntry->Value);
+        YoriLibHashInsertByKey(ScopeContext->VariableCache, &NameCopy, CacheEntry, &CacheEntry->HashEntry);
+        YoriLibAppendList(&ScopeContext->VariableCacheList, &CacheEntry->ListEntry);
+        ScopeContext->MakeContext->VariableCacheEntries++;
+    } else {
+        YoriLibFreeStringContents(&CacheEntry->Value);
+    }
+
+    YoriLibCloneString(&CacheEntry->Value, VariableData);
+    CacheEntry->Generation = ScopeContext->MakeContext->VariableGeneration;
+}
+
 /**
  Given a variable name, obtain the data for the variable.  For user variables,
  this is a hashtable lookup.  This function also handles special target
@@ -218,6 +296,8 @@ MakeSubstituteNamedVariable(
     )
 {
     PMAKE_VARIABLE FoundVariable;
+    PMAKE_VARIABLE_CACHE_ENTRY CacheEntry;
+    PYORI_HASH_ENTRY FoundCacheEntry;
     YORI_STRING NameToFind;
     YORI_STRING SearchText;
     YORI_STRING ReplaceText;
@@ -239,6 +319,31 @@ MakeSubstituteNamedVariable(
         }
     }
 
+    //
+    //  Check if this reference has been resolved in this scope since any
+    //  variable was last set.  The hash table compares case insensitively
+    //  but search and replace text is case sensitive, so a reference that
+    //  differs only in case is resolved without the cache.
+    //
+
+    CacheEntry = NULL;
+    FoundCacheEntry = YoriLibHashLookupByKey(ScopeContext->VariableCache, VariableName);
+    if (FoundCacheEntry == NULL) {
+        ScopeContext->MakeContext->VariableCacheMisses++;
+    } else {
+        CacheEntry = FoundCacheEntry->Context;
+        if (YoriLibCompareString(&CacheEntry->HashEntry.Key, VariableName) != 0) {
+            ScopeContext->MakeContext->VariableCacheCaseMismatches++;
+        } else if (CacheEntry->Generation != ScopeContext->MakeContext->VariableGeneration) {
+            ScopeContext->MakeContext->VariableCacheStale++;
+        } else {
+            ScopeContext->MakeContext->VariableCacheHits++;
+            VariableData->StartOfString = CacheEntry->Value.StartOfString;
+            VariableData->LengthInChars = CacheEntry->Value.LengthInChars;
+            return TRUE;
+        }
+    }
+
     YoriLibInitEmptyString(&NameToFind);
     YoriLibInitEmptyString(&SearchText);
     YoriLibInitEmptyString(&ReplaceText);
@@ -280,6 +385,11 @@ MakeSubstituteNamedVariable(
     if (SearchText.LengthInChars == 0) {
         VariableData->StartOfString = FoundVariable->Value.StartOfString;
         VariableData->LengthInChars = FoundVariable->Value.LengthInChars;
+        if (FoundCacheEntry == NULL) {
+            MakeCacheVariableReference(ScopeContext, NULL, VariableName, &FoundVariable->Value);
+        } else if (YoriLibCompareString(&CacheEntry->HashEntry.Key, VariableName) == 0) {
+            MakeCacheVariableReference(ScopeContext, CacheEntry, VariableName, &FoundVariable->Value);
+        }
         return TRUE;
     }
 
@@ -340,6 +450,11 @@ MakeSubstituteNamedVariable(
     }
 
     VariableData->LengthInChars = LengthNeeded;
+    if (FoundCacheEntry == NULL) {
+        MakeCacheVariableReference(ScopeContext, NULL, VariableName, VariableData);
+    } else if (YoriLibCompareString(&CacheEntry->HashEntry.Key, VariableName) == 0) {
+        MakeCacheVariableReference(ScopeContext, CacheEntry, VariableName, VariableData);
+    }
     return TRUE;
 }
 
@@ -552,6 +667,13 @@ MakeSetVariable(
     PYORI_HASH_ENTRY FoundVariableEntry;
     PMAKE_VARIABLE FoundVariable;
 
+    //
+    //  Any reference resolved before this point may now refer to a
+    //  different value, in this scope or any child scope.
+    //
+
+    ScopeContext->MakeContext->VariableGeneration++;
+
     FoundVariableEntry = YoriLibHashLookupByKey(ScopeContext->Variables, Variable);
     if (FoundVariableEntry != NULL) {
         FoundVariable = FoundVariableEntry->Context;
@@ -585,13 +707,25 @@ MakeSetVariable(
     } else {
         YORI_STRING VariableNameCopy;
         YORI_ALLOC_SIZE_T LengthNeeded;
+        PVOID MemoryToFree;
 
         LengthNeeded = Variable->LengthInChars;
         if (Value != NULL) {
             LengthNeeded = LengthNeeded + Value->LengthInChars;
         }
 
-        FoundVariable = YoriLibReferencedMalloc(sizeof(MAKE_VARIABLE) + LengthNeeded * sizeof(TCHAR));
+        //
+        //  The variable is owned by the scope's arena.  If it has a value,
+        //  the value holds a reference on the underlying allocation so that
+        //  it can be cloned and outlive the scope like any other string.
+        //
+
+        MemoryToFree = NULL;
+        if (Value != NULL) {
+            FoundVariable = YoriLibArenaAlloc(&ScopeContext->Arena, sizeof(MAKE_VARIABLE) + LengthNeeded * sizeof(TCHAR), &MemoryToFree);
+        } else {
+            FoundVariable = YoriLibArenaAlloc(&ScopeContext->Arena, sizeof(MAKE_VARIABLE) + LengthNeeded * sizeof(TCHAR), NULL);
+        }
         if (FoundVariable == NULL) {
             return FALSE;
         }
@@ -612,8 +746,7 @@ MakeSetVariable(
 
         YoriLibInitEmptyString(&FoundVariable->Value);
         if (Value != NULL) {
-            YoriLibReference(FoundVariable);
-            FoundVariable->Value.MemoryToFree = FoundVariable;
+            FoundVariable->Value.MemoryToFree = MemoryToFree;
             FoundVariable->Value.StartOfString = VariableNameCopy.StartOfString + VariableNameCopy.LengthInChars;
             memcpy(FoundVariable->Value.StartOfString, Value->StartOfString, Value->LengthInChars * sizeof(TCHAR));
             FoundVariable->Value.LengthAllocated = Value->LengthInChars;
@@ -560,17 +560,17 @@ YoriPkgFreeExistingFiles(
     __in PYORIPKG_PACKAGES_PENDING_INSTALL PendingPackages
     )
 {
-    DWORD BucketIndex;
-    PYORI_HASH_BUCKET Bucket;
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_HASH_ENTRY NextHashEntry;
     PYORIPKG_EXISTING_FILE ExistingFile;
 
-    for (BucketIndex = 0; BucketIndex < PendingPackages->ExistingFilesTable->NumberBuckets; BucketIndex++) {
-        Bucket = &PendingPackages->ExistingFilesTable->Buckets[BucketIndex];
-        while (!YoriLibIsListEmpty(&Bucket->ListHead)) {
-            ExistingFile = CONTAINING_RECORD(Bucket->ListHead.Next, YORIPKG_EXISTING_FILE, HashEntry.ListEntry);
-            YoriLibHashRemoveByEntry(&ExistingFile->HashEntry);
-            YoriLibDereference(ExistingFile);
-        }
+    HashEntry = YoriLibHashGetNextEntry(PendingPackages->ExistingFilesTable, NULL);
+    while (HashEntry != NULL) {
+        NextHashEntry = YoriLibHashGetNextEntry(PendingPackages->ExistingFilesTable, HashEntry);
+        ExistingFile = CONTAINING_RECORD(HashEntry, YORIPKG_EXISTING_FILE, HashEntry);
+        YoriLibHashRemoveByEntry(&ExistingFile->HashEntry);
+        YoriLibDereference(ExistingFile);
+        HashEntry = NextHashEntry;
     }
 }
 
@@ -366,12 +366,14 @@ RegeditPopulateKeyValueList(
         //  If it failed, tell the user.  Otherwise, sort, and add them to the
         //  list.  If an item should be selected, find the index of a matching
         //  string or the first item to be greater than it, and select that.
+        //  Keys such as HKCR\CLSID contain enough subkeys to benefit from
+        //  sorting with all processors.
         //
 
         if (Err != ERROR_SUCCESS) {
             RegeditDisplayWin32Error(Parent, Err);
         } else if (Index > 0) {
-            YoriLibSortStringArray(StringArray, Index);
+            YoriLibSortStringArrayEx(StringArray, Index, YORI_LIB_SORT_PARALLEL);
             YoriWinListAddItems(KeyListCtrl, StringArray, Index);
             if (SelectKey != NULL) {
                 for (SelectIndex = 0; SelectIndex < Index; SelectIndex++) {
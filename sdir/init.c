@@ -610,10 +610,8 @@ SdirAppCleanup(VOID)
     YoriLibFileFiltFreeFilter(&SdirGlobal.FileColorCriteria);
     YoriLibFileFiltFreeFilter(&SdirGlobal.FileHideCriteria);
 
-    if (SdirDirCollection != NULL) {
-        YoriLibFree(SdirDirCollection);
-        SdirDirCollection = NULL;
-    }
+    YoriLibCleanupArena(&SdirDirArena);
+    SdirDirSpareEntry = NULL;
 
     if (SdirDirSorted != NULL) {
         YoriLibFree(SdirDirSorted);
@@ -31,15 +31,25 @@
 
 
 /**
- Specifies the number of directory entries that are currently allocated.
+ Specifies the number of directory entries that can be recorded in the
+ sorted array before it needs to be reallocated.
  */
 YORI_ALLOC_SIZE_T SdirAllocatedDirents;
 
 /**
- Pointer to an array of directory entries.  This corresponds to files in
- a single directory, populated in response to enumerate.
+ An arena that directory entries are allocated from.  This corresponds to
+ files in a single directory, populated in response to enumerate.  Entries
+ do not move once allocated, so the collection can grow while the
+ directory is being enumerated.
  */
-PYORI_FILE_INFO SdirDirCollection;
+YORI_LIB_ARENA SdirDirArena;
+
+/**
+ Points to a directory entry that was allocated from SdirDirArena but not
+ added to the collection because the file is hidden.  This is reused for
+ the next file found.
+ */
+PYORI_FILE_INFO SdirDirSpareEntry;
 
 /**
  Pointer to an array of pointers to directory entries.  These pointers
@@ -67,6 +77,12 @@ YORI_ALLOC_SIZE_T SdirDirCollectionLongest;
  */
 ULONG SdirDirCollectionTotalNameLength;
 
+/**
+ Set to TRUE if an entry has been added to the collection out of order, so
+ the collection needs to be sorted before it is displayed.
+ */
+BOOLEAN SdirDirCollectionNeedsSort;
+
 /**
  Pointer to a dynamically allocated options structure which contains run
  time configuration about the application.
@@ -190,6 +206,45 @@ SdirRenderAttributesFromPath (
     }
 }
 
+/**
+ Reallocate the array of sorted directory entries so that more entries can be
+ added to the collection.  The entries themselves are allocated from an arena
+ and do not move, so only the pointers to them are copied.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+BOOL
+SdirGrowCollection(VOID)
+{
+    PYORI_FILE_INFO * NewSdirDirSorted;
+    YORI_MAX_UNSIGNED_T NewAllocatedDirents;
+    YORI_MAX_UNSIGNED_T BytesRequired;
+
+    NewAllocatedDirents = SdirAllocatedDirents;
+    if (SdirDirSorted != NULL) {
+        NewAllocatedDirents = NewAllocatedDirents * 2;
+    }
+
+    BytesRequired = NewAllocatedDirents * sizeof(PYORI_FILE_INFO);
+    if (!YoriLibIsSizeAllocatable(BytesRequired)) {
+        return FALSE;
+    }
+
+    NewSdirDirSorted = YoriLibMalloc((YORI_ALLOC_SIZE_T)BytesRequired);
+    if (NewSdirDirSorted == NULL) {
+        return FALSE;
+    }
+
+    if (SdirDirSorted != NULL) {
+        memcpy(NewSdirDirSorted, SdirDirSorted, SdirDirCollectionCurrent * sizeof(PYORI_FILE_INFO));
+        YoriLibFree(SdirDirSorted);
+    }
+
+    SdirDirSorted = NewSdirDirSorted;
+    SdirAllocatedDirents = (YORI_ALLOC_SIZE_T)NewAllocatedDirents;
+    return TRUE;
+}
+
 /**
  Add a single found object to the set of files found so far.
 
@@ -207,17 +262,22 @@ SdirAddToCollection (
     ) 
 {
     PYORI_FILE_INFO CurrentEntry;
-    YORI_ALLOC_SIZE_T i, j;
-    DWORD CompareResult = 0;
 
-    if (SdirDirCollectionCurrent >= SdirAllocatedDirents) {
-        if (SdirDirCollectionCurrent < ((YORI_ALLOC_SIZE_T)-1)) {
-            SdirDirCollectionCurrent++;
+    if (SdirDirCollectionCurrent >= SdirAllocatedDirents || SdirDirSorted == NULL) {
+        if (!SdirGrowCollection()) {
+            return FALSE;
         }
-        return FALSE;
     }
 
-    CurrentEntry = &SdirDirCollection[SdirDirCollectionCurrent];
+    if (SdirDirSpareEntry != NULL) {
+        CurrentEntry = SdirDirSpareEntry;
+        SdirDirSpareEntry = NULL;
+    } else {
+        CurrentEntry = YoriLibArenaAlloc(&SdirDirArena, sizeof(YORI_FILE_INFO), NULL);
+        if (CurrentEntry == NULL) {
+            return FALSE;
+        }
+    }
 
     SdirDirCollectionCurrent++;
 
@@ -226,6 +286,7 @@ SdirAddToCollection (
     if (CurrentEntry->RenderAttributes.Ctrl & YORILIB_ATTRCTRL_HIDE) {
 
         SdirDirCollectionCurrent--;
+        SdirDirSpareEntry = CurrentEntry;
         return TRUE;
     }
 
@@ -240,47 +301,211 @@ SdirAddToCollection (
     }
 
     //
-    //  Now that our internal entry is fully poulated, insert it into the
-    //  correct sorted position.  As an optimization, check if we just need
-    //  to insert at the end (for file name sort on NTFS, this is the
-    //  common case.)
+    //  Now that our internal entry is fully poulated, append it to the
+    //  sorted array.  As an optimization, check if it is already in order
+    //  (for file name sort on NTFS, this is the common case.)  If not,
+    //  remember that the collection needs to be sorted before it is
+    //  displayed.
     //
 
     if (SdirDirCollectionCurrent > 1 &&
-        Opts->Sort[0].CompareFn(SdirDirSorted[SdirDirCollectionCurrent - 2], CurrentEntry) == Opts->Sort[0].CompareInverseCondition) {
+        !SdirDirCollectionNeedsSort &&
+        Opts->Sort[0].CompareFn(SdirDirSorted[SdirDirCollectionCurrent - 2], CurrentEntry) != Opts->Sort[0].CompareInverseCondition) {
 
-        SdirDirSorted[SdirDirCollectionCurrent - 1] = CurrentEntry;
-        return TRUE;
+        SdirDirCollectionNeedsSort = TRUE;
     }
 
-    //
-    //  Currently sorting is done very inefficiently by a selection sort
-    //  type algorithm.  Generally this doesn't run due to the optimization
-    //  above.  When a different sort order is requested, performance could
-    //  be improved by using a better algorithm here.
-    //
+    SdirDirSorted[SdirDirCollectionCurrent - 1] = CurrentEntry;
+    return TRUE;
+}
+
+/**
+ Compare two directory entries using all of the sort criteria specified by
+ the user.
 
-    for (i = 0; i < SdirDirCollectionCurrent - 1; i++) {
+ @param Left Pointer to the first directory entry.
 
-        for (j = 0; j < Opts->CurrentSort; j++) {
-            CompareResult = Opts->Sort[j].CompareFn(SdirDirSorted[i], CurrentEntry);
+ @param Right Pointer to the second directory entry.
 
-            if (CompareResult == Opts->Sort[j].CompareBreakCondition ||
-                CompareResult == Opts->Sort[j].CompareInverseCondition) {
-                break;
-            }
+ @return YORI_LIB_LESS_THAN if Left should be displayed before Right,
+         YORI_LIB_GREATER_THAN if Left should be displayed after Right, or
+         YORI_LIB_EQUAL if the user's sort criteria cannot distinguish them.
+ */
+DWORD
+SdirCompareForSort(
+    __in PYORI_FILE_INFO Left,
+    __in PYORI_FILE_INFO Right
+    )
+{
+    DWORD CompareResult;
+    DWORD Index;
+
+    for (Index = 0; Index < Opts->CurrentSort; Index++) {
+        CompareResult = Opts->Sort[Index].CompareFn(Left, Right);
+
+        if (CompareResult == Opts->Sort[Index].CompareBreakCondition) {
+            return YORI_LIB_GREATER_THAN;
+        }
+
+        if (CompareResult == Opts->Sort[Index].CompareInverseCondition) {
+            return YORI_LIB_LESS_THAN;
+        }
+    }
+
+    return YORI_LIB_EQUAL;
+}
+
+/**
+ Sort a range of the sorted array by inserting each element into position.
+ This is used for small ranges where a merge has more overhead than it
+ saves, and as a fallback if the merge buffer cannot be allocated.  This
+ sort is stable, so entries that compare equal remain in enumeration order.
+
+ @param Array Pointer to the array of directory entry pointers to sort.
+
+ @param Count The number of elements in the array.
+ */
+VOID
+SdirInsertionSortRange(
+    __inout PYORI_FILE_INFO * Array,
+    __in YORI_ALLOC_SIZE_T Count
+    )
+{
+    YORI_ALLOC_SIZE_T Index;
+    YORI_ALLOC_SIZE_T InsertPoint;
+    PYORI_FILE_INFO Entry;
+
+    for (Index = 1; Index < Count; Index++) {
+        Entry = Array[Index];
+        InsertPoint = Index;
+        while (InsertPoint > 0 &&
+               SdirCompareForSort(Array[InsertPoint - 1], Entry) == YORI_LIB_GREATER_THAN) {
+
+            Array[InsertPoint] = Array[InsertPoint - 1];
+            InsertPoint--;
+        }
+        Array[InsertPoint] = Entry;
+    }
+}
+
+/**
+ The number of elements in each run that is sorted by insertion before runs
+ are merged.
+ */
+#define SDIR_SORT_RUN_LENGTH 16
+
+/**
+ Sort the collection of directory entries according to the user's sort
+ criteria.  Entries are appended in enumeration order as they are found,
+ and sorted once here before display, which is O(n log n) rather than the
+ O(n^2) cost of inserting each entry into its sorted position as it is
+ found.  This is a bottom up merge sort, which is stable, so entries that
+ compare equal retain their enumeration order.  Adjacent runs which are
+ already in order are not merged, so partially sorted input is cheap.
+ */
+VOID
+SdirSortCollection(VOID)
+{
+    PYORI_FILE_INFO * Source;
+    PYORI_FILE_INFO * Dest;
+    PYORI_FILE_INFO * Temp;
+    PYORI_FILE_INFO * MergeBuffer;
+    YORI_ALLOC_SIZE_T Count;
+    YORI_ALLOC_SIZE_T RunLength;
+    YORI_ALLOC_SIZE_T Start;
+    YORI_ALLOC_SIZE_T Middle;
+    YORI_ALLOC_SIZE_T End;
+    YORI_ALLOC_SIZE_T LeftIndex;
+    YORI_ALLOC_SIZE_T RightIndex;
+    YORI_ALLOC_SIZE_T DestIndex;
+
+    if (!SdirDirCollectionNeedsSort) {
+        return;
+    }
+
+    SdirDirCollectionNeedsSort = FALSE;
+    Count = SdirDirCollectionCurrent;
+    if (Count < 2) {
+        return;
+    }
+
+    if (Count <= SDIR_SORT_RUN_LENGTH) {
+        SdirInsertionSortRange(SdirDirSorted, Count);
+        return;
+    }
+
+    MergeBuffer = YoriLibMalloc(Count * sizeof(PYORI_FILE_INFO));
+    if (MergeBuffer == NULL) {
+        SdirInsertionSortRange(SdirDirSorted, Count);
+        return;
+    }
+
+    for (Start = 0; Start < Count; Start += SDIR_SORT_RUN_LENGTH) {
+        End = Count - Start;
+        if (End > SDIR_SORT_RUN_LENGTH) {
+            End = SDIR_SORT_RUN_LENGTH;
         }
+        SdirInsertionSortRange(&SdirDirSorted[Start], End);
+    }
 
-        if (CompareResult == Opts->Sort[j].CompareBreakCondition) {
-            for (j = SdirDirCollectionCurrent - 1; j > i; j--) {
-                SdirDirSorted[j] = SdirDirSorted[j - 1];
+    Source = SdirDirSorted;
+    Dest = MergeBuffer;
+
+    for (RunLength = SDIR_SORT_RUN_LENGTH; RunLength < Count; RunLength = RunLength * 2) {
+        for (Start = 0; Start < Count; Start = End) {
+            Middle = Count;
+            End = Count;
+            if (Count - Start > RunLength) {
+                Middle = Start + RunLength;
+                if (Count - Middle > RunLength) {
+                    End = Middle + RunLength;
+                }
+            }
+
+            //
+            //  If there's no right run, or the two runs are already in
+            //  order, this range can be copied as is.
+            //
+
+            if (Middle == End ||
+                SdirCompareForSort(Source[Middle - 1], Source[Middle]) != YORI_LIB_GREATER_THAN) {
+
+                memcpy(&Dest[Start], &Source[Start], (End - Start) * sizeof(PYORI_FILE_INFO));
+                continue;
+            }
+
+            LeftIndex = Start;
+            RightIndex = Middle;
+            DestIndex = Start;
+
+            while (LeftIndex < Middle && RightIndex < End) {
+                if (SdirCompareForSort(Source[LeftIndex], Source[RightIndex]) == YORI_LIB_GREATER_THAN) {
+                    Dest[DestIndex] = Source[RightIndex];
+                    RightIndex++;
+                } else {
+                    Dest[DestIndex] = Source[LeftIndex];
+                    LeftIndex++;
+                }
+                DestIndex++;
+            }
+
+            if (LeftIndex < Middle) {
+                memcpy(&Dest[DestIndex], &Source[LeftIndex], (Middle - LeftIndex) * sizeof(PYORI_FILE_INFO));
+            } else if (RightIndex < End) {
+                memcpy(&Dest[DestIndex], &Source[RightIndex], (End - RightIndex) * sizeof(PYORI_FILE_INFO));
             }
-            SdirDirSorted[i] = CurrentEntry;
-            return TRUE;
         }
+
+        Temp = Source;
+        Source = Dest;
+        Dest = Temp;
     }
-    SdirDirSorted[SdirDirCollectionCurrent - 1] = CurrentEntry;
-    return TRUE;
+
+    if (Source != SdirDirSorted) {
+        memcpy(SdirDirSorted, Source, Count * sizeof(PYORI_FILE_INFO));
+    }
+
+    YoriLibFree(MergeBuffer);
 }
 
 /**
@@ -391,7 +616,10 @@ SdirItemFoundCallback(
         //  Display the default stream
         //
 
-        SdirAddToCollection(FindData, FullPath);
+        if (!SdirAddToCollection(FindData, FullPath)) {
+            ItemContext->Error = ERROR_NOT_ENOUGH_MEMORY;
+            return FALSE;
+        }
 
         //
         //  Look for any named streams
@@ -461,7 +689,11 @@ SdirItemFoundCallback(
                     if (!YoriLibUpdateFindDataFromFileInformation(&BogusFindData, ItemContext->StreamFullPath.StartOfString, FALSE)) {
                         memcpy(&BogusFindData, &FindData, sizeof(FindData));
                     }
-                    SdirAddToCollection(&BogusFindData, &ItemContext->StreamFullPath);
+                    if (!SdirAddToCollection(&BogusFindData, &ItemContext->StreamFullPath)) {
+                        ItemContext->Error = ERROR_NOT_ENOUGH_MEMORY;
+                        FindClose(hStreamFind);
+                        return FALSE;
+                    }
                 }
             } while (DllKernel32.pFindNextStreamW(hStreamFind, &FindStreamData));
         }
@@ -470,7 +702,10 @@ SdirItemFoundCallback(
 
     } else {
 #endif
-        SdirAddToCollection(FindData, FullPath);
+        if (!SdirAddToCollection(FindData, FullPath)) {
+            ItemContext->Error = ERROR_NOT_ENOUGH_MEMORY;
+            return FALSE;
+        }
 #if defined(UNICODE)
     }
 #endif
@@ -478,69 +713,6 @@ SdirItemFoundCallback(
     return TRUE;
 }
 
-/**
- Copy entries from one old sorted array allocation to a new allocation.
- When this occurs the pointer values in the old array need to be adjusted
- from the old allocation to the new allocation.  In addition, entries may
- have been inserted into the old collection which should not be preserved
- because they will be reenumerated.  When this occurs they will be in the
- sorted array in sorted order, so any entry beyond the end of the
- collection array should not be propagated to the new sort array.
-
- @param OldCollection Pointer to the previous array of directory entries.
-
- @param NewCollection Pointer to the new array of directory entries.  This,
-        combined with OldCollection, implies the offset adjustment to apply
-        to any entry within the sorted array.
-
- @param NumberEntriesToCopy Specifies the maximum number of entries that
-        should be copied into the new sorted array.  This is the number of
-        entries within the collection that are being preserved; newer entries
-        will be enumerated again in a subsequent operation.
-
- @param OldSorted Pointer to the previous array of sorted entries.  Entries
-        within this array will be filtered against NumberEntriesToCopy,
-        adjusted based on pointer offset, and propagated to the new array.
-
- @param NewSorted Pointer to the new array of sorted entries.  This will be
-        populated within this routine.
-
- @param NumberSortedEntries The number of elements in the OldSorted array.
- */
-VOID
-SdirMoveSortedEntries(
-    __in PYORI_FILE_INFO OldCollection,
-    __in PYORI_FILE_INFO NewCollection,
-    __in YORI_ALLOC_SIZE_T NumberEntriesToCopy,
-    __in_ecount(NumberSortedEntries) PYORI_FILE_INFO* OldSorted,
-    __out_ecount(NumberEntriesToCopy) PYORI_FILE_INFO* NewSorted,
-    __in YORI_ALLOC_SIZE_T NumberSortedEntries
-    )
-{
-    YORI_ALLOC_SIZE_T SrcIndex;
-    YORI_ALLOC_SIZE_T DestIndex;
-    PYORI_FILE_INFO ThisEntry;
-
-    DestIndex = 0;
-    for (SrcIndex = 0; SrcIndex < NumberSortedEntries; SrcIndex++) {
-        ThisEntry = (PYORI_FILE_INFO)OldSorted[SrcIndex];
-        ASSERT(ThisEntry >= OldCollection);
-        if (ThisEntry < &OldCollection[NumberEntriesToCopy]) {
-            ASSERT(DestIndex < NumberEntriesToCopy);
-            if (DestIndex >= NumberEntriesToCopy) {
-                break;
-            }
-            NewSorted[DestIndex] = (PYORI_FILE_INFO)((PUCHAR)ThisEntry -
-                                                     (PUCHAR)OldCollection +
-                                                     (PUCHAR)NewCollection);
-            DestIndex++;
-        }
-    }
-
-    ASSERT(DestIndex == NumberEntriesToCopy);
-}
-
-
 /**
  Enumerate all of the files in a given single directory/wildcard pattern,
  and populate the results into the global SdirAllocatedDirents array.
@@ -558,10 +730,6 @@ SdirEnumeratePathWithDepth (
     )
 {
     LPTSTR FinalPart;
-    YORI_ALLOC_SIZE_T DirEntsToPreserve;
-    SDIR_SUMMARY SummaryToPreserve;
-    PYORI_FILE_INFO NewSdirDirCollection;
-    PYORI_FILE_INFO * NewSdirDirSorted;
     SDIR_ITEM_FOUND_CONTEXT ItemFoundContext;
     WORD MatchFlags;
 
@@ -641,163 +809,80 @@ SdirEnumeratePathWithDepth (
     }
 
     //
-    //  We loop enumerating all the files.  Hopefully for common directories
-    //  we'll allocate a big enough buffer in the first case and we can then
-    //  just populate that buffer and display it.  If the directory is large
-    //  enough though, we count the number of entries, loop back, and allocate
-    //  a large enough buffer to hold the result, then enumerate it again.
-    //  Because we sort the output, we must keep the entire set in memory to
-    //  be able to meaningfully process it.
+    //  Directory entries are allocated as files are found, so the collection
+    //  can grow without enumerating the directory again.
     //
 
-    DirEntsToPreserve = SdirDirCollectionCurrent;
-    memcpy(&SummaryToPreserve, Summary, sizeof(SummaryToPreserve));
+    //
+    //  If we can't find enumerate, display the error except when we're recursive
+    //  and the error is we found no files in this particular directory.
+    //
 
-    do {
+    ItemFoundContext.ItemsFound = 0;
+    MatchFlags = YORILIB_FILEENUM_RETURN_FILES | YORILIB_FILEENUM_RETURN_DIRECTORIES | YORILIB_FILEENUM_INCLUDE_DOTFILES;
 
-        //
-        //  If this is a subsequent pass and we didn't allocate a big enough
-        //  buffer, reallocate our buffers.  Add an extra 64 just in case
-        //  we're still adding files in real time.
-        //
+    //
+    //  MSFIX This isn't really correct without a major refactor.  What
+    //  we want is to allow full expansion of the search criteria but
+    //  basic expansion of the search path, since it was the result of
+    //  a prior enumerate.
+    //
 
-        if (SdirDirCollectionCurrent >= SdirAllocatedDirents || SdirDirCollection == NULL) {
-            YORI_ALLOC_SIZE_T PreviousAllocatedDirents = SdirAllocatedDirents;
-            DWORD BytesRequired;
+    if (Depth > 0 || Opts->BasicEnumeration) {
+        MatchFlags |= YORILIB_FILEENUM_BASIC_EXPANSION;
+    }
 
-            if (SdirDirCollectionCurrent >= SdirAllocatedDirents) {
-                SdirAllocatedDirents = SdirDirCollectionCurrent + 1;
-            }
-            if (SdirAllocatedDirents < UINT_MAX - 64) {
-                SdirAllocatedDirents += 64;
-            }
+    YoriLibInitEmptyString(&ItemFoundContext.StreamFullPath);
+    ItemFoundContext.Error = ERROR_SUCCESS;
 
-            BytesRequired = SdirAllocatedDirents;
-            BytesRequired = BytesRequired * sizeof(YORI_FILE_INFO);
-            if (!YoriLibIsSizeAllocatable(BytesRequired)) {
-                SdirAllocatedDirents = SdirDirCollectionCurrent;
-                SdirWriteStringWithAttribute(_T("Too many files for a single memory allocation\n"), Opts->FtError.HighlightColor);
-                return FALSE;
-            }
+    if (!YoriLibForEachFile(FindStr,
+                            MatchFlags,
+                            0,
+                            SdirItemFoundCallback,
+                            SdirEnumerateErrorCallback,
+                            &ItemFoundContext)) {
 
-            NewSdirDirCollection = YoriLibMalloc(SdirAllocatedDirents * sizeof(YORI_FILE_INFO));
-            if (NewSdirDirCollection == NULL) {
-                SdirAllocatedDirents = SdirDirCollectionCurrent;
-                SdirDisplayError(GetLastError(), _T("YoriLibMalloc"));
-                return FALSE;
-            }
-
-            NewSdirDirSorted = YoriLibMalloc(SdirAllocatedDirents * sizeof(PYORI_FILE_INFO));
-            if (NewSdirDirSorted == NULL) {
-                SdirAllocatedDirents = SdirDirCollectionCurrent;
-                YoriLibFree(NewSdirDirCollection);
-                SdirDisplayError(GetLastError(), _T("YoriLibMalloc"));
-                return FALSE;
+        if (!Opts->Recursive) {
+            if (ItemFoundContext.Error == ERROR_SUCCESS) {
+                ItemFoundContext.Error = GetLastError();
             }
+            YoriLibFreeStringContents(&ItemFoundContext.StreamFullPath);
 
             //
-            //  Copy back any previous data.  This occurs when multiple
-            //  criteria are specified, eg., "*.a *.b".  Apply fixups to
-            //  everything in the sorted array which were based on the
-            //  previous collection and now need to be based on the new one.
+            //  For file not found errors, continue enumerating through
+            //  all of the criteria specified by the user, and display
+            //  it only if there are no files from any criteria
             //
 
-            if (DirEntsToPreserve > 0 && SdirDirCollection != NULL) {
-                memcpy(NewSdirDirCollection, SdirDirCollection, sizeof(YORI_FILE_INFO)*DirEntsToPreserve);
-                SdirMoveSortedEntries(SdirDirCollection, NewSdirDirCollection, DirEntsToPreserve, SdirDirSorted, NewSdirDirSorted, PreviousAllocatedDirents);
-            }
-
-            if (SdirDirCollection != NULL) {
-                YoriLibFree(SdirDirCollection);
-            }
-
-            if (SdirDirSorted != NULL) {
-                YoriLibFree(SdirDirSorted);
-            }
-
-            SdirDirCollection = NewSdirDirCollection;
-            SdirDirSorted = NewSdirDirSorted;
-            SdirDirCollectionCurrent = DirEntsToPreserve;
-            memcpy(Summary, &SummaryToPreserve, sizeof(SummaryToPreserve));
-        }
-
-        //
-        //  If we can't find enumerate, display the error except when we're recursive
-        //  and the error is we found no files in this particular directory.
-        //
-
-        ItemFoundContext.ItemsFound = 0;
-        MatchFlags = YORILIB_FILEENUM_RETURN_FILES | YORILIB_FILEENUM_RETURN_DIRECTORIES | YORILIB_FILEENUM_INCLUDE_DOTFILES;
-
-        //
-        //  MSFIX This isn't really correct without a major refactor.  What
-        //  we want is to allow full expansion of the search criteria but
-        //  basic expansion of the search path, since it was the result of
-        //  a prior enumerate.
-        //
-
-        if (Depth > 0 || Opts->BasicEnumeration) {
-            MatchFlags |= YORILIB_FILEENUM_BASIC_EXPANSION;
-        }
-
-        YoriLibInitEmptyString(&ItemFoundContext.StreamFullPath);
-        ItemFoundContext.Error = ERROR_SUCCESS;
-
-        if (!YoriLibForEachFile(FindStr,
-                                MatchFlags,
-                                0,
-                                SdirItemFoundCallback,
-                                SdirEnumerateErrorCallback,
-                                &ItemFoundContext)) {
-
-            if (!Opts->Recursive) {
-                if (ItemFoundContext.Error == ERROR_SUCCESS) {
-                    ItemFoundContext.Error = GetLastError();
-                }
-                YoriLibFreeStringContents(&ItemFoundContext.StreamFullPath);
-
-                //
-                //  For file not found errors, continue enumerating through
-                //  all of the criteria specified by the user, and display
-                //  it only if there are no files from any criteria
-                //
-
-                if (ItemFoundContext.Error != ERROR_FILE_NOT_FOUND) {
-                    SdirDisplayYsError(ItemFoundContext.Error, FindStr);
-                    SetLastError(ItemFoundContext.Error);
-                } else {
-                    return TRUE;
-                }
+            if (ItemFoundContext.Error != ERROR_FILE_NOT_FOUND) {
+                SdirDisplayYsError(ItemFoundContext.Error, FindStr);
+                SetLastError(ItemFoundContext.Error);
             } else {
-                YoriLibFreeStringContents(&ItemFoundContext.StreamFullPath);
+                return TRUE;
             }
-            return FALSE;
+        } else {
+            YoriLibFreeStringContents(&ItemFoundContext.StreamFullPath);
         }
+        return FALSE;
+    }
 
-        YoriLibFreeStringContents(&ItemFoundContext.StreamFullPath);
+    YoriLibFreeStringContents(&ItemFoundContext.StreamFullPath);
 
-        if (ItemFoundContext.ItemsFound == 0) {
-            if (!Opts->Recursive) {
-                if (ItemFoundContext.Error == ERROR_SUCCESS) {
-                    ItemFoundContext.Error = ERROR_FILE_NOT_FOUND;
-                }
+    if (ItemFoundContext.ItemsFound == 0) {
+        if (!Opts->Recursive) {
+            if (ItemFoundContext.Error == ERROR_SUCCESS) {
+                ItemFoundContext.Error = ERROR_FILE_NOT_FOUND;
+            }
 
-                if (ItemFoundContext.Error != ERROR_FILE_NOT_FOUND) {
-                    SdirDisplayYsError(ItemFoundContext.Error, FindStr);
-                } else {
-                    return TRUE;
-                }
+            if (ItemFoundContext.Error != ERROR_FILE_NOT_FOUND) {
+                SdirDisplayYsError(ItemFoundContext.Error, FindStr);
+            } else {
+                return TRUE;
             }
-            SetLastError(ERROR_FILE_NOT_FOUND);
-            return FALSE;
         }
-
-        //
-        //  If we've encountered more than we've allocated, go back
-        //  and reallocate.
-        //
-
-    } while (SdirDirCollectionCurrent >= SdirAllocatedDirents);
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return FALSE;
+    }
 
     return TRUE;
 }
@@ -926,6 +1011,8 @@ SdirDisplayCollection(VOID)
     }
 #endif
 
+    SdirSortCollection();
+
     //
     //  If we're allowed to shorten names to make the display more
     //  legible, we won't allow a longest name greater than twice
@@ -1466,6 +1553,9 @@ SdirEnumerateAndDisplaySubtree (
     SdirDirCollectionCurrent = 0;
     SdirDirCollectionLongest = 0;
     SdirDirCollectionTotalNameLength = 0;
+    SdirDirCollectionNeedsSort = FALSE;
+    SdirDirSpareEntry = NULL;
+    YoriLibResetArena(&SdirDirArena);
 
     if (ParentDirectory.LengthInChars == 0 ||
         ParentDirectory.StartOfString[ParentDirectory.LengthInChars - 1] == '\\') {
@@ -1626,17 +1716,26 @@ ENTRYPOINT(
     )
 {
     SdirAllocatedDirents = 1000;
-    SdirDirCollection = NULL;
+    YoriLibInitializeArena(&SdirDirArena, 64 * sizeof(YORI_FILE_INFO));
+    SdirDirSpareEntry = NULL;
     SdirDirSorted = NULL;
     SdirDirCollectionCurrent = 0;
     SdirDirCollectionLongest = 0;
     SdirDirCollectionTotalNameLength = 0;
+    SdirDirCollectionNeedsSort = FALSE;
     SdirWriteStringLinesDisplayed = 0;
 
     if (!SdirInit(ArgC, ArgV)) {
         goto restore_and_exit;
     }
 
+    //
+    //  sdir writes each run of characters with the same color separately.
+    //  When the output is not a console, batch these into larger writes.
+    //
+
+    YoriLibEnableOutputBuffering(GetStdHandle(STD_OUTPUT_HANDLE));
+
     if (Opts->Recursive) {
         if (!SdirEnumerateAndDisplayRecursive(ArgC, ArgV)) {
             goto restore_and_exit;
@@ -680,7 +680,8 @@ extern PSDIR_OPTS Opts;
 extern PSDIR_SUMMARY Summary;
 extern const SDIR_OPT SdirOptions[];
 extern const SDIR_EXEC SdirExec[];
-extern PYORI_FILE_INFO SdirDirCollection;
+extern YORI_LIB_ARENA SdirDirArena;
+extern PYORI_FILE_INFO SdirDirSpareEntry;
 extern PYORI_FILE_INFO * SdirDirSorted;
 extern WORD SdirWriteStringLinesDisplayed;
 
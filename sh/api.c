@@ -116,6 +116,18 @@ YoriApiBuiltinUnregister(
     return YoriLibShBuiltinUnregister(BuiltinCmd, CallbackFn);
 }
 
+/**
+ Remove all commands from the history file, if the user has configured one
+ with YORIHISTFILE.  History in memory is not changed.
+
+ @return TRUE if the history file was successfully cleared, FALSE if not.
+ */
+BOOL
+YoriApiClearHistoryFile(VOID)
+{
+    return YoriShClearHistoryFile();
+}
+
 /**
  Clear existing history strings.
 
@@ -356,6 +368,7 @@ YoriApiGetHistoryStrings(
     )
 {
     YoriLibInitEmptyString(HistoryStrings);
+    YoriShLoadOlderHistory();
     return YoriShGetHistoryStrings(MaximumNumber, HistoryStrings);
 }
 
@@ -433,6 +446,23 @@ YoriApiGetNextJobId(
     return YoriShGetNextJobId(PreviousJobId);
 }
 
+/**
+ Return counters describing the shell's cache of executables found in PATH
+ directories.
+
+ @param Statistics On successful completion, populated with the counters.
+
+ @return TRUE to indicate success, or FALSE if the shell is not caching
+         PATH directories.
+ */
+BOOL
+YoriApiGetPathIndexStatistics(
+    __out PYORI_LIB_PATH_INDEX_STATISTICS Statistics
+    )
+{
+    return YoriLibGetPathIndexStatistics(Statistics);
+}
+
 /**
  Build the complete set of system defined aliases into a an array of key value
  pairs and return a pointer to the result.  This must be freed with a
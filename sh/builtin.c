@@ -276,6 +276,13 @@ YoriShExecuteInProc(
     YoriShGlobal.EscapedArgQuotesPresent = ArgQuotesPresent;
     YoriShGlobal.RecursionDepth++;
     ExitCode = Fn(ArgC, NoEscapedArgV);
+
+    //
+    //  If the builtin buffered its output, write it before the redirected
+    //  handles are closed.
+    //
+
+    YoriLibDisableOutputBuffering();
     YoriShGlobal.RecursionDepth--;
     YoriShGlobal.EscapedArgC = SavedEscapedArgC;
     YoriShGlobal.EscapedArgV = SavedEscapedArgV;
@@ -202,9 +202,11 @@ YoriShPerformHistoryTabCompletion(
     FoundPath = NULL;
 
     //
-    //  Search the list of history.
+    //  Search the list of history, including anything that has not yet
+    //  been merged from the history file.
     //
 
+    YoriShLoadOlderHistory();
     ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, NULL);
     while (ListEntry != NULL) {
         HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
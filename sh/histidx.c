@@ -0,0 +1,830 @@
+/**
+ * @file sh/histidx.c
+ *
+ * Yori shell index of command history for substring search
+ *
+ * Copyright (c) 2018 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "yori.h"
+
+/**
+ The number of characters in each indexed substring.
+ */
+#define YORI_SH_HISTORY_GRAM_LENGTH (3)
+
+/**
+ The number of trigram slots to allocate when the index is first used.
+ This must be a power of two.
+ */
+#define YORI_SH_HISTORY_INITIAL_TRIGRAMS (1024)
+
+/**
+ The number of history entry slots to allocate when the index is first used.
+ */
+#define YORI_SH_HISTORY_INITIAL_ENTRIES (256)
+
+/**
+ The number of sequence numbers to allocate in a posting list when the
+ trigram is first encountered.
+ */
+#define YORI_SH_HISTORY_INITIAL_POSTINGS (4)
+
+/**
+ Information about a single three character substring that has been found
+ in one or more history entries.
+ */
+typedef struct _YORI_SH_HISTORY_TRIGRAM {
+
+    /**
+     The upcased characters of the trigram, combined with a marker bit so
+     that a populated slot is never zero.  Zero indicates an empty slot.
+     */
+    DWORDLONG Key;
+
+    /**
+     The number of sequence numbers populated in Sequences.
+     */
+    DWORD Count;
+
+    /**
+     The number of sequence numbers that Sequences has space for.
+     */
+    DWORD Allocated;
+
+    /**
+     An array of history entry sequence numbers in ascending order, one for
+     each entry which contains this trigram.  Entries which have since been
+     removed from history are not removed from this array; they are found to
+     be stale when looked up in the entry array.
+     */
+    PDWORD Sequences;
+} YORI_SH_HISTORY_TRIGRAM, *PYORI_SH_HISTORY_TRIGRAM;
+
+/**
+ The index of all history entries.  Each entry is assigned an increasing
+ sequence number as it is added, which is its offset within the entry array.
+ */
+typedef struct _YORI_SH_HISTORY_INDEX {
+
+    /**
+     An open addressed hash table of trigrams.  The number of slots is
+     always a power of two.
+     */
+    PYORI_SH_HISTORY_TRIGRAM Trigrams;
+
+    /**
+     The number of slots in the Trigrams table.
+     */
+    DWORD TrigramSlots;
+
+    /**
+     The number of populated slots in the Trigrams table.
+     */
+    DWORD TrigramCount;
+
+    /**
+     An array of history entries indexed by sequence number.  Entries that
+     have been removed from history are NULL.
+     */
+    PYORI_SH_HISTORY_ENTRY *Entries;
+
+    /**
+     The number of elements that Entries has space for.
+     */
+    DWORD EntriesAllocated;
+
+    /**
+     The sequence number to assign to the next history entry.
+     */
+    DWORD NextSequence;
+
+    /**
+     The number of non-NULL elements in Entries.
+     */
+    DWORD LiveEntries;
+
+    /**
+     Set to TRUE if an allocation failed while updating the index.  When this
+     occurs the index is discarded and searches scan the history list until
+     the history is cleared.
+     */
+    BOOLEAN Abandoned;
+} YORI_SH_HISTORY_INDEX, *PYORI_SH_HISTORY_INDEX;
+
+/**
+ The maximum number of distinct trigrams from a search string to use when
+ finding candidate entries.  Longer search strings use the least common
+ trigrams, and candidates are checked for the complete string.
+ */
+#define YORI_SH_HISTORY_MAX_QUERY_TERMS (8)
+
+/**
+ The state of a single trigram while searching for entries that contain
+ every trigram in a search string.
+ */
+typedef struct _YORI_SH_HISTORY_QUERY_TERM {
+
+    /**
+     Pointer to the trigram.
+     */
+    PYORI_SH_HISTORY_TRIGRAM Trigram;
+
+    /**
+     The number of elements in the trigram's posting list which have not yet
+     been excluded by the search.  The element before the cursor is the
+     most recent entry that remains a candidate.
+     */
+    DWORD Cursor;
+} YORI_SH_HISTORY_QUERY_TERM, *PYORI_SH_HISTORY_QUERY_TERM;
+
+/**
+ The global index of history entries.
+ */
+YORI_SH_HISTORY_INDEX YoriShHistoryIndex;
+
+/**
+ Generate the key for a trigram from three characters.
+
+ @param String Pointer to the first of three characters.
+
+ @return The key for the trigram.
+ */
+DWORDLONG
+YoriShHistoryTrigramKey(
+    __in LPCTSTR String
+    )
+{
+    DWORDLONG Key;
+
+    Key = 1;
+    Key = (Key << 16) | (WORD)YoriLibUpcaseChar(String[0]);
+    Key = (Key << 16) | (WORD)YoriLibUpcaseChar(String[1]);
+    Key = (Key << 16) | (WORD)YoriLibUpcaseChar(String[2]);
+    return Key;
+}
+
+/**
+ Find the slot within a trigram table that either contains a key or is where
+ the key should be inserted.
+
+ @param Trigrams Pointer to the trigram table.
+
+ @param TrigramSlots The number of slots in the table, which must be a power
+        of two.
+
+ @param Key The key to find.
+
+ @return Pointer to the slot.  If the key is not present, the slot's Key is
+         zero.
+ */
+PYORI_SH_HISTORY_TRIGRAM
+YoriShHistoryTrigramSlot(
+    __in PYORI_SH_HISTORY_TRIGRAM Trigrams,
+    __in DWORD TrigramSlots,
+    __in DWORDLONG Key
+    )
+{
+    DWORD Hash;
+    DWORD Index;
+
+    Hash = (DWORD)Key ^ ((DWORD)(Key >> 32) * 0x85EBCA6B);
+    Hash = Hash * 0x9E3779B1;
+    Hash = Hash ^ (Hash >> 15);
+
+    Index = Hash & (TrigramSlots - 1);
+    while (Trigrams[Index].Key != 0 && Trigrams[Index].Key != Key) {
+        Index = (Index + 1) & (TrigramSlots - 1);
+    }
+
+    return &Trigrams[Index];
+}
+
+/**
+ Double the size of the trigram table.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShHistoryGrowTrigrams(VOID)
+{
+    PYORI_SH_HISTORY_TRIGRAM NewTrigrams;
+    PYORI_SH_HISTORY_TRIGRAM Slot;
+    DWORD NewSlots;
+    DWORD Index;
+
+    if (YoriShHistoryIndex.TrigramSlots == 0) {
+        NewSlots = YORI_SH_HISTORY_INITIAL_TRIGRAMS;
+    } else {
+        NewSlots = YoriShHistoryIndex.TrigramSlots * 2;
+    }
+
+    if (!YoriLibIsSizeAllocatable((YORI_MAX_UNSIGNED_T)NewSlots * sizeof(YORI_SH_HISTORY_TRIGRAM))) {
+        return FALSE;
+    }
+
+    NewTrigrams = YoriLibMalloc((YORI_ALLOC_SIZE_T)(NewSlots * sizeof(YORI_SH_HISTORY_TRIGRAM)));
+    if (NewTrigrams == NULL) {
+        return FALSE;
+    }
+
+    ZeroMemory(NewTrigrams, NewSlots * sizeof(YORI_SH_HISTORY_TRIGRAM));
+
+    for (Index = 0; Index < YoriShHistoryIndex.TrigramSlots; Index++) {
+        if (YoriShHistoryIndex.Trigrams[Index].Key != 0) {
+            Slot = YoriShHistoryTrigramSlot(NewTrigrams, NewSlots, YoriShHistoryIndex.Trigrams[Index].Key);
+            memcpy(Slot, &YoriShHistoryIndex.Trigrams[Index], sizeof(YORI_SH_HISTORY_TRIGRAM));
+        }
+    }
+
+    if (YoriShHistoryIndex.Trigrams != NULL) {
+        YoriLibFree(YoriShHistoryIndex.Trigrams);
+    }
+    YoriShHistoryIndex.Trigrams = NewTrigrams;
+    YoriShHistoryIndex.TrigramSlots = NewSlots;
+    return TRUE;
+}
+
+/**
+ Record that a history entry contains a trigram.
+
+ @param Key The key of the trigram.
+
+ @param Sequence The sequence number of the history entry.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShHistoryAddTrigram(
+    __in DWORDLONG Key,
+    __in DWORD Sequence
+    )
+{
+    PYORI_SH_HISTORY_TRIGRAM Slot;
+    PDWORD NewSequences;
+    DWORD NewAllocated;
+
+    //
+    //  Keep the table no more than three quarters full so probe sequences
+    //  stay short.
+    //
+
+    if ((YoriShHistoryIndex.TrigramCount + 1) * 4 > YoriShHistoryIndex.TrigramSlots * 3) {
+        if (!YoriShHistoryGrowTrigrams()) {
+            return FALSE;
+        }
+    }
+
+    Slot = YoriShHistoryTrigramSlot(YoriShHistoryIndex.Trigrams, YoriShHistoryIndex.TrigramSlots, Key);
+    if (Slot->Key == 0) {
+        Slot->Key = Key;
+        YoriShHistoryIndex.TrigramCount++;
+    }
+
+    //
+    //  If the trigram occurs more than once in a single entry, it only
+    //  needs to be recorded once.
+    //
+
+    if (Slot->Count > 0 && Slot->Sequences[Slot->Count - 1] == Sequence) {
+        return TRUE;
+    }
+
+    if (Slot->Count == Slot->Allocated) {
+        if (Slot->Allocated == 0) {
+            NewAllocated = YORI_SH_HISTORY_INITIAL_POSTINGS;
+        } else {
+            NewAllocated = Slot->Allocated * 2;
+        }
+
+        if (!YoriLibIsSizeAllocatable((YORI_MAX_UNSIGNED_T)NewAllocated * sizeof(DWORD))) {
+            return FALSE;
+        }
+
+        NewSequences = YoriLibMalloc((YORI_ALLOC_SIZE_T)(NewAllocated * sizeof(DWORD)));
+        if (NewSequences == NULL) {
+            return FALSE;
+        }
+
+        if (Slot->Sequences != NULL) {
+            memcpy(NewSequences, Slot->Sequences, Slot->Count * sizeof(DWORD));
+            YoriLibFree(Slot->Sequences);
+        }
+        Slot->Sequences = NewSequences;
+        Slot->Allocated = NewAllocated;
+    }
+
+    Slot->Sequences[Slot->Count] = Sequence;
+    Slot->Count++;
+    return TRUE;
+}
+
+/**
+ Free all memory used by the history index and return it to its initial
+ empty state.  Note this does not modify the history entries themselves.
+ */
+VOID
+YoriShHistoryIndexFreeAll(VOID)
+{
+    DWORD Index;
+
+    if (YoriShHistoryIndex.Trigrams != NULL) {
+        for (Index = 0; Index < YoriShHistoryIndex.TrigramSlots; Index++) {
+            if (YoriShHistoryIndex.Trigrams[Index].Sequences != NULL) {
+                YoriLibFree(YoriShHistoryIndex.Trigrams[Index].Sequences);
+            }
+        }
+        YoriLibFree(YoriShHistoryIndex.Trigrams);
+    }
+
+    if (YoriShHistoryIndex.Entries != NULL) {
+        YoriLibFree(YoriShHistoryIndex.Entries);
+    }
+
+    ZeroMemory(&YoriShHistoryIndex, sizeof(YoriShHistoryIndex));
+}
+
+/**
+ Assign a sequence number to a history entry and record each trigram it
+ contains.  The caller is expected to have ensured there is space in the
+ entry array.
+
+ @param HistoryEntry Pointer to the history entry to index.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShHistoryIndexInsert(
+    __in PYORI_SH_HISTORY_ENTRY HistoryEntry
+    )
+{
+    YORI_ALLOC_SIZE_T Index;
+    DWORD Sequence;
+
+    Sequence = YoriShHistoryIndex.NextSequence;
+    YoriShHistoryIndex.Entries[Sequence] = HistoryEntry;
+    YoriShHistoryIndex.NextSequence++;
+    YoriShHistoryIndex.LiveEntries++;
+    HistoryEntry->IndexSequence = Sequence;
+
+    for (Index = 0; Index + YORI_SH_HISTORY_GRAM_LENGTH <= HistoryEntry->CmdLine.LengthInChars; Index++) {
+        if (!YoriShHistoryAddTrigram(YoriShHistoryTrigramKey(&HistoryEntry->CmdLine.StartOfString[Index]), Sequence)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Discard the current index and generate a new one from the history list.
+ This is used when most of the entry array refers to entries that have
+ been removed, and renumbers the remaining entries from zero.
+
+ @param EntriesToAllocate The number of elements to allocate in the new
+        entry array.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShHistoryIndexRebuild(
+    __in DWORD EntriesToAllocate
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_HISTORY_ENTRY HistoryEntry;
+
+    YoriShHistoryIndexFreeAll();
+
+    if (!YoriLibIsSizeAllocatable((YORI_MAX_UNSIGNED_T)EntriesToAllocate * sizeof(PYORI_SH_HISTORY_ENTRY))) {
+        return FALSE;
+    }
+
+    YoriShHistoryIndex.Entries = YoriLibMalloc((YORI_ALLOC_SIZE_T)(EntriesToAllocate * sizeof(PYORI_SH_HISTORY_ENTRY)));
+    if (YoriShHistoryIndex.Entries == NULL) {
+        return FALSE;
+    }
+    YoriShHistoryIndex.EntriesAllocated = EntriesToAllocate;
+
+    ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
+    while (ListEntry != NULL) {
+        HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
+        if (!YoriShHistoryIndexInsert(HistoryEntry)) {
+            return FALSE;
+        }
+        ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, ListEntry);
+    }
+
+    return TRUE;
+}
+
+/**
+ Add a history entry to the search index.  The entry must already have
+ been appended to the end of the history list.
+
+ @param HistoryEntry Pointer to the history entry that was added.
+ */
+VOID
+YoriShHistoryIndexAdd(
+    __in PYORI_SH_HISTORY_ENTRY HistoryEntry
+    )
+{
+    PYORI_SH_HISTORY_ENTRY *NewEntries;
+    DWORD NewAllocated;
+
+    if (YoriShHistoryIndex.Abandoned) {
+        return;
+    }
+
+    if (YoriShHistoryIndex.NextSequence == YoriShHistoryIndex.EntriesAllocated) {
+
+        //
+        //  If at least half of the array refers to entries that have been
+        //  trimmed from history, renumber the remaining entries rather than
+        //  growing.  Since the history list already contains the new entry,
+        //  the rebuild indexes it too.
+        //
+
+        if (YoriShHistoryIndex.EntriesAllocated > 0 &&
+            YoriShHistoryIndex.LiveEntries <= YoriShHistoryIndex.EntriesAllocated / 2) {
+
+            if (!YoriShHistoryIndexRebuild(YoriShHistoryIndex.EntriesAllocated)) {
+                YoriShHistoryIndexFreeAll();
+                YoriShHistoryIndex.Abandoned = TRUE;
+            }
+            return;
+        }
+
+        if (YoriShHistoryIndex.EntriesAllocated == 0) {
+            NewAllocated = YORI_SH_HISTORY_INITIAL_ENTRIES;
+        } else {
+            NewAllocated = YoriShHistoryIndex.EntriesAllocated * 2;
+        }
+
+        NewEntries = NULL;
+        if (NewAllocated > YoriShHistoryIndex.EntriesAllocated &&
+            YoriLibIsSizeAllocatable((YORI_MAX_UNSIGNED_T)NewAllocated * sizeof(PYORI_SH_HISTORY_ENTRY))) {
+
+            NewEntries = YoriLibMalloc((YORI_ALLOC_SIZE_T)(NewAllocated * sizeof(PYORI_SH_HISTORY_ENTRY)));
+        }
+
+        if (NewEntries == NULL) {
+            YoriShHistoryIndexFreeAll();
+            YoriShHistoryIndex.Abandoned = TRUE;
+            return;
+        }
+
+        if (YoriShHistoryIndex.Entries != NULL) {
+            memcpy(NewEntries, YoriShHistoryIndex.Entries, YoriShHistoryIndex.NextSequence * sizeof(PYORI_SH_HISTORY_ENTRY));
+            YoriLibFree(YoriShHistoryIndex.Entries);
+        }
+        YoriShHistoryIndex.Entries = NewEntries;
+        YoriShHistoryIndex.EntriesAllocated = NewAllocated;
+    }
+
+    if (!YoriShHistoryIndexInsert(HistoryEntry)) {
+        YoriShHistoryIndexFreeAll();
+        YoriShHistoryIndex.Abandoned = TRUE;
+    }
+}
+
+/**
+ Remove a history entry from the search index.  This should be called
+ before the entry is freed.  The trigram posting lists are not updated;
+ stale sequence numbers are skipped during search and discarded when the
+ index is next rebuilt.
+
+ @param HistoryEntry Pointer to the history entry being removed.
+ */
+VOID
+YoriShHistoryIndexRemove(
+    __in PYORI_SH_HISTORY_ENTRY HistoryEntry
+    )
+{
+    DWORD Sequence;
+
+    Sequence = HistoryEntry->IndexSequence;
+    if (Sequence < YoriShHistoryIndex.NextSequence &&
+        YoriShHistoryIndex.Entries[Sequence] == HistoryEntry) {
+
+        YoriShHistoryIndex.Entries[Sequence] = NULL;
+        YoriShHistoryIndex.LiveEntries--;
+    }
+}
+
+/**
+ Discard the search index because all history has been removed.
+ */
+VOID
+YoriShHistoryIndexClear(VOID)
+{
+    YoriShHistoryIndexFreeAll();
+}
+
+/**
+ Regenerate the search index from the history list.  This is required when
+ entries are inserted anywhere other than the end of the list, since the
+ index assumes sequence numbers increase from oldest to newest.
+ */
+VOID
+YoriShHistoryIndexRefresh(VOID)
+{
+    PYORI_LIST_ENTRY ListEntry;
+    DWORD EntryCount;
+    DWORD EntriesToAllocate;
+
+    EntryCount = 0;
+    ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
+    while (ListEntry != NULL) {
+        EntryCount++;
+        ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, ListEntry);
+    }
+
+    EntriesToAllocate = YORI_SH_HISTORY_INITIAL_ENTRIES;
+    while (EntriesToAllocate <= EntryCount) {
+        EntriesToAllocate = EntriesToAllocate * 2;
+        if (EntriesToAllocate == 0) {
+            break;
+        }
+    }
+
+    if (EntriesToAllocate == 0 ||
+        !YoriShHistoryIndexRebuild(EntriesToAllocate)) {
+
+        YoriShHistoryIndexFreeAll();
+        YoriShHistoryIndex.Abandoned = TRUE;
+    }
+}
+
+/**
+ Search backwards through history for an entry containing a string by
+ walking the history list.  This is used when the search string is too
+ short to use the index, or if the index could not be maintained.
+
+ @param SearchString The string to find, case insensitively.
+
+ @param StartingEntry If non-NULL, the entry to start searching from.  If
+        NULL, the search starts from the most recent entry.
+
+ @param IncludeStartingEntry If TRUE, StartingEntry is itself a candidate
+        for the match.  If FALSE, only entries older than StartingEntry are
+        considered.
+
+ @param MatchOffset On successful completion, updated to contain the offset
+        within the history entry of the match.
+
+ @return Pointer to the matching history entry, or NULL if no match is
+         found.
+ */
+PYORI_SH_HISTORY_ENTRY
+YoriShFindHistoryEntryByScan(
+    __in PYORI_STRING SearchString,
+    __in_opt PYORI_SH_HISTORY_ENTRY StartingEntry,
+    __in BOOLEAN IncludeStartingEntry,
+    __out PYORI_ALLOC_SIZE_T MatchOffset
+    )
+{
+    PYORI_LIST_ENTRY ListEntry;
+    PYORI_SH_HISTORY_ENTRY HistoryEntry;
+
+    if (StartingEntry != NULL && IncludeStartingEntry) {
+        ListEntry = &StartingEntry->ListEntry;
+    } else if (StartingEntry != NULL) {
+        ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, &StartingEntry->ListEntry);
+    } else {
+        ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, NULL);
+    }
+
+    while (ListEntry != NULL) {
+        HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
+        if (YoriLibFindFirstMatchSubstrIns(&HistoryEntry->CmdLine, 1, SearchString, MatchOffset) != NULL) {
+            return HistoryEntry;
+        }
+        ListEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, ListEntry);
+    }
+
+    return NULL;
+}
+
+/**
+ Move a query term's cursor so that it refers to the highest sequence number
+ that is less than or equal to a value.
+
+ @param Term Pointer to the query term.
+
+ @param Sequence The sequence number to seek to.
+
+ @return TRUE if the term contains a sequence number less than or equal to
+         the specified value, FALSE if it does not.
+ */
+BOOL
+YoriShHistoryQueryTermSeek(
+    __inout PYORI_SH_HISTORY_QUERY_TERM Term,
+    __in DWORD Sequence
+    )
+{
+    PDWORD Sequences;
+    DWORD Low;
+    DWORD High;
+    DWORD Mid;
+
+    Sequences = Term->Trigram->Sequences;
+    Low = 0;
+    High = Term->Cursor;
+    while (Low < High) {
+        Mid = Low + (High - Low) / 2;
+        if (Sequences[Mid] <= Sequence) {
+            Low = Mid + 1;
+        } else {
+            High = Mid;
+        }
+    }
+
+    Term->Cursor = Low;
+    if (Low == 0) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ Search backwards through history for an entry containing a string.  Entries
+ are only checked for the complete string if they contain every trigram in
+ the string, which is determined by intersecting the posting lists of the
+ least common trigrams.
+
+ @param SearchString The string to find, case insensitively.
+
+ @param StartingEntry If non-NULL, the entry to start searching from.  If
+        NULL, the search starts from the most recent entry.
+
+ @param IncludeStartingEntry If TRUE, StartingEntry is itself a candidate
+        for the match.  If FALSE, only entries older than StartingEntry are
+        considered.
+
+ @param MatchOffset On successful completion, updated to contain the offset
+        within the history entry of the match.
+
+ @return Pointer to the matching history entry, or NULL if no match is
+         found.
+ */
+PYORI_SH_HISTORY_ENTRY
+YoriShFindHistoryEntryContaining(
+    __in PYORI_STRING SearchString,
+    __in_opt PYORI_SH_HISTORY_ENTRY StartingEntry,
+    __in BOOLEAN IncludeStartingEntry,
+    __out PYORI_ALLOC_SIZE_T MatchOffset
+    )
+{
+    YORI_SH_HISTORY_QUERY_TERM Terms[YORI_SH_HISTORY_MAX_QUERY_TERMS];
+    PYORI_SH_HISTORY_TRIGRAM Slot;
+    PYORI_SH_HISTORY_ENTRY HistoryEntry;
+    YORI_ALLOC_SIZE_T Index;
+    DWORD TermCount;
+    DWORD TermIndex;
+    DWORD MostCommon;
+    DWORD Agreed;
+    DWORD Candidate;
+    DWORD Limit;
+    DWORD Value;
+
+    if (SearchString->LengthInChars == 0 ||
+        YoriShGlobal.CommandHistory.Next == NULL) {
+        return NULL;
+    }
+
+    if (YoriShHistoryIndex.Abandoned ||
+        YoriShHistoryIndex.Trigrams == NULL ||
+        SearchString->LengthInChars < YORI_SH_HISTORY_GRAM_LENGTH) {
+
+        return YoriShFindHistoryEntryByScan(SearchString, StartingEntry, IncludeStartingEntry, MatchOffset);
+    }
+
+    //
+    //  Collect the least common distinct trigrams in the search string.  If
+    //  any trigram has never been seen, no entry can match.
+    //
+
+    TermCount = 0;
+    for (Index = 0; Index + YORI_SH_HISTORY_GRAM_LENGTH <= SearchString->LengthInChars; Index++) {
+        Slot = YoriShHistoryTrigramSlot(YoriShHistoryIndex.Trigrams, YoriShHistoryIndex.TrigramSlots, YoriShHistoryTrigramKey(&SearchString->StartOfString[Index]));
+        if (Slot->Key == 0 || Slot->Count == 0) {
+            return NULL;
+        }
+
+        for (TermIndex = 0; TermIndex < TermCount; TermIndex++) {
+            if (Terms[TermIndex].Trigram == Slot) {
+                break;
+            }
+        }
+
+        if (TermIndex < TermCount) {
+            continue;
+        }
+
+        if (TermCount < YORI_SH_HISTORY_MAX_QUERY_TERMS) {
+            Terms[TermCount].Trigram = Slot;
+            TermCount++;
+        } else {
+            MostCommon = 0;
+            for (TermIndex = 1; TermIndex < TermCount; TermIndex++) {
+                if (Terms[TermIndex].Trigram->Count > Terms[MostCommon].Trigram->Count) {
+                    MostCommon = TermIndex;
+                }
+            }
+            if (Slot->Count < Terms[MostCommon].Trigram->Count) {
+                Terms[MostCommon].Trigram = Slot;
+            }
+        }
+    }
+
+    for (TermIndex = 0; TermIndex < TermCount; TermIndex++) {
+        Terms[TermIndex].Cursor = Terms[TermIndex].Trigram->Count;
+    }
+
+    //
+    //  Only sequence numbers below Limit are candidates.
+    //
+
+    if (StartingEntry == NULL) {
+        Limit = YoriShHistoryIndex.NextSequence;
+    } else if (IncludeStartingEntry) {
+        Limit = StartingEntry->IndexSequence + 1;
+    } else {
+        Limit = StartingEntry->IndexSequence;
+    }
+
+    if (Limit == 0) {
+        return NULL;
+    }
+    Candidate = Limit - 1;
+
+    while (TRUE) {
+
+        //
+        //  Move each term in turn to the highest sequence number that is
+        //  no greater than the candidate.  If a term doesn't contain the
+        //  candidate, its next lower sequence number becomes the candidate.
+        //  Once every term agrees, the candidate contains every trigram.
+        //
+
+        Agreed = 0;
+        TermIndex = 0;
+        while (Agreed < TermCount) {
+            if (!YoriShHistoryQueryTermSeek(&Terms[TermIndex], Candidate)) {
+                return NULL;
+            }
+
+            Value = Terms[TermIndex].Trigram->Sequences[Terms[TermIndex].Cursor - 1];
+            if (Value == Candidate) {
+                Agreed++;
+            } else {
+                Candidate = Value;
+                Agreed = 1;
+            }
+
+            TermIndex++;
+            if (TermIndex == TermCount) {
+                TermIndex = 0;
+            }
+        }
+
+        HistoryEntry = YoriShHistoryIndex.Entries[Candidate];
+        if (HistoryEntry != NULL &&
+            YoriLibFindFirstMatchSubstrIns(&HistoryEntry->CmdLine, 1, SearchString, MatchOffset) != NULL) {
+
+            return HistoryEntry;
+        }
+
+        if (Candidate == 0) {
+            break;
+        }
+        Candidate--;
+    }
+
+    return NULL;
+}
+
+// vim:sw=4:ts=4:et:
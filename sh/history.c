@@ -48,6 +48,103 @@ HANDLE YoriShHistoryLock;
  */
 BOOL YoriShHistoryInitialized;
 
+/**
+ The pool that history entries are allocated from.
+ */
+YORI_LIB_POOL YoriShHistoryPool;
+
+/**
+ The number of history entries to read from the history file before
+ returning to the user.  Older entries are read in the background.
+ */
+#define YORI_SH_HISTORY_INITIAL_LOAD (100)
+
+/**
+ The number of bytes to read from the history file at a time.
+ */
+#define YORI_SH_HISTORY_READ_SIZE (64 * 1024)
+
+/**
+ The number of times to retry opening or locking the history file if it is
+ in use by another shell.
+ */
+#define YORI_SH_HISTORY_RETRY_COUNT (50)
+
+/**
+ The number of milliseconds to wait between attempts to open or lock the
+ history file.
+ */
+#define YORI_SH_HISTORY_RETRY_DELAY (20)
+
+/**
+ The high 32 bits of the offset of the byte that is locked to indicate that
+ a shell is reading the history file by offset or rewriting it.  This is
+ well beyond any offset that contains data, so the lock does not prevent
+ appending.
+ */
+#define YORI_SH_HISTORY_LOCK_OFFSET_HIGH (0x7FFFFFFF)
+
+/**
+ State for reading older history from the history file in the background.
+ */
+typedef struct _YORI_SH_HISTORY_LOADER {
+
+    /**
+     Handle to the background thread, or NULL if no thread is running or
+     it has been waited on.
+     */
+    HANDLE Thread;
+
+    /**
+     Handle to the history file, which is locked while the thread is
+     reading it.
+     */
+    HANDLE FileHandle;
+
+    /**
+     The full path to the history file.
+     */
+    YORI_STRING FilePath;
+
+    /**
+     The offset within the file of the oldest line that has already been
+     loaded.  The thread reads lines before this offset.
+     */
+    DWORDLONG EndOffset;
+
+    /**
+     The size of the file when it was opened.
+     */
+    DWORDLONG FileSize;
+
+    /**
+     The maximum number of lines for the thread to read.
+     */
+    DWORD MaxLines;
+
+    /**
+     Lines read by the thread, with the most recent first.
+     */
+    YORI_STRING_ARRAY Lines;
+
+    /**
+     TRUE if lines have been requested from the thread and have not yet been
+     added to history.
+     */
+    BOOLEAN Pending;
+} YORI_SH_HISTORY_LOADER;
+
+/**
+ State for reading older history from the history file in the background.
+ */
+YORI_SH_HISTORY_LOADER YoriShHistoryLoader;
+
+/**
+ Commands which have been entered but not yet written to the history file,
+ because a shell was compacting it when they were entered.
+ */
+YORI_STRING_ARRAY YoriShHistoryAppendQueue;
+
 /**
  Add an entered command into the command history buffer.
 
@@ -95,7 +192,7 @@ YoriShAddToHistory(
             }
         }
 
-        NewHistoryEntry = YoriLibMalloc(LengthToAllocate);
+        NewHistoryEntry = YoriLibPoolAlloc(&YoriShHistoryPool, LengthToAllocate);
         if (NewHistoryEntry == NULL) {
             ReleaseMutex(YoriShHistoryLock);
             return FALSE;
@@ -104,6 +201,7 @@ YoriShAddToHistory(
         YoriLibCloneString(&NewHistoryEntry->CmdLine, NewCmd);
 
         YoriLibAppendList(&YoriShGlobal.CommandHistory, &NewHistoryEntry->ListEntry);
+        YoriShHistoryIndexAdd(NewHistoryEntry);
         YoriShCommandHistoryCount++;
         while (YoriShCommandHistoryCount > YoriShCommandHistoryMax) {
             PYORI_LIST_ENTRY ListEntry;
@@ -111,9 +209,10 @@ YoriShAddToHistory(
 
             ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
             OldHistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
+            YoriShHistoryIndexRemove(OldHistoryEntry);
             YoriLibRemoveListItem(ListEntry);
             YoriLibFreeStringContents(&OldHistoryEntry->CmdLine);
-            YoriLibFree(OldHistoryEntry);
+            YoriLibPoolFree(OldHistoryEntry);
             YoriShCommandHistoryCount--;
         }
         ReleaseMutex(YoriShHistoryLock);
@@ -139,9 +238,10 @@ YoriShRemoveOneHistoryEntry(
     )
 {
     if (WaitForSingleObject(YoriShHistoryLock, 0) == WAIT_OBJECT_0) {
+        YoriShHistoryIndexRemove(HistoryEntry);
         YoriLibRemoveListItem(&HistoryEntry->ListEntry);
         YoriLibFreeStringContents(&HistoryEntry->CmdLine);
-        YoriLibFree(HistoryEntry);
+        YoriLibPoolFree(HistoryEntry);
         YoriShCommandHistoryCount--;
         ReleaseMutex(YoriShHistoryLock);
     }
@@ -156,6 +256,21 @@ YoriShClearAllHistory(VOID)
     PYORI_LIST_ENTRY ListEntry = NULL;
     PYORI_SH_HISTORY_ENTRY HistoryEntry;
 
+    //
+    //  Any older entries that have not yet been merged from the history
+    //  file are discarded along with everything else.
+    //
+
+    YoriShWaitForHistoryFile();
+    if (YoriShHistoryLoader.Thread != NULL) {
+        CloseHandle(YoriShHistoryLoader.Thread);
+        YoriShHistoryLoader.Thread = NULL;
+    }
+    if (YoriShHistoryLoader.Pending) {
+        YoriStringArrayCleanup(&YoriShHistoryLoader.Lines);
+        YoriShHistoryLoader.Pending = FALSE;
+    }
+
     if (WaitForSingleObject(YoriShHistoryLock, 0) == WAIT_OBJECT_0) {
         ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
         while (ListEntry != NULL) {
@@ -163,9 +278,11 @@ YoriShClearAllHistory(VOID)
             ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, ListEntry);
             YoriLibRemoveListItem(&HistoryEntry->ListEntry);
             YoriLibFreeStringContents(&HistoryEntry->CmdLine);
-            YoriLibFree(HistoryEntry);
+            YoriLibPoolFree(HistoryEntry);
             YoriShCommandHistoryCount--;
         }
+        YoriShHistoryIndexClear();
+        YoriLibCleanupPool(&YoriShHistoryPool);
         ReleaseMutex(YoriShHistoryLock);
     }
 }
@@ -235,32 +352,26 @@ YoriShInitHistory(VOID)
 }
 
 /**
- Load history from a file if the user has requested this behavior by
- setting YORIHISTFILE.  Configure the maximum amount of history to retain
- if the user has requested this behavior by setting YORIHISTSIZE.
+ Obtain the full path to the history file, if the user has requested that
+ history be saved by setting YORIHISTFILE.
+
+ @param FilePath On successful completion, populated with the full path to
+        the history file.  If no history file is configured, this is an
+        empty string.  The caller should free this with
+        @ref YoriLibFreeStringContents .
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 __success(return)
 BOOL
-YoriShLoadHistoryFromFile(VOID)
+YoriShGetHistoryFilePath(
+    __out PYORI_STRING FilePath
+    )
 {
     YORI_ALLOC_SIZE_T EnvVarLength;
     YORI_STRING UserHistFileName;
-    YORI_STRING FilePath;
-    HANDLE FileHandle;
-    PVOID LineContext = NULL;
-    YORI_STRING LineString;
-
-    if (YoriShHistoryInitialized) {
-        return TRUE;
-    }
 
-    YoriShInitHistory();
-
-    //
-    //  Check if there's a file to load saved history from.
-    //
+    YoriLibInitEmptyString(FilePath);
 
     EnvVarLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), NULL, 0, NULL);
     if (EnvVarLength == 0) {
@@ -278,147 +389,1108 @@ YoriShLoadHistoryFromFile(VOID)
         return FALSE;
     }
 
-    if (!YoriLibUserStringToSingleFilePath(&UserHistFileName, TRUE, &FilePath)) {
+    if (!YoriLibUserStringToSingleFilePath(&UserHistFileName, TRUE, FilePath)) {
         YoriLibFreeStringContents(&UserHistFileName);
         return FALSE;
     }
 
     YoriLibFreeStringContents(&UserHistFileName);
+    return TRUE;
+}
 
-    FileHandle = CreateFile(FilePath.StartOfString,
-                            GENERIC_READ,
-                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
-                            NULL,
-                            OPEN_EXISTING,
-                            FILE_ATTRIBUTE_NORMAL,
-                            NULL);
+/**
+ Open the history file, retrying for a short time if another shell has it
+ open in a way that prevents this open from succeeding.
 
-    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
-        DWORD LastError = GetLastError();
-        if (LastError != ERROR_FILE_NOT_FOUND) {
-            LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
-            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("yori: open of %y failed: %s"), &FilePath, ErrText);
-            YoriLibFreeWinErrorText(ErrText);
+ @param FilePath Pointer to the full path to the history file.
+
+ @param DesiredAccess The access to request to the file.
+
+ @param ShareMode The access that other handles are allowed to have to the
+        file.
+
+ @param CreationDisposition Specifies whether the file should be created if
+        it does not exist.
+
+ @return Handle to the opened file, or INVALID_HANDLE_VALUE on failure.
+ */
+HANDLE
+YoriShOpenHistoryFile(
+    __in PYORI_STRING FilePath,
+    __in DWORD DesiredAccess,
+    __in DWORD ShareMode,
+    __in DWORD CreationDisposition
+    )
+{
+    HANDLE FileHandle;
+    DWORD Retry;
+
+    for (Retry = 0; TRUE; Retry++) {
+        FileHandle = CreateFile(FilePath->StartOfString,
+                                DesiredAccess,
+                                ShareMode,
+                                NULL,
+                                CreationDisposition,
+                                FILE_ATTRIBUTE_NORMAL,
+                                NULL);
+
+        if (FileHandle != INVALID_HANDLE_VALUE ||
+            GetLastError() != ERROR_SHARING_VIOLATION ||
+            Retry >= YORI_SH_HISTORY_RETRY_COUNT) {
+
+            break;
         }
-        YoriLibFreeStringContents(&FilePath);
+
+        Sleep(YORI_SH_HISTORY_RETRY_DELAY);
+    }
+
+    return FileHandle;
+}
+
+/**
+ Lock the history file to indicate that this shell is reading it by offset
+ or rewriting it.  Only one shell can hold this lock at a time.  Appending
+ to the file does not require the lock.
+
+ @param FileHandle Handle to the history file.
+
+ @return TRUE to indicate the lock was acquired, FALSE if it was not.
+ */
+__success(return)
+BOOL
+YoriShLockHistoryFile(
+    __in HANDLE FileHandle
+    )
+{
+    DWORD Retry;
+
+    for (Retry = 0; Retry < YORI_SH_HISTORY_RETRY_COUNT; Retry++) {
+        if (LockFile(FileHandle, 0, YORI_SH_HISTORY_LOCK_OFFSET_HIGH, 1, 0)) {
+            return TRUE;
+        }
+        Sleep(YORI_SH_HISTORY_RETRY_DELAY);
+    }
+
+    return FALSE;
+}
+
+/**
+ Release the lock acquired with @ref YoriShLockHistoryFile .
+
+ @param FileHandle Handle to the history file.
+ */
+VOID
+YoriShUnlockHistoryFile(
+    __in HANDLE FileHandle
+    )
+{
+    UnlockFile(FileHandle, 0, YORI_SH_HISTORY_LOCK_OFFSET_HIGH, 1, 0);
+}
+
+/**
+ Convert a single line from the history file into a string and add it to
+ an array of lines.  Empty lines are ignored.
+
+ @param Lines Pointer to the array of lines to add to.
+
+ @param Scratch Pointer to a string used to convert the line.  This may be
+        reallocated within this routine.
+
+ @param LineBuffer Pointer to the encoded line, not including the line
+        feed which terminates it.
+
+ @param LineLength The number of bytes in the encoded line.
+
+ @param LineAdded On successful completion, set to TRUE if the line was
+        added to the array, or FALSE if it was empty.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShAddHistoryFileLine(
+    __inout PYORI_STRING_ARRAY Lines,
+    __inout PYORI_STRING Scratch,
+    __in PUCHAR LineBuffer,
+    __in YORI_ALLOC_SIZE_T LineLength,
+    __out PBOOLEAN LineAdded
+    )
+{
+    YORI_ALLOC_SIZE_T CharsNeeded;
+
+    *LineAdded = FALSE;
+
+    if (LineLength > 0 && LineBuffer[LineLength - 1] == '\r') {
+        LineLength--;
+    }
+
+    if (LineLength == 0) {
+        return TRUE;
+    }
+
+    CharsNeeded = YoriLibGetMultibyteInputSizeNeeded((LPCSTR)LineBuffer, LineLength);
+    if (Scratch->LengthAllocated < CharsNeeded) {
+        YoriLibFreeStringContents(Scratch);
+        if (!YoriLibAllocateString(Scratch, CharsNeeded)) {
+            return FALSE;
+        }
+    }
+
+    YoriLibMultibyteInput((LPCSTR)LineBuffer, LineLength, Scratch->StartOfString, CharsNeeded);
+    Scratch->LengthInChars = CharsNeeded;
+
+    if (!YoriStringArrayAddItems(Lines, Scratch, 1)) {
         return FALSE;
     }
 
-    YoriLibFreeStringContents(&FilePath);
+    *LineAdded = TRUE;
+    return TRUE;
+}
 
-    YoriLibInitEmptyString(&LineString);
+/**
+ Read lines from the history file, starting from a specified offset and
+ working backwards towards the beginning of the file.  This allows the most
+ recent history to be loaded without reading the whole file.
 
-    while (TRUE) {
+ @param FileHandle Handle to the history file.
 
-        if (!YoriLibReadLineToString(&LineString, &LineContext, FileHandle)) {
-            break;
+ @param EndOffset The offset within the file to read backwards from.  This
+        should be the end of the file or the beginning of a line.
+
+ @param MaxLines The maximum number of lines to read.
+
+ @param Lines Pointer to an array of strings to add lines to.  Lines are
+        added with the most recent first.
+
+ @param StartOffset On successful completion, updated to contain the offset
+        of the beginning of the oldest line that was read.  If there are no
+        more lines before this, it is zero.
+
+ @return TRUE to indicate success, FALSE to indicate failure.  On failure,
+         Lines may contain some lines that were read successfully.
+ */
+__success(return)
+BOOL
+YoriShReadHistoryFileLines(
+    __in HANDLE FileHandle,
+    __in DWORDLONG EndOffset,
+    __in DWORD MaxLines,
+    __inout PYORI_STRING_ARRAY Lines,
+    __out PDWORDLONG StartOffset
+    )
+{
+    PUCHAR Buffer;
+    PUCHAR NewBuffer;
+    YORI_ALLOC_SIZE_T BufferSize;
+    YORI_ALLOC_SIZE_T CarryLength;
+    YORI_ALLOC_SIZE_T LineEnd;
+    YORI_ALLOC_SIZE_T Index;
+    YORI_MAX_UNSIGNED_T NewBufferSize;
+    DWORDLONG ReadOffset;
+    DWORD BytesToRead;
+    DWORD BytesRead;
+    DWORD LinesFound;
+    LARGE_INTEGER FileOffset;
+    YORI_STRING Scratch;
+    BOOLEAN LineAdded;
+    BOOL Result;
+
+    *StartOffset = EndOffset;
+    if (MaxLines == 0 || EndOffset == 0) {
+        return TRUE;
+    }
+
+    BufferSize = YORI_SH_HISTORY_READ_SIZE;
+    Buffer = YoriLibMalloc(BufferSize);
+    if (Buffer == NULL) {
+        return FALSE;
+    }
+
+    YoriLibInitEmptyString(&Scratch);
+    Result = FALSE;
+    LinesFound = 0;
+    CarryLength = 0;
+    ReadOffset = EndOffset;
+
+    while (ReadOffset > 0) {
+
+        BytesToRead = YORI_SH_HISTORY_READ_SIZE;
+        if (ReadOffset < BytesToRead) {
+            BytesToRead = (DWORD)ReadOffset;
         }
 
         //
-        //  If we fail to add to history, stop.  If it is added to history,
-        //  that string is now owned by the history buffer, so reinitialize
-        //  between lines.  The free below is really just a dereference.
+        //  The start of the buffer contains the part of a line that has been
+        //  read but whose beginning has not.  Move it after the space for
+        //  the next read, growing the buffer if needed.
         //
 
-        if (!YoriShAddToHistory(&LineString, FALSE)) {
-            break;
+        if (BytesToRead + CarryLength > BufferSize) {
+            NewBufferSize = (YORI_MAX_UNSIGNED_T)BufferSize * 2;
+            if (!YoriLibIsSizeAllocatable(NewBufferSize)) {
+                goto Exit;
+            }
+
+            NewBuffer = YoriLibMalloc((YORI_ALLOC_SIZE_T)NewBufferSize);
+            if (NewBuffer == NULL) {
+                goto Exit;
+            }
+
+            memcpy(NewBuffer, Buffer, CarryLength);
+            YoriLibFree(Buffer);
+            Buffer = NewBuffer;
+            BufferSize = (YORI_ALLOC_SIZE_T)NewBufferSize;
+        }
+
+        memmove(&Buffer[BytesToRead], Buffer, CarryLength);
+
+        ReadOffset = ReadOffset - BytesToRead;
+        FileOffset.QuadPart = ReadOffset;
+        SetFilePointer(FileHandle, FileOffset.LowPart, &FileOffset.HighPart, FILE_BEGIN);
+        if (!ReadFile(FileHandle, Buffer, BytesToRead, &BytesRead, NULL) ||
+            BytesRead != BytesToRead) {
+
+            goto Exit;
+        }
+
+        LineEnd = BytesToRead + CarryLength;
+        for (Index = BytesToRead; Index > 0; Index--) {
+            if (Buffer[Index - 1] == '\n') {
+                if (!YoriShAddHistoryFileLine(Lines, &Scratch, &Buffer[Index], LineEnd - Index, &LineAdded)) {
+                    goto Exit;
+                }
+
+                if (LineAdded) {
+                    LinesFound++;
+                    if (LinesFound == MaxLines) {
+                        *StartOffset = ReadOffset + Index;
+                        Result = TRUE;
+                        goto Exit;
+                    }
+                }
+
+                LineEnd = Index - 1;
+            }
         }
 
-        YoriLibFreeStringContents(&LineString);
-        YoriLibInitEmptyString(&LineString);
+        CarryLength = LineEnd;
     }
 
-    YoriLibLineReadCloseOrCache(LineContext);
-    YoriLibFreeStringContents(&LineString);
-    CloseHandle(FileHandle);
-    return TRUE;
+    //
+    //  The beginning of the file has been reached, so whatever remains is
+    //  the first line.
+    //
+
+    if (!YoriShAddHistoryFileLine(Lines, &Scratch, Buffer, CarryLength, &LineAdded)) {
+        goto Exit;
+    }
+
+    *StartOffset = 0;
+    Result = TRUE;
+
+Exit:
+    YoriLibFreeStringContents(&Scratch);
+    YoriLibFree(Buffer);
+    return Result;
 }
 
 /**
- Write the current command history buffer to a file, if the user has requested
- this behavior by configuring the YORIHISTFILE environment variable.
+ Append the end of one history file to another.  This is used after the
+ history file has been compacted to move commands that other shells
+ appended to the old file after its contents were copied.
+
+ @param SourcePath Pointer to the full path to the file to copy from.
+
+ @param TargetPath Pointer to the full path to the file to append to.
+
+ @param SourceOffset The offset within the source file to copy from.
 
  @return TRUE to indicate success, FALSE to indicate failure.
  */
 __success(return)
 BOOL
-YoriShSaveHistoryToFile(VOID)
+YoriShAppendHistoryFileTail(
+    __in PYORI_STRING SourcePath,
+    __in PYORI_STRING TargetPath,
+    __in DWORDLONG SourceOffset
+    )
 {
-    YORI_ALLOC_SIZE_T FileNameLength;
-    YORI_STRING UserHistFileName;
-    YORI_STRING FilePath;
-    HANDLE FileHandle;
-    PYORI_LIST_ENTRY ListEntry;
-    PYORI_SH_HISTORY_ENTRY HistoryEntry;
+    HANDLE SourceHandle;
+    HANDLE TargetHandle;
+    PUCHAR Buffer;
+    LARGE_INTEGER FileSize;
+    LARGE_INTEGER FileOffset;
+    DWORD BytesRead;
+    DWORD BytesWritten;
+    BOOL Result;
+
+    SourceHandle = CreateFile(SourcePath->StartOfString,
+                              GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              NULL,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                              NULL);
+
+    if (SourceHandle == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
 
-    FileNameLength = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), NULL, 0, NULL);
-    if (FileNameLength == 0) {
-        return TRUE;
+    Result = FALSE;
+    Buffer = NULL;
+    TargetHandle = INVALID_HANDLE_VALUE;
+
+    FileSize.LowPart = GetFileSize(SourceHandle, (LPDWORD)&FileSize.HighPart);
+    if (FileSize.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+        goto Exit;
     }
 
-    if (!YoriLibAllocateString(&UserHistFileName, FileNameLength)) {
-        return FALSE;
+    if ((DWORDLONG)FileSize.QuadPart <= SourceOffset) {
+        Result = TRUE;
+        goto Exit;
     }
 
-    UserHistFileName.LengthInChars = YoriShGetEnvironmentVariableWithoutSubstitution(_T("YORIHISTFILE"), UserHistFileName.StartOfString, UserHistFileName.LengthAllocated, NULL);
+    Buffer = YoriLibMalloc(YORI_SH_HISTORY_READ_SIZE);
+    if (Buffer == NULL) {
+        goto Exit;
+    }
 
-    if (UserHistFileName.LengthInChars == 0 || UserHistFileName.LengthInChars >= UserHistFileName.LengthAllocated) {
-        YoriLibFreeStringContents(&UserHistFileName);
-        return FALSE;
+    TargetHandle = YoriShOpenHistoryFile(TargetPath,
+                                         FILE_APPEND_DATA | SYNCHRONIZE,
+                                         FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                         OPEN_ALWAYS);
+
+    if (TargetHandle == INVALID_HANDLE_VALUE) {
+        goto Exit;
     }
 
-    if (!YoriLibUserStringToSingleFilePath(&UserHistFileName, TRUE, &FilePath)) {
-        YoriLibFreeStringContents(&UserHistFileName);
+    FileOffset.QuadPart = SourceOffset;
+    SetFilePointer(SourceHandle, FileOffset.LowPart, &FileOffset.HighPart, FILE_BEGIN);
+    while (TRUE) {
+        if (!ReadFile(SourceHandle, Buffer, YORI_SH_HISTORY_READ_SIZE, &BytesRead, NULL)) {
+            goto Exit;
+        }
+
+        if (BytesRead == 0) {
+            break;
+        }
+
+        if (!WriteFile(TargetHandle, Buffer, BytesRead, &BytesWritten, NULL) ||
+            BytesWritten != BytesRead) {
+
+            goto Exit;
+        }
+    }
+
+    Result = TRUE;
+
+Exit:
+    if (Buffer != NULL) {
+        YoriLibFree(Buffer);
+    }
+    if (TargetHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(TargetHandle);
+    }
+    CloseHandle(SourceHandle);
+    return Result;
+}
+
+/**
+ Remove the beginning of the history file, so that the file starts with the
+ oldest entry that is still retained.  The retained entries are written to
+ a temporary file in the same directory, which then replaces the history
+ file, so the history file is never left partially rewritten if the process
+ is terminated.  The caller is not expected to have the history file open.
+
+ @param FilePath Pointer to the full path to the history file.
+
+ @param KeepOffset The offset of the first byte in the file to retain.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShCompactHistoryFile(
+    __in PYORI_STRING FilePath,
+    __in DWORDLONG KeepOffset
+    )
+{
+    YORI_STRING ParentDirectory;
+    YORI_STRING Prefix;
+    YORI_STRING TempFilePath;
+    YORI_STRING BackupFilePath;
+    HANDLE FileHandle;
+    HANDLE TempHandle;
+    PUCHAR Buffer;
+    LARGE_INTEGER FileSize;
+    LARGE_INTEGER FileOffset;
+    DWORDLONG CopyOffset;
+    DWORD BytesToCopy;
+    DWORD BytesRead;
+    DWORD BytesWritten;
+    YORI_ALLOC_SIZE_T Index;
+    BOOL Locked;
+    BOOL Result;
+
+    if (DllKernel32.pReplaceFileW == NULL) {
         return FALSE;
     }
 
-    YoriLibFreeStringContents(&UserHistFileName);
+    //
+    //  Not sharing write access means this fails if another shell is
+    //  appending, and prevents other shells from appending while the file
+    //  is copied.  Compaction is not required, so if the file is busy it
+    //  can wait until a later shell starts.
+    //
 
-    FileHandle = CreateFile(FilePath.StartOfString,
-                            GENERIC_WRITE,
-                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+    FileHandle = CreateFile(FilePath->StartOfString,
+                            GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_DELETE,
                             NULL,
-                            CREATE_ALWAYS,
+                            OPEN_EXISTING,
                             FILE_ATTRIBUTE_NORMAL,
                             NULL);
 
-    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
-        DWORD LastError = GetLastError();
-        LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
-        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("yori: open of %y failed: %s"), &FilePath, ErrText);
-        YoriLibFreeWinErrorText(ErrText);
-        YoriLibFreeStringContents(&FilePath);
+    if (FileHandle == INVALID_HANDLE_VALUE) {
         return FALSE;
     }
 
-    YoriLibFreeStringContents(&FilePath);
+    Result = FALSE;
+    Locked = FALSE;
+    Buffer = NULL;
+    TempHandle = INVALID_HANDLE_VALUE;
+    YoriLibInitEmptyString(&TempFilePath);
+    YoriLibInitEmptyString(&BackupFilePath);
+
+    if (!YoriShLockHistoryFile(FileHandle)) {
+        goto Exit;
+    }
+    Locked = TRUE;
+
+    FileSize.LowPart = GetFileSize(FileHandle, (LPDWORD)&FileSize.HighPart);
+    if (FileSize.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+        goto Exit;
+    }
+
+    if ((DWORDLONG)FileSize.QuadPart < KeepOffset) {
+        goto Exit;
+    }
 
     //
-    //  Search the list of history.
+    //  Create the temporary file in the same directory as the history file
+    //  so that it can be renamed into place.
     //
 
-    if (WaitForSingleObject(YoriShHistoryLock, 0) == WAIT_OBJECT_0) {
-        ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, NULL);
-        while (ListEntry != NULL) {
-            HistoryEntry = CONTAINING_RECORD(ListEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
+    YoriLibInitEmptyString(&ParentDirectory);
+    for (Index = FilePath->LengthInChars; Index > 0; Index--) {
+        if (YoriLibIsSep(FilePath->StartOfString[Index - 1])) {
+            ParentDirectory.StartOfString = FilePath->StartOfString;
+            ParentDirectory.LengthInChars = Index - 1;
+            break;
+        }
+    }
+
+    if (Index == 0) {
+        YoriLibConstantString(&ParentDirectory, _T("."));
+    }
 
-            YoriLibOutputToDevice(FileHandle, 0, _T("%y\n"), &HistoryEntry->CmdLine);
+    YoriLibConstantString(&Prefix, _T("YHST"));
 
-            ListEntry = YoriLibGetNextListEntry(&YoriShGlobal.CommandHistory, ListEntry);
-        }
-        ReleaseMutex(YoriShHistoryLock);
+    if (!YoriLibGetTempFileName(&ParentDirectory, &Prefix, &TempHandle, &TempFilePath)) {
+        TempHandle = INVALID_HANDLE_VALUE;
+        goto Exit;
     }
 
+    Buffer = YoriLibMalloc(YORI_SH_HISTORY_READ_SIZE);
+    if (Buffer == NULL) {
+        goto Exit;
+    }
+
+    FileOffset.QuadPart = KeepOffset;
+    SetFilePointer(FileHandle, FileOffset.LowPart, &FileOffset.HighPart, FILE_BEGIN);
+    for (CopyOffset = KeepOffset; CopyOffset < (DWORDLONG)FileSize.QuadPart; CopyOffset = CopyOffset + BytesToCopy) {
+        BytesToCopy = YORI_SH_HISTORY_READ_SIZE;
+        if ((DWORDLONG)FileSize.QuadPart - CopyOffset < BytesToCopy) {
+            BytesToCopy = (DWORD)(FileSize.QuadPart - CopyOffset);
+        }
+
+        if (!ReadFile(FileHandle, Buffer, BytesToCopy, &BytesRead, NULL) ||
+            BytesRead != BytesToCopy) {
+
+            goto Exit;
+        }
+
+        if (!WriteFile(TempHandle, Buffer, BytesToCopy, &BytesWritten, NULL) ||
+            BytesWritten != BytesToCopy) {
+
+            goto Exit;
+        }
+    }
+
+    if (!FlushFileBuffers(TempHandle)) {
+        goto Exit;
+    }
+
+    CloseHandle(TempHandle);
+    TempHandle = INVALID_HANDLE_VALUE;
+
+    //
+    //  The history file can't be replaced while this handle is open.
+    //  Replace it, retaining the old file under a backup name.  Another
+    //  shell may append to the old file between closing this handle and
+    //  replacing it, so anything beyond what was copied is then moved to
+    //  the new file.
+    //
+
+    YoriShUnlockHistoryFile(FileHandle);
+    Locked = FALSE;
     CloseHandle(FileHandle);
+    FileHandle = INVALID_HANDLE_VALUE;
+
+    if (!YoriLibYPrintf(&BackupFilePath, _T("%y.old"), &TempFilePath)) {
+        goto Exit;
+    }
+
+    if (!DllKernel32.pReplaceFileW(FilePath->StartOfString, TempFilePath.StartOfString, BackupFilePath.StartOfString, 0, NULL, NULL)) {
+
+        //
+        //  This error indicates the history file has been renamed to the
+        //  backup name but the new file could not be renamed into place, so
+        //  put the original back.
+        //
+
+        if (GetLastError() == ERROR_UNABLE_TO_MOVE_REPLACEMENT_2) {
+            MoveFileEx(BackupFilePath.StartOfString, FilePath->StartOfString, 0);
+        }
+        goto Exit;
+    }
+
+    YoriLibFreeStringContents(&TempFilePath);
+
+    YoriShAppendHistoryFileTail(&BackupFilePath, FilePath, FileSize.QuadPart);
+    DeleteFile(BackupFilePath.StartOfString);
+    Result = TRUE;
+
+Exit:
+    if (Buffer != NULL) {
+        YoriLibFree(Buffer);
+    }
+    if (TempHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(TempHandle);
+    }
+    if (TempFilePath.LengthInChars > 0) {
+        DeleteFile(TempFilePath.StartOfString);
+    }
+    YoriLibFreeStringContents(&TempFilePath);
+    YoriLibFreeStringContents(&BackupFilePath);
+    if (Locked) {
+        YoriShUnlockHistoryFile(FileHandle);
+    }
+    if (FileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(FileHandle);
+    }
+    return Result;
+}
+
+/**
+ A background thread which reads older history from the history file after
+ the most recent entries have been loaded, and compacts the file if it
+ contains many more entries than are retained.
+
+ @param Context Unused.
+
+ @return Thread return code, which is ignored for this thread.
+ */
+DWORD WINAPI
+YoriShHistoryLoaderThread(
+    __in LPVOID Context
+    )
+{
+    DWORDLONG KeepOffset;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    if (!YoriShReadHistoryFileLines(YoriShHistoryLoader.FileHandle,
+                                    YoriShHistoryLoader.EndOffset,
+                                    YoriShHistoryLoader.MaxLines,
+                                    &YoriShHistoryLoader.Lines,
+                                    &KeepOffset)) {
+        KeepOffset = 0;
+    }
+
+    //
+    //  If more than half of the file precedes the oldest entry that will
+    //  be retained, remove it.  This means the file is rewritten each time
+    //  its size doubles.
+    //
+
+    YoriShUnlockHistoryFile(YoriShHistoryLoader.FileHandle);
+    CloseHandle(YoriShHistoryLoader.FileHandle);
+    YoriShHistoryLoader.FileHandle = NULL;
+
+    if (KeepOffset > 0 && KeepOffset >= YoriShHistoryLoader.FileSize - KeepOffset) {
+        YoriShCompactHistoryFile(&YoriShHistoryLoader.FilePath, KeepOffset);
+    }
+
+    YoriLibFreeStringContents(&YoriShHistoryLoader.FilePath);
+    return 0;
+}
+
+/**
+ Wait for the background thread that reads older history from the history
+ file to complete, and write any commands that could not be appended while
+ it was compacting the file.  This ensures that no commands are lost when
+ the process exits.
+ */
+VOID
+YoriShWaitForHistoryFile(VOID)
+{
+    if (YoriShHistoryLoader.Thread != NULL) {
+        WaitForSingleObject(YoriShHistoryLoader.Thread, INFINITE);
+    }
+
+    YoriShFlushHistoryAppendQueue(TRUE);
+}
+
+/**
+ Add any older history that has been read from the history file to the
+ beginning of the history list.  This is called when the user navigates
+ beyond the oldest entry that has been loaded.
+
+ @return TRUE to indicate that entries were added, FALSE if no more history
+         is available.
+ */
+BOOL
+YoriShLoadOlderHistory(VOID)
+{
+    PYORI_SH_HISTORY_ENTRY NewHistoryEntry;
+    YORI_ALLOC_SIZE_T Index;
+    BOOL EntriesAdded;
+
+    if (!YoriShHistoryLoader.Pending) {
+        return FALSE;
+    }
+
+    if (YoriShHistoryLoader.Thread != NULL) {
+        WaitForSingleObject(YoriShHistoryLoader.Thread, INFINITE);
+        CloseHandle(YoriShHistoryLoader.Thread);
+        YoriShHistoryLoader.Thread = NULL;
+        YoriShFlushHistoryAppendQueue(FALSE);
+    }
+
+    EntriesAdded = FALSE;
+    if (WaitForSingleObject(YoriShHistoryLock, 0) == WAIT_OBJECT_0) {
+
+        for (Index = 0; Index < YoriShHistoryLoader.Lines.Count; Index++) {
+            if (YoriShCommandHistoryCount >= YoriShCommandHistoryMax) {
+                break;
+            }
+
+            NewHistoryEntry = YoriLibPoolAlloc(&YoriShHistoryPool, sizeof(YORI_SH_HISTORY_ENTRY));
+            if (NewHistoryEntry == NULL) {
+                break;
+            }
+
+            YoriLibCloneString(&NewHistoryEntry->CmdLine, &YoriShHistoryLoader.Lines.Items[Index]);
+            YoriLibInsertList(&YoriShGlobal.CommandHistory, &NewHistoryEntry->ListEntry);
+            YoriShCommandHistoryCount++;
+            EntriesAdded = TRUE;
+        }
+
+        //
+        //  The index orders entries by when they were added, so entries
+        //  inserted before existing ones require it to be regenerated.
+        //
+
+        if (EntriesAdded) {
+            YoriShHistoryIndexRefresh();
+        }
+        ReleaseMutex(YoriShHistoryLock);
+    }
+
+    YoriStringArrayCleanup(&YoriShHistoryLoader.Lines);
+    YoriShHistoryLoader.Pending = FALSE;
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1700)
 #pragma warning(suppress: 26165) // Analyze thinks a lock might be leaked
                                  // if WaitForSingleObject acquired it but
                                  // returned a different result.  That can't
                                  // happen.
 #endif
+    return EntriesAdded;
+}
+
+/**
+ Load history from a file if the user has requested this behavior by
+ setting YORIHISTFILE.  Configure the maximum amount of history to retain
+ if the user has requested this behavior by setting YORIHISTSIZE.  Only the
+ most recent entries are read before returning; older entries are read by
+ a background thread and added to history by @ref YoriShLoadOlderHistory .
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShLoadHistoryFromFile(VOID)
+{
+    YORI_STRING FilePath;
+    YORI_STRING_ARRAY Lines;
+    HANDLE FileHandle;
+    LARGE_INTEGER FileSize;
+    DWORDLONG StartOffset;
+    YORI_ALLOC_SIZE_T Index;
+    DWORD LinesToLoad;
+    DWORD ThreadId;
+
+    if (YoriShHistoryInitialized) {
+        return TRUE;
+    }
+
+    YoriShInitHistory();
+
+    //
+    //  Check if there's a file to load saved history from.
+    //
+
+    if (!YoriShGetHistoryFilePath(&FilePath)) {
+        return FALSE;
+    }
+
+    if (FilePath.LengthInChars == 0) {
+        return TRUE;
+    }
+
+    FileHandle = CreateFile(FilePath.StartOfString,
+                            GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+
+    if (FileHandle == NULL || FileHandle == INVALID_HANDLE_VALUE) {
+        DWORD LastError = GetLastError();
+        if (LastError != ERROR_FILE_NOT_FOUND) {
+            LPTSTR ErrText = YoriLibGetWinErrorText(LastError);
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("yori: open of %y failed: %s"), &FilePath, ErrText);
+            YoriLibFreeWinErrorText(ErrText);
+        }
+        YoriLibFreeStringContents(&FilePath);
+        return FALSE;
+    }
+
+    //
+    //  Reading by offset requires the lock, since another shell holding it
+    //  may be truncating the file.  If the lock can't be acquired in a
+    //  short time, start without loading history rather than reading data
+    //  that may be changing.
+    //
+
+    if (!YoriShLockHistoryFile(FileHandle)) {
+        CloseHandle(FileHandle);
+        YoriLibFreeStringContents(&FilePath);
+        return TRUE;
+    }
+
+    FileSize.LowPart = GetFileSize(FileHandle, (LPDWORD)&FileSize.HighPart);
+    if (FileSize.LowPart == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+        FileSize.QuadPart = 0;
+    }
+
+    LinesToLoad = YoriShCommandHistoryMax;
+    if (LinesToLoad > YORI_SH_HISTORY_INITIAL_LOAD) {
+        LinesToLoad = YORI_SH_HISTORY_INITIAL_LOAD;
+    }
+
+    YoriStringArrayInitialize(&Lines);
+    if (!YoriShReadHistoryFileLines(FileHandle, FileSize.QuadPart, LinesToLoad, &Lines, &StartOffset)) {
+        StartOffset = 0;
+    }
+
+    //
+    //  Lines are read from the end of the file, so add them to history in
+    //  reverse order.  History references the strings, so the array can be
+    //  freed afterwards.
+    //
+
+    for (Index = Lines.Count; Index > 0; Index--) {
+        if (!YoriShAddToHistory(&Lines.Items[Index - 1], FALSE)) {
+            break;
+        }
+    }
+
+    YoriStringArrayCleanup(&Lines);
+
+    if (StartOffset > 0) {
+        YoriShHistoryLoader.FileHandle = FileHandle;
+        memcpy(&YoriShHistoryLoader.FilePath, &FilePath, sizeof(YORI_STRING));
+        YoriShHistoryLoader.FileSize = FileSize.QuadPart;
+        YoriShHistoryLoader.EndOffset = StartOffset;
+        YoriShHistoryLoader.MaxLines = 0;
+        if (YoriShCommandHistoryMax > YoriShCommandHistoryCount) {
+            YoriShHistoryLoader.MaxLines = YoriShCommandHistoryMax - YoriShCommandHistoryCount;
+        }
+        YoriStringArrayInitialize(&YoriShHistoryLoader.Lines);
+        YoriShHistoryLoader.Pending = TRUE;
+
+        YoriShHistoryLoader.Thread = CreateThread(NULL, 0, YoriShHistoryLoaderThread, NULL, 0, &ThreadId);
+        if (YoriShHistoryLoader.Thread == NULL) {
+            YoriShHistoryLoaderThread(NULL);
+        }
+        return TRUE;
+    }
+
+    YoriShUnlockHistoryFile(FileHandle);
+    CloseHandle(FileHandle);
+    YoriLibFreeStringContents(&FilePath);
     return TRUE;
 }
 
+/**
+ Write any commands waiting in YoriShHistoryAppendQueue to the end of the
+ history file.  Commands remain queued if the file is being compacted by a
+ shell, and are discarded if the file cannot be written for any other
+ reason.
+
+ @param FilePath Pointer to the full path to the history file.
+
+ @param Wait If TRUE, wait for a short time for any compaction to complete.
+        If FALSE, return immediately if the file is being compacted.
+
+ @return TRUE to indicate that the commands were written or remain queued,
+         FALSE if they could not be written.
+ */
+__success(return)
+BOOL
+YoriShWriteHistoryAppendQueue(
+    __in PYORI_STRING FilePath,
+    __in BOOLEAN Wait
+    )
+{
+    YORI_STRING Lines;
+    LPTSTR LineEnding;
+    YORI_ALLOC_SIZE_T LineEndingLength;
+    YORI_MAX_UNSIGNED_T CharsNeeded;
+    YORI_ALLOC_SIZE_T BytesNeeded;
+    YORI_ALLOC_SIZE_T Index;
+    LPSTR EncodedLines;
+    HANDLE FileHandle;
+    DWORD BytesWritten;
+    BOOL Result;
+
+    if (YoriShHistoryAppendQueue.Count == 0) {
+        return TRUE;
+    }
+
+    //
+    //  Other shells may be appending to the same file.  Each write to a
+    //  handle opened only for append is placed at the end of the file as a
+    //  unit, so construct every line with its line ending and write them
+    //  with a single call.
+    //
+
+    LineEnding = YoriLibVtGetLineEnding();
+    LineEndingLength = (YORI_ALLOC_SIZE_T)_tcslen(LineEnding);
+
+    CharsNeeded = 1;
+    for (Index = 0; Index < YoriShHistoryAppendQueue.Count; Index++) {
+        CharsNeeded = CharsNeeded + YoriShHistoryAppendQueue.Items[Index].LengthInChars + LineEndingLength;
+    }
+
+    Result = FALSE;
+    if (!YoriLibIsSizeAllocatable(CharsNeeded * sizeof(TCHAR)) ||
+        !YoriLibAllocateString(&Lines, (YORI_ALLOC_SIZE_T)CharsNeeded)) {
+
+        goto Exit;
+    }
+
+    Lines.LengthInChars = 0;
+    for (Index = 0; Index < YoriShHistoryAppendQueue.Count; Index++) {
+        memcpy(&Lines.StartOfString[Lines.LengthInChars], YoriShHistoryAppendQueue.Items[Index].StartOfString, YoriShHistoryAppendQueue.Items[Index].LengthInChars * sizeof(TCHAR));
+        Lines.LengthInChars = Lines.LengthInChars + YoriShHistoryAppendQueue.Items[Index].LengthInChars;
+        memcpy(&Lines.StartOfString[Lines.LengthInChars], LineEnding, LineEndingLength * sizeof(TCHAR));
+        Lines.LengthInChars = Lines.LengthInChars + LineEndingLength;
+    }
+
+    BytesNeeded = YoriLibGetMbyteOutputSizeNeeded(Lines.StartOfString, Lines.LengthInChars);
+    EncodedLines = YoriLibMalloc(BytesNeeded);
+    if (EncodedLines == NULL) {
+        YoriLibFreeStringContents(&Lines);
+        goto Exit;
+    }
+
+    YoriLibMultibyteOutput(Lines.StartOfString, Lines.LengthInChars, EncodedLines, BytesNeeded);
+    YoriLibFreeStringContents(&Lines);
+
+    //
+    //  A shell compacting the file opens it without sharing write access.
+    //  Rather than stall the prompt until that completes, leave the
+    //  commands queued to be written later.
+    //
+
+    if (Wait) {
+        FileHandle = YoriShOpenHistoryFile(FilePath,
+                                           FILE_APPEND_DATA | SYNCHRONIZE,
+                                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                           OPEN_ALWAYS);
+    } else {
+        FileHandle = CreateFile(FilePath->StartOfString,
+                                FILE_APPEND_DATA | SYNCHRONIZE,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                NULL,
+                                OPEN_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL,
+                                NULL);
+    }
+
+    if (FileHandle == INVALID_HANDLE_VALUE) {
+        if (!Wait && GetLastError() == ERROR_SHARING_VIOLATION) {
+            YoriLibFree(EncodedLines);
+            return TRUE;
+        }
+        YoriLibFree(EncodedLines);
+        goto Exit;
+    }
+
+    if (WriteFile(FileHandle, EncodedLines, BytesNeeded, &BytesWritten, NULL) &&
+        BytesWritten == BytesNeeded) {
+
+        Result = TRUE;
+    }
+
+    CloseHandle(FileHandle);
+    YoriLibFree(EncodedLines);
+
+Exit:
+    YoriStringArrayCleanup(&YoriShHistoryAppendQueue);
+    return Result;
+}
+
+/**
+ Append a command to the history file, if the user has requested this
+ behavior by configuring the YORIHISTFILE environment variable.
+
+ @param NewCmd Pointer to the command to append.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShAppendToHistoryFile(
+    __in PYORI_STRING NewCmd
+    )
+{
+    YORI_STRING FilePath;
+    BOOL Result;
+
+    if (NewCmd->LengthInChars == 0) {
+        return TRUE;
+    }
+
+    if (!YoriShGetHistoryFilePath(&FilePath)) {
+        return FALSE;
+    }
+
+    if (FilePath.LengthInChars == 0) {
+        YoriStringArrayCleanup(&YoriShHistoryAppendQueue);
+        return TRUE;
+    }
+
+    if (!YoriStringArrayAddItems(&YoriShHistoryAppendQueue, NewCmd, 1)) {
+        YoriLibFreeStringContents(&FilePath);
+        return FALSE;
+    }
+
+    Result = YoriShWriteHistoryAppendQueue(&FilePath, FALSE);
+    YoriLibFreeStringContents(&FilePath);
+    return Result;
+}
+
+/**
+ Write any commands that could not be appended to the history file because
+ it was being compacted.
+
+ @param Wait If TRUE, wait for a short time for any compaction to complete.
+        If FALSE, return immediately if the file is being compacted.
+ */
+VOID
+YoriShFlushHistoryAppendQueue(
+    __in BOOLEAN Wait
+    )
+{
+    YORI_STRING FilePath;
+
+    if (YoriShHistoryAppendQueue.Count == 0) {
+        return;
+    }
+
+    if (!YoriShGetHistoryFilePath(&FilePath)) {
+        return;
+    }
+
+    if (FilePath.LengthInChars == 0) {
+        YoriStringArrayCleanup(&YoriShHistoryAppendQueue);
+        return;
+    }
+
+    if (!YoriShWriteHistoryAppendQueue(&FilePath, Wait)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("yori: could not save history to %y\n"), &FilePath);
+    }
+
+    YoriLibFreeStringContents(&FilePath);
+}
+
+/**
+ Remove all entries from the history file, if the user has requested that
+ history be saved by configuring the YORIHISTFILE environment variable.
+
+ @return TRUE to indicate success, FALSE to indicate failure.
+ */
+__success(return)
+BOOL
+YoriShClearHistoryFile(VOID)
+{
+    YORI_STRING FilePath;
+    HANDLE FileHandle;
+    BOOL Result;
+
+    YoriShWaitForHistoryFile();
+
+    if (!YoriShGetHistoryFilePath(&FilePath)) {
+        return FALSE;
+    }
+
+    if (FilePath.LengthInChars == 0) {
+        return TRUE;
+    }
+
+    FileHandle = YoriShOpenHistoryFile(&FilePath,
+                                       GENERIC_READ | GENERIC_WRITE,
+                                       FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                       OPEN_EXISTING);
+
+    YoriLibFreeStringContents(&FilePath);
+
+    if (FileHandle == INVALID_HANDLE_VALUE) {
+        if (GetLastError() == ERROR_FILE_NOT_FOUND) {
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    Result = FALSE;
+    if (YoriShLockHistoryFile(FileHandle)) {
+        SetFilePointer(FileHandle, 0, NULL, FILE_BEGIN);
+        if (SetEndOfFile(FileHandle)) {
+            Result = TRUE;
+        }
+        YoriShUnlockHistoryFile(FileHandle);
+    }
+
+    CloseHandle(FileHandle);
+    return Result;
+}
+
 /**
  Build history into an array of NULL terminated strings terminated by an
  additional NULL terminator.  The result must be freed with a subsequent
@@ -704,7 +704,8 @@ YoriShConfigureMouseForPrograms(
  read them as keystrokes.  For app close however, we want to be able to save
  state before terminating.  Frustratingly, this handler is invoked and all
  other threads are immediately terminated, so any state must be saved
- right here.
+ right here.  History is appended to the history file as each command is
+ entered, so the only thing to do is let any rewrite of that file finish.
 
  @param CtrlType Indicates the type of the control message.
 
@@ -721,7 +722,7 @@ YoriShAppCloseCtrlHandler(
         CtrlType == CTRL_LOGOFF_EVENT ||
         CtrlType == CTRL_SHUTDOWN_EVENT) {
 
-        YoriShSaveHistoryToFile();
+        YoriShWaitForHistoryFile();
         return FALSE;
     }
 
@@ -751,6 +752,7 @@ YoriShTerminateInput(
     Buffer->SuggestionPopulated = FALSE;
     YoriLibFreeStringContents(&Buffer->SuggestionString);
     YoriLibFreeStringContents(&Buffer->SearchString);
+    YoriLibFreeStringContents(&Buffer->PreSearchString);
     SetConsoleCtrlHandler(YoriShAppCloseCtrlHandler, FALSE);
     YoriShDisplayAfterKeyPress(Buffer);
     YoriShPostKeyPress(Buffer);
@@ -819,6 +821,7 @@ YoriShClearInput(
     Buffer->SuggestionPopulated = FALSE;
     YoriLibFreeStringContents(&Buffer->SuggestionString);
     YoriLibFreeStringContents(&Buffer->SearchString);
+    YoriLibFreeStringContents(&Buffer->PreSearchString);
     YoriShClearTabCompletionMatches(Buffer);
     if (Buffer->String.LengthInChars > 0) {
         YoriShExtendDirtyRangeToCover(Buffer, 0, Buffer->String.LengthInChars);
@@ -826,6 +829,7 @@ YoriShClearInput(
     Buffer->String.LengthInChars = 0;
     Buffer->CurrentOffset = 0;
     Buffer->SearchMode = FALSE;
+    Buffer->HistorySearchMode = FALSE;
     YoriShClearInputSelections(Buffer);
 }
 
@@ -855,6 +859,151 @@ YoriShUpdateSelectionWithSearchResult(
     }
 }
 
+/**
+ Replace the contents of the input buffer with a new string without
+ altering any search state.
+
+ @param Buffer Pointer to the input buffer to update.
+
+ @param NewString Pointer to the string to place in the input buffer.
+
+ @param NewOffset The offset within the new string to place the cursor.
+ */
+VOID
+YoriShReplaceInputDuringSearch(
+    __inout PYORI_SH_INPUT_BUFFER Buffer,
+    __in PYORI_STRING NewString,
+    __in YORI_ALLOC_SIZE_T NewOffset
+    )
+{
+    if (!YoriShEnsureStringHasEnoughCharacters(&Buffer->String, NewString->LengthInChars)) {
+        return;
+    }
+
+    Buffer->SuggestionPopulated = FALSE;
+    Buffer->SuggestionDirty = TRUE;
+    YoriLibFreeStringContents(&Buffer->SuggestionString);
+    YoriShClearTabCompletionMatches(Buffer);
+
+    if (Buffer->String.LengthInChars > 0) {
+        YoriShExtendDirtyRangeToCover(Buffer, 0, Buffer->String.LengthInChars);
+    }
+    memcpy(Buffer->String.StartOfString, NewString->StartOfString, NewString->LengthInChars * sizeof(TCHAR));
+    Buffer->String.LengthInChars = NewString->LengthInChars;
+    if (Buffer->String.LengthInChars > 0) {
+        YoriShExtendDirtyRangeToCover(Buffer, 0, Buffer->String.LengthInChars);
+    }
+    Buffer->CurrentOffset = NewOffset;
+}
+
+/**
+ Based on the search text entered so far, find a history entry containing
+ the text and display it in the input buffer.  If no entry matches, the
+ previous match remains displayed.
+
+ @param Buffer Pointer to the input buffer to update.
+
+ @param RestartSearch If TRUE, the search starts from the most recent
+        history entry.  If FALSE, the search starts from the currently
+        displayed match.
+
+ @param SkipCurrentMatch If TRUE, the currently displayed match is not
+        considered, so the next older match is found.  If FALSE, the
+        currently displayed match is retained if it still matches.
+ */
+VOID
+YoriShUpdateHistorySearchResult(
+    __inout PYORI_SH_INPUT_BUFFER Buffer,
+    __in BOOLEAN RestartSearch,
+    __in BOOLEAN SkipCurrentMatch
+    )
+{
+    PYORI_SH_HISTORY_ENTRY StartingEntry;
+    PYORI_SH_HISTORY_ENTRY HistoryEntry;
+    YORI_ALLOC_SIZE_T StringOffsetOfMatch;
+
+    if (Buffer->SearchString.LengthInChars == 0) {
+        Buffer->HistoryEntryToUse = NULL;
+        YoriShReplaceInputDuringSearch(Buffer, &Buffer->PreSearchString, Buffer->PreSearchOffset);
+        return;
+    }
+
+    StartingEntry = NULL;
+    if (!RestartSearch && Buffer->HistoryEntryToUse != NULL) {
+        StartingEntry = CONTAINING_RECORD(Buffer->HistoryEntryToUse, YORI_SH_HISTORY_ENTRY, ListEntry);
+    }
+
+    HistoryEntry = YoriShFindHistoryEntryContaining(&Buffer->SearchString, StartingEntry, (BOOLEAN)!SkipCurrentMatch, &StringOffsetOfMatch);
+    if (HistoryEntry == NULL && YoriShLoadOlderHistory()) {
+        HistoryEntry = YoriShFindHistoryEntryContaining(&Buffer->SearchString, StartingEntry, (BOOLEAN)!SkipCurrentMatch, &StringOffsetOfMatch);
+    }
+    if (HistoryEntry == NULL) {
+        return;
+    }
+
+    Buffer->HistoryEntryToUse = &HistoryEntry->ListEntry;
+    YoriShReplaceInputDuringSearch(Buffer, &HistoryEntry->CmdLine, StringOffsetOfMatch + Buffer->SearchString.LengthInChars);
+}
+
+/**
+ Start searching backwards through history.  If a history search is already
+ in progress, find the next older match.
+
+ @param Buffer Pointer to the input buffer.
+ */
+VOID
+YoriShStartHistorySearch(
+    __inout PYORI_SH_INPUT_BUFFER Buffer
+    )
+{
+    if (Buffer->SearchMode && Buffer->HistorySearchMode) {
+        YoriShUpdateHistorySearchResult(Buffer, FALSE, TRUE);
+        return;
+    }
+
+    if (!YoriLibAllocateString(&Buffer->PreSearchString, Buffer->String.LengthInChars + 1)) {
+        return;
+    }
+    memcpy(Buffer->PreSearchString.StartOfString, Buffer->String.StartOfString, Buffer->String.LengthInChars * sizeof(TCHAR));
+    Buffer->PreSearchString.LengthInChars = Buffer->String.LengthInChars;
+
+    Buffer->SearchMode = TRUE;
+    Buffer->HistorySearchMode = TRUE;
+    Buffer->PreSearchOffset = Buffer->CurrentOffset;
+    Buffer->SearchString.LengthInChars = 0;
+    Buffer->HistoryEntryToUse = NULL;
+}
+
+/**
+ Stop searching, either within the input buffer or within history.
+
+ @param Buffer Pointer to the input buffer.
+
+ @param Cancel If TRUE, the input buffer is returned to the state it was in
+        before the search started.  If FALSE, the result of the search is
+        retained.
+ */
+VOID
+YoriShEndSearch(
+    __inout PYORI_SH_INPUT_BUFFER Buffer,
+    __in BOOLEAN Cancel
+    )
+{
+    if (Cancel) {
+        if (Buffer->HistorySearchMode) {
+            Buffer->HistoryEntryToUse = NULL;
+            YoriShReplaceInputDuringSearch(Buffer, &Buffer->PreSearchString, Buffer->PreSearchOffset);
+        } else {
+            Buffer->CurrentOffset = Buffer->PreSearchOffset;
+        }
+    }
+
+    Buffer->SearchMode = FALSE;
+    Buffer->HistorySearchMode = FALSE;
+    YoriLibFreeStringContents(&Buffer->SearchString);
+    YoriLibFreeStringContents(&Buffer->PreSearchString);
+}
+
 
 /**
  Display all of the tab completion matches.  Note this routine needs to
@@ -997,7 +1146,11 @@ YoriShBackspace(
 
         Buffer->SearchString.LengthInChars = Buffer->SearchString.LengthInChars - CountToUse;
 
-        YoriShUpdateSelectionWithSearchResult(Buffer);
+        if (Buffer->HistorySearchMode) {
+            YoriShUpdateHistorySearchResult(Buffer, TRUE, FALSE);
+        } else {
+            YoriShUpdateSelectionWithSearchResult(Buffer);
+        }
         return;
     }
 
@@ -1194,7 +1347,11 @@ YoriShAddYoriStringToInput(
         memcpy(&Buffer->SearchString.StartOfString[Buffer->SearchString.LengthInChars], String->StartOfString, String->LengthInChars * sizeof(TCHAR));
         Buffer->SearchString.LengthInChars = Buffer->SearchString.LengthInChars + String->LengthInChars;
 
-        YoriShUpdateSelectionWithSearchResult(Buffer);
+        if (Buffer->HistorySearchMode) {
+            YoriShUpdateHistorySearchResult(Buffer, FALSE, FALSE);
+        } else {
+            YoriShUpdateSelectionWithSearchResult(Buffer);
+        }
 
     } else if (Buffer->InsertMode) {
         if (!YoriShEnsureStringHasEnoughCharacters(&Buffer->String, Buffer->String.LengthInChars + String->LengthInChars)) {
@@ -2044,6 +2201,9 @@ YoriShProcessEnhancedKeyDown(
 
     if (KeyCode == VK_UP) {
         NewEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, Buffer->HistoryEntryToUse);
+        if (NewEntry == NULL && YoriShLoadOlderHistory()) {
+            NewEntry = YoriLibGetPreviousListEntry(&YoriShGlobal.CommandHistory, Buffer->HistoryEntryToUse);
+        }
         if (NewEntry != NULL) {
             Buffer->HistoryEntryToUse = NewEntry;
             HistoryEntry = CONTAINING_RECORD(NewEntry, YORI_SH_HISTORY_ENTRY, ListEntry);
@@ -2088,8 +2248,7 @@ YoriShProcessEnhancedKeyDown(
         }
     } else if (KeyCode == VK_RETURN) {
         if (Buffer->SearchMode) {
-            Buffer->SearchMode = FALSE;
-            YoriLibFreeStringContents(&Buffer->SearchString);
+            YoriShEndSearch(Buffer, FALSE);
         } else {
             if (!YoriLibCopySelectionIfPresent(&Buffer->Selection)) {
                 *TerminateInput = TRUE;
@@ -2317,8 +2476,7 @@ YoriShProcessKeyDown(
 
         if (Char == '\r') {
             if (Buffer->SearchMode) {
-                Buffer->SearchMode = FALSE;
-                YoriLibFreeStringContents(&Buffer->SearchString);
+                YoriShEndSearch(Buffer, FALSE);
             } else {
                 if (!YoriLibCopySelectionIfPresent(&Buffer->Selection)) {
                     *TerminateInput = TRUE;
@@ -2328,9 +2486,7 @@ YoriShProcessKeyDown(
             }
         } else if (Char == 27) {
             if (Buffer->SearchMode) {
-                Buffer->SearchMode = FALSE;
-                Buffer->CurrentOffset = Buffer->PreSearchOffset;
-                YoriLibFreeStringContents(&Buffer->SearchString);
+                YoriShEndSearch(Buffer, TRUE);
             } else {
                 YoriShClearInput(Buffer);
                 Buffer->HistoryEntryToUse = NULL;
@@ -2429,6 +2585,8 @@ YoriShProcessKeyDown(
             ClearSelection = TRUE;
         } else if (KeyCode == 'L') {
             YoriShClearScreen(Buffer);
+        } else if (KeyCode == 'R') {
+            YoriShStartHistorySearch(Buffer);
         } else if (KeyCode == 'V') {
             YORI_STRING ClipboardData;
             YoriLibInitEmptyString(&ClipboardData);
@@ -2442,16 +2600,16 @@ YoriShProcessKeyDown(
             YoriShAddYoriStringToInput(Buffer, &YoriShGlobal.YankBuffer);
         } else if (KeyCode == 0xDB) { // Aka VK_OEM_4, { or [ on US keyboards
             if (Buffer->SearchMode) {
-                Buffer->SearchMode = FALSE;
-                Buffer->CurrentOffset = Buffer->PreSearchOffset;
-                YoriLibFreeStringContents(&Buffer->SearchString);
+                YoriShEndSearch(Buffer, TRUE);
             } else {
                 YoriShClearInput(Buffer);
                 Buffer->HistoryEntryToUse = NULL;
             }
         } else if (KeyCode == 0xBF) { // Aka VK_OEM_2, / or ? on US keyboards
-            Buffer->SearchMode = TRUE;
-            Buffer->PreSearchOffset = Buffer->CurrentOffset;
+            if (!Buffer->HistorySearchMode) {
+                Buffer->SearchMode = TRUE;
+                Buffer->PreSearchOffset = Buffer->CurrentOffset;
+            }
         } else if (KeyCode == VK_TAB) {
             YoriShConfigureConsoleForTabComplete(Buffer);
             ListAll = YoriShTabCompletion(Buffer, YORI_SH_TAB_COMPLETE_FULL_PATH);
@@ -3183,7 +3341,9 @@ YoriShGetExpressionFromConsole(
                 YoriShTerminateInput(&Buffer);
                 ReadConsoleInput(InputHandle, InputRecords, CurrentRecordIndex + 1, &ActuallyRead);
                 if (Buffer.String.LengthInChars > 0) {
-                    YoriShAddToHistory(&Buffer.String, TRUE);
+                    if (YoriShAddToHistory(&Buffer.String, TRUE)) {
+                        YoriShAppendToHistoryFile(&Buffer.String);
+                    }
                 }
                 memcpy(Expression, &Buffer.String, sizeof(YORI_STRING));
                 return TRUE;
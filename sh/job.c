@@ -95,6 +95,11 @@ typedef struct _YORI_JOB {
  */
 YORI_LIST_ENTRY JobList;
 
+/**
+ The pool that job structures are allocated from.
+ */
+YORI_LIB_POOL JobPool;
+
 /**
  Allocate a new job for background processing.
 
@@ -115,7 +120,7 @@ YoriShCreateNewJob(
         YoriLibInitializeListHead(&JobList);
     }
 
-    ThisJob = YoriLibMalloc(sizeof(YORI_JOB));
+    ThisJob = YoriLibPoolAlloc(&JobPool, sizeof(YORI_JOB));
     if (ThisJob == NULL) {
         return FALSE;
     }
@@ -123,7 +128,7 @@ YoriShCreateNewJob(
     ZeroMemory(ThisJob, sizeof(YORI_JOB));
 
     if (!YoriLibShBuildCmdlineFromCmdContext(&ExecContext->CmdToExec, &ThisJob->CmdLine, TRUE, NULL, NULL)) {
-        YoriLibFree(ThisJob);
+        YoriLibPoolFree(ThisJob);
         return FALSE;
     }
 
@@ -168,7 +173,7 @@ YoriShFreeJob(
     }
 
     YoriLibFreeStringContents(&ThisJob->CmdLine);
-    YoriLibFree(ThisJob);
+    YoriLibPoolFree(ThisJob);
 }
 
 /**
@@ -223,6 +228,10 @@ YoriShScanJobsReportCompletion(
         }
     }
 
+    if (TeardownAll) {
+        YoriLibCleanupPool(&JobPool);
+    }
+
     return TRUE;
 }
 
@@ -864,7 +864,9 @@ ymain (
     YORI_STRING CurrentExpression;
     BOOLEAN TerminateApp = FALSE;
 
+    YoriLibCheckAllocationProfileEnvironment();
     YoriShInit();
+    YoriLibEnablePathIndex();
     YoriShParseArgs(ArgC, ArgV, &TerminateApp, &YoriShGlobal.ExitProcessExitCode);
 
     if (!TerminateApp) {
@@ -877,6 +879,7 @@ ymain (
             YoriShPostCommand();
             YoriShScanJobsReportCompletion(FALSE);
             YoriLibShScanProcessBuffersForTeardown(FALSE);
+            YoriLibCheckAllocationProfileEnvironment();
             if (YoriShGlobal.ExitProcess) {
                 break;
             }
@@ -909,11 +912,11 @@ ymain (
             YoriLibFreeStringContents(&CurrentExpression);
         }
 
-        YoriShSaveHistoryToFile();
+        YoriShWaitForHistoryFile();
     }
 
-    YoriLibShScanProcessBuffersForTeardown(TRUE);
     YoriShScanJobsReportCompletion(TRUE);
+    YoriLibShScanProcessBuffersForTeardown(TRUE);
     YoriShClearAllHistory();
     YoriShClearAllAliases();
     YoriLibShBuiltinUnregisterAll();
@@ -921,6 +924,7 @@ ymain (
     YoriShCleanupInputContext();
     YoriLibLineReadCleanupCache();
     YoriLibCleanupCurrentDirectory();
+    YoriLibDisablePathIndex();
     YoriLibFreeStringContents(&YoriShGlobal.PreCmdVariable);
     YoriLibFreeStringContents(&YoriShGlobal.PostCmdVariable);
     YoriLibFreeStringContents(&YoriShGlobal.PromptVariable);
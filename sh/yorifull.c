@@ -356,6 +356,11 @@ YORI_CMD_BUILTIN YoriCmd_YOBJDIR;
  */
 YORI_CMD_BUILTIN YoriCmd_OSVER;
 
+/**
+ Declaration for the builtin command.
+ */
+YORI_CMD_BUILTIN YoriCmd_PATHIDX;
+
 /**
  Declaration for the builtin command.
  */
@@ -610,6 +615,7 @@ YoriShBuiltins[] = {
                     {_T("LINES"),     YoriCmd_LINES},
                     {_T("NICE"),      YoriCmd_NICE},
                     {_T("OSVER"),     YoriCmd_OSVER},
+                    {_T("PATHIDX"),   YoriCmd_PATHIDX},
                     {_T("PETOOL"),    YoriCmd_PETOOL},
                     {_T("PROCINFO"),  YoriCmd_PROCINFO},
                     {_T("PUSHD"),     YoriCmd_PUSHD},
@@ -280,6 +280,32 @@ YoriShExecuteExpression(
     __in PYORI_STRING Expression
     );
 
+// *** HISTIDX.C ***
+
+VOID
+YoriShHistoryIndexAdd(
+    __in PYORI_SH_HISTORY_ENTRY HistoryEntry
+    );
+
+VOID
+YoriShHistoryIndexRemove(
+    __in PYORI_SH_HISTORY_ENTRY HistoryEntry
+    );
+
+VOID
+YoriShHistoryIndexClear(VOID);
+
+VOID
+YoriShHistoryIndexRefresh(VOID);
+
+PYORI_SH_HISTORY_ENTRY
+YoriShFindHistoryEntryContaining(
+    __in PYORI_STRING SearchString,
+    __in_opt PYORI_SH_HISTORY_ENTRY StartingEntry,
+    __in BOOLEAN IncludeStartingEntry,
+    __out PYORI_ALLOC_SIZE_T MatchOffset
+    );
+
 // *** HISTORY.C ***
 
 __success(return)
@@ -311,9 +337,26 @@ __success(return)
 BOOL
 YoriShLoadHistoryFromFile(VOID);
 
+VOID
+YoriShWaitForHistoryFile(VOID);
+
+BOOL
+YoriShLoadOlderHistory(VOID);
+
+__success(return)
+BOOL
+YoriShAppendToHistoryFile(
+    __in PYORI_STRING NewCmd
+    );
+
+VOID
+YoriShFlushHistoryAppendQueue(
+    __in BOOLEAN Wait
+    );
+
 __success(return)
 BOOL
-YoriShSaveHistoryToFile(VOID);
+YoriShClearHistoryFile(VOID);
 
 __success(return)
 BOOL
@@ -96,6 +96,11 @@ YORI_CMD_BUILTIN YoriCmd_JOB;
  */
 YORI_CMD_BUILTIN YoriCmd_NICE;
 
+/**
+ Declaration for the builtin command.
+ */
+YORI_CMD_BUILTIN YoriCmd_PATHIDX;
+
 /**
  Declaration for the builtin command.
  */
@@ -170,6 +175,7 @@ YoriShBuiltins[] = {
                     {_T("INTCMP"),    YoriCmd_INTCMP},
                     {_T("JOB"),       YoriCmd_JOB},
                     {_T("NICE"),      YoriCmd_NICE},
+                    {_T("PATHIDX"),   YoriCmd_PATHIDX},
                     {_T("PUSHD"),     YoriCmd_PUSHD},
                     {_T("REM"),       YoriCmd_REM},
                     {_T("SET"),       YoriCmd_SET},
@@ -38,6 +38,11 @@ typedef struct _YORI_SH_HISTORY_ENTRY {
      The command that was executed by the user.
      */
     YORI_STRING CmdLine;
+
+    /**
+     The sequence number of this entry within the history search index.
+     */
+    DWORD IndexSequence;
 } YORI_SH_HISTORY_ENTRY, *PYORI_SH_HISTORY_ENTRY;
 
 /**
@@ -313,10 +318,24 @@ typedef struct _YORI_SH_INPUT_BUFFER {
     YORI_ALLOC_SIZE_T PreSearchOffset;
 
     /**
-     The current search string, when searching within the buffer itself.
+     The current search string, when searching within the buffer itself or
+     within history.
      */
     YORI_STRING SearchString;
 
+    /**
+     If TRUE, the search string is being used to find entries in history
+     rather than to move within the input buffer.  This is only meaningful
+     if SearchMode is TRUE.
+     */
+    BOOLEAN HistorySearchMode;
+
+    /**
+     A copy of the input buffer as it was when a history search started.
+     This is restored if the search is cancelled.
+     */
+    YORI_STRING PreSearchString;
+
 } YORI_SH_INPUT_BUFFER, *PYORI_SH_INPUT_BUFFER;
 
 /**
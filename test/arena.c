@@ -0,0 +1,125 @@
+/**
+ * @file test/arena.c
+ *
+ * Yori shell test arena allocation
+ *
+ * Copyright (c) 2022 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include "test.h"
+
+/**
+ The number of allocations to make from the arena in each pass.
+ */
+#define TEST_ARENA_ALLOCATIONS (500)
+
+/**
+ A test variation to allocate from an arena, check that allocations are
+ aligned and do not overlap, reset the arena and allocate again, and check
+ that strings allocated from the arena remain valid after it is cleaned up.
+ */
+BOOLEAN
+TestArenaAlloc(VOID)
+{
+    YORI_LIB_ARENA Arena;
+    PUCHAR Allocations[TEST_ARENA_ALLOCATIONS];
+    YORI_ALLOC_SIZE_T Sizes[TEST_ARENA_ALLOCATIONS];
+    YORI_STRING String;
+    DWORD Pass;
+    DWORD Index;
+    YORI_ALLOC_SIZE_T ByteIndex;
+    BOOLEAN Result;
+
+    YoriLibInitializeArena(&Arena, 1024);
+    YoriLibInitEmptyString(&String);
+    Result = TRUE;
+
+    for (Pass = 0; Result && Pass < 2; Pass++) {
+
+        //
+        //  Most allocations are small, but every 50th allocation is larger
+        //  than the chunk size.
+        //
+
+        for (Index = 0; Index < TEST_ARENA_ALLOCATIONS; Index++) {
+            Sizes[Index] = (Index * 7) % 61;
+            if ((Index % 50) == 0) {
+                Sizes[Index] = 3000;
+            }
+
+            Allocations[Index] = YoriLibArenaAlloc(&Arena, Sizes[Index], NULL);
+            if (Allocations[Index] == NULL) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibArenaAlloc failed\n"), __FILE__, __LINE__);
+                Result = FALSE;
+                break;
+            }
+
+            if (((DWORD_PTR)Allocations[Index] & (sizeof(DWORDLONG) - 1)) != 0) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i allocation %i is not aligned\n"), __FILE__, __LINE__, Index);
+                Result = FALSE;
+                break;
+            }
+
+            FillMemory(Allocations[Index], Sizes[Index], (UCHAR)Index);
+        }
+
+        for (Index = 0; Result && Index < TEST_ARENA_ALLOCATIONS; Index++) {
+            for (ByteIndex = 0; ByteIndex < Sizes[Index]; ByteIndex++) {
+                if (Allocations[Index][ByteIndex] != (UCHAR)Index) {
+                    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i allocation %i was overwritten\n"), __FILE__, __LINE__, Index);
+                    Result = FALSE;
+                    break;
+                }
+            }
+        }
+
+        if (Pass == 0) {
+            if (Result && !YoriLibArenaAllocateString(&Arena, &String, sizeof("arena"))) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibArenaAllocateString failed\n"), __FILE__, __LINE__);
+                Result = FALSE;
+            }
+            if (Result) {
+                String.LengthInChars = YoriLibSPrintfS(String.StartOfString, String.LengthAllocated, _T("arena"));
+            }
+            YoriLibResetArena(&Arena);
+        }
+    }
+
+    YoriLibCleanupArena(&Arena);
+
+    //
+    //  The string holds a reference on its allocation, so it should still
+    //  be valid after the arena has been reset and cleaned up.
+    //
+
+    if (Result && YoriLibCompareStringLit(&String, _T("arena")) != 0) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i string contains '%y', expected 'arena'\n"), __FILE__, __LINE__, &String);
+        Result = FALSE;
+    }
+
+    YoriLibFreeStringContents(&String);
+    return Result;
+}
+
+// vim:sw=4:ts=4:et:
@@ -0,0 +1,528 @@
+/**
+ * @file test/cmdbuf.c
+ *
+ * Yori shell test process output buffering
+ *
+ * Copyright (c) 2022 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include <yorish.h>
+#include "test.h"
+
+/**
+ The number of bytes written by the producer.  This is larger than the
+ memory limit used by the test so that data is written to a spill file.
+ */
+#define TEST_CMDBUF_BYTES (3 * 1024 * 1024 + 17)
+
+/**
+ The number of bytes written by the producer in each call.  This is small
+ so that the buffer receives many small reads.
+ */
+#define TEST_CMDBUF_WRITE_SIZE (100)
+
+/**
+ The number of bytes read from the mirror in each call.
+ */
+#define TEST_CMDBUF_READ_SIZE (64 * 1024)
+
+/**
+ The number of bytes written by the producer when measuring throughput.
+ This is larger than the default memory limit so the measurement includes
+ writing to a spill file.
+ */
+#define TEST_CMDBUF_TIMED_BYTES (64 * 1024 * 1024)
+
+/**
+ The number of bytes written by the producer in each call when measuring
+ throughput with large writes.
+ */
+#define TEST_CMDBUF_TIMED_WRITE_SIZE (64 * 1024)
+
+/**
+ The length of the pattern generated by TestCmdBufPatternAt.
+ */
+#define TEST_CMDBUF_PATTERN_LENGTH (23)
+
+/**
+ Return the character expected at a specified offset in the stream.  The
+ pattern does not repeat on any power of two, so data returned from the
+ wrong chunk is detected.
+
+ @param Offset The offset within the stream.
+
+ @return The character at that offset.
+ */
+UCHAR
+TestCmdBufPatternAt(
+    __in DWORD Offset
+    )
+{
+    return (UCHAR)('a' + (Offset % TEST_CMDBUF_PATTERN_LENGTH));
+}
+
+/**
+ Context for a thread which writes the pattern into a pipe.
+ */
+typedef struct _TEST_CMDBUF_PRODUCER_CONTEXT {
+
+    /**
+     The handle to write data to.  This is closed by the producer when all
+     data has been written.
+     */
+    HANDLE hPipe;
+
+    /**
+     The total number of bytes to write.
+     */
+    DWORD TotalBytes;
+
+    /**
+     The number of bytes to write in each call.
+     */
+    DWORD WriteSize;
+} TEST_CMDBUF_PRODUCER_CONTEXT, *PTEST_CMDBUF_PRODUCER_CONTEXT;
+
+/**
+ A thread which writes the pattern into a pipe in pieces as quickly as it
+ can, then closes the pipe.  The pattern is generated once, and each write
+ is taken from the offset within it that continues the stream, so the
+ producer spends its time writing rather than generating data.
+
+ @param Param Pointer to the producer context.
+
+ @return Zero on success, nonzero on failure.
+ */
+DWORD WINAPI
+TestCmdBufProducer(
+    __in LPVOID Param
+    )
+{
+    PTEST_CMDBUF_PRODUCER_CONTEXT Context = (PTEST_CMDBUF_PRODUCER_CONTEXT)Param;
+    PUCHAR Buffer;
+    DWORD Offset;
+    DWORD Index;
+    DWORD BytesToWrite;
+    DWORD BytesWritten;
+    DWORD Result;
+
+    Result = 1;
+    Buffer = YoriLibMalloc(Context->WriteSize + TEST_CMDBUF_PATTERN_LENGTH);
+    if (Buffer == NULL) {
+        goto Exit;
+    }
+
+    for (Index = 0; Index < Context->WriteSize + TEST_CMDBUF_PATTERN_LENGTH; Index++) {
+        Buffer[Index] = TestCmdBufPatternAt(Index);
+    }
+
+    Offset = 0;
+    while (Offset < Context->TotalBytes) {
+        BytesToWrite = Context->WriteSize;
+        if (Offset + BytesToWrite > Context->TotalBytes) {
+            BytesToWrite = Context->TotalBytes - Offset;
+        }
+        if (!WriteFile(Context->hPipe, &Buffer[Offset % TEST_CMDBUF_PATTERN_LENGTH], BytesToWrite, &BytesWritten, NULL) ||
+            BytesWritten != BytesToWrite) {
+
+            goto Exit;
+        }
+        Offset = Offset + BytesWritten;
+    }
+
+    Result = 0;
+
+Exit:
+    if (Buffer != NULL) {
+        YoriLibFree(Buffer);
+    }
+    CloseHandle(Context->hPipe);
+    return Result;
+}
+
+/**
+ Context for a thread which reads data sent to a mirror.
+ */
+typedef struct _TEST_CMDBUF_MIRROR_CONTEXT {
+
+    /**
+     The handle to read mirrored data from.
+     */
+    HANDLE hPipe;
+
+    /**
+     The number of bytes received.
+     */
+    DWORD BytesReceived;
+
+    /**
+     Set to TRUE if the data received does not match the pattern.
+     */
+    BOOLEAN Mismatch;
+} TEST_CMDBUF_MIRROR_CONTEXT, *PTEST_CMDBUF_MIRROR_CONTEXT;
+
+/**
+ A thread which reads data sent to a mirror until the mirror is closed and
+ checks that it matches the pattern.
+
+ @param Param Pointer to the mirror context.
+
+ @return Zero.
+ */
+DWORD WINAPI
+TestCmdBufMirrorReader(
+    __in LPVOID Param
+    )
+{
+    PTEST_CMDBUF_MIRROR_CONTEXT Context = (PTEST_CMDBUF_MIRROR_CONTEXT)Param;
+    PUCHAR Buffer;
+    DWORD BytesRead;
+    DWORD Index;
+
+    Buffer = YoriLibMalloc(TEST_CMDBUF_READ_SIZE);
+    if (Buffer == NULL) {
+        Context->Mismatch = TRUE;
+        return 0;
+    }
+
+    while (ReadFile(Context->hPipe, Buffer, TEST_CMDBUF_READ_SIZE, &BytesRead, NULL) &&
+           BytesRead > 0) {
+
+        for (Index = 0; Index < BytesRead; Index++) {
+            if (Buffer[Index] != TestCmdBufPatternAt(Context->BytesReceived + Index)) {
+                Context->Mismatch = TRUE;
+            }
+        }
+        Context->BytesReceived = Context->BytesReceived + BytesRead;
+    }
+
+    YoriLibFree(Buffer);
+    return 0;
+}
+
+/**
+ A test variation to capture output from a fast producer into a process
+ buffer which exceeds its memory limit, mirror it to a pipe while it is
+ being captured, and check that both the mirror and the buffer contents are
+ complete and in order.
+ */
+BOOLEAN
+TestCmdBufPump(VOID)
+{
+    YORI_LIBSH_SINGLE_EXEC_CONTEXT ExecContext;
+    TEST_CMDBUF_PRODUCER_CONTEXT ProducerContext;
+    TEST_CMDBUF_MIRROR_CONTEXT MirrorContext;
+    YORI_STRING Output;
+    HANDLE ReadPipe;
+    HANDLE WritePipe;
+    HANDLE MirrorWritePipe;
+    HANDLE hProducer;
+    HANDLE hMirrorReader;
+    PVOID ProcessBuffers;
+    DWORD ThreadId;
+    DWORD ExitCode;
+    DWORD Index;
+    BOOLEAN Result;
+
+    Result = FALSE;
+    hProducer = NULL;
+    hMirrorReader = NULL;
+    ProcessBuffers = NULL;
+    ZeroMemory(&MirrorContext, sizeof(MirrorContext));
+    YoriLibInitEmptyString(&Output);
+
+    //
+    //  Use a one megabyte limit so the test data is spilled to disk.
+    //
+
+    SetEnvironmentVariable(_T("YORIBUFFERLIMIT"), _T("1"));
+
+    if (!CreatePipe(&ReadPipe, &WritePipe, NULL, 0)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i CreatePipe failed, error %i\n"), __FILE__, __LINE__, GetLastError());
+        goto Exit;
+    }
+
+    ZeroMemory(&ExecContext, sizeof(ExecContext));
+    ExecContext.StdOutType = StdOutTypeBuffer;
+    ExecContext.StdErrType = StdErrTypeDefault;
+    ExecContext.StdOut.Buffer.PipeFromProcess = ReadPipe;
+
+    if (!YoriLibShCreateNewProcessBuffer(&ExecContext)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibShCreateNewProcessBuffer failed\n"), __FILE__, __LINE__);
+        CloseHandle(ReadPipe);
+        CloseHandle(WritePipe);
+        goto Exit;
+    }
+    ProcessBuffers = ExecContext.StdOut.Buffer.ProcessBuffers;
+
+    //
+    //  Attach the mirror before any data is written so that the mirror
+    //  should receive the entire stream.
+    //
+
+    if (!CreatePipe(&MirrorContext.hPipe, &MirrorWritePipe, NULL, 0)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i CreatePipe failed, error %i\n"), __FILE__, __LINE__, GetLastError());
+        CloseHandle(WritePipe);
+        goto Exit;
+    }
+
+    if (!YoriLibShPipeProcessBuffers(ProcessBuffers, MirrorWritePipe, NULL)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibShPipeProcessBuffers failed\n"), __FILE__, __LINE__);
+        CloseHandle(MirrorWritePipe);
+        CloseHandle(WritePipe);
+        goto Exit;
+    }
+
+    hMirrorReader = CreateThread(NULL, 0, TestCmdBufMirrorReader, &MirrorContext, 0, &ThreadId);
+    if (hMirrorReader == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i CreateThread failed, error %i\n"), __FILE__, __LINE__, GetLastError());
+        CloseHandle(WritePipe);
+        goto Exit;
+    }
+
+    ProducerContext.hPipe = WritePipe;
+    ProducerContext.TotalBytes = TEST_CMDBUF_BYTES;
+    ProducerContext.WriteSize = TEST_CMDBUF_WRITE_SIZE;
+
+    hProducer = CreateThread(NULL, 0, TestCmdBufProducer, &ProducerContext, 0, &ThreadId);
+    if (hProducer == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i CreateThread failed, error %i\n"), __FILE__, __LINE__, GetLastError());
+        CloseHandle(WritePipe);
+        goto Exit;
+    }
+
+    WaitForSingleObject(hProducer, INFINITE);
+    if (!GetExitCodeThread(hProducer, &ExitCode) || ExitCode != 0) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i producer failed to write data\n"), __FILE__, __LINE__);
+        goto Exit;
+    }
+
+    if (!YoriLibShWaitForProcessBufferToFinalize(ProcessBuffers)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibShWaitForProcessBufferToFinalize failed\n"), __FILE__, __LINE__);
+        goto Exit;
+    }
+
+    //
+    //  The pump closes the mirror when it completes, so the mirror reader
+    //  should observe the end of the stream.
+    //
+
+    WaitForSingleObject(hMirrorReader, INFINITE);
+    if (MirrorContext.Mismatch || MirrorContext.BytesReceived != TEST_CMDBUF_BYTES) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i mirror received %i bytes, expected %i, mismatch %i\n"), __FILE__, __LINE__, MirrorContext.BytesReceived, TEST_CMDBUF_BYTES, MirrorContext.Mismatch);
+        goto Exit;
+    }
+
+    if (!YoriLibShGetProcessOutputBuffer(ProcessBuffers, &Output)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibShGetProcessOutputBuffer failed\n"), __FILE__, __LINE__);
+        goto Exit;
+    }
+
+    if (Output.LengthInChars != TEST_CMDBUF_BYTES) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i buffer contains %i chars, expected %i\n"), __FILE__, __LINE__, Output.LengthInChars, TEST_CMDBUF_BYTES);
+        goto Exit;
+    }
+
+    for (Index = 0; Index < Output.LengthInChars; Index++) {
+        if (Output.StartOfString[Index] != TestCmdBufPatternAt(Index)) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i buffer contains %c at offset %i, expected %c\n"), __FILE__, __LINE__, Output.StartOfString[Index], Index, TestCmdBufPatternAt(Index));
+            goto Exit;
+        }
+    }
+
+    Result = TRUE;
+
+Exit:
+
+    YoriLibFreeStringContents(&Output);
+
+    if (hProducer != NULL) {
+        WaitForSingleObject(hProducer, INFINITE);
+        CloseHandle(hProducer);
+    }
+
+    //
+    //  If nothing is reading from the mirror, close it so the pump can't
+    //  block writing to it.
+    //
+
+    if (hMirrorReader == NULL && MirrorContext.hPipe != NULL) {
+        CloseHandle(MirrorContext.hPipe);
+        MirrorContext.hPipe = NULL;
+    }
+
+    if (ProcessBuffers != NULL) {
+        YoriLibShWaitForProcessBufferToFinalize(ProcessBuffers);
+        YoriLibShTeardownProcessBuffersIfCompleted(ProcessBuffers);
+        YoriLibShDereferenceProcessBuffer(ProcessBuffers);
+    }
+
+    if (hMirrorReader != NULL) {
+        WaitForSingleObject(hMirrorReader, INFINITE);
+        CloseHandle(hMirrorReader);
+    }
+
+    if (MirrorContext.hPipe != NULL) {
+        CloseHandle(MirrorContext.hPipe);
+    }
+
+    SetEnvironmentVariable(_T("YORIBUFFERLIMIT"), NULL);
+
+    return Result;
+}
+
+/**
+ Capture output from a fast producer into a process buffer using the default
+ memory limit, and display the rate at which it was captured.
+
+ @param Description A short description of the measurement.
+
+ @param TotalBytes The number of bytes for the producer to write.
+
+ @param WriteSize The number of bytes for the producer to write in each
+        call.
+
+ @return TRUE if all data was captured, FALSE if not.
+ */
+BOOLEAN
+TestCmdBufTimePump(
+    __in LPCTSTR Description,
+    __in DWORD TotalBytes,
+    __in DWORD WriteSize
+    )
+{
+    YORI_LIBSH_SINGLE_EXEC_CONTEXT ExecContext;
+    TEST_CMDBUF_PRODUCER_CONTEXT ProducerContext;
+    YORI_STRING Output;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER EndTime;
+    HANDLE ReadPipe;
+    HANDLE WritePipe;
+    HANDLE hProducer;
+    PVOID ProcessBuffers;
+    DWORD ThreadId;
+    DWORD ExitCode;
+    BOOLEAN Result;
+
+    Result = FALSE;
+    hProducer = NULL;
+    ProcessBuffers = NULL;
+    YoriLibInitEmptyString(&Output);
+
+    if (!CreatePipe(&ReadPipe, &WritePipe, NULL, 0)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i CreatePipe failed, error %i\n"), __FILE__, __LINE__, GetLastError());
+        goto Exit;
+    }
+
+    ZeroMemory(&ExecContext, sizeof(ExecContext));
+    ExecContext.StdOutType = StdOutTypeBuffer;
+    ExecContext.StdErrType = StdErrTypeDefault;
+    ExecContext.StdOut.Buffer.PipeFromProcess = ReadPipe;
+
+    QueryPerformanceCounter(&StartTime);
+
+    if (!YoriLibShCreateNewProcessBuffer(&ExecContext)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibShCreateNewProcessBuffer failed\n"), __FILE__, __LINE__);
+        CloseHandle(ReadPipe);
+        CloseHandle(WritePipe);
+        goto Exit;
+    }
+    ProcessBuffers = ExecContext.StdOut.Buffer.ProcessBuffers;
+
+    ProducerContext.hPipe = WritePipe;
+    ProducerContext.TotalBytes = TotalBytes;
+    ProducerContext.WriteSize = WriteSize;
+
+    hProducer = CreateThread(NULL, 0, TestCmdBufProducer, &ProducerContext, 0, &ThreadId);
+    if (hProducer == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i CreateThread failed, error %i\n"), __FILE__, __LINE__, GetLastError());
+        CloseHandle(WritePipe);
+        goto Exit;
+    }
+
+    WaitForSingleObject(hProducer, INFINITE);
+    if (!GetExitCodeThread(hProducer, &ExitCode) || ExitCode != 0) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i producer failed to write data\n"), __FILE__, __LINE__);
+        goto Exit;
+    }
+
+    if (!YoriLibShWaitForProcessBufferToFinalize(ProcessBuffers)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibShWaitForProcessBufferToFinalize failed\n"), __FILE__, __LINE__);
+        goto Exit;
+    }
+
+    QueryPerformanceCounter(&EndTime);
+
+    if (!YoriLibShGetProcessOutputBuffer(ProcessBuffers, &Output)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibShGetProcessOutputBuffer failed\n"), __FILE__, __LINE__);
+        goto Exit;
+    }
+
+    if (Output.LengthInChars != TotalBytes) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i buffer contains %i chars, expected %i\n"), __FILE__, __LINE__, Output.LengthInChars, TotalBytes);
+        goto Exit;
+    }
+
+    TestReportThroughput(Description, TotalBytes, &StartTime, &EndTime);
+    Result = TRUE;
+
+Exit:
+
+    YoriLibFreeStringContents(&Output);
+
+    if (hProducer != NULL) {
+        WaitForSingleObject(hProducer, INFINITE);
+        CloseHandle(hProducer);
+    }
+
+    if (ProcessBuffers != NULL) {
+        YoriLibShWaitForProcessBufferToFinalize(ProcessBuffers);
+        YoriLibShTeardownProcessBuffersIfCompleted(ProcessBuffers);
+        YoriLibShDereferenceProcessBuffer(ProcessBuffers);
+    }
+
+    return Result;
+}
+
+/**
+ A timed test variation to measure the rate at which output from a fast
+ producer is captured into a process buffer, both when the producer writes
+ large blocks and when it writes many small ones.  The amount of data
+ exceeds the default memory limit, so this includes the cost of writing to a
+ spill file.
+ */
+BOOLEAN
+TestCmdBufPumpThroughput(VOID)
+{
+    if (!TestCmdBufTimePump(_T("large writes"), TEST_CMDBUF_TIMED_BYTES, TEST_CMDBUF_TIMED_WRITE_SIZE)) {
+        return FALSE;
+    }
+
+    if (!TestCmdBufTimePump(_T("small writes"), TEST_CMDBUF_TIMED_BYTES, TEST_CMDBUF_WRITE_SIZE)) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// vim:sw=4:ts=4:et:
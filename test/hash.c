@@ -0,0 +1,366 @@
+/**
+ * @file test/hash.c
+ *
+ * Yori shell test hash tables
+ *
+ * Copyright (c) 2022 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include "test.h"
+
+/**
+ The number of entries to insert into a hash table when testing hash table
+ growth.
+ */
+#define TEST_HASH_ENTRY_COUNT (5000)
+
+/**
+ An entry inserted into a hash table by the hash table tests.
+ */
+typedef struct _TEST_HASH_ENTRY {
+
+    /**
+     The entry within the hash table.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     The index of this entry.
+     */
+    DWORD Index;
+
+    /**
+     Storage for the key of this entry.
+     */
+    TCHAR KeyBuffer[16];
+} TEST_HASH_ENTRY, *PTEST_HASH_ENTRY;
+
+/**
+ A test variation to insert many entries into a small hash table so it is
+ resized, and check that every entry can be found, enumerated and removed.
+ */
+BOOLEAN
+TestHashGrow(VOID)
+{
+    PYORI_HASH_TABLE HashTable;
+    PTEST_HASH_ENTRY Entries;
+    PTEST_HASH_ENTRY Entry;
+    PYORI_HASH_ENTRY HashEntry;
+    PYORI_HASH_ENTRY NextHashEntry;
+    YORI_STRING Key;
+    TCHAR KeyBuffer[16];
+    BOOLEAN Result;
+    DWORD Index;
+    DWORD Found;
+
+    Entries = YoriLibMalloc(TEST_HASH_ENTRY_COUNT * sizeof(TEST_HASH_ENTRY));
+    if (Entries == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibMalloc failed\n"), __FILE__, __LINE__);
+        return FALSE;
+    }
+
+    HashTable = YoriLibAllocateHashTable(1);
+    if (HashTable == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibAllocateHashTable failed\n"), __FILE__, __LINE__);
+        YoriLibFree(Entries);
+        return FALSE;
+    }
+
+    Result = TRUE;
+    YoriLibInitEmptyString(&Key);
+
+    for (Index = 0; Index < TEST_HASH_ENTRY_COUNT; Index++) {
+        Entry = &Entries[Index];
+        Entry->Index = Index;
+        Key.StartOfString = Entry->KeyBuffer;
+        Key.LengthInChars = (YORI_ALLOC_SIZE_T)YoriLibSPrintf(Entry->KeyBuffer, _T("Key%i"), Index);
+        YoriLibHashInsertByKey(HashTable, &Key, Entry, &Entry->HashEntry);
+    }
+
+    if (HashTable->NumberBuckets <= 1) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i hash table was not resized\n"), __FILE__, __LINE__);
+        Result = FALSE;
+    }
+
+    //
+    //  Look up each entry with a key that differs in case from the key
+    //  that was inserted.
+    //
+
+    Key.StartOfString = KeyBuffer;
+    for (Index = 0; Result && Index < TEST_HASH_ENTRY_COUNT; Index++) {
+        Key.LengthInChars = (YORI_ALLOC_SIZE_T)YoriLibSPrintf(KeyBuffer, _T("KEY%i"), Index);
+        HashEntry = YoriLibHashLookupByKey(HashTable, &Key);
+        if (HashEntry == NULL || HashEntry->Context != &Entries[Index]) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i lookup of %y failed\n"), __FILE__, __LINE__, &Key);
+            Result = FALSE;
+        }
+    }
+
+    Key.LengthInChars = (YORI_ALLOC_SIZE_T)YoriLibSPrintf(KeyBuffer, _T("Key%i"), TEST_HASH_ENTRY_COUNT);
+    if (Result && YoriLibHashLookupByKey(HashTable, &Key) != NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i lookup of %y succeeded unexpectedly\n"), __FILE__, __LINE__, &Key);
+        Result = FALSE;
+    }
+
+    //
+    //  Remove every other entry by key, then check the remaining entries
+    //  are enumerated once each.
+    //
+
+    for (Index = 0; Index < TEST_HASH_ENTRY_COUNT; Index = Index + 2) {
+        Key.LengthInChars = (YORI_ALLOC_SIZE_T)YoriLibSPrintf(KeyBuffer, _T("Key%i"), Index);
+        if (YoriLibHashRemoveByKey(HashTable, &Key) != &Entries[Index].HashEntry) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i remove of %y failed\n"), __FILE__, __LINE__, &Key);
+            Result = FALSE;
+        }
+    }
+
+    Found = 0;
+    HashEntry = YoriLibHashGetNextEntry(HashTable, NULL);
+    while (HashEntry != NULL) {
+        NextHashEntry = YoriLibHashGetNextEntry(HashTable, HashEntry);
+        Entry = HashEntry->Context;
+        if ((Entry->Index % 2) == 0) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i removed entry %i was enumerated\n"), __FILE__, __LINE__, Entry->Index);
+            Result = FALSE;
+        }
+        YoriLibHashRemoveByEntry(HashEntry);
+        Found++;
+        HashEntry = NextHashEntry;
+    }
+
+    if (Found != TEST_HASH_ENTRY_COUNT / 2) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i enumerated %i entries, expected %i\n"), __FILE__, __LINE__, Found, TEST_HASH_ENTRY_COUNT / 2);
+        Result = FALSE;
+    }
+
+    if (Result) {
+        YoriLibFreeEmptyHashTable(HashTable);
+    }
+    YoriLibFree(Entries);
+
+    return Result;
+}
+
+/**
+ The number of directories in the key set used to measure hash table
+ throughput.
+ */
+#define TEST_HASH_TIMED_DIRECTORIES (150)
+
+/**
+ The number of source files in each directory in the key set used to
+ measure hash table throughput.
+ */
+#define TEST_HASH_TIMED_FILES (40)
+
+/**
+ The extensions of each file in the key set used to measure hash table
+ throughput.  Each source file produces a target for its source, header and
+ object.
+ */
+CONST LPCTSTR TestHashTimedExtensions[] = {
+    _T("c"),
+    _T("h"),
+    _T("obj")
+};
+
+/**
+ The number of keys in the key set used to measure hash table throughput.
+ */
+#define TEST_HASH_TIMED_COUNT (TEST_HASH_TIMED_DIRECTORIES * TEST_HASH_TIMED_FILES * sizeof(TestHashTimedExtensions)/sizeof(TestHashTimedExtensions[0]))
+
+/**
+ The maximum number of characters in each key used to measure hash table
+ throughput.
+ */
+#define TEST_HASH_TIMED_KEY_CHARS (64)
+
+/**
+ The number of times every key is looked up when measuring hash table
+ throughput.
+ */
+#define TEST_HASH_TIMED_LOOKUP_PASSES (20)
+
+/**
+ The number of buckets that ymake allocates for its table of targets.
+ */
+#define TEST_HASH_TIMED_BUCKETS (4000)
+
+/**
+ An entry inserted into a hash table when measuring hash table throughput.
+ */
+typedef struct _TEST_HASH_TIMED_ENTRY {
+
+    /**
+     The entry within the hash table.
+     */
+    YORI_HASH_ENTRY HashEntry;
+
+    /**
+     Storage for the key of this entry.
+     */
+    TCHAR KeyBuffer[TEST_HASH_TIMED_KEY_CHARS];
+} TEST_HASH_TIMED_ENTRY, *PTEST_HASH_TIMED_ENTRY;
+
+/**
+ Generate a key in the form ymake uses for its table of targets, which is
+ the full path to the target.  Keys share a long prefix and differ in a
+ small number of characters, as the paths of a source tree do.
+
+ @param Buffer Pointer to a buffer of TEST_HASH_TIMED_KEY_CHARS characters
+        to generate the key in.
+
+ @param Index The index of the key to generate.
+
+ @param Key On completion, updated to refer to the key in Buffer.
+ */
+VOID
+TestHashGenerateTimedKey(
+    __out LPTSTR Buffer,
+    __in DWORD Index,
+    __out PYORI_STRING Key
+    )
+{
+    DWORD ExtensionCount;
+    DWORD Extension;
+    DWORD File;
+    DWORD Directory;
+
+    ExtensionCount = sizeof(TestHashTimedExtensions)/sizeof(TestHashTimedExtensions[0]);
+    Extension = Index % ExtensionCount;
+    File = (Index / ExtensionCount) % TEST_HASH_TIMED_FILES;
+    Directory = Index / (ExtensionCount * TEST_HASH_TIMED_FILES);
+
+    YoriLibInitEmptyString(Key);
+    Key->StartOfString = Buffer;
+    Key->LengthInChars = (YORI_ALLOC_SIZE_T)YoriLibSPrintfS(Buffer, TEST_HASH_TIMED_KEY_CHARS, _T("C:\\src\\yori\\component%i\\source%i.%s"), Directory, File, TestHashTimedExtensions[Extension]);
+}
+
+/**
+ A timed test variation to measure the rate at which a key set shaped like
+ ymake's table of targets is inserted into, looked up in, and removed from
+ a hash table of the size ymake allocates.
+ */
+BOOLEAN
+TestHashThroughput(VOID)
+{
+    PYORI_HASH_TABLE HashTable;
+    PTEST_HASH_TIMED_ENTRY Entries;
+    PYORI_HASH_ENTRY HashEntry;
+    YORI_STRING Key;
+    TCHAR KeyBuffer[TEST_HASH_TIMED_KEY_CHARS];
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER EndTime;
+    BOOLEAN Result;
+    DWORD Index;
+    DWORD Pass;
+
+    Entries = YoriLibMalloc(TEST_HASH_TIMED_COUNT * sizeof(TEST_HASH_TIMED_ENTRY));
+    if (Entries == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibMalloc failed\n"), __FILE__, __LINE__);
+        return FALSE;
+    }
+
+    HashTable = YoriLibAllocateHashTable(TEST_HASH_TIMED_BUCKETS);
+    if (HashTable == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibAllocateHashTable failed\n"), __FILE__, __LINE__);
+        YoriLibFree(Entries);
+        return FALSE;
+    }
+
+    Result = TRUE;
+
+    QueryPerformanceCounter(&StartTime);
+    for (Index = 0; Index < TEST_HASH_TIMED_COUNT; Index++) {
+        TestHashGenerateTimedKey(Entries[Index].KeyBuffer, Index, &Key);
+        YoriLibHashInsertByKey(HashTable, &Key, &Entries[Index], &Entries[Index].HashEntry);
+    }
+    QueryPerformanceCounter(&EndTime);
+    TestReportRate(_T("insert"), TEST_HASH_TIMED_COUNT, _T("keys"), &StartTime, &EndTime);
+
+    //
+    //  Generate each key again so that lookups compare strings rather than
+    //  finding the inserted key by pointer.
+    //
+
+    QueryPerformanceCounter(&StartTime);
+    for (Pass = 0; Result && Pass < TEST_HASH_TIMED_LOOKUP_PASSES; Pass++) {
+        for (Index = 0; Index < TEST_HASH_TIMED_COUNT; Index++) {
+            TestHashGenerateTimedKey(KeyBuffer, Index, &Key);
+            HashEntry = YoriLibHashLookupByKey(HashTable, &Key);
+            if (HashEntry == NULL || HashEntry->Context != &Entries[Index]) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i lookup of %y failed\n"), __FILE__, __LINE__, &Key);
+                Result = FALSE;
+                break;
+            }
+        }
+    }
+    QueryPerformanceCounter(&EndTime);
+    if (Result) {
+        TestReportRate(_T("lookup hit"), TEST_HASH_TIMED_COUNT * TEST_HASH_TIMED_LOOKUP_PASSES, _T("keys"), &StartTime, &EndTime);
+    }
+
+    //
+    //  Look up keys for a directory that doesn't exist, which share the
+    //  same prefix and length distribution as the keys that do.
+    //
+
+    QueryPerformanceCounter(&StartTime);
+    for (Pass = 0; Result && Pass < TEST_HASH_TIMED_LOOKUP_PASSES; Pass++) {
+        for (Index = 0; Index < TEST_HASH_TIMED_COUNT; Index++) {
+            TestHashGenerateTimedKey(KeyBuffer, Index + TEST_HASH_TIMED_COUNT, &Key);
+            if (YoriLibHashLookupByKey(HashTable, &Key) != NULL) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i lookup of %y succeeded unexpectedly\n"), __FILE__, __LINE__, &Key);
+                Result = FALSE;
+                break;
+            }
+        }
+    }
+    QueryPerformanceCounter(&EndTime);
+    if (Result) {
+        TestReportRate(_T("lookup miss"), TEST_HASH_TIMED_COUNT * TEST_HASH_TIMED_LOOKUP_PASSES, _T("keys"), &StartTime, &EndTime);
+    }
+
+    QueryPerformanceCounter(&StartTime);
+    for (Index = 0; Index < TEST_HASH_TIMED_COUNT; Index++) {
+        TestHashGenerateTimedKey(KeyBuffer, Index, &Key);
+        if (YoriLibHashRemoveByKey(HashTable, &Key) != &Entries[Index].HashEntry) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i remove of %y failed\n"), __FILE__, __LINE__, &Key);
+            Result = FALSE;
+            break;
+        }
+    }
+    QueryPerformanceCounter(&EndTime);
+    if (Result) {
+        TestReportRate(_T("remove"), TEST_HASH_TIMED_COUNT, _T("keys"), &StartTime, &EndTime);
+        YoriLibFreeEmptyHashTable(HashTable);
+    }
+
+    YoriLibFree(Entries);
+
+    return Result;
+}
+
+// vim:sw=4:ts=4:et:
@@ -0,0 +1,530 @@
+/**
+ * @file test/iconv.c
+ *
+ * Yori shell test UTF8 and UTF16 conversion
+ *
+ * Copyright (c) 2022 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include "test.h"
+
+/**
+ A UTF8 sequence and the UTF16 characters it is expected to convert to.
+ */
+typedef struct _TEST_ICONV_UTF8_CASE {
+
+    /**
+     The UTF8 bytes to convert.
+     */
+    CONST UCHAR *Utf8;
+
+    /**
+     The number of bytes in Utf8.
+     */
+    YORI_ALLOC_SIZE_T Utf8Length;
+
+    /**
+     The expected UTF16 characters.
+     */
+    CONST WCHAR *Utf16;
+
+    /**
+     The number of characters in Utf16.
+     */
+    YORI_ALLOC_SIZE_T Utf16Length;
+} TEST_ICONV_UTF8_CASE, *PTEST_ICONV_UTF8_CASE;
+
+/**
+ Mixed ASCII, two, three and four byte characters.
+ */
+CONST UCHAR TestIconvValidUtf8[] = {0x61, 0xC3, 0xA9, 0xE2, 0x82, 0xAC, 0xF0, 0x9F, 0x98, 0x80, 0x7A};
+
+/**
+ The expected conversion of TestIconvValidUtf8.
+ */
+CONST WCHAR TestIconvValidUtf16[] = {0x0061, 0x00E9, 0x20AC, 0xD83D, 0xDE00, 0x007A};
+
+/**
+ The example of replacing maximal subparts from the Unicode standard, which
+ contains truncated sequences and unexpected continuation bytes.
+ */
+CONST UCHAR TestIconvSubpartUtf8[] = {0x61, 0xF1, 0x80, 0x80, 0xE1, 0x80, 0xC2, 0x62, 0x80, 0x63, 0x80, 0xBF, 0x64};
+
+/**
+ The expected conversion of TestIconvSubpartUtf8.
+ */
+CONST WCHAR TestIconvSubpartUtf16[] = {0x0061, 0xFFFD, 0xFFFD, 0xFFFD, 0x0062, 0xFFFD, 0x0063, 0xFFFD, 0xFFFD, 0x0064};
+
+/**
+ Overlong encodings of '/', which must not be decoded.
+ */
+CONST UCHAR TestIconvOverlongUtf8[] = {0xC0, 0xAF, 0xE0, 0x80, 0xAF, 0xF0, 0x80, 0x80, 0xAF};
+
+/**
+ The expected conversion of TestIconvOverlongUtf8.
+ */
+CONST WCHAR TestIconvOverlongUtf16[] = {0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD};
+
+/**
+ An encoded surrogate, a value above U+10FFFF, and invalid bytes.
+ */
+CONST UCHAR TestIconvOutOfRangeUtf8[] = {0xED, 0xA0, 0x80, 0xF4, 0x90, 0x80, 0x80, 0xF5, 0xFE, 0xFF};
+
+/**
+ The expected conversion of TestIconvOutOfRangeUtf8.
+ */
+CONST WCHAR TestIconvOutOfRangeUtf16[] = {0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD};
+
+/**
+ A three byte sequence truncated by the end of the buffer.
+ */
+CONST UCHAR TestIconvTruncatedUtf8[] = {0x61, 0xE2, 0x82};
+
+/**
+ The expected conversion of TestIconvTruncatedUtf8.
+ */
+CONST WCHAR TestIconvTruncatedUtf16[] = {0x0061, 0xFFFD};
+
+/**
+ The boundaries of each UTF8 sequence length.
+ */
+CONST UCHAR TestIconvBoundaryUtf8[] = {0x7F, 0xC2, 0x80, 0xDF, 0xBF, 0xE0, 0xA0, 0x80, 0xED, 0x9F, 0xBF, 0xEE, 0x80, 0x80, 0xEF, 0xBF, 0xBF, 0xF0, 0x90, 0x80, 0x80, 0xF4, 0x8F, 0xBF, 0xBF};
+
+/**
+ The expected conversion of TestIconvBoundaryUtf8.
+ */
+CONST WCHAR TestIconvBoundaryUtf16[] = {0x007F, 0x0080, 0x07FF, 0x0800, 0xD7FF, 0xE000, 0xFFFF, 0xD800, 0xDC00, 0xDBFF, 0xDFFF};
+
+/**
+ Lone and reversed surrogates, which cannot be represented in UTF8.
+ */
+CONST WCHAR TestIconvLoneSurrogateUtf16[] = {0x0061, 0xD800, 0x0062, 0xDC00, 0xDC00, 0xD800, 0xD83D};
+
+/**
+ The expected conversion of TestIconvLoneSurrogateUtf16.
+ */
+CONST UCHAR TestIconvLoneSurrogateUtf8[] = {0x61, 0xEF, 0xBF, 0xBD, 0x62, 0xEF, 0xBF, 0xBD, 0xEF, 0xBF, 0xBD, 0xEF, 0xBF, 0xBD, 0xEF, 0xBF, 0xBD};
+
+/**
+ The set of UTF8 sequences to convert and their expected results.
+ */
+CONST TEST_ICONV_UTF8_CASE TestIconvUtf8Cases[] = {
+    {TestIconvValidUtf8,      sizeof(TestIconvValidUtf8),      TestIconvValidUtf16,      sizeof(TestIconvValidUtf16)/sizeof(WCHAR)},
+    {TestIconvSubpartUtf8,    sizeof(TestIconvSubpartUtf8),    TestIconvSubpartUtf16,    sizeof(TestIconvSubpartUtf16)/sizeof(WCHAR)},
+    {TestIconvOverlongUtf8,   sizeof(TestIconvOverlongUtf8),   TestIconvOverlongUtf16,   sizeof(TestIconvOverlongUtf16)/sizeof(WCHAR)},
+    {TestIconvOutOfRangeUtf8, sizeof(TestIconvOutOfRangeUtf8), TestIconvOutOfRangeUtf16, sizeof(TestIconvOutOfRangeUtf16)/sizeof(WCHAR)},
+    {TestIconvTruncatedUtf8,  sizeof(TestIconvTruncatedUtf8),  TestIconvTruncatedUtf16,  sizeof(TestIconvTruncatedUtf16)/sizeof(WCHAR)},
+    {TestIconvBoundaryUtf8,   sizeof(TestIconvBoundaryUtf8),   TestIconvBoundaryUtf16,   sizeof(TestIconvBoundaryUtf16)/sizeof(WCHAR)},
+};
+
+/**
+ A test variation to convert valid and invalid UTF8 sequences into UTF16,
+ including sequences embedded within runs of ASCII at each alignment, and
+ check the results and the size reported for each.
+ */
+BOOLEAN
+TestIconvUtf8ToUtf16(VOID)
+{
+    UCHAR Input[64];
+    WCHAR Output[64];
+    DWORD CaseIndex;
+    YORI_ALLOC_SIZE_T Prefix;
+    YORI_ALLOC_SIZE_T Index;
+    YORI_ALLOC_SIZE_T InputLength;
+    YORI_ALLOC_SIZE_T ExpectedLength;
+    YORI_ALLOC_SIZE_T Length;
+    CONST TEST_ICONV_UTF8_CASE *Case;
+
+    for (CaseIndex = 0; CaseIndex < sizeof(TestIconvUtf8Cases)/sizeof(TestIconvUtf8Cases[0]); CaseIndex++) {
+        Case = &TestIconvUtf8Cases[CaseIndex];
+
+        //
+        //  Surround the sequence with enough ASCII to convert a word at a
+        //  time before and after it, and move it through each alignment.
+        //
+
+        for (Prefix = 0; Prefix < 2 * sizeof(DWORD_PTR); Prefix++) {
+            for (Index = 0; Index < Prefix; Index++) {
+                Input[Index] = (UCHAR)('A' + Index);
+            }
+            memcpy(&Input[Prefix], Case->Utf8, Case->Utf8Length);
+            for (Index = 0; Index < sizeof(DWORD_PTR); Index++) {
+                Input[Prefix + Case->Utf8Length + Index] = (UCHAR)('a' + Index);
+            }
+            InputLength = Prefix + Case->Utf8Length + sizeof(DWORD_PTR);
+            ExpectedLength = Prefix + Case->Utf16Length + sizeof(DWORD_PTR);
+
+            Length = YoriLibUtf8ToUtf16((LPCSTR)Input, InputLength, NULL, 0);
+            if (Length != ExpectedLength) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i case %i prefix %i needs %i chars, expected %i\n"), __FILE__, __LINE__, CaseIndex, Prefix, Length, ExpectedLength);
+                return FALSE;
+            }
+
+            Length = YoriLibUtf8ToUtf16((LPCSTR)Input, InputLength, Output, sizeof(Output)/sizeof(Output[0]));
+            if (Length != ExpectedLength) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i case %i prefix %i returned %i chars, expected %i\n"), __FILE__, __LINE__, CaseIndex, Prefix, Length, ExpectedLength);
+                return FALSE;
+            }
+
+            for (Index = 0; Index < Prefix; Index++) {
+                if (Output[Index] != 'A' + Index) {
+                    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i case %i prefix %i char %i incorrect\n"), __FILE__, __LINE__, CaseIndex, Prefix, Index);
+                    return FALSE;
+                }
+            }
+
+            if (memcmp(&Output[Prefix], Case->Utf16, Case->Utf16Length * sizeof(WCHAR)) != 0) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i case %i prefix %i converted incorrectly\n"), __FILE__, __LINE__, CaseIndex, Prefix);
+                return FALSE;
+            }
+
+            for (Index = 0; Index < sizeof(DWORD_PTR); Index++) {
+                if (Output[Prefix + Case->Utf16Length + Index] != 'a' + Index) {
+                    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i case %i prefix %i suffix char %i incorrect\n"), __FILE__, __LINE__, CaseIndex, Prefix, Index);
+                    return FALSE;
+                }
+            }
+        }
+    }
+
+    //
+    //  A buffer which ends in the middle of a surrogate pair should not
+    //  receive half of the pair.
+    //
+
+    Length = YoriLibUtf8ToUtf16((LPCSTR)TestIconvValidUtf8, sizeof(TestIconvValidUtf8), Output, 4);
+    if (Length != 3) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i returned %i chars into a short buffer, expected 3\n"), __FILE__, __LINE__, Length);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ A test variation to convert UTF16 containing lone surrogates into UTF8 and
+ check that they are replaced, and check that a buffer which is too small
+ does not receive part of a character.
+ */
+BOOLEAN
+TestIconvUtf16ToUtf8(VOID)
+{
+    CHAR Output[64];
+    YORI_ALLOC_SIZE_T Length;
+
+    Length = YoriLibUtf16ToUtf8(TestIconvLoneSurrogateUtf16, sizeof(TestIconvLoneSurrogateUtf16)/sizeof(WCHAR), NULL, 0);
+    if (Length != sizeof(TestIconvLoneSurrogateUtf8)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i needs %i bytes, expected %i\n"), __FILE__, __LINE__, Length, sizeof(TestIconvLoneSurrogateUtf8));
+        return FALSE;
+    }
+
+    Length = YoriLibUtf16ToUtf8(TestIconvLoneSurrogateUtf16, sizeof(TestIconvLoneSurrogateUtf16)/sizeof(WCHAR), Output, sizeof(Output));
+    if (Length != sizeof(TestIconvLoneSurrogateUtf8) ||
+        memcmp(Output, TestIconvLoneSurrogateUtf8, Length) != 0) {
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i lone surrogates converted incorrectly\n"), __FILE__, __LINE__);
+        return FALSE;
+    }
+
+    Length = YoriLibUtf16ToUtf8(TestIconvValidUtf16, sizeof(TestIconvValidUtf16)/sizeof(WCHAR), Output, sizeof(Output));
+    if (Length != sizeof(TestIconvValidUtf8) ||
+        memcmp(Output, TestIconvValidUtf8, Length) != 0) {
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i valid string converted incorrectly\n"), __FILE__, __LINE__);
+        return FALSE;
+    }
+
+    Length = YoriLibUtf16ToUtf8(TestIconvValidUtf16, sizeof(TestIconvValidUtf16)/sizeof(WCHAR), Output, 8);
+    if (Length != 6) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i returned %i bytes into a short buffer, expected 6\n"), __FILE__, __LINE__, Length);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ A test variation to convert every Unicode scalar value from UTF16 to UTF8
+ and back, and check that the result matches the original.
+ */
+BOOLEAN
+TestIconvRoundTrip(VOID)
+{
+    LPTSTR Original;
+    LPTSTR RoundTrip;
+    LPSTR Utf8;
+    DWORD CodePoint;
+    YORI_ALLOC_SIZE_T Length;
+    YORI_ALLOC_SIZE_T Utf8Length;
+    YORI_ALLOC_SIZE_T RoundTripLength;
+    BOOLEAN Result;
+
+    //
+    //  Every scalar value needs at most two UTF16 characters and four UTF8
+    //  bytes.
+    //
+
+    Original = YoriLibMalloc(0x110000 * 2 * sizeof(TCHAR));
+    RoundTrip = YoriLibMalloc(0x110000 * 2 * sizeof(TCHAR));
+    Utf8 = YoriLibMalloc(0x110000 * 4);
+    Result = FALSE;
+    if (Original == NULL || RoundTrip == NULL || Utf8 == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibMalloc failed\n"), __FILE__, __LINE__);
+        goto Cleanup;
+    }
+
+    Length = 0;
+    for (CodePoint = 0; CodePoint < 0x110000; CodePoint++) {
+        if (CodePoint >= 0xD800 && CodePoint <= 0xDFFF) {
+            continue;
+        }
+        if (CodePoint >= 0x10000) {
+            Original[Length] = (TCHAR)(0xD800 + ((CodePoint - 0x10000) >> 10));
+            Original[Length + 1] = (TCHAR)(0xDC00 + ((CodePoint - 0x10000) & 0x3FF));
+            Length = Length + 2;
+        } else {
+            Original[Length] = (TCHAR)CodePoint;
+            Length++;
+        }
+    }
+
+    Utf8Length = YoriLibUtf16ToUtf8(Original, Length, Utf8, 0x110000 * 4);
+    if (Utf8Length != YoriLibUtf16ToUtf8(Original, Length, NULL, 0)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i UTF8 size does not match conversion\n"), __FILE__, __LINE__);
+        goto Cleanup;
+    }
+
+    RoundTripLength = YoriLibUtf8ToUtf16(Utf8, Utf8Length, RoundTrip, 0x110000 * 2);
+    if (RoundTripLength != Length ||
+        memcmp(Original, RoundTrip, Length * sizeof(TCHAR)) != 0) {
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i round trip returned %i chars, expected %i\n"), __FILE__, __LINE__, RoundTripLength, Length);
+        goto Cleanup;
+    }
+
+    Result = TRUE;
+
+Cleanup:
+    if (Original != NULL) {
+        YoriLibFree(Original);
+    }
+    if (RoundTrip != NULL) {
+        YoriLibFree(RoundTrip);
+    }
+    if (Utf8 != NULL) {
+        YoriLibFree(Utf8);
+    }
+    return Result;
+}
+
+/**
+ The number of UTF16 characters converted when measuring conversion
+ throughput.
+ */
+#define TEST_ICONV_TIMED_CHARS (8 * 1024 * 1024)
+
+/**
+ The number of times each conversion is repeated when measuring conversion
+ throughput.
+ */
+#define TEST_ICONV_TIMED_PASSES (4)
+
+/**
+ A line of ASCII text, used to measure conversion of text which is entirely
+ ASCII.
+ */
+CONST TCHAR TestIconvTimedAscii[] = _T("The quick brown fox jumps over the lazy dog 0123456789.\r\n");
+
+/**
+ A line of mostly ASCII text containing two, three and four byte UTF8
+ sequences, used to measure conversion of typical non-English text.
+ */
+CONST TCHAR TestIconvTimedMixed[] = _T("Caf\x00e9 na\x00efve r\x00e9sum\x00e9 \x20ac") _T("5 \xD83D\xDE00 fa\x00e7") _T("ade.\r\n");
+
+/**
+ Convert a buffer between UTF8 and UTF16 repeatedly with the yori
+ conversion routines and with the Windows conversion APIs, check that the
+ results match, and display the rate of each.
+
+ @param Name A short description of the text being converted.
+
+ @param Line The line of text to repeat to fill the buffer.
+
+ @param LineLength The number of characters in Line.
+
+ @return TRUE if the conversions match, FALSE if they do not.
+ */
+BOOLEAN
+TestIconvTimeText(
+    __in LPCTSTR Name,
+    __in LPCTSTR Line,
+    __in YORI_ALLOC_SIZE_T LineLength
+    )
+{
+    LPTSTR Utf16;
+    LPTSTR Utf16Output;
+    LPSTR Utf8;
+    LPSTR Utf8Output;
+    YORI_STRING Description;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER EndTime;
+    YORI_ALLOC_SIZE_T Length;
+    YORI_ALLOC_SIZE_T Utf8Length;
+    YORI_ALLOC_SIZE_T OutputLength;
+    DWORD Pass;
+    BOOLEAN Result;
+
+    Result = FALSE;
+    YoriLibInitEmptyString(&Description);
+
+    //
+    //  A UTF16 character needs at most three UTF8 bytes, and a surrogate
+    //  pair needs four bytes for two characters.
+    //
+
+    Utf16 = YoriLibMalloc(TEST_ICONV_TIMED_CHARS * sizeof(TCHAR));
+    Utf16Output = YoriLibMalloc(TEST_ICONV_TIMED_CHARS * sizeof(TCHAR));
+    Utf8 = YoriLibMalloc(TEST_ICONV_TIMED_CHARS * 3);
+    Utf8Output = YoriLibMalloc(TEST_ICONV_TIMED_CHARS * 3);
+    if (Utf16 == NULL || Utf16Output == NULL || Utf8 == NULL || Utf8Output == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibMalloc failed\n"), __FILE__, __LINE__);
+        goto Cleanup;
+    }
+
+    for (Length = 0; Length + LineLength <= TEST_ICONV_TIMED_CHARS; Length = Length + LineLength) {
+        memcpy(&Utf16[Length], Line, LineLength * sizeof(TCHAR));
+    }
+
+    Utf8Length = YoriLibUtf16ToUtf8(Utf16, Length, Utf8, TEST_ICONV_TIMED_CHARS * 3);
+
+    //
+    //  UTF8 to UTF16.
+    //
+
+    QueryPerformanceCounter(&StartTime);
+    for (Pass = 0; Pass < TEST_ICONV_TIMED_PASSES; Pass++) {
+        OutputLength = YoriLibUtf8ToUtf16(Utf8, Utf8Length, Utf16Output, TEST_ICONV_TIMED_CHARS);
+    }
+    QueryPerformanceCounter(&EndTime);
+    if (OutputLength != Length ||
+        memcmp(Utf16Output, Utf16, Length * sizeof(TCHAR)) != 0) {
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibUtf8ToUtf16 returned %i chars, expected %i\n"), __FILE__, __LINE__, OutputLength, Length);
+        goto Cleanup;
+    }
+    if (YoriLibYPrintf(&Description, _T("%s UTF-8 to UTF-16, YoriLibUtf8ToUtf16"), Name) < 0) {
+        goto Cleanup;
+    }
+    TestReportThroughput(Description.StartOfString, (DWORDLONG)Utf8Length * TEST_ICONV_TIMED_PASSES, &StartTime, &EndTime);
+
+    QueryPerformanceCounter(&StartTime);
+    for (Pass = 0; Pass < TEST_ICONV_TIMED_PASSES; Pass++) {
+        OutputLength = (YORI_ALLOC_SIZE_T)MultiByteToWideChar(CP_UTF8, 0, Utf8, Utf8Length, Utf16Output, TEST_ICONV_TIMED_CHARS);
+    }
+    QueryPerformanceCounter(&EndTime);
+    if (OutputLength != Length ||
+        memcmp(Utf16Output, Utf16, Length * sizeof(TCHAR)) != 0) {
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i MultiByteToWideChar returned %i chars, expected %i\n"), __FILE__, __LINE__, OutputLength, Length);
+        goto Cleanup;
+    }
+    if (YoriLibYPrintf(&Description, _T("%s UTF-8 to UTF-16, MultiByteToWideChar"), Name) < 0) {
+        goto Cleanup;
+    }
+    TestReportThroughput(Description.StartOfString, (DWORDLONG)Utf8Length * TEST_ICONV_TIMED_PASSES, &StartTime, &EndTime);
+
+    //
+    //  UTF16 to UTF8.
+    //
+
+    QueryPerformanceCounter(&StartTime);
+    for (Pass = 0; Pass < TEST_ICONV_TIMED_PASSES; Pass++) {
+        OutputLength = YoriLibUtf16ToUtf8(Utf16, Length, Utf8Output, TEST_ICONV_TIMED_CHARS * 3);
+    }
+    QueryPerformanceCounter(&EndTime);
+    if (OutputLength != Utf8Length ||
+        memcmp(Utf8Output, Utf8, Utf8Length) != 0) {
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibUtf16ToUtf8 returned %i bytes, expected %i\n"), __FILE__, __LINE__, OutputLength, Utf8Length);
+        goto Cleanup;
+    }
+    if (YoriLibYPrintf(&Description, _T("%s UTF-16 to UTF-8, YoriLibUtf16ToUtf8"), Name) < 0) {
+        goto Cleanup;
+    }
+    TestReportThroughput(Description.StartOfString, (DWORDLONG)Length * sizeof(TCHAR) * TEST_ICONV_TIMED_PASSES, &StartTime, &EndTime);
+
+    QueryPerformanceCounter(&StartTime);
+    for (Pass = 0; Pass < TEST_ICONV_TIMED_PASSES; Pass++) {
+        OutputLength = (YORI_ALLOC_SIZE_T)WideCharToMultiByte(CP_UTF8, 0, Utf16, Length, Utf8Output, TEST_ICONV_TIMED_CHARS * 3, NULL, NULL);
+    }
+    QueryPerformanceCounter(&EndTime);
+    if (OutputLength != Utf8Length ||
+        memcmp(Utf8Output, Utf8, Utf8Length) != 0) {
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i WideCharToMultiByte returned %i bytes, expected %i\n"), __FILE__, __LINE__, OutputLength, Utf8Length);
+        goto Cleanup;
+    }
+    if (YoriLibYPrintf(&Description, _T("%s UTF-16 to UTF-8, WideCharToMultiByte"), Name) < 0) {
+        goto Cleanup;
+    }
+    TestReportThroughput(Description.StartOfString, (DWORDLONG)Length * sizeof(TCHAR) * TEST_ICONV_TIMED_PASSES, &StartTime, &EndTime);
+
+    Result = TRUE;
+
+Cleanup:
+    YoriLibFreeStringContents(&Description);
+    if (Utf16 != NULL) {
+        YoriLibFree(Utf16);
+    }
+    if (Utf16Output != NULL) {
+        YoriLibFree(Utf16Output);
+    }
+    if (Utf8 != NULL) {
+        YoriLibFree(Utf8);
+    }
+    if (Utf8Output != NULL) {
+        YoriLibFree(Utf8Output);
+    }
+    return Result;
+}
+
+/**
+ A timed test variation to measure the rate at which ASCII and mixed text
+ is converted between UTF8 and UTF16 by the yori conversion routines,
+ compared to MultiByteToWideChar and WideCharToMultiByte.
+ */
+BOOLEAN
+TestIconvThroughput(VOID)
+{
+    if (!TestIconvTimeText(_T("ASCII"), TestIconvTimedAscii, sizeof(TestIconvTimedAscii)/sizeof(TestIconvTimedAscii[0]) - 1)) {
+        return FALSE;
+    }
+
+    if (!TestIconvTimeText(_T("mixed"), TestIconvTimedMixed, sizeof(TestIconvTimedMixed)/sizeof(TestIconvTimedMixed[0]) - 1)) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// vim:sw=4:ts=4:et:
@@ -0,0 +1,581 @@
+/**
+ * @file test/lineread.c
+ *
+ * Yori shell test line reading
+ *
+ * Copyright (c) 2022 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include "test.h"
+
+/**
+ The contents of the file used to test line reading.  This contains each
+ type of line ending, a line long enough to be scanned a word at a time, an
+ empty line, and a final line without a line ending.
+ */
+CONST CHAR TestLineReadContents[] =
+    "one\r\n"
+    "two\n"
+    "three\r"
+    "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz\n"
+    "\n"
+    "last";
+
+/**
+ A line that is expected to be returned when reading TestLineReadContents.
+ */
+typedef struct _TEST_LINE_READ_EXPECTED {
+
+    /**
+     The contents of the line.
+     */
+    LPCTSTR Line;
+
+    /**
+     The line ending that should be reported for the line.
+     */
+    YORI_LIB_LINE_ENDING LineEnding;
+} TEST_LINE_READ_EXPECTED, *PTEST_LINE_READ_EXPECTED;
+
+/**
+ The lines that are expected to be returned when reading
+ TestLineReadContents.
+ */
+CONST TEST_LINE_READ_EXPECTED TestLineReadExpected[] = {
+    {_T("one"),   YoriLibLineEndingCRLF},
+    {_T("two"),   YoriLibLineEndingLF},
+    {_T("three"), YoriLibLineEndingCR},
+    {_T("0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz"), YoriLibLineEndingLF},
+    {_T(""),      YoriLibLineEndingLF},
+    {_T("last"),  YoriLibLineEndingNone}
+};
+
+/**
+ Create a temporary file containing TestLineReadContents.
+
+ @param FileName On successful completion, populated with the name of the
+        file, which the caller should delete and free.
+
+ @return A handle to the file, positioned at the beginning of the file, or
+         NULL on failure.
+ */
+HANDLE
+TestLineReadCreateFile(
+    __out PYORI_STRING FileName
+    )
+{
+    YORI_STRING TempPath;
+    YORI_STRING Prefix;
+    HANDLE hFile;
+    DWORD BytesWritten;
+
+    if (!YoriLibGetTempPath(&TempPath, 0)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibGetTempPath failed\n"), __FILE__, __LINE__);
+        return NULL;
+    }
+
+    if (TempPath.LengthInChars > 0 &&
+        YoriLibIsSep(TempPath.StartOfString[TempPath.LengthInChars - 1])) {
+
+        TempPath.LengthInChars--;
+    }
+
+    YoriLibConstantString(&Prefix, _T("YTST"));
+    if (!YoriLibGetTempFileName(&TempPath, &Prefix, &hFile, FileName)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibGetTempFileName failed in %y\n"), __FILE__, __LINE__, &TempPath);
+        YoriLibFreeStringContents(&TempPath);
+        return NULL;
+    }
+    YoriLibFreeStringContents(&TempPath);
+
+    if (!WriteFile(hFile, TestLineReadContents, sizeof(TestLineReadContents) - 1, &BytesWritten, NULL) ||
+        BytesWritten != sizeof(TestLineReadContents) - 1) {
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i WriteFile failed, error %i\n"), __FILE__, __LINE__, GetLastError());
+        CloseHandle(hFile);
+        DeleteFile(FileName->StartOfString);
+        YoriLibFreeStringContents(FileName);
+        return NULL;
+    }
+
+    SetFilePointer(hFile, 0, NULL, FILE_BEGIN);
+    return hFile;
+}
+
+/**
+ Check that a line matches the line that is expected.
+
+ @param Index The index of the line within the file.
+
+ @param Line Pointer to the line that was returned.
+
+ @param LineEnding The line ending that was returned.
+
+ @return TRUE if the line matches, FALSE if it does not.
+ */
+BOOLEAN
+TestLineReadCheckLine(
+    __in DWORD Index,
+    __in PYORI_STRING Line,
+    __in YORI_LIB_LINE_ENDING LineEnding
+    )
+{
+    if (Index >= sizeof(TestLineReadExpected)/sizeof(TestLineReadExpected[0])) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i unexpected line %i returned: %y\n"), __FILE__, __LINE__, Index, Line);
+        return FALSE;
+    }
+
+    if (YoriLibCompareStringLit(Line, TestLineReadExpected[Index].Line) != 0) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i line %i returned '%y', expected '%s'\n"), __FILE__, __LINE__, Index, Line, TestLineReadExpected[Index].Line);
+        return FALSE;
+    }
+
+    if (LineEnding != TestLineReadExpected[Index].LineEnding) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i line %i returned line ending %i, expected %i\n"), __FILE__, __LINE__, Index, LineEnding, TestLineReadExpected[Index].LineEnding);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ A test variation to read lines with mixed line endings one at a time.
+ */
+BOOLEAN
+TestLineReadMixedEndings(VOID)
+{
+    YORI_STRING FileName;
+    YORI_STRING Line;
+    YORI_LIB_LINE_ENDING LineEnding;
+    HANDLE hFile;
+    PVOID LineContext;
+    BOOL TimeoutReached;
+    BOOLEAN Result;
+    DWORD Index;
+
+    hFile = TestLineReadCreateFile(&FileName);
+    if (hFile == NULL) {
+        return FALSE;
+    }
+
+    YoriLibInitEmptyString(&Line);
+    LineContext = NULL;
+    Result = TRUE;
+    Index = 0;
+
+    while (YoriLibReadLineToStringEx(&Line, &LineContext, TRUE, INFINITE, hFile, &LineEnding, &TimeoutReached)) {
+        if (!TestLineReadCheckLine(Index, &Line, LineEnding)) {
+            Result = FALSE;
+            break;
+        }
+        Index++;
+    }
+
+    if (Result && Index != sizeof(TestLineReadExpected)/sizeof(TestLineReadExpected[0])) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i returned %i lines, expected %i\n"), __FILE__, __LINE__, Index, sizeof(TestLineReadExpected)/sizeof(TestLineReadExpected[0]));
+        Result = FALSE;
+    }
+
+    YoriLibLineReadClose(LineContext);
+    YoriLibFreeStringContents(&Line);
+    CloseHandle(hFile);
+    DeleteFile(FileName.StartOfString);
+    YoriLibFreeStringContents(&FileName);
+
+    return Result;
+}
+
+/**
+ A test variation to read lines with mixed line endings as a batch.
+ */
+BOOLEAN
+TestLineReadBatch(VOID)
+{
+    YORI_STRING FileName;
+    YORI_LIB_LINE_BATCH Batch;
+    HANDLE hFile;
+    PVOID LineContext;
+    BOOLEAN Result;
+    DWORD Index;
+    YORI_ALLOC_SIZE_T BatchIndex;
+
+    hFile = TestLineReadCreateFile(&FileName);
+    if (hFile == NULL) {
+        return FALSE;
+    }
+
+    YoriLibInitializeLineBatch(&Batch);
+    LineContext = NULL;
+    Result = TRUE;
+    Index = 0;
+
+    while (Result && YoriLibReadLineBatch(&Batch, &LineContext, hFile)) {
+        for (BatchIndex = 0; BatchIndex < Batch.LineCount; BatchIndex++) {
+            if (!TestLineReadCheckLine(Index, &Batch.Lines[BatchIndex].Line, Batch.Lines[BatchIndex].LineEnding)) {
+                Result = FALSE;
+                break;
+            }
+            Index++;
+        }
+    }
+
+    if (Result && Index != sizeof(TestLineReadExpected)/sizeof(TestLineReadExpected[0])) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i returned %i lines, expected %i\n"), __FILE__, __LINE__, Index, sizeof(TestLineReadExpected)/sizeof(TestLineReadExpected[0]));
+        Result = FALSE;
+    }
+
+    YoriLibLineReadClose(LineContext);
+    YoriLibFreeLineBatch(&Batch);
+    CloseHandle(hFile);
+    DeleteFile(FileName.StartOfString);
+    YoriLibFreeStringContents(&FileName);
+
+    return Result;
+}
+
+/**
+ The approximate number of bytes in the file used to measure line reading
+ throughput.
+ */
+#define TEST_LINE_READ_TIMED_BYTES (32 * 1024 * 1024)
+
+/**
+ The number of characters of lines generated at a time when creating the
+ file used to measure line reading throughput.
+ */
+#define TEST_LINE_READ_TIMED_BLOCK_CHARS (64 * 1024)
+
+/**
+ The Windows western European code page, used to measure reading 8 bit text
+ which is not UTF8.
+ */
+#define TEST_LINE_READ_CP_WESTERN (1252)
+
+/**
+ Text that lines in the throughput file are taken from.  Each line is a
+ prefix of this text of varying length, so lines have different lengths
+ and most lines contain characters which are not ASCII.
+ */
+CONST TCHAR TestLineReadTimedText[] =
+    _T("Caf\x00e9 na\x00efve r\x00e9sum\x00e9 \x20ac") _T("42 ")
+    _T("the quick brown fox jumps over the lazy dog 0123456789 ")
+    _T("THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG");
+
+/**
+ An encoding to measure line reading throughput with.
+ */
+typedef struct _TEST_LINE_READ_TIMED_ENCODING {
+
+    /**
+     The encoding of the file, as passed to YoriLibSetMultibyteInputEncoding.
+     */
+    DWORD Encoding;
+
+    /**
+     A short description of the encoding.
+     */
+    LPCTSTR Name;
+} TEST_LINE_READ_TIMED_ENCODING, *PTEST_LINE_READ_TIMED_ENCODING;
+
+/**
+ The encodings to measure line reading throughput with.
+ */
+CONST TEST_LINE_READ_TIMED_ENCODING TestLineReadTimedEncodings[] = {
+    {TEST_LINE_READ_CP_WESTERN, _T("8 bit")},
+    {CP_UTF8,                   _T("UTF-8")},
+    {CP_UTF16,                  _T("UTF-16")}
+};
+
+/**
+ Create a temporary file containing lines of text in a specified encoding
+ for measuring line reading throughput.
+
+ @param Encoding The encoding to write lines in.
+
+ @param FileName On successful completion, populated with the name of the
+        file, which the caller should delete and free.
+
+ @param LineCount On successful completion, populated with the number of
+        lines in the file.
+
+ @param FileSize On successful completion, populated with the number of
+        bytes in the file.
+
+ @return TRUE to indicate the file was created, FALSE if it was not.
+ */
+BOOLEAN
+TestLineReadCreateTimedFile(
+    __in DWORD Encoding,
+    __out PYORI_STRING FileName,
+    __out PDWORD LineCount,
+    __out PDWORDLONG FileSize
+    )
+{
+    YORI_STRING TempPath;
+    YORI_STRING Prefix;
+    LPTSTR Block;
+    LPSTR EncodedBlock;
+    HANDLE hFile;
+    DWORD BlockChars;
+    DWORD BlockLines;
+    DWORD LineLength;
+    DWORD TextLength;
+    DWORD BytesToWrite;
+    DWORD BytesWritten;
+    DWORDLONG TotalBytes;
+    DWORD TotalLines;
+    BOOLEAN Result;
+
+    Result = FALSE;
+    Block = NULL;
+    EncodedBlock = NULL;
+    hFile = NULL;
+    YoriLibInitEmptyString(FileName);
+
+    if (!YoriLibGetTempPath(&TempPath, 0)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibGetTempPath failed\n"), __FILE__, __LINE__);
+        return FALSE;
+    }
+
+    if (TempPath.LengthInChars > 0 &&
+        YoriLibIsSep(TempPath.StartOfString[TempPath.LengthInChars - 1])) {
+
+        TempPath.LengthInChars--;
+    }
+
+    YoriLibConstantString(&Prefix, _T("YTST"));
+    if (!YoriLibGetTempFileName(&TempPath, &Prefix, &hFile, FileName)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibGetTempFileName failed in %y\n"), __FILE__, __LINE__, &TempPath);
+        YoriLibFreeStringContents(&TempPath);
+        return FALSE;
+    }
+    YoriLibFreeStringContents(&TempPath);
+
+    //
+    //  Generate a block of complete lines.  The same block is written
+    //  repeatedly, so the cost of generating it is not significant.
+    //
+
+    Block = YoriLibMalloc(TEST_LINE_READ_TIMED_BLOCK_CHARS * sizeof(TCHAR));
+    EncodedBlock = YoriLibMalloc(TEST_LINE_READ_TIMED_BLOCK_CHARS * 3);
+    if (Block == NULL || EncodedBlock == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i allocation failed\n"), __FILE__, __LINE__);
+        goto Exit;
+    }
+
+    TextLength = sizeof(TestLineReadTimedText)/sizeof(TestLineReadTimedText[0]) - 1;
+    BlockChars = 0;
+    BlockLines = 0;
+    while (TRUE) {
+        LineLength = (BlockLines * 7) % (TextLength + 1);
+        if (BlockChars + LineLength + 2 > TEST_LINE_READ_TIMED_BLOCK_CHARS) {
+            break;
+        }
+        memcpy(&Block[BlockChars], TestLineReadTimedText, LineLength * sizeof(TCHAR));
+        BlockChars = BlockChars + LineLength;
+        Block[BlockChars++] = '\r';
+        Block[BlockChars++] = '\n';
+        BlockLines++;
+    }
+
+    if (Encoding == CP_UTF16) {
+        memcpy(EncodedBlock, Block, BlockChars * sizeof(TCHAR));
+        BytesToWrite = BlockChars * sizeof(TCHAR);
+    } else {
+        BytesToWrite = WideCharToMultiByte(Encoding, 0, Block, BlockChars, EncodedBlock, TEST_LINE_READ_TIMED_BLOCK_CHARS * 3, NULL, NULL);
+        if (BytesToWrite == 0) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i WideCharToMultiByte failed, error %i\n"), __FILE__, __LINE__, GetLastError());
+            goto Exit;
+        }
+    }
+
+    TotalBytes = 0;
+    TotalLines = 0;
+    while (TotalBytes < TEST_LINE_READ_TIMED_BYTES) {
+        if (!WriteFile(hFile, EncodedBlock, BytesToWrite, &BytesWritten, NULL) ||
+            BytesWritten != BytesToWrite) {
+
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i WriteFile failed, error %i\n"), __FILE__, __LINE__, GetLastError());
+            goto Exit;
+        }
+        TotalBytes = TotalBytes + BytesWritten;
+        TotalLines = TotalLines + BlockLines;
+    }
+
+    *LineCount = TotalLines;
+    *FileSize = TotalBytes;
+    Result = TRUE;
+
+Exit:
+    if (Block != NULL) {
+        YoriLibFree(Block);
+    }
+    if (EncodedBlock != NULL) {
+        YoriLibFree(EncodedBlock);
+    }
+    if (hFile != NULL) {
+        CloseHandle(hFile);
+    }
+    if (!Result && FileName->StartOfString != NULL) {
+        DeleteFile(FileName->StartOfString);
+        YoriLibFreeStringContents(FileName);
+    }
+    return Result;
+}
+
+/**
+ Read every line from a file, either one at a time or in batches, and
+ display the rate at which the file was read.  The file is opened without
+ write access, as a command such as type would, so that it can be read
+ through mapped views.
+
+ @param Description A short description of the measurement.
+
+ @param FileName The name of the file to read.
+
+ @param ExpectedLines The number of lines in the file.
+
+ @param FileSize The number of bytes in the file.
+
+ @param UseBatch If TRUE, lines are read with YoriLibReadLineBatch.  If
+        FALSE, lines are read with YoriLibReadLineToStringEx.
+
+ @return TRUE if the expected number of lines was read, FALSE if not.
+ */
+BOOLEAN
+TestLineReadTimeFile(
+    __in LPCTSTR Description,
+    __in PYORI_STRING FileName,
+    __in DWORD ExpectedLines,
+    __in DWORDLONG FileSize,
+    __in BOOLEAN UseBatch
+    )
+{
+    YORI_LIB_LINE_BATCH Batch;
+    YORI_STRING Line;
+    YORI_LIB_LINE_ENDING LineEnding;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER EndTime;
+    HANDLE hFile;
+    PVOID LineContext;
+    BOOL TimeoutReached;
+    DWORD LinesRead;
+
+    hFile = CreateFile(FileName->StartOfString,
+                       GENERIC_READ,
+                       FILE_SHARE_READ | FILE_SHARE_DELETE,
+                       NULL,
+                       OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                       NULL);
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i CreateFile failed, error %i\n"), __FILE__, __LINE__, GetLastError());
+        return FALSE;
+    }
+
+    YoriLibInitializeLineBatch(&Batch);
+    YoriLibInitEmptyString(&Line);
+    LineContext = NULL;
+    LinesRead = 0;
+
+    QueryPerformanceCounter(&StartTime);
+    if (UseBatch) {
+        while (YoriLibReadLineBatch(&Batch, &LineContext, hFile)) {
+            LinesRead = LinesRead + Batch.LineCount;
+        }
+    } else {
+        while (YoriLibReadLineToStringEx(&Line, &LineContext, TRUE, INFINITE, hFile, &LineEnding, &TimeoutReached)) {
+            LinesRead++;
+        }
+    }
+    QueryPerformanceCounter(&EndTime);
+
+    YoriLibLineReadClose(LineContext);
+    YoriLibFreeLineBatch(&Batch);
+    YoriLibFreeStringContents(&Line);
+    CloseHandle(hFile);
+
+    if (LinesRead != ExpectedLines) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i read %i lines, expected %i\n"), __FILE__, __LINE__, LinesRead, ExpectedLines);
+        return FALSE;
+    }
+
+    TestReportThroughput(Description, FileSize, &StartTime, &EndTime);
+    return TRUE;
+}
+
+/**
+ A timed test variation to measure the rate at which lines are read from
+ files encoded as 8 bit text, UTF8 and UTF16, both one line at a time and
+ in batches.
+ */
+BOOLEAN
+TestLineReadThroughput(VOID)
+{
+    YORI_STRING FileName;
+    YORI_STRING Description;
+    DWORD OriginalEncoding;
+    DWORD LineCount;
+    DWORDLONG FileSize;
+    DWORD Index;
+    BOOLEAN Result;
+
+    Result = TRUE;
+    YoriLibInitEmptyString(&Description);
+    OriginalEncoding = YoriLibGetMultibyteInputEncoding();
+
+    for (Index = 0; Index < sizeof(TestLineReadTimedEncodings)/sizeof(TestLineReadTimedEncodings[0]); Index++) {
+        if (!TestLineReadCreateTimedFile(TestLineReadTimedEncodings[Index].Encoding, &FileName, &LineCount, &FileSize)) {
+            Result = FALSE;
+            break;
+        }
+
+        YoriLibSetMultibyteInputEncoding(TestLineReadTimedEncodings[Index].Encoding);
+
+        if (YoriLibYPrintf(&Description, _T("%s by line"), TestLineReadTimedEncodings[Index].Name) < 0 ||
+            !TestLineReadTimeFile(Description.StartOfString, &FileName, LineCount, FileSize, FALSE)) {
+
+            Result = FALSE;
+        }
+
+        if (YoriLibYPrintf(&Description, _T("%s by batch"), TestLineReadTimedEncodings[Index].Name) < 0 ||
+            !TestLineReadTimeFile(Description.StartOfString, &FileName, LineCount, FileSize, TRUE)) {
+
+            Result = FALSE;
+        }
+
+        YoriLibSetMultibyteInputEncoding(OriginalEncoding);
+        DeleteFile(FileName.StartOfString);
+        YoriLibFreeStringContents(&FileName);
+
+        if (!Result) {
+            break;
+        }
+    }
+
+    YoriLibFreeStringContents(&Description);
+    return Result;
+}
+
+// vim:sw=4:ts=4:et:
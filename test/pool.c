@@ -0,0 +1,261 @@
+/**
+ * @file test/pool.c
+ *
+ * Yori shell test pool allocation
+ *
+ * Copyright (c) 2022 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include "test.h"
+
+/**
+ The number of elements to allocate from the pool in each pass.
+ */
+#define TEST_POOL_ALLOCATIONS (1000)
+
+/**
+ The number of threads which allocate from the pool concurrently.
+ */
+#define TEST_POOL_THREADS (4)
+
+/**
+ An element allocated from the pool in the test.
+ */
+typedef struct _TEST_POOL_ELEMENT {
+
+    /**
+     The index of the element, used to check that elements do not overlap.
+     */
+    DWORD Index;
+
+    /**
+     A value derived from the index, used to check that elements do not
+     overlap.
+     */
+    DWORDLONG Pattern;
+} TEST_POOL_ELEMENT, *PTEST_POOL_ELEMENT;
+
+/**
+ The pool shared by each thread in the concurrent part of the test.
+ */
+YORI_LIB_POOL TestPoolShared;
+
+/**
+ Allocate elements from a pool, fill them with a pattern, check the pattern
+ is intact, and free them.
+
+ @param Pool Pointer to the pool to allocate from.
+
+ @param Elements Pointer to an array of TEST_POOL_ALLOCATIONS elements to
+        populate with allocations.
+
+ @param Seed A value to combine into the pattern so that different threads
+        write different values.
+
+ @return TRUE if every element was allocated and retained its contents,
+         FALSE if not.
+ */
+BOOLEAN
+TestPoolAllocAndCheck(
+    __in PYORI_LIB_POOL Pool,
+    __out_ecount(TEST_POOL_ALLOCATIONS) PTEST_POOL_ELEMENT *Elements,
+    __in DWORD Seed
+    )
+{
+    DWORD Index;
+    DWORD FreeIndex;
+    BOOLEAN Result;
+
+    Result = TRUE;
+    for (Index = 0; Index < TEST_POOL_ALLOCATIONS; Index++) {
+        Elements[Index] = YoriLibPoolAlloc(Pool, sizeof(TEST_POOL_ELEMENT));
+        if (Elements[Index] == NULL) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibPoolAlloc failed\n"), __FILE__, __LINE__);
+            Result = FALSE;
+            break;
+        }
+
+        if (((DWORD_PTR)Elements[Index] & (sizeof(DWORDLONG) - 1)) != 0) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i element %i is not aligned\n"), __FILE__, __LINE__, Index);
+            Result = FALSE;
+            Index++;
+            break;
+        }
+
+        Elements[Index]->Index = Index;
+        Elements[Index]->Pattern = ((DWORDLONG)Seed << 32) | Index;
+    }
+
+    for (FreeIndex = 0; FreeIndex < Index; FreeIndex++) {
+        if (Result &&
+            (Elements[FreeIndex]->Index != FreeIndex ||
+             Elements[FreeIndex]->Pattern != (((DWORDLONG)Seed << 32) | FreeIndex))) {
+
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i element %i was overwritten\n"), __FILE__, __LINE__, FreeIndex);
+            Result = FALSE;
+        }
+        YoriLibPoolFree(Elements[FreeIndex]);
+    }
+
+    return Result;
+}
+
+/**
+ A thread which repeatedly allocates from and frees to the shared pool.
+
+ @param Param The seed for the thread, cast to a pointer.
+
+ @return TRUE if the thread's allocations were valid, FALSE if not.
+ */
+DWORD WINAPI
+TestPoolThread(
+    __in PVOID Param
+    )
+{
+    PTEST_POOL_ELEMENT *Elements;
+    DWORD Pass;
+    BOOLEAN Result;
+
+    Elements = YoriLibMalloc(TEST_POOL_ALLOCATIONS * sizeof(PTEST_POOL_ELEMENT));
+    if (Elements == NULL) {
+        return FALSE;
+    }
+
+    Result = TRUE;
+    for (Pass = 0; Result && Pass < 10; Pass++) {
+        Result = TestPoolAllocAndCheck(&TestPoolShared, Elements, (DWORD)(DWORD_PTR)Param);
+    }
+
+    YoriLibFree(Elements);
+    return Result;
+}
+
+/**
+ A test variation to allocate elements from a pool, check that they do not
+ overlap, check that freed elements are reused, check that elements of a
+ different size are rejected, and allocate from several threads at once.
+ */
+BOOLEAN
+TestPoolAlloc(VOID)
+{
+    YORI_LIB_POOL Pool;
+    PTEST_POOL_ELEMENT *Elements;
+    PVOID Element;
+    HANDLE Threads[TEST_POOL_THREADS];
+    DWORD ThreadsStarted;
+    DWORD ThreadResult;
+    DWORD SlabsAllocated;
+    DWORD Index;
+    BOOLEAN Result;
+
+    Elements = YoriLibMalloc(TEST_POOL_ALLOCATIONS * sizeof(PTEST_POOL_ELEMENT));
+    if (Elements == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibMalloc failed\n"), __FILE__, __LINE__);
+        return FALSE;
+    }
+
+    ZeroMemory(&Pool, sizeof(Pool));
+    Result = TestPoolAllocAndCheck(&Pool, Elements, 1);
+
+    //
+    //  Everything allocated in the first pass has been freed, so the second
+    //  pass should not need any more memory.
+    //
+
+    if (Result) {
+        SlabsAllocated = Pool.SlabsAllocated;
+        Result = TestPoolAllocAndCheck(&Pool, Elements, 2);
+        if (Result && Pool.SlabsAllocated != SlabsAllocated) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i pool allocated %i slabs, expected %i\n"), __FILE__, __LINE__, Pool.SlabsAllocated, SlabsAllocated);
+            Result = FALSE;
+        }
+    }
+
+    if (Result) {
+        Element = YoriLibPoolAlloc(&Pool, sizeof(TEST_POOL_ELEMENT) + 1);
+        if (Element != NULL) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i allocation of a different size succeeded\n"), __FILE__, __LINE__);
+            YoriLibPoolFree(Element);
+            Result = FALSE;
+        }
+    }
+
+    //
+    //  The pool should not release memory while an element is allocated.
+    //
+
+    if (Result) {
+        Element = YoriLibPoolAlloc(&Pool, sizeof(TEST_POOL_ELEMENT));
+        if (Element == NULL) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibPoolAlloc failed\n"), __FILE__, __LINE__);
+            Result = FALSE;
+        } else {
+            if (YoriLibCleanupPool(&Pool)) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i pool released memory with an element allocated\n"), __FILE__, __LINE__);
+                Result = FALSE;
+            } else {
+                YoriLibPoolFree(Element);
+            }
+        }
+    }
+
+    if (!YoriLibCleanupPool(&Pool)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i pool did not release memory\n"), __FILE__, __LINE__);
+        Result = FALSE;
+    }
+
+    YoriLibFree(Elements);
+
+    if (!Result) {
+        return FALSE;
+    }
+
+    ZeroMemory(&TestPoolShared, sizeof(TestPoolShared));
+    ThreadsStarted = 0;
+    for (Index = 0; Index < TEST_POOL_THREADS; Index++) {
+        Threads[Index] = CreateThread(NULL, 0, TestPoolThread, (PVOID)(DWORD_PTR)(Index + 1), 0, &ThreadResult);
+        if (Threads[Index] == NULL) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i CreateThread failed, error %i\n"), __FILE__, __LINE__, GetLastError());
+            Result = FALSE;
+            break;
+        }
+        ThreadsStarted++;
+    }
+
+    for (Index = 0; Index < ThreadsStarted; Index++) {
+        WaitForSingleObject(Threads[Index], INFINITE);
+        if (!GetExitCodeThread(Threads[Index], &ThreadResult) || !ThreadResult) {
+            Result = FALSE;
+        }
+        CloseHandle(Threads[Index]);
+    }
+
+    if (!YoriLibCleanupPool(&TestPoolShared)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i pool did not release memory\n"), __FILE__, __LINE__);
+        Result = FALSE;
+    }
+
+    return Result;
+}
+
+// vim:sw=4:ts=4:et:
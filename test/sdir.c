@@ -0,0 +1,451 @@
+/**
+ * @file test/sdir.c
+ *
+ * Yori shell test sdir sorting of large directories
+ *
+ * Copyright (c) 2022 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include "test.h"
+
+/**
+ The number of entries in each synthetic directory listed when measuring
+ sdir throughput.  Each directory is created by adding entries to the
+ previous one.
+ */
+CONST DWORD TestSdirEntryCounts[] = {
+    10000,
+    100000,
+    1000000
+};
+
+/**
+ The sort keys to measure.  These are the keys whose values are returned by
+ enumerating the directory.  Keys which require each file to be opened are
+ not included, since listing with them measures file system performance
+ rather than sorting.
+ */
+CONST LPCTSTR TestSdirSortKeys[] = {
+    _T("ad"),
+    _T("at"),
+    _T("cd"),
+    _T("ct"),
+    _T("dr"),
+    _T("fe"),
+    _T("fn"),
+    _T("fs"),
+    _T("rt"),
+    _T("sn"),
+    _T("wd"),
+    _T("wt")
+};
+
+/**
+ The extensions given to synthetic files.
+ */
+CONST LPCTSTR TestSdirExtensions[] = {
+    _T("c"),
+    _T("h"),
+    _T("obj"),
+    _T("exe"),
+    _T("txt"),
+    _T("log"),
+    _T("dll")
+};
+
+/**
+ One entry in every this many is a directory rather than a file.
+ */
+#define TEST_SDIR_DIRECTORY_INTERVAL (50)
+
+/**
+ Return a value derived from an entry index which is used to give each
+ entry a name, size and timestamps that are not in the order the entries
+ were created.
+
+ @param Index The index of the entry.
+
+ @param Salt A value which is combined with the index so that different
+        attributes of one entry are not correlated.
+
+ @return The derived value.
+ */
+DWORD
+TestSdirScramble(
+    __in DWORD Index,
+    __in DWORD Salt
+    )
+{
+    DWORD Value;
+
+    Value = (Index ^ Salt) * 2654435761;
+    Value = Value ^ (Value >> 15);
+    Value = Value * 2246822519;
+    Value = Value ^ (Value >> 13);
+    return Value;
+}
+
+/**
+ Generate the full path to a synthetic directory entry.
+
+ @param Directory The directory containing synthetic entries.
+
+ @param Index The index of the entry.
+
+ @param Path On successful completion, updated to contain the full path to
+        the entry.  This may be reallocated.
+
+ @return TRUE to indicate success, FALSE on allocation failure.
+ */
+BOOLEAN
+TestSdirEntryPath(
+    __in PYORI_STRING Directory,
+    __in DWORD Index,
+    __inout PYORI_STRING Path
+    )
+{
+    DWORD Extension;
+
+    if ((Index % TEST_SDIR_DIRECTORY_INTERVAL) == 0) {
+        if (YoriLibYPrintf(Path, _T("%y\\dir%08x_%i"), Directory, TestSdirScramble(Index, 0), Index) < 0) {
+            return FALSE;
+        }
+    } else {
+        Extension = TestSdirScramble(Index, 1) % (sizeof(TestSdirExtensions)/sizeof(TestSdirExtensions[0]));
+        if (YoriLibYPrintf(Path, _T("%y\\file%08x_%i.%s"), Directory, TestSdirScramble(Index, 0), Index, TestSdirExtensions[Extension]) < 0) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ Convert a number of seconds before the current time into a file time.
+
+ @param Now The current time.
+
+ @param SecondsAgo The number of seconds before the current time.
+
+ @param FileTime On completion, populated with the file time.
+ */
+VOID
+TestSdirFileTime(
+    __in PLARGE_INTEGER Now,
+    __in DWORD SecondsAgo,
+    __out LPFILETIME FileTime
+    )
+{
+    LARGE_INTEGER Time;
+
+    Time.QuadPart = Now->QuadPart - (LONGLONG)SecondsAgo * 10 * 1000 * 1000;
+    FileTime->dwLowDateTime = Time.LowPart;
+    FileTime->dwHighDateTime = Time.HighPart;
+}
+
+/**
+ Create synthetic directory entries.  Files are given sizes small enough to
+ be stored within the file system's metadata, so large directories don't
+ consume much disk space.
+
+ @param Directory The directory to create entries in.
+
+ @param FirstIndex The index of the first entry to create.
+
+ @param EndIndex The index after the last entry to create.
+
+ @return TRUE to indicate all entries were created, FALSE if not.
+ */
+BOOLEAN
+TestSdirCreateEntries(
+    __in PYORI_STRING Directory,
+    __in DWORD FirstIndex,
+    __in DWORD EndIndex
+    )
+{
+    YORI_STRING Path;
+    LARGE_INTEGER Now;
+    FILETIME CreationTime;
+    FILETIME AccessTime;
+    FILETIME WriteTime;
+    HANDLE hFile;
+    DWORD Index;
+    DWORD Attributes;
+    BOOLEAN Result;
+
+    YoriLibInitEmptyString(&Path);
+    Now.QuadPart = YoriLibGetSystemTimeAsInteger();
+    Result = FALSE;
+
+    for (Index = FirstIndex; Index < EndIndex; Index++) {
+        if (!TestSdirEntryPath(Directory, Index, &Path)) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibYPrintf failed\n"), __FILE__, __LINE__);
+            goto Exit;
+        }
+
+        if ((Index % TEST_SDIR_DIRECTORY_INTERVAL) == 0) {
+            if (!CreateDirectory(Path.StartOfString, NULL)) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i CreateDirectory of %y failed, error %i\n"), __FILE__, __LINE__, &Path, GetLastError());
+                goto Exit;
+            }
+            continue;
+        }
+
+        Attributes = FILE_ATTRIBUTE_ARCHIVE;
+        if ((TestSdirScramble(Index, 2) % 3) == 0) {
+            Attributes = FILE_ATTRIBUTE_NORMAL;
+        }
+
+        hFile = CreateFile(Path.StartOfString, GENERIC_WRITE, 0, NULL, CREATE_NEW, Attributes, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i CreateFile of %y failed, error %i\n"), __FILE__, __LINE__, &Path, GetLastError());
+            goto Exit;
+        }
+
+        TestSdirFileTime(&Now, TestSdirScramble(Index, 3) % (366 * 24 * 60 * 60) + 2 * 366 * 24 * 60 * 60, &CreationTime);
+        TestSdirFileTime(&Now, TestSdirScramble(Index, 4) % (366 * 24 * 60 * 60), &AccessTime);
+        TestSdirFileTime(&Now, TestSdirScramble(Index, 5) % (366 * 24 * 60 * 60) + 366 * 24 * 60 * 60, &WriteTime);
+
+        SetFilePointer(hFile, TestSdirScramble(Index, 6) % 512, NULL, FILE_BEGIN);
+        if (!SetEndOfFile(hFile) ||
+            !SetFileTime(hFile, &CreationTime, &AccessTime, &WriteTime)) {
+
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i setting size or time of %y failed, error %i\n"), __FILE__, __LINE__, &Path, GetLastError());
+            CloseHandle(hFile);
+            goto Exit;
+        }
+
+        CloseHandle(hFile);
+    }
+
+    Result = TRUE;
+
+Exit:
+    YoriLibFreeStringContents(&Path);
+    return Result;
+}
+
+/**
+ Delete synthetic directory entries.
+
+ @param Directory The directory containing the entries.
+
+ @param EndIndex The index after the last entry that may have been
+        created.
+ */
+VOID
+TestSdirDeleteEntries(
+    __in PYORI_STRING Directory,
+    __in DWORD EndIndex
+    )
+{
+    YORI_STRING Path;
+    DWORD Index;
+
+    YoriLibInitEmptyString(&Path);
+
+    for (Index = 0; Index < EndIndex; Index++) {
+        if (!TestSdirEntryPath(Directory, Index, &Path)) {
+            break;
+        }
+
+        if ((Index % TEST_SDIR_DIRECTORY_INTERVAL) == 0) {
+            RemoveDirectory(Path.StartOfString);
+        } else {
+            DeleteFile(Path.StartOfString);
+        }
+    }
+
+    YoriLibFreeStringContents(&Path);
+}
+
+/**
+ List a directory with sdir, sorted by a specified key, and display the
+ rate at which entries were listed.  Output is discarded so the measurement
+ doesn't depend on the speed of the console.
+
+ @param Directory The directory to list.
+
+ @param EntryCount The number of entries in the directory.
+
+ @param SortKey The sdir sort key.
+
+ @return TRUE if sdir completed successfully, FALSE if it did not.
+ */
+BOOLEAN
+TestSdirTimeListing(
+    __in PYORI_STRING Directory,
+    __in DWORD EntryCount,
+    __in LPCTSTR SortKey
+    )
+{
+    YORI_STRING CmdLine;
+    YORI_STRING Description;
+    SECURITY_ATTRIBUTES SecurityAttributes;
+    STARTUPINFO StartupInfo;
+    PROCESS_INFORMATION ProcessInfo;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER EndTime;
+    HANDLE hNul;
+    DWORD ExitCode;
+    BOOLEAN Result;
+
+    Result = FALSE;
+    YoriLibInitEmptyString(&CmdLine);
+    YoriLibInitEmptyString(&Description);
+    ProcessInfo.hProcess = NULL;
+    ProcessInfo.hThread = NULL;
+
+    SecurityAttributes.nLength = sizeof(SecurityAttributes);
+    SecurityAttributes.lpSecurityDescriptor = NULL;
+    SecurityAttributes.bInheritHandle = TRUE;
+
+    hNul = CreateFile(_T("NUL"), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &SecurityAttributes, OPEN_EXISTING, 0, NULL);
+    if (hNul == INVALID_HANDLE_VALUE) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i CreateFile of NUL failed, error %i\n"), __FILE__, __LINE__, GetLastError());
+        return FALSE;
+    }
+
+    if (YoriLibYPrintf(&CmdLine, _T("sdir -s%s \"%y\""), SortKey, Directory) < 0 ||
+        YoriLibYPrintf(&Description, _T("%i entries, -s%s"), EntryCount, SortKey) < 0) {
+
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibYPrintf failed\n"), __FILE__, __LINE__);
+        goto Exit;
+    }
+
+    ZeroMemory(&StartupInfo, sizeof(StartupInfo));
+    StartupInfo.cb = sizeof(StartupInfo);
+    StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+    StartupInfo.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+    StartupInfo.hStdOutput = hNul;
+    StartupInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+    QueryPerformanceCounter(&StartTime);
+    if (!CreateProcess(NULL, CmdLine.StartOfString, NULL, NULL, TRUE, 0, NULL, NULL, &StartupInfo, &ProcessInfo)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i CreateProcess of %y failed, error %i\n"), __FILE__, __LINE__, &CmdLine, GetLastError());
+        ProcessInfo.hProcess = NULL;
+        ProcessInfo.hThread = NULL;
+        goto Exit;
+    }
+
+    WaitForSingleObject(ProcessInfo.hProcess, INFINITE);
+    QueryPerformanceCounter(&EndTime);
+
+    if (!GetExitCodeProcess(ProcessInfo.hProcess, &ExitCode) || ExitCode != 0) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i %y failed\n"), __FILE__, __LINE__, &CmdLine);
+        goto Exit;
+    }
+
+    TestReportRate(Description.StartOfString, EntryCount, _T("entries"), &StartTime, &EndTime);
+    Result = TRUE;
+
+Exit:
+    if (ProcessInfo.hProcess != NULL) {
+        CloseHandle(ProcessInfo.hProcess);
+    }
+    if (ProcessInfo.hThread != NULL) {
+        CloseHandle(ProcessInfo.hThread);
+    }
+    CloseHandle(hNul);
+    YoriLibFreeStringContents(&CmdLine);
+    YoriLibFreeStringContents(&Description);
+    return Result;
+}
+
+/**
+ A timed test variation to measure the rate at which sdir lists synthetic
+ directories of ten thousand, one hundred thousand, and one million entries
+ when sorting by each key that is returned from directory enumeration.
+ Entries have names, extensions, sizes, attributes and timestamps which are
+ not in creation order.  sdir is launched from the same directory as the
+ test or from the path.
+ */
+BOOLEAN
+TestSdirThroughput(VOID)
+{
+    YORI_STRING TempPath;
+    YORI_STRING Directory;
+    DWORD EntriesCreated;
+    DWORD CountIndex;
+    DWORD KeyIndex;
+    BOOLEAN Result;
+
+    YoriLibInitEmptyString(&Directory);
+    if (!YoriLibGetTempPath(&TempPath, 0)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibGetTempPath failed\n"), __FILE__, __LINE__);
+        return FALSE;
+    }
+
+    if (TempPath.LengthInChars > 0 &&
+        YoriLibIsSep(TempPath.StartOfString[TempPath.LengthInChars - 1])) {
+
+        TempPath.LengthInChars--;
+    }
+
+    if (YoriLibYPrintf(&Directory, _T("%y\\YTSTSDIR%x"), &TempPath, GetCurrentProcessId()) < 0) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibYPrintf failed\n"), __FILE__, __LINE__);
+        YoriLibFreeStringContents(&TempPath);
+        return FALSE;
+    }
+    YoriLibFreeStringContents(&TempPath);
+
+    if (!CreateDirectory(Directory.StartOfString, NULL)) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i CreateDirectory of %y failed, error %i\n"), __FILE__, __LINE__, &Directory, GetLastError());
+        YoriLibFreeStringContents(&Directory);
+        return FALSE;
+    }
+
+    Result = TRUE;
+    EntriesCreated = 0;
+
+    for (CountIndex = 0; Result && CountIndex < sizeof(TestSdirEntryCounts)/sizeof(TestSdirEntryCounts[0]); CountIndex++) {
+
+        //
+        //  Each directory is the previous one with more entries added.  If
+        //  creation fails partway, entries up to the requested count may
+        //  exist and need to be deleted.
+        //
+
+        if (!TestSdirCreateEntries(&Directory, EntriesCreated, TestSdirEntryCounts[CountIndex])) {
+            EntriesCreated = TestSdirEntryCounts[CountIndex];
+            Result = FALSE;
+            break;
+        }
+        EntriesCreated = TestSdirEntryCounts[CountIndex];
+
+        for (KeyIndex = 0; KeyIndex < sizeof(TestSdirSortKeys)/sizeof(TestSdirSortKeys[0]); KeyIndex++) {
+            if (!TestSdirTimeListing(&Directory, EntriesCreated, TestSdirSortKeys[KeyIndex])) {
+                Result = FALSE;
+                break;
+            }
+        }
+    }
+
+    TestSdirDeleteEntries(&Directory, EntriesCreated);
+    RemoveDirectory(Directory.StartOfString);
+    YoriLibFreeStringContents(&Directory);
+
+    return Result;
+}
+
+// vim:sw=4:ts=4:et:
@@ -0,0 +1,139 @@
+/**
+ * @file test/strfind.c
+ *
+ * Yori shell test substring searches
+ *
+ * Copyright (c) 2022 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include "test.h"
+
+/**
+ Strings to search for when testing multiple substring searches.  There are
+ enough strings that a state machine is used, and several are prefixes or
+ suffixes of others.
+ */
+CONST LPCTSTR TestStrFindMatches[] = {
+    _T("hers"),
+    _T("he"),
+    _T("she"),
+    _T("his"),
+    _T("ushe"),
+    _T("e"),
+    _T("rs"),
+    _T("hIs"),
+    _T("xyz"),
+    _T("sh")
+};
+
+/**
+ Strings to search through when testing multiple substring searches.
+ */
+CONST LPCTSTR TestStrFindStrings[] = {
+    _T("ushers"),
+    _T("HISTORY"),
+    _T("this is his"),
+    _T("abcd"),
+    _T("xyxyz"),
+    _T("s"),
+    _T("")
+};
+
+/**
+ A test variation to check that searching for many substrings with a state
+ machine returns the same results as comparing each substring at each
+ offset.
+ */
+BOOLEAN
+TestStrFindMultiMatch(VOID)
+{
+    YORI_STRING Matches[sizeof(TestStrFindMatches)/sizeof(TestStrFindMatches[0])];
+    YORI_LIB_MULTI_MATCH Matcher;
+    YORI_STRING String;
+    PYORI_STRING Found;
+    PYORI_STRING Expected;
+    YORI_ALLOC_SIZE_T FoundOffset;
+    YORI_ALLOC_SIZE_T ExpectedOffset;
+    YORI_ALLOC_SIZE_T Index;
+    YORI_ALLOC_SIZE_T StringIndex;
+    BOOLEAN Insensitive;
+
+    for (Index = 0; Index < sizeof(Matches)/sizeof(Matches[0]); Index++) {
+        YoriLibConstantString(&Matches[Index], TestStrFindMatches[Index]);
+    }
+
+    for (Insensitive = FALSE; Insensitive <= TRUE; Insensitive++) {
+        YoriLibInitializeMultiMatch(&Matcher, sizeof(Matches)/sizeof(Matches[0]), Matches, Insensitive);
+        if (Matcher.Automaton == NULL) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i state machine not built\n"), __FILE__, __LINE__);
+            return FALSE;
+        }
+
+        for (StringIndex = 0; StringIndex < sizeof(TestStrFindStrings)/sizeof(TestStrFindStrings[0]); StringIndex++) {
+            YoriLibConstantString(&String, TestStrFindStrings[StringIndex]);
+
+            if (Insensitive) {
+                Expected = YoriLibFindFirstMatchSubstrIns(&String, sizeof(Matches)/sizeof(Matches[0]), Matches, &ExpectedOffset);
+            } else {
+                Expected = YoriLibFindFirstMatchSubstr(&String, sizeof(Matches)/sizeof(Matches[0]), Matches, &ExpectedOffset);
+            }
+            Found = YoriLibFindFirstMultiMatch(&Matcher, &String, &FoundOffset);
+            if (Found != Expected || FoundOffset != ExpectedOffset) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i searching '%y' insensitive %i found %i at %i, expected %i at %i\n"), __FILE__, __LINE__, &String, Insensitive, Found == NULL?-1:(int)(Found - Matches), FoundOffset, Expected == NULL?-1:(int)(Expected - Matches), ExpectedOffset);
+                YoriLibCleanupMultiMatch(&Matcher);
+                return FALSE;
+            }
+
+            //
+            //  The lowest match is the first string in the array which is
+            //  found anywhere.
+            //
+
+            Expected = NULL;
+            ExpectedOffset = 0;
+            for (Index = 0; Index < sizeof(Matches)/sizeof(Matches[0]); Index++) {
+                if (Insensitive) {
+                    Expected = YoriLibFindFirstMatchSubstrIns(&String, 1, &Matches[Index], &ExpectedOffset);
+                } else {
+                    Expected = YoriLibFindFirstMatchSubstr(&String, 1, &Matches[Index], &ExpectedOffset);
+                }
+                if (Expected != NULL) {
+                    break;
+                }
+            }
+
+            Found = YoriLibFindLowestMultiMatch(&Matcher, &String, &FoundOffset);
+            if (Found != Expected || FoundOffset != ExpectedOffset) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i searching '%y' insensitive %i found lowest %i at %i, expected %i at %i\n"), __FILE__, __LINE__, &String, Insensitive, Found == NULL?-1:(int)(Found - Matches), FoundOffset, Expected == NULL?-1:(int)(Expected - Matches), ExpectedOffset);
+                YoriLibCleanupMultiMatch(&Matcher);
+                return FALSE;
+            }
+        }
+
+        YoriLibCleanupMultiMatch(&Matcher);
+    }
+
+    return TRUE;
+}
+
+// vim:sw=4:ts=4:et:
@@ -0,0 +1,335 @@
+/**
+ * @file test/strsort.c
+ *
+ * Yori shell test string sorting
+ *
+ * Copyright (c) 2022 Malcolm J. Smith
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <yoripch.h>
+#include <yorilib.h>
+#include "test.h"
+
+/**
+ The number of characters allocated for each string being sorted.
+ */
+#define TEST_STR_SORT_CHARS (6)
+
+/**
+ The number of strings to sort.  This is large enough that a parallel sort
+ will use more than one thread if the system has more than one processor.
+ */
+#define TEST_STR_SORT_COUNT (50000)
+
+/**
+ Populate an array of strings to sort.  The strings are short and use a
+ small alphabet of mixed case characters so that many of them compare equal,
+ and each string refers to a distinct location in the buffer so the original
+ order of equal strings can be determined.
+
+ @param Strings Pointer to the array of strings to populate.
+
+ @param Buffer Pointer to a buffer that contains the characters for each
+        string.
+
+ @param Order Specifies 0 to populate strings in random order, 1 to populate
+        strings in ascending order, or 2 to populate strings in descending
+        order.
+ */
+VOID
+TestStrSortPopulate(
+    __out PYORI_STRING Strings,
+    __out LPTSTR Buffer,
+    __in DWORD Order
+    )
+{
+    DWORD Index;
+    DWORD CharIndex;
+    DWORD Seed;
+    DWORD Value;
+    LPTSTR Chars;
+
+    Seed = 0x1234567;
+    for (Index = 0; Index < TEST_STR_SORT_COUNT; Index++) {
+        Chars = &Buffer[Index * TEST_STR_SORT_CHARS];
+        if (Order == 0) {
+            Seed = Seed * 1103515245 + 12345;
+            Value = Seed >> 8;
+        } else if (Order == 1) {
+            Value = Index;
+        } else {
+            Value = TEST_STR_SORT_COUNT - Index;
+        }
+
+        //
+        //  Generate the most significant character first so that ascending
+        //  values produce ascending strings.  Alternate case based on the
+        //  index so that strings which differ only in case are generated.
+        //
+
+        for (CharIndex = TEST_STR_SORT_CHARS; CharIndex > 0; CharIndex--) {
+            Chars[CharIndex - 1] = (TCHAR)('a' + (Value % 4));
+            if (((Index >> CharIndex) & 1) != 0) {
+                Chars[CharIndex - 1] = YoriLibUpcaseChar(Chars[CharIndex - 1]);
+            }
+            Value = Value / 4;
+        }
+
+        YoriLibInitEmptyString(&Strings[Index]);
+        Strings[Index].StartOfString = Chars;
+        Strings[Index].LengthInChars = TEST_STR_SORT_CHARS - (Index % 3);
+    }
+}
+
+/**
+ Check that an array of strings is sorted.
+
+ @param Strings Pointer to the array of strings to check.
+
+ @param Stable If TRUE, strings that compare equal must be in the order that
+        they were populated in, which is the order of their location in the
+        buffer.
+
+ @return TRUE if the array is sorted, FALSE if it is not.
+ */
+BOOLEAN
+TestStrSortCheck(
+    __in PYORI_STRING Strings,
+    __in BOOLEAN Stable
+    )
+{
+    DWORD Index;
+    int Result;
+
+    for (Index = 1; Index < TEST_STR_SORT_COUNT; Index++) {
+        Result = YoriLibCompareStringIns(&Strings[Index - 1], &Strings[Index]);
+        if (Result > 0) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i string %i '%y' sorted before '%y'\n"), __FILE__, __LINE__, Index, &Strings[Index - 1], &Strings[Index]);
+            return FALSE;
+        }
+
+        if (Result == 0 &&
+            Stable &&
+            Strings[Index - 1].StartOfString > Strings[Index].StartOfString) {
+
+            YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i string %i '%y' is out of original order\n"), __FILE__, __LINE__, Index, &Strings[Index]);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ A test variation to sort arrays of strings in random, ascending and
+ descending order, using each combination of stable and parallel sorting.
+ */
+BOOLEAN
+TestStrSortStringArray(VOID)
+{
+    PYORI_STRING Strings;
+    LPTSTR Buffer;
+    DWORD Order;
+    DWORD Flags;
+    BOOLEAN Result;
+
+    Strings = YoriLibMalloc(TEST_STR_SORT_COUNT * sizeof(YORI_STRING));
+    Buffer = YoriLibMalloc(TEST_STR_SORT_COUNT * TEST_STR_SORT_CHARS * sizeof(TCHAR));
+    if (Strings == NULL || Buffer == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibMalloc failed\n"), __FILE__, __LINE__);
+        if (Strings != NULL) {
+            YoriLibFree(Strings);
+        }
+        if (Buffer != NULL) {
+            YoriLibFree(Buffer);
+        }
+        return FALSE;
+    }
+
+    Result = TRUE;
+    for (Order = 0; Result && Order < 3; Order++) {
+        for (Flags = 0; Flags <= (YORI_LIB_SORT_STABLE | YORI_LIB_SORT_PARALLEL); Flags++) {
+            TestStrSortPopulate(Strings, Buffer, Order);
+            YoriLibSortStringArrayEx(Strings, TEST_STR_SORT_COUNT, Flags);
+            if (!TestStrSortCheck(Strings, (BOOLEAN)((Flags & YORI_LIB_SORT_STABLE) != 0))) {
+                YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i sort failed with order %i flags %x\n"), __FILE__, __LINE__, Order, Flags);
+                Result = FALSE;
+                break;
+            }
+        }
+    }
+
+    YoriLibFree(Strings);
+    YoriLibFree(Buffer);
+    return Result;
+}
+
+/**
+ The number of characters in each string sorted when measuring sort
+ throughput.  This is longer than the sort key so that comparisons of
+ strings with a common prefix are measured.
+ */
+#define TEST_STR_SORT_TIMED_CHARS (12)
+
+/**
+ The number of strings sorted when measuring sort throughput.
+ */
+#define TEST_STR_SORT_TIMED_COUNT (1000000)
+
+/**
+ Descriptions of each order of input, indexed by the Order parameter to
+ TestStrSortPopulateTimed.
+ */
+CONST LPCTSTR TestStrSortOrderNames[] = {
+    _T("random"),
+    _T("sorted"),
+    _T("reverse sorted")
+};
+
+/**
+ Descriptions of each combination of sort flags, indexed by the flags.
+ */
+CONST LPCTSTR TestStrSortFlagNames[] = {
+    _T("unstable"),
+    _T("stable"),
+    _T("parallel unstable"),
+    _T("parallel stable")
+};
+
+/**
+ Populate an array of distinct strings of equal length to measure sort
+ throughput.
+
+ @param Strings Pointer to the array of strings to populate.
+
+ @param Buffer Pointer to a buffer that contains the characters for each
+        string.
+
+ @param Order Specifies 0 to populate strings in random order, 1 to populate
+        strings in ascending order, or 2 to populate strings in descending
+        order.
+ */
+VOID
+TestStrSortPopulateTimed(
+    __out PYORI_STRING Strings,
+    __out LPTSTR Buffer,
+    __in DWORD Order
+    )
+{
+    DWORD Index;
+    DWORD CharIndex;
+    DWORD Seed;
+    DWORD Value;
+    LPTSTR Chars;
+
+    Seed = 0x1234567;
+    for (Index = 0; Index < TEST_STR_SORT_TIMED_COUNT; Index++) {
+        Chars = &Buffer[Index * TEST_STR_SORT_TIMED_CHARS];
+        if (Order == 0) {
+            Seed = Seed * 1103515245 + 12345;
+            Value = Seed;
+        } else if (Order == 1) {
+            Value = Index;
+        } else {
+            Value = TEST_STR_SORT_TIMED_COUNT - Index;
+        }
+
+        for (CharIndex = TEST_STR_SORT_TIMED_CHARS; CharIndex > 0; CharIndex--) {
+            Chars[CharIndex - 1] = (TCHAR)('a' + (Value % 26));
+            Value = Value / 26;
+        }
+
+        YoriLibInitEmptyString(&Strings[Index]);
+        Strings[Index].StartOfString = Chars;
+        Strings[Index].LengthInChars = TEST_STR_SORT_TIMED_CHARS;
+    }
+}
+
+/**
+ A timed test variation to measure the rate at which arrays of strings are
+ sorted when they are in random, ascending and descending order, using each
+ combination of stable and parallel sorting.
+ */
+BOOLEAN
+TestStrSortThroughput(VOID)
+{
+    PYORI_STRING Strings;
+    LPTSTR Buffer;
+    YORI_STRING Description;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER EndTime;
+    DWORD Order;
+    DWORD Flags;
+    DWORD Index;
+    BOOLEAN Result;
+
+    Strings = YoriLibMalloc(TEST_STR_SORT_TIMED_COUNT * sizeof(YORI_STRING));
+    Buffer = YoriLibMalloc(TEST_STR_SORT_TIMED_COUNT * TEST_STR_SORT_TIMED_CHARS * sizeof(TCHAR));
+    if (Strings == NULL || Buffer == NULL) {
+        YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i YoriLibMalloc failed\n"), __FILE__, __LINE__);
+        if (Strings != NULL) {
+            YoriLibFree(Strings);
+        }
+        if (Buffer != NULL) {
+            YoriLibFree(Buffer);
+        }
+        return FALSE;
+    }
+
+    YoriLibInitEmptyString(&Description);
+    Result = TRUE;
+    for (Order = 0; Result && Order < 3; Order++) {
+        for (Flags = 0; Flags <= (YORI_LIB_SORT_STABLE | YORI_LIB_SORT_PARALLEL); Flags++) {
+            TestStrSortPopulateTimed(Strings, Buffer, Order);
+
+            QueryPerformanceCounter(&StartTime);
+            YoriLibSortStringArrayEx(Strings, TEST_STR_SORT_TIMED_COUNT, Flags);
+            QueryPerformanceCounter(&EndTime);
+
+            for (Index = 1; Index < TEST_STR_SORT_TIMED_COUNT; Index++) {
+                if (YoriLibCompareStringIns(&Strings[Index - 1], &Strings[Index]) > 0) {
+                    YoriLibOutput(YORI_LIB_OUTPUT_STDERR, _T("%hs:%i string %i '%y' sorted before '%y' with order %i flags %x\n"), __FILE__, __LINE__, Index, &Strings[Index - 1], &Strings[Index], Order, Flags);
+                    Result = FALSE;
+                    break;
+                }
+            }
+
+            if (!Result) {
+                break;
+            }
+
+            if (YoriLibYPrintf(&Description, _T("%s, %s"), TestStrSortOrderNames[Order], TestStrSortFlagNames[Flags]) < 0) {
+                Result = FALSE;
+                break;
+            }
+
+            TestReportRate(Description.StartOfString, TEST_STR_SORT_TIMED_COUNT, _T("strings"), &StartTime, &EndTime);
+        }
+    }
+
+    YoriLibFreeStringContents(&Description);
+    YoriLibFree(Strings);
+    YoriLibFree(Buffer);
+    return Result;
+}
+
+// vim:sw=4:ts=4:et:
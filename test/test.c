@@ -41,6 +41,8 @@ CHAR strTestHelpText[] =
         "   -v             Variation to include\n"
         "   -x             Variation to exclude\n"
         "\n"
+        "Timed variations measure throughput and only run when included with -v.\n"
+        "\n"
         "Supported variations:\n";
 
 /**
@@ -58,6 +60,12 @@ typedef struct _TEST_VARIATION {
      */
     LPCTSTR Name;
 
+    /**
+     If TRUE, the variation measures performance rather than correctness, so
+     it only executes when explicitly specified.
+     */
+    BOOLEAN Timed;
+
     /**
      If TRUE, the execution status of this variation was set explicitly via
      command line parameter.  If FALSE, default execution should apply.
@@ -93,8 +101,129 @@ TEST_VARIATION TestVariations[] = {
     {TestArgOneArgEnclosedInQuotesCmd,     _T("ArgOneArgEnclosedInQuotesCmd")},
     {TestArgRedirectWithEndingQuoteCmd,    _T("ArgRedirectWithEndingQuoteCmd")},
     {TestArgBackslashEscapeCmd,            _T("ArgBackslashEscapeCmd")},
+    {TestArenaAlloc,                       _T("ArenaAlloc")},
+    {TestHashGrow,                         _T("HashGrow")},
+    {TestHashThroughput,                   _T("HashThroughput"), TRUE},
+    {TestLineReadMixedEndings,             _T("LineReadMixedEndings")},
+    {TestLineReadBatch,                    _T("LineReadBatch")},
+    {TestLineReadThroughput,               _T("LineReadThroughput"), TRUE},
+    {TestStrFindMultiMatch,                _T("StrFindMultiMatch")},
+    {TestStrSortStringArray,               _T("StrSortStringArray")},
+    {TestStrSortThroughput,                _T("StrSortThroughput"), TRUE},
+    {TestPoolAlloc,                        _T("PoolAlloc")},
+    {TestIconvUtf8ToUtf16,                 _T("IconvUtf8ToUtf16")},
+    {TestIconvUtf16ToUtf8,                 _T("IconvUtf16ToUtf8")},
+    {TestIconvRoundTrip,                   _T("IconvRoundTrip")},
+    {TestIconvThroughput,                  _T("IconvThroughput"), TRUE},
+    {TestCmdBufPump,                       _T("CmdBufPump")},
+    {TestSdirThroughput,                   _T("SdirThroughput"), TRUE},
+    {TestCmdBufPumpThroughput,             _T("CmdBufPumpThroughput"), TRUE},
 };
 
+/**
+ Return the number of microseconds between two performance counter values.
+
+ @param StartTime The performance counter value when the operation started.
+
+ @param EndTime The performance counter value when the operation completed.
+
+ @return The number of microseconds elapsed, which is at least one.
+ */
+DWORDLONG
+TestElapsedMicroseconds(
+    __in PLARGE_INTEGER StartTime,
+    __in PLARGE_INTEGER EndTime
+    )
+{
+    LARGE_INTEGER Frequency;
+    DWORDLONG Elapsed;
+
+    Elapsed = 0;
+    if (QueryPerformanceFrequency(&Frequency) &&
+        Frequency.QuadPart > 0 &&
+        EndTime->QuadPart > StartTime->QuadPart) {
+
+        Elapsed = (DWORDLONG)(EndTime->QuadPart - StartTime->QuadPart);
+        Elapsed = Elapsed * 1000 * 1000 / (DWORDLONG)Frequency.QuadPart;
+    }
+
+    if (Elapsed == 0) {
+        Elapsed = 1;
+    }
+
+    return Elapsed;
+}
+
+/**
+ Display the rate at which a timed variation processed data.
+
+ @param Description A short description of the measurement.
+
+ @param Bytes The number of bytes processed.
+
+ @param StartTime The performance counter value when processing started.
+
+ @param EndTime The performance counter value when processing completed.
+ */
+VOID
+TestReportThroughput(
+    __in LPCTSTR Description,
+    __in DWORDLONG Bytes,
+    __in PLARGE_INTEGER StartTime,
+    __in PLARGE_INTEGER EndTime
+    )
+{
+    DWORDLONG Elapsed;
+    DWORDLONG HundredthsMbPerSecond;
+
+    Elapsed = TestElapsedMicroseconds(StartTime, EndTime);
+    HundredthsMbPerSecond = Bytes * 100 * 1000 * 1000 / (Elapsed * 1024 * 1024);
+
+    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT,
+                  _T("  %s: %lli bytes in %lli us, %lli.%02i MB/s\n"),
+                  Description,
+                  Bytes,
+                  Elapsed,
+                  HundredthsMbPerSecond / 100,
+                  (int)(HundredthsMbPerSecond % 100));
+}
+
+/**
+ Display the rate at which a timed variation processed items.
+
+ @param Description A short description of the measurement.
+
+ @param Count The number of items processed.
+
+ @param Units The name of the items processed.
+
+ @param StartTime The performance counter value when processing started.
+
+ @param EndTime The performance counter value when processing completed.
+ */
+VOID
+TestReportRate(
+    __in LPCTSTR Description,
+    __in DWORDLONG Count,
+    __in LPCTSTR Units,
+    __in PLARGE_INTEGER StartTime,
+    __in PLARGE_INTEGER EndTime
+    )
+{
+    DWORDLONG Elapsed;
+
+    Elapsed = TestElapsedMicroseconds(StartTime, EndTime);
+
+    YoriLibOutput(YORI_LIB_OUTPUT_STDOUT,
+                  _T("  %s: %lli %s in %lli us, %lli %s/s\n"),
+                  Description,
+                  Count,
+                  Units,
+                  Elapsed,
+                  Count * 1000 * 1000 / Elapsed,
+                  Units);
+}
+
 
 /**
  Display usage text to the user.
@@ -109,7 +238,11 @@ TestHelp(VOID)
 #endif
     YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("%hs"), strTestHelpText);
     for (i = 0; i < sizeof(TestVariations)/sizeof(TestVariations[0]); i++) {
-        YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("    %s\n"), TestVariations[i].Name);
+        if (TestVariations[i].Timed) {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("    %s (timed)\n"), TestVariations[i].Name);
+        } else {
+            YoriLibOutput(YORI_LIB_OUTPUT_STDOUT, _T("    %s\n"), TestVariations[i].Name);
+        }
     }
     return TRUE;
 }
@@ -185,9 +318,11 @@ ymain(
 
         ExecuteVariation = FALSE;
         if (RunAll) {
-            if (!TestVariations[i].ExplicitlySpecified ||
-                TestVariations[i].Execute) {
-
+            if (TestVariations[i].ExplicitlySpecified) {
+                if (TestVariations[i].Execute) {
+                    ExecuteVariation = TRUE;
+                }
+            } else if (!TestVariations[i].Timed) {
                 ExecuteVariation = TRUE;
             }
         } else {
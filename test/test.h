@@ -125,4 +125,125 @@ YORI_TEST_FN TestArgRedirectWithEndingQuoteCmd;
  */
 YORI_TEST_FN TestArgBackslashEscapeCmd;
 
+/**
+ A test variation to allocate from an arena, check that allocations are
+ aligned and do not overlap, reset the arena and allocate again, and check
+ that strings allocated from the arena remain valid after it is cleaned up.
+ */
+YORI_TEST_FN TestArenaAlloc;
+
+/**
+ A test variation to insert many entries into a small hash table so it is
+ resized, and check that every entry can be found, enumerated and removed.
+ */
+YORI_TEST_FN TestHashGrow;
+
+/**
+ A timed test variation to measure the rate at which a key set shaped like
+ ymake's table of targets is inserted, looked up and removed.
+ */
+YORI_TEST_FN TestHashThroughput;
+
+/**
+ A test variation to read lines with mixed line endings one at a time.
+ */
+YORI_TEST_FN TestLineReadMixedEndings;
+
+/**
+ A test variation to read lines with mixed line endings as a batch.
+ */
+YORI_TEST_FN TestLineReadBatch;
+
+/**
+ A timed test variation to measure the rate at which lines are read from
+ files encoded as 8 bit text, UTF8 and UTF16.
+ */
+YORI_TEST_FN TestLineReadThroughput;
+
+/**
+ A test variation to check that searching for many substrings with a state
+ machine returns the same results as comparing each substring at each
+ offset.
+ */
+YORI_TEST_FN TestStrFindMultiMatch;
+
+/**
+ A test variation to sort arrays of strings in random, ascending and
+ descending order, using each combination of stable and parallel sorting.
+ */
+YORI_TEST_FN TestStrSortStringArray;
+
+/**
+ A timed test variation to measure the rate at which arrays of strings in
+ random, ascending and descending order are sorted.
+ */
+YORI_TEST_FN TestStrSortThroughput;
+
+/**
+ A test variation to allocate elements from a pool, check that they do not
+ overlap, check that freed elements are reused, check that elements of a
+ different size are rejected, and allocate from several threads at once.
+ */
+YORI_TEST_FN TestPoolAlloc;
+
+/**
+ A test variation to convert valid and invalid UTF8 sequences into UTF16 at
+ each alignment.
+ */
+YORI_TEST_FN TestIconvUtf8ToUtf16;
+
+/**
+ A test variation to convert UTF16 containing lone surrogates into UTF8.
+ */
+YORI_TEST_FN TestIconvUtf16ToUtf8;
+
+/**
+ A test variation to convert every Unicode scalar value from UTF16 to UTF8
+ and back.
+ */
+YORI_TEST_FN TestIconvRoundTrip;
+
+/**
+ A timed test variation to measure the rate at which text is converted
+ between UTF8 and UTF16, compared to the Windows conversion APIs.
+ */
+YORI_TEST_FN TestIconvThroughput;
+
+/**
+ A test variation to capture output from a fast producer into a process
+ buffer which spills to disk while mirroring it to a pipe, and check that
+ all data arrives in order.
+ */
+YORI_TEST_FN TestCmdBufPump;
+
+/**
+ A timed test variation to measure the rate at which output from a fast
+ producer is captured into a process buffer.
+ */
+YORI_TEST_FN TestCmdBufPumpThroughput;
+
+/**
+ A timed test variation to measure the rate at which sdir lists synthetic
+ directories of ten thousand, one hundred thousand and one million entries
+ sorted by each key.
+ */
+YORI_TEST_FN TestSdirThroughput;
+
+VOID
+TestReportThroughput(
+    __in LPCTSTR Description,
+    __in DWORDLONG Bytes,
+    __in PLARGE_INTEGER StartTime,
+    __in PLARGE_INTEGER EndTime
+    );
+
+VOID
+TestReportRate(
+    __in LPCTSTR Description,
+    __in DWORDLONG Count,
+    __in LPCTSTR Units,
+    __in PLARGE_INTEGER StartTime,
+    __in PLARGE_INTEGER EndTime
+    );
+
 // vim:sw=4:ts=4:et: